@@ -693,7 +693,12 @@ Example:
 
         void computeMissingTangents(const Array<Mesh*> affectedMeshes);
 
-        void mergeVertices(const Array<Face>& faceArray, float maxNormalWeldAngle, const Array<Mesh*> affectedMeshes);
+        /** Welds face vertices that match in position, texture coordinates, and normal (to within
+            \a maxNormalWeldAngle), rebuilding cpuVertexArray and the index arrays of \a affectedMeshes.
+
+            \param serial If true, uses the single-threaded hash table reference implementation
+            instead of the parallel sort-based one. Both produce identical output. */
+        void mergeVertices(const Array<Face>& faceArray, float maxNormalWeldAngle, const Array<Mesh*> affectedMeshes, bool serial = false);
 
         void getAffectedMeshes(const Array<Mesh*>& fullMeshArray, Array<Mesh*>& affectedMeshes);
 
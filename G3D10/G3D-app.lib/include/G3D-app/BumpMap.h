@@ -138,6 +138,11 @@ public:
         m_normalBump->setStorage(s);
     }
 
+    /** \sa Texture::setLoadingPriority */
+    inline void setLoadingPriority(bool visible, float projectedScreenArea) const {
+        m_normalBump->setLoadingPriority(visible, projectedScreenArea);
+    }
+
 
 
      /**
@@ -16,6 +16,8 @@
 #include "G3D-base/Image3.h"
 #include "G3D-base/Image4.h"
 #include "G3D-gfx/Texture.h"
+#include "G3D-app/TextureTileCache.h"
+#include <mutex>
 
 namespace G3D {
 
@@ -91,6 +93,10 @@ protected:
     mutable typename Image::StorageType     m_max;
     mutable typename Image::ComputeType     m_mean;
 
+    /** Registration with TextureTileCache::global(), created on first use */
+    mutable std::once_flag                  m_cacheSourceOnce;
+    mutable shared_ptr<TextureTileCache::Source> m_cacheSource;
+
     static void getTexture(const shared_ptr<Image>& im, shared_ptr<Texture>& tex) {
             
         Texture::Dimension dim;
@@ -119,6 +125,18 @@ protected:
         v.value = c.r;
     }
 
+    static Color4 toColor4(const Color1& c) {
+        return Color4(c.value, c.value, c.value, 1.0f);
+    }
+
+    static Color4 toColor4(const Color3& c) {
+        return Color4(c, 1.0f);
+    }
+
+    static Color4 toColor4(const Color4& c) {
+        return c;
+    }
+
     MapComponent(const class shared_ptr<Image>& im, const shared_ptr<Texture>& tex) : 
         m_cpuImage(im),
         m_gpuImage(tex),
@@ -242,6 +260,33 @@ public:
         return m_gpuImage;
     }
 
+    /** The CPU image registered with TextureTileCache::global(), synthesizing the image if
+        necessary. Threadsafe. */
+    TextureTileCache::Source& cacheSource() const {
+        std::call_once(m_cacheSourceOnce, [this]() {
+            // The cache keeps the image alive until this component releases the source
+            const shared_ptr<Image> im = image();
+            m_cacheSource = TextureTileCache::global()->addSource(im->width(), im->height(), im->wrapMode(),
+                [im](int x0, int y0, int width, int height, Color4* dst) {
+                    const typename Image::StorageType* src = im->getCArray();
+                    for (int y = 0; y < height; ++y) {
+                        for (int x = 0; x < width; ++x) {
+                            dst[x + y * width] = toColor4(src[(x0 + x) + (y0 + y) * im->width()]);
+                        }
+                    }
+                });
+        });
+        return *m_cacheSource;
+    }
+
+    /** Forwards to Texture::setLoadingPriority. Does not create the texture if only the
+        image is present. */
+    void setLoadingPriority(bool visible, float projectedScreenArea) const {
+        if (notNull(m_gpuImage)) {
+            m_gpuImage->setLoadingPriority(visible, projectedScreenArea);
+        }
+    }
+
     void setStorage(ImageStorage s) const {
         MyType* me = const_cast<MyType*>(this);
         switch (s) {
@@ -328,6 +373,16 @@ private:
         return c.a;
     }
 
+    static void fromColor4(const Color4& c, Color1& v) {
+        v.value = c.r;
+    }
+    static void fromColor4(const Color4& c, Color3& v) {
+        v = c.rgb();
+    }
+    static void fromColor4(const Color4& c, Color4& v) {
+        v = c;
+    }
+
 
 public:
         
@@ -378,6 +433,32 @@ public:
         return handleTextureEncoding(im->bilinear(pos * Vector2(float(im->width()), float(im->height()))), m_map->texture());
     }
 
+    /** Samples the MIP level whose texels are about \a texCoordFootprint wide (in normalized
+        texture coordinates) through TextureTileCache::global(), which filters and caches tiles of
+        the image so that rays with wide footprints read little memory. Falls back to sample(pos)
+        when the footprint is not positive or the cache has no memory budget.
+
+        Texel centers are where sample(pos) puts them, so the two agree at MIP level 0. */
+    Color sample(const Vector2& pos, float texCoordFootprint) const {
+        if (isNull(m_map)) {
+            return Color::zero();
+        }
+
+        const shared_ptr<TextureTileCache>& cache = TextureTileCache::global();
+        if ((texCoordFootprint <= 0.0f) || ! cache->enabled()) {
+            return sample(pos);
+        }
+
+        TextureTileCache::Source& source = m_map->cacheSource();
+
+        // sample(pos) centers texels at integer multiples of the texel size, and the cache
+        // centers them half a texel later, as on the GPU
+        const Vector2 halfTexel(0.5f / float(source.width()), 0.5f / float(source.height()));
+        Color c;
+        fromColor4(cache->sample(source, pos + halfTexel, source.levelForFootprint(texCoordFootprint)), c);
+        return handleTextureEncoding(c, m_map->texture());
+    }
+
     /** Largest value per color channel */
     inline const Color& max() const {
         computeStats();
@@ -413,6 +494,11 @@ public:
         if (notNull(m_map)) { m_map->setStorage(s); }
     }
 
+    /** \sa Texture::setLoadingPriority */
+    inline void setLoadingPriority(bool visible, float projectedScreenArea) const {
+        if (notNull(m_map)) { m_map->setLoadingPriority(visible, projectedScreenArea); }
+    }
+
     /** Says nothing about the alpha channel */
     inline bool notBlack() const {
         return ! isBlack();
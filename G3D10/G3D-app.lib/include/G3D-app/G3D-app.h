@@ -16,6 +16,7 @@
 #include "G3D-app/TriTree.h"
 #include "G3D-app/TriTreeBase.h"
 #include "G3D-app/NativeTriTree.h"
+#include "G3D-app/InstancedTriTree.h"
 #include "G3D-app/EmbreeTriTree.h"
 #include "G3D-app/OptiXTriTree.h"
 #include "G3D-app/GFont.h"
@@ -81,6 +82,8 @@
 #include "G3D-app/Entity.h"
 #include "G3D-app/FontModel.h"
 #include "G3D-app/VoxelModel.h"
+#include "G3D-app/VoxelOctree.h"
+#include "G3D-app/PointLODOctree.h"
 #include "G3D-app/PointModel.h"
 #include "G3D-app/ArticulatedModel.h"
 #include "G3D-app/PhysicsFrameSplineEditor.h"
@@ -110,6 +113,8 @@
 #include "G3D-app/Renderer.h"
 #include "G3D-app/TemporalFilter.h"
 #include "G3D-app/BilateralFilter.h"
+#include "G3D-app/LightTree.h"
+#include "G3D-app/TextureTileCache.h"
 #include "G3D-app/PathTracer.h"
 #include "G3D-app/FogVolumeSurface.h"
 #include "G3D-app/VRApp.h"
@@ -28,7 +28,9 @@
 #include "G3D-app/GBuffer.h"
 #include "G3D-app/debugDraw.h"
 #include "G3D-app/ArticulatedModelSpecificationEditorDialog.h"
+#include <condition_variable>
 #include <mutex>
+#include <thread>
 
 namespace G3D {
 
@@ -81,6 +83,8 @@ class XRWidget;
  onWait runs before onGraphics because the beginning of onGraphics causes the CPU to block, waiting for the GPU
  to complete the previous frame.
 
+ GApp::setFrameLoopMode can instead overlap simulation with rendering on two threads, or run without rendering for servers.
+
  When you override a method, invoke the GApp version of that method to ensure that Widget%s still work
  properly.  This allows you to control whether your per-app operations occur before or after the Widget ones.
 
@@ -111,6 +115,12 @@ public:
         BALANCE,
         MINIMIZE_LATENCY);
 
+    // See documentation on setFrameLoopMode
+    G3D_DECLARE_ENUM_CLASS(FrameLoopMode,
+        SEQUENTIAL,
+        PIPELINED,
+        HEADLESS);
+
     // See documentation on setSubmitToDisplayMode
     G3D_DECLARE_ENUM_CLASS(DebugVRMirrorMode,
         NONE,
@@ -418,6 +428,9 @@ public:
     /** Labels to be rendered each frame, updated at the same times as debugShapeArray */
     Array<DebugLabel>    debugLabelArray;
 
+    /** Protects debugShapeArray and debugLabelArray, which the simulation may add to from another thread in FrameLoopMode::PIPELINED */
+    std::mutex           m_debugShapeMutex;
+
     /** \brief Draw everything in debugShapeArray.
 
         Subclasses should call from onGraphics3D() or onGraphics().
@@ -458,6 +471,94 @@ private:
 
     SubmitToDisplayMode             m_submitToDisplayMode;
 
+    FrameLoopMode                   m_frameLoopMode;
+
+    /** Set by setFrameLoopMode and applied at the start of the next oneFrame, so that a frame never changes modes partway through */
+    FrameLoopMode                   m_nextFrameLoopMode;
+
+    /** Thread that invokes onRun. activeCamera() returns m_pipelinedCamera on this thread while rendering in PIPELINED mode. */
+    std::thread::id                 m_mainThreadId;
+
+    /** True while the main thread renders in PIPELINED mode */
+    bool                            m_renderingPipelined;
+
+    /** Copy of the active camera, made after posing, that onGraphics renders from in PIPELINED mode while the simulation moves the real one */
+    shared_ptr<Camera>              m_pipelinedCamera;
+
+    /** Copies of the clocks, made with m_pipelinedCamera, that the main thread reads while the simulation advances the real ones */
+    float                           m_pipelinedPreviousSimTimeStep;
+    float                           m_pipelinedPreviousRealTimeStep;
+    RealTime                        m_pipelinedRealTime;
+    SimTime                         m_pipelinedSimTime;
+
+    /** Copy of the scene's lighting environment, made with m_pipelinedCamera, whose lights are Light::snapshot()s */
+    LightingEnvironment             m_pipelinedLightingEnvironment;
+
+    /** The scene editor's selection, copied with m_pipelinedCamera */
+    shared_ptr<Entity>              m_pipelinedSelectedEntity;
+
+    /** True on the main thread while it renders in PIPELINED mode, when the accessors return the copies above */
+    bool renderingPipelinedOnThisThread() const {
+        return (std::this_thread::get_id() == m_mainThreadId) && m_renderingPipelined;
+    }
+
+    /** Back buffers for m_posed3D and m_posed2D in PIPELINED mode */
+    Array<shared_ptr<Surface> >     m_nextPosed3D;
+    Array<shared_ptr<Surface2D> >   m_nextPosed2D;
+
+    /** Runs the simulation in PIPELINED mode. Started on the first pipelined frame. */
+    std::thread                     m_simulationThread;
+    std::mutex                      m_simulationMutex;
+    std::condition_variable         m_simulationCondition;
+
+    /** Protected by m_simulationMutex */
+    bool                            m_simulationPending;
+    bool                            m_simulationThreadQuit;
+    RealTime                        m_simulationTimeStep;
+
+    /** Timed on the simulation thread and copied to m_simulationWatch at the sync point, so that the
+        developer HUD never reads a Stopwatch while it is being written */
+    Stopwatch                       m_pipelinedSimulationWatch;
+
+    /** Elapsed real time since the previous frame. Updates m_now and m_lastTime. */
+    RealTime advanceFrameTime();
+
+    /** onAfterEvents and onUserInput, with the event queue and gaze tracker */
+    void userInputStage();
+
+    /** The real, simulation, and ideal time steps passed to the simulation handlers for a frame that took \a timeStep */
+    void simulationTimeSteps(RealTime timeStep, RealTime& rdt, SimTime& sdt, SimTime& idt) const;
+
+    /** onBeforeSimulation, onSimulation and onAfterSimulation, then advances the clocks */
+    void simulationStage(RealTime timeStep, Stopwatch& watch);
+
+    /** The part of the default onSimulation that moves the widgets and the debug camera */
+    void simulateWidgetsAndDebugCamera(RealTime rdt, SimTime sdt, SimTime idt);
+
+    void poseStage(Array<shared_ptr<Surface> >& posed3D, Array<shared_ptr<Surface2D> >& posed2D);
+
+    /** Sleeps until the target frame time */
+    void waitStage();
+
+    void graphicsStage();
+
+    /** Expires debug shapes and labels */
+    void endFrameStage();
+
+    void oneFramePipelined();
+    void oneFrameHeadless();
+
+    void simulationThreadMain();
+
+    /** Blocks until the simulation thread is idle */
+    void waitForPipelinedSimulation();
+
+    /** Sync point for PIPELINED mode: blocks until the simulation started by the previous frame has finished */
+    void finishPipelinedSimulation();
+
+    /** Joins m_simulationThread */
+    void stopPipelinedSimulation();
+
 protected:
 
     /** The low-level XR API. VRApp mostly communicates through an XRWidget that
@@ -473,6 +574,10 @@ protected:
     Stopwatch                       m_simulationWatch;
     Stopwatch                       m_waitWatch;
 
+    /** In FrameLoopMode::PIPELINED, the time that the main thread was blocked at the sync point waiting for
+        the simulation thread. The simulation time hidden behind rendering is simulationWatch() minus this. */
+    Stopwatch                       m_pipelineStallWatch;
+
     /** The original settings */
     Settings                        m_settings;
 
@@ -502,6 +607,10 @@ protected:
     */
     Array<String>                   debugText;
 
+    /** screenPrintf output from the simulation thread in FrameLoopMode::PIPELINED, which is moved
+        to debugText at the next sync point. Protected by m_debugTextMutex. */
+    Array<String>                   m_pipelinedDebugText;
+
     Color4                          m_debugTextColor;
     Color4                          m_debugTextOutlineColor;
 
@@ -670,6 +779,47 @@ protected:
         return m_submitToDisplayMode;
     }
 
+    /** Defaults to FrameLoopMode::SEQUENTIAL.
+
+        FrameLoopMode::SEQUENTIAL invokes every event handler in order on the main thread, as described
+        in the GApp class documentation.
+
+        FrameLoopMode::PIPELINED overlaps the simulation of frame N + 1 with the rendering of frame N.
+        Each frame begins with a sync point that waits for the previous frame's simulation, then processes
+        events, onUserInput, onAI, and onNetwork, poses the scene into a back buffer that becomes m_posed3D
+        and m_posed2D, and finally starts onBeforeSimulation, onSimulation, and onAfterSimulation on a
+        separate thread while onWait and onGraphics run on the main thread. Rendering therefore shows the
+        state from before the most recent input, which adds one frame of latency in exchange for
+        hiding the simulation time. With a render period greater than one, the extra simulation steps
+        all run on the simulation thread and events are processed once per frame.
+
+        The default onSimulation simulates the Scene on the simulation thread. GApp simulates the widgets
+        and the debug camera on the main thread before starting that thread, because the posed Surface2D%s
+        draw the live widgets. At that point it also copies what the default onGraphics3D reads besides the
+        posed surfaces, and while rendering activeCamera(), lightingEnvironment(), selectedEntity(),
+        realTime(), simTime(), previousSimTimeStep(), and previousRealTimeStep() return the copies. The
+        lights in the copy are Light::snapshot()s. Scene visualizations other than wireframe read the
+        Entity%s themselves, so when they are enabled or an Entity is selected, the default onGraphics3D
+        waits for the simulation before drawing them, and they show the state one frame ahead of the surfaces.
+        An application's own onSimulation and onGraphics must follow the same rule: rendering may read
+        simulated state only through the posed surfaces or copies made in onPose, which runs on the main
+        thread while the simulation is stopped. GUI controls bound directly to Entity properties may show
+        values from the simulation in progress. debugDraw and screenPrintf are safe to call from the simulation.
+        
+        FrameLoopMode::HEADLESS runs events, onAI, onNetwork, and simulation at the target frame rate
+        without posing or rendering, for servers that run with a hidden window.
+
+        The new mode takes effect at the start of the next frame, so this may be called from any handler
+        on the main thread.
+
+        \sa pipelineStallWatch
+    */
+    void setFrameLoopMode(FrameLoopMode m);
+
+    FrameLoopMode frameLoopMode() const {
+        return m_frameLoopMode;
+    }
+
 public:
 
     const GazeTracker::Gaze& gazeForEye(int eye) const {
@@ -725,7 +875,7 @@ public:
         \sa activeListener
     */
     virtual const shared_ptr<Camera>& activeCamera() const {
-        return m_activeCamera;
+        return renderingPipelinedOnThisThread() ? m_pipelinedCamera : m_activeCamera;
     }
 
     /** Exposes the debugging camera */
@@ -766,6 +916,16 @@ public:
 
     virtual const SceneVisualizationSettings& sceneVisualizationSettings() const;
 
+    /** The scene's lighting environment. While rendering in FrameLoopMode::PIPELINED, a copy made at the
+        sync point whose lights are Light::snapshot()s, because the simulation thread moves the originals.
+        Renderers invoked from onGraphics should read this instead of scene()->lightingEnvironment().
+        Requires scene() to be non-null. */
+    const LightingEnvironment& lightingEnvironment() const;
+
+    /** The Entity selected in the scene editor, or nullptr. While rendering in FrameLoopMode::PIPELINED,
+        the selection at the sync point. */
+    shared_ptr<Entity> selectedEntity() const;
+
     const Settings& settings() const {
         return m_settings;
     }
@@ -802,6 +962,10 @@ public:
         return m_simulationWatch;
     }
 
+    const Stopwatch& pipelineStallWatch() const {
+        return m_pipelineStallWatch;
+    }
+
     /** Initialized to GApp::Settings::dataDir, or if that is "<AUTO>",
         to  FilePath::parent(System::currentProgramFilename()). To make your program
         distributable, override the default
@@ -1041,7 +1205,7 @@ public:
         Since this time is accumulated, it may drift from the true
         wall-clock obtained by System::time().*/
     RealTime realTime() const {
-        return m_realTime;
+        return renderingPipelinedOnThisThread() ? m_pipelinedRealTime : m_realTime;
     }
 
     virtual void setRealTime(RealTime r);
@@ -1051,7 +1215,7 @@ public:
         after ooSimulation.
     */
     SimTime simTime() const {
-        return m_simTime;
+        return renderingPipelinedOnThisThread() ? m_pipelinedSimTime : m_simTime;
     }
 
     virtual void setSimTime(SimTime s);
@@ -1115,12 +1279,12 @@ public:
     /** A non-negative number that is the amount that time is was advanced by in the previous frame.  Never an enum value.
         For the first frame, this is the amount that time will be advanced by if rendering runs at speed. */
     SimTime previousSimTimeStep() const {
-        return m_previousSimTimeStep;
+        return renderingPipelinedOnThisThread() ? m_pipelinedPreviousSimTimeStep : m_previousSimTimeStep;
     }
 
     /** Actual wall-clock time elapsed between the previous two frames. \sa realTimeTargetDuration */
     RealTime previousRealTimeStep() const {
-        return m_previousRealTimeStep;
+        return renderingPipelinedOnThisThread() ? m_pipelinedPreviousRealTimeStep : m_previousRealTimeStep;
     }
 
     /**
@@ -1196,6 +1360,9 @@ protected:
        desiredFrameDuration * simTimeRate, no matter how much wall-clock
        time has elapsed.
 
+       Must be overridden, without calling the default implementation, in
+       FrameLoopMode::PIPELINED. See setFrameLoopMode.
+
        \sa onBeforeSimulation, onAfterSimulation
     */
     virtual void onSimulation(RealTime rdt, SimTime sdt, SimTime idt);
@@ -13,7 +13,9 @@
 #include "G3D-base/G3DString.h"
 #include "G3D-base/BinaryInput.h"
 #include "G3D-base/CoordinateFrame.h"
+#include "G3D-base/Table.h"
 #include "G3D-gfx/Texture.h"
+#include <mutex>
 
 namespace G3D {
 
@@ -33,6 +35,13 @@ namespace G3D {
  files and rules for distribution. 
 
  You can make new fonts with the GFont::makeFont static function.
+
+ Each font keeps a cache of laid-out strings keyed by the string, size,
+ wrap width, alignment, and spacing (but not color or position), so
+ redrawing mostly-static labels every frame skips glyph lookup and word
+ wrapping.  Entries that have not been drawn recently are evicted when
+ the cache exceeds layoutCacheCapacity().  All GFont methods may be
+ called concurrently from multiple threads.
  */
 class GFont : public ReferenceCountedObject {
 public:
@@ -62,8 +71,76 @@ public:
         uniform spacing regardless of character width. */
     enum Spacing {PROPORTIONAL_SPACING, FIXED_SPACING};
 
+    /** Counters for the layout cache.  Times are in seconds.  \sa layoutCacheStats */
+    class LayoutCacheStats {
+    public:
+        /** Strings that were laid out because they were not in the cache */
+        int         layouts;
+
+        /** Strings copied from the cache */
+        int         cacheHits;
+
+        /** Entries discarded because the cache was full */
+        int         evictions;
+
+        /** Entries currently in the cache */
+        int         entries;
+
+        /** Total time spent laying out strings that missed the cache. Hits are not timed,
+            because reading the clock would cost about as much as the hit itself. */
+        RealTime    layoutTime;
+
+        LayoutCacheStats() : layouts(0), cacheHits(0), evictions(0), entries(0), layoutTime(0) {}
+    };
+
 private:
 
+    /** A string laid out at the origin.  Immutable once in the cache. */
+    class Layout {
+    public:
+        class Vertex {
+        public:
+            Vector2 texCoord;
+            Vector2 position;
+        };
+
+        /** Four vertices per glyph quad */
+        Array<Vertex>           vertexArray;
+        Vector2                 bounds;
+    };
+
+    class LayoutKey {
+    public:
+        String                  s;
+        float                   size;
+
+        /** finf() when not word wrapping */
+        float                   wrapWidth;
+        XAlign                  xalign;
+        YAlign                  yalign;
+        Spacing                 spacing;
+
+        static size_t hashCode(const LayoutKey& k) {
+            return HashTrait<String>::hashCode(k.s) ^ (size_t(superFastHash(&k.size, sizeof(float))) << 1) ^
+                size_t(superFastHash(&k.wrapWidth, sizeof(float))) ^ (size_t(k.xalign) << 2) ^ (size_t(k.yalign) << 4) ^ size_t(k.spacing);
+        }
+
+        static bool equals(const LayoutKey& a, const LayoutKey& b) {
+            return (a.size == b.size) && (a.wrapWidth == b.wrapWidth) && (a.xalign == b.xalign) &&
+                (a.yalign == b.yalign) && (a.spacing == b.spacing) && (a.s == b.s);
+        }
+    };
+
+    class LayoutEntry {
+    public:
+        shared_ptr<Layout>      layout;
+
+        /** Value of m_layoutClock when this entry was last used, for least-recently-used eviction */
+        uint64                  lastUse = 0;
+    };
+
+    typedef Table<LayoutKey, LayoutEntry, LayoutKey, LayoutKey> LayoutTable;
+
     /** Must be a power of 2.  Number of characters in the set (typically 128 or 256)*/
     int                     charsetSize;
 
@@ -100,6 +177,58 @@ private:
 
     float m_textureMatrix[16];
 
+    /** Protects all of the layout cache state below */
+    mutable std::mutex      m_layoutMutex;
+    mutable LayoutTable     m_layoutCache;
+    mutable uint64          m_layoutClock;
+    mutable LayoutCacheStats m_layoutStats;
+    int                     m_layoutCacheCapacity;
+
+    /** Lays out one line of \a s at \a pos2D without using the cache */
+    Vector2 layoutLine
+       (Array<CPUCharVertex>&       cpuCharArray,
+        Array<int>&                 indexArray,
+        const String&               s,
+        const Point2&               pos2D,
+        float                       size,
+        const Color4&               color,
+        const Color4&               outline,
+        XAlign                      xalign,
+        YAlign                      yalign,
+        Spacing                     spacing) const;
+
+    /** Lays out \a key.s at the origin without using the cache */
+    shared_ptr<Layout> computeLayout(const LayoutKey& key) const;
+
+    /** Returns the cached layout for \a key, laying it out and inserting it on a miss.
+        Updates m_layoutStats. */
+    shared_ptr<Layout> cachedLayout(const LayoutKey& key) const;
+
+    /** Removes the least-recently used half of the cache. Called with m_layoutMutex locked. */
+    void evictLayouts() const;
+
+    /** Translates and colors a cached layout onto the arrays */
+    static void appendLayout
+       (const Layout&               layout,
+        const Point2&               pos2D,
+        const Color4&               color,
+        const Color4&               outline,
+        Array<CPUCharVertex>&       cpuCharArray,
+        Array<int>&                 indexArray);
+
+    Vector2 appendCached
+       (Array<CPUCharVertex>&       cpuCharArray,
+        Array<int>&                 indexArray,
+        float                       wrapWidth,
+        const String&               s,
+        const Point2&               pos2D,
+        float                       size,
+        const Color4&               color,
+        const Color4&               outline,
+        XAlign                      xalign,
+        YAlign                      yalign,
+        Spacing                     spacing) const;
+
 public:
     
     inline String name() const {
@@ -357,7 +486,8 @@ public:
        rd->popState();
        \endcode
 
-       This amortizes the cost of the font setup across multiple calls.
+       This amortizes the cost of the font setup across multiple calls
+       and submits all of the strings in a single vertex buffer.
      */
     void renderCharVertexArray(RenderDevice* rd, const Array<CPUCharVertex>& cpuCharArray, Array<int>& indexArray) const;
 
@@ -390,6 +520,22 @@ public:
         XAlign                      xalign  = XALIGN_LEFT,
         YAlign                      yalign  = YALIGN_TOP,
         Spacing                     spacing = PROPORTIONAL_SPACING) const;
+
+    /** Maximum number of laid-out strings retained. When exceeded, the least-recently
+        drawn half is evicted. 0 disables the cache. Default is 4096. */
+    void setLayoutCacheCapacity(int capacity);
+
+    int layoutCacheCapacity() const {
+        return m_layoutCacheCapacity;
+    }
+
+    void clearLayoutCache();
+
+    /** Thread-safe snapshot of the layout cache counters */
+    LayoutCacheStats layoutCacheStats() const;
+
+    /** Zeros the counters (but not LayoutCacheStats::entries), e.g., at the start of each frame */
+    void resetLayoutCacheStats();
 };
 
 }
@@ -209,6 +209,24 @@ protected:
     /** Elevation image */
     shared_ptr<Image>           m_elevationImage;
 
+    /** One level of the elevation pyramid */
+    class ElevationBounds {
+    public:
+        /** In quads (level 0) or groups of 2^level x 2^level quads */
+        int                     width = 0;
+        int                     height = 0;
+
+        /** (minimum, maximum) elevation in meters over each group, in row-major order */
+        Array<Vector2>          minMax;
+    };
+
+    /** Level 0 bounds each quad of the mesh. Each higher level halves the resolution, up to a
+        single element. Lets intersect() skip regions that a ray passes over or under. */
+    Array<ElevationBounds>      m_elevationPyramid;
+
+    /** Elevation in meters of each mesh vertex, in row-major order with numQuads().x + 1 columns */
+    Array<float>                m_vertexElevation;
+
     HeightfieldModel(const Specification& spec, const String& name);
 
     /** Called from the constructor */
@@ -220,6 +238,26 @@ protected:
     /** This binds attribute arrays, so it cannot accept a UniformTable argument. */
     void setShaderArgs(Args& args) const;
 
+    /** Called from the constructor */
+    void buildElevationPyramid();
+
+    /** Number of quads in the mesh along x and z */
+    Vector2int32 numQuads() const;
+
+    /** Object-space corners of quad \a index, in the order (x, z), (x + 1, z), (x + 1, z + 1), (x, z + 1) */
+    void getQuadCorners(const Vector2int32& index, Point3 p[4]) const;
+
+    /** Tests the two triangles of the quad whose corners are \a p against an object-space ray.
+        Returns the distance to the nearer hit, or finf(). */
+    static float intersectQuad(const Ray& ray, const Point3 p[4], bool& hitTri0, float w[3]);
+
+    /** Finds the first quad that the object-space \a ray hits before \a maxDistance
+        by descending the elevation pyramid. On a hit, reduces \a maxDistance. */
+    bool intersectPyramid(const Ray& ray, float& maxDistance, Vector2int32& quad, bool& hitTri0, float w[3]) const;
+
+    /** Sets \a info for a hit on triangle \a tri0 or 1 of \a quad */
+    void setHitInfo(Model::HitInfo& info, const Entity* entity, const Vector2int32& quad, bool hitTri0, const float w[3], const Point3& point, const Vector3& normal) const;
+
 public:
 
     static shared_ptr<HeightfieldModel> create(const Specification& spec, const String& name = "Heightfield") {
@@ -261,6 +299,24 @@ public:
      const Entity*                   entity         = nullptr,
      const Model::Pose*              pose           = nullptr) const override;
 
+    /** Intersects many world-space rays concurrently, skipping empty regions with the elevation pyramid.
+        \param distanceArray Set to the distance to the first hit before each ray's maxDistance, or finf()
+        \param normalArray If not null, set to the world-space face normal at each hit */
+    void intersectRays
+    (const Array<Ray>&               rayArray,
+     const CoordinateFrame&          cframe,
+     Array<float>&                   distanceArray,
+     Array<Vector3>*                 normalArray    = nullptr) const;
+
+    /** The original intersection algorithm, which walks the ray across the grid one quad at a time.
+        Slower than intersect() for long rays; retained for testing. */
+    bool intersectByGridWalk
+    (const Ray&                      ray, 
+     const CoordinateFrame&          cframe, 
+     float&                          maxDistance, 
+     Model::HitInfo&                 info           = Model::HitInfo::ignore,
+     const Entity*                   entity         = nullptr) const;
+
     /** 
       Return the elevation (y value) under <code>(osPoint.x, -, osPoint.z)</code> according to the tessellation
       used for rendering (i.e., using barycentric interpolation on the triangles, not bilinear interpolation on the grid).
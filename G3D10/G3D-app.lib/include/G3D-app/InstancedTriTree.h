@@ -0,0 +1,261 @@
+/**
+  \file G3D-app.lib/include/G3D-app/InstancedTriTree.h
+
+  G3D Innovation Engine http://casual-effects.com/g3d
+  Copyright 2000-2019, Morgan McGuire
+  All rights reserved
+  Available under the BSD License
+*/
+#pragma once
+
+#include <mutex>
+#include "G3D-base/platform.h"
+#include "G3D-base/AABox.h"
+#include "G3D-base/CoordinateFrame.h"
+#include "G3D-base/Table.h"
+#include "G3D-base/Triangle.h"
+#include "G3D-app/TriTreeBase.h"
+#include "G3D-app/NativeTriTree.h"
+
+namespace G3D {
+
+/**
+ \brief Two-level ray-casting structure that shares one object-space tree among all instances of the same geometry.
+
+ TriTreeBase::setContents flattens every posed Surface into world-space Tris, so a forest of 10,000
+ copies of one ArticulatedModel stores 10,000 copies of its triangles. InstancedTriTree instead keeps
+ one bottom-level NativeTriTree per unique geometry and a top-level bounding volume hierarchy over the
+ world-space bounds of the instances, each of which has its own rigid object-to-world transformation.
+ Memory scales with the unique geometry and moving an instance only refits the top level.
+
+ setContents() recognizes UniversalSurface%s that share CPU vertex and index arrays and material, which
+ is the case for all Entity%s using the same ArticulatedModel. Skinned surfaces and other Surface types
+ are flattened into one world-space geometry, as TriTreeBase does. Bottom-level trees from the previous
+ call are reused, so re-posing a scene in which only frames changed does not rebuild any of them. A tree is
+ reused only if its copy of the vertices and indices still matches the surface's, so geometry edited in
+ place is rebuilt. That check reads each unique geometry once per call, which is much cheaper than a rebuild.
+
+ Hit::triIndex is an index into the virtual array formed by concatenating the triangles of every
+ instance in order, and size() is the length of that array. triArray() and vertexArray() hold a
+ world-space copy of it only after flatten(), which the Tri overloads of intersectBox() and
+ intersectSphere() invoke. The Triangle overloads answer the same queries without that copy.
+
+ PathTracer uses this class when PathTracer::Options::useInstancedTriTree is set.
+
+ \sa NativeTriTree, TriTree::create
+*/
+class InstancedTriTree : public TriTreeBase {
+public:
+    using TriTree::intersectRay;
+    using TriTree::intersectRays;
+
+    class Instance {
+    public:
+        /** Index into the geometry array */
+        int                         geometry = -1;
+
+        /** Object to world. Must be a rigid transformation. */
+        CFrame                      frame;
+
+        CFrame                      previousFrame;
+
+        /** Reported as Surfel::surface for hits on this instance. May be null. */
+        shared_ptr<Surface>         surface;
+
+        /** Index of this instance's first triangle in the virtual Hit::triIndex space */
+        int                         firstTri = 0;
+
+        /** World-space bounds of the object-space tree under frame */
+        AABox                       bounds;
+
+        /** Index of this instance's first vertex in vertexArray() after flatten() */
+        int                         firstVertex = 0;
+    };
+
+protected:
+
+    /** Top-level bounding volume hierarchy node. Children always follow their parent in m_node,
+        so iterating backwards visits children first. */
+    class Node {
+    public:
+        AABox                       bounds;
+
+        /** Index of the first child, or -1 at a leaf. The second child is at child + 1. */
+        int                         child = -1;
+
+        /** Leaves: range of m_instanceOrder */
+        int                         first = 0;
+        int                         count = 0;
+    };
+
+    /** Identifies geometry that may be shared between surfaces. The arrays may change in place
+        under the same key, so setContents() also compares their contents before reusing a tree. */
+    class GeometryKey {
+    public:
+        const void*                 vertexArray = nullptr;
+        const void*                 index = nullptr;
+        const void*                 material = nullptr;
+        int                         numVertices = 0;
+        int                         numIndices = 0;
+        bool                        twoSided = false;
+
+        bool operator==(const GeometryKey& other) const {
+            return (vertexArray == other.vertexArray) && (index == other.index) && (material == other.material) &&
+                (numVertices == other.numVertices) && (numIndices == other.numIndices) && (twoSided == other.twoSided);
+        }
+
+        static size_t hashCode(const GeometryKey& k) {
+            return HashTrait<const void*>::hashCode(k.vertexArray) ^ HashTrait<const void*>::hashCode(k.index) ^
+                HashTrait<const void*>::hashCode(k.material) ^ size_t(k.numIndices);
+        }
+
+        static bool equals(const GeometryKey& a, const GeometryKey& b) {
+            return a == b;
+        }
+    };
+
+    Array<shared_ptr<NativeTriTree>>    m_geometry;
+
+    /** Object-space bounds of each m_geometry tree */
+    Array<AABox>                m_geometryBounds;
+
+    /** Maps shareable surface geometry to its index in m_geometry for setContents() */
+    Table<GeometryKey, int, GeometryKey, GeometryKey> m_geometryTable;
+
+    Array<Instance>             m_instance;
+
+    Array<Node>                 m_node;
+
+    /** Instance indices, grouped by top-level leaf */
+    Array<int>                  m_instanceOrder;
+
+    /** Total triangles over all instances */
+    int                         m_numTris = 0;
+
+    /** Total vertices over all instances */
+    int                         m_numVertices = 0;
+
+    /** True when triArray() and vertexArray() hold the current world-space copy */
+    mutable bool                m_flattened = false;
+
+    /** Guards the lazy write of triArray() and vertexArray() by flatten() */
+    mutable std::mutex          m_flattenMutex;
+
+    InstancedTriTree() {}
+
+    void buildNode(int n, int first, int count);
+
+    /** Returns the instance containing virtual triangle \a triIndex */
+    int findInstance(int triIndex) const;
+
+    /** \param coneCos Cosine of the ray cone half-angle for MIP selection, or 0 for none */
+    void sample(const Hit& hit, float coneCos, shared_ptr<Surfel>& surfel) const;
+
+    /** Invokes \a visit(instanceIndex) for every instance whose bounds overlap \a box */
+    void forEachInstance(const AABox& box, const std::function<void(int)>& visit) const;
+
+    /** Discards the world-space copy made by flatten() after the instances change */
+    void invalidateFlattened();
+
+public:
+
+    static shared_ptr<InstancedTriTree> create() {
+        return createShared<InstancedTriTree>();
+    }
+
+    virtual const String& className() const override { static const String n = "InstancedTriTree"; return n; }
+
+    virtual void clear() override;
+
+    /** Adds a bottom-level tree over object-space triangles and returns its index. Call rebuild()
+        after adding geometry and instances. */
+    int addGeometry(const Array<Tri>& triArray, const CPUVertexArray& vertexArray);
+
+    /** Returns the index of the new instance. Call rebuild() after adding geometry and instances. */
+    int addInstance(int geometry, const CFrame& frame, const shared_ptr<Surface>& surface = nullptr);
+
+    /** Moves an instance. Call refit() after moving instances. */
+    void setInstanceFrame(int instance, const CFrame& frame);
+
+    /** Recomputes the top-level bounds after instances have moved, without changing its structure
+        or touching any bottom-level tree. */
+    void refit();
+
+    /** Rebuilds the top level over the current instances. Bottom-level trees are never rebuilt. */
+    virtual void rebuild() override;
+
+    virtual void setContents
+        (const Array<shared_ptr<Surface>>&  surfaceArray,
+         ImageStorage                       newImageStorage = ImageStorage::COPY_TO_CPU) override;
+
+    /** Stores the triangles as a single instance with an identity frame. */
+    virtual void setContents
+       (const Array<Tri>&                   triArray,
+        const CPUVertexArray&               vertexArray,
+        ImageStorage                        newStorage = ImageStorage::COPY_TO_CPU) override;
+
+    using TriTreeBase::setContents;
+
+    int numGeometries() const {
+        return m_geometry.size();
+    }
+
+    const shared_ptr<NativeTriTree>& geometry(int g) const {
+        return m_geometry[g];
+    }
+
+    int numInstances() const {
+        return m_instance.size();
+    }
+
+    const Instance& instance(int i) const {
+        return m_instance[i];
+    }
+
+    /** Total number of triangles over all instances, which is the exclusive bound on Hit::triIndex. */
+    virtual int size() const override {
+        return m_numTris;
+    }
+
+    /** Fills triArray() and vertexArray() with the world-space triangles of every instance, in
+        Hit::triIndex order, unless they are already current. This copy costs the memory that
+        instancing saves, so it is only made on demand. It is discarded by rebuild(), refit(),
+        setContents(), and clear(). Threadsafe. */
+    void flatten() const;
+
+    /** Hit::distance is in world space. */
+    virtual bool intersectRay
+        (const Ray&                         ray,
+         Hit&                               hit,
+         IntersectRayOptions                options         = IntersectRayOptions(0)) const override;
+
+    virtual void intersectRays
+        (const Array<Ray>&                  rays,
+         Array<shared_ptr<Surfel>>&         results,
+         IntersectRayOptions                options         = IntersectRayOptions(0),
+         const Array<float>&                coneBuffer      = Array<float>()) const override;
+
+    virtual void sample(const Hit& hit, shared_ptr<Surfel>& surfel) const override;
+
+    /** Results index into vertexArray(). Invokes flatten() first. */
+    virtual void intersectBox
+        (const AABox&                       box,
+         Array<Tri>&                        results) const override;
+
+    /** Results index into vertexArray(). Invokes flatten() first. */
+    virtual void intersectSphere
+        (const Sphere&                      sphere,
+         Array<Tri>&                        triArray) const override;
+
+    /** Returns all world-space triangles that intersect the box */
+    void intersectBox
+        (const AABox&                       box,
+         Array<Triangle>&                   results) const;
+
+    /** Returns all world-space triangles that intersect the ball */
+    void intersectSphere
+        (const Sphere&                      sphere,
+         Array<Triangle>&                   results) const;
+};
+
+} // G3D
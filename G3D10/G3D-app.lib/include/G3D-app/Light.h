@@ -477,6 +477,11 @@ public:
     const shared_ptr<class ShadowMap>& shadowMap() const {
         return m_shadowMap;
     }
+
+    /** Returns a copy of this light's current state that belongs to no Scene and shares this light's
+        shadow map. GApp renders from snapshots in GApp::FrameLoopMode::PIPELINED while the originals
+        continue to simulate on another thread. State added by subclasses of Light is not copied. */
+    shared_ptr<Light> snapshot() const;
     
     /** Returns the cosine of the spot light's half angle, and the softness 
         constant used in G3D's lighting model. Only useful for spot lights */
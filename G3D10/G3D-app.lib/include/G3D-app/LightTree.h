@@ -0,0 +1,124 @@
+/**
+  \file G3D-app.lib/include/G3D-app/LightTree.h
+
+  G3D Innovation Engine http://casual-effects.com/g3d
+  Copyright 2000-2019, Morgan McGuire
+  All rights reserved
+  Available under the BSD License
+*/
+#pragma once
+#define GLG3D_LightTree_h
+
+#include "G3D-base/platform.h"
+#include "G3D-base/ReferenceCount.h"
+#include "G3D-base/Array.h"
+#include "G3D-base/AABox.h"
+#include "G3D-base/Vector3.h"
+
+namespace G3D {
+
+class Light;
+
+/** \brief Bounding volume hierarchy over lights for choosing one light to sample
+    in time logarithmic in the number of lights.
+
+    Every node stores the bounds of its lights' positions, a cone bounding their emission
+    directions, and their total power. From those, importance() conservatively estimates
+    how much light the node could deliver to a shading point. sample() walks from the root
+    to a leaf, choosing each child in proportion to its importance, and returns the light
+    along with the exact probability with which it was chosen. Lights that cannot reach the
+    point (behind a spot light's cone or an area light's plane) are never chosen.
+
+    DIRECTIONAL lights have no position, so they are kept in a separate list and are
+    weighted against the tree at the root.
+
+    The tree references lights by their index in the array it was built from and does not
+    track changes to them. Rebuild it when lights move.
+
+    Used by PathTracer when PathTracer::Options::useLightTree is set.
+
+    @cite Conty Estevez and Kulla, Importance Sampling of Many Lights with Adaptive Tree Splitting, HPG 2018
+*/
+class LightTree : public ReferenceCountedObject {
+protected:
+
+    class Node {
+    public:
+        AABox       bounds;
+
+        /** Central direction of emission */
+        Vector3     axis;
+
+        /** Half-angle of the cone about axis that contains the lights' orientations */
+        float       thetaO = 0.0f;
+
+        /** Additional angle beyond thetaO over which the lights emit */
+        float       thetaE = 0.0f;
+
+        /** Sum of the average bulb power of the lights in the subtree */
+        float       power = 0.0f;
+
+        /** Index of the second child, or -1 for a leaf. The first child immediately follows its parent. */
+        int         secondChild = -1;
+
+        /** For a leaf, the index of the light. */
+        int         lightIndex = -1;
+
+        int         parent = -1;
+
+        bool isLeaf() const {
+            return secondChild == -1;
+        }
+    };
+
+    Array<shared_ptr<Light>>    m_lightArray;
+
+    /** Depth-first order; m_nodeArray[0] is the root when it is not empty */
+    Array<Node>                 m_nodeArray;
+
+    /** Node for each light in m_lightArray, or -1 for DIRECTIONAL lights */
+    Array<int>                  m_leafForLight;
+
+    /** Indices of the DIRECTIONAL lights */
+    Array<int>                  m_infiniteLightIndex;
+
+    LightTree(const Array<shared_ptr<Light>>& lightArray);
+
+    /** Builds the subtree over lightIndex[begin..end - 1] and returns the index of its root.
+        \param lightNode Leaf node for each light */
+    int build(const Array<Node>& lightNode, Array<int>& lightIndex, int begin, int end, int parent);
+
+    float importance(const Node& node, const Point3& X, const Vector3& n) const;
+
+    float infiniteImportance(int lightIndex, const Vector3& n) const;
+
+public:
+
+    /** Builds the tree. The lights should all be enabled. */
+    static shared_ptr<LightTree> create(const Array<shared_ptr<Light>>& lightArray);
+
+    const Array<shared_ptr<Light>>& lightArray() const {
+        return m_lightArray;
+    }
+
+    int size() const {
+        return m_lightArray.size();
+    }
+
+    /** Chooses a light to illuminate the point \a X with surface normal \a n (which may be NaN
+        to ignore orientation).
+
+        \param u Uniform random number on [0, 1)
+        \param pdf The probability with which the returned light was chosen
+
+        \return Index into lightArray(), or -1 if no light can illuminate \a X.
+    */
+    int sample(const Point3& X, const Vector3& n, float u, float& pdf) const;
+
+    /** Probability that sample() chooses light \a lightIndex for \a X and \a n. The sum over
+        all lights is less than one when sample() can reach a subtree whose lights all face away
+        from \a X; sample() returns -1 in that case. */
+    float pdf(const Point3& X, const Vector3& n, int lightIndex) const;
+};
+
+} // namespace G3D
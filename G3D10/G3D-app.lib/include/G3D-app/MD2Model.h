@@ -15,10 +15,12 @@
 #include "G3D-base/Sphere.h"
 #include "G3D-base/Any.h"
 #include "G3D-base/MeshAlg.h"
+#include "G3D-base/Table.h"
 #include "G3D-gfx/AttributeArray.h"
 #include "G3D-gfx/Texture.h"
 #include "G3D-app/UniversalMaterial.h"
 #include "G3D-app/Model.h"
+#include <mutex>
 
 namespace G3D {
 
@@ -38,16 +40,19 @@ class Surface;
  feet are you might want to look at the bounding box for the
  stand/walk animations.
  
- <P>This class is not threadsafe; you cannot even call methods on two
- different instances on different threads.
+ <P>Loading and posing surfaces must happen on the rendering thread.
+ MD2Model::Part::getGeometry may be called concurrently from any
+ number of threads, which is how crowds are posed in parallel.
 
  <P>
- When getting geometry from the posed model, the normalArray 
- values are interpolated and often have slightly less than unit length.
+ Each part keeps a least-recently-used cache of interpolated poses
+ keyed by keyframe pair and blend weight, so characters that share a
+ model and are at the same point in an animation are only blended
+ once.  See MD2Model::Part::setPoseCacheCapacity.
 
- <P> When available, this class uses SSE instructions for fast vertex
-  blending.  This cuts the time for getGeometry by a factor of 2 on
-  most processors.
+ <P> When available, this class uses SSE instructions to blend
+  keyframes four floats at a time and to renormalize the blended
+  normals, which are unit length.
 
  <p>
   Sample posing code:
@@ -362,6 +367,21 @@ public:
             Specification(const Any& any);
         };
 
+        /** Counters for the pose cache. \sa poseCacheStats */
+        class PoseCacheStats {
+        public:
+            int             hits;
+            int             misses;
+
+            /** Poses discarded because the cache was full */
+            int             evictions;
+
+            /** Poses currently in the cache */
+            int             entries;
+
+            PoseCacheStats() : hits(0), misses(0), evictions(0), entries(0) {}
+        };
+
     protected:
 
         enum {NUM_VAR_AREAS = 10, NONE_ALLOCATED = -1};
@@ -397,11 +417,40 @@ public:
         };
 
 
-        /** The pose currently stored in interpolatedFrame.  When the animation is MAX_ANIMATIONS
-            interpolatedFrame is not yet initialized. */
-        static MD2Model::Part*      interpolatedModel;
-        static Pose                 interpolatedPose;
-        static MeshAlg::Geometry    interpolatedFrame;
+        /** Identifies an interpolated pose independent of the animation that produced it */
+        class PoseKey {
+        public:
+            int                     frame0;
+            int                     frame1;
+            float                   alpha;
+            bool                    negateNormals;
+
+            static size_t hashCode(const PoseKey& k) {
+                return size_t(k.frame0) ^ (size_t(k.frame1) << 8) ^ (size_t(superFastHash(&k.alpha, sizeof(float))) << 1) ^ size_t(k.negateNormals);
+            }
+
+            static bool equals(const PoseKey& a, const PoseKey& b) {
+                return (a.frame0 == b.frame0) && (a.frame1 == b.frame1) && (a.alpha == b.alpha) && (a.negateNormals == b.negateNormals);
+            }
+        };
+
+        class PoseEntry {
+        public:
+            /** Immutable once in the cache */
+            shared_ptr<MeshAlg::Geometry> geometry;
+
+            /** Value of m_poseClock when this entry was last used */
+            uint64                  lastUse = 0;
+        };
+
+        typedef Table<PoseKey, PoseEntry, PoseKey, PoseKey> PoseTable;
+
+        /** Protects the pose cache state below */
+        mutable std::mutex          m_poseCacheMutex;
+        mutable PoseTable           m_poseCache;
+        mutable uint64              m_poseClock = 0;
+        mutable PoseCacheStats      m_poseCacheStats;
+        int                         m_poseCacheCapacity = 64;
 
         /** Shared dynamic vertex arrays. Allocated by allocateVertexArrays.
             We cycle through multiple VertexBuffers because the models are so small
@@ -489,12 +538,11 @@ public:
          */
         void render(RenderDevice* renderDevice, const Pose& pose);
 
-        /**
-         Fills the geometry out from the pose. 
+        /** Blends two keyframes into \a out, which must already have the right size, and renormalizes the normals. */
+        void interpolate(const PoseKey& key, MeshAlg::Geometry& out) const;
 
-         Called from PosedMD2Model::getGeometry
-         */
-        void getGeometry(const Pose& pose, MeshAlg::Geometry& geometry, bool negateNormals = false) const;
+        /** Removes the least-recently used pose. Called with m_poseCacheMutex locked. */
+        void evictLeastRecentlyUsedPose() const;
 
         /** 
             Sets \param boxBounds and \param sphereBounds to conservative bounds for the pose, which includes
@@ -521,6 +569,31 @@ public:
             _name = n;
         }
 
+        /**
+         Fills the geometry out from the pose. Threadsafe.
+
+         Called from pose()
+         */
+        void getGeometry(const Pose& pose, MeshAlg::Geometry& geometry, bool negateNormals = false) const;
+
+        /**
+         Poses a crowd on multiple threads.  \a geometryArray is resized to match \a poseArray.
+         Characters with identical poses share one pose cache entry.
+         */
+        void getGeometry(const Array<Pose>& poseArray, Array<MeshAlg::Geometry>& geometryArray, bool negateNormals = false) const;
+
+        /** Maximum number of interpolated poses retained. 0 disables the cache. Default is 64. */
+        void setPoseCacheCapacity(int capacity);
+
+        int poseCacheCapacity() const {
+            return m_poseCacheCapacity;
+        }
+
+        void clearPoseCache();
+
+        /** Thread-safe snapshot of the pose cache counters */
+        PoseCacheStats poseCacheStats() const;
+
         /**
          \param filename The tris.md2 file.  Note that most MD2 
           files are stored in two files, tris.md2 and weapon.md2.  
@@ -648,6 +721,13 @@ public:
         return m_part.size();
     }
 
+    const shared_ptr<Part>& part(int p) const {
+        return m_part[p];
+    }
+
+    /** Sets Part::setPoseCacheCapacity on every part */
+    void setPoseCacheCapacity(int capacity);
+
     /** Total number of triangles in the mesh */
     int numTriangles() const {
         return m_numTriangles;
@@ -13,10 +13,19 @@
 #include "G3D-base/ReferenceCount.h"
 #include "G3D-base/Array.h"
 #include "G3D-base/Ray.h"
+#include "G3D-base/G3DGameUnits.h"
+#include "G3D-base/Rect2D.h"
+#include "G3D-base/Vector2int32.h"
 #include "G3D-app/TriTree.h"
+#include "G3D-base/CubeMapSampler.h"
+#include "G3D-app/LightTree.h"
+#include <atomic>
+#include <functional>
 
 namespace G3D {
 
+class BinaryInput;
+class BinaryOutput;
 class Camera;
 class Light;
 class Surfel;
@@ -29,9 +38,29 @@ public:
     class Options {
     public:
         /** Only used for traceImage. Default = 64 in Release mode and 1 in Debug mode.
-            Not used by traceBuffer(). */
+            Not used by traceBuffer(). With adaptiveSampling, this is the average over the image. */
         int         raysPerPixel = 64;
 
+        /** If true, traceImage() spends raysPerPixel times the number of pixels rays where they
+            are needed instead of uniformly. After a few uniform passes, it tracks the running mean
+            and variance of each pixel's luminance and gives each later pass's rays to the 8 x 8
+            pixel tiles in proportion to their squared relative error. Tiles whose error is below
+            adaptiveTargetError receive no more rays, and tracing stops early when every tile has
+            converged or adaptiveTimeLimit elapses.
+
+            Pass an image to traceImage() to see how many rays each pixel received.
+
+            Default = false. */
+        bool        adaptiveSampling = false;
+
+        /** Standard error of a pixel's mean luminance, relative to that mean, below which
+            adaptiveSampling considers it converged. Default = 0.02. */
+        float       adaptiveTargetError = 0.02f;
+
+        /** Wall-clock seconds after which adaptiveSampling stops starting new passes.
+            Default = infinity. */
+        RealTime    adaptiveTimeLimit = inf();
+
         /** 1 = direct illumination. Default = 5 in Release mode and 2 in Debug mode. */
         int         maxScatteringEvents = 5;
 
@@ -75,6 +104,74 @@ public:
         );
         LightSamplingMethod samplingMethod = LightSamplingMethod::LOW_DISCREPANCY_SOLID_ANGLE;
 
+        /** If true and the scene has more than 12 directly sampled lights, choose the light for each
+            shadow ray by traversing a LightTree. This costs time logarithmic in the number of
+            lights instead of evaluating every light at every path vertex. With few lights, the
+            exhaustive evaluation has lower variance, so it is always used.
+
+            Enabling this changes which light each shadow ray samples, and therefore the noise
+            of every image of a scene with many lights.
+
+            Default = false. */
+        bool        useLightTree = false;
+
+        /** If true, trace against an InstancedTriTree, which stores the triangles of each
+            ArticulatedModel once no matter how many Entity%s use it, instead of the TriTree that
+            was passed to create(). This saves memory and rebuild time in scenes with many copies
+            of the same models, at some cost in ray-casting speed. Changing this option rebuilds
+            the tree on the next trace.
+
+            Default = false. */
+        bool        useInstancedTriTree = false;
+
+        /** If true and the scene has a skybox, shadow rays are also cast toward directions
+            chosen in proportion to the skybox's brightness (see CubeMapSampler). Rays that
+            scatter off surfaces and then miss the scene are weighted against those samples, so
+            small, bright features such as the sun converge much faster without double counting.
+
+            The weights compare the skybox density to scatterDensityProxy(), a cosine density,
+            not to the density of Surfel::scatter(). The result is unbiased for any material,
+            but this is not multiple importance sampling against BSDF sampling: on glossy
+            surfaces, whose scattering is far from cosine-distributed, the variance can be
+            higher than with this option off.
+
+            When there are also direct lights, half of the shadow rays go to the skybox. Enabling
+            this changes the noise pattern and sample sequence of every image of a scene with a
+            skybox, so results are not bit-comparable to renders made without it.
+
+            Default = false. */
+        bool        importanceSampleEnvironment = false;
+
+        /** If true, subpixel jitter, light selection, and scattering draw from CounterRandom streams
+            keyed by (randomSeed, pixel or ray index, ray index within the pixel, scattering event)
+            instead of Random::threadCommon(), so traceBuffer() produces the same result on every
+            run regardless of thread scheduling. traceImage() splats samples into shared pixels, so
+            its output may still vary in the last bits when multithreaded.
+
+            UNIFORM_AREA light sampling is not covered; use one of the other samplingMethod values.
+
+            Default = false. */
+        bool        deterministicSampling = false;
+
+        /** Seed for deterministicSampling. Vary it between frames to decorrelate them. */
+        uint64      randomSeed = 0xF018A4D2;
+
+        /** If positive, material textures are sampled through TextureTileCache::global() with this
+            memory budget in megabytes. Each path carries a ray cone, starting at the pixel
+            footprint and widened by the scattering density at each glossy or diffuse bounce, that
+            selects a MIP level at every hit. Incoherent secondary rays then read small, prefiltered
+            tiles instead of the full-resolution images, which reduces both memory traffic and
+            texture aliasing.
+
+            TextureTileCache::global() is shared by all PathTracers. Each trace with a positive
+            value sets the shared budget and reclaims tiles evicted by the previous trace, so
+            PathTracers that use the cache must not trace concurrently with each other. A
+            PathTracer with this option at zero neither reads nor modifies the cache. The cache
+            keeps its memory until the application sets its budget to zero and clears it.
+
+            Default = 0, which samples the full-resolution CPU images directly. */
+        float       textureCacheSizeMB = 0.0f;
+
         Options()
 #       ifdef G3D_DEBUG
             : raysPerPixel(1),
@@ -84,9 +181,78 @@ public:
         {}
     };
 
+    /** \brief Accumulated samples of a render made by traceImageProgressive().
+
+        Holds the unnormalized radiance and filter weight sums, so that a render can be
+        inspected with resolve() after any pass, stopped, saved with serialize(), and later
+        continued from where it stopped, possibly in another process. Continuing requires the
+        same scene, camera, and Options. */
+    class ProgressiveState : public ReferenceCountedObject {
+    protected:
+        friend class PathTracer;
+
+        /** RGB32F sum of splatted radiance */
+        shared_ptr<Image>                       m_radianceSum;
+
+        /** R32F sum of splat weights */
+        shared_ptr<Image>                       m_weightSum;
+
+        int                                     m_passesCompleted = 0;
+
+        std::atomic<bool>                       m_cancelRequested;
+
+        ProgressiveState(int width, int height);
+
+    public:
+
+        static shared_ptr<ProgressiveState> create(int width, int height);
+
+        /** Creates a state from the data written by serialize() */
+        static shared_ptr<ProgressiveState> create(BinaryInput& b);
+
+        int width() const;
+        int height() const;
+
+        /** Passes of one ray per pixel accumulated so far */
+        int passesCompleted() const {
+            return m_passesCompleted;
+        }
+
+        /** Threadsafe. Makes traceImageProgressive() return after the pass in progress. The
+            request is cleared when traceImageProgressive() returns, so the render can be resumed. */
+        void requestCancel() {
+            m_cancelRequested = true;
+        }
+
+        bool cancelRequested() const {
+            return m_cancelRequested;
+        }
+
+        /** Writes the normalized radiance accumulated so far to \a radianceImage, which must be
+            the same size as this state. Pixels without samples are black. */
+        void resolve(const shared_ptr<Image>& radianceImage) const;
+
+        void serialize(BinaryOutput& b) const;
+
+        void deserialize(BinaryInput& b);
+    };
+
 protected:
     typedef Point2                              PixelCoord;
 
+    /** Separates the CounterRandom streams used for different decisions at the same
+        scattering event when Options::deterministicSampling is enabled. */
+    enum RandomPurpose {
+        EYE_RAY_RANDOM,
+        LIGHT_SELECTION_RANDOM,
+        SCATTER_RANDOM
+    };
+
+    /** Third word of the CounterRandom stream for \a purpose at \a scatteringEvent */
+    static uint32 randomStream(int scatteringEvent, RandomPurpose purpose) {
+        return (uint32(scatteringEvent) << 2) | uint32(purpose);
+    }
+
     
     /** Per-path data passed between major routines. Configured as a structure of arrays
         instead of an array of structures s othat the ray and surfel buffers can be directly
@@ -118,6 +284,15 @@ protected:
             do not contribute to indirect light unless the previous event was an impulse. This
             avoids double-counting the lights. */
         Array<bool>                             impulseRay;
+
+        /** scatterDensityProxy() of the current ray's direction, used to weight rays that miss
+            the scene against the skybox samples and to size ray cones. Infinite for primary and
+            impulse rays, which the skybox samples can never produce. */
+        Array<float>                            scatterDensity;
+
+        /** Cosine of the half-angle of the current ray's cone, used to select MIP levels when
+            Options::textureCacheSizeMB is positive */
+        Array<float>                            coneCos;
     
         /** Location in the output buffer to write the final radiance to.*/
         Array<int>                              outputIndex;
@@ -125,11 +300,16 @@ protected:
         /** Location in the output image to write the final radiance to.*/
         Array<PixelCoord>                       outputCoord;
 
+        /** Pixel (traceImage) or input ray (traceBuffer) that started this path. Unlike
+            the position in the buffer, this survives compaction, so it identifies the
+            path's random stream. */
+        Array<int>                              pathIndex;
+
         size_t size() const {
             return ray.size();
         }
 
-        /** Does not resize outputIndex or outputCoord */
+        /** Does not resize outputIndex, outputCoord, or pathIndex */
         void resize(size_t n) {
             ray.resize(n);
             modulation.resize(n);
@@ -138,6 +318,8 @@ protected:
             shadowRay.resize(n);
             lightShadowed.resize(n);
             impulseRay.resize(n);
+            scatterDensity.resize(n);
+            coneCos.resize(n);
         }
 
         /** Removes element \a i from all arrays, including either outputIndex or outputCoord. */
@@ -149,6 +331,9 @@ protected:
             shadowRay.fastRemove(i);
             lightShadowed.fastRemove(i);
             impulseRay.fastRemove(i);
+            scatterDensity.fastRemove(i);
+            coneCos.fastRemove(i);
+            pathIndex.fastRemove(i);
 
             if (outputIndex.size() > 0) {
                 outputIndex.fastRemove(i);
@@ -159,6 +344,9 @@ protected:
     };
 
     mutable shared_ptr<TriTree>                 m_triTree;
+
+    /** The tree passed to create(), restored when Options::useInstancedTriTree is turned off */
+    mutable shared_ptr<TriTree>                 m_defaultTriTree;
     
     /** For the active trace */
     mutable Options                             m_options;
@@ -168,12 +356,39 @@ protected:
     /** \see Options:: useEnvironmentMapForLastScatteringEvent */
     mutable shared_ptr<CubeMap>                 m_environmentMap;
 
+    /** Built over the direct lights by prepare() when Options::useLightTree applies, otherwise nullptr */
+    mutable shared_ptr<LightTree>               m_lightTree;
+
+    /** Built over m_skybox by prepare() when Options::importanceSampleEnvironment applies, otherwise nullptr */
+    mutable shared_ptr<CubeMapSampler>          m_skyboxSampler;
+
+    /** The skybox from which m_skyboxSampler was built */
+    mutable shared_ptr<CubeMap>                 m_skyboxSamplerSource;
+
     static const Ray                            s_degenerateRay;
 
     PathTracer(const shared_ptr<TriTree>& t = nullptr);
 
     Radiance3 skyRadiance(const Vector3& direction) const;
 
+    /** Probability that a shadow ray cast at scattering event \a currentPathDepth is aimed at the
+        skybox (via m_skyboxSampler) rather than at one of \a numDirectLights lights. Zero when
+        environment sampling is disabled or would not be weighted against a traced ray. */
+    float environmentSampleFraction(int numDirectLights, int currentPathDepth) const;
+
+    /** Stands in for the density of Surfel::scatter() when weighting scattered rays against
+        skybox samples, because Surfel does not expose that density. This is the
+        cosine-weighted density about the shading normal, which is exact only for Lambertian
+        scattering.
+
+        The skybox sample weight and the scattered ray weight both use this same value, so
+        they sum to one for every direction and the estimate stays unbiased. They are not
+        balance-heuristic weights with respect to the actual BSDF pdf, so the variance
+        reduction degrades as materials become glossy. */
+    static float scatterDensityProxy(const Vector3& n, const Vector3& w_i) {
+        return fabsf(n.dot(w_i)) / pif();
+    }
+
     /**
      Sample a single light and choose a point on it, potentially in a low-discrepancy or importance sampling way.
 
@@ -187,6 +402,32 @@ protected:
     */
     Point3 sampleOneLight(const shared_ptr<Light>& light, const Point3& X, const Vector3& n, int pixelIndex, int lightIndex, int sampleIndex, int numSamples, float& areaTimesPDFValue) const;
 
+    /** Cosine of the half-angle of a cone covering one pixel at the center of the image */
+    static float primaryConeCos(const shared_ptr<Camera>& camera, int width, int height);
+
+    /** Traces one ray through every pixel, splatting into \a radianceImage and \a weightSumImage.
+        Used by traceImage() and traceImageProgressive(). */
+    void traceImagePass
+       (const shared_ptr<Image>&                radianceImage,
+        const shared_ptr<Image>&                weightSumImage,
+        const shared_ptr<Camera>&               camera,
+        float                                   primaryConeCos,
+        const Array<shared_ptr<Light>>&         directLightArray,
+        const Array<shared_ptr<Light>>&         indirectLightArray,
+        int                                     rayIndex,
+        BufferSet&                              buffers) const;
+
+    /** The eye ray through \a point + \a offset, using the lens sample for \a rayIndex when there is
+        depth of field */
+    Ray eyeRay
+       (const shared_ptr<Camera>&               camera,
+        const Rect2D&                           viewport,
+        bool                                    depthOfField,
+        Point2int32                             point,
+        const Vector2&                          offset,
+        int                                     rayIndex,
+        int                                     raysPerPixel) const;
+
     /** Produces a buffer of eye rays, stored in raster order in the preallocated rayBuffer. 
         \param castThroughCenter When true (for the first ray at each pixel), cast the ray through
                the pixel center to make images look less noisy.
@@ -210,18 +451,25 @@ protected:
         
         If outputBuffer is not null, writes to it using outputCoordBuffer indices, otherwise writes to
         radianceImage using pixelCoordBuffer indices.
+
+        \param environmentFraction environmentSampleFraction() for the scattering event that produced
+        these rays, used to weight skybox radiance against the skybox samples taken there.
         */
     void addEmissive
        (const Array<Ray>&                       rayFromEye,
         const Array<shared_ptr<Surfel>>&        surfelBuffer, 
         const Array<bool>&                      impulseRay,
+        const Array<float>&                     scatterDensityBuffer,
+        float                                   environmentFraction,
         const Array<Color3>&                    modulationBuffer,
         Radiance3*                              outputBuffer,
         const Array<int>                        outputCoordBuffer,
         const shared_ptr<Image>&                radianceImage,
         const Array<PixelCoord>&                pixelCoordBuffer) const;
 
-    /** Choose what light surface to sample, storing the corresponding shadow ray and biradiance value */
+    /** Choose what light surface (or, with probability environmentSampleFraction(), which skybox
+        direction) to sample, storing the corresponding shadow ray and biradiance value.
+        \a lightArray may be empty when only the skybox is sampled. */
     void computeDirectIllumination
        (const Array<shared_ptr<Surfel>>&        surfelBuffer,
         const Array<shared_ptr<Light>>&         lightArray,
@@ -230,6 +478,7 @@ protected:
         int                                     currentRayIndex,
         const Options&                          options,
         const Array<PixelCoord>&                pixelCoordBuffer,
+        const Array<int>&                       pathIndexBuffer,
         const int                               radianceImageWidth,
         Array<Radiance3>&                       directBuffer,
         Array<Ray>&                             shadowRayBuffer) const;
@@ -257,6 +506,7 @@ protected:
     
     \param probability Relative probablity mass with which this particular sample was taken relative to other samples
            that were considered.     
+    \param rng Chooses among multiple lights
     */
     const shared_ptr<Light>& importanceSampleLight
        (const Array<shared_ptr<Light>>&         lightArray,
@@ -265,14 +515,41 @@ protected:
         int                                     sequenceIndex,
         int                                     rayIndex,
         int                                     raysPerPixel,
+        Random&                                 rng,
         Biradiance3&                            biradiance,
         Color3&                                 cosBSDFDivPDF,
         Point3&                                 lightPosition) const;
 
     /** Compute the next bounce direction by mutating rayBuffer, and then multiply the modulationBuffer by
         the inverse probability density that the direction was taken. Those probabilities are computed across
-        three color channels, so modulationBuffer can become "colored" by this. */
+        three color channels, so modulationBuffer can become "colored" by this. Records scatterDensityProxy()
+        for each new direction in scatterDensityBuffer.
+
+        This is the overload that traceBuffer() calls. Subclasses that customize scattering must
+        override it (declared with \c override, so that any future signature change fails to
+        compile) and should add <code>using PathTracer::scatterRays;</code> to keep the other
+        overload visible.
+        
+        \param pathIndexBuffer Identifies each path's random stream for Options::deterministicSampling */
     virtual void scatterRays
+       (const Array<shared_ptr<Surfel>>&        surfelBuffer, 
+        const Array<int>&                       pathIndexBuffer,
+        const Array<shared_ptr<Light>>&         indirectLightArray,
+        int                                     currentPathDepth,
+        int                                     rayIndex,
+        int                                     raysPerPixel,
+        Array<Ray>&                             rayBuffer,
+        Array<Color3>&                          modulationBuffer,
+        Array<bool>&                            impulseScatterBuffer,
+        Array<float>&                           scatterDensityBuffer) const;
+
+    /** \deprecated The signature of scatterRays() before Options::deterministicSampling and
+        Options::importanceSampleEnvironment. Forwards to the overload above, using each ray's
+        index in the buffers as its path index and discarding the densities.
+
+        This is no longer virtual: traceBuffer() does not call it, so an override of it would
+        never run. Move such overrides to the overload above. */
+    void scatterRays
        (const Array<shared_ptr<Surfel>>&        surfelBuffer, 
         const Array<shared_ptr<Light>>&         indirectLightArray,
         int                                     currentPathDepth,
@@ -308,10 +585,40 @@ protected:
         const Array<shared_ptr<Light>>&         indirectLightArray,
         int                                     currentRayIndex) const;
 
+    /** traceImage() for Options::adaptiveSampling. Accumulates into radianceImage and
+        weightSumImage, which traceImage() then normalizes. */
+    void traceImageAdaptive
+       (const shared_ptr<Image>&                radianceImage,
+        const shared_ptr<Image>&                weightSumImage,
+        const shared_ptr<Camera>&               camera,
+        float                                   primaryConeCos,
+        const Array<shared_ptr<Light>>&         directLightArray,
+        const Array<shared_ptr<Light>>&         indirectLightArray,
+        const std::function<void(const String&, float)>& statusCallback,
+        const shared_ptr<Image>&                sampleCountImage) const;
+
 public:
 
     static shared_ptr<PathTracer> create(shared_ptr<TriTree> t = nullptr);
 
+    /** Chooses the rays per pixel of each tile for one pass of Options::adaptiveSampling.
+
+        Tiles whose error is at most \a targetError receive none. Every other tile receives one
+        ray per pixel, in order of decreasing error for as long as the budget allows, and then
+        a share of the rest of the budget in proportion to its squared error, up to
+        \a maxRaysPerPixel. The rays over all pixels never total more than \a passBudget, except
+        that the tile with the largest error always receives one ray per pixel.
+
+        \param tilePixels Number of pixels in each tile
+        \return False if every tile has converged */
+    static bool allocateAdaptivePass
+       (const Array<float>&                     tileError,
+        const Array<int>&                       tilePixels,
+        float                                   targetError,
+        int64                                   passBudget,
+        int                                     maxRaysPerPixel,
+        Array<int>&                             tileRays);
+
     /** Replaces the previous scene.*/
     void setScene(const shared_ptr<Scene>& scene);
 
@@ -330,8 +637,39 @@ public:
         if the scene has changed. 
 
         \param statusCallback Function called periodically to update the GUI with the rendering progress. Arguments are percentage (between 0 and 1) and an arbitrary message string.
+
+        \param sampleCountImage If not null, must be the same size as \a radianceImage, and
+        receives the number of rays traced through each pixel. Useful as a heatmap of where
+        Options::adaptiveSampling spent its effort.
       */
-    void traceImage(const shared_ptr<Image>& radianceImage, const shared_ptr<Camera>& camera, const Options& options, const std::function<void(const String&, float)>& statusCallback = nullptr) const;
+    void traceImage(const shared_ptr<Image>& radianceImage, const shared_ptr<Camera>& camera, const Options& options, const std::function<void(const String&, float)>& statusCallback = nullptr, const shared_ptr<Image>& sampleCountImage = nullptr) const;
+
+    /** Continues the render in \a state by up to Options::raysPerPixel - state->passesCompleted()
+        passes of one ray per pixel, for interactive previews and renders with deadlines.
+
+        Returns early, after the pass in progress, when \a timeLimit seconds have elapsed or
+        another thread calls state->requestCancel(). Call again with the same state to resume.
+        After every pass, \a passCallback (if not null) receives the state, from which it can
+        resolve() a snapshot of the image so far.
+
+        Options::adaptiveSampling is ignored.
+
+        \return True if all Options::raysPerPixel passes are complete
+
+        \code
+        const shared_ptr<PathTracer::ProgressiveState>& state = PathTracer::ProgressiveState::create(w, h);
+        while (! pathTracer->traceImageProgressive(state, camera, options, 0.1)) {
+            state->resolve(preview);
+            // ...display preview, or serialize the state and quit
+        }
+        \endcode
+    */
+    bool traceImageProgressive
+       (const shared_ptr<ProgressiveState>&     state,
+        const shared_ptr<Camera>&               camera,
+        const Options&                          options,
+        RealTime                                timeLimit = inf(),
+        const std::function<void(const shared_ptr<ProgressiveState>&)>& passCallback = nullptr) const;
 
     /** 
      \param output Must be allocated to at least the size of rayBuffer. This may be uncached, memory mapped memory.
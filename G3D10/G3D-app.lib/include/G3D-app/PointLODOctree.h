@@ -0,0 +1,258 @@
+/**
+  \file G3D-app.lib/include/G3D-app/PointLODOctree.h
+
+  G3D Innovation Engine http://casual-effects.com/g3d
+  Copyright 2000-2019, Morgan McGuire
+  All rights reserved
+  Available under the BSD License
+*/
+#pragma once
+#define GLG3D_PointLODOctree_h
+
+#include "G3D-base/platform.h"
+#include "G3D-base/ReferenceCount.h"
+#include "G3D-base/Array.h"
+#include "G3D-base/AABox.h"
+#include "G3D-base/Plane.h"
+#include "G3D-base/Vector3.h"
+#include "G3D-base/Color4unorm8.h"
+#include <mutex>
+
+namespace G3D {
+
+/** \brief Level-of-detail octree of points that is stored in a file and paged in by view,
+    for point clouds that are too large to hold in memory.
+
+    Every point is stored in exactly one node. Each interior node holds an evenly spaced
+    subsample of the points below it: at most one point per cell of a
+    Specification::gridResolution<sup>3</sup> grid over the node. Drawing a node and all of
+    its ancestors therefore shows the region at that node's point spacing, and refining
+    only adds points. Leaves hold whatever is left.
+
+    The Builder never holds more than Specification::maxPointsInMemory points. Points
+    that it receives are spilled to a temporary file. When a node has too many points to
+    build in memory, one pass over its file selects the node's own subsample and writes
+    every other point to a file for its octant; then the children are built in turn.
+
+    The file holds each node's points, followed by a node table. open() reads only the
+    table. selectNodes() picks the nodes needed for a viewpoint and error budget, and
+    makeResident() loads those nodes and evicts the rest.
+
+    \sa PointModel, VoxelOctree
+*/
+class PointLODOctree : public ReferenceCountedObject {
+public:
+
+    class Specification {
+    public:
+        /** Most points stored in one node. Default = 20000 */
+        int         maxPointsPerNode;
+
+        /** Cells per axis of the grid that subsamples an interior node. Surfaces occupy about
+            the square of this many cells, so about sqrt(maxPointsPerNode) fills each node. Default = 128 */
+        int         gridResolution;
+
+        /** Most points that the Builder holds in memory at once. Default = 2^24 */
+        int64       maxPointsInMemory;
+
+        /** Nodes at this level keep all of their points, which bounds the depth of
+            clouds with many coincident points. Default = 20 */
+        int         maxDepth;
+
+        Specification() : maxPointsPerNode(20000), gridResolution(128), maxPointsInMemory(1 << 24), maxDepth(20) {}
+    };
+
+    /** Streams points into a new octree file. */
+    class Builder : public ReferenceCountedObject {
+    protected:
+        friend class PointLODOctree;
+
+        String              m_filename;
+        Specification       m_specification;
+
+        /** Points that have not been spilled to m_spillFile */
+        Array<Point3>       m_position;
+        Array<Color4unorm8> m_color;
+
+        FILE*               m_spillFile = nullptr;
+        int64               m_numSpilled = 0;
+
+        AABox               m_bounds;
+
+        /** In double precision so that the mean of billions of points is accurate */
+        double              m_sum[3] = {0.0, 0.0, 0.0};
+        int64               m_numPoints = 0;
+
+        Builder(const String& filename, const Specification& specification);
+
+        void spill();
+
+    public:
+
+        static shared_ptr<Builder> create(const String& filename, const Specification& specification = Specification());
+
+        /** Deletes the temporary files if commit() was never called */
+        ~Builder();
+
+        void addPoint(const Point3& position, const Color4unorm8& color);
+
+        int64 numPoints() const {
+            return m_numPoints;
+        }
+
+        /** Mean of the points added so far */
+        Point3 center() const;
+
+        /** Bounds of the points added so far */
+        const AABox& bounds() const {
+            return m_bounds;
+        }
+
+        /** Writes the octree file, adding \a translation to every point.
+            The Builder may not be used afterward. */
+        void commit(const Vector3& translation = Vector3::zero());
+    };
+
+    class Node {
+    public:
+        /** Cube containing the node's points and all of its descendants' */
+        AABox       bounds;
+
+        /** Distance between the points of this node and its ancestors, i.e., the edge
+            length of one subsampling grid cell. Zero for leaves, which hold all of their points. */
+        float       spacing = 0.0f;
+
+        int         level = 0;
+        int         parent = -1;
+
+        /** Index of the child in each octant, or -1 */
+        int         child[8];
+
+        int64       numPoints = 0;
+
+        /** Byte offset of the node's positions in the file. Its colors follow them. */
+        int64       fileOffset = 0;
+
+        Node() {
+            for (int i = 0; i < 8; ++i) {
+                child[i] = -1;
+            }
+        }
+    };
+
+    /** The points of one resident node */
+    class NodePoints : public ReferenceCountedObject {
+    public:
+        Array<Point3>       position;
+        Array<Color4unorm8> color;
+    };
+
+    /** Where the octree is seen from, in the octree's coordinate system */
+    class Viewpoint {
+    public:
+        Point3          eye;
+
+        /** Pixels covered by one unit at unit distance from the eye, e.g.,
+            <code>viewportHeight / (2 * tan(verticalFieldOfView / 2))</code>. */
+        float           pixelsPerUnit = 1000.0f;
+
+        /** Refine a node while its point spacing projects to more than this many pixels */
+        float           maxErrorPixels = 2.0f;
+
+        /** Stop refining once the selected nodes hold this many points */
+        int64           maxPoints = 10000000;
+
+        /** Nodes entirely outside any of these planes are not selected. For example,
+            the view frustum's planes. */
+        Array<Plane>    clipPlanes;
+    };
+
+    class Stats {
+    public:
+        int         numResidentNodes = 0;
+        int64       numResidentPoints = 0;
+
+        /** Nodes read from the file since open() */
+        int64       numNodeLoads = 0;
+        int64       numNodeEvictions = 0;
+    };
+
+protected:
+
+    /** Changed whenever the file layout changes */
+    static const int CURRENT_FILE_FORMAT = 1;
+
+    String                          m_filename;
+    Array<Node>                     m_node;
+    int64                           m_numPoints = 0;
+
+    /** Protects everything below */
+    mutable std::mutex              m_mutex;
+
+    FILE*                           m_file = nullptr;
+
+    /** Parallel to m_node. Null for nodes that are not resident. */
+    Array<shared_ptr<NodePoints>>   m_resident;
+
+    /** Parallel to m_node. Value of m_clock when the node was last passed to makeResident(). */
+    Array<int64>                    m_lastUsed;
+
+    int64                           m_clock = 0;
+
+    /** Unselected nodes are evicted least recently used first beyond this many points */
+    int64                           m_residentPointBudget = 0;
+
+    Stats                           m_stats;
+
+    PointLODOctree() {}
+
+    shared_ptr<NodePoints> readNode(int n);
+
+public:
+
+    /** Returns null if the file does not exist or is in an older format */
+    static shared_ptr<PointLODOctree> open(const String& filename);
+
+    ~PointLODOctree();
+
+    const String& filename() const {
+        return m_filename;
+    }
+
+    /** Node 0 is the root */
+    const Array<Node>& nodes() const {
+        return m_node;
+    }
+
+    int64 numPoints() const {
+        return m_numPoints;
+    }
+
+    /** Appends to \a nodeIndexArray the indices of the nodes needed to draw the octree from
+        \a viewpoint. Every selected node's parent is also selected, and precedes it.
+        Does not read the file. Threadsafe. */
+    void selectNodes(const Viewpoint& viewpoint, Array<int>& nodeIndexArray) const;
+
+    /** Reads the nodes in \a nodeIndexArray that are not already resident, then evicts
+        other nodes until at most residentPointBudget() points are resident beyond those.
+        Threadsafe. */
+    void makeResident(const Array<int>& nodeIndexArray);
+
+    /** Points of node \a n, or null if it is not resident. Threadsafe. */
+    shared_ptr<NodePoints> residentPoints(int n) const;
+
+    /** Points of node \a n, reading them if necessary. Does not affect eviction. Threadsafe. */
+    shared_ptr<NodePoints> loadPoints(int n);
+
+    /** Points in nodes that were not passed to the latest makeResident() call
+        that may stay resident in case they are needed again. Default = 0 */
+    void setResidentPointBudget(int64 numPoints);
+
+    int64 residentPointBudget() const {
+        return m_residentPointBudget;
+    }
+
+    Stats stats() const;
+};
+
+} // namespace G3D
@@ -11,10 +11,12 @@
 
 #include "G3D-base/platform.h"
 #include "G3D-app/Model.h"
+#include "G3D-app/PointLODOctree.h"
 #include "G3D-base/AABox.h"
 
 namespace G3D {
 class PointSurface;
+class BinaryInput;
 
 /**
   \sa PointSurface 
@@ -40,10 +42,23 @@ public:
         } xyzOptions;
 
         String              filename;
+
+        /** If true, translate the points so that their centroid is at the origin after applying
+            transform. Applies to the .xyz and .ply formats. Default = true */
         bool                center;
+
+        /** Applied to every point read from an .xyz or .ply file. ASCII .ply files, which are in a
+            laser scanner's format, are first scaled from its units by 0.0005. The default rotates
+            z-up files to G3D's y-up convention. */
         Matrix4             transform;
+
         float               scale;
         bool                renderAsDisk = true;
+
+        /** If true, stream the points into a PointLODOctree stored in the cache directory
+            and page in only the nodes that setViewpoint() selects, instead of holding
+            every point in memory. Default = false */
+        bool                streaming = false;
         ImageFormat::ColorSpace sourceColorSpace;
         Specification(const String& filename = "") : filename(filename), center(true), 
             transform(1,  0,  0,  0,
@@ -106,17 +121,43 @@ protected:
 
     Array<shared_ptr<PointArray>> m_pointArrayArray;
 
+    /** Non-null if Specification::streaming was set */
+    shared_ptr<PointLODOctree> m_lodOctree;
+
+    /** Receives the points from the loaders while building m_lodOctree */
+    shared_ptr<PointLODOctree::Builder> m_lodBuilder;
+
+    /** Set by centerPoints() while building m_lodOctree */
+    bool                m_lodCenter = false;
+
+    /** Specification::scale, which is applied to octree points as they are paged in */
+    float               m_lodScale = 1.0f;
+
+    /** The PointArray of each octree node that was selected by the last setViewpoint() call */
+    Table<int, shared_ptr<PointArray>> m_lodPointArrayTable;
+
     void load(const Specification& spec);
+    void loadStreaming(const Specification& spec);
+
+    /** Dispatches to the loader for the file type. The loaders call addPoint(). */
+    void loadSource(const Specification& spec);
+
     void loadPLY(const Specification& spec);
+
+    /** Standard binary PLY files, streamed from ParsePLY */
+    void loadBinaryPLY(const Specification& spec, BinaryInput& bi);
     void loadXYZ(const Specification& spec);
     void loadVOX(const Specification& spec);
 
     /** Returns false if the cache load fails */
     bool loadCache(const String& filename);
 
-    /** Only call during loading. Write to pointArrayArray[0] */
+    /** Only call during loading. Write to pointArrayArray[0], or to m_lodBuilder when streaming */
     void addPoint(const Point3& position, const Color4unorm8 radiance);
 
+    /** Only call during loading, after the last addPoint() */
+    void centerPoints();
+
     PointModel(const String& name) : m_name(name) {}
 
     /** Divides pointArrayArray[0] into multiple arrays */
@@ -202,6 +243,17 @@ public:
         return m_numPoints;
     }
 
+    /** Null unless Specification::streaming was set */
+    const shared_ptr<PointLODOctree>& lodOctree() const {
+        return m_lodOctree;
+    }
+
+    /** For streaming models, selects the octree nodes needed to draw the model from
+        \a viewpoint, pages them in, and replaces the point arrays that pose() produces
+        surfaces for. \a viewpoint is in the model's object space, after Specification::scale.
+        Does nothing if Specification::streaming was not set. */
+    void setViewpoint(const PointLODOctree::Viewpoint& viewpoint);
+
     void pose(Array<shared_ptr<Surface>>& surfaceArray, const shared_ptr<Entity>& entity = shared_ptr<Entity>()) const;
 };
 
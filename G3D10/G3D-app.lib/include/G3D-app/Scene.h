@@ -80,7 +80,31 @@ public:
         /** Remove VisibleEntitys for which canChange = false. Default = false */
         bool        stripDynamicVisibleEntitys;
 
-        LoadOptions() : stripStaticVisibleEntitys(false), stripDynamicVisibleEntitys(false) {}
+        /** Resolve every model in the scene's models table during load() instead of when
+            each is first used. ArticulatedModels load concurrently on worker threads while
+            the calling thread creates their materials and textures (see GLThreadQueue), so
+            texture files decode on the Texture loading threads in the meantime. Other Model
+            types then load on the calling thread. Default = false
+
+            \sa modelLoadTimes */
+        bool        prefetchModels;
+
+        /** Worker threads for prefetchModels. 0 = one per core. Default = 0 */
+        int         numPrefetchThreads;
+
+        LoadOptions() : stripStaticVisibleEntitys(false), stripDynamicVisibleEntitys(false), prefetchModels(false), numPrefetchThreads(0) {}
+    };
+
+    /** Time spent resolving one model during load() when LoadOptions::prefetchModels is set. \sa modelLoadTimes */
+    class ModelLoadTime {
+    public:
+        String      name;
+
+        /** Wall-clock time, including any time spent waiting for the calling thread to create its materials */
+        RealTime    time = 0;
+
+        /** True if the model loaded on a worker thread */
+        bool        concurrent = false;
     };
 
     /** \sa registerEntityType */
@@ -156,8 +180,14 @@ protected:
 
     String                              m_description;
 
+    /** \sa modelLoadTimes */
+    Array<ModelLoadTime>                m_modelLoadTimeArray;
+
     Scene(const shared_ptr<AmbientOcclusion>& ambientOcclusion);
 
+    /** Resolves the unresolved models in m_modelTable and records m_modelLoadTimeArray. Called from load(). */
+    void prefetchModels(const LoadOptions& options);
+
     const shared_ptr<Entity> _entity(const String& name) const;
      
     /** If m_needEntitySort, sort Entitys to resolve dependencies and set m_needEntitySort = false. Called fromOnSimulation */
@@ -186,6 +216,12 @@ public:
         return m_modelTable;
     }
 
+    /** Per-model load times from the last load() with LoadOptions::prefetchModels set, in
+        the order that the models finished. Also written to the log. Empty otherwise. */
+    const Array<ModelLoadTime>& modelLoadTimes() const {
+        return m_modelLoadTimeArray;
+    }
+
     const String& name() const {
         return m_name;
     }
@@ -24,6 +24,11 @@ public:
     bool            showEntityNames;
 
     SceneVisualizationSettings() : showMarkers(false), showAxes(false), showEntityBoxBounds(false), showEntityBoxBoundArray(false), showEntitySphereBounds(false), showWireframe(false), showEntityNames(false) {}
+
+    /** True if any option other than showWireframe is enabled, which requires Scene::visualize to read the Entity%s */
+    bool showsEntities() const {
+        return showMarkers || showAxes || showEntityBoxBounds || showEntityBoxBoundArray || showEntitySphereBounds || showEntityNames;
+    }
 };
 
 }
@@ -252,6 +252,13 @@ public:
 
     virtual bool isSkybox() const { return false; }
 
+    /** Forwards to Texture::setLoadingPriority for every lazily-loaded texture that this surface
+        samples. Called by Renderer::cullAndSort() each frame with the approximate number of pixels
+        that the surface covers.
+
+        The default implementation does nothing. */
+    virtual void setTextureLoadingPriority(bool visible, float projectedScreenArea) const {}
+
     /** What type of transparency (= alpha and transmission) does this surface have? */
     virtual TransparencyType transparencyType() const = 0;
     
@@ -0,0 +1,229 @@
+/**
+  \file G3D-app.lib/include/G3D-app/TextureTileCache.h
+
+  G3D Innovation Engine http://casual-effects.com/g3d
+  Copyright 2000-2019, Morgan McGuire
+  All rights reserved
+  Available under the BSD License
+*/
+#pragma once
+#define GLG3D_TextureTileCache_h
+
+#include "G3D-base/platform.h"
+#include "G3D-base/ReferenceCount.h"
+#include "G3D-base/Array.h"
+#include "G3D-base/Color4.h"
+#include "G3D-base/Vector2.h"
+#include "G3D-base/WrapMode.h"
+#include <atomic>
+#include <functional>
+#include <mutex>
+
+namespace G3D {
+
+/** \brief Fixed-budget cache of mipmapped texture tiles for sampling materials on the CPU.
+
+    Each registered texture is divided into TILE_SIZE x TILE_SIZE tiles at every MIP level. Tiles
+    are created on first use: level 0 tiles by reading the texels through the source's
+    callback, and coarser tiles by box filtering the level below, so only the regions and
+    resolutions that rays actually touch are ever materialized. Incoherent rays that select
+    coarse levels from their ray cones touch a few small tiles instead of the full-resolution
+    image.
+
+    Looking up a resident tile takes no locks. Creating a tile takes a mutex only to publish
+    it, and when the resident tiles exceed the memory budget, the least recently used ones
+    are evicted. Evicted tiles may still be in use by concurrent lookups, so their memory is
+    reclaimed by advanceEpoch(), which must not run concurrently with sample(). PathTracer
+    calls it at the start of every trace that uses the cache. Once a full budget's worth of
+    tiles is awaiting reclamation, eviction stops and the cache grows past its budget until the
+    next advanceEpoch().
+
+    The cache holds texels as Color4 in the source's own encoding; apply any
+    Texture::Encoding after sampling.
+
+    \sa Component, UniversalSurfel::sample, PathTracer::Options::textureCacheSizeMB
+*/
+class TextureTileCache : public ReferenceCountedObject {
+protected:
+
+    class Tile;
+
+public:
+
+    /** Edge length of a tile in texels */
+    enum { TILE_SIZE = 32 };
+
+    /** Writes the level-0 texels in the rectangle [x0, x0 + width) x [y0, y0 + height), in
+        row-major order, to \a dst. Called concurrently for different tiles. */
+    typedef std::function<void (int x0, int y0, int width, int height, Color4* dst)> TexelFunction;
+
+    class Stats {
+    public:
+        /** Tile lookups that found the tile resident */
+        uint64          hits = 0;
+
+        /** Tile lookups that had to create the tile */
+        uint64          misses = 0;
+
+        uint64          evictions = 0;
+
+        int             residentTiles = 0;
+        size_t          residentBytes = 0;
+
+        float hitRate() const {
+            return (hits + misses > 0) ? float(double(hits) / double(hits + misses)) : 0.0f;
+        }
+    };
+
+    /** A texture registered with addSource(). Release the last reference to let advanceEpoch()
+        free its tiles. */
+    class Source : public ReferenceCountedObject {
+    protected:
+        friend class TextureTileCache;
+
+        class Level {
+        public:
+            int                     width = 0;
+            int                     height = 0;
+            int                     tilesX = 0;
+            int                     tilesY = 0;
+
+            /** tilesX * tilesY slots, owned by the Source */
+            std::atomic<Tile*>*     tile = nullptr;
+        };
+
+        int                         m_width;
+        int                         m_height;
+        WrapMode                    m_wrapMode;
+        TexelFunction               m_texelFunction;
+        Array<Level>                m_level;
+
+        Source(int width, int height, WrapMode wrapMode, const TexelFunction& texelFunction);
+
+    public:
+
+        virtual ~Source();
+
+        int width() const {
+            return m_width;
+        }
+
+        int height() const {
+            return m_height;
+        }
+
+        int numLevels() const {
+            return m_level.size();
+        }
+
+        /** MIP level at which a footprint \a texCoordWidth wide, in normalized texture
+            coordinates, covers about one texel. Not clamped. */
+        float levelForFootprint(float texCoordWidth) const {
+            return log2(max(texCoordWidth * float(max(m_width, m_height)), 1e-20f));
+        }
+    };
+
+protected:
+
+    class Tile {
+    public:
+        Color4                      texel[TILE_SIZE * TILE_SIZE];
+
+        /** Value of m_clock when last looked up */
+        std::atomic<uint32>         lastUse;
+
+        /** Where this tile is published, for eviction */
+        std::atomic<Tile*>*         slot = nullptr;
+
+        Source*                     source = nullptr;
+    };
+
+    /** Lookup counters, striped across threads so that hits do not contend on one cache line */
+    class alignas(64) Counter {
+    public:
+        std::atomic<uint64>         hits;
+        Counter() : hits(0) {}
+    };
+
+    enum { NUM_COUNTERS = 32 };
+
+    Counter                         m_counter[NUM_COUNTERS];
+
+    /** Protects everything below */
+    mutable std::mutex              m_mutex;
+
+    Array<shared_ptr<Source>>       m_sourceArray;
+
+    /** Published tiles */
+    Array<Tile*>                    m_resident;
+
+    /** Evicted tiles awaiting advanceEpoch() */
+    Array<Tile*>                    m_retired;
+
+    std::atomic<size_t>             m_budgetBytes;
+    uint64                          m_misses = 0;
+    uint64                          m_evictions = 0;
+
+    /** Incremented on every miss; orders tiles for LRU eviction */
+    std::atomic<uint32>             m_clock;
+
+    TextureTileCache(size_t budgetBytes);
+
+    /** Returns the tile, creating it if it is not resident */
+    Tile* tile(Source& source, int level, int tx, int ty);
+
+    /** Fills a new tile's texels */
+    void fillTile(Source& source, int level, int tx, int ty, Tile* t);
+
+    /** Evicts least recently used tiles until under budget, unless a budget's worth of tiles is
+        already retired. Requires m_mutex. */
+    void evict();
+
+    /** Texel at integer coordinates, after wrapping */
+    Color4 texel(Source& source, int level, int x, int y);
+
+    Color4 bilinear(Source& source, int level, const Vector2& texCoord);
+
+public:
+
+    static shared_ptr<TextureTileCache> create(size_t budgetBytes = 256 * 1024 * 1024);
+
+    /** Shared by Component::sample(). Its budget starts at zero, which disables it. */
+    static const shared_ptr<TextureTileCache>& global();
+
+    virtual ~TextureTileCache();
+
+    /** \param wrapMode TILE or CLAMP. Other modes are treated as CLAMP. */
+    shared_ptr<Source> addSource(int width, int height, WrapMode wrapMode, const TexelFunction& texelFunction);
+
+    /** Trilinear sample at normalized texture coordinate \a texCoord, where texel centers are
+        at half-integers as on the GPU. \a level is clamped to the available MIP levels. */
+    Color4 sample(Source& source, const Vector2& texCoord, float level);
+
+    /** Changing the budget does not evict until the next miss */
+    void setMemoryBudget(size_t bytes) {
+        m_budgetBytes = bytes;
+    }
+
+    size_t memoryBudget() const {
+        return m_budgetBytes;
+    }
+
+    /** True if the budget is nonzero */
+    bool enabled() const {
+        return m_budgetBytes > 0;
+    }
+
+    /** Frees evicted tiles and sources that are no longer referenced outside of the cache, and
+        evicts down to the budget. Must not be called concurrently with sample(). */
+    void advanceEpoch();
+
+    /** Evicts and frees every tile. Must not be called concurrently with sample(). */
+    void clear();
+
+    Stats stats() const;
+
+    void resetStats();
+};
+
+} // namespace G3D
@@ -105,7 +105,8 @@ public:
         return m_triArray[i];
     }
 
-    int size() const {
+    /** Number of triangles. Subclasses that do not store every triangle in triArray() override this. */
+    virtual int size() const {
         return m_triArray.size();
     }
 
@@ -159,7 +160,11 @@ public:
          Array<Hit>&                        results,
          IntersectRayOptions                options         = IntersectRayOptions(0)) const = 0;
 
-    /** Values in results will be reused if already allocated, which can increase performance*/
+    /** Values in results will be reused if already allocated, which can increase performance.
+
+        \param coneBuffer Empty, or one element per ray: the cosine of the half-angle of the cone
+        about the ray direction, used to select a MIP level at the intersection when
+        TextureTileCache::global() is enabled. */
     virtual void intersectRays
         (const Array<Ray>&                  rays,
          Array<shared_ptr<Surfel>>&         results,
@@ -287,7 +292,7 @@ public:
         (const Sphere&                      sphere,
          Array<Tri>&                        triArray) const = 0;
 
-    void sample(const Hit& hit, shared_ptr<Surfel>& surfel) const;
+    virtual void sample(const Hit& hit, shared_ptr<Surfel>& surfel) const;
 
     /** Create an instance of whatever is the fastest implementation subclass for this machine.
         \param preferGPUData If true, use an implementation that is fast for ray buffers already on the GPU. */
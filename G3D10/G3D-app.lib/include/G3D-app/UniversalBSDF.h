@@ -254,6 +254,10 @@ public:
         Called from G3DMaterial::setStorage(). */
     virtual void setStorage(ImageStorage s) const;
 
+    /** \brief Orders lazy loading of the textures. Called from UniversalMaterial::setLoadingPriority().
+        \sa Texture::setLoadingPriority */
+    virtual void setLoadingPriority(bool visible, float projectedScreenArea) const;
+
     /** \brief Return true if there is any glossy (non-Lambertian, non-mirror) 
         reflection from this BSDF. */
     bool hasGlossy() const;
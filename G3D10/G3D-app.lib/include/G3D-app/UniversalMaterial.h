@@ -531,6 +531,9 @@ public:
 
     void setStorage(ImageStorage s) const override;
 
+    /** Orders lazy loading of every texture in the material. \sa Texture::setLoadingPriority */
+    void setLoadingPriority(bool visible, float projectedScreenArea) const;
+
     /** Never nullptr */
     const shared_ptr<UniversalBSDF>& bsdf() const {
         return m_bsdf;
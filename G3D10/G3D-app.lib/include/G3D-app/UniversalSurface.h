@@ -376,6 +376,8 @@ public:
 
     virtual TransparencyType transparencyType() const override;
 
+    virtual void setTextureLoadingPriority(bool visible, float projectedScreenArea) const override;
+
     shared_ptr<GPUGeom>& gpuGeom() {
         return m_gpuGeom;
     }
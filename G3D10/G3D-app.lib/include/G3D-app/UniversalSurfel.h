@@ -102,6 +102,9 @@ public:
     /** Primarily useful for constructing skybox surfels */
     static shared_ptr<UniversalSurfel> createEmissive(const Radiance3 emission, const Point3& position, const Vector3& normal);
 
+    /** \param du, dv Extent of the ray footprint in barycentric coordinates, used to select a
+        MIP level when TextureTileCache::global() is enabled. Zero samples the full-resolution
+        texture. */
     void sample(const Tri& tri, float u, float v, int triIndex, const CPUVertexArray& vertexArray, bool backside, const class UniversalMaterial* universalMaterial, float du = 0, float dv = 0);
 
     UniversalSurfel(const Tri& tri, float u, float v, int triIndex, const CPUVertexArray& vertexArray, bool backside, float du = 0, float dv = 0) {
@@ -10,10 +10,15 @@
 #pragma once
 #include "G3D-base/G3DString.h"
 #include "G3D-base/g3dmath.h"
+#include "G3D-base/enumclass.h"
 #include "G3D-base/Image.h"
+#include "G3D-base/Queue.h"
 #include "G3D-base/ReferenceCount.h"
 #include "G3D-base/Table.h"
 #include "G3D-gfx/Texture.h"
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 
 #ifndef G3D_NO_FFMPEG
 
@@ -27,11 +32,33 @@ struct AVStream;
 
 namespace G3D {
 
+class CPUPixelTransferBuffer;
+class GLPixelTransferBuffer;
+
 /** 
     \brief Creates video files such as mp4/h264 from provided frames or textures. 
+
+    When Settings::asynchronous is true, append() only copies the frame into
+    one of a small ring of reusable buffers and returns. Codec work then runs
+    on a dedicated encoder thread, so capture does not stall the frame loop.
+    commit() waits for all queued frames to be encoded.
+
+    The RenderDevice and Texture overloads of append() read back from the GPU
+    into a second ring of reusable GLPixelTransferBuffers and only map a buffer
+    once its transfer has completed, so a frame reaches the encoder up to
+    MAX_PENDING_READBACKS - 1 append() calls later.
  */
 class VideoOutput : public ReferenceCountedObject {
 public:
+    /** What append() does in asynchronous mode when Settings::maxQueuedFrames
+        frames are already waiting for the encoder thread.
+
+        - BLOCK: wait for the encoder thread to finish a frame (no frames are lost)
+        - DROP_NEWEST: discard the frame being appended
+        - DROP_OLDEST: discard the oldest frame still waiting in the queue
+    */
+    G3D_DECLARE_ENUM_CLASS(QueueFullPolicy, BLOCK, DROP_NEWEST, DROP_OLDEST);
+
     class Encoder {
     public:
         int codecId;
@@ -58,6 +85,16 @@ public:
         int bitrate;
         bool flipVertical;
 
+        /** If true, encode frames on a dedicated thread instead of inside append(). Default is false. */
+        bool asynchronous;
+
+        /** Maximum number of frames waiting for the encoder thread when asynchronous.
+            Also determines the number of preallocated frame buffers. Default is 4. */
+        int maxQueuedFrames;
+
+        /** Behavior of append() when the asynchronous queue is full. Default is BLOCK. */
+        QueueFullPolicy queueFullPolicy;
+
         Encoder encoder;
 
         void setBitrateQuality(float quality = 1.0f);
@@ -65,14 +102,97 @@ public:
         Settings();
     };
 
+    /** Counters for monitoring capture cost. Times are in seconds. \sa stats() */
+    class Stats {
+    public:
+        /** Number of frames passed to append() */
+        int         framesAppended;
+
+        /** Number of frames that have been sent to the codec */
+        int         framesEncoded;
+
+        /** Number of frames discarded by Settings::queueFullPolicy */
+        int         framesDropped;
+
+        /** Frames currently waiting for the encoder thread */
+        int         queueDepth;
+
+        /** Largest queueDepth observed */
+        int         maxQueueDepth;
+
+        /** Mean time spent in conversion and codec work per frame */
+        RealTime    averageEncodeTime;
+
+        RealTime    maxEncodeTime;
+
+        /** Mean time from append() until the frame was encoded, including time spent queued */
+        RealTime    averageLatency;
+
+        RealTime    maxLatency;
+
+        Stats() : framesAppended(0), framesEncoded(0), framesDropped(0), queueDepth(0), maxQueueDepth(0),
+            averageEncodeTime(0), maxEncodeTime(0), averageLatency(0), maxLatency(0) {}
+    };
+
 protected:
+
+    /** A frame waiting for the encoder thread */
+    class QueuedFrame {
+    public:
+        shared_ptr<CPUPixelTransferBuffer>  buffer;
+        RealTime                            appendTime;
+    };
+
+    /** A GPU to CPU transfer issued by append() that has not been mapped yet */
+    class PendingReadback {
+    public:
+        shared_ptr<GLPixelTransferBuffer>   buffer;
+        bool                                invertY;
+        RealTime                            appendTime;
+    };
+
+    /** Number of GPU readbacks that may be in flight before append() blocks on the oldest */
+    static const int MAX_PENDING_READBACKS = 3;
+
     VideoOutput(const String& filename, const Settings& settings);
 
     bool initialize();
     void shutdown();
 
     bool validSettings();
-    void encodeFrame(const uint8* pixels, const ImageFormat* format);
+
+    /** \param invertY If true, \a pixels is stored bottom row first */
+    void encodeFrame(const uint8* pixels, const ImageFormat* format, bool invertY);
+
+    /** Synchronous append() path */
+    void encodeImmediately(const uint8* pixels, const ImageFormat* format, bool invertY, RealTime appendTime);
+
+    /** Encodes on the calling thread and updates m_stats */
+    void encodeAndRecord(const uint8* pixels, const ImageFormat* format, bool invertY, RealTime appendTime);
+
+    /** Copies (and converts to RGB8, if needed) \a pixels into a ring buffer and queues it
+        for the encoder thread, applying Settings::queueFullPolicy. */
+    void enqueueFrame(const uint8* pixels, const ImageFormat* format, size_t srcStride, bool invertY, RealTime appendTime);
+
+    /** Sends \a pixels to enqueueFrame() or encodeImmediately() */
+    void appendPixels(const uint8* pixels, const ImageFormat* format, size_t srcStride, bool invertY, RealTime appendTime);
+
+    /** Returns an RGB8 readback buffer that is not in flight, first appending the oldest
+        pending readback if all of them are. */
+    shared_ptr<GLPixelTransferBuffer> acquireReadbackBuffer();
+
+    /** Appends the pending readbacks that have completed, oldest first. If \a wait is true,
+        blocks on and appends all of them. */
+    void appendCompletedReadbacks(bool wait);
+
+    /** Returns nullptr if the frame should be dropped. Called with m_queueMutex locked. */
+    shared_ptr<CPUPixelTransferBuffer> acquireFrameBuffer(std::unique_lock<std::mutex>& lock);
+
+    void encoderThreadMain();
+
+    /** If \a drain is true, encodes all queued frames before stopping the thread,
+        otherwise discards them. Safe to call when no thread is running. */
+    void stopEncoderThread(bool drain);
 
     String              m_filename;
     Settings            m_settings;
@@ -91,6 +211,28 @@ protected:
     AVFilterContext*    m_avBufferSink;
     AVFilterGraph*      m_avFilterGraph;
 
+    // asynchronous encoding
+    std::thread                                 m_encoderThread;
+
+    /** Protects m_pendingFrames, m_freeBuffers, m_quitEncoderThread, and m_stats */
+    mutable std::mutex                          m_queueMutex;
+
+    /** Signaled when a frame is queued, a buffer is freed, or the thread is told to quit */
+    std::condition_variable                     m_queueCondition;
+    Queue<QueuedFrame>                          m_pendingFrames;
+
+    /** Ring of reusable RGB8 buffers that are not currently queued or being encoded */
+    Array<shared_ptr<CPUPixelTransferBuffer>>   m_freeBuffers;
+    bool                                        m_quitEncoderThread;
+
+    Stats                                       m_stats;
+
+    /** GPU readbacks from append() in the order they were issued. Only accessed on the GL thread. */
+    Queue<PendingReadback>                      m_pendingReadbacks;
+
+    /** Readback buffers that are not in flight. Only accessed on the GL thread. */
+    Array<shared_ptr<GLPixelTransferBuffer>>    m_freeReadbackBuffers;
+
 public:
     /**
        Video files have a file format and a codec.  VideoOutput
@@ -105,6 +247,8 @@ public:
 
     const Settings& settings() const { return m_settings; }
 
+    /** Reads \a frame back asynchronously through a reusable GLPixelTransferBuffer.
+        Must be called on the GL thread. */
     void append(const shared_ptr<Texture>& frame, bool invertY = false); 
 
     void append(const shared_ptr<PixelTransferBuffer>& frame); 
@@ -115,16 +259,24 @@ public:
 
         @param useBackBuffer If true, read from the back
         buffer (the current frame) instead of the front buffer.
-        to be replaced/removed.
+
+        The pixels are read back asynchronously through a reusable
+        GLPixelTransferBuffer. Must be called on the GL thread.
      */
     void append(class RenderDevice* rd, bool useBackBuffer = false); 
 
-    /** Aborts writing video file and ends encoding */
+    /** Aborts writing video file and ends encoding. Frames still queued
+        for the encoder thread or still being read back are discarded. */
     void abort();
 
-    /** Finishes writing video file and ends encoding */
+    /** Finishes writing video file and ends encoding. Waits for pending GPU readbacks, and
+        in asynchronous mode, blocks until every queued frame has been encoded. Must be called
+        on the GL thread if a RenderDevice or Texture was appended. */
     void commit();
 
+    /** Thread-safe snapshot of the capture statistics */
+    Stats stats() const;
+
     bool finished()       { return m_isFinished; }
 
 };
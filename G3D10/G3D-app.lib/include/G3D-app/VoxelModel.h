@@ -15,6 +15,7 @@
 #include "G3D-base/ParseSchematic.h"
 namespace G3D {
 class VoxelSurface;
+class VoxelOctree;
 
 /**
   \sa VoxelSurface 
@@ -76,6 +77,9 @@ protected:
 
     /** Meters */
     float               m_voxelRadius;
+
+    /** CPU acceleration structure for intersect(), built by load() */
+    shared_ptr<VoxelOctree> m_octree;
     
     void copyToGPU();
         
@@ -133,6 +137,12 @@ public:
         return m_cpuPosition.size();
     }
 
+    /** Octree over the voxels for ray casting on the CPU, e.g., for picking or headless
+        rendering. Its voxel indices refer to the order in which the voxels are stored here. */
+    const shared_ptr<VoxelOctree>& octree() const {
+        return m_octree;
+    }
+
     void pose(Array<shared_ptr<Surface>>& surfaceArray, const shared_ptr<Entity>& entity = nullptr) const;
 
     /** For debugging */
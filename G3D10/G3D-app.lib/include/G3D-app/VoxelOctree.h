@@ -0,0 +1,150 @@
+/**
+  \file G3D-app.lib/include/G3D-app/VoxelOctree.h
+
+  G3D Innovation Engine http://casual-effects.com/g3d
+  Copyright 2000-2019, Morgan McGuire
+  All rights reserved
+  Available under the BSD License
+*/
+#pragma once
+#define GLG3D_VoxelOctree_h
+
+#include "G3D-base/platform.h"
+#include "G3D-base/ReferenceCount.h"
+#include "G3D-base/Array.h"
+#include "G3D-base/AABox.h"
+#include "G3D-base/Vector3.h"
+#include "G3D-base/Vector3int16.h"
+#include "G3D-base/Vector3int32.h"
+#include "G3D-base/Color4unorm8.h"
+
+namespace G3D {
+
+class Ray;
+
+/** \brief CPU sparse voxel octree for ray casting VoxelModel data without a GPU.
+
+    The tree is built in parallel by sorting the voxels along a Morton (Z-order) curve and
+    then collapsing runs of shared prefixes one level at a time. No pointers are stored:
+    each interior node holds an 8-bit mask of its occupied children and the index of the
+    first of them in the next level, where the children are contiguous. A child's index is
+    that first index plus the number of occupied children before it in the mask. This is
+    five bytes per interior node plus a color per node for level-of-detail queries.
+
+    Level 0 is the root and level depth() holds one node per voxel. Voxel \a p occupies the
+    object-space cube centered on <code>2 * voxelRadius * p</code>, matching VoxelModel.
+
+    Ray casts visit children front to back, so they stop at the first occupied leaf. Passing
+    a \a maxLevel less than depth() treats every occupied node at that level as solid, which
+    is a cheap way to trace coarse versions of the model, e.g., for secondary rays.
+
+    \sa VoxelModel, SVO, TriTree
+*/
+class VoxelOctree : public ReferenceCountedObject {
+public:
+
+    class Hit {
+    public:
+        /** Object-space distance along the ray. finf() on a miss. */
+        float           distance = finf();
+
+        /** Object-space normal of the face through which the ray entered */
+        Vector3         normal = Vector3::nan();
+
+        /** Index into the arrays that the tree was built from, or -1 if the hit was at a
+            coarser level than depth() or the ray missed. */
+        int             voxelIndex = -1;
+
+        /** Level of the node hit */
+        int             level = -1;
+
+        /** Color of the voxel, or the average color of the node for coarse levels */
+        Color4unorm8    color;
+
+        bool hit() const {
+            return level >= 0;
+        }
+    };
+
+protected:
+
+    /** One level of interior nodes, as a structure of arrays */
+    class Level {
+    public:
+        Array<uint8>        childMask;
+
+        /** Index in the next level of this node's first child */
+        Array<uint32>       firstChild;
+
+        /** Average color of the children */
+        Array<Color4unorm8> color;
+    };
+
+    /** Interior levels 0 .. m_depth - 1 */
+    Array<Level>            m_level;
+
+    /** Colors of the leaves, in Morton order */
+    Array<Color4unorm8>     m_leafColor;
+
+    /** Index of each leaf in the source arrays */
+    Array<int>              m_leafVoxelIndex;
+
+    /** Voxel coordinate of the low corner of the root */
+    Point3int32             m_origin;
+
+    /** Number of interior levels. The root has edge length 2^m_depth voxels. */
+    int                     m_depth = 0;
+
+    float                   m_voxelRadius = 0.0f;
+
+    AABox                   m_bounds;
+
+    VoxelOctree(const Array<Point3int16>& position, const Array<Color4unorm8>& color, float voxelRadius);
+
+    /** Traverses in grid space, where leaf cells are unit cubes and the root is [0, 2^m_depth]^3 */
+    bool intersectGrid(const Point3& origin, const Vector3& direction, float minDistance, float maxDistance, int maxLevel, Hit& hit) const;
+
+public:
+
+    /** \param position Voxel coordinates. Duplicates are ignored after the first.
+        \param color One per position */
+    static shared_ptr<VoxelOctree> create(const Array<Point3int16>& position, const Array<Color4unorm8>& color, float voxelRadius);
+
+    /** Number of levels below the root. Leaves are at this level. */
+    int depth() const {
+        return m_depth;
+    }
+
+    /** Number of nodes at \a level, which is on [0, depth()] */
+    int numNodes(int level) const {
+        return (level == m_depth) ? m_leafColor.size() : m_level[level].childMask.size();
+    }
+
+    /** Number of distinct voxels */
+    int numVoxels() const {
+        return m_leafColor.size();
+    }
+
+    /** Bytes of heap memory used by the nodes */
+    size_t sizeInBytes() const;
+
+    /** Object-space bounds of the voxels */
+    const AABox& bounds() const {
+        return m_bounds;
+    }
+
+    /** Finds the first voxel hit by \a ray, which is in object space, between its minimum and
+        maximum distances.
+
+        \param maxLevel Treat occupied nodes at this level as solid. Negative values mean depth(). */
+    bool intersectRay(const Ray& ray, Hit& hit, int maxLevel = -1) const;
+
+    /** Casts all of the rays in parallel. \a hitArray is resized to match. */
+    void intersectRays(const Array<Ray>& rayArray, Array<Hit>& hitArray, int maxLevel = -1, bool multithreaded = true) const;
+
+    /** Color of the node at \a level containing the object-space point \a P.
+        \return false if that node is empty. */
+    bool lodColor(const Point3& P, int level, Color4unorm8& color) const;
+};
+
+} // namespace G3D
@@ -10,7 +10,9 @@
 #include "G3D-base/Ray.h"
 #include "G3D-base/FileSystem.h"
 #include "G3D-base/Stopwatch.h"
+#include "G3D-gfx/GLThreadQueue.h"
 #include "G3D-app/GApp.h"
+#include <mutex>
 
 namespace G3D {
 
@@ -29,9 +31,20 @@ String ArticulatedModel::resolveRelativeFilename(const String& filename, const S
 }
 
 
-Table<ArticulatedModel::Specification, shared_ptr<ArticulatedModel> > s_cache;
+/** A cached model. Its mutex is held while the model loads, so that concurrent
+    requests for the same specification wait for one load instead of each starting their own. */
+class ArticulatedModelCacheEntry {
+public:
+    std::mutex                      mutex;
+    shared_ptr<ArticulatedModel>    model;
+};
+
+/** Protects s_cache but not its entries, so that different models can load concurrently */
+static std::mutex s_cacheMutex;
+static Table<ArticulatedModel::Specification, shared_ptr<ArticulatedModelCacheEntry> > s_cache;
 
 void ArticulatedModel::clearCache() {
+    std::lock_guard<std::mutex> lock(s_cacheMutex);
     s_cache.clear();
 }
 
@@ -42,8 +55,14 @@ shared_ptr<ArticulatedModel> ArticulatedModel::loadArticulatedModel(const Articu
     if (n.empty()) {
         a->m_name = FilePath::base(specification.filename);
     }
-    
-    a->load(specification);
+
+    const String& ext = toLower(FilePath::ext(specification.filename));
+    if ((ext == "bsp") || (ext == "dae") || (ext == "fbx") || (ext == "lwo") || (ext == "ase") || (ext == "glb") || (ext == "gltf")) {
+        // These importers create and render to textures directly, so they must run on the GL thread
+        GLThreadQueue::run([&] { a->load(specification); });
+    } else {
+        a->load(specification);
+    }
 
     if (! n.empty()) {
         a->m_name = n;
@@ -65,12 +84,23 @@ lazy_ptr<Model> ArticulatedModel::lazyCreate(const ArticulatedModel::Specificati
 
 shared_ptr<ArticulatedModel> ArticulatedModel::create(const ArticulatedModel::Specification& specification, const String& n) {
     if (specification.cachable) {
-        bool created = false;
-        shared_ptr<ArticulatedModel>& a = s_cache.getCreate(specification, created);
-        if (created) {
-            a = loadArticulatedModel(specification, n);
+        shared_ptr<ArticulatedModelCacheEntry> entry;
+        {
+            std::lock_guard<std::mutex> lock(s_cacheMutex);
+            bool created = false;
+            shared_ptr<ArticulatedModelCacheEntry>& e = s_cache.getCreate(specification, created);
+            if (created) {
+                e.reset(new ArticulatedModelCacheEntry());
+            }
+            entry = e;
+        }
+
+        // If the load throws, the entry stays empty and the next request retries it
+        std::lock_guard<std::mutex> lock(entry->mutex);
+        if (isNull(entry->model)) {
+            entry->model = loadArticulatedModel(specification, n);
         }
-        return a;
+        return entry->model;
     } else {
         return loadArticulatedModel(specification, n);
     }
@@ -24,54 +24,56 @@ void ArticulatedModel::loadPLY(const Specification& specification) {
     Mesh*       mesh = addMesh("mesh", part, geom);
     mesh->material = UniversalMaterial::create();
     
-    ParsePLY parseData;
-    {
-        BinaryInput bi(specification.filename, G3D_LITTLE_ENDIAN);
-        parseData.parse(bi);
-    }
-
-    // Convert the format
-    
-    geom->cpuVertexArray.vertex.resize(parseData.numVertices);
-    geom->cpuVertexArray.hasTangent = false;
-    geom->cpuVertexArray.hasTexCoord0 = false;
-     
     // The PLY format is technically completely flexible, so we have
     // to search for the location of the X, Y, and Z fields within each
     // vertex.
     int axisIndex[3];
     const String axisName[3] = {"x", "y", "z"};
-    const int numVertexProperties = parseData.vertexProperty.size();
-    for (int a = 0; a < 3; ++a) {
-        axisIndex[a] = 0;
-        for (int p = 0; p < numVertexProperties; ++p) {
-            if (parseData.vertexProperty[p].name == axisName[a]) {
-                axisIndex[a] = p;
-                break;
+    
+    geom->cpuVertexArray.hasTangent = false;
+    geom->cpuVertexArray.hasTexCoord0 = false;
+
+    // Convert the vertices as they are read instead of holding all of the parsed properties
+    ParsePLY parseData;
+    {
+        BinaryInput bi(specification.filename, G3D_LITTLE_ENDIAN);
+        parseData.parse(bi, [&](int firstVertex, int count, const float* data) {
+            const int numVertexProperties = parseData.vertexProperty.size();
+            if (firstVertex == 0) {
+                for (int a = 0; a < 3; ++a) {
+                    axisIndex[a] = 0;
+                    for (int p = 0; p < numVertexProperties; ++p) {
+                        if (parseData.vertexProperty[p].name == axisName[a]) {
+                            axisIndex[a] = p;
+                            break;
+                        }
+                    }
+                }
+                geom->cpuVertexArray.vertex.resize(parseData.numVertices);
             }
-        }
-    }
 
-    for (int v = 0; v < parseData.numVertices; ++v) {
-        CPUVertexArray::Vertex& vertex = geom->cpuVertexArray.vertex[v];
+            for (int i = 0; i < count; ++i) {
+                CPUVertexArray::Vertex& vertex = geom->cpuVertexArray.vertex[firstVertex + i];
 
-        // Read the position
-        for (int a = 0; a < 3; ++a) {
-            vertex.position[a] = parseData.vertexData[v * numVertexProperties + axisIndex[a]];
-        }
+                // Read the position
+                for (int a = 0; a < 3; ++a) {
+                    vertex.position[a] = data[i * numVertexProperties + axisIndex[a]];
+                }
 
-        // Flag the normal as undefined 
-        vertex.normal.x = fnan();
+                // Flag the normal as undefined 
+                vertex.normal.x = fnan();
+            }
+        });
     }
 
     if (parseData.numFaces > 0) {
         // Read faces
         for (int f = 0; f < parseData.numFaces; ++f) {
-            const ParsePLY::Face& face = parseData.faceArray[f];
+            const int* face = parseData.faceIndices(f);
         
             // Read and tessellate into triangles, assuming convex polygons
-            for (int i = 2; i < face.size(); ++i) {
-                mesh->cpuIndexArray.append(face[0], face[1], face[i]);
+            for (int i = 2; i < parseData.faceSize(f); ++i) {
+                mesh->cpuIndexArray.append(face[0], face[i - 1], face[i]);
             }
         }
 
@@ -10,6 +10,7 @@
 #include "G3D-base/AreaMemoryManager.h"
 #include "G3D-app/ArticulatedModel.h"
 #include "G3D-base/FastPointHashGrid.h"
+#include "G3D-base/radixSort.h"
 
 namespace G3D {
     
@@ -623,30 +624,26 @@ void ArticulatedModel::Geometry::computeMissingTangents(const Array<Mesh*> affec
     
  }
 
- 
-void ArticulatedModel::Geometry::mergeVertices(const Array<Face>& faceArray, float maxNormalWeldAngle, const Array<Mesh*> affectedMeshes) {
-    // Clear all mesh index arrays
-    for (int m = 0; m < affectedMeshes.size(); ++m) {
-        Mesh* mesh = affectedMeshes[m];
-        mesh->cpuIndexArray.fastClear();
-        mesh->gpuIndexArray = IndexStream();
-    }
+typedef ArticulatedModel::Geometry::Face AMFace;
 
-    // Clear the CPU vertex array
-    cpuVertexArray.vertex.fastClear();
-    cpuVertexArray.texCoord1.fastClear();
-    cpuVertexArray.vertexColors.fastClear();
-    cpuVertexArray.boneIndices.fastClear();
-    cpuVertexArray.boneWeights.fastClear();
+/** True if the normals of two vertices that match in all other properties are close enough to weld */
+static bool normalsWeldable(const Vector3& a, const Vector3& b, float normalClosenessThreshold) {
+    return (a.dot(b) >= normalClosenessThreshold) || a.isZero() || b.isZero();
+}
 
-    Stopwatch timer;
-    timer.setEnabled(false);
+
+/** Reference implementation for mergeVertices. Appends the unique vertices to cpuVertexArray
+    and writes the index of each face vertex in it to vertexIndex[3 * f + v]. */
+static void matchVerticesSerial
+   (const Array<AMFace>&    faceArray,
+    float                   normalClosenessThreshold,
+    CPUVertexArray&         cpuVertexArray,
+    Array<int>&             vertexIndex) {
 
     // Track the location of vertices in cpuVertexArray by their exact texcoord and position.
     // The vertices in the list may have differing normals.
-    typedef int VertexIndex;
-    typedef SmallArray<VertexIndex, 4> VertexIndexList;
-    Table<Face::Vertex, VertexIndexList, Face::AMFaceVertexHash, Face::AMFaceVertexHash> vertexIndexTable;
+    typedef SmallArray<int, 4> VertexIndexList;
+    Table<AMFace::Vertex, VertexIndexList, AMFace::AMFaceVertexHash, AMFace::AMFaceVertexHash> vertexIndexTable;
 
     // Almost all of the time in this method is spent deallocating the table at
     // the end, so use an AreaMemoryManager to directly dump the allocated memory
@@ -656,16 +653,9 @@ void ArticulatedModel::Geometry::mergeVertices(const Array<Face>& faceArray, flo
     // Conservative estimate of the size (overallocation here is bad for large models on low RAM systems (such as San Miguel on a standard 8GB RAM computer)
     vertexIndexTable.setSizeHint(faceArray.size() / 6); 
 
-    const float normalClosenessThreshold = cos(maxNormalWeldAngle);
-
-    // Iterate over all faces
-    int longestListLength = 0;
     for (int f = 0; f < faceArray.size(); ++f) {
-        const Face& face = faceArray[f];
-        Mesh* mesh = face.mesh;
-        int vertexIndex[3];
         for (int v = 0; v < 3; ++v) {
-            const Face::Vertex& vertex = face.vertex[v];
+            const AMFace::Vertex& vertex = faceArray[f].vertex[v];
 
             // Find the location of this vertex in cpuVertexArray...or add it.
             // The texture coordinates and vertices must exactly match.
@@ -675,13 +665,10 @@ void ArticulatedModel::Geometry::mergeVertices(const Array<Face>& faceArray, flo
 
             int index = -1;
             for (int i = 0; i < list.size(); ++i) {
-                int j = list[i];
                 // See if the normals are close (we know that the texcoords and positions match exactly)
-                const Vector3& otherNormal = cpuVertexArray.vertex[j].normal;
-                if ((otherNormal.dot(vertex.normal) >= normalClosenessThreshold) 
-                    || otherNormal.isZero() || vertex.normal.isZero()) { 
+                if (normalsWeldable(cpuVertexArray.vertex[list[i]].normal, vertex.normal, normalClosenessThreshold)) {
                     // Reuse this vertex
-                    index = j;
+                    index = list[i];
                     break;
                 }
             }
@@ -701,22 +688,273 @@ void ArticulatedModel::Geometry::mergeVertices(const Array<Face>& faceArray, flo
                     cpuVertexArray.boneWeights.append(vertex.boneWeights);
                 }
                 list.append(index);
-                longestListLength = max(longestListLength, list.size());
             }
 
-            // Add this vertex index to the mesh
-            vertexIndex[v] = index;
+            vertexIndex[3 * f + v] = index;
         }
+    }
+}
+
 
-        // Add only non-degenerate triangles
-        if ((vertexIndex[0] != vertexIndex[1]) && (vertexIndex[1] != vertexIndex[2]) && (vertexIndex[2] != vertexIndex[0])) {
-            mesh->cpuIndexArray.append(vertexIndex[0], vertexIndex[1], vertexIndex[2]);
+/** Bit pattern of \a f for hashing, with -0 mapped to +0 because they compare equal */
+static uint32 hashBits(float f) {
+    if (f == 0.0f) {
+        return 0;
+    }
+    uint32 bits;
+    System::memcpy(&bits, &f, sizeof(bits));
+    return bits;
+}
+
+
+static void hashCombine(uint64& h, uint32 x) {
+    h = (h ^ x) * 0x100000001B3ULL;
+    h ^= h >> 29;
+}
+
+
+/** 64-bit sort key for grouping vertices that the serial Table in matchVerticesSerial could
+    place in the same list. The Table only compares vertices with equal
+    AMFaceVertexHash::hashCode values, so that is the start of the key. It does not hash colors
+    or bones, so they are added here to avoid long runs of colliding keys. */
+static uint64 vertexKey(const AMFace::Vertex& vertex) {
+    uint64 h = 0xCBF29CE484222325ULL;
+    const uint64 tableHash = uint64(AMFace::AMFaceVertexHash::hashCode(vertex));
+    hashCombine(h, uint32(tableHash));
+    hashCombine(h, uint32(tableHash >> 32));
+    for (int i = 0; i < 4; ++i) { hashCombine(h, hashBits(vertex.vertexColor[i])); }
+    for (int i = 0; i < 4; ++i) { hashCombine(h, hashBits(vertex.boneWeights[i])); }
+    for (int i = 0; i < 4; ++i) { hashCombine(h, uint32(vertex.boneIndices[i])); }
+    // Final avalanche so that the low digits used by the first radix passes are well mixed
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+    return h;
+}
+
+
+/** 
+  Parallel implementation of matchVerticesSerial that produces exactly the same output.
+
+  1. Compute a 64-bit key for every face vertex from the properties that must match exactly.
+  2. Radix sort the (key, face vertex) pairs. The sort is stable, so each run of equal keys
+     lists its face vertices in the order that the serial algorithm would visit them.
+  3. Within each run, independently and in parallel, apply the serial first-fit normal test.
+     Each face vertex records the first face vertex (its "creator") that introduced the
+     output vertex it welds to.
+  4. Number the creators in face order with a parallel prefix sum, which reproduces the
+     order in which the serial algorithm appends vertices, and scatter them to cpuVertexArray.
+*/
+static void matchVerticesParallel
+   (const Array<AMFace>&    faceArray,
+    float                   normalClosenessThreshold,
+    CPUVertexArray&         cpuVertexArray,
+    Array<int>&             vertexIndex) {
+
+    const int numFaceVertices = faceArray.size() * 3;
+    if (numFaceVertices == 0) {
+        return;
+    }
+
+    const auto faceVertex = [&](int i) -> const AMFace::Vertex& {
+        return faceArray[i / 3].vertex[i % 3];
+    };
+
+    Stopwatch timer;
+    timer.setEnabled(false);
+
+    // Divide the face vertices into blocks for the passes that are not naturally parallel
+    const int numBlocks = clamp(numFaceVertices / (1 << 14), 1, 256);
+    const int blockSize = (numFaceVertices + numBlocks - 1) / numBlocks;
+    const bool singleThread = (numBlocks == 1);
+
+    class KeyedVertex {
+    public:
+        uint64  key;
+        int     index;
+    };
+
+    Array<KeyedVertex> sorted;
+    sorted.resize(numFaceVertices);
+    runConcurrently(0, numBlocks, [&](int b) {
+        const int end = min(numFaceVertices, (b + 1) * blockSize);
+        for (int i = b * blockSize; i < end; ++i) {
+            sorted[i].key   = vertexKey(faceVertex(i));
+            sorted[i].index = i;
         }
+    }, singleThread);
+    timer.printElapsedTime("    vertexKey");
+
+    radixSort(sorted, [](const KeyedVertex& k) { return k.key; });
+    timer.printElapsedTime("    radixSort");
+
+    // creator[i] is the face vertex whose output vertex face vertex i welds to. 
+    // It is always <= i. This shares storage with vertexIndex, which the final
+    // pass overwrites element by element.
+    Array<int>& creator = vertexIndex;
+
+    // Each block resolves the runs that begin inside it, even if they extend past its end
+    runConcurrently(0, numBlocks, [&](int b) {
+        SmallArray<int, 8>    creatorsInRun;
+        SmallArray<size_t, 8> creatorHashInRun;
+        const int end = min(numFaceVertices, (b + 1) * blockSize);
+        int s = b * blockSize;
+
+        // Skip the tail of a run that began in the previous block
+        while ((s > 0) && (s < end) && (sorted[s].key == sorted[s - 1].key)) {
+            ++s;
+        }
+
+        while (s < end) {
+            int e = s + 1;
+            while ((e < numFaceVertices) && (sorted[e].key == sorted[s].key)) {
+                ++e;
+            }
+
+            if (e == s + 1) {
+                // Unique vertex
+                creator[sorted[s].index] = sorted[s].index;
+                s = e;
+                continue;
+            }
+
+            creatorsInRun.clear(false);
+            creatorHashInRun.clear(false);
+            for (int r = s; r < e; ++r) {
+                const int i = sorted[r].index;
+                const AMFace::Vertex& vertex = faceVertex(i);
+                const size_t hash = AMFace::AMFaceVertexHash::hashCode(vertex);
+
+                int c = i;
+                for (int k = 0; k < creatorsInRun.size(); ++k) {
+                    const AMFace::Vertex& other = faceVertex(creatorsInRun[k]);
+                    // Sort keys may collide, so apply the same test as the Table
+                    if ((creatorHashInRun[k] == hash) &&
+                        AMFace::AMFaceVertexHash::equals(other, vertex) && 
+                        normalsWeldable(other.normal, vertex.normal, normalClosenessThreshold)) {
+                        c = creatorsInRun[k];
+                        break;
+                    }
+                }
+
+                if (c == i) {
+                    creatorsInRun.append(i);
+                    creatorHashInRun.append(hash);
+                }
+                creator[i] = c;
+            }
+            s = e;
+        }
+    }, singleThread);
+    sorted.clear();
+    timer.printElapsedTime("    resolve runs");
+
+    // Exclusive prefix sum over the number of creators in each block
+    Array<int> blockStart;
+    blockStart.resize(numBlocks + 1);
+    blockStart[0] = 0;
+    runConcurrently(0, numBlocks, [&](int b) {
+        int count = 0;
+        const int end = min(numFaceVertices, (b + 1) * blockSize);
+        for (int i = b * blockSize; i < end; ++i) {
+            count += (creator[i] == i) ? 1 : 0;
+        }
+        blockStart[b + 1] = count;
+    }, singleThread);
+    for (int b = 0; b < numBlocks; ++b) {
+        blockStart[b + 1] += blockStart[b];
     }
 
-   // debugPrintf("average bucket size = %f\n", vertexIndexTable.debugGetAverageBucketSize());
-   // debugPrintf("deepest bucket size = %d\n", vertexIndexTable.debugGetDeepestBucketSize());
-   // debugPrintf("longestListLength = %d\n", longestListLength);
+    const int numVertices = blockStart[numBlocks];
+    cpuVertexArray.vertex.resize(numVertices);
+    if (cpuVertexArray.hasTexCoord1) {
+        cpuVertexArray.texCoord1.resize(numVertices);
+    }
+    if (cpuVertexArray.hasVertexColors) {
+        cpuVertexArray.vertexColors.resize(numVertices);
+    }
+    if (cpuVertexArray.hasBones) {
+        cpuVertexArray.boneIndices.resize(numVertices);
+        cpuVertexArray.boneWeights.resize(numVertices);
+    }
+
+    // Number the creators in face order and copy them to the output
+    Array<int> outputIndex;
+    outputIndex.resize(numFaceVertices);
+    runConcurrently(0, numBlocks, [&](int b) {
+        int index = blockStart[b];
+        const int end = min(numFaceVertices, (b + 1) * blockSize);
+        for (int i = b * blockSize; i < end; ++i) {
+            if (creator[i] == i) {
+                const AMFace::Vertex& vertex = faceVertex(i);
+                cpuVertexArray.vertex[index] = vertex;
+                if (cpuVertexArray.hasTexCoord1) {
+                    cpuVertexArray.texCoord1[index] = vertex.texCoord1;
+                }
+                if (cpuVertexArray.hasVertexColors) {
+                    cpuVertexArray.vertexColors[index] = vertex.vertexColor;
+                }
+                if (cpuVertexArray.hasBones) {
+                    cpuVertexArray.boneIndices[index] = vertex.boneIndices;
+                    cpuVertexArray.boneWeights[index] = vertex.boneWeights;
+                }
+                outputIndex[i] = index;
+                ++index;
+            }
+        }
+    }, singleThread);
+
+    // Every creator precedes the face vertices that weld to it, but may be in another block,
+    // so this must be a separate pass.
+    runConcurrently(0, numBlocks, [&](int b) {
+        const int end = min(numFaceVertices, (b + 1) * blockSize);
+        for (int i = b * blockSize; i < end; ++i) {
+            vertexIndex[i] = outputIndex[creator[i]];
+        }
+    }, singleThread);
+    timer.printElapsedTime("    write vertices");
+}
+
+ 
+void ArticulatedModel::Geometry::mergeVertices(const Array<Face>& faceArray, float maxNormalWeldAngle, const Array<Mesh*> affectedMeshes, bool serial) {
+    // Clear all mesh index arrays
+    for (int m = 0; m < affectedMeshes.size(); ++m) {
+        Mesh* mesh = affectedMeshes[m];
+        mesh->cpuIndexArray.fastClear();
+        mesh->gpuIndexArray = IndexStream();
+    }
+
+    // Clear the CPU vertex array
+    cpuVertexArray.vertex.fastClear();
+    cpuVertexArray.texCoord1.fastClear();
+    cpuVertexArray.vertexColors.fastClear();
+    cpuVertexArray.boneIndices.fastClear();
+    cpuVertexArray.boneWeights.fastClear();
+
+    Stopwatch timer;
+    timer.setEnabled(false);
+
+    const float normalClosenessThreshold = cos(maxNormalWeldAngle);
+
+    // Index in cpuVertexArray of face vertex 3 * f + v
+    Array<int> vertexIndex;
+    vertexIndex.resize(faceArray.size() * 3);
+
+    if (serial) {
+        matchVerticesSerial(faceArray, normalClosenessThreshold, cpuVertexArray, vertexIndex);
+    } else {
+        matchVerticesParallel(faceArray, normalClosenessThreshold, cpuVertexArray, vertexIndex);
+    }
+    timer.printElapsedTime("  matchVertices");
+
+    // Rebuild the index arrays, adding only non-degenerate triangles
+    for (int f = 0; f < faceArray.size(); ++f) {
+        const int* index = vertexIndex.getCArray() + 3 * f;
+        if ((index[0] != index[1]) && (index[1] != index[2]) && (index[2] != index[0])) {
+            faceArray[f].mesh->cpuIndexArray.append(index[0], index[1], index[2]);
+        }
+    }
+    timer.printElapsedTime("  build index arrays");
 }
 
 
@@ -98,9 +98,16 @@ void DebugTextWidget::render(RenderDevice *rd) const {
 
                     const int swapTime = iRound(rd->swapBufferTimer().smoothElapsedTime() / units::milliseconds());
 
+                    // In pipelined mode, only the stall at the sync point adds to the frame time
+                    String sim = format("%4d ms Sim", s);
+                    if (m_app->frameLoopMode() == GApp::FrameLoopMode::PIPELINED) {
+                        const int stall = iRound(m_app->m_pipelineStallWatch.smoothElapsedTime() / units::milliseconds());
+                        sim += format(" (%d ms overlapped)", max(0, s - stall));
+                    }
+
                     const String& str =
-                        format("Time:%4d ms Gfx,%4d ms Swap,%4d ms Sim,%4d ms Pose,%4d ms AI,%4d ms Net,%4d ms UI,%4d ms idle",
-                        g, swapTime, s, p, L, n, u, w);
+                        format("Time:%4d ms Gfx,%4d ms Swap,%s,%4d ms Pose,%4d ms AI,%4d ms Net,%4d ms UI,%4d ms idle",
+                        g, swapTime, sim.c_str(), p, L, n, u, w);
                     m_app->debugFont->appendToCharVertexArray(charVertexArray, indexArray, rd, str, pos, size, statColor);
                 }
 
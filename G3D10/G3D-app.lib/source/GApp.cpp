@@ -130,7 +130,12 @@ void GApp::vscreenPrintf
         const Array<String>& newlineSeparatedStrings = stringSplit(s, '\n');
 
         std::lock_guard<std::mutex> guard(m_debugTextMutex);
-        debugText.append(newlineSeparatedStrings);
+        if ((m_frameLoopMode == FrameLoopMode::PIPELINED) && (std::this_thread::get_id() != m_mainThreadId)) {
+            // Hold text from the simulation until the frame that it produced is rendered
+            m_pipelinedDebugText.append(newlineSeparatedStrings);
+        } else {
+            debugText.append(newlineSeparatedStrings);
+        }
     }
 }
 
@@ -144,6 +149,7 @@ DebugID debugDraw
 
     if (GApp::current()) {
         debugAssert(shape);
+        std::lock_guard<std::mutex> guard(GApp::current()->m_debugShapeMutex);
         GApp::DebugShape& s = GApp::current()->debugShapeArray.next();
         s.shape             = shape;
         s.solidColor        = solidColor;
@@ -230,6 +236,7 @@ DebugID debugDrawLabel
  const GFont::YAlign yalign) {
 
     if (notNull(GApp::current())) {
+        std::lock_guard<std::mutex> guard(GApp::current()->m_debugShapeMutex);
         GApp::DebugLabel& L = GApp::current()->debugLabelArray.next();
         L.text = text;
 
@@ -442,6 +449,17 @@ GApp::GApp(const Settings& settings, OSWindow* window, RenderDevice* rd, bool cr
     m_lastDebugID(0),
     m_screenCapture(nullptr),
     m_submitToDisplayMode(SubmitToDisplayMode::MAXIMIZE_THROUGHPUT),
+    m_frameLoopMode(FrameLoopMode::SEQUENTIAL),
+    m_nextFrameLoopMode(FrameLoopMode::SEQUENTIAL),
+    m_mainThreadId(std::this_thread::get_id()),
+    m_renderingPipelined(false),
+    m_pipelinedPreviousSimTimeStep(1.0f / 60.0f),
+    m_pipelinedPreviousRealTimeStep(1.0f / 60.0f),
+    m_pipelinedRealTime(0),
+    m_pipelinedSimTime(0),
+    m_simulationPending(false),
+    m_simulationThreadQuit(false),
+    m_simulationTimeStep(0),
     m_settings(settings),
     m_renderPeriod(1),
     m_endProgram(false),
@@ -559,6 +577,23 @@ const SceneVisualizationSettings& GApp::sceneVisualizationSettings() const {
 }
 
 
+const LightingEnvironment& GApp::lightingEnvironment() const {
+    debugAssert(notNull(m_scene));
+    return renderingPipelinedOnThisThread() ? m_pipelinedLightingEnvironment : m_scene->lightingEnvironment();
+}
+
+
+shared_ptr<Entity> GApp::selectedEntity() const {
+    if (renderingPipelinedOnThisThread()) {
+        return m_pipelinedSelectedEntity;
+    } else if (notNull(developerWindow) && notNull(developerWindow->sceneEditorWindow)) {
+        return developerWindow->sceneEditorWindow->selectedEntity();
+    } else {
+        return nullptr;
+    }
+}
+
+
 void GApp::createDeveloperHUD() {
     alwaysAssertM(isNull(developerWindow), "Developer HUD has already been created");
 
@@ -755,6 +790,8 @@ shared_ptr<GFont> GApp::loadFont(const String& fontName) {
 
 
 GApp::~GApp() {
+    stopPipelinedSimulation();
+
     if (current() == this) {
         setCurrent(nullptr);
     }
@@ -1148,16 +1185,26 @@ void GApp::onGraphics3D(RenderDevice* rd, Array<shared_ptr<Surface> >& allSurfac
     m_gbuffer->resize(framebufferSize);
     m_gbuffer->prepare(rd, activeCamera(), 0, -(float)previousSimTimeStep(), m_settings.hdrFramebuffer.depthGuardBandThickness, m_settings.hdrFramebuffer.colorGuardBandThickness);
 
-    m_renderer->render(rd, activeCamera(), m_framebuffer, scene()->lightingEnvironment().ambientOcclusionSettings.enabled ? m_depthPeelFramebuffer : nullptr, 
-        scene()->lightingEnvironment(), m_gbuffer, allSurfaces);
+    m_renderer->render(rd, activeCamera(), m_framebuffer, lightingEnvironment().ambientOcclusionSettings.enabled ? m_depthPeelFramebuffer : nullptr, 
+        lightingEnvironment(), m_gbuffer, allSurfaces);
 
     // Debug visualizations and post-process effects
     rd->pushState(m_framebuffer); {
         // Call to make the App show the output of debugDraw(...)
         rd->setProjectionAndCameraMatrix(activeCamera()->projection(), activeCamera()->frame());
         drawDebugShapes();
-        const shared_ptr<Entity>& selectedEntity = (notNull(developerWindow) && notNull(developerWindow->sceneEditorWindow)) ? developerWindow->sceneEditorWindow->selectedEntity() : nullptr;
-        scene()->visualize(rd, selectedEntity, allSurfaces, sceneVisualizationSettings(), activeCamera());
+        const shared_ptr<Entity>& selected = selectedEntity();
+        if (renderingPipelinedOnThisThread() && ! sceneVisualizationSettings().showsEntities() && isNull(selected)) {
+            // The entities are simulating on another thread, and only the posed surfaces are needed
+            if (sceneVisualizationSettings().showWireframe) {
+                Surface::renderWireframe(rd, allSurfaces);
+            }
+        } else {
+            if (renderingPipelinedOnThisThread()) {
+                waitForPipelinedSimulation();
+            }
+            scene()->visualize(rd, selected, allSurfaces, sceneVisualizationSettings(), activeCamera());
+        }
 
         onPostProcessHDR3DEffects(rd);
     } rd->popState();
@@ -1280,86 +1327,84 @@ void GApp::resize(int w, int h) {
 }
 
 
-void GApp::oneFrame() {
-    for (int repeat = 0; repeat < max(1, m_renderPeriod); ++repeat) {
-        Profiler::nextFrame();
-        m_lastTime = m_now;
-        m_now = System::time();
-        RealTime timeStep = m_now - m_lastTime;
+RealTime GApp::advanceFrameTime() {
+    m_lastTime = m_now;
+    m_now = System::time();
+    return m_now - m_lastTime;
+}
 
-        // Logic
-        m_logicWatch.tick();
-        BEGIN_PROFILER_EVENT("GApp::onAI");
-        onAI();
+
+void GApp::userInputStage() {
+    m_userInputWatch.tick();
+    if (manageUserInput) {
+        processGEventQueue();
+    }
+    onAfterEvents();
+    onUserInput(userInput);
+    m_userInputWatch.tock();
+    
+    if (notNull(m_gazeTracker)) {
+        BEGIN_PROFILER_EVENT("GApp::sampleGazeTrackerData");
+        sampleGazeTrackerData();
         END_PROFILER_EVENT();
-        m_logicWatch.tock();
+    }
+}
 
-        // User input
-        m_userInputWatch.tick();
-        if (manageUserInput) {
-            processGEventQueue();
-        }
-        onAfterEvents();
-        onUserInput(userInput);
-        m_userInputWatch.tock();
-        
-        if (notNull(m_gazeTracker)) {
-            BEGIN_PROFILER_EVENT("GApp::sampleGazeTrackerData");
-            sampleGazeTrackerData();
-            END_PROFILER_EVENT();
-        }
 
-        // Network
-        BEGIN_PROFILER_EVENT("GApp::onNetwork");
-        m_networkWatch.tick();
-        onNetwork();
-        m_networkWatch.tock();
-        END_PROFILER_EVENT();
+void GApp::simulationTimeSteps(RealTime timeStep, RealTime& rdt, SimTime& sdt, SimTime& idt) const {
+    rdt = timeStep;
 
-        // Simulation
-        m_simulationWatch.tick();
-        BEGIN_PROFILER_EVENT("Simulation");
-        {
-            RealTime rdt = timeStep;
+    sdt = m_simTimeStep;
+    if (sdt == MATCH_REAL_TIME_TARGET) {
+        sdt = m_wallClockTargetDuration;
+    } else if (sdt == REAL_TIME) {
+        sdt = float(timeStep);
+    }
+    sdt *= m_simTimeScale;
+
+    idt = m_wallClockTargetDuration;
+}
 
-            SimTime sdt = m_simTimeStep;
-            if (sdt == MATCH_REAL_TIME_TARGET) {
-                sdt = m_wallClockTargetDuration;
-            } else if (sdt == REAL_TIME) {
-                sdt = float(timeStep);
-            }
-            sdt *= m_simTimeScale;
 
-            SimTime idt = m_wallClockTargetDuration;
+void GApp::simulationStage(RealTime timeStep, Stopwatch& watch) {
+    watch.tick();
+    BEGIN_PROFILER_EVENT("Simulation");
+    {
+        RealTime rdt;
+        SimTime sdt, idt;
+        simulationTimeSteps(timeStep, rdt, sdt, idt);
 
-            onBeforeSimulation(rdt, sdt, idt);
-            onSimulation(rdt, sdt, idt);
-            onAfterSimulation(rdt, sdt, idt);
+        onBeforeSimulation(rdt, sdt, idt);
+        onSimulation(rdt, sdt, idt);
+        onAfterSimulation(rdt, sdt, idt);
 
-            m_previousSimTimeStep = float(sdt);
-            m_previousRealTimeStep = float(rdt);
-            setRealTime(realTime() + rdt);
-            setSimTime(simTime() + sdt);
-        }
-        m_simulationWatch.tock();
-        END_PROFILER_EVENT();
+        m_previousSimTimeStep = float(sdt);
+        m_previousRealTimeStep = float(rdt);
+        setRealTime(realTime() + rdt);
+        setSimTime(simTime() + sdt);
     }
-    
-    // Pose
+    END_PROFILER_EVENT();
+    watch.tock();
+}
+
+
+void GApp::poseStage(Array<shared_ptr<Surface> >& posed3D, Array<shared_ptr<Surface2D> >& posed2D) {
     BEGIN_PROFILER_EVENT("Pose");
     m_poseWatch.tick(); {
-        m_posed3D.fastClear();
-        m_posed2D.fastClear();
-        onPose(m_posed3D, m_posed2D);
+        posed3D.fastClear();
+        posed2D.fastClear();
+        onPose(posed3D, posed2D);
 
         // The debug camera is not in the scene, so we have
         // to explicitly pose it. This actually does nothing, but
         // it allows us to trigger the TAA code.
-        m_debugCamera->onPose(m_posed3D);
+        m_debugCamera->onPose(posed3D);
     } m_poseWatch.tock();
     END_PROFILER_EVENT();
+}
+
 
-    // Wait
+void GApp::waitStage() {
     // Note: we might end up spending all of our time inside of
     // RenderDevice::beginFrame.  Waiting here isn't double waiting,
     // though, because while we're sleeping the CPU the GPU is working
@@ -1396,7 +1441,10 @@ void GApp::oneFrame() {
         }
     }  m_waitWatch.tock();
     END_PROFILER_EVENT();
+}
 
+
+void GApp::graphicsStage() {
     debugAssertGLOk();
     if ((submitToDisplayMode() == SubmitToDisplayMode::BALANCE) && (! renderDevice->swapBuffersAutomatically())) {
         swapBuffers();
@@ -1417,30 +1465,264 @@ void GApp::oneFrame() {
         swapBuffers();
     }
     END_PROFILER_EVENT();
+}
+
 
+void GApp::endFrameStage() {
     // Remove all expired debug shapes
-    for (int i = 0; i < debugShapeArray.size(); ++i) {
-        if (debugShapeArray[i].endTime <= m_now) {
-            debugShapeArray.fastRemove(i);
-            --i;
+    {
+        std::lock_guard<std::mutex> guard(m_debugShapeMutex);
+        for (int i = 0; i < debugShapeArray.size(); ++i) {
+            if (debugShapeArray[i].endTime <= m_now) {
+                debugShapeArray.fastRemove(i);
+                --i;
+            }
+        }
+
+        for (int i = 0; i < debugLabelArray.size(); ++i) {
+            if (debugLabelArray[i].endTime <= m_now) {
+                debugLabelArray.fastRemove(i);
+                --i;
+            }
         }
     }
 
-    for (int i = 0; i < debugLabelArray.size(); ++i) {
-        if (debugLabelArray[i].endTime <= m_now) {
-            debugLabelArray.fastRemove(i);
-            --i;
+    {
+        std::lock_guard<std::mutex> guard(m_debugTextMutex);
+        debugText.fastClear();
+    }
+
+    if (m_endProgram && window()->requiresMainLoop()) {
+        window()->popLoopBody();
+    }
+}
+
+
+void GApp::setFrameLoopMode(FrameLoopMode m) {
+    m_nextFrameLoopMode = m;
+}
+
+
+void GApp::oneFrame() {
+    if (m_nextFrameLoopMode != m_frameLoopMode) {
+        if (m_frameLoopMode == FrameLoopMode::PIPELINED) {
+            // The scene may not be touched by another thread in the other modes
+            stopPipelinedSimulation();
         }
+        m_frameLoopMode = m_nextFrameLoopMode;
     }
 
-    debugText.fastClear();
+    if (m_frameLoopMode == FrameLoopMode::PIPELINED) {
+        oneFramePipelined();
+        return;
+    } else if (m_frameLoopMode == FrameLoopMode::HEADLESS) {
+        oneFrameHeadless();
+        return;
+    }
+
+    for (int repeat = 0; repeat < max(1, m_renderPeriod); ++repeat) {
+        Profiler::nextFrame();
+        const RealTime timeStep = advanceFrameTime();
+
+        // Logic
+        m_logicWatch.tick();
+        BEGIN_PROFILER_EVENT("GApp::onAI");
+        onAI();
+        END_PROFILER_EVENT();
+        m_logicWatch.tock();
+
+        // User input
+        userInputStage();
+
+        // Network
+        BEGIN_PROFILER_EVENT("GApp::onNetwork");
+        m_networkWatch.tick();
+        onNetwork();
+        m_networkWatch.tock();
+        END_PROFILER_EVENT();
+
+        // Simulation
+        simulationStage(timeStep, m_simulationWatch);
+    }
+    
+    poseStage(m_posed3D, m_posed2D);
+    waitStage();
+    graphicsStage();
 
     m_posed3D.fastClear();
     m_posed2D.fastClear();
 
-    if (m_endProgram && window()->requiresMainLoop()) {
-        window()->popLoopBody();
+    endFrameStage();
+}
+
+
+void GApp::oneFramePipelined() {
+    // Sync point. Nothing below may read or write the scene until the simulation
+    // started by the previous frame has finished.
+    finishPipelinedSimulation();
+
+    Profiler::nextFrame();
+    const RealTime timeStep = advanceFrameTime();
+
+    m_logicWatch.tick();
+    BEGIN_PROFILER_EVENT("GApp::onAI");
+    onAI();
+    END_PROFILER_EVENT();
+    m_logicWatch.tock();
+
+    userInputStage();
+
+    BEGIN_PROFILER_EVENT("GApp::onNetwork");
+    m_networkWatch.tick();
+    onNetwork();
+    m_networkWatch.tock();
+    END_PROFILER_EVENT();
+
+    // The posed Surface2Ds draw the live widgets, so simulate them here instead of on the simulation thread
+    {
+        RealTime rdt;
+        SimTime sdt, idt;
+        simulationTimeSteps(timeStep, rdt, sdt, idt);
+        simulateWidgetsAndDebugCamera(rdt, sdt, idt);
+    }
+
+    // Pose the result of the previous simulation into the back buffer and then present it. The
+    // old front buffer keeps the previous frame's surfaces alive until the next pose.
+    poseStage(m_nextPosed3D, m_nextPosed2D);
+    m_posed3D.swap(m_nextPosed3D);
+    m_posed2D.swap(m_nextPosed2D);
+
+    // The simulation moves the active camera and the lights and advances the clocks while
+    // rendering reads them, so render from copies
+    if (isNull(m_pipelinedCamera)) {
+        m_pipelinedCamera = Camera::create("(Pipelined Camera)");
+    }
+    m_pipelinedCamera->copyParametersFrom(m_activeCamera);
+    m_pipelinedPreviousSimTimeStep  = m_previousSimTimeStep;
+    m_pipelinedPreviousRealTimeStep = m_previousRealTimeStep;
+    m_pipelinedRealTime             = m_realTime;
+    m_pipelinedSimTime              = m_simTime;
+    m_pipelinedSelectedEntity       = selectedEntity();
+    if (notNull(scene())) {
+        m_pipelinedLightingEnvironment = scene()->lightingEnvironment();
+        for (shared_ptr<Light>& light : m_pipelinedLightingEnvironment.lightArray) {
+            light = light->snapshot();
+        }
+    }
+
+    // Simulate the next frame on the simulation thread while this one renders
+    if (! m_simulationThread.joinable()) {
+        m_simulationThreadQuit = false;
+        m_simulationThread = std::thread([this]() { simulationThreadMain(); });
     }
+    {
+        std::lock_guard<std::mutex> lock(m_simulationMutex);
+        m_simulationTimeStep = timeStep;
+        m_simulationPending = true;
+    }
+    m_simulationCondition.notify_all();
+
+    m_renderingPipelined = true;
+    waitStage();
+    graphicsStage();
+    m_renderingPipelined = false;
+
+    endFrameStage();
+}
+
+
+void GApp::oneFrameHeadless() {
+    for (int repeat = 0; repeat < max(1, m_renderPeriod); ++repeat) {
+        Profiler::nextFrame();
+        const RealTime timeStep = advanceFrameTime();
+
+        m_logicWatch.tick();
+        BEGIN_PROFILER_EVENT("GApp::onAI");
+        onAI();
+        END_PROFILER_EVENT();
+        m_logicWatch.tock();
+
+        userInputStage();
+
+        BEGIN_PROFILER_EVENT("GApp::onNetwork");
+        m_networkWatch.tick();
+        onNetwork();
+        m_networkWatch.tock();
+        END_PROFILER_EVENT();
+
+        simulationStage(timeStep, m_simulationWatch);
+    }
+
+    // Nothing is posed or rendered; only hold the target frame rate
+    waitStage();
+    endFrameStage();
+}
+
+
+void GApp::simulationThreadMain() {
+    while (true) {
+        RealTime timeStep = 0;
+        {
+            std::unique_lock<std::mutex> lock(m_simulationMutex);
+            m_simulationCondition.wait(lock, [this]() { return m_simulationPending || m_simulationThreadQuit; });
+            if (m_simulationThreadQuit) {
+                break;
+            }
+            timeStep = m_simulationTimeStep;
+        }
+
+        // Divide the frame's real time among the render period's simulation steps
+        const int numSteps = max(1, m_renderPeriod);
+        for (int step = 0; step < numSteps; ++step) {
+            simulationStage(timeStep / numSteps, m_pipelinedSimulationWatch);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_simulationMutex);
+            m_simulationPending = false;
+        }
+        m_simulationCondition.notify_all();
+    }
+
+    Profiler::threadShutdownHook();
+}
+
+
+void GApp::waitForPipelinedSimulation() {
+    std::unique_lock<std::mutex> lock(m_simulationMutex);
+    m_simulationCondition.wait(lock, [this]() { return ! m_simulationPending; });
+}
+
+
+void GApp::finishPipelinedSimulation() {
+    if (! m_simulationThread.joinable()) {
+        return;
+    }
+
+    m_pipelineStallWatch.tick();
+    waitForPipelinedSimulation();
+    m_pipelineStallWatch.tock();
+
+    m_simulationWatch = m_pipelinedSimulationWatch;
+
+    std::lock_guard<std::mutex> guard(m_debugTextMutex);
+    debugText.append(m_pipelinedDebugText);
+    m_pipelinedDebugText.fastClear();
+}
+
+
+void GApp::stopPipelinedSimulation() {
+    if (! m_simulationThread.joinable()) {
+        return;
+    }
+
+    finishPipelinedSimulation();
+    {
+        std::lock_guard<std::mutex> lock(m_simulationMutex);
+        m_simulationThreadQuit = true;
+    }
+    m_simulationCondition.notify_all();
+    m_simulationThread.join();
 }
 
 
@@ -1453,6 +1735,7 @@ void GApp::swapBuffers() {
 
 void GApp::drawDebugShapes() {
     BEGIN_PROFILER_EVENT("GApp::drawDebugShapes");
+    std::lock_guard<std::mutex> guard(m_debugShapeMutex);
     renderDevice->setObjectToWorldMatrix(CFrame());
 
     if (debugShapeArray.size() > 0) {
@@ -1483,12 +1766,14 @@ void GApp::drawDebugShapes() {
 
 
 void GApp::removeAllDebugShapes() {
+    std::lock_guard<std::mutex> guard(m_debugShapeMutex);
     debugShapeArray.fastClear();
     debugLabelArray.fastClear();
 }
 
 
 void GApp::removeDebugShape(DebugID id) {
+    std::lock_guard<std::mutex> guard(m_debugShapeMutex);
     for (int i = 0; i < debugShapeArray.size(); ++i) {
         if (debugShapeArray[i].id == id) {
             debugShapeArray.fastRemove(i);
@@ -1542,6 +1827,16 @@ void GApp::onCleanup() {}
 
 
 void GApp::onSimulation(RealTime rdt, SimTime sdt, SimTime idt) {
+    // In FrameLoopMode::PIPELINED, oneFramePipelined already simulated these on the main thread
+    if (m_frameLoopMode != FrameLoopMode::PIPELINED) {
+        simulateWidgetsAndDebugCamera(rdt, sdt, idt);
+    }
+
+    if (scene()) { scene()->onSimulation(sdt); }
+}
+
+
+void GApp::simulateWidgetsAndDebugCamera(RealTime rdt, SimTime sdt, SimTime idt) {
     if (notNull(m_cameraManipulator)) { m_cameraManipulator->setEnabled(activeCamera() == m_debugCamera); }
 
     m_widgetManager->onSimulation(rdt, sdt, idt);
@@ -1562,8 +1857,6 @@ void GApp::onSimulation(RealTime rdt, SimTime sdt, SimTime idt) {
         // m_activeCameraMarker to match it instead of using a Entity::Track.
         m_activeCameraMarker->setFrame(m_debugCamera->frame());
     }
-
-    if (scene()) { scene()->onSimulation(sdt); }
 }
 
 
@@ -1613,6 +1906,7 @@ void GApp::onAI() {
 
 void GApp::beginRun() {
 
+    m_mainThreadId = std::this_thread::get_id();
     m_endProgram = false;
     m_exitCode = 0;
 
@@ -1628,6 +1922,7 @@ void GApp::beginRun() {
 
 
 void GApp::endRun() {
+    stopPipelinedSimulation();
     onCleanup();
 
     Log::common()->section("Files Used");
@@ -1802,7 +2097,7 @@ void GApp::setActiveCamera(const shared_ptr<Camera>& camera) {
 
 void GApp::extendGBufferSpecification(GBuffer::Specification& spec) {
     if (notNull(scene())) {
-        scene()->lightingEnvironment().ambientOcclusionSettings.extendGBufferSpecification(spec);
+        lightingEnvironment().ambientOcclusionSettings.extendGBufferSpecification(spec);
         activeCamera()->motionBlurSettings().extendGBufferSpecification(spec);
         activeCamera()->depthOfFieldSettings().extendGBufferSpecification(spec);
         activeCamera()->filmSettings().extendGBufferSpecification(spec);
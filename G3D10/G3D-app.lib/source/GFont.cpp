@@ -108,7 +108,7 @@ shared_ptr<GFont> GFont::fromMemory(const String& name, const uint8* bytes, cons
 } 
 
 
-GFont::GFont(const String& filename, BinaryInput& b) {    
+GFont::GFont(const String& filename, BinaryInput& b) : m_layoutClock(0), m_layoutCacheCapacity(4096) {
 
     const int ver = b.readInt32();
     debugAssertM((ver == 1) || (ver == 2), "Can't read font files other than version 1");
@@ -348,31 +348,212 @@ Vector2 GFont::appendToCharVertexArrayWordWrap
  YAlign                      yalign,
  Spacing                     spacing) const {
 
-    if (maxWidth == finf()) {
-        return appendToCharVertexArray(cpuCharArray, indexArray, renderDevice, s, pos2D, size, color, border, xalign, yalign, spacing);
+    return appendCached(cpuCharArray, indexArray, maxWidth, s, pos2D, size, color, border, xalign, yalign, spacing);
+}
+
+
+Vector2 GFont::appendToCharVertexArray
+   (Array<CPUCharVertex>&       cpuCharArray,
+    Array<int>&                 indexArray,
+    RenderDevice*               renderDevice,
+    const String&               s,
+    const Vector2&              pos2D,
+    float                       size,
+    const Color4&               color,
+    const Color4&               border,
+    XAlign                      xalign,
+    YAlign                      yalign,
+    Spacing                     spacing) const {
+
+    return appendCached(cpuCharArray, indexArray, finf(), s, pos2D, size, color, border, xalign, yalign, spacing);
+}
+
+
+Vector2 GFont::appendCached
+   (Array<CPUCharVertex>&       cpuCharArray,
+    Array<int>&                 indexArray,
+    float                       wrapWidth,
+    const String&               s,
+    const Vector2&              pos2D,
+    float                       size,
+    const Color4&               color,
+    const Color4&               border,
+    XAlign                      xalign,
+    YAlign                      yalign,
+    Spacing                     spacing) const {
+
+    LayoutKey key;
+    key.s         = s;
+    key.size      = size;
+    key.wrapWidth = wrapWidth;
+    key.xalign    = xalign;
+    key.yalign    = yalign;
+    key.spacing   = spacing;
+
+    const shared_ptr<Layout>& layout = cachedLayout(key);
+    appendLayout(*layout, pos2D, color, border, cpuCharArray, indexArray);
+    return layout->bounds;
+}
+
+
+void GFont::appendLayout
+   (const Layout&               layout,
+    const Point2&               pos2D,
+    const Color4&               color,
+    const Color4&               border,
+    Array<CPUCharVertex>&       cpuCharArray,
+    Array<int>&                 indexArray) {
+
+    const int base = cpuCharArray.size();
+    const int n = layout.vertexArray.size();
+    cpuCharArray.resize(base + n, false);
+    indexArray.reserve(indexArray.size() + n / 4 * 6);
+
+    for (int i = 0; i < n; ++i) {
+        const Layout::Vertex& src = layout.vertexArray[i];
+        CPUCharVertex& dst = cpuCharArray[base + i];
+        dst.texCoord    = src.texCoord;
+        dst.position    = src.position + pos2D;
+        dst.color       = color;
+        dst.borderColor = border;
+    }
+
+    for (int v = base; v < base + n; v += 4) {
+        indexArray.append
+            (v + 0, v + 1, v + 2,
+             v + 0, v + 2, v + 3);
     }
+}
+
 
-    Vector2 bounds = Vector2::zero();
-    Point2 p = pos2D;
-    String rest = s;
-    String first = "";
+shared_ptr<GFont::Layout> GFont::computeLayout(const LayoutKey& key) const {
+    Array<CPUCharVertex> charVertexArray;
+    Array<int> indexArray;
+    shared_ptr<Layout> layout(new Layout());
 
-    while (! rest.empty()) {
-        wordWrapCut(maxWidth, rest, first, size, spacing);
-        Vector2 extent = appendToCharVertexArray(cpuCharArray, indexArray, renderDevice, first, p, size, color, border, xalign, yalign, spacing);
-        bounds.x = max(bounds.x, extent.x);
-        bounds.y += extent.y;
-        p.y += iCeil(extent.y * 0.8f);
+    if (key.wrapWidth == finf()) {
+        layout->bounds = layoutLine(charVertexArray, indexArray, key.s, Point2(0, 0), key.size, Color4::clear(), Color4::clear(), key.xalign, key.yalign, key.spacing);
+    } else {
+        Point2 p(0, 0);
+        String rest = key.s;
+        String first = "";
+
+        while (! rest.empty()) {
+            wordWrapCut(key.wrapWidth, rest, first, key.size, key.spacing);
+            const Vector2 extent = layoutLine(charVertexArray, indexArray, first, p, key.size, Color4::clear(), Color4::clear(), key.xalign, key.yalign, key.spacing);
+            layout->bounds.x = max(layout->bounds.x, extent.x);
+            layout->bounds.y += extent.y;
+            p.y += iCeil(extent.y * 0.8f);
+        }
     }
 
-    return bounds;
+    layout->vertexArray.resize(charVertexArray.size());
+    for (int i = 0; i < charVertexArray.size(); ++i) {
+        layout->vertexArray[i].texCoord = charVertexArray[i].texCoord;
+        layout->vertexArray[i].position = charVertexArray[i].position;
+    }
+
+    return layout;
 }
 
 
-Vector2 GFont::appendToCharVertexArray
+shared_ptr<GFont::Layout> GFont::cachedLayout(const LayoutKey& key) const {
+    {
+        std::lock_guard<std::mutex> lock(m_layoutMutex);
+        LayoutEntry* entry = m_layoutCache.getPointer(key);
+        if (entry != nullptr) {
+            entry->lastUse = ++m_layoutClock;
+            ++m_layoutStats.cacheHits;
+            return entry->layout;
+        }
+    }
+
+    // Lay out without holding the lock. If another thread inserts the same
+    // key meanwhile, the layouts are identical and either may be kept.
+    const RealTime start = System::time();
+    const shared_ptr<Layout>& layout = computeLayout(key);
+    const RealTime elapsed = System::time() - start;
+
+    std::lock_guard<std::mutex> lock(m_layoutMutex);
+    ++m_layoutStats.layouts;
+    m_layoutStats.layoutTime += elapsed;
+    if (m_layoutCacheCapacity > 0) {
+        LayoutEntry& entry = m_layoutCache.getCreate(key);
+        entry.layout  = layout;
+        entry.lastUse = ++m_layoutClock;
+        if (int(m_layoutCache.size()) > m_layoutCacheCapacity) {
+            evictLayouts();
+        }
+    }
+
+    return layout;
+}
+
+
+void GFont::evictLayouts() const {
+    const int keep = max(1, m_layoutCacheCapacity / 2);
+    if (int(m_layoutCache.size()) <= keep) {
+        return;
+    }
+
+    // Use times are unique, so the keep-th most recent one splits the cache exactly
+    Array<uint64> useArray;
+    useArray.reserve(int(m_layoutCache.size()));
+    for (LayoutTable::Iterator it = m_layoutCache.begin(); it.isValid(); ++it) {
+        useArray.append(it->value.lastUse);
+    }
+    useArray.sort();
+    const uint64 oldestKept = useArray[useArray.size() - keep];
+
+    Array<LayoutKey> evictArray;
+    for (LayoutTable::Iterator it = m_layoutCache.begin(); it.isValid(); ++it) {
+        if (it->value.lastUse < oldestKept) {
+            evictArray.append(it->key);
+        }
+    }
+
+    for (const LayoutKey& key : evictArray) {
+        m_layoutCache.remove(key);
+    }
+    m_layoutStats.evictions += evictArray.size();
+}
+
+
+void GFont::setLayoutCacheCapacity(int capacity) {
+    debugAssert(capacity >= 0);
+    std::lock_guard<std::mutex> lock(m_layoutMutex);
+    m_layoutCacheCapacity = capacity;
+    if (capacity == 0) {
+        m_layoutCache.clear();
+    } else if (int(m_layoutCache.size()) > capacity) {
+        evictLayouts();
+    }
+}
+
+
+void GFont::clearLayoutCache() {
+    std::lock_guard<std::mutex> lock(m_layoutMutex);
+    m_layoutCache.clear();
+}
+
+
+GFont::LayoutCacheStats GFont::layoutCacheStats() const {
+    std::lock_guard<std::mutex> lock(m_layoutMutex);
+    LayoutCacheStats stats = m_layoutStats;
+    stats.entries = int(m_layoutCache.size());
+    return stats;
+}
+
+
+void GFont::resetLayoutCacheStats() {
+    std::lock_guard<std::mutex> lock(m_layoutMutex);
+    m_layoutStats = LayoutCacheStats();
+}
+
+
+Vector2 GFont::layoutLine
    (Array<CPUCharVertex>&       cpuCharArray,
     Array<int>&                 indexArray,
-    RenderDevice*               renderDevice,
     const String&               s,
     const Vector2&              pos2D,
     float                       size,
@@ -450,8 +631,8 @@ Vector2 GFont::draw2D
 
     Vector2 bounds;
     renderDevice->pushState(); {
-        static Array<CPUCharVertex> charVertexArray;
-        static Array<int> indexArray;
+        static thread_local Array<CPUCharVertex> charVertexArray;
+        static thread_local Array<int> indexArray;
         indexArray.fastClear();
         charVertexArray.fastClear();
         bounds = appendToCharVertexArray(charVertexArray, indexArray, renderDevice, s, pos2D, size, color, border, xalign, yalign, spacing);
@@ -517,8 +698,8 @@ Vector2 GFont::draw2DWordWrap
     Vector2 bounds;
     renderDevice->pushState();
     {
-        static Array<CPUCharVertex> charVertexArray;
-        static Array<int> indexArray;
+        static thread_local Array<CPUCharVertex> charVertexArray;
+        static thread_local Array<int> indexArray;
         indexArray.fastClear();
         charVertexArray.fastClear();
         bounds = appendToCharVertexArrayWordWrap(charVertexArray, indexArray, renderDevice, maxWidth, s, pos2D, size, color, border, xalign, yalign, spacing);
@@ -12,6 +12,8 @@
 #include "G3D-base/Any.h"
 #include "G3D-base/Image.h"
 #include "G3D-base/MeshAlg.h"
+#include "G3D-base/Thread.h"
+#include "G3D-base/SmallArray.h"
 #include "G3D-app/Entity.h"
 
 namespace G3D {
@@ -75,6 +77,66 @@ HeightfieldModel::HeightfieldModel(const Specification& spec, const String& name
 
     loadShaders();
     generateGeometry();
+    buildElevationPyramid();
+}
+
+
+Vector2int32 HeightfieldModel::numQuads() const {
+    return Vector2int32(m_elevationImage->width() / m_specification.pixelsPerQuadSide - 1,
+                        m_elevationImage->height() / m_specification.pixelsPerQuadSide - 1);
+}
+
+
+void HeightfieldModel::buildElevationPyramid() {
+    const Vector2int32 quads = numQuads();
+    const int pixelsPerQuadSide = m_specification.pixelsPerQuadSide;
+
+    // Read each vertex once, exactly as intersectByGridWalk() does
+    const int vertexWidth = quads.x + 1;
+    m_vertexElevation.resize(vertexWidth * (quads.y + 1));
+    runConcurrently(Point2int32(0, 0), Point2int32(vertexWidth, quads.y + 1), [&](Point2int32 P) {
+        m_vertexElevation[P.x + P.y * vertexWidth] =
+            m_elevationImage->nearest(P.x * pixelsPerQuadSide, P.y * pixelsPerQuadSide).rgb().sum() / 3.0f * m_specification.maxElevation;
+    });
+
+    m_elevationPyramid.fastClear();
+    {
+        ElevationBounds& level = m_elevationPyramid.next();
+        level.width  = quads.x;
+        level.height = quads.y;
+        level.minMax.resize(quads.x * quads.y);
+        runConcurrently(Point2int32(0, 0), Point2int32(quads.x, quads.y), [&](Point2int32 P) {
+            const int i = P.x + P.y * vertexWidth;
+            const float a = m_vertexElevation[i], b = m_vertexElevation[i + 1];
+            const float c = m_vertexElevation[i + vertexWidth], d = m_vertexElevation[i + vertexWidth + 1];
+            level.minMax[P.x + P.y * quads.x] = Vector2(min(a, b, min(c, d)), max(a, b, max(c, d)));
+        });
+    }
+
+    while ((m_elevationPyramid.last().width > 1) || (m_elevationPyramid.last().height > 1)) {
+        // Reference by index because next() may reallocate
+        const int L = m_elevationPyramid.size();
+        m_elevationPyramid.next();
+        const ElevationBounds& below = m_elevationPyramid[L - 1];
+        ElevationBounds& level = m_elevationPyramid[L];
+        level.width  = (below.width + 1) / 2;
+        level.height = (below.height + 1) / 2;
+        level.minMax.resize(level.width * level.height);
+        runConcurrently(Point2int32(0, 0), Point2int32(level.width, level.height), [&](Point2int32 P) {
+            Vector2 bounds(finf(), -finf());
+            for (int dz = 0; dz < 2; ++dz) {
+                for (int dx = 0; dx < 2; ++dx) {
+                    const int x = 2 * P.x + dx, z = 2 * P.y + dz;
+                    if ((x < below.width) && (z < below.height)) {
+                        const Vector2& b = below.minMax[x + z * below.width];
+                        bounds.x = min(bounds.x, b.x);
+                        bounds.y = max(bounds.y, b.y);
+                    }
+                }
+            }
+            level.minMax[P.x + P.y * level.width] = bounds;
+        });
+    }
 }
 
 
@@ -157,6 +219,146 @@ void HeightfieldModel::pose
 }
     
 
+void HeightfieldModel::getQuadCorners(const Vector2int32& index, Point3 p[4]) const {
+    const float metersPerQuad = m_specification.metersPerPixel * m_specification.pixelsPerQuadSide;
+    const int   vertexWidth   = numQuads().x + 1;
+    const int   xOffset[4]    = {0, 1, 1, 0};
+    const int   zOffset[4]    = {0, 0, 1, 1};
+    for (int i = 0; i < 4; ++i) {
+        const int x = index.x + xOffset[i], z = index.y + zOffset[i];
+        p[i] = Point3(float(x) * metersPerQuad, m_vertexElevation[x + z * vertexWidth], float(z) * metersPerQuad);
+    }
+}
+
+
+float HeightfieldModel::intersectQuad(const Ray& ray, const Point3 p[4], bool& hitTri0, float w[3]) {
+    float w0 = 0, w1 = 0, w2 = 0;
+    float w3 = 0, w4 = 0, w5 = 0;
+    float d0 = ray.intersectionTime(p[0], p[3], p[2], w0, w1, w2);
+    float d1 = ray.intersectionTime(p[0], p[2], p[1], w3, w4, w5);
+
+    // Ignore intersections behind the ray origin
+    if (d0 < 0) { d0 = finf(); }
+    if (d1 < 0) { d1 = finf(); }
+
+    hitTri0 = (d0 < d1);
+    if (hitTri0) {
+        w[0] = w0; w[1] = w1; w[2] = w2;
+    } else {
+        w[0] = w3; w[1] = w4; w[2] = w5;
+    }
+    return min(d0, d1);
+}
+
+
+bool HeightfieldModel::intersectPyramid(const Ray& ray, float& maxDistance, Vector2int32& quad, bool& hitTri0, float w[3]) const {
+    if (m_elevationPyramid.size() == 0) { return false; }
+
+    const float metersPerQuad = m_specification.metersPerPixel * m_specification.pixelsPerQuadSide;
+    const Vector2int32 quads = numQuads();
+    const Point3&  origin    = ray.origin();
+    const Vector3& direction = ray.direction();
+
+    // Avoid 0 * inf for rays parallel to a slab
+    Vector3 invDirection;
+    for (int a = 0; a < 3; ++a) {
+        invDirection[a] = (fabsf(direction[a]) < 1e-20f) ? 1e20f : 1.0f / direction[a];
+    }
+
+    // Pad the boxes so that rays grazing a shared edge or a flat region are not culled by roundoff
+    const float epsilon = 1e-4f * max(metersPerQuad, m_specification.maxElevation);
+    const float tMin = max(0.0f, ray.minDistance());
+
+    const auto hitsBox = [&](const Point3& lo, const Point3& hi) {
+        float t0 = tMin, t1 = min(maxDistance, ray.maxDistance());
+        for (int a = 0; a < 3; ++a) {
+            const float tA = (lo[a] - epsilon - origin[a]) * invDirection[a];
+            const float tB = (hi[a] + epsilon - origin[a]) * invDirection[a];
+            t0 = max(t0, min(tA, tB));
+            t1 = min(t1, max(tA, tB));
+        }
+        return t0 <= t1;
+    };
+
+    class Entry {
+    public:
+        int level;
+        int x;
+        int z;
+    };
+
+    // Visiting children nearest-first along x and z is a valid front-to-back
+    // order for columns, so the first quad hit is the closest one.
+    const int flipX = (direction.x < 0.0f) ? 1 : 0;
+    const int flipZ = (direction.z < 0.0f) ? 1 : 0;
+
+    SmallArray<Entry, 64> stack;
+    stack.push(Entry{m_elevationPyramid.size() - 1, 0, 0});
+
+    while (stack.size() > 0) {
+        const Entry e = stack.pop();
+        const ElevationBounds& level = m_elevationPyramid[e.level];
+        const Vector2& bounds = level.minMax[e.x + e.z * level.width];
+
+        const int span = 1 << e.level;
+        const Point3 lo(float(e.x * span) * metersPerQuad, bounds.x, float(e.z * span) * metersPerQuad);
+        const Point3 hi(float(min((e.x + 1) * span, quads.x)) * metersPerQuad, bounds.y, float(min((e.z + 1) * span, quads.y)) * metersPerQuad);
+        if (! hitsBox(lo, hi)) { continue; }
+
+        if (e.level == 0) {
+            Point3 p[4];
+            getQuadCorners(Vector2int32(e.x, e.z), p);
+            const float d = intersectQuad(ray, p, hitTri0, w);
+            if ((d < maxDistance) && (d <= ray.maxDistance())) {
+                maxDistance = d;
+                quad = Vector2int32(e.x, e.z);
+                return true;
+            }
+        } else {
+            const ElevationBounds& below = m_elevationPyramid[e.level - 1];
+            // Push the farthest child first
+            for (int k = 3; k >= 0; --k) {
+                const int x = 2 * e.x + ((k & 1) ^ flipX);
+                const int z = 2 * e.z + ((k >> 1) ^ flipZ);
+                if ((x < below.width) && (z < below.height)) {
+                    stack.push(Entry{e.level - 1, x, z});
+                }
+            }
+        }
+    }
+
+    return false;
+}
+
+
+void HeightfieldModel::setHitInfo(Model::HitInfo& info, const Entity* entity, const Vector2int32& quad, bool hitTri0, const float w[3], const Point3& point, const Vector3& normal) const {
+    const int trisPerTile   = m_quadsPerTileSide * m_quadsPerTileSide * 2;
+    const int tilesPerWidth = m_elevation->width() / m_specification.pixelsPerTileSide;
+    const int trisPerQuad   = 2;
+    const Vector2int32 tileIndex(quad.x / m_quadsPerTileSide, quad.y / m_quadsPerTileSide);
+
+    const int primIndex = 
+        tileIndex.x * trisPerTile +
+        tileIndex.y * trisPerTile * tilesPerWidth +
+        (quad.x - m_quadsPerTileSide * tileIndex.y) * trisPerQuad + 
+        (quad.y - m_quadsPerTileSide * tileIndex.x) * m_quadsPerTileSide * trisPerQuad +
+        (hitTri0 ? 0 : 1);
+
+    info.set
+        (dynamic_pointer_cast<HeightfieldModel>(const_cast<HeightfieldModel*>(this)->shared_from_this()), 
+         entity ? dynamic_pointer_cast<Entity>(const_cast<Entity*>(entity)->shared_from_this()) : nullptr, 
+         m_material,
+         normal,
+         point,
+         "N/A",
+         "N/A",
+         0,
+         primIndex,
+         w[0],
+         w[2]);
+}
+
+
 bool HeightfieldModel::intersect
 (const Ray&                      r, 
  const CoordinateFrame&          cframe, 
@@ -165,6 +367,68 @@ bool HeightfieldModel::intersect
  const Entity*                   entity,
  const Model::Pose*              pose) const {
 
+    const Ray& osRay = cframe.toObjectSpace(r);
+    Vector2int32 quad;
+    bool hitTri0;
+    float w[3];
+    if (! intersectPyramid(osRay, maxDistance, quad, hitTri0, w)) {
+        return false;
+    }
+
+    Point3 p[4];
+    getQuadCorners(quad, p);
+    const Vector3& normal = cframe.vectorToWorldSpace
+        (hitTri0 ? 
+         (p[2] - p[0]).cross(p[3] - p[0]).direction() : 
+         (p[1] - p[0]).cross(p[2] - p[0]).direction());
+
+    setHitInfo(info, entity, quad, hitTri0, w, r.origin() + maxDistance * r.direction(), normal);
+    return true;
+}
+
+
+void HeightfieldModel::intersectRays
+(const Array<Ray>&               rayArray,
+ const CoordinateFrame&          cframe,
+ Array<float>&                   distanceArray,
+ Array<Vector3>*                 normalArray) const {
+
+    distanceArray.resize(rayArray.size());
+    if (notNull(normalArray)) {
+        normalArray->resize(rayArray.size());
+    }
+
+    runConcurrently(0, rayArray.size(), [&](int i) {
+        const Ray& osRay = cframe.toObjectSpace(rayArray[i]);
+        float distance = finf();
+        Vector2int32 quad;
+        bool hitTri0;
+        float w[3];
+        const bool hit = intersectPyramid(osRay, distance, quad, hitTri0, w);
+        distanceArray[i] = distance;
+
+        if (notNull(normalArray)) {
+            Vector3 normal = Vector3::nan();
+            if (hit) {
+                Point3 p[4];
+                getQuadCorners(quad, p);
+                normal = cframe.vectorToWorldSpace(hitTri0 ? 
+                    (p[2] - p[0]).cross(p[3] - p[0]).direction() : 
+                    (p[1] - p[0]).cross(p[2] - p[0]).direction());
+            }
+            (*normalArray)[i] = normal;
+        }
+    });
+}
+
+
+bool HeightfieldModel::intersectByGridWalk
+(const Ray&                      r, 
+ const CoordinateFrame&          cframe, 
+ float&                          maxDistance, 
+ Model::HitInfo&                 info,
+ const Entity*                   entity) const {
+
     bool first  = true;
     bool top    = false;
 
@@ -308,10 +572,10 @@ bool HeightfieldModel::intersect
                     (index.z - m_quadsPerTileSide * tileIndex.x) * m_quadsPerTileSide * trisPerQuad +
                     (hitTri0 ? 0 : 1);
 
-                const Vector3& normal = 
-                    hitTri0 ? 
-                    (p[2] - p[0]).cross(p[3] - p[0]).direction() : 
-                    (p[1] - p[0]).cross(p[2] - p[0]).direction();
+                const Vector3& normal = cframe.vectorToWorldSpace
+                    (hitTri0 ? 
+                     (p[2] - p[0]).cross(p[3] - p[0]).direction() : 
+                     (p[1] - p[0]).cross(p[2] - p[0]).direction());
 
                 const Point3& intersectionPoint = r.origin() + firstIntersectDistance * r.direction();
 
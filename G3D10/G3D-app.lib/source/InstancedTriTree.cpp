@@ -0,0 +1,603 @@
+/**
+  \file G3D-app.lib/source/InstancedTriTree.cpp
+
+  G3D Innovation Engine http://casual-effects.com/g3d
+  Copyright 2000-2019, Morgan McGuire
+  All rights reserved
+  Available under the BSD License
+*/
+#include <algorithm>
+#include <cstring>
+#include "G3D-base/Box.h"
+#include "G3D-base/CollisionDetection.h"
+#include "G3D-base/Sphere.h"
+#include "G3D-app/InstancedTriTree.h"
+#include "G3D-app/Surface.h"
+#include "G3D-app/Surfel.h"
+#include "G3D-app/UniversalSurface.h"
+
+namespace G3D {
+
+/** Slab test that tolerates zero direction components, for which invDirection is infinite */
+static inline bool rayIntersectsBox(const Point3& origin, const Vector3& invDirection, const AABox& box, float minDistance, float maxDistance) {
+    for (int a = 0; a < 3; ++a) {
+        float t0 = (box.low()[a]  - origin[a]) * invDirection[a];
+        float t1 = (box.high()[a] - origin[a]) * invDirection[a];
+        if (t0 > t1) { std::swap(t0, t1); }
+
+        // Written so that NaN from 0 * inf leaves the interval unchanged
+        minDistance = (t0 > minDistance) ? t0 : minDistance;
+        maxDistance = (t1 < maxDistance) ? t1 : maxDistance;
+    }
+    return minDistance <= maxDistance;
+}
+
+
+/** True if \a tree was built from exactly this vertex and index data. Matching array addresses
+    do not prove this, because the arrays may have been edited in place since the tree was built. */
+static bool builtFrom(const NativeTriTree& tree, const CPUVertexArray& vertexArray, const Array<int>& index) {
+    const CPUVertexArray& treeVertexArray = tree.vertexArray();
+    const Array<Tri>& triArray = tree.triArray();
+    if ((treeVertexArray.size() != vertexArray.size()) ||
+        (treeVertexArray.texCoord1.size() != vertexArray.texCoord1.size()) ||
+        (triArray.size() * 3 != index.size())) {
+        return false;
+    }
+
+    // The tree's copy was made with copyPOD, so compare it the same way
+    if ((std::memcmp(treeVertexArray.vertex.getCArray(), vertexArray.vertex.getCArray(), sizeof(CPUVertexArray::Vertex) * vertexArray.size()) != 0) ||
+        (std::memcmp(treeVertexArray.texCoord1.getCArray(), vertexArray.texCoord1.getCArray(), sizeof(Point2unorm16) * vertexArray.texCoord1.size()) != 0)) {
+        return false;
+    }
+
+    for (int t = 0; t < triArray.size(); ++t) {
+        const Tri& tri = triArray[t];
+        if ((int(tri.index[0]) != index[3 * t]) || (int(tri.index[1]) != index[3 * t + 1]) || (int(tri.index[2]) != index[3 * t + 2])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+void InstancedTriTree::clear() {
+    TriTreeBase::clear();
+    m_geometry.fastClear();
+    m_geometryBounds.fastClear();
+    m_geometryTable.clear();
+    m_instance.fastClear();
+    m_node.fastClear();
+    m_instanceOrder.fastClear();
+    m_numTris = 0;
+    m_numVertices = 0;
+    m_flattened = false;
+}
+
+
+void InstancedTriTree::invalidateFlattened() {
+    m_triArray.fastClear();
+    m_vertexArray.clear();
+    m_flattened = false;
+}
+
+
+void InstancedTriTree::flatten() const {
+    std::lock_guard<std::mutex> lock(m_flattenMutex);
+    if (m_flattened) {
+        return;
+    }
+
+    // The copy is a cache of the instances, so filling it does not change the logical state
+    InstancedTriTree* me = const_cast<InstancedTriTree*>(this);
+    me->m_triArray.fastClear();
+    me->m_vertexArray.clear();
+    me->m_triArray.reserve(m_numTris);
+    for (const Instance& instance : m_instance) {
+        const NativeTriTree& tree = *m_geometry[instance.geometry];
+        debugAssert(m_vertexArray.size() == instance.firstVertex);
+        me->m_vertexArray.transformAndAppend(tree.vertexArray(), instance.frame);
+        for (const Tri& tri : tree.triArray()) {
+            Tri& copy = me->m_triArray.next();
+            copy = tri;
+            for (int v = 0; v < 3; ++v) {
+                copy.index[v] += uint32(instance.firstVertex);
+            }
+        }
+    }
+    m_flattened = true;
+}
+
+
+int InstancedTriTree::addGeometry(const Array<Tri>& triArray, const CPUVertexArray& vertexArray) {
+    const shared_ptr<NativeTriTree>& tree = NativeTriTree::create();
+    tree->triArray() = triArray;
+    tree->vertexArray().copyFrom(vertexArray);
+    tree->rebuild();
+
+    AABox bounds;
+    for (const Tri& tri : triArray) {
+        for (int v = 0; v < 3; ++v) {
+            bounds.merge(tri.position(vertexArray, v));
+        }
+    }
+
+    m_geometry.append(tree);
+    m_geometryBounds.append(bounds);
+    return m_geometry.size() - 1;
+}
+
+
+int InstancedTriTree::addInstance(int geometry, const CFrame& frame, const shared_ptr<Surface>& surface) {
+    debugAssert(geometry >= 0 && geometry < m_geometry.size());
+    Instance& instance     = m_instance.next();
+    instance.geometry      = geometry;
+    instance.frame         = frame;
+    instance.previousFrame = frame;
+    instance.surface       = surface;
+    instance.firstTri      = m_numTris;
+    instance.firstVertex   = m_numVertices;
+    m_numTris     += m_geometry[geometry]->size();
+    m_numVertices += m_geometry[geometry]->vertexArray().size();
+    return m_instance.size() - 1;
+}
+
+
+void InstancedTriTree::setInstanceFrame(int i, const CFrame& frame) {
+    Instance& instance = m_instance[i];
+    instance.previousFrame = instance.frame;
+    instance.frame = frame;
+}
+
+
+int InstancedTriTree::findInstance(int triIndex) const {
+    debugAssert(triIndex >= 0 && triIndex < m_numTris);
+    // Last instance whose firstTri <= triIndex, which skips any empty instances sharing its firstTri
+    int lo = 0, hi = m_instance.size();
+    while (hi - lo > 1) {
+        const int mid = (lo + hi) / 2;
+        if (m_instance[mid].firstTri <= triIndex) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+
+void InstancedTriTree::buildNode(int n, int first, int count) {
+    AABox bounds;
+    for (int i = first; i < first + count; ++i) {
+        bounds.merge(m_instance[m_instanceOrder[i]].bounds);
+    }
+    m_node[n].bounds = bounds;
+    m_node[n].first  = first;
+    m_node[n].count  = count;
+
+    const int maxInstancesPerLeaf = 2;
+    if (count <= maxInstancesPerLeaf) {
+        m_node[n].child = -1;
+        return;
+    }
+
+    // Median split on the longest axis of the instance centers
+    AABox centerBounds;
+    for (int i = first; i < first + count; ++i) {
+        const AABox& b = m_instance[m_instanceOrder[i]].bounds;
+        centerBounds.merge(b.isEmpty() ? Point3::zero() : b.center());
+    }
+    int axis = 0;
+    for (int a = 1; a < 3; ++a) {
+        if (centerBounds.extent(a) > centerBounds.extent(axis)) {
+            axis = a;
+        }
+    }
+
+    const int mid = count / 2;
+    int* order = m_instanceOrder.getCArray();
+    std::nth_element(order + first, order + first + mid, order + first + count, [&](int i, int j) {
+        const AABox& a = m_instance[i].bounds;
+        const AABox& b = m_instance[j].bounds;
+        return (a.isEmpty() ? 0.0f : a.center()[axis]) < (b.isEmpty() ? 0.0f : b.center()[axis]);
+    });
+
+    // Allocating both children before recursing keeps children after their parent
+    const int child = m_node.size();
+    m_node.next();
+    m_node.next();
+    m_node[n].child = child;
+    buildNode(child, first, mid);
+    buildNode(child + 1, first + mid, count - mid);
+}
+
+
+void InstancedTriTree::rebuild() {
+    invalidateFlattened();
+    for (Instance& instance : m_instance) {
+        const AABox& objectBounds = m_geometryBounds[instance.geometry];
+        if (objectBounds.isEmpty()) {
+            instance.bounds = AABox();
+        } else {
+            instance.frame.toWorldSpace(objectBounds, instance.bounds);
+        }
+    }
+
+    m_instanceOrder.resize(m_instance.size());
+    for (int i = 0; i < m_instanceOrder.size(); ++i) {
+        m_instanceOrder[i] = i;
+    }
+
+    m_node.fastClear();
+    if (m_instance.size() > 0) {
+        m_node.next();
+        buildNode(0, 0, m_instance.size());
+    }
+
+    m_lastBuildTime = System::time();
+}
+
+
+void InstancedTriTree::refit() {
+    invalidateFlattened();
+    for (Instance& instance : m_instance) {
+        const AABox& objectBounds = m_geometryBounds[instance.geometry];
+        if (objectBounds.isEmpty()) {
+            instance.bounds = AABox();
+        } else {
+            instance.frame.toWorldSpace(objectBounds, instance.bounds);
+        }
+    }
+
+    for (int n = m_node.size() - 1; n >= 0; --n) {
+        Node& node = m_node[n];
+        AABox bounds;
+        if (node.child == -1) {
+            for (int i = node.first; i < node.first + node.count; ++i) {
+                bounds.merge(m_instance[m_instanceOrder[i]].bounds);
+            }
+        } else {
+            bounds = m_node[node.child].bounds;
+            bounds.merge(m_node[node.child + 1].bounds);
+        }
+        node.bounds = bounds;
+    }
+
+    m_lastBuildTime = System::time();
+}
+
+
+void InstancedTriTree::setContents
+   (const Array<shared_ptr<Surface>>&  surfaceArray,
+    ImageStorage                       newStorage) {
+
+    // Keep the previous bottom-level trees so that unchanged geometry is not rebuilt
+    const Array<shared_ptr<NativeTriTree>> previousGeometry = m_geometry;
+    const Array<AABox> previousGeometryBounds = m_geometryBounds;
+    const Table<GeometryKey, int, GeometryKey, GeometryKey> previousGeometryTable = m_geometryTable;
+    const bool hadTopLevel = (m_node.size() > 0);
+    Array<int> previousInstanceGeometry;
+    previousInstanceGeometry.resize(m_instance.size());
+    for (int i = 0; i < m_instance.size(); ++i) {
+        previousInstanceGeometry[i] = m_instance[i].geometry;
+    }
+
+    clear();
+    m_sky = nullptr;
+
+    Array<shared_ptr<Surface>> flatSurfaceArray;
+    for (const shared_ptr<Surface>& surface : surfaceArray) {
+        const shared_ptr<UniversalSurface>& universal = dynamic_pointer_cast<UniversalSurface>(surface);
+        const bool shareable = notNull(universal) && notNull(universal->cpuGeom().vertexArray) && notNull(universal->cpuGeom().index) &&
+            notNull(universal->gpuGeom()) && ! universal->gpuGeom()->hasBones();
+
+        if (! shareable) {
+            flatSurfaceArray.append(surface);
+            continue;
+        }
+
+        const UniversalSurface::CPUGeom& cpuGeom = universal->cpuGeom();
+        GeometryKey key;
+        key.vertexArray = cpuGeom.vertexArray;
+        key.index       = cpuGeom.index;
+        key.material    = universal->material().get();
+        key.numVertices = cpuGeom.vertexArray->size();
+        key.numIndices  = cpuGeom.index->size();
+        key.twoSided    = universal->gpuGeom()->twoSided;
+
+        bool created = false;
+        int& geometry = m_geometryTable.getCreate(key, created);
+        if (created) {
+            const int* previous = previousGeometryTable.getPointer(key);
+            if (notNull(previous) && builtFrom(*previousGeometry[*previous], *cpuGeom.vertexArray, *cpuGeom.index)) {
+                geometry = m_geometry.size();
+                m_geometry.append(previousGeometry[*previous]);
+                m_geometryBounds.append(previousGeometryBounds[*previous]);
+            } else {
+                const Array<int>& index = *cpuGeom.index;
+                const bool hasPartialCoverage = universal->material()->hasPartialCoverage();
+                Array<Tri> triArray;
+                triArray.reserve(index.size() / 3);
+                for (int i = 0; i < index.size(); i += 3) {
+                    triArray.append(Tri(index[i], index[i + 1], index[i + 2], *cpuGeom.vertexArray, universal, key.twoSided, hasPartialCoverage));
+                }
+                geometry = addGeometry(triArray, *cpuGeom.vertexArray);
+            }
+        }
+
+        CFrame frame, previousFrame;
+        universal->getCoordinateFrame(frame, false);
+        universal->getCoordinateFrame(previousFrame, true);
+        const int i = addInstance(geometry, frame, surface);
+        m_instance[i].previousFrame = previousFrame;
+    }
+
+    if (flatSurfaceArray.size() > 0) {
+        // Everything that cannot be shared becomes one world-space geometry, as in TriTreeBase
+        CPUVertexArray vertexArray;
+        Array<Tri> triArray;
+        Surface::getTris(flatSurfaceArray, vertexArray, triArray, false);
+        addInstance(addGeometry(triArray, vertexArray), CFrame());
+    }
+
+    Surface::setStorage(surfaceArray, newStorage);
+
+    // When only frames changed, the previous top-level structure is still valid
+    bool sameInstances = hadTopLevel && (previousInstanceGeometry.size() == m_instance.size());
+    for (int i = 0; sameInstances && (i < m_instance.size()); ++i) {
+        sameInstances = (previousInstanceGeometry[i] == m_instance[i].geometry);
+    }
+
+    if (sameInstances) {
+        refit();
+    } else {
+        rebuild();
+    }
+}
+
+
+void InstancedTriTree::setContents
+   (const Array<Tri>&                  triArray,
+    const CPUVertexArray&              vertexArray,
+    ImageStorage                       newStorage) {
+
+    clear();
+    Tri::setStorage(triArray, newStorage);
+    m_sky = nullptr;
+    addInstance(addGeometry(triArray, vertexArray), CFrame());
+    rebuild();
+}
+
+
+bool InstancedTriTree::intersectRay
+   (const Ray&                         ray,
+    Hit&                               hit,
+    IntersectRayOptions                options) const {
+
+    hit.triIndex = Hit::NONE;
+    if (m_node.size() == 0) {
+        return false;
+    }
+
+    const bool occlusionOnly = (options & OCCLUSION_TEST_ONLY) != 0;
+    const Point3& origin = ray.origin();
+    const Vector3 invDirection(1.0f / ray.direction().x, 1.0f / ray.direction().y, 1.0f / ray.direction().z);
+    float maxDistance = ray.maxDistance();
+
+    // The top level is balanced, so its depth is logarithmic in the number of instances
+    int stack[64];
+    int stackSize = 0;
+    stack[stackSize++] = 0;
+
+    while (stackSize > 0) {
+        const Node& node = m_node[stack[--stackSize]];
+        if (! rayIntersectsBox(origin, invDirection, node.bounds, ray.minDistance(), maxDistance)) {
+            continue;
+        }
+
+        if (node.child != -1) {
+            debugAssert(stackSize + 2 <= 64);
+            stack[stackSize++] = node.child + 1;
+            stack[stackSize++] = node.child;
+            continue;
+        }
+
+        for (int i = node.first; i < node.first + node.count; ++i) {
+            const Instance& instance = m_instance[m_instanceOrder[i]];
+            if (! rayIntersectsBox(origin, invDirection, instance.bounds, ray.minDistance(), maxDistance)) {
+                continue;
+            }
+
+            // Rigid transformations preserve distance along the ray
+            const Ray objectRay(instance.frame.pointToObjectSpace(origin), instance.frame.vectorToObjectSpace(ray.direction()), ray.minDistance(), maxDistance);
+            Hit instanceHit;
+            if (m_geometry[instance.geometry]->intersectRay(objectRay, instanceHit, options)) {
+                hit = instanceHit;
+                hit.triIndex += instance.firstTri;
+                if (occlusionOnly) {
+                    return true;
+                }
+                maxDistance = instanceHit.distance;
+            }
+        }
+    }
+
+    return hit.triIndex != Hit::NONE;
+}
+
+
+void InstancedTriTree::sample(const Hit& hit, float coneCos, shared_ptr<Surfel>& surfel) const {
+    if (hit.triIndex == Hit::NONE) {
+        surfel = nullptr;
+        return;
+    }
+
+    const Instance& instance = m_instance[findInstance(hit.triIndex)];
+    const NativeTriTree& tree = *m_geometry[instance.geometry];
+    const CPUVertexArray& vertexArray = tree.vertexArray();
+    const Tri& tri = tree.triArray()[hit.triIndex - instance.firstTri];
+
+    float du = 0.0f, dv = 0.0f;
+    if ((coneCos > 0.0f) && (coneCos < 1.0f)) {
+        // As in TriTreeBase::intersectRays; edge lengths are the same in object space
+        const float radius = hit.distance * sqrt(1.0f - square(coneCos)) / coneCos;
+        const Point3& p0 = tri.position(vertexArray, 0);
+        du = radius / max((tri.position(vertexArray, 1) - p0).length(), 1e-10f);
+        dv = radius / max((tri.position(vertexArray, 2) - p0).length(), 1e-10f);
+    }
+
+    tri.sample(hit.u, hit.v, hit.triIndex, vertexArray, hit.backface, surfel, du, dv);
+
+    if (notNull(surfel)) {
+        const Point3 objectPosition = surfel->position;
+        surfel->transformToWorldSpace(instance.frame);
+        surfel->prevPosition = instance.previousFrame.pointToWorldSpace(objectPosition);
+        if (notNull(instance.surface)) {
+            surfel->surface = instance.surface.get();
+        }
+    }
+}
+
+
+void InstancedTriTree::sample(const Hit& hit, shared_ptr<Surfel>& surfel) const {
+    sample(hit, 0.0f, surfel);
+}
+
+
+void InstancedTriTree::intersectRays
+   (const Array<Ray>&                  rays,
+    Array<shared_ptr<Surfel>>&         results,
+    IntersectRayOptions                options,
+    const Array<float>&                coneBuffer) const {
+
+    Array<Hit> hits;
+    results.resize(rays.size());
+    intersectRays(rays, hits, options);
+
+    const float* pCone = (coneBuffer.size() == rays.size()) ? coneBuffer.getCArray() : nullptr;
+    runConcurrently(0, hits.size(), [&](int i) {
+        sample(hits[i], notNull(pCone) ? pCone[i] : 0.0f, results[i]);
+    });
+}
+
+
+void InstancedTriTree::forEachInstance(const AABox& box, const std::function<void(int)>& visit) const {
+    if (m_node.size() == 0) {
+        return;
+    }
+
+    int stack[64];
+    int stackSize = 0;
+    stack[stackSize++] = 0;
+
+    while (stackSize > 0) {
+        const Node& node = m_node[stack[--stackSize]];
+        if (node.bounds.isEmpty() || ! node.bounds.intersects(box)) {
+            continue;
+        }
+
+        if (node.child != -1) {
+            debugAssert(stackSize + 2 <= 64);
+            stack[stackSize++] = node.child + 1;
+            stack[stackSize++] = node.child;
+        } else {
+            for (int i = node.first; i < node.first + node.count; ++i) {
+                const int instance = m_instanceOrder[i];
+                if (! m_instance[instance].bounds.isEmpty() && m_instance[instance].bounds.intersects(box)) {
+                    visit(instance);
+                }
+            }
+        }
+    }
+}
+
+
+void InstancedTriTree::intersectBox
+   (const AABox&                       box,
+    Array<Triangle>&                   results) const {
+
+    results.fastClear();
+    Array<Tri> candidateArray;
+    forEachInstance(box, [&](int i) {
+        const Instance& instance = m_instance[i];
+        const NativeTriTree& tree = *m_geometry[instance.geometry];
+        const CPUVertexArray& vertexArray = tree.vertexArray();
+
+        AABox objectBox;
+        instance.frame.toObjectSpace(box).getBounds(objectBox);
+        candidateArray.fastClear();
+        tree.intersectBox(objectBox, candidateArray);
+
+        for (const Tri& tri : candidateArray) {
+            const Triangle triangle(instance.frame.pointToWorldSpace(tri.position(vertexArray, 0)),
+                                    instance.frame.pointToWorldSpace(tri.position(vertexArray, 1)),
+                                    instance.frame.pointToWorldSpace(tri.position(vertexArray, 2)));
+            if (CollisionDetection::fixedSolidBoxIntersectsFixedTriangle(box, triangle)) {
+                results.append(triangle);
+            }
+        }
+    });
+}
+
+
+void InstancedTriTree::intersectSphere
+   (const Sphere&                      sphere,
+    Array<Triangle>&                   results) const {
+
+    AABox box;
+    sphere.getBounds(box);
+    intersectBox(box, results);
+
+    // Iterate backwards because we're removing
+    for (int i = results.size() - 1; i >= 0; --i) {
+        if (! CollisionDetection::fixedSolidSphereIntersectsFixedTriangle(sphere, results[i])) {
+            results.fastRemove(i);
+        }
+    }
+}
+
+
+void InstancedTriTree::intersectBox
+   (const AABox&                       box,
+    Array<Tri>&                        results) const {
+
+    flatten();
+    results.fastClear();
+    Array<Tri> candidateArray;
+    forEachInstance(box, [&](int i) {
+        const Instance& instance = m_instance[i];
+
+        AABox objectBox;
+        instance.frame.toObjectSpace(box).getBounds(objectBox);
+        candidateArray.fastClear();
+        m_geometry[instance.geometry]->intersectBox(objectBox, candidateArray);
+
+        // Re-index the object-space candidates into the flattened world-space vertices
+        for (Tri& tri : candidateArray) {
+            for (int v = 0; v < 3; ++v) {
+                tri.index[v] += uint32(instance.firstVertex);
+            }
+            if (CollisionDetection::fixedSolidBoxIntersectsFixedTriangle(box, tri.toTriangle(m_vertexArray))) {
+                results.append(tri);
+            }
+        }
+    });
+}
+
+
+void InstancedTriTree::intersectSphere
+   (const Sphere&                      sphere,
+    Array<Tri>&                        triArray) const {
+
+    AABox box;
+    sphere.getBounds(box);
+    intersectBox(box, triArray);
+
+    // Iterate backwards because we're removing
+    for (int i = triArray.size() - 1; i >= 0; --i) {
+        if (! CollisionDetection::fixedSolidSphereIntersectsFixedTriangle(sphere, triArray[i].toTriangle(m_vertexArray))) {
+            triArray.fastRemove(i);
+        }
+    }
+}
+
+} // G3D
@@ -670,6 +670,11 @@ void Light::setFrame(const CoordinateFrame& c, bool updatePreviousFrame) {
 }
 
 
+shared_ptr<Light> Light::snapshot() const {
+    return createShared<Light>(*this);
+}
+
+
 shared_ptr<Light> Light::directional(const String& name, const Vector3& toLight, const Color3& color, bool s, int shadowMapRes) {
     
     shared_ptr<Light> L = createShared<Light>();
@@ -0,0 +1,293 @@
+/**
+  \file G3D-app.lib/source/LightTree.cpp
+
+  G3D Innovation Engine http://casual-effects.com/g3d
+  Copyright 2000-2019, Morgan McGuire
+  All rights reserved
+  Available under the BSD License
+*/
+#include "G3D-app/LightTree.h"
+#include "G3D-app/Light.h"
+#include "G3D-base/Matrix3.h"
+#include <algorithm>
+
+namespace G3D {
+
+/** Smallest squared distance used when evaluating importance, to avoid the singularity at lights */
+static const float minDistanceSquared = 1e-4f;
+
+static float safeAcos(float c) {
+    return acos(clamp(c, -1.0f, 1.0f));
+}
+
+
+/** Merges the orientation cone (axisB, thetaOB, thetaEB) into (axis, thetaO, thetaE) */
+static void mergeCones(Vector3& axis, float& thetaO, float& thetaE, Vector3 axisB, float thetaOB, float thetaEB) {
+    thetaE = max(thetaE, thetaEB);
+
+    if (thetaOB > thetaO) {
+        // Make the first cone the wider one
+        std::swap(axis, axisB);
+        std::swap(thetaO, thetaOB);
+    }
+
+    const float thetaD = safeAcos(axis.dot(axisB));
+    if (min(thetaD + thetaOB, pif()) <= thetaO) {
+        // B is already inside
+        return;
+    }
+
+    const float newThetaO = (thetaO + thetaD + thetaOB) * 0.5f;
+    const Vector3& rotationAxis = axis.cross(axisB);
+    if ((newThetaO >= pif()) || (rotationAxis.squaredLength() < 1e-12f)) {
+        thetaO = pif();
+        return;
+    }
+
+    // Rotate the axis towards B until the cone just contains both
+    axis   = (Matrix3::fromAxisAngle(rotationAxis.direction(), newThetaO - thetaO) * axis).direction();
+    thetaO = newThetaO;
+}
+
+
+LightTree::LightTree(const Array<shared_ptr<Light>>& lightArray) : m_lightArray(lightArray) {
+    m_leafForLight.resize(m_lightArray.size());
+
+    // Bounds of the individual lights
+    Array<Node> lightNode;
+    lightNode.resize(m_lightArray.size());
+
+    Array<int> finiteLightIndex;
+    for (int i = 0; i < m_lightArray.size(); ++i) {
+        const Light& light = *m_lightArray[i];
+        m_leafForLight[i] = -1;
+
+        Node& node = lightNode[i];
+        node.lightIndex = i;
+        node.power = light.color.average();
+
+        switch (light.type()) {
+        case Light::Type::DIRECTIONAL:
+            m_infiniteLightIndex.append(i);
+            continue;
+
+        case Light::Type::OMNI:
+            node.bounds = AABox(light.position().xyz());
+            node.axis   = Vector3::unitZ();
+            node.thetaO = pif();
+            node.thetaE = pif() / 2.0f;
+            break;
+
+        case Light::Type::SPOT:
+            node.bounds = AABox(light.position().xyz());
+            node.axis   = light.frame().lookVector();
+            node.thetaO = 0.0f;
+            // A rectangular spot light circumscribes the cone, so its corners are farther out
+            node.thetaE = light.rectangular() ? atan(tan(light.spotHalfAngle()) * sqrt(2.0f)) : light.spotHalfAngle();
+            node.thetaE = min(node.thetaE, pif() / 2.0f);
+            break;
+
+        case Light::Type::AREA:
+        default:
+            node.bounds = AABox(light.position(-1, -1).xyz());
+            node.bounds.merge(light.position(1, -1).xyz());
+            node.bounds.merge(light.position(-1, 1).xyz());
+            node.bounds.merge(light.position(1, 1).xyz());
+            node.axis   = light.frame().lookVector();
+            node.thetaO = 0.0f;
+            node.thetaE = pif() / 2.0f;
+            break;
+        }
+
+        finiteLightIndex.append(i);
+    }
+
+    if (finiteLightIndex.size() > 0) {
+        m_nodeArray.reserve(2 * finiteLightIndex.size() - 1);
+        build(lightNode, finiteLightIndex, 0, finiteLightIndex.size(), -1);
+    }
+}
+
+
+shared_ptr<LightTree> LightTree::create(const Array<shared_ptr<Light>>& lightArray) {
+    return createShared<LightTree>(lightArray);
+}
+
+
+int LightTree::build(const Array<Node>& lightNode, Array<int>& lightIndex, int begin, int end, int parent) {
+    const int index = m_nodeArray.size();
+
+    if (end - begin == 1) {
+        m_nodeArray.append(lightNode[lightIndex[begin]]);
+        m_nodeArray[index].parent = parent;
+        m_leafForLight[lightIndex[begin]] = index;
+        return index;
+    }
+
+    m_nodeArray.next();
+
+    // Split at the median along the axis of greatest centroid extent
+    AABox centroidBounds;
+    for (int i = begin; i < end; ++i) {
+        centroidBounds.merge(lightNode[lightIndex[i]].bounds.center());
+    }
+    const Vector3& extent = centroidBounds.extent();
+    const int axis = (extent.x >= extent.y) ? ((extent.x >= extent.z) ? 0 : 2) : ((extent.y >= extent.z) ? 1 : 2);
+
+    const int mid = (begin + end) / 2;
+    std::nth_element(lightIndex.getCArray() + begin, lightIndex.getCArray() + mid, lightIndex.getCArray() + end, [&](int a, int b) {
+        return lightNode[a].bounds.center()[axis] < lightNode[b].bounds.center()[axis];
+    });
+
+    const int first  = build(lightNode, lightIndex, begin, mid, index);
+    const int second = build(lightNode, lightIndex, mid, end, index);
+    debugAssert(first == index + 1);
+    (void)first;
+
+    // The array may have been reallocated by the recursive calls
+    const Node& A = m_nodeArray[index + 1];
+    const Node& B = m_nodeArray[second];
+    Node& node = m_nodeArray[index];
+    node.parent      = parent;
+    node.secondChild = second;
+    node.power       = A.power + B.power;
+    node.bounds      = A.bounds;
+    node.bounds.merge(B.bounds);
+    node.axis   = A.axis;
+    node.thetaO = A.thetaO;
+    node.thetaE = A.thetaE;
+    mergeCones(node.axis, node.thetaO, node.thetaE, B.axis, B.thetaO, B.thetaE);
+
+    return index;
+}
+
+
+float LightTree::importance(const Node& node, const Point3& X, const Vector3& n) const {
+    const Vector3& d = X - node.bounds.center();
+    const float distanceSquared = d.squaredLength();
+    const float radiusSquared = node.bounds.extent().squaredLength() * 0.25f;
+
+    if (distanceSquared <= radiusSquared) {
+        // Inside the bounds: every direction is possible
+        return node.power / max(radiusSquared, minDistanceSquared);
+    }
+
+    const float distance = sqrt(distanceSquared);
+    const Vector3& w = d / distance;
+
+    // Angle subtended by the bounds as seen from X
+    const float thetaU = asin(sqrt(radiusSquared / distanceSquared));
+
+    // Smallest angle between any emission direction in the cone and any direction towards X
+    const float theta = safeAcos(node.axis.dot(w));
+    const float thetaPrime = max(0.0f, theta - node.thetaO - thetaU);
+    if (thetaPrime >= node.thetaE) {
+        return 0.0f;
+    }
+
+    // Largest cosine at the receiver. PathTracer uses |w_i . n|, so both hemispheres count.
+    float cosI = 1.0f;
+    if (! n.isNaN()) {
+        const float thetaI = safeAcos(fabsf(n.dot(w)));
+        cosI = cos(max(0.0f, thetaI - thetaU));
+    }
+
+    return node.power * cos(thetaPrime) * cosI / max(distanceSquared, minDistanceSquared);
+}
+
+
+float LightTree::infiniteImportance(int lightIndex, const Vector3& n) const {
+    const Light& light = *m_lightArray[lightIndex];
+    const float c = n.isNaN() ? 1.0f : fabsf(n.dot(light.frame().lookVector()));
+    return light.color.average() * c;
+}
+
+
+int LightTree::sample(const Point3& X, const Vector3& n, float u, float& pdf) const {
+    pdf = 0.0f;
+
+    // Choose between the tree and each infinite light
+    const float treeImportance = (m_nodeArray.size() > 0) ? importance(m_nodeArray[0], X, n) : 0.0f;
+    float total = treeImportance;
+    for (const int i : m_infiniteLightIndex) {
+        total += infiniteImportance(i, n);
+    }
+
+    if (! (total > 0.0f)) {
+        return -1;
+    }
+
+    float r = u * total;
+    if (r >= treeImportance) {
+        r -= treeImportance;
+        for (int k = 0; k < m_infiniteLightIndex.size(); ++k) {
+            const float I = infiniteImportance(m_infiniteLightIndex[k], n);
+            if ((r < I) || (k == m_infiniteLightIndex.size() - 1)) {
+                pdf = I / total;
+                return (I > 0.0f) ? m_infiniteLightIndex[k] : -1;
+            }
+            r -= I;
+        }
+    }
+
+    // Reuse the remaining randomness at each level
+    u   = r / treeImportance;
+    pdf = treeImportance / total;
+
+    int index = 0;
+    while (! m_nodeArray[index].isLeaf()) {
+        const int first  = index + 1;
+        const int second = m_nodeArray[index].secondChild;
+        const float I0 = importance(m_nodeArray[first], X, n);
+        const float I1 = importance(m_nodeArray[second], X, n);
+        if (! (I0 + I1 > 0.0f)) {
+            pdf = 0.0f;
+            return -1;
+        }
+
+        const float p0 = I0 / (I0 + I1);
+        if (u < p0) {
+            index = first;
+            pdf *= p0;
+            u = min(u / p0, 0.99999994f);
+        } else {
+            index = second;
+            pdf *= 1.0f - p0;
+            u = min((u - p0) / (1.0f - p0), 0.99999994f);
+        }
+    }
+
+    return m_nodeArray[index].lightIndex;
+}
+
+
+float LightTree::pdf(const Point3& X, const Vector3& n, int lightIndex) const {
+    const float treeImportance = (m_nodeArray.size() > 0) ? importance(m_nodeArray[0], X, n) : 0.0f;
+    float total = treeImportance;
+    for (const int i : m_infiniteLightIndex) {
+        total += infiniteImportance(i, n);
+    }
+
+    if (! (total > 0.0f)) {
+        return 0.0f;
+    }
+
+    int index = m_leafForLight[lightIndex];
+    if (index == -1) {
+        return infiniteImportance(lightIndex, n) / total;
+    }
+
+    float p = treeImportance / total;
+    for (int parent = m_nodeArray[index].parent; parent != -1; index = parent, parent = m_nodeArray[index].parent) {
+        const float I0 = importance(m_nodeArray[parent + 1], X, n);
+        const float I1 = importance(m_nodeArray[m_nodeArray[parent].secondChild], X, n);
+        if (! (I0 + I1 > 0.0f)) {
+            return 0.0f;
+        }
+        p *= ((index == parent + 1) ? I0 : I1) / (I0 + I1);
+    }
+
+    return p;
+}
+
+} // namespace G3D
@@ -8,10 +8,11 @@
 */
 
 #include "G3D-base/platform.h"
-#if defined(G3D_WINDOWS)
+#ifndef G3D_ARM
 #    include <xmmintrin.h>
 #endif
 #include "G3D-base/Ray.h"
+#include "G3D-base/Thread.h"
 #include "G3D-base/Log.h"
 #include "G3D-base/FileSystem.h"
 #include "G3D-base/BinaryInput.h"
@@ -209,6 +210,13 @@ void MD2Model::pose
     }
 }
 
+
+void MD2Model::setPoseCacheCapacity(int capacity) {
+    for (int p = 0; p < m_part.size(); ++p) {
+        m_part[p]->setPoseCacheCapacity(capacity);
+    }
+}
+
 ///////////////////////////////////////////////////////
 
 MD2Model::Part::Specification::Specification(const Any& any) {
@@ -230,8 +238,6 @@ MD2Model::Part::Specification::Specification(const Any& any) {
 
 
 
-MD2Model::Part*             MD2Model::Part::interpolatedModel       = nullptr;
-MD2Model::Pose              MD2Model::Part::interpolatedPose;
 shared_ptr<VertexBuffer>    MD2Model::Part::varArea[MD2Model::Part::NUM_VAR_AREAS];
 int                         MD2Model::Part::nextVarArea             = MD2Model::Part::NONE_ALLOCATED;
 const SimTime               MD2Model::PRE_BLEND_TIME                = 1.0 / 8.0;
@@ -727,9 +733,10 @@ void MD2Model::Part::pose(Array<shared_ptr<Surface> >& surfaceArray, const Coord
 
 
 void MD2Model::Part::render(RenderDevice* renderDevice, const Pose& pose) {
-    getGeometry(pose, interpolatedFrame);
+    MeshAlg::Geometry geometry;
+    getGeometry(pose, geometry);
 
-    UniversalSurface::CPUGeom cpuGeom(&indexArray, &interpolatedFrame, &_texCoordArray);
+    UniversalSurface::CPUGeom cpuGeom(&indexArray, &geometry, &_texCoordArray);
 
     // Upload the arrays
     debugAssert(notNull(varArea[nextVarArea]));
@@ -755,7 +762,8 @@ void MD2Model::Part::render(RenderDevice* renderDevice, const Pose& pose) {
 
 void MD2Model::Part::debugRenderWireframe(RenderDevice* renderDevice, const Pose& pose, bool negateNormals) {
     /*
-    getGeometry(pose, interpolatedFrame, negateNormals);
+    MeshAlg::Geometry geometry;
+    getGeometry(pose, geometry, negateNormals);
 
     renderDevice->pushState();
         renderDevice->setDepthTest(RenderDevice::DEPTH_LEQUAL);
@@ -765,7 +773,7 @@ void MD2Model::Part::debugRenderWireframe(RenderDevice* renderDevice, const Pose
         
         renderDevice->beginPrimitive(PrimitiveType::TRIANGLES);
         for (int i = 0; i < indexArray.size(); ++i) {
-            renderDevice->sendVertex(interpolatedFrame.vertexArray[indexArray[i]]);
+            renderDevice->sendVertex(geometry.vertexArray[indexArray[i]]);
         }
         renderDevice->endPrimitive();
 
@@ -799,8 +807,6 @@ size_t MD2Model::Part::mainMemorySize() const {
 }
 
 
-MeshAlg::Geometry MD2Model::Part::interpolatedFrame;
-
 void MD2Model::Part::getGeometry(const Pose& pose, MeshAlg::Geometry& out, bool negateNormals) const {
     
     const int numVertices = keyFrame[0].vertexArray.size();
@@ -816,57 +822,185 @@ void MD2Model::Part::getGeometry(const Pose& pose, MeshAlg::Geometry& out, bool
     out.vertexArray.resize(numVertices, DONT_SHRINK_UNDERLYING_ARRAY);
     out.normalArray.resize(numVertices, DONT_SHRINK_UNDERLYING_ARRAY);
 
-    if ((interpolatedModel == this) && (pose == interpolatedPose)) {
-        // We're being asked to recompute a pose we have cached.
-        if (&out != &interpolatedFrame) {
-            // Copy from the cache
-            System::memcpy(out.vertexArray.getCArray(), interpolatedFrame.vertexArray.getCArray(), sizeof(Vector3) * interpolatedFrame.vertexArray.size());
-            System::memcpy(out.normalArray.getCArray(), interpolatedFrame.normalArray.getCArray(), sizeof(Vector3) * interpolatedFrame.vertexArray.size());
+    PoseKey key;
+    key.negateNormals = negateNormals;
+    computeFrameNumbers(pose, key.frame0, key.frame1, key.alpha);
+
+    if ((key.frame0 >= keyFrame.size()) || (key.frame1 >= keyFrame.size())) {
+        // This animation is not supported by this model.
+        key.frame0 = 0;
+        key.frame1 = 0;
+        key.alpha  = 0;
+    }
+
+    shared_ptr<MeshAlg::Geometry> cached;
+    bool useCache = false;
+    {
+        std::lock_guard<std::mutex> lock(m_poseCacheMutex);
+        useCache = (m_poseCacheCapacity > 0);
+        PoseEntry* entry = m_poseCache.getPointer(key);
+        if (entry != nullptr) {
+            entry->lastUse = ++m_poseClock;
+            cached = entry->geometry;
+            ++m_poseCacheStats.hits;
+        } else {
+            ++m_poseCacheStats.misses;
         }
+    }
 
+    if (notNull(cached)) {
+        // We're being asked to recompute a pose we have cached.
+        System::memcpy(out.vertexArray.getCArray(), cached->vertexArray.getCArray(), sizeof(Vector3) * numVertices);
+        System::memcpy(out.normalArray.getCArray(), cached->normalArray.getCArray(), sizeof(Vector3) * numVertices);
         return;
     }
 
-    if (&out == &interpolatedFrame) {
-        // Make a note about what the cache contains
-        interpolatedPose  = pose;
-        interpolatedModel = const_cast<MD2Model::Part*>(this);
+    // Blend without holding the lock. If another thread misses on the same
+    // pose meanwhile, the results are identical and either may be kept.
+    interpolate(key, out);
+
+    if (useCache) {
+        const shared_ptr<MeshAlg::Geometry> geometry(new MeshAlg::Geometry());
+        geometry->vertexArray = out.vertexArray;
+        geometry->normalArray = out.normalArray;
+
+        std::lock_guard<std::mutex> lock(m_poseCacheMutex);
+        PoseEntry& entry = m_poseCache.getCreate(key);
+        entry.geometry = geometry;
+        entry.lastUse  = ++m_poseClock;
+        while (int(m_poseCache.size()) > m_poseCacheCapacity) {
+            evictLeastRecentlyUsedPose();
+        }
     }
+}
 
-    float alpha;
-    int i0, i1;
 
-    computeFrameNumbers(pose, i0, i1, alpha);
+void MD2Model::Part::getGeometry(const Array<Pose>& poseArray, Array<MeshAlg::Geometry>& geometryArray, bool negateNormals) const {
+    geometryArray.resize(poseArray.size());
+    runConcurrently(0, poseArray.size(), [&](int i) {
+        getGeometry(poseArray[i], geometryArray[i], negateNormals);
+    });
+}
 
-    if ((i0 >= keyFrame.size()) || (i1 >= keyFrame.size())) {
-        // This animation is not supported by this model.
-        i0 = 0;
-        i1 = 0;
-        alpha = 0;
-    }
 
-    const PackedGeometry& frame0 = keyFrame[i0];
-    const PackedGeometry& frame1 = keyFrame[i1];
+void MD2Model::Part::interpolate(const PoseKey& key, MeshAlg::Geometry& out) const {
+    const PackedGeometry& frame0 = keyFrame[key.frame0];
+    const PackedGeometry& frame1 = keyFrame[key.frame1];
+    const int   numVertices = frame0.vertexArray.size();
+    const float alpha       = key.alpha;
 
-    const Vector3*  v0 = frame0.vertexArray.getCArray();
-    const Vector3*  v1 = frame1.vertexArray.getCArray();
+    // Normals of opposing keyframes can cancel; leave those at zero rather than dividing by zero
+    const float minLength2  = 1e-12f;
+    const float sign        = key.negateNormals ? -1.0f : 1.0f;
+
+    // Positions are a flat lerp over all of the coordinates
+    const float*    p0 = reinterpret_cast<const float*>(frame0.vertexArray.getCArray());
+    const float*    p1 = reinterpret_cast<const float*>(frame1.vertexArray.getCArray());
+    float*          pI = reinterpret_cast<float*>(out.vertexArray.getCArray());
+    const int       numFloats = numVertices * 3;
     
     const uint8*    n0 = frame0.normalArray.getCArray();
     const uint8*    n1 = frame1.normalArray.getCArray();
-
-    Vector3*        vI = out.vertexArray.getCArray();
     Vector3*        nI = out.normalArray.getCArray();
 
-    for (int v = numVertices - 1; v >= 0; --v) {
-        vI[v] = v0[v].lerp(v1[v], alpha);
-        nI[v] = normalTable[n0[v]].lerp(normalTable[n1[v]], alpha);
+    int i = 0;
+    int v = 0;
+
+#   ifndef G3D_ARM
+    {
+        const __m128 a = _mm_set1_ps(alpha);
+        for (; i + 4 <= numFloats; i += 4) {
+            const __m128 x0 = _mm_loadu_ps(p0 + i);
+            const __m128 x1 = _mm_loadu_ps(p1 + i);
+            _mm_storeu_ps(pI + i, _mm_add_ps(x0, _mm_mul_ps(_mm_sub_ps(x1, x0), a)));
+        }
+
+        // Normals four at a time, transposed from the table into x, y, and z registers
+        const __m128 s    = _mm_set1_ps(sign);
+        const __m128 eps  = _mm_set1_ps(minLength2);
+        for (; v + 4 <= numVertices; v += 4) {
+            const Vector3& a0 = normalTable[n0[v]];
+            const Vector3& a1 = normalTable[n0[v + 1]];
+            const Vector3& a2 = normalTable[n0[v + 2]];
+            const Vector3& a3 = normalTable[n0[v + 3]];
+            const Vector3& b0 = normalTable[n1[v]];
+            const Vector3& b1 = normalTable[n1[v + 1]];
+            const Vector3& b2 = normalTable[n1[v + 2]];
+            const Vector3& b3 = normalTable[n1[v + 3]];
+
+            const __m128 ax = _mm_setr_ps(a0.x, a1.x, a2.x, a3.x);
+            const __m128 ay = _mm_setr_ps(a0.y, a1.y, a2.y, a3.y);
+            const __m128 az = _mm_setr_ps(a0.z, a1.z, a2.z, a3.z);
+            const __m128 nx = _mm_add_ps(ax, _mm_mul_ps(_mm_sub_ps(_mm_setr_ps(b0.x, b1.x, b2.x, b3.x), ax), a));
+            const __m128 ny = _mm_add_ps(ay, _mm_mul_ps(_mm_sub_ps(_mm_setr_ps(b0.y, b1.y, b2.y, b3.y), ay), a));
+            const __m128 nz = _mm_add_ps(az, _mm_mul_ps(_mm_sub_ps(_mm_setr_ps(b0.z, b1.z, b2.z, b3.z), az), a));
+
+            const __m128 length2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, nx), _mm_mul_ps(ny, ny)), _mm_mul_ps(nz, nz));
+            const __m128 scale   = _mm_and_ps(_mm_cmpgt_ps(length2, eps), _mm_div_ps(s, _mm_sqrt_ps(length2)));
+
+            float x[4], y[4], z[4];
+            _mm_storeu_ps(x, _mm_mul_ps(nx, scale));
+            _mm_storeu_ps(y, _mm_mul_ps(ny, scale));
+            _mm_storeu_ps(z, _mm_mul_ps(nz, scale));
+            for (int k = 0; k < 4; ++k) {
+                nI[v + k] = Vector3(x[k], y[k], z[k]);
+            }
+        }
+    }
+#   endif
+
+    for (; i < numFloats; ++i) {
+        pI[i] = p0[i] + (p1[i] - p0[i]) * alpha;
+    }
+
+    for (; v < numVertices; ++v) {
+        const Vector3& n = normalTable[n0[v]].lerp(normalTable[n1[v]], alpha);
+        const float length2 = n.squaredMagnitude();
+        nI[v] = (length2 > minLength2) ? n * (sign / sqrt(length2)) : Vector3::zero();
     }
+}
+
 
-    if (negateNormals) {
-        for (int v = numVertices - 1; v >= 0; --v) {
-            nI[v] = -nI[v];
+void MD2Model::Part::evictLeastRecentlyUsedPose() const {
+    const PoseKey* oldest = nullptr;
+    uint64 oldestUse = 0;
+    for (PoseTable::Iterator it = m_poseCache.begin(); it.isValid(); ++it) {
+        if ((oldest == nullptr) || (it->value.lastUse < oldestUse)) {
+            oldest    = &it->key;
+            oldestUse = it->value.lastUse;
         }
     }
+
+    if (oldest != nullptr) {
+        // Copy the key, since removal destroys the entry that it points into
+        const PoseKey key = *oldest;
+        m_poseCache.remove(key);
+        ++m_poseCacheStats.evictions;
+    }
+}
+
+
+void MD2Model::Part::setPoseCacheCapacity(int capacity) {
+    debugAssert(capacity >= 0);
+    std::lock_guard<std::mutex> lock(m_poseCacheMutex);
+    m_poseCacheCapacity = capacity;
+    while (int(m_poseCache.size()) > m_poseCacheCapacity) {
+        evictLeastRecentlyUsedPose();
+    }
+}
+
+
+void MD2Model::Part::clearPoseCache() {
+    std::lock_guard<std::mutex> lock(m_poseCacheMutex);
+    m_poseCache.clear();
+}
+
+
+MD2Model::Part::PoseCacheStats MD2Model::Part::poseCacheStats() const {
+    std::lock_guard<std::mutex> lock(m_poseCacheMutex);
+    PoseCacheStats stats = m_poseCacheStats;
+    stats.entries = int(m_poseCache.size());
+    return stats;
 }
 
 
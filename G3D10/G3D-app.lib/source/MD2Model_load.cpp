@@ -91,7 +91,7 @@ void MD2Model::Part::load(const String& filename, float resize) {
     resize *= 0.55f;
 
     // If models are being reloaded it is dangerous to trust the interpolation cache.
-    interpolatedModel = nullptr;
+    clearPoseCache();
 
     alwaysAssertM(FileSystem::exists(filename), String("Can't find \"") + filename + "\"");
 
@@ -9,10 +9,15 @@
 #include "G3D-app/PathTracer.h"
 #include "G3D-base/Image.h"
 #include "G3D-base/CubeMap.h"
+#include "G3D-base/CounterRandom.h"
+#include "G3D-base/BinaryInput.h"
+#include "G3D-base/BinaryOutput.h"
 #include "G3D-app/Light.h"
 #include "G3D-app/Camera.h"
 #include "G3D-app/Scene.h"
+#include "G3D-app/InstancedTriTree.h"
 #include "G3D-app/UniversalSurfel.h"
+#include "G3D-app/TextureTileCache.h"
 #include "G3D-gfx/GLPixelTransferBuffer.h"
 
 namespace G3D {
@@ -23,6 +28,7 @@ const Ray PathTracer::s_degenerateRay = Ray(Point3(5000, 5000, 5000), Vector3::u
 
 PathTracer::PathTracer(const shared_ptr<TriTree>& t) {
     m_triTree = isNull(t) ? TriTree::create(true) : t;
+    m_defaultTriTree = m_triTree;
 }
 
 
@@ -46,6 +52,18 @@ Radiance3 PathTracer::skyRadiance(const Vector3& direction) const {
     }
 }
 
+float PathTracer::environmentSampleFraction(int numDirectLights, int currentPathDepth) const {
+    // When the last ray is replaced by an environment map lookup, that lookup is not weighted
+    // against skybox samples, so skip them at the event that produces it.
+    const int numTraceIterations = m_options.maxScatteringEvents - (m_options.useEnvironmentMapForLastScatteringEvent ? 1 : 0);
+    if (isNull(m_skyboxSampler) ||
+        (m_options.useEnvironmentMapForLastScatteringEvent && (currentPathDepth >= numTraceIterations - 1))) {
+        return 0.0f;
+    }
+
+    return (numDirectLights > 0) ? 0.5f : 1.0f;
+}
+
 // Below this amount of modulation, paths are terminated because their contribution
 // is likely to be too low to matter.
 static const float minModulation = 0.02f;
@@ -54,7 +72,8 @@ void PathTracer::traceImage
    (const shared_ptr<Image>&            radianceImage,
     const shared_ptr<Camera>&           camera,
     const Options&                      options,
-    const std::function<void(const String&, float)>& statusCallback) const {
+    const std::function<void(const String&, float)>& statusCallback,
+    const shared_ptr<Image>&            sampleCountImage) const {
     
     // Visible area lights are handled by indirect rays during
     // recursive ray importance sampling. Point lights and invisible
@@ -63,30 +82,29 @@ void PathTracer::traceImage
     Array<shared_ptr<Light>> directLightArray, indirectLightArray;
     prepare(options, directLightArray, indirectLightArray);
 
-    // Resize all buffers for one sample per pixel
-    const int numPixels = radianceImage->width() * radianceImage->height();
-
     BufferSet buffers;
     // Total contribution, taking individual ray filter footprints into account
     const shared_ptr<Image>& weightSumImage = Image::create(radianceImage->width(), radianceImage->height(), ImageFormat::R32F());
+    const float coneCos = primaryConeCos(camera, radianceImage->width(), radianceImage->height());
+
+    alwaysAssertM(isNull(sampleCountImage) || ((sampleCountImage->width() == radianceImage->width()) && (sampleCountImage->height() == radianceImage->height())),
+                  "sampleCountImage must be the same size as radianceImage");
 
     // All operations act on all pixels in parallel
     radianceImage->setAll(Radiance3::zero());
-    for (int rayIndex = 0; rayIndex < options.raysPerPixel; ++rayIndex) {
-        buffers.resize(numPixels);
-        buffers.modulation.setAll(Color3::one());
-        buffers.impulseRay.setAll(true);
-        buffers.outputCoord.resize(numPixels);
-        
-        generateEyeRays(radianceImage->width(), radianceImage->height(), camera, buffers.ray, options.raysPerPixel > 1, buffers.outputCoord, weightSumImage, rayIndex, options.raysPerPixel);
-        
-        // Visualize eye rays
-        // for (Point2int32 P(0, 0); P.y < radianceImage->height(); ++P.y) for (P.x = 0; P.x < radianceImage->width(); ++P.x) radianceImage->set(P, Radiance3(rayBuffer[P.x + P.y * radianceImage->width()].direction() * 0.5f + Vector3::one() * 0.5f)); return;
+    if (options.adaptiveSampling && (options.raysPerPixel > 1)) {
+        traceImageAdaptive(radianceImage, weightSumImage, camera, coneCos, directLightArray, indirectLightArray, statusCallback, sampleCountImage);
+    } else {
+        for (int rayIndex = 0; rayIndex < options.raysPerPixel; ++rayIndex) {
+            traceImagePass(radianceImage, weightSumImage, camera, coneCos, directLightArray, indirectLightArray, rayIndex, buffers);
 
-        traceBufferInternal(buffers, nullptr, radianceImage, nullptr, directLightArray, indirectLightArray, rayIndex);
+            if (statusCallback) { statusCallback(format("%d/%d rays/pixel", rayIndex, options.raysPerPixel), float(rayIndex) / float(options.raysPerPixel)); }
+        } // for rays per pixel
 
-        if (statusCallback) { statusCallback(format("%d/%d rays/pixel", rayIndex, options.raysPerPixel), float(rayIndex) / float(options.raysPerPixel)); }
-    } // for rays per pixel
+        if (notNull(sampleCountImage)) {
+            sampleCountImage->setAll(Color1(float(options.raysPerPixel)));
+        }
+    }
 
     // Normalize by the weight per pixel
     runConcurrently(Point2int32(0, 0), Point2int32(radianceImage->width(), radianceImage->height()), [&](Point2int32 pix) {
@@ -97,6 +115,415 @@ void PathTracer::traceImage
 }
 
 
+float PathTracer::primaryConeCos(const shared_ptr<Camera>& camera, int width, int height) {
+    // Half of the angle between adjacent pixels at the center of the image
+    const Rect2D viewport = Rect2D::xywh(0.0f, 0.0f, float(width), float(height));
+    const float cx = float(width / 2), cy = float(height / 2);
+    const float pixelAngle = acos(clamp(camera->worldRay(cx, cy, viewport).direction().dot(camera->worldRay(cx + 1.0f, cy, viewport).direction()), -1.0f, 1.0f));
+    return cos(0.5f * pixelAngle);
+}
+
+
+void PathTracer::traceImagePass
+   (const shared_ptr<Image>&            radianceImage,
+    const shared_ptr<Image>&            weightSumImage,
+    const shared_ptr<Camera>&           camera,
+    float                               primaryConeCos,
+    const Array<shared_ptr<Light>>&     directLightArray,
+    const Array<shared_ptr<Light>>&     indirectLightArray,
+    int                                 rayIndex,
+    BufferSet&                          buffers) const {
+
+    // Resize all buffers for one sample per pixel
+    const int numPixels = radianceImage->width() * radianceImage->height();
+
+    buffers.resize(numPixels);
+    buffers.modulation.setAll(Color3::one());
+    buffers.impulseRay.setAll(true);
+    buffers.scatterDensity.setAll(finf());
+    buffers.coneCos.setAll(primaryConeCos);
+    buffers.outputCoord.resize(numPixels);
+    buffers.pathIndex.resize(numPixels);
+    runConcurrently(0, numPixels, [&](int i) {
+        buffers.pathIndex[i] = i;
+    }, ! m_options.multithreaded);
+
+    generateEyeRays(radianceImage->width(), radianceImage->height(), camera, buffers.ray, m_options.raysPerPixel > 1, buffers.outputCoord, weightSumImage, rayIndex, m_options.raysPerPixel);
+
+    // Visualize eye rays
+    // for (Point2int32 P(0, 0); P.y < radianceImage->height(); ++P.y) for (P.x = 0; P.x < radianceImage->width(); ++P.x) radianceImage->set(P, Radiance3(rayBuffer[P.x + P.y * radianceImage->width()].direction() * 0.5f + Vector3::one() * 0.5f)); return;
+
+    traceBufferInternal(buffers, nullptr, radianceImage, nullptr, directLightArray, indirectLightArray, rayIndex);
+}
+
+
+PathTracer::ProgressiveState::ProgressiveState(int width, int height) :
+    m_radianceSum(Image::create(width, height, ImageFormat::RGB32F())),
+    m_weightSum(Image::create(width, height, ImageFormat::R32F())),
+    m_cancelRequested(false) {
+
+    m_radianceSum->setAll(Radiance3::zero());
+    m_weightSum->setAll(Color1(0.0f));
+}
+
+
+shared_ptr<PathTracer::ProgressiveState> PathTracer::ProgressiveState::create(int width, int height) {
+    return createShared<ProgressiveState>(width, height);
+}
+
+
+shared_ptr<PathTracer::ProgressiveState> PathTracer::ProgressiveState::create(BinaryInput& b) {
+    const shared_ptr<ProgressiveState>& state = create(1, 1);
+    state->deserialize(b);
+    return state;
+}
+
+
+int PathTracer::ProgressiveState::width() const {
+    return m_radianceSum->width();
+}
+
+
+int PathTracer::ProgressiveState::height() const {
+    return m_radianceSum->height();
+}
+
+
+void PathTracer::ProgressiveState::resolve(const shared_ptr<Image>& radianceImage) const {
+    alwaysAssertM((radianceImage->width() == width()) && (radianceImage->height() == height()), "radianceImage must be the same size as the ProgressiveState");
+    runConcurrently(Point2int32(0, 0), Point2int32(width(), height()), [&](Point2int32 pix) {
+        radianceImage->set(pix, m_radianceSum->get<Radiance3>(pix) / max(0.00001f, m_weightSum->get<Color1>(pix).value));
+    });
+}
+
+
+void PathTracer::ProgressiveState::serialize(BinaryOutput& b) const {
+    b.writeString32("PathTracer::ProgressiveState");
+    b.writeInt32(1); // version
+    b.writeInt32(width());
+    b.writeInt32(height());
+    b.writeInt32(m_passesCompleted);
+    for (Point2int32 pix(0, 0); pix.y < height(); ++pix.y) {
+        for (pix.x = 0; pix.x < width(); ++pix.x) {
+            m_radianceSum->get<Radiance3>(pix).serialize(b);
+            b.writeFloat32(m_weightSum->get<Color1>(pix).value);
+        }
+    }
+}
+
+
+void PathTracer::ProgressiveState::deserialize(BinaryInput& b) {
+    const String& header = b.readString32();
+    if (header != "PathTracer::ProgressiveState") {
+        throw ParseError(b.getFilename(), b.getPosition(), "Not a PathTracer::ProgressiveState");
+    }
+    const int version = b.readInt32();
+    if (version != 1) {
+        throw ParseError(b.getFilename(), b.getPosition(), format("Unsupported PathTracer::ProgressiveState version %d", version));
+    }
+
+    const int w = b.readInt32();
+    const int h = b.readInt32();
+    m_passesCompleted = b.readInt32();
+    m_radianceSum = Image::create(w, h, ImageFormat::RGB32F());
+    m_weightSum = Image::create(w, h, ImageFormat::R32F());
+    for (Point2int32 pix(0, 0); pix.y < h; ++pix.y) {
+        for (pix.x = 0; pix.x < w; ++pix.x) {
+            Radiance3 L;
+            L.deserialize(b);
+            m_radianceSum->set(pix, L);
+            m_weightSum->set(pix, Color1(b.readFloat32()));
+        }
+    }
+    m_cancelRequested = false;
+}
+
+
+bool PathTracer::traceImageProgressive
+   (const shared_ptr<ProgressiveState>&     state,
+    const shared_ptr<Camera>&               camera,
+    const Options&                          options,
+    RealTime                                timeLimit,
+    const std::function<void(const shared_ptr<ProgressiveState>&)>& passCallback) const {
+
+    const RealTime startTime = System::time();
+
+    Array<shared_ptr<Light>> directLightArray, indirectLightArray;
+    prepare(options, directLightArray, indirectLightArray);
+
+    const float coneCos = primaryConeCos(camera, state->width(), state->height());
+    BufferSet buffers;
+    while ((state->m_passesCompleted < options.raysPerPixel) && ! state->m_cancelRequested && (System::time() - startTime < timeLimit)) {
+        // The pass index keys the random streams, so resuming continues the same sequence
+        traceImagePass(state->m_radianceSum, state->m_weightSum, camera, coneCos, directLightArray, indirectLightArray, state->m_passesCompleted, buffers);
+        ++state->m_passesCompleted;
+
+        if (passCallback) {
+            passCallback(state);
+        }
+    }
+
+    state->m_cancelRequested = false;
+    return state->m_passesCompleted >= options.raysPerPixel;
+}
+
+
+bool PathTracer::allocateAdaptivePass
+   (const Array<float>&                 tileError,
+    const Array<int>&                   tilePixels,
+    float                               targetError,
+    int64                               passBudget,
+    int                                 maxRaysPerPixel,
+    Array<int>&                         tileRays) {
+
+    debugAssert(tileError.size() == tilePixels.size());
+    tileRays.resize(tileError.size());
+    tileRays.setAll(0);
+
+    Array<int> unconverged;
+    for (int t = 0; t < tileError.size(); ++t) {
+        if (tileError[t] > targetError) {
+            unconverged.append(t);
+        }
+    }
+
+    if (unconverged.size() == 0) {
+        return false;
+    }
+
+    // Noisiest first, so that a pass too small for every tile is not spent in raster order
+    unconverged.sort([&](int a, int b) { return tileError[a] > tileError[b]; });
+
+    // One ray per pixel for as many tiles as fit
+    int64 remaining = passBudget;
+    double totalWeight = 0.0;
+    for (const int t : unconverged) {
+        if ((tilePixels[t] <= remaining) || (t == unconverged[0])) {
+            tileRays[t] = 1;
+            remaining -= tilePixels[t];
+            totalWeight += double(square(tileError[t])) * double(tilePixels[t]);
+        }
+    }
+
+    // Share the rest in proportion to squared error, which is proportional to the number of
+    // rays that a tile needs to converge. Rounding down keeps the total within the budget.
+    if (remaining > 0) {
+        const double extraBudget = double(remaining);
+        for (const int t : unconverged) {
+            if (tileRays[t] > 0) {
+                const double extra = floor(extraBudget * double(square(tileError[t])) / totalWeight);
+                tileRays[t] += int(min(extra, double(maxRaysPerPixel - 1)));
+            }
+        }
+    }
+
+    return true;
+}
+
+
+void PathTracer::traceImageAdaptive
+   (const shared_ptr<Image>&            radianceImage,
+    const shared_ptr<Image>&            weightSumImage,
+    const shared_ptr<Camera>&           camera,
+    float                               primaryConeCos,
+    const Array<shared_ptr<Light>>&     directLightArray,
+    const Array<shared_ptr<Light>>&     indirectLightArray,
+    const std::function<void(const String&, float)>& statusCallback,
+    const shared_ptr<Image>&            sampleCountImage) const {
+
+    // Uniform passes before the variance estimates are trusted
+    static const int initialPasses = 4;
+
+    // Edge length in pixels of the blocks that receive rays together
+    static const int tileSize = 8;
+
+    // Cap on rays per pixel in one pass, so that a few noisy tiles do not absorb a whole pass
+    // before their estimates improve
+    static const int maxRaysPerPixelPerPass = 16;
+
+    // Below this mean luminance, error is measured in absolute rather than relative terms
+    static const float minLuminance = 1e-3f;
+
+    const int width = radianceImage->width(), height = radianceImage->height();
+    const int numPixels = width * height;
+    const int tilesX = (width + tileSize - 1) / tileSize, tilesY = (height + tileSize - 1) / tileSize;
+    const Rect2D viewport = Rect2D::xywh(0.0f, 0.0f, float(width), float(height));
+    const bool depthOfField = camera->depthOfFieldSettings().enabled() && (camera->depthOfFieldSettings().model() == DepthOfFieldModel::PHYSICAL);
+
+    // Running statistics of each pixel's sample luminance (Welford's method)
+    Array<int>   sampleCount;
+    Array<float> mean, sumSquaredDeviation;
+    sampleCount.resize(numPixels);         sampleCount.setAll(0);
+    mean.resize(numPixels);                mean.setAll(0.0f);
+    sumSquaredDeviation.resize(numPixels); sumSquaredDeviation.setAll(0.0f);
+
+    // Rays per pixel for the current pass, per tile
+    Array<float> tileError;
+    Array<int>   tileRays;
+    Array<int>   tilePixels;
+    tileError.resize(tilesX * tilesY);
+    tileRays.resize(tilesX * tilesY);
+    tilePixels.resize(tilesX * tilesY);
+    for (int t = 0; t < tilePixels.size(); ++t) {
+        const Point2int32 tile(t % tilesX, t / tilesX);
+        tilePixels[t] = (min(width, (tile.x + 1) * tileSize) - tile.x * tileSize) * (min(height, (tile.y + 1) * tileSize) - tile.y * tileSize);
+    }
+
+    // Pixels that receive rays this pass; the rays for passPixel[j] are firstRay[j] through firstRay[j + 1] - 1
+    Array<int>       passPixel;
+    Array<int>       firstRay;
+    Array<PixelCoord> sampleCoord;
+    Array<Radiance3> sampleRadiance;
+    BufferSet        buffers;
+
+    const int64 rayBudget = int64(numPixels) * int64(m_options.raysPerPixel);
+    int64 raysTraced = 0;
+    const RealTime startTime = System::time();
+
+    for (int pass = 0; raysTraced < rayBudget; ++pass) {
+        const int64 passBudget = min(rayBudget - raysTraced, int64(numPixels));
+
+        if (pass < initialPasses) {
+            tileRays.setAll(1);
+        } else {
+            // Root-mean-square relative standard error of the pixel means in each tile
+            runConcurrently(0, tileError.size(), [&](int t) {
+                const Point2int32 tile(t % tilesX, t / tilesX);
+                float sum = 0.0f;
+                int n = 0;
+                for (int y = tile.y * tileSize; y < min(height, (tile.y + 1) * tileSize); ++y) {
+                    for (int x = tile.x * tileSize; x < min(width, (tile.x + 1) * tileSize); ++x, ++n) {
+                        const int p = x + y * width;
+                        const float variance = sumSquaredDeviation[p] / float(sampleCount[p] - 1);
+                        sum += variance / (float(sampleCount[p]) * square(max(mean[p], minLuminance)));
+                    }
+                }
+                tileError[t] = sqrt(sum / float(n));
+            }, ! m_options.multithreaded);
+
+            if (! allocateAdaptivePass(tileError, tilePixels, m_options.adaptiveTargetError, passBudget, maxRaysPerPixelPerPass, tileRays)) {
+                // Every tile has converged
+                break;
+            }
+        }
+
+        // Lay out the rays, pixel by pixel. The allocation fits the budget, except at the end of
+        // the render when even the noisiest tile does not fit.
+        passPixel.fastClear();
+        firstRay.fastClear();
+        int numRays = 0;
+        for (int y = 0; (y < height) && (numRays < passBudget); ++y) {
+            for (int x = 0; (x < width) && (numRays < passBudget); ++x) {
+                const int rays = tileRays[(x / tileSize) + (y / tileSize) * tilesX];
+                if (rays > 0) {
+                    passPixel.append(x + y * width);
+                    firstRay.append(numRays);
+                    numRays += int(min(int64(rays), passBudget - numRays));
+                }
+            }
+        }
+        firstRay.append(numRays);
+
+        buffers.resize(numRays);
+        buffers.modulation.setAll(Color3::one());
+        buffers.impulseRay.setAll(true);
+        buffers.scatterDensity.setAll(finf());
+        buffers.coneCos.setAll(primaryConeCos);
+        buffers.outputIndex.resize(numRays);
+        buffers.pathIndex.resize(numRays);
+        sampleCoord.resize(numRays);
+
+        runConcurrently(0, passPixel.size(), [&](int j) {
+            const int p = passPixel[j];
+            const Point2int32 point(p % width, p / width);
+            for (int i = firstRay[j]; i < firstRay[j + 1]; ++i) {
+                const int sampleIndex = sampleCount[p] + (i - firstRay[j]);
+                Vector2 offset;
+                if (m_options.deterministicSampling) {
+                    CounterRandom rng(m_options.randomSeed, uint32(p), uint32(sampleIndex), randomStream(0, EYE_RAY_RANDOM));
+                    offset.x = rng.uniform(); offset.y = rng.uniform();
+                } else {
+                    Random& rng = Random::threadCommon();
+                    offset.x = rng.uniform(); offset.y = rng.uniform();
+                }
+
+                buffers.ray[i] = eyeRay(camera, viewport, depthOfField, point, offset, sampleIndex, m_options.raysPerPixel);
+                buffers.outputIndex[i] = i;
+                buffers.pathIndex[i] = i;
+
+                // Camera coords put integers at top left, but image coords put them at pixel centers
+                sampleCoord[i] = Point2(point) + offset - Point2(0.5f, 0.5f);
+            }
+        }, ! m_options.multithreaded);
+        buffers.outputCoord = sampleCoord;
+
+        sampleRadiance.resize(numRays);
+        System::memset(sampleRadiance.getCArray(), 0, sizeof(Radiance3) * numRays);
+        traceBufferInternal(buffers, sampleRadiance.getCArray(), radianceImage, nullptr, directLightArray, indirectLightArray, pass);
+
+        // Each pixel's rays are contiguous, so its statistics can be updated without contention
+        runConcurrently(0, passPixel.size(), [&](int j) {
+            const int p = passPixel[j];
+            for (int i = firstRay[j]; i < firstRay[j + 1]; ++i) {
+                const float x = sampleRadiance[i].average();
+                ++sampleCount[p];
+                const float delta = x - mean[p];
+                mean[p] += delta / float(sampleCount[p]);
+                sumSquaredDeviation[p] += delta * (x - mean[p]);
+            }
+        }, ! m_options.multithreaded);
+
+        // Splatting touches neighboring pixels, so it is serial
+        for (int i = 0; i < numRays; ++i) {
+            radianceImage->bilinearIncrement(sampleCoord[i], sampleRadiance[i]);
+            weightSumImage->bilinearIncrement(sampleCoord[i], Color1(1.0f));
+        }
+
+        raysTraced += numRays;
+
+        if (statusCallback) {
+            statusCallback(format("%.1f/%d rays/pixel", double(raysTraced) / double(numPixels), m_options.raysPerPixel), float(double(raysTraced) / double(rayBudget)));
+        }
+
+        if (System::time() - startTime > m_options.adaptiveTimeLimit) {
+            break;
+        }
+    } // for each pass
+
+    if (notNull(sampleCountImage)) {
+        runConcurrently(Point2int32(0, 0), Point2int32(width, height), [&](Point2int32 pix) {
+            sampleCountImage->set(pix, Color1(float(sampleCount[pix.x + pix.y * width])));
+        }, ! m_options.multithreaded);
+    }
+}
+
+
+Ray PathTracer::eyeRay
+   (const shared_ptr<Camera>&           camera,
+    const Rect2D&                       viewport,
+    bool                                depthOfField,
+    Point2int32                         point,
+    const Vector2&                      offset,
+    int                                 rayIndex,
+    int                                 raysPerPixel) const {
+
+    const Point2 P(float(point.x) + offset.x, float(point.y) + offset.y);
+
+    if (depthOfField) {
+        // Hammersley sequence remapped from a square to a disk
+        const uint32_t hash = superFastHash(&point, sizeof(point));
+        const Point2 pixelShift((hash >> 16) / float(0xFFFF), (hash & 0xFFFF) / float(0xFFFF));
+        const Point2& h = (Point2::hammersleySequence2D(rayIndex, raysPerPixel) + pixelShift).mod1();
+        const float angle = 2.0f * h.x * pif();
+        const float radius = sqrt(h.y);
+        const Point2 lens(cos(angle) * radius, sin(angle) * radius);
+        return camera->worldRay(P.x, P.y, lens.x, lens.y, viewport);
+    } else {
+        return camera->worldRay(P.x, P.y, viewport);
+    }
+}
+
+
 void PathTracer::generateEyeRays
 (int                                 width, 
  int                                 height,
@@ -112,28 +539,27 @@ void PathTracer::generateEyeRays
 
     const bool depthOfField = camera->depthOfFieldSettings().enabled() && (camera->depthOfFieldSettings().model() == DepthOfFieldModel::PHYSICAL);
 
+    // For deterministic sampling, generate all of the subpixel offsets in one batch per row
+    Array<Vector4> jitter;
+    const bool batchJitter = randomSubpixelPosition && m_options.deterministicSampling;
+    if (batchJitter) {
+        jitter.resize(width * height);
+        runConcurrently(0, height, [&](int y) {
+            CounterRandom::uniformBatch(m_options.randomSeed, uint32(y * width), uint32(rayIndex), randomStream(0, EYE_RAY_RANDOM), 0, width, jitter.getCArray() + y * width);
+        }, ! m_options.multithreaded);
+    }
+
     runConcurrently(Point2int32(0, 0), Point2int32(width, height), [&](Point2int32 point) {
+        const int i = point.x + point.y * width;
         Vector2 offset(0.5f, 0.5f);
-        if (randomSubpixelPosition) {
+        if (batchJitter) {
+            offset = jitter[i].xy();
+        } else if (randomSubpixelPosition) {
             Random& rng = Random::threadCommon();
             offset.x = rng.uniform(); offset.y = rng.uniform();
         }
-        const int i = point.x + point.y * width;
 
-        const Point2 P(float(point.x) + offset.x, float(point.y) + offset.y);
-
-        if (depthOfField) {
-            // Hammersley sequence remapped from a square to a disk
-            const uint32_t hash = superFastHash(&point, sizeof(point));
-            const Point2 pixelShift((hash >> 16) / float(0xFFFF), (hash & 0xFFFF) / float(0xFFFF));
-            const Point2& h = (Point2::hammersleySequence2D(rayIndex, raysPerPixel) + pixelShift).mod1();
-            const float angle = 2.0f * h.x * pif();
-            const float radius = sqrt(h.y);
-            const Point2 lens(cos(angle) * radius, sin(angle) * radius);
-            rayBuffer[i] = camera->worldRay(P.x, P.y, lens.x, lens.y, viewport);
-        } else {
-            rayBuffer[i] = camera->worldRay(P.x, P.y, viewport);
-        }
+        rayBuffer[i] = eyeRay(camera, viewport, depthOfField, point, offset, rayIndex, raysPerPixel);
 
         // Camera coords put integers at top left, but image coords put them at pixel centers
         const PixelCoord& pixelCoord = Point2(point) + offset - Point2(0.5f, 0.5f);
@@ -147,6 +573,8 @@ void PathTracer::addEmissive
 (const Array<Ray>&                   rayFromEye,
  const Array<shared_ptr<Surfel>>&    surfelBuffer, 
  const Array<bool>&                  impulseRay,
+ const Array<float>&                 scatterDensityBuffer,
+ float                               environmentFraction,
  const Array<Color3>&                modulationBuffer,
  Radiance3*                          outputBuffer,
  const Array<int>                    outputCoordBuffer,
@@ -161,6 +589,11 @@ void PathTracer::addEmissive
         if (surfel && ! impulseRay[i] && surfel->isLight()) {
             // Remove the portion of non-impulse sampling of area lights that was already handled by direct illumination
             L_e *= 1.0f - m_options.areaLightDirectFraction;
+        } else if (! surfel && (environmentFraction > 0.0f) && isFinite(scatterDensityBuffer[i])) {
+            // Weight against the skybox samples taken at the previous event, using the cosine
+            // proxy for the scattering density (see scatterDensityProxy)
+            const float q = scatterDensityBuffer[i];
+            L_e *= q / (q + environmentFraction * m_skyboxSampler->pdf(-w_o));
         }
 
         debugAssertM(L_e.min() >= -1e-6f, "Negative emission");
@@ -208,6 +641,7 @@ const shared_ptr<Light>& PathTracer::importanceSampleLight
  int                                         sequenceIndex,
  int                                         rayIndex,
  int                                         raysPerPixel,
+ Random&                                     rng,
  Biradiance3&                                biradiance,
  Color3&                                     cosBSDFDivPDF,
  Point3&                                     lightPosition) const {
@@ -248,6 +682,39 @@ const shared_ptr<Light>& PathTracer::importanceSampleLight
         cosBSDFDivPDF = f * fabsf(w_i.dot(n));
         return light0;
 
+    } else if (notNull(m_lightTree)) {
+        debugAssertM(m_lightTree->size() == lightArray.size(), "Light tree is out of date");
+
+        // Choose one light stochastically without visiting the others
+        float selectionPDF;
+        const int j = m_lightTree->sample(X, n, rng.uniform(), selectionPDF);
+        if ((j < 0) || (selectionPDF <= 0.0f)) {
+            // No light can illuminate X
+            biradiance    = Biradiance3::zero();
+            cosBSDFDivPDF = Color3::zero();
+            lightPosition = X;
+            return light0;
+        }
+
+        const shared_ptr<Light>& light = lightArray[j];
+        float areaTimesPDFValue;
+        lightPosition = sampleOneLight(light, X, n, sequenceIndex, j, rayIndex, raysPerPixel, areaTimesPDFValue).xyz();
+        const Vector3& w_i = (lightPosition - X).direction();
+        biradiance = light->biradiance(X, lightPosition);
+        if (areaTimesPDFValue != 0.0f) {
+            biradiance /= areaTimesPDFValue;
+        }
+
+        if (visibleAreaLight(light)) {
+            biradiance *= m_options.areaLightDirectFraction;
+        }
+
+        const Color3& f = surfel->finiteScatteringDensity(w_i, w_o);
+        debugAssertM(f.min() >= 0.0f, "Negative finiteScatteringDensity");
+        cosBSDFDivPDF = f * (fabsf(w_i.dot(n)) / selectionPDF);
+        debugAssertM(cosBSDFDivPDF.isFinite(), "Infinite/NaN BSDF");
+        return light;
+
     } else {
 
         // Compute the biradiance for each light. Assume a small number of lights (e.g., 10)
@@ -300,7 +767,6 @@ const shared_ptr<Light>& PathTracer::importanceSampleLight
         // we always select the last light if we slightly overshot due to roundoff. In scenes
         // with only one light, we always choose that light, of course.
         int j = 0;
-        Random& rng = Random::threadCommon();
         Color3 cosBSDF;
         Radiance Lsum;
         for (float r = rng.uniform(0, totalRadiance); j < lightArray.size(); ++j) {
@@ -337,11 +803,15 @@ void PathTracer::computeDirectIllumination
  int                                 currentRayIndex,
  const Options&                      options,
  const Array<PixelCoord>&            pixelCoordBuffer,
+ const Array<int>&                   pathIndexBuffer,
  const int                           radianceImageWidth,
  Array<Radiance3>&                   directBuffer,
  Array<Ray>&                         shadowRayBuffer) const {
 
     const float epsilon = 1e-3f;
+    const float environmentFraction = environmentSampleFraction(lightArray.size(), currentPathDepth);
+    const bool  scattersAfter = (currentPathDepth < options.maxScatteringEvents - 1);
+    debugAssert((lightArray.size() > 0) || (environmentFraction == 1.0f));
 
     runConcurrently(0, surfelBuffer.size(), [&](int i) {
         const shared_ptr<Surfel>& surfel = surfelBuffer[i];
@@ -355,10 +825,38 @@ void PathTracer::computeDirectIllumination
 
         Point2 pixelCoord = pixelCoordBuffer[i];
         int surfelIndex = int(pixelCoord.x + pixelCoord.y * radianceImageWidth);
+
+        CounterRandom counterRandom(options.randomSeed, pathIndexBuffer[i], currentRayIndex, randomStream(currentPathDepth, LIGHT_SELECTION_RANDOM));
+        Random& rng = options.deterministicSampling ? counterRandom : Random::threadCommon();
+        const Vector3& w_o = -rayBuffer[i].direction();
+
+        if ((environmentFraction > 0.0f) && (rng.uniform() < environmentFraction)) {
+            // Sample the skybox. The result is weighted against scattering with scatterDensityProxy,
+            // unless this is the last event and no scattered ray will follow.
+            const Vector4 u(rng.uniform(), rng.uniform(), rng.uniform(), rng.uniform());
+            float pdf;
+            const Vector3& w_i = m_skyboxSampler->sample(u, pdf);
+            const float q = scattersAfter ? scatterDensityProxy(surfel->shadingNormal, w_i) : 0.0f;
+            const float density = environmentFraction * pdf + q;
+            if (density > 0.0f) {
+                L_sd = skyRadiance(-w_i) * surfel->finiteScatteringDensity(w_i, w_o) * (fabsf(w_i.dot(surfel->shadingNormal)) / density);
+            } else {
+                L_sd = Radiance3::zero();
+            }
+
+            if (L_sd.nonZero()) {
+                debugAssertM(L_sd.min() >= 0.0f, "Negative direct light");
+                shadowRayBuffer[i] = Ray::fromOriginAndDirection(surfel->position + surfel->geometricNormal * epsilon * sign(w_i.dot(surfel->geometricNormal)), w_i, epsilon);
+            } else {
+                shadowRayBuffer[i] = s_degenerateRay;
+            }
+            return;
+        }
+
         // Compute the surfel index before surfel compaction to ensure the low
         // discrepancy samples are not accidentally correlated.
-        const shared_ptr<Light>& light = importanceSampleLight(lightArray, -rayBuffer[i].direction(), surfel, surfelIndex * options.maxScatteringEvents + currentPathDepth, currentRayIndex, options.raysPerPixel, biradiance, cosBSDFDivPDF, lightPosition);
-        L_sd = biradiance * cosBSDFDivPDF;
+        const shared_ptr<Light>& light = importanceSampleLight(lightArray, w_o, surfel, surfelIndex * options.maxScatteringEvents + currentPathDepth, currentRayIndex, options.raysPerPixel, rng, biradiance, cosBSDFDivPDF, lightPosition);
+        L_sd = biradiance * cosBSDFDivPDF / (1.0f - environmentFraction);
 
         // Cast shadow rays from the light to the surface for more coherence in scenes
         // with few lights (i.e., where many pixels are casting from the same lights)
@@ -444,13 +942,15 @@ void PathTracer::shade
 
 void PathTracer::scatterRays
    (const Array<shared_ptr<Surfel>>&        surfelBuffer,
+    const Array<int>&                       pathIndexBuffer,
     const Array<shared_ptr<Light>>&         indirectLightArray,
     int                                     currentPathDepth,
     int                                     rayIndex,
     int                                     raysPerPixel,
     Array<Ray>&                             rayBuffer,
     Array<Color3>&                          modulationBuffer,
-    Array<bool>&                            impulseRay) const {
+    Array<bool>&                            impulseRay,
+    Array<float>&                           scatterDensityBuffer) const {
     
     static const float epsilon = 1e-4f;
 
@@ -473,21 +973,25 @@ void PathTracer::scatterRays
         // Direction that light came in, being sampled
         Vector3 w_i;
 
+        CounterRandom counterRandom(m_options.randomSeed, pathIndexBuffer[i], rayIndex, randomStream(currentPathDepth, SCATTER_RANDOM));
+        Random& rng = m_options.deterministicSampling ? counterRandom : Random::threadCommon();
+
 #       if 1 // Surfel scattering
-            surfel->scatter(PathDirection::EYE_TO_SOURCE, w_o, false, Random::threadCommon(), weight, w_i, impulseRay[i]);
+            surfel->scatter(PathDirection::EYE_TO_SOURCE, w_o, false, rng, weight, w_i, impulseRay[i]);
 #       else // Replace the BSDF for specific experiments.
             // scatterDBRDF
             // scatterDisney
             // scatterPeteCone
             // scatterBlinnPhong
             // scatterHackedBlinnPhong
-            SimpleBSDF::scatter(dynamic_pointer_cast<UniversalSurfel>(surfel), w_o, Random::threadCommon(), w_i, weight);
+            SimpleBSDF::scatter(dynamic_pointer_cast<UniversalSurfel>(surfel), w_o, rng, w_i, weight);
 #       endif
 
         if ((modulationBuffer[i].sum() < minModulation) || w_i.isNaN() || weight.isZero()) {
             // This ray didn't scatter; it will be culled after the next pass, so avoid
             // the cost of a real ray cast on it
             rayBuffer[i] = s_degenerateRay;
+            scatterDensityBuffer[i] = finf();
         } else {
             debugAssertM(weight.isFinite(), "Nonfinite weight");
             debugAssertM(weight.min() >= 0.0f, "Negative weight");
@@ -506,10 +1010,33 @@ void PathTracer::scatterRays
 
 
             modulationBuffer[i] *= weight;
+            scatterDensityBuffer[i] = impulseRay[i] ? finf() : scatterDensityProxy(surfel->shadingNormal, w_i);
             rayBuffer[i] = Ray::fromOriginAndDirection(surfel->position + surfel->geometricNormal * epsilon * sign(w_i.dot(surfel->geometricNormal)), w_i);
         }
     });
 }
+
+
+void PathTracer::scatterRays
+   (const Array<shared_ptr<Surfel>>&        surfelBuffer,
+    const Array<shared_ptr<Light>>&         indirectLightArray,
+    int                                     currentPathDepth,
+    int                                     rayIndex,
+    int                                     raysPerPixel,
+    Array<Ray>&                             rayBuffer,
+    Array<Color3>&                          modulationBuffer,
+    Array<bool>&                            impulseRay) const {
+
+    Array<int> pathIndexBuffer;
+    pathIndexBuffer.resize(surfelBuffer.size());
+    for (int i = 0; i < pathIndexBuffer.size(); ++i) {
+        pathIndexBuffer[i] = i;
+    }
+    Array<float> scatterDensityBuffer;
+    scatterDensityBuffer.resize(surfelBuffer.size());
+
+    scatterRays(surfelBuffer, pathIndexBuffer, indirectLightArray, currentPathDepth, rayIndex, raysPerPixel, rayBuffer, modulationBuffer, impulseRay, scatterDensityBuffer);
+}
  
 
 void PathTracer::traceBuffer
@@ -533,10 +1060,12 @@ void PathTracer::traceBuffer
     buffers.resize(rayBuffer.size());
     buffers.ray = rayBuffer;
     buffers.outputIndex.resize(buffers.size());
+    buffers.pathIndex.resize(buffers.size());
 
     // Writing to output buffer
     runConcurrently(size_t(0), buffers.size(), [&](size_t i) {
         buffers.outputIndex[i] = int(i);
+        buffers.pathIndex[i] = int(i);
     });
 
     if (notNull(weight)) {
@@ -547,6 +1076,10 @@ void PathTracer::traceBuffer
         buffers.modulation.setAll(Color3::one());
     }
     buffers.impulseRay.setAll(lightEmissiveOnFirstHit);
+    buffers.scatterDensity.setAll(finf());
+
+    // The ray footprints are unknown, so sample the finest MIP level
+    buffers.coneCos.setAll(1.0f);
     
     // Zero the output
     System::memset(output, 0, sizeof(Radiance3) * buffers.size());
@@ -565,7 +1098,14 @@ void PathTracer::prepare
     m_options = options;
 
     debugAssert(notNull(m_scene));
-    if (max(m_scene->lastEditingTime(), m_scene->lastStructuralChangeTime(), m_scene->lastVisibleChangeTime()) > m_triTree->lastBuildTime()) {
+    bool switchedTree = false;
+    if (options.useInstancedTriTree != (m_triTree != m_defaultTriTree)) {
+        // The default tree may be out of date after tracing with the other one
+        m_triTree = options.useInstancedTriTree ? shared_ptr<TriTree>(InstancedTriTree::create()) : m_defaultTriTree;
+        switchedTree = true;
+    }
+
+    if (switchedTree || (max(m_scene->lastEditingTime(), m_scene->lastStructuralChangeTime(), m_scene->lastVisibleChangeTime()) > m_triTree->lastBuildTime())) {
         // Reset the tree
         debugPrintf("Rebuilding TriTree\n");
         m_triTree->setContents(m_scene);
@@ -590,10 +1130,37 @@ void PathTracer::prepare
         }
     }
 
+    // Lights may have moved, so rebuild the light tree for every trace. This is O(n log n) in the
+    // number of lights, which is negligible compared to tracing.
+    static const int minLightsForTree = 12;
+    if (m_options.useLightTree && (directLightArray.size() > minLightsForTree)) {
+        m_lightTree = LightTree::create(directLightArray);
+    } else {
+        m_lightTree = nullptr;
+    }
+
+    if (m_options.importanceSampleEnvironment && notNull(m_skybox)) {
+        if (m_skyboxSamplerSource != m_skybox) {
+            m_skyboxSampler = CubeMapSampler::create(m_skybox);
+            m_skyboxSamplerSource = m_skybox;
+        }
+    } else {
+        m_skyboxSampler = nullptr;
+        m_skyboxSamplerSource = nullptr;
+    }
+
     if (m_options.useEnvironmentMapForLastScatteringEvent && isNull(m_environmentMap)) {
         m_environmentMap = m_scene->environmentMapAsCubeMap();
     }
 
+    // The cache is shared with every other PathTracer, so leave it alone unless this one uses it.
+    // No trace that uses the cache can be sampling it at this point, so reclaim the tiles that
+    // were evicted during the previous one.
+    if (m_options.textureCacheSizeMB > 0.0f) {
+        const shared_ptr<TextureTileCache>& textureCache = TextureTileCache::global();
+        textureCache->setMemoryBudget(size_t(m_options.textureCacheSizeMB * 1024.0f * 1024.0f));
+        textureCache->advanceEpoch();
+    }
 }
 
 
@@ -617,9 +1184,14 @@ void PathTracer::traceBufferInternal
 
     int radianceImageWidth = radianceImage->width();
 
+    // Only compute ray cones when they will be used to select MIP levels. Without cones, materials
+    // are sampled at full resolution even if another PathTracer has enabled the shared cache.
+    const bool useRayCones = (m_options.textureCacheSizeMB > 0.0f);
+    static const Array<float> noCones;
+
     for (int scatteringEvents = 0; (scatteringEvents < numTraceIterations) && (buffers.surfel.size() > 0); ++scatteringEvents) {
 
-        m_triTree->intersectRays(buffers.ray, buffers.surfel, (scatteringEvents == 0) ? TriTree::COHERENT_RAY_HINT : 0);
+        m_triTree->intersectRays(buffers.ray, buffers.surfel, (scatteringEvents == 0) ? TriTree::COHERENT_RAY_HINT : 0, useRayCones ? buffers.coneCos : noCones);
 
         if (notNull(distance) && (scatteringEvents == 0)) {
             // Write to the distance buffer.
@@ -630,7 +1202,8 @@ void PathTracer::traceBufferInternal
             });
         }
 
-        addEmissive(buffers.ray, buffers.surfel, buffers.impulseRay, buffers.modulation, output, buffers.outputIndex, radianceImage, buffers.outputCoord);
+        const float previousEnvironmentFraction = (scatteringEvents > 0) ? environmentSampleFraction(directLightArray.size(), scatteringEvents - 1) : 0.0f;
+        addEmissive(buffers.ray, buffers.surfel, buffers.impulseRay, buffers.scatterDensity, previousEnvironmentFraction, buffers.modulation, output, buffers.outputIndex, radianceImage, buffers.outputCoord);
 
         // Compact buffers by removing paths that terminated (missed the entire scene)
         // This must be done serially.
@@ -641,16 +1214,28 @@ void PathTracer::traceBufferInternal
             }
         } // for i
 
-        // Direct lighting
-        if (directLightArray.size() > 0) {
-            computeDirectIllumination(buffers.surfel, directLightArray, buffers.ray, scatteringEvents, currentRayIndex, m_options, buffers.outputCoord, radianceImageWidth, buffers.direct, buffers.shadowRay);
+        // Direct lighting, including skybox samples
+        if ((directLightArray.size() > 0) || (environmentSampleFraction(0, scatteringEvents) > 0.0f)) {
+            computeDirectIllumination(buffers.surfel, directLightArray, buffers.ray, scatteringEvents, currentRayIndex, m_options, buffers.outputCoord, buffers.pathIndex, radianceImageWidth, buffers.direct, buffers.shadowRay);
             m_triTree->intersectRays(buffers.shadowRay, buffers.lightShadowed, TriTree::COHERENT_RAY_HINT | TriTree::DO_NOT_CULL_BACKFACES | TriTree::OCCLUSION_TEST_ONLY);
             shade(buffers.surfel, buffers.ray, buffers.shadowRay, buffers.lightShadowed, buffers.direct, buffers.modulation, output, buffers.outputIndex, radianceImage, buffers.outputCoord);
         }
 
         // Indirect lighting rays (don't compute on the last scattering event)
         if (scatteringEvents < m_options.maxScatteringEvents - 1) {
-            scatterRays(buffers.surfel, indirectLightArray, scatteringEvents, currentRayIndex, m_options.raysPerPixel, buffers.ray, buffers.modulation, buffers.impulseRay);
+            scatterRays(buffers.surfel, buffers.pathIndex, indirectLightArray, scatteringEvents, currentRayIndex, m_options.raysPerPixel, buffers.ray, buffers.modulation, buffers.impulseRay, buffers.scatterDensity);
+
+            if (useRayCones) {
+                // A direction chosen with density p covers about 1/p steradians, which is a cone of
+                // half-angle sqrt(1 / (pi p)). Impulses (and unscattered rays, whose density is
+                // infinite) keep their incoming cone.
+                runConcurrently(0, buffers.ray.size(), [&](int i) {
+                    const float density = buffers.scatterDensity[i];
+                    if (! buffers.impulseRay[i] && (density < finf()) && (density > 0.0f)) {
+                        buffers.coneCos[i] = cos(min(0.5f, sqrt(1.0f / (pif() * density))));
+                    }
+                }, ! m_options.multithreaded);
+            }
         }
     } // for scattering events
 
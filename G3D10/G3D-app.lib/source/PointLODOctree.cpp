@@ -0,0 +1,619 @@
+/**
+  \file G3D-app.lib/source/PointLODOctree.cpp
+
+  G3D Innovation Engine http://casual-effects.com/g3d
+  Copyright 2000-2019, Morgan McGuire
+  All rights reserved
+  Available under the BSD License
+*/
+#include "G3D-app/PointLODOctree.h"
+#include "G3D-base/FileSystem.h"
+#include "G3D-base/System.h"
+#include "G3D-base/format.h"
+#include <algorithm>
+#include <cstdio>
+
+namespace G3D {
+
+/** Record format of the temporary files */
+class PackedPoint {
+public:
+    Point3          position;
+    Color4unorm8    color;
+};
+
+/** Points read from or written to a temporary file at a time */
+static const int CHUNK_SIZE = 1 << 16;
+
+/** Bytes of a node's points in the octree file */
+static const int64 BYTES_PER_POINT = sizeof(Point3) + sizeof(Color4unorm8);
+
+/** version, numPoints, numNodes, node table offset */
+static const int64 HEADER_SIZE = 8 + 8 + 4 + 8;
+
+
+static void seekFile(FILE* file, int64 position) {
+#   ifdef G3D_WINDOWS
+        const int ret = _fseeki64(file, position, SEEK_SET);
+#   else
+        const int ret = fseeko(file, (off_t)position, SEEK_SET);
+#   endif
+    debugAssert(ret == 0); (void)ret;
+}
+
+
+static void writePackedPoints(FILE* file, const Array<PackedPoint>& points) {
+    if (points.size() > 0) {
+        fwrite(points.getCArray(), sizeof(PackedPoint), points.size(), file);
+    }
+}
+
+
+/** Builds the nodes of one octree file depth first, writing each node's points as soon as they are known */
+class PointLODOctreeWriter {
+public:
+    const PointLODOctree::Specification&    specification;
+    const String&                           tempPrefix;
+    FILE*                                   out;
+    int64                                   offset = HEADER_SIZE;
+    Array<PointLODOctree::Node>             node;
+
+    /** One bit per subsampling grid cell */
+    Array<uint64>                           occupied;
+
+    /** Words of occupied to clear after each node */
+    Array<int>                              touched;
+
+    PointLODOctreeWriter(const PointLODOctree::Specification& specification, const String& tempPrefix, FILE* out) :
+        specification(specification), tempPrefix(tempPrefix), out(out) {
+        const int64 numCells = int64(specification.gridResolution) * specification.gridResolution * specification.gridResolution;
+        occupied.resize(int((numCells + 63) / 64));
+        System::memset(occupied.getCArray(), 0, sizeof(uint64) * occupied.size());
+    }
+
+    int newNode(const AABox& bounds, int level, int parent) {
+        PointLODOctree::Node& n = node.next();
+        n.bounds = bounds;
+        n.level = level;
+        n.parent = parent;
+        return node.size() - 1;
+    }
+
+    static int octant(const Point3& P, const Point3& center) {
+        return ((P.x >= center.x) ? 1 : 0) | ((P.y >= center.y) ? 2 : 0) | ((P.z >= center.z) ? 4 : 0);
+    }
+
+    static AABox childBounds(const AABox& bounds, int o) {
+        const Point3& C = bounds.center();
+        const Point3& L = bounds.low();
+        const Point3& H = bounds.high();
+        return AABox(Point3((o & 1) ? C.x : L.x, (o & 2) ? C.y : L.y, (o & 4) ? C.z : L.z),
+                     Point3((o & 1) ? H.x : C.x, (o & 2) ? H.y : C.y, (o & 4) ? H.z : C.z));
+    }
+
+    /** True if \a P falls in a grid cell of \a bounds that is not yet occupied, which it then marks */
+    bool claimCell(const Point3& P, const AABox& bounds) {
+        const int g = specification.gridResolution;
+        const Vector3& v = (P - bounds.low()) * (float(g) / bounds.extent().x);
+        const int64 x = clamp(iFloor(v.x), 0, g - 1);
+        const int64 y = clamp(iFloor(v.y), 0, g - 1);
+        const int64 z = clamp(iFloor(v.z), 0, g - 1);
+        const int64 cell = x + g * (y + g * z);
+        uint64& word = occupied[int(cell >> 6)];
+        const uint64 bit = uint64(1) << (cell & 63);
+        if (word & bit) {
+            return false;
+        }
+        if (word == 0) {
+            touched.append(int(cell >> 6));
+        }
+        word |= bit;
+        return true;
+    }
+
+    void clearCells() {
+        for (const int w : touched) {
+            occupied[w] = 0;
+        }
+        touched.fastClear();
+    }
+
+    void writePoints(int n, const Array<Point3>& position, const Array<Color4unorm8>& color) {
+        node[n].numPoints = position.size();
+        node[n].fileOffset = offset;
+        if (position.size() > 0) {
+            fwrite(position.getCArray(), sizeof(Point3), position.size(), out);
+            fwrite(color.getCArray(), sizeof(Color4unorm8), color.size(), out);
+        }
+        offset += BYTES_PER_POINT * position.size();
+    }
+
+    bool isLeaf(int n, int64 numPoints) const {
+        return (numPoints <= specification.maxPointsPerNode) || (node[n].level >= specification.maxDepth);
+    }
+
+    /** Builds node \a n and its descendants from points in memory. Clears the arrays. */
+    void buildInMemory(int n, Array<Point3>& position, Array<Color4unorm8>& color) {
+        if (isLeaf(n, position.size())) {
+            writePoints(n, position, color);
+            position.clear();
+            color.clear();
+            return;
+        }
+
+        const AABox bounds = node[n].bounds;
+        const Point3& center = bounds.center();
+        Array<Point3> samplePosition;
+        Array<Color4unorm8> sampleColor;
+        Array<Point3> childPosition[8];
+        Array<Color4unorm8> childColor[8];
+        for (int i = 0; i < position.size(); ++i) {
+            const Point3& P = position[i];
+            if ((samplePosition.size() < specification.maxPointsPerNode) && claimCell(P, bounds)) {
+                samplePosition.append(P);
+                sampleColor.append(color[i]);
+            } else {
+                const int o = octant(P, center);
+                childPosition[o].append(P);
+                childColor[o].append(color[i]);
+            }
+        }
+        clearCells();
+        position.clear();
+        color.clear();
+
+        node[n].spacing = bounds.extent().x / float(specification.gridResolution);
+        writePoints(n, samplePosition, sampleColor);
+
+        for (int o = 0; o < 8; ++o) {
+            if (childPosition[o].size() > 0) {
+                const int c = newNode(childBounds(bounds, o), node[n].level + 1, n);
+                node[n].child[o] = c;
+                buildInMemory(c, childPosition[o], childColor[o]);
+            }
+        }
+    }
+
+    /** Builds node \a n and its descendants from the \a numPoints points in temporary file
+        \a filename, adding \a translation to each. Deletes the file. */
+    void buildFromFile(int n, const String& filename, int64 numPoints, const Vector3& translation) {
+        FILE* in = fopen(filename.c_str(), "rb");
+        alwaysAssertM(notNull(in), "Could not open " + filename);
+        Array<PackedPoint> chunk;
+
+        if (numPoints <= specification.maxPointsInMemory) {
+            Array<Point3> position;
+            Array<Color4unorm8> color;
+            position.reserve(int(numPoints));
+            color.reserve(int(numPoints));
+            for (int64 i = 0; i < numPoints; i += CHUNK_SIZE) {
+                chunk.resize(int(min(int64(CHUNK_SIZE), numPoints - i)));
+                fread(chunk.getCArray(), sizeof(PackedPoint), chunk.size(), in);
+                for (const PackedPoint& p : chunk) {
+                    position.append(p.position + translation);
+                    color.append(p.color);
+                }
+            }
+            fclose(in);
+            FileSystem::removeFile(filename);
+            buildInMemory(n, position, color);
+            return;
+        }
+
+        if (node[n].level >= specification.maxDepth) {
+            // A leaf too large to hold in memory: copy the positions, then the colors
+            node[n].numPoints = numPoints;
+            node[n].fileOffset = offset;
+            for (int pass = 0; pass < 2; ++pass) {
+                seekFile(in, 0);
+                Array<Point3> position;
+                Array<Color4unorm8> color;
+                for (int64 i = 0; i < numPoints; i += CHUNK_SIZE) {
+                    chunk.resize(int(min(int64(CHUNK_SIZE), numPoints - i)));
+                    fread(chunk.getCArray(), sizeof(PackedPoint), chunk.size(), in);
+                    position.fastClear();
+                    color.fastClear();
+                    for (const PackedPoint& p : chunk) {
+                        position.append(p.position + translation);
+                        color.append(p.color);
+                    }
+                    if (pass == 0) {
+                        fwrite(position.getCArray(), sizeof(Point3), position.size(), out);
+                    } else {
+                        fwrite(color.getCArray(), sizeof(Color4unorm8), color.size(), out);
+                    }
+                }
+            }
+            offset += BYTES_PER_POINT * numPoints;
+            fclose(in);
+            FileSystem::removeFile(filename);
+            return;
+        }
+
+        // One pass selects this node's subsample and splits everything else by octant
+        const AABox bounds = node[n].bounds;
+        const Point3& center = bounds.center();
+        Array<Point3> samplePosition;
+        Array<Color4unorm8> sampleColor;
+        FILE* childFile[8] = {};
+        String childFilename[8];
+        int64 childCount[8] = {};
+        Array<PackedPoint> childBuffer[8];
+
+        for (int64 i = 0; i < numPoints; i += CHUNK_SIZE) {
+            chunk.resize(int(min(int64(CHUNK_SIZE), numPoints - i)));
+            fread(chunk.getCArray(), sizeof(PackedPoint), chunk.size(), in);
+            for (PackedPoint& p : chunk) {
+                p.position += translation;
+                if ((samplePosition.size() < specification.maxPointsPerNode) && claimCell(p.position, bounds)) {
+                    samplePosition.append(p.position);
+                    sampleColor.append(p.color);
+                } else {
+                    const int o = octant(p.position, center);
+                    childBuffer[o].append(p);
+                    ++childCount[o];
+                    if (childBuffer[o].size() == CHUNK_SIZE) {
+                        if (isNull(childFile[o])) {
+                            childFilename[o] = tempPrefix + format("%d-%d.tmp", n, o);
+                            childFile[o] = fopen(childFilename[o].c_str(), "wb");
+                            alwaysAssertM(notNull(childFile[o]), "Could not create " + childFilename[o]);
+                        }
+                        writePackedPoints(childFile[o], childBuffer[o]);
+                        childBuffer[o].fastClear();
+                    }
+                }
+            }
+        }
+        clearCells();
+        fclose(in);
+        FileSystem::removeFile(filename);
+
+        node[n].spacing = bounds.extent().x / float(specification.gridResolution);
+        writePoints(n, samplePosition, sampleColor);
+        samplePosition.clear();
+        sampleColor.clear();
+
+        for (int o = 0; o < 8; ++o) {
+            if (childCount[o] == 0) {
+                continue;
+            }
+
+            const int c = newNode(childBounds(bounds, o), node[n].level + 1, n);
+            node[n].child[o] = c;
+            if (isNull(childFile[o])) {
+                // Never spilled
+                Array<Point3> position;
+                Array<Color4unorm8> color;
+                for (const PackedPoint& p : childBuffer[o]) {
+                    position.append(p.position);
+                    color.append(p.color);
+                }
+                childBuffer[o].clear();
+                buildInMemory(c, position, color);
+            } else {
+                writePackedPoints(childFile[o], childBuffer[o]);
+                childBuffer[o].clear();
+                fclose(childFile[o]);
+                buildFromFile(c, childFilename[o], childCount[o], Vector3::zero());
+            }
+        }
+    }
+};
+
+////////////////////////////////////////////////////////////////////////////
+
+PointLODOctree::Builder::Builder(const String& filename, const Specification& specification) :
+    m_filename(filename), m_specification(specification) {
+    alwaysAssertM(specification.gridResolution > 0, "gridResolution must be positive");
+    alwaysAssertM(specification.maxPointsPerNode > 0, "maxPointsPerNode must be positive");
+    alwaysAssertM(specification.maxPointsInMemory >= specification.maxPointsPerNode,
+        "maxPointsInMemory must be at least maxPointsPerNode");
+}
+
+
+shared_ptr<PointLODOctree::Builder> PointLODOctree::Builder::create(const String& filename, const Specification& specification) {
+    return createShared<Builder>(filename, specification);
+}
+
+
+PointLODOctree::Builder::~Builder() {
+    if (notNull(m_spillFile)) {
+        fclose(m_spillFile);
+        m_spillFile = nullptr;
+        FileSystem::removeFile(m_filename + ".spill.tmp");
+    }
+}
+
+
+void PointLODOctree::Builder::addPoint(const Point3& position, const Color4unorm8& color) {
+    m_position.append(position);
+    m_color.append(color);
+    m_bounds.merge(position);
+    m_sum[0] += position.x;
+    m_sum[1] += position.y;
+    m_sum[2] += position.z;
+    ++m_numPoints;
+
+    if (m_position.size() >= m_specification.maxPointsInMemory) {
+        spill();
+    }
+}
+
+
+void PointLODOctree::Builder::spill() {
+    if (isNull(m_spillFile)) {
+        const String& spillFilename = m_filename + ".spill.tmp";
+        m_spillFile = fopen(spillFilename.c_str(), "wb");
+        alwaysAssertM(notNull(m_spillFile), "Could not create " + spillFilename);
+    }
+
+    Array<PackedPoint> chunk;
+    for (int i = 0; i < m_position.size(); i += CHUNK_SIZE) {
+        chunk.resize(min(CHUNK_SIZE, m_position.size() - i));
+        for (int j = 0; j < chunk.size(); ++j) {
+            chunk[j].position = m_position[i + j];
+            chunk[j].color = m_color[i + j];
+        }
+        writePackedPoints(m_spillFile, chunk);
+    }
+    m_numSpilled += m_position.size();
+    m_position.clear();
+    m_color.clear();
+}
+
+
+Point3 PointLODOctree::Builder::center() const {
+    if (m_numPoints == 0) {
+        return Point3::zero();
+    }
+    return Point3(float(m_sum[0] / double(m_numPoints)), float(m_sum[1] / double(m_numPoints)), float(m_sum[2] / double(m_numPoints)));
+}
+
+
+void PointLODOctree::Builder::commit(const Vector3& translation) {
+    alwaysAssertM(System::machineEndian() == G3DEndian::G3D_LITTLE_ENDIAN,
+        "Cannot write a PointLODOctree on a big endian machine");
+
+    FILE* out = fopen(m_filename.c_str(), "wb");
+    alwaysAssertM(notNull(out), "Could not create " + m_filename);
+
+    // Reserve the header
+    const char zero[HEADER_SIZE] = {};
+    fwrite(zero, 1, HEADER_SIZE, out);
+
+    const String& tempPrefix = m_filename + ".";
+    PointLODOctreeWriter writer(m_specification, tempPrefix, out);
+    if (m_numPoints > 0) {
+        // A cube, so that every node's subsampling grid has cubic cells
+        const Point3& center = m_bounds.center() + translation;
+        const float halfExtent = max(m_bounds.extent().max() * 0.5f * 1.0001f, 1e-4f);
+        const int root = writer.newNode(AABox(center - Vector3::one() * halfExtent, center + Vector3::one() * halfExtent), 0, -1);
+
+        if (isNull(m_spillFile)) {
+            for (Point3& P : m_position) {
+                P += translation;
+            }
+            writer.buildInMemory(root, m_position, m_color);
+        } else {
+            spill();
+            fclose(m_spillFile);
+            m_spillFile = nullptr;
+            writer.buildFromFile(root, m_filename + ".spill.tmp", m_numSpilled, translation);
+        }
+    }
+
+    // Node table
+    const int64 tableOffset = writer.offset;
+    for (const Node& node : writer.node) {
+        fwrite(&node.bounds.low(), sizeof(Point3), 1, out);
+        fwrite(&node.bounds.high(), sizeof(Point3), 1, out);
+        fwrite(&node.spacing, sizeof(float), 1, out);
+        fwrite(&node.level, sizeof(int32), 1, out);
+        fwrite(&node.parent, sizeof(int32), 1, out);
+        fwrite(node.child, sizeof(int32), 8, out);
+        fwrite(&node.numPoints, sizeof(int64), 1, out);
+        fwrite(&node.fileOffset, sizeof(int64), 1, out);
+    }
+
+    // Header
+    seekFile(out, 0);
+    const int64 version = CURRENT_FILE_FORMAT;
+    const int32 numNodes = writer.node.size();
+    fwrite(&version, sizeof(int64), 1, out);
+    fwrite(&m_numPoints, sizeof(int64), 1, out);
+    fwrite(&numNodes, sizeof(int32), 1, out);
+    fwrite(&tableOffset, sizeof(int64), 1, out);
+    fclose(out);
+    out = nullptr;
+}
+
+////////////////////////////////////////////////////////////////////////////
+
+shared_ptr<PointLODOctree> PointLODOctree::open(const String& filename) {
+    alwaysAssertM(System::machineEndian() == G3DEndian::G3D_LITTLE_ENDIAN,
+        "Cannot read a PointLODOctree on a big endian machine");
+
+    FILE* file = fopen(filename.c_str(), "rb");
+    if (isNull(file)) {
+        return nullptr;
+    }
+
+    int64 version = 0;
+    if ((fread(&version, sizeof(int64), 1, file) != 1) || (version != CURRENT_FILE_FORMAT)) {
+        debugPrintf("PointLODOctree file out of date\n");
+        fclose(file);
+        return nullptr;
+    }
+
+    const shared_ptr<PointLODOctree>& octree = createShared<PointLODOctree>();
+    octree->m_filename = filename;
+    octree->m_file = file;
+
+    int32 numNodes = 0;
+    int64 tableOffset = 0;
+    fread(&octree->m_numPoints, sizeof(int64), 1, file);
+    fread(&numNodes, sizeof(int32), 1, file);
+    fread(&tableOffset, sizeof(int64), 1, file);
+
+    seekFile(file, tableOffset);
+    octree->m_node.resize(numNodes);
+    for (Node& node : octree->m_node) {
+        Point3 low, high;
+        fread(&low, sizeof(Point3), 1, file);
+        fread(&high, sizeof(Point3), 1, file);
+        node.bounds = AABox(low, high);
+        fread(&node.spacing, sizeof(float), 1, file);
+        fread(&node.level, sizeof(int32), 1, file);
+        fread(&node.parent, sizeof(int32), 1, file);
+        fread(node.child, sizeof(int32), 8, file);
+        fread(&node.numPoints, sizeof(int64), 1, file);
+        fread(&node.fileOffset, sizeof(int64), 1, file);
+    }
+
+    octree->m_resident.resize(numNodes);
+    octree->m_lastUsed.resize(numNodes);
+    for (int64& t : octree->m_lastUsed) {
+        t = -1;
+    }
+
+    return octree;
+}
+
+
+PointLODOctree::~PointLODOctree() {
+    if (notNull(m_file)) {
+        fclose(m_file);
+        m_file = nullptr;
+    }
+}
+
+
+void PointLODOctree::selectNodes(const Viewpoint& viewpoint, Array<int>& nodeIndexArray) const {
+    if (m_node.size() == 0) {
+        return;
+    }
+
+    // Max-heap of nodes whose parents are selected, by the projected spacing of their parents,
+    // i.e., the error that selecting them removes
+    class Candidate {
+    public:
+        int     node;
+        float   error;
+        bool operator<(const Candidate& other) const {
+            return error < other.error;
+        }
+    };
+    Array<Candidate> heap;
+
+    const auto& culled = [&](const Node& node) {
+        return (viewpoint.clipPlanes.size() > 0) && node.bounds.culledBy(viewpoint.clipPlanes);
+    };
+
+    if (! culled(m_node[0])) {
+        heap.append(Candidate{0, finf()});
+    }
+
+    int64 numPoints = 0;
+    while (heap.size() > 0) {
+        std::pop_heap(heap.begin(), heap.end());
+        const Candidate c = heap.pop();
+        const Node& node = m_node[c.node];
+
+        if ((numPoints + node.numPoints > viewpoint.maxPoints) && (numPoints > 0)) {
+            break;
+        }
+        nodeIndexArray.append(c.node);
+        numPoints += node.numPoints;
+
+        if (node.spacing > 0.0f) {
+            const Point3& nearest = viewpoint.eye.max(node.bounds.low()).min(node.bounds.high());
+            const float distance = max((nearest - viewpoint.eye).length(), 1e-6f);
+            const float error = node.spacing * viewpoint.pixelsPerUnit / distance;
+            if (error > viewpoint.maxErrorPixels) {
+                for (int o = 0; o < 8; ++o) {
+                    if ((node.child[o] >= 0) && ! culled(m_node[node.child[o]])) {
+                        heap.append(Candidate{node.child[o], error});
+                        std::push_heap(heap.begin(), heap.end());
+                    }
+                }
+            }
+        }
+    }
+}
+
+
+shared_ptr<PointLODOctree::NodePoints> PointLODOctree::readNode(int n) {
+    const Node& node = m_node[n];
+    const shared_ptr<NodePoints>& points = createShared<NodePoints>();
+    points->position.resize(int(node.numPoints));
+    points->color.resize(int(node.numPoints));
+    seekFile(m_file, node.fileOffset);
+    fread(points->position.getCArray(), sizeof(Point3), points->position.size(), m_file);
+    fread(points->color.getCArray(), sizeof(Color4unorm8), points->color.size(), m_file);
+
+    m_resident[n] = points;
+    ++m_stats.numResidentNodes;
+    m_stats.numResidentPoints += node.numPoints;
+    ++m_stats.numNodeLoads;
+    return points;
+}
+
+
+void PointLODOctree::makeResident(const Array<int>& nodeIndexArray) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    ++m_clock;
+    for (const int n : nodeIndexArray) {
+        if (isNull(m_resident[n])) {
+            readNode(n);
+        }
+        m_lastUsed[n] = m_clock;
+    }
+
+    // Evict the least recently used of the other nodes until they fit in the budget
+    Array<int> unused;
+    int64 numUnusedPoints = 0;
+    for (int n = 0; n < m_resident.size(); ++n) {
+        if (notNull(m_resident[n]) && (m_lastUsed[n] != m_clock)) {
+            unused.append(n);
+            numUnusedPoints += m_node[n].numPoints;
+        }
+    }
+
+    if (numUnusedPoints > m_residentPointBudget) {
+        std::sort(unused.begin(), unused.end(), [&](int a, int b) { return m_lastUsed[a] < m_lastUsed[b]; });
+        for (int i = 0; (i < unused.size()) && (numUnusedPoints > m_residentPointBudget); ++i) {
+            const int n = unused[i];
+            m_resident[n].reset();
+            numUnusedPoints -= m_node[n].numPoints;
+            --m_stats.numResidentNodes;
+            m_stats.numResidentPoints -= m_node[n].numPoints;
+            ++m_stats.numNodeEvictions;
+        }
+    }
+}
+
+
+shared_ptr<PointLODOctree::NodePoints> PointLODOctree::residentPoints(int n) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_resident[n];
+}
+
+
+shared_ptr<PointLODOctree::NodePoints> PointLODOctree::loadPoints(int n) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return notNull(m_resident[n]) ? m_resident[n] : readNode(n);
+}
+
+
+void PointLODOctree::setResidentPointBudget(int64 numPoints) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_residentPointBudget = numPoints;
+}
+
+
+PointLODOctree::Stats PointLODOctree::stats() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
+
+} // namespace G3D
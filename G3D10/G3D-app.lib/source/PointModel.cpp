@@ -11,6 +11,8 @@
 #include "G3D-app/PointSurface.h"
 #include "G3D-app/Entity.h"
 #include "G3D-base/FileSystem.h"
+#include "G3D-base/BinaryInput.h"
+#include "G3D-base/ParsePLY.h"
 #include "G3D-base/ParseVOX.h"
 #include "G3D-base/Ray.h"
 
@@ -27,6 +29,7 @@ Any PointModel::Specification::toAny() const {
     a["filename"]                  = filename;
     a["scale"]                     = scale;
     a["renderAsDisk"]              = renderAsDisk;
+    a["streaming"]                 = streaming;
     return a;
 }
 
@@ -56,6 +59,7 @@ PointModel::Specification::Specification(const Any& a) {
 
         r.getIfPresent("scale",                     scale);
         r.getIfPresent("renderAsDisk",              renderAsDisk);
+        r.getIfPresent("streaming",                 streaming);
 
 
         r.verifyDone();
@@ -93,6 +97,10 @@ void PointModel::PointArray::copyToGPU() {
 
 
 void PointModel::load(const Specification& spec) {
+    if (spec.streaming) {
+        loadStreaming(spec);
+        return;
+    }
 
     const String& resolvedFilename = FileSystem::resolve(spec.filename);
     const String& cacheFilename = makeCacheFilename(resolvedFilename);
@@ -112,22 +120,7 @@ void PointModel::load(const Specification& spec) {
         m_pointArrayArray[0] = shared_ptr<PointArray>(new PointArray());
         m_pointRadius = 0.01f;
 
-        if (endsWith(toLower(spec.filename), ".xyz")) {
-            loadXYZ(spec);
-        } else if (endsWith(toLower(spec.filename), ".ply")) {
-            loadPLY(spec);
-        } else if (endsWith(toLower(spec.filename), ".vox")) {
-            loadVOX(spec);
-        } else if ((endsWith(spec.filename, "/") || endsWith(spec.filename, "\\")) && FileSystem::exists(spec.filename + "000.ply")) {
-            for (int i = 0; FileSystem::exists(spec.filename + format("%03d.ply", i)); ++i) {
-                debugPrintf("---------------------\nLoading file #%d\n", i);
-                Specification individual = spec;
-                individual.filename = individual.filename + format("%03d.ply", i);
-                loadPLY(individual);
-            }
-        } else {
-            alwaysAssertM(false, "Illegal filename");
-        }
+        loadSource(spec);
 
         m_pointArrayArray[0]->randomize();
 
@@ -153,6 +146,103 @@ void PointModel::load(const Specification& spec) {
 }
 
 
+void PointModel::loadSource(const Specification& spec) {
+    if (endsWith(toLower(spec.filename), ".xyz")) {
+        loadXYZ(spec);
+    } else if (endsWith(toLower(spec.filename), ".ply")) {
+        loadPLY(spec);
+    } else if (endsWith(toLower(spec.filename), ".vox")) {
+        loadVOX(spec);
+    } else if ((endsWith(spec.filename, "/") || endsWith(spec.filename, "\\")) && FileSystem::exists(spec.filename + "000.ply")) {
+        for (int i = 0; FileSystem::exists(spec.filename + format("%03d.ply", i)); ++i) {
+            debugPrintf("---------------------\nLoading file #%d\n", i);
+            Specification individual = spec;
+            individual.filename = individual.filename + format("%03d.ply", i);
+            loadPLY(individual);
+        }
+    } else {
+        alwaysAssertM(false, "Illegal filename");
+    }
+}
+
+
+void PointModel::loadStreaming(const Specification& spec) {
+    const String& resolvedFilename = FileSystem::resolve(spec.filename);
+    const String& octreeFilename = FilePath::concat("cache", manglePathToFilename(resolvedFilename) + ".octree");
+
+    if (FileSystem::exists(octreeFilename) && ! FileSystem::isNewer(resolvedFilename, octreeFilename)) {
+        // Null if the file is in an older format
+        m_lodOctree = PointLODOctree::open(octreeFilename);
+    }
+
+    if (isNull(m_lodOctree)) {
+        FileSystem::createDirectory(FilePath::parent(octreeFilename));
+
+        // The loaders write to m_lodBuilder instead of holding the points
+        m_lodBuilder = PointLODOctree::Builder::create(octreeFilename);
+        m_lodCenter = false;
+        loadSource(spec);
+
+        m_lodBuilder->commit(m_lodCenter ? -m_lodBuilder->center() : Vector3::zero());
+        m_lodBuilder.reset();
+
+        m_lodOctree = PointLODOctree::open(octreeFilename);
+        alwaysAssertM(notNull(m_lodOctree), "Could not write " + octreeFilename);
+    }
+
+    m_renderAsDisk = spec.renderAsDisk;
+    m_pointRadius = 0.01f * spec.scale;
+    m_lodScale = spec.scale;
+    m_numPoints = m_lodOctree->numPoints();
+
+    // Show only the root until the first setViewpoint() call from the application
+    PointLODOctree::Viewpoint coarsest;
+    coarsest.maxPoints = 0;
+    setViewpoint(coarsest);
+}
+
+
+void PointModel::setViewpoint(const PointLODOctree::Viewpoint& viewpoint) {
+    if (isNull(m_lodOctree)) {
+        return;
+    }
+
+    // Convert to the octree's coordinate system, which is not scaled. The
+    // projected point spacing is unchanged because both lengths scale together.
+    PointLODOctree::Viewpoint unscaled = viewpoint;
+    unscaled.eye = viewpoint.eye / m_lodScale;
+    for (Plane& plane : unscaled.clipPlanes) {
+        plane = Plane(plane.normal(), plane.closestPoint(Point3::zero()) / m_lodScale);
+    }
+
+    Array<int> selection;
+    m_lodOctree->selectNodes(unscaled, selection);
+    m_lodOctree->makeResident(selection);
+
+    // Reuse the GPU copies of nodes that are still selected
+    const Table<int, shared_ptr<PointArray>> previous = m_lodPointArrayTable;
+    m_lodPointArrayTable.clear();
+    m_pointArrayArray.fastClear();
+
+    for (const int n : selection) {
+        shared_ptr<PointArray> pointArray;
+        if (! previous.get(n, pointArray)) {
+            const shared_ptr<PointLODOctree::NodePoints>& points = m_lodOctree->residentPoints(n);
+            pointArray = PointArray::createShared<PointArray>();
+            pointArray->cpuPosition = points->position;
+            pointArray->cpuRadiance = points->color;
+            for (Point3& point : pointArray->cpuPosition) {
+                point *= m_lodScale;
+            }
+            pointArray->computeBounds();
+            pointArray->copyToGPU();
+        }
+        m_lodPointArrayTable.set(n, pointArray);
+        m_pointArrayArray.append(pointArray);
+    }
+}
+
+
 void PointModel::PointArray::randomize() {
     Random rng(123721321U, false);
     cpuPosition.randomize(cpuRadiance, rng);
@@ -317,7 +407,7 @@ void PointModel::loadXYZ(const Specification& specification) {
     }
 
     if (specification.center) {
-        m_pointArrayArray[0]->centerPoints();
+        centerPoints();
     }
 }
 
@@ -340,14 +430,28 @@ void PointModel::loadVOX(const Specification& specification){
 
         addPoint(Point3(vox_pos.x, vox_pos.z, -vox_pos.y) * 0.01f, Color4unorm8(color)); //0.01f is hardcoded voxel size, swizzle on Point3 is rotation from MagicaVoxel.
     }
-    m_pointArrayArray[0]->centerPoints();
+    centerPoints();
 
 
 }
 
 
 void PointModel::addPoint(const Point3& position, const Color4unorm8 radiance) {
-    m_pointArrayArray[0]->addPoint(position, radiance);
+    if (notNull(m_lodBuilder)) {
+        m_lodBuilder->addPoint(position, radiance);
+    } else {
+        m_pointArrayArray[0]->addPoint(position, radiance);
+    }
+}
+
+
+void PointModel::centerPoints() {
+    if (notNull(m_lodBuilder)) {
+        // Applied when the octree is committed, once all points are known
+        m_lodCenter = true;
+    } else {
+        m_pointArrayArray[0]->centerPoints();
+    }
 }
 
 
@@ -358,6 +462,17 @@ void PointModel::PointArray::addPoint(const Point3& position, const Color4unorm8
 
 
 void PointModel::loadPLY(const Specification& spec) {
+    {
+        // ASCII files are in the scanner format below, which has a camera line after the header
+        BinaryInput bi(spec.filename, G3D_LITTLE_ENDIAN);
+        bi.readStringNewline();
+        if (beginsWith(bi.readStringNewline(), "format binary")) {
+            bi.setPosition(0);
+            loadBinaryPLY(spec, bi);
+            return;
+        }
+    }
+
     TextInput t(spec.filename);
     //bool c = t.hasMore();
 
@@ -386,12 +501,73 @@ void PointModel::loadPLY(const Specification& spec) {
 
         (void)sourceY; (void)sourceX; (void)nx; (void)ny; (void)nz; (void)i;
 
-        // Magic constants for mapping between coordinate systems
+        // Magic constants for the scanner's color and distance units
         const float s = 2.0f / 255.0f;
+        const float metersPerUnit = 0.0005f;
+
+        addPoint((spec.transform * Vector4(Point3(x, y, z) * metersPerUnit, 1.0f)).xyz(), Color4unorm8(Color4(r * s, g * s, b * s, 1.0f)));
+    }
+
+    if (spec.center) {
+        centerPoints();
+    }
+}
+
+
+void PointModel::loadBinaryPLY(const Specification& spec, BinaryInput& bi) {
+    static const char* axisName[] = {"x", "y", "z"};
+    static const char* channelName[] = {"red", "green", "blue", "alpha"};
+
+    // Property index of x, y, z, and each color channel, or -1
+    int axisIndex[3];
+    int channelIndex[4];
+
+    // Integer channels are on [0, 255] and floating-point ones on [0, 1]
+    float channelScale[4];
+
+    ParsePLY parser;
+    parser.parse(bi, [&](int firstVertex, int count, const float* data) {
+        const int N = parser.vertexProperty.size();
+        if (firstVertex == 0) {
+            for (int a = 0; a < 3; ++a) {
+                axisIndex[a] = -1;
+                for (int p = 0; p < N; ++p) {
+                    if (parser.vertexProperty[p].name == axisName[a]) {
+                        axisIndex[a] = p;
+                    }
+                }
+                alwaysAssertM(axisIndex[a] >= 0, "PLY vertices must have x, y, and z properties");
+            }
+
+            for (int c = 0; c < 4; ++c) {
+                channelIndex[c] = -1;
+                for (int p = 0; p < N; ++p) {
+                    const ParsePLY::Property& prop = parser.vertexProperty[p];
+                    if (prop.name == channelName[c]) {
+                        channelIndex[c] = p;
+                        channelScale[c] = ((prop.type == ParsePLY::float_type) || (prop.type == ParsePLY::double_type)) ? 1.0f : 1.0f / 255.0f;
+                    }
+                }
+            }
+        }
+
+        for (int i = 0; i < count; ++i) {
+            const float* vertex = data + i * N;
+            Color4 color(1.0f, 1.0f, 1.0f, 1.0f);
+            for (int c = 0; c < 4; ++c) {
+                if (channelIndex[c] >= 0) {
+                    color[c] = vertex[channelIndex[c]] * channelScale[c];
+                }
+            }
+
+            const Vector4 position(vertex[axisIndex[0]], vertex[axisIndex[1]], vertex[axisIndex[2]], 1.0f);
+            addPoint((spec.transform * position).xyz(), Color4unorm8(color));
+        }
+    });
 
-        addPoint(Point3(x, z, -y) * 0.0005f, Color4unorm8(Color4(r * s, g * s, b * s, 1.0f)));
+    if (spec.center) {
+        centerPoints();
     }
-    m_pointArrayArray[0]->centerPoints();
 }
 
 
@@ -10,6 +10,7 @@
 #include "G3D-app/Renderer.h"
 #include "G3D-gfx/RenderDevice.h"
 #include "G3D-gfx/Framebuffer.h"
+#include "G3D-gfx/Texture.h"
 #include "G3D-app/LightingEnvironment.h"
 #include "G3D-app/Camera.h"
 #include "G3D-app/Surface.h"
@@ -67,6 +68,43 @@ void Renderer::computeShadowing
 }
 
 
+/** Approximate number of pixels covered by the bounding sphere of \a surface */
+static float projectedScreenArea(const shared_ptr<Surface>& surface, const CFrame& cameraFrame, float pixelsPerMeter, float viewportArea) {
+    Sphere sphere;
+    surface->getObjectSpaceBoundingSphere(sphere);
+    sphere = surface->frame().toWorldSpace(sphere);
+
+    const float distance = -cameraFrame.pointToObjectSpace(sphere.center).z;
+    if (distance <= sphere.radius) {
+        // The camera is inside or level with the bounds
+        return viewportArea;
+    } else {
+        return min(viewportArea, pif() * square(sphere.radius * pixelsPerMeter / distance));
+    }
+}
+
+
+/** Lazily-loaded textures of visible surfaces load first, largest on screen first */
+static void setTextureLoadingPriorities(const shared_ptr<Camera>& camera, const Rect2D& viewport, const Array<shared_ptr<Surface>>& allSurfaces, const Array<shared_ptr<Surface>>& visibleSurfaces) {
+    if (Texture::loadingStats().queued == 0) {
+        // Nothing left to order
+        return;
+    }
+
+    const CFrame& cameraFrame = camera->frame();
+    const float pixelsPerMeter = camera->projection().imagePlanePixelsPerMeter(viewport);
+    const float viewportArea = viewport.area();
+
+    // Surfaces that share a material are assigned the priority of the last one visited
+    for (const shared_ptr<Surface>& surface : allSurfaces) {
+        surface->setTextureLoadingPriority(false, projectedScreenArea(surface, cameraFrame, pixelsPerMeter, viewportArea));
+    }
+    for (const shared_ptr<Surface>& surface : visibleSurfaces) {
+        surface->setTextureLoadingPriority(true, projectedScreenArea(surface, cameraFrame, pixelsPerMeter, viewportArea));
+    }
+}
+
+
 void Renderer::cullAndSort
    (const shared_ptr<Camera>&           camera,
     const shared_ptr<GBuffer>&          gbuffer,
@@ -78,6 +116,7 @@ void Renderer::cullAndSort
 
     BEGIN_PROFILER_EVENT("Renderer::cullAndSort");
     Surface::cull(camera->frame(), camera->projection(), viewport, allSurfaces, allVisibleSurfaces);
+    setTextureLoadingPriorities(camera, viewport, allSurfaces, allVisibleSurfaces);
 
     Surface::sortBackToFront(allVisibleSurfaces, camera->frame().lookVector());
 
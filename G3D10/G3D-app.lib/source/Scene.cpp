@@ -29,6 +29,11 @@
 #include "G3D-app/FontModel.h"
 #include "G3D-app/VoxelModel.h"
 #include "G3D-app/SoundEntity.h"
+#include "G3D-gfx/GLThreadQueue.h"
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
 
 using namespace G3D::units;
 
@@ -345,6 +350,12 @@ Any Scene::load(const String& scene, const LoadOptions& loadOptions) {
         }
     }
 
+    m_modelLoadTimeArray.fastClear();
+    if (loadOptions.prefetchModels) {
+        // Entities resolve their models as they are created, so this must precede them
+        prefetchModels(loadOptions);
+    }
+
     // Instantiate the entities
     // Try for both the current and extended format entity group names...intended to support using #include to merge
     // different files with entitys in them
@@ -458,6 +469,87 @@ void Scene::getVisibleBounds(AABox& box) const {
 }
 
 
+void Scene::prefetchModels(const LoadOptions& options) {
+    // Only ArticulatedModel is known to forward all of its OpenGL work through GLThreadQueue
+    Array<String> concurrentNames, serialNames;
+    Array<lazy_ptr<Model>> concurrentModels, serialModels;
+    for (ModelTable::Iterator it = m_modelTable.begin(); it.isValid(); ++it) {
+        if (! it->value.resolved()) {
+            const Any& v = m_modelsAny[it->key];
+            if ((v.type() == Any::STRING) || beginsWith(v.name(), "ArticulatedModel")) {
+                concurrentNames.append(it->key);
+                concurrentModels.append(it->value);
+            } else {
+                serialNames.append(it->key);
+                serialModels.append(it->value);
+            }
+        }
+    }
+
+    const RealTime start = System::time();
+    std::mutex resultMutex;
+    if (concurrentNames.size() > 0) {
+        const int numThreads = G3D::min(concurrentNames.size(),
+            (options.numPrefetchThreads > 0) ? options.numPrefetchThreads : G3D::max(1, int(std::thread::hardware_concurrency())));
+        std::atomic<int> next(0);
+
+        GLThreadQueue::serve([&] {
+            std::exception_ptr firstException;
+            const auto loadNext = [&] {
+                for (int i = next++; i < concurrentNames.size(); i = next++) {
+                    ModelLoadTime result;
+                    result.name = concurrentNames[i];
+                    result.concurrent = true;
+                    const RealTime t0 = System::time();
+                    try {
+                        concurrentModels[i].resolve();
+                    } catch (...) {
+                        // Stop handing out models and report the first failure to load()
+                        next = concurrentNames.size();
+                        std::lock_guard<std::mutex> lock(resultMutex);
+                        if (! firstException) {
+                            firstException = std::current_exception();
+                        }
+                        return;
+                    }
+                    result.time = System::time() - t0;
+
+                    std::lock_guard<std::mutex> lock(resultMutex);
+                    m_modelLoadTimeArray.append(result);
+                }
+            };
+
+            Array<shared_ptr<std::thread>> threadArray;
+            for (int t = 1; t < numThreads; ++t) {
+                threadArray.append(std::make_shared<std::thread>(loadNext));
+            }
+            loadNext();
+            for (const shared_ptr<std::thread>& thread : threadArray) {
+                thread->join();
+            }
+
+            if (firstException) {
+                std::rethrow_exception(firstException);
+            }
+        });
+    }
+
+    for (int i = 0; i < serialModels.size(); ++i) {
+        ModelLoadTime& result = m_modelLoadTimeArray.next();
+        result.name = serialNames[i];
+        const RealTime t0 = System::time();
+        serialModels[i].resolve();
+        result.time = System::time() - t0;
+    }
+
+    logPrintf("Scene::load prefetched %d models (%d concurrently) in %.2fs:\n",
+        m_modelLoadTimeArray.size(), concurrentNames.size(), System::time() - start);
+    for (const ModelLoadTime& result : m_modelLoadTimeArray) {
+        logPrintf("    %-30s %7.3fs%s\n", result.name.c_str(), result.time, result.concurrent ? "" : " (serial)");
+    }
+}
+
+
 lazy_ptr<Model> Scene::createModel(const Any& v, const String& name) {
     v.verify(! m_modelTable.containsKey(name), "A model named '" + name + "' already exists in this scene.");
 
@@ -0,0 +1,323 @@
+/**
+  \file G3D-app.lib/source/TextureTileCache.cpp
+
+  G3D Innovation Engine http://casual-effects.com/g3d
+  Copyright 2000-2019, Morgan McGuire
+  All rights reserved
+  Available under the BSD License
+*/
+#include "G3D-app/TextureTileCache.h"
+#include "G3D-base/g3dmath.h"
+#include <algorithm>
+
+namespace G3D {
+
+TextureTileCache::Source::Source(int width, int height, WrapMode wrapMode, const TexelFunction& texelFunction) :
+    m_width(width),
+    m_height(height),
+    m_wrapMode((wrapMode == WrapMode::TILE) ? WrapMode::TILE : WrapMode::CLAMP),
+    m_texelFunction(texelFunction) {
+
+    alwaysAssertM((width > 0) && (height > 0), "TextureTileCache sources must not be empty");
+
+    // Down to 1 x 1, rounding down at each level as on the GPU
+    for (int L = 0; (L == 0) || (m_level.last().width > 1) || (m_level.last().height > 1); ++L) {
+        Level& level = m_level.next();
+        level.width  = max(1, width >> L);
+        level.height = max(1, height >> L);
+        level.tilesX = (level.width  + TILE_SIZE - 1) / TILE_SIZE;
+        level.tilesY = (level.height + TILE_SIZE - 1) / TILE_SIZE;
+
+        const int n = level.tilesX * level.tilesY;
+        level.tile = new std::atomic<Tile*>[n];
+        for (int i = 0; i < n; ++i) {
+            level.tile[i].store(nullptr, std::memory_order_relaxed);
+        }
+    }
+}
+
+
+TextureTileCache::Source::~Source() {
+    for (Level& level : m_level) {
+        delete[] level.tile;
+        level.tile = nullptr;
+    }
+}
+
+
+TextureTileCache::TextureTileCache(size_t budgetBytes) : m_budgetBytes(budgetBytes), m_clock(0) {}
+
+
+TextureTileCache::~TextureTileCache() {
+    clear();
+}
+
+
+shared_ptr<TextureTileCache> TextureTileCache::create(size_t budgetBytes) {
+    return createShared<TextureTileCache>(budgetBytes);
+}
+
+
+const shared_ptr<TextureTileCache>& TextureTileCache::global() {
+    static const shared_ptr<TextureTileCache> cache = create(0);
+    return cache;
+}
+
+
+shared_ptr<TextureTileCache::Source> TextureTileCache::addSource(int width, int height, WrapMode wrapMode, const TexelFunction& texelFunction) {
+    const shared_ptr<Source>& source = createShared<Source>(width, height, wrapMode, texelFunction);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_sourceArray.append(source);
+    return source;
+}
+
+
+/** Each thread increments its own counter so that resident lookups do not share a cache line */
+static int threadCounterIndex(int numCounters) {
+    static std::atomic<int> nextIndex(0);
+    static thread_local int index = nextIndex.fetch_add(1) % numCounters;
+    return index;
+}
+
+
+TextureTileCache::Tile* TextureTileCache::tile(Source& source, int level, int tx, int ty) {
+    const Source::Level& L = source.m_level[level];
+    std::atomic<Tile*>& slot = L.tile[tx + ty * L.tilesX];
+
+    Tile* t = slot.load(std::memory_order_acquire);
+    if (notNull(t)) {
+        // Avoid writing the shared line when the tile was already used this tick
+        const uint32 now = m_clock.load(std::memory_order_relaxed);
+        if (t->lastUse.load(std::memory_order_relaxed) != now) {
+            t->lastUse.store(now, std::memory_order_relaxed);
+        }
+        m_counter[threadCounterIndex(NUM_COUNTERS)].hits.fetch_add(1, std::memory_order_relaxed);
+        return t;
+    }
+
+    // Fill outside of the lock, since that may call back into the source or recursively
+    // create finer tiles. Two threads may race to create the same tile; the loser discards its copy.
+    Tile* created = new Tile();
+    created->slot   = &slot;
+    created->source = &source;
+    fillTile(source, level, tx, ty, created);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    ++m_misses;
+    t = slot.load(std::memory_order_relaxed);
+    if (notNull(t)) {
+        delete created;
+        return t;
+    }
+
+    created->lastUse.store(m_clock.fetch_add(1, std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    slot.store(created, std::memory_order_release);
+    m_resident.append(created);
+
+    if (size_t(m_resident.size()) * sizeof(Tile) > m_budgetBytes) {
+        evict();
+    }
+
+    return created;
+}
+
+
+void TextureTileCache::fillTile(Source& source, int level, int tx, int ty, Tile* t) {
+    const Source::Level& L = source.m_level[level];
+    const int x0 = tx * TILE_SIZE, y0 = ty * TILE_SIZE;
+    const int w = min(int(TILE_SIZE), L.width - x0), h = min(int(TILE_SIZE), L.height - y0);
+
+    if (level == 0) {
+        if (w == TILE_SIZE) {
+            source.m_texelFunction(x0, y0, w, h, t->texel);
+        } else {
+            // The source writes tightly packed rows; spread them to the tile stride
+            Color4 packed[TILE_SIZE * TILE_SIZE];
+            source.m_texelFunction(x0, y0, w, h, packed);
+            for (int y = 0; y < h; ++y) {
+                for (int x = 0; x < w; ++x) {
+                    t->texel[x + y * TILE_SIZE] = packed[x + y * w];
+                }
+            }
+        }
+        return;
+    }
+
+    // Box filter 2 x 2 blocks of the finer level, whose tiles are exactly twice as far apart
+    const Source::Level& fine = source.m_level[level - 1];
+    Tile* child[2][2] = {{nullptr, nullptr}, {nullptr, nullptr}};
+    for (int j = 0; j < 2; ++j) {
+        for (int i = 0; i < 2; ++i) {
+            const int cx = 2 * tx + i, cy = 2 * ty + j;
+            if ((cx < fine.tilesX) && (cy < fine.tilesY)) {
+                child[j][i] = tile(source, level - 1, cx, cy);
+            }
+        }
+    }
+
+    for (int y = 0; y < h; ++y) {
+        for (int x = 0; x < w; ++x) {
+            Color4 sum = Color4::zero();
+            for (int j = 0; j < 2; ++j) {
+                for (int i = 0; i < 2; ++i) {
+                    // Clamp odd sizes to the edge of the finer level
+                    const int fx = min(2 * (x0 + x) + i, fine.width - 1);
+                    const int fy = min(2 * (y0 + y) + j, fine.height - 1);
+                    const Tile* c = child[fy / TILE_SIZE - 2 * ty][fx / TILE_SIZE - 2 * tx];
+                    sum += c->texel[(fx % TILE_SIZE) + (fy % TILE_SIZE) * TILE_SIZE];
+                }
+            }
+            t->texel[x + y * TILE_SIZE] = sum * 0.25f;
+        }
+    }
+}
+
+
+void TextureTileCache::evict() {
+    // Evict down below the budget so that the next few misses do not each scan the tiles
+    const int keep = int((m_budgetBytes.load() / 10 * 9) / sizeof(Tile));
+    const int n = m_resident.size() - keep;
+    if ((n <= 0) || (size_t(m_retired.size()) * sizeof(Tile) >= m_budgetBytes)) {
+        // Retired tiles cannot be freed until advanceEpoch(), so evicting more would not reduce memory
+        return;
+    }
+
+    // Oldest first, measuring age from now so that wraparound of the clock is harmless
+    const uint32 now = m_clock.load(std::memory_order_relaxed);
+    std::nth_element(m_resident.begin(), m_resident.begin() + (n - 1), m_resident.end(), [now](const Tile* a, const Tile* b) {
+        return (now - a->lastUse.load(std::memory_order_relaxed)) > (now - b->lastUse.load(std::memory_order_relaxed));
+    });
+
+    for (int i = 0; i < n; ++i) {
+        Tile* t = m_resident[i];
+        t->slot->store(nullptr, std::memory_order_release);
+        m_retired.append(t);
+    }
+    m_resident.remove(0, n);
+    m_evictions += n;
+}
+
+
+Color4 TextureTileCache::texel(Source& source, int level, int x, int y) {
+    const Source::Level& L = source.m_level[level];
+    if (source.m_wrapMode == WrapMode::TILE) {
+        x = iWrap(x, L.width);
+        y = iWrap(y, L.height);
+    } else {
+        x = iClamp(x, 0, L.width - 1);
+        y = iClamp(y, 0, L.height - 1);
+    }
+    return tile(source, level, x / TILE_SIZE, y / TILE_SIZE)->texel[(x % TILE_SIZE) + (y % TILE_SIZE) * TILE_SIZE];
+}
+
+
+Color4 TextureTileCache::bilinear(Source& source, int level, const Vector2& texCoord) {
+    const Source::Level& L = source.m_level[level];
+    const float x = texCoord.x * float(L.width) - 0.5f;
+    const float y = texCoord.y * float(L.height) - 0.5f;
+    const int x0 = iFloor(x), y0 = iFloor(y);
+    const float fx = x - float(x0), fy = y - float(y0);
+
+    Color4 c00, c10, c01, c11;
+    if ((x0 >= 0) && (y0 >= 0) && (x0 + 1 < L.width) && (y0 + 1 < L.height) &&
+        (x0 / TILE_SIZE == (x0 + 1) / TILE_SIZE) && (y0 / TILE_SIZE == (y0 + 1) / TILE_SIZE)) {
+        // Common case: all four texels are in one tile
+        const Tile* t = tile(source, level, x0 / TILE_SIZE, y0 / TILE_SIZE);
+        const Color4* p = t->texel + (x0 % TILE_SIZE) + (y0 % TILE_SIZE) * TILE_SIZE;
+        c00 = p[0];         c10 = p[1];
+        c01 = p[TILE_SIZE]; c11 = p[TILE_SIZE + 1];
+    } else {
+        c00 = texel(source, level, x0, y0);     c10 = texel(source, level, x0 + 1, y0);
+        c01 = texel(source, level, x0, y0 + 1); c11 = texel(source, level, x0 + 1, y0 + 1);
+    }
+
+    return c00.lerp(c10, fx).lerp(c01.lerp(c11, fx), fy);
+}
+
+
+Color4 TextureTileCache::sample(Source& source, const Vector2& texCoord, float level) {
+    level = clamp(level, 0.0f, float(source.numLevels() - 1));
+    const int L = iFloor(level);
+    const float f = level - float(L);
+
+    const Color4& c = bilinear(source, L, texCoord);
+    if ((f > 0.0f) && (L + 1 < source.numLevels())) {
+        return c.lerp(bilinear(source, L + 1, texCoord), f);
+    } else {
+        return c;
+    }
+}
+
+
+void TextureTileCache::advanceEpoch() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    for (Tile* t : m_retired) {
+        delete t;
+    }
+    m_retired.fastClear();
+
+    // Sources referenced only by the cache can never be sampled again
+    for (int s = m_sourceArray.size() - 1; s >= 0; --s) {
+        if (m_sourceArray[s].use_count() == 1) {
+            const Source* source = m_sourceArray[s].get();
+            for (int i = m_resident.size() - 1; i >= 0; --i) {
+                if (m_resident[i]->source == source) {
+                    delete m_resident[i];
+                    m_resident.fastRemove(i);
+                }
+            }
+            m_sourceArray.fastRemove(s);
+        }
+    }
+
+    // Now that nothing can be reading tiles, trim any growth past the budget since the last epoch
+    if (size_t(m_resident.size()) * sizeof(Tile) > m_budgetBytes) {
+        evict();
+        for (Tile* t : m_retired) {
+            delete t;
+        }
+        m_retired.fastClear();
+    }
+}
+
+
+void TextureTileCache::clear() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (Tile* t : m_resident) {
+        t->slot->store(nullptr, std::memory_order_relaxed);
+        delete t;
+    }
+    for (Tile* t : m_retired) {
+        delete t;
+    }
+    m_resident.fastClear();
+    m_retired.fastClear();
+}
+
+
+TextureTileCache::Stats TextureTileCache::stats() const {
+    Stats s;
+    for (const Counter& counter : m_counter) {
+        s.hits += counter.hits.load(std::memory_order_relaxed);
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    s.misses        = m_misses;
+    s.evictions     = m_evictions;
+    s.residentTiles = m_resident.size();
+    s.residentBytes = size_t(m_resident.size()) * sizeof(Tile);
+    return s;
+}
+
+
+void TextureTileCache::resetStats() {
+    for (Counter& counter : m_counter) {
+        counter.hits.store(0, std::memory_order_relaxed);
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_misses = 0;
+    m_evictions = 0;
+}
+
+} // namespace G3D
@@ -133,6 +133,7 @@ void TriTreeBase::intersectRays
     const Hit* pHit = hits.getCArray();
     shared_ptr<Surfel>* pSurfel = results.getCArray();
     const Tri* pTri = m_triArray.getCArray();
+    const float* pCone = (coherence.size() == rays.size()) ? coherence.getCArray() : nullptr;
 
     tbb::parallel_for(tbb::blocked_range<size_t>(0, hits.size(), 128), [&](const tbb::blocked_range<size_t>& r) {
         const size_t start = r.begin();
@@ -140,8 +141,17 @@ void TriTreeBase::intersectRays
         for (size_t i = start; i < end; ++i) {
             const Hit& hit = pHit[i];
             if (hit.triIndex != Hit::NONE) {
-                // TODO: compute MIP level using coherence, pass to sample
-                pTri[hit.triIndex].sample(hit.u, hit.v, hit.triIndex, m_vertexArray, hit.backface, pSurfel[i]);
+                float du = 0.0f, dv = 0.0f;
+                if (notNull(pCone) && (pCone[i] > 0.0f) && (pCone[i] < 1.0f)) {
+                    // Radius of the cone at the hit, measured along each edge of the triangle
+                    // in barycentric units. Ignores foreshortening, which errs toward sharpness.
+                    const Tri& tri = pTri[hit.triIndex];
+                    const float radius = hit.distance * sqrt(1.0f - square(pCone[i])) / pCone[i];
+                    const Point3& p0 = tri.position(m_vertexArray, 0);
+                    du = radius / max((tri.position(m_vertexArray, 1) - p0).length(), 1e-10f);
+                    dv = radius / max((tri.position(m_vertexArray, 2) - p0).length(), 1e-10f);
+                }
+                pTri[hit.triIndex].sample(hit.u, hit.v, hit.triIndex, m_vertexArray, hit.backface, pSurfel[i], du, dv);
             } else {
                 pSurfel[i] = nullptr;
             }
@@ -52,6 +52,13 @@ void UniversalBSDF::setStorage(ImageStorage s) const {
 }
 
 
+void UniversalBSDF::setLoadingPriority(bool visible, float projectedScreenArea) const {
+    m_lambertian.setLoadingPriority(visible, projectedScreenArea);
+    m_transmissive.setLoadingPriority(visible, projectedScreenArea);
+    m_glossy.setLoadingPriority(visible, projectedScreenArea);
+}
+
+
 bool UniversalBSDF::hasMirror() const {
     const Color4& m = m_glossy.max();
     return (m.a == 1.0f) && ! m.rgb().isZero();
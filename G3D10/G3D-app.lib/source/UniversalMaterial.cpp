@@ -13,6 +13,7 @@
 #include "G3D-app/UniversalSurfel.h"
 #include "G3D-gfx/Args.h"
 #include "G3D-gfx/Sampler.h"
+#include "G3D-gfx/GLThreadQueue.h"
 
 #ifdef OPTIONAL
 #   undef OPTIONAL
@@ -167,6 +168,13 @@ bool UniversalMaterial::validateTextureDimensions() const {
 
 
 shared_ptr<UniversalMaterial> UniversalMaterial::create(const String& name, const Specification& specification) {
+    if (GLThreadQueue::mustForward()) {
+        // The cache is not thread-safe, and computing the components' statistics forces textures onto the GPU
+        shared_ptr<UniversalMaterial> m;
+        GLThreadQueue::run([&] { m = create(name, specification); });
+        return m;
+    }
+
     MaterialCache& cache = _internal::materialCache();
     shared_ptr<UniversalMaterial> value = cache[specification];
 
@@ -259,6 +267,19 @@ void UniversalMaterial::setStorage(ImageStorage s) const {
 }
 
 
+void UniversalMaterial::setLoadingPriority(bool visible, float projectedScreenArea) const {
+    m_bsdf->setLoadingPriority(visible, projectedScreenArea);
+    m_emissive.setLoadingPriority(visible, projectedScreenArea);
+    for (int i = 0; i < 3; ++i) {
+        m_lightMap[i].setLoadingPriority(visible, projectedScreenArea);
+    }
+
+    if (m_bump) {
+        m_bump->setLoadingPriority(visible, projectedScreenArea);
+    }
+}
+
+
 bool UniversalMaterial::hasTransmissive() const {
     return notNull(m_bsdf->transmissive().texture()) && (m_bsdf->transmissive().texture()->max().rgb().max() > 0);
 }
@@ -33,6 +33,11 @@ void UniversalSurface::setStorage(ImageStorage newStorage) {
 }
 
 
+void UniversalSurface::setTextureLoadingPriority(bool visible, float projectedScreenArea) const {
+    m_material->setLoadingPriority(visible, projectedScreenArea);
+}
+
+
 TransparencyType UniversalSurface::transparencyType() const {
     if ((m_material->bsdf()->lambertian().max().a < 1.0f) && (m_material->alphaFilter() == AlphaFilter::BLEND)) {
         // Because the max alpha is less than one, this surface has no fully nontransparent texels
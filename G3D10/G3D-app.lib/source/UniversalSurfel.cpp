@@ -31,7 +31,6 @@ shared_ptr<UniversalSurfel> UniversalSurfel::createEmissive(const Radiance3 emis
 
     
 void UniversalSurfel::sample(const Tri& tri, float u, float v, int triIndex, const CPUVertexArray& vertexArray, bool backside, const UniversalMaterial* universalMaterial, float du, float dv) {
-    // TODO: MIP-map
     source.index = triIndex;
     source.u = u;
     source.v = v;
@@ -66,6 +65,11 @@ void UniversalSurfel::sample(const Tri& tri, float u, float v, int triIndex, con
         u * vert1.texCoord0 +
         v * vert2.texCoord0;
 
+    // Width of the ray footprint in texture space, for MIP-mapping. du and dv are
+    // the extents of the footprint in barycentric coordinates.
+    const float texCoordFootprint = max(du * (vert1.texCoord0 - vert0.texCoord0).length(),
+                                        dv * (vert2.texCoord0 - vert0.texCoord0).length());
+
     geometricNormal = tri.normal(vertexArray);
 
     if (!interpolatedNormal.isFinite()) {
@@ -148,7 +152,7 @@ void UniversalSurfel::sample(const Tri& tri, float u, float v, int triIndex, con
         prevPosition = position;
     }
 
-    const Color4& lambertianSample = bsdf->lambertian().sample(texCoord);
+    const Color4& lambertianSample = bsdf->lambertian().sample(texCoord, texCoordFootprint);
 
     lambertianReflectivity = lambertianSample.rgb();
     coverage = lambertianSample.a;
@@ -165,13 +169,13 @@ void UniversalSurfel::sample(const Tri& tri, float u, float v, int triIndex, con
         coverage *= interpolatedColor.a;
     }
 
-    emission = universalMaterial->emissive().sample(texCoord);
+    emission = universalMaterial->emissive().sample(texCoord, texCoordFootprint);
 
-    const Color4& packG = bsdf->glossy().sample(texCoord);
+    const Color4& packG = bsdf->glossy().sample(texCoord, texCoordFootprint);
     glossyReflectionCoefficient  = packG.rgb();
     smoothness     = packG.a;
     
-    transmissionCoefficient = bsdf->transmissive().sample(texCoord);
+    transmissionCoefficient = bsdf->transmissive().sample(texCoord, texCoordFootprint);
 
     isTransmissive = transmissionCoefficient.nonZero() || (coverage < 1.0f);
 
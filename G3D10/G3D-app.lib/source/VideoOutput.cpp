@@ -11,6 +11,8 @@
 #include "G3D-base/Log.h"
 #include "G3D-base/Image.h"
 #include "G3D-base/CPUPixelTransferBuffer.h"
+#include "G3D-base/System.h"
+#include "G3D-gfx/glcalls.h"
 #include "G3D-gfx/RenderDevice.h"
 #include "G3D-gfx/GLPixelTransferBuffer.h"
 #include "G3D-app/VideoOutput.h"
@@ -84,7 +86,8 @@ void VideoOutput::Settings::setBitrateQuality(float quality) {
 }
 
 VideoOutput::Settings::Settings()
-    : width(0), height(0), fps(0), bitrate(0), flipVertical(false), encoder(Encoder::DEFAULT()) {}
+    : width(0), height(0), fps(0), bitrate(0), flipVertical(false), asynchronous(false),
+      maxQueuedFrames(4), queueFullPolicy(QueueFullPolicy::BLOCK), encoder(Encoder::DEFAULT()) {}
 
 shared_ptr<VideoOutput> VideoOutput::create(const String& filename, const Settings& settings) {
     shared_ptr<VideoOutput> vo = createShared<VideoOutput>(filename, settings);
@@ -124,6 +127,7 @@ VideoOutput::VideoOutput(const String& filename, const Settings& settings)
     , m_avBufferSrc(nullptr)
     , m_avBufferSink(nullptr)
     , m_avFilterGraph(nullptr)
+    , m_quitEncoderThread(false)
 {
 }
 
@@ -330,6 +334,17 @@ bool VideoOutput::initialize() {
         debugPrintf("VideoOutput: could configure graph\n");
         return false;
     }
+
+    if (m_settings.asynchronous) {
+        // Allocate the whole ring up front: one buffer per queue slot plus the one being encoded
+        m_freeBuffers.fastClear();
+        for (int i = 0; i < m_settings.maxQueuedFrames + 1; ++i) {
+            m_freeBuffers.append(CPUPixelTransferBuffer::create(m_settings.width, m_settings.height, ImageFormat::RGB8()));
+        }
+        m_quitEncoderThread = false;
+        m_encoderThread = std::thread(&VideoOutput::encoderThreadMain, this);
+    }
+
     return true;
 }
     
@@ -354,6 +369,9 @@ bool VideoOutput::validSettings() {
     if (m_settings.width < 2 || m_settings.height < 2 || m_settings.fps < 1.0f) {
         return false;
     }
+    if (m_settings.asynchronous && (m_settings.maxQueuedFrames < 1)) {
+        return false;
+    }
     return true;
 }
 
@@ -361,6 +379,9 @@ void VideoOutput::append(RenderDevice* rd, bool backbuffer) {
     debugAssert(rd->width() == m_settings.width);
     debugAssert(rd->height() == m_settings.height);
 
+    const RealTime appendTime = System::time();
+    const shared_ptr<GLPixelTransferBuffer>& buffer = acquireReadbackBuffer();
+
     RenderDevice::ReadBuffer old = rd->readBuffer();
     if (backbuffer) {
         rd->setReadBuffer(RenderDevice::READ_BACK);
@@ -369,12 +390,28 @@ void VideoOutput::append(RenderDevice* rd, bool backbuffer) {
     }
     debugAssertGLOk();
 
+    GLint oldPackAlignment = 4;
+    glGetIntegerv(GL_PACK_ALIGNMENT, &oldPackAlignment);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    debugAssert(glGetInteger(GL_READ_FRAMEBUFFER_BINDING) == 0);
+
+    // Returns immediately; the milestone set by unbindWrite() tracks the transfer
+    buffer->bindWrite();
+    glReadPixels(0, 0, m_settings.width, m_settings.height, buffer->format()->openGLBaseFormat, buffer->format()->openGLDataFormat, nullptr);
+    buffer->unbindWrite();
 
-    // TODO: Optimize using GLPixelTransferBuffer and glReadPixels instead of screenshotPic
-    shared_ptr<Image> image = rd->screenshotPic(false, true);
+    glPixelStorei(GL_PACK_ALIGNMENT, oldPackAlignment);
     rd->setReadBuffer(old);
-    shared_ptr<CPUPixelTransferBuffer> imageBuffer = dynamic_pointer_cast<CPUPixelTransferBuffer>(image->toPixelTransferBuffer());
-    encodeFrame(static_cast<const uint8*>(imageBuffer->buffer()), imageBuffer->format());
+    debugAssertGLOk();
+
+    // OpenGL returns the bottom row first
+    PendingReadback readback;
+    readback.buffer = buffer;
+    readback.invertY = true;
+    readback.appendTime = appendTime;
+    m_pendingReadbacks.pushBack(readback);
+
+    appendCompletedReadbacks(false);
 }
 
 
@@ -382,9 +419,22 @@ void VideoOutput::append(const shared_ptr<Texture>& frame, bool invertY) {
     debugAssert(frame->width() == m_settings.width);
     debugAssert(frame->height() == m_settings.height);
 
-    const shared_ptr<PixelTransferBuffer>& buffer = frame->toPixelTransferBuffer(TextureFormat::RGB8());
-    encodeFrame(static_cast<const uint8*>(buffer->mapRead()), ImageFormat::RGB8());
-    buffer->unmap();
+    const RealTime appendTime = System::time();
+    shared_ptr<GLPixelTransferBuffer> buffer = acquireReadbackBuffer();
+    frame->toPixelTransferBuffer(buffer, ImageFormat::RGB8());
+
+    // Texture::toPixelTransferBuffer binds the buffer directly, so fence the
+    // transfer that it issued to make readyToMap() track its completion
+    buffer->bindWrite();
+    buffer->unbindWrite();
+
+    PendingReadback readback;
+    readback.buffer = buffer;
+    readback.invertY = invertY;
+    readback.appendTime = appendTime;
+    m_pendingReadbacks.pushBack(readback);
+
+    appendCompletedReadbacks(false);
 }
 
 
@@ -392,13 +442,211 @@ void VideoOutput::append(const shared_ptr<PixelTransferBuffer>& frame) {
     debugAssert(frame->width() == m_settings.width);
     debugAssert(frame->height() == m_settings.height);
 
-    encodeFrame(static_cast<const uint8*>(frame->mapRead()), frame->format());
+    const RealTime appendTime = System::time();
+    appendPixels(static_cast<const uint8*>(frame->mapRead()), frame->format(), frame->stride(), false, appendTime);
     frame->unmap();
 }
 
 
+shared_ptr<GLPixelTransferBuffer> VideoOutput::acquireReadbackBuffer() {
+    if (m_freeReadbackBuffers.size() > 0) {
+        return m_freeReadbackBuffers.pop();
+    } else if (m_pendingReadbacks.size() < MAX_PENDING_READBACKS) {
+        // Grow the ring on demand; it is reused for every later frame
+        return GLPixelTransferBuffer::create(m_settings.width, m_settings.height, ImageFormat::RGB8());
+    } else {
+        // Every buffer is in flight, so block on the oldest transfer
+        const PendingReadback& oldest = m_pendingReadbacks.popFront();
+        appendPixels(static_cast<const uint8*>(oldest.buffer->mapRead()), oldest.buffer->format(), oldest.buffer->stride(), oldest.invertY, oldest.appendTime);
+        oldest.buffer->unmap();
+        return oldest.buffer;
+    }
+}
+
+
+void VideoOutput::appendCompletedReadbacks(bool wait) {
+    while ((m_pendingReadbacks.size() > 0) && (wait || m_pendingReadbacks[0].buffer->readyToMap())) {
+        const PendingReadback& readback = m_pendingReadbacks.popFront();
+        appendPixels(static_cast<const uint8*>(readback.buffer->mapRead()), readback.buffer->format(), readback.buffer->stride(), readback.invertY, readback.appendTime);
+        readback.buffer->unmap();
+        m_freeReadbackBuffers.append(readback.buffer);
+    }
+}
+
+
+void VideoOutput::appendPixels(const uint8* pixels, const ImageFormat* format, size_t srcStride, bool invertY, RealTime appendTime) {
+    if (m_settings.asynchronous) {
+        enqueueFrame(pixels, format, srcStride, invertY, appendTime);
+    } else {
+        encodeImmediately(pixels, format, invertY, appendTime);
+    }
+}
+
+
+void VideoOutput::encodeImmediately(const uint8* pixels, const ImageFormat* format, bool invertY, RealTime appendTime) {
+    {
+        std::lock_guard<std::mutex> guard(m_queueMutex);
+        ++m_stats.framesAppended;
+    }
+    encodeAndRecord(pixels, format, invertY, appendTime);
+}
+
+
+void VideoOutput::encodeAndRecord(const uint8* pixels, const ImageFormat* format, bool invertY, RealTime appendTime) {
+    const RealTime start = System::time();
+    encodeFrame(pixels, format, invertY);
+    const RealTime stop = System::time();
+
+    std::lock_guard<std::mutex> guard(m_queueMutex);
+    ++m_stats.framesEncoded;
+    const RealTime encodeTime = stop - start;
+    const RealTime latency    = stop - appendTime;
+    const float    n          = float(m_stats.framesEncoded);
+    m_stats.averageEncodeTime += (encodeTime - m_stats.averageEncodeTime) / n;
+    m_stats.averageLatency    += (latency - m_stats.averageLatency) / n;
+    m_stats.maxEncodeTime      = max(m_stats.maxEncodeTime, encodeTime);
+    m_stats.maxLatency         = max(m_stats.maxLatency, latency);
+}
+
+
+shared_ptr<CPUPixelTransferBuffer> VideoOutput::acquireFrameBuffer(std::unique_lock<std::mutex>& lock) {
+    // The ring has one more buffer than the queue has slots, for the frame being encoded,
+    // so a free buffer alone does not mean that there is room in the queue
+    const auto queueFull = [this] {
+        return (m_pendingFrames.size() >= m_settings.maxQueuedFrames) || (m_freeBuffers.size() == 0);
+    };
+
+    if (queueFull()) {
+        switch (m_settings.queueFullPolicy.value) {
+        case QueueFullPolicy::DROP_NEWEST:
+            ++m_stats.framesDropped;
+            return nullptr;
+
+        case QueueFullPolicy::DROP_OLDEST:
+            if (m_pendingFrames.size() > 0) {
+                m_freeBuffers.append(m_pendingFrames.popFront().buffer);
+                ++m_stats.framesDropped;
+                break;
+            }
+            // Nothing left to drop, so wait for the encoder
+            // fall through
+        case QueueFullPolicy::BLOCK:
+        default:
+            m_queueCondition.wait(lock, [&] { return ! queueFull() || m_quitEncoderThread; });
+            if (queueFull()) {
+                return nullptr;
+            }
+        }
+    }
+
+    return m_freeBuffers.pop();
+}
 
-void VideoOutput::encodeFrame(const uint8* pixels, const ImageFormat* format) {
+
+void VideoOutput::enqueueFrame(const uint8* pixels, const ImageFormat* format, size_t srcStride, bool invertY, RealTime appendTime) {
+    shared_ptr<CPUPixelTransferBuffer> buffer;
+    {
+        std::unique_lock<std::mutex> lock(m_queueMutex);
+        if (m_isFinished || m_quitEncoderThread) {
+            return;
+        }
+        ++m_stats.framesAppended;
+        buffer = acquireFrameBuffer(lock);
+    }
+
+    if (isNull(buffer)) {
+        return;
+    }
+
+    // Every ring buffer is RGB8, so convert while copying instead of allocating
+    // a buffer in the source format
+    const size_t rowBytes = size_t(m_settings.width) * format->cpuBitsPerPixel / 8;
+    if (format != buffer->format()) {
+        const int srcRowPadBits = int(srcStride * 8) - m_settings.width * format->cpuBitsPerPixel;
+        const int dstRowPadBits = int(buffer->stride() * 8) - m_settings.width * buffer->format()->cpuBitsPerPixel;
+        const bool converted = ImageFormat::convert(Array<const void*>(pixels), m_settings.width, m_settings.height, format, srcRowPadBits,
+                                                    Array<void*>(buffer->buffer()), buffer->format(), dstRowPadBits, invertY);
+        alwaysAssertM(converted, "VideoOutput cannot convert frames from " + format->name());
+    } else if ((srcStride == buffer->stride()) && ! invertY) {
+        System::memcpy(buffer->buffer(), pixels, buffer->size());
+    } else {
+        for (int y = 0; y < m_settings.height; ++y) {
+            const int srcY = invertY ? (m_settings.height - 1 - y) : y;
+            System::memcpy(buffer->row(y), pixels + srcY * srcStride, rowBytes);
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(m_queueMutex);
+        QueuedFrame frame;
+        frame.buffer = buffer;
+        frame.appendTime = appendTime;
+        m_pendingFrames.pushBack(frame);
+        m_stats.queueDepth = m_pendingFrames.size();
+        m_stats.maxQueueDepth = max(m_stats.maxQueueDepth, m_stats.queueDepth);
+    }
+    m_queueCondition.notify_all();
+}
+
+
+void VideoOutput::encoderThreadMain() {
+    while (true) {
+        QueuedFrame frame;
+        {
+            std::unique_lock<std::mutex> lock(m_queueMutex);
+            m_queueCondition.wait(lock, [this] { return (m_pendingFrames.size() > 0) || m_quitEncoderThread; });
+            if (m_pendingFrames.size() == 0) {
+                // Told to quit and the queue is drained
+                break;
+            }
+            frame = m_pendingFrames.popFront();
+            m_stats.queueDepth = m_pendingFrames.size();
+        }
+        // A slot opened up for a blocked append()
+        m_queueCondition.notify_all();
+
+        // enqueueFrame() already converted to RGB8 and flipped the rows
+        debugAssert(frame.buffer->format() == ImageFormat::RGB8());
+        encodeAndRecord(static_cast<const uint8*>(frame.buffer->buffer()), ImageFormat::RGB8(), false, frame.appendTime);
+
+        {
+            std::lock_guard<std::mutex> guard(m_queueMutex);
+            m_freeBuffers.append(frame.buffer);
+        }
+        m_queueCondition.notify_all();
+    }
+}
+
+
+void VideoOutput::stopEncoderThread(bool drain) {
+    if (! m_encoderThread.joinable()) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(m_queueMutex);
+        if (! drain) {
+            while (m_pendingFrames.size() > 0) {
+                m_freeBuffers.append(m_pendingFrames.popFront().buffer);
+                ++m_stats.framesDropped;
+            }
+            m_stats.queueDepth = 0;
+        }
+        m_quitEncoderThread = true;
+    }
+    m_queueCondition.notify_all();
+    m_encoderThread.join();
+}
+
+
+VideoOutput::Stats VideoOutput::stats() const {
+    std::lock_guard<std::mutex> guard(m_queueMutex);
+    return m_stats;
+}
+
+
+
+void VideoOutput::encodeFrame(const uint8* pixels, const ImageFormat* format, bool invertY) {
     if (m_isFinished) {
         return;
     }
@@ -415,7 +663,8 @@ void VideoOutput::encodeFrame(const uint8* pixels, const ImageFormat* format) {
         // copy each line individually to accomodate padding in the AVFrame buffer for alignment
         const int sourceLineSize = frame->width * ImageFormat::RGB8()->cpuBitsPerPixel / 8;
         runConcurrently(0, frame->height, [&](int y) {
-            memcpy(frame->data[0] + (y * frame->linesize[0]), pixels + (y * sourceLineSize), sourceLineSize);
+            const int srcY = invertY ? (frame->height - 1 - y) : y;
+            memcpy(frame->data[0] + (y * frame->linesize[0]), pixels + (srcY * sourceLineSize), sourceLineSize);
         });
 
         frame->pts = ++m_framecount;
@@ -464,6 +713,9 @@ void VideoOutput::encodeFrame(const uint8* pixels, const ImageFormat* format) {
 
 
 void VideoOutput::commit() {
+    // Encode everything still being read back or in the queue before flushing the codec
+    appendCompletedReadbacks(true);
+    stopEncoderThread(true);
     m_isFinished = true;
 
     AVFrame* filteredFrame = nullptr;
@@ -508,6 +760,10 @@ void VideoOutput::commit() {
 }
 
 void VideoOutput::abort() {
+    while (m_pendingReadbacks.size() > 0) {
+        m_freeReadbackBuffers.append(m_pendingReadbacks.popFront().buffer);
+    }
+    stopEncoderThread(false);
     m_isFinished = true;
     if (m_avFormatContext && m_avFormatContext->pb) {
         avio_closep(&m_avFormatContext->pb);
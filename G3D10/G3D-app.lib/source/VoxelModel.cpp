@@ -10,6 +10,7 @@
 
 #include "G3D-app/VoxelModel.h"
 #include "G3D-app/VoxelSurface.h"
+#include "G3D-app/VoxelOctree.h"
 
 #include "G3D-app/Entity.h"
 #include "G3D-base/FileSystem.h"
@@ -114,6 +115,7 @@ void VoxelModel::load(const Specification& spec) {
     }
 
     computeBounds();
+    m_octree = VoxelOctree::create(m_cpuPosition, m_cpuColor, m_voxelRadius);
     copyToGPU();
 }
 
@@ -293,8 +295,27 @@ bool VoxelModel::intersect
     const Entity*                   entity,
     const Model::Pose*              pose) const {       
 
+    if (isNull(m_octree)) {
+        return entity->intersectBounds(R, maxDistance);
+    }
+
+    const Ray& osRay = cframe.toObjectSpace(R);
+    VoxelOctree::Hit hit;
+    if (! m_octree->intersectRay(Ray(osRay.origin(), osRay.direction(), osRay.minDistance(), min(osRay.maxDistance(), maxDistance)), hit)) {
+        return false;
+    }
 
-    return entity->intersectBounds(R, maxDistance);
+    maxDistance = hit.distance;
+    info.set(dynamic_pointer_cast<VoxelModel>(const_cast<VoxelModel*>(this)->shared_from_this()),
+             notNull(entity) ? dynamic_pointer_cast<Entity>(const_cast<Entity*>(entity)->shared_from_this()) : nullptr,
+             nullptr,
+             cframe.vectorToWorldSpace(hit.normal),
+             R.origin() + R.direction() * hit.distance,
+             "",
+             "",
+             0,
+             hit.voxelIndex);
+    return true;
 }
 
 
@@ -0,0 +1,352 @@
+/**
+  \file G3D-app.lib/source/VoxelOctree.cpp
+
+  G3D Innovation Engine http://casual-effects.com/g3d
+  Copyright 2000-2019, Morgan McGuire
+  All rights reserved
+  Available under the BSD License
+*/
+#include "G3D-app/VoxelOctree.h"
+#include "G3D-base/Ray.h"
+#include "G3D-base/Thread.h"
+#include "G3D-base/radixSort.h"
+
+namespace G3D {
+
+/** Below this many elements per block, the build passes are not worth running concurrently */
+static const int minBlockSize = 1 << 14;
+
+/** Interleaves the low 16 bits of x, y, and z as ...z1y1x1z0y0x0 */
+static uint64 mortonCode(const Vector3int32& P) {
+    uint64 code = 0;
+    for (int b = 0; b < 16; ++b) {
+        code |= (uint64((P.x >> b) & 1) << (3 * b)) |
+                (uint64((P.y >> b) & 1) << (3 * b + 1)) |
+                (uint64((P.z >> b) & 1) << (3 * b + 2));
+    }
+    return code;
+}
+
+
+static int countBits(uint32 x) {
+    x = x - ((x >> 1) & 0x55555555);
+    x = (x & 0x33333333) + ((x >> 2) & 0x33333333);
+    return int((((x + (x >> 4)) & 0x0F0F0F0F) * 0x01010101) >> 24);
+}
+
+
+/** Index of child \a c of a node whose first child is \a first */
+static uint32 childIndex(uint8 mask, uint32 first, int c) {
+    return first + uint32(countBits(mask & ((1u << c) - 1u)));
+}
+
+
+/** Finds the indices at which code[i] >> shift differs from code[i - 1] >> shift, in
+    increasing order. Index 0 always begins a run. */
+static void findRunStarts(const Array<uint64>& code, int shift, Array<uint32>& start) {
+    const int n = code.size();
+    const int numBlocks = clamp(n / minBlockSize, 1, 64);
+    const int blockSize = (n + numBlocks - 1) / numBlocks;
+    const bool singleThread = (numBlocks == 1);
+
+    const auto isStart = [&](int i) {
+        return (i == 0) || ((code[i] >> shift) != (code[i - 1] >> shift));
+    };
+
+    Array<int> offset;
+    offset.resize(numBlocks + 1);
+    runConcurrently(0, numBlocks, [&](int b) {
+        int count = 0;
+        const int end = min(n, (b + 1) * blockSize);
+        for (int i = b * blockSize; i < end; ++i) {
+            count += isStart(i) ? 1 : 0;
+        }
+        offset[b + 1] = count;
+    }, singleThread);
+
+    offset[0] = 0;
+    for (int b = 0; b < numBlocks; ++b) {
+        offset[b + 1] += offset[b];
+    }
+
+    start.resize(offset[numBlocks]);
+    runConcurrently(0, numBlocks, [&](int b) {
+        int j = offset[b];
+        const int end = min(n, (b + 1) * blockSize);
+        for (int i = b * blockSize; i < end; ++i) {
+            if (isStart(i)) {
+                start[j] = uint32(i);
+                ++j;
+            }
+        }
+    }, singleThread);
+}
+
+
+shared_ptr<VoxelOctree> VoxelOctree::create(const Array<Point3int16>& position, const Array<Color4unorm8>& color, float voxelRadius) {
+    return createShared<VoxelOctree>(position, color, voxelRadius);
+}
+
+
+VoxelOctree::VoxelOctree(const Array<Point3int16>& position, const Array<Color4unorm8>& color, float voxelRadius) : m_origin(0, 0, 0), m_voxelRadius(voxelRadius) {
+    alwaysAssertM(position.size() == color.size(), "Need one color per voxel");
+    const int n = position.size();
+    if (n == 0) {
+        return;
+    }
+
+    Point3int32 lo(position[0]), hi(position[0]);
+    for (const Point3int16& P : position) {
+        lo = lo.min(Point3int32(P));
+        hi = hi.max(Point3int32(P));
+    }
+    m_origin = lo;
+    m_bounds = AABox((Point3(lo) - Point3(0.5f, 0.5f, 0.5f)) * 2.0f * voxelRadius, (Point3(hi) + Point3(0.5f, 0.5f, 0.5f)) * 2.0f * voxelRadius);
+
+    const int extent = max(hi.x - lo.x, hi.y - lo.y, hi.z - lo.z) + 1;
+    while ((1 << m_depth) < extent) {
+        ++m_depth;
+    }
+
+    // Sort voxel indices along the Morton curve. The sort is stable, so the
+    // first of any duplicate positions comes first.
+    Array<int> order;
+    order.resize(n);
+    runConcurrently(0, n, [&](int i) { order[i] = i; }, n < minBlockSize);
+    radixSort(order, [&](int i) { return mortonCode(Point3int32(position[i]) - lo); }, 3 * m_depth);
+
+    Array<uint64> code;
+    code.resize(n);
+    runConcurrently(0, n, [&](int i) { code[i] = mortonCode(Point3int32(position[order[i]]) - lo); }, n < minBlockSize);
+
+    // Leaves are the distinct codes
+    Array<uint32> start;
+    findRunStarts(code, 0, start);
+    const int numLeaves = start.size();
+    m_leafColor.resize(numLeaves);
+    m_leafVoxelIndex.resize(numLeaves);
+    Array<uint64> levelCode;
+    levelCode.resize(numLeaves);
+    runConcurrently(0, numLeaves, [&](int j) {
+        const int i = order[start[j]];
+        m_leafVoxelIndex[j] = i;
+        m_leafColor[j]      = color[i];
+        levelCode[j]        = code[start[j]];
+    }, numLeaves < minBlockSize);
+
+    // Build the interior levels from the bottom up. The children of each node
+    // are the run of nodes in the level below that share all but the last three bits.
+    m_level.resize(m_depth);
+    Array<uint64> parentCode;
+    for (int d = m_depth - 1; d >= 0; --d) {
+        findRunStarts(levelCode, 3, start);
+        const Array<Color4unorm8>& childColor = (d == m_depth - 1) ? m_leafColor : m_level[d + 1].color;
+        const int numChildren = levelCode.size();
+
+        Level& level = m_level[d];
+        const int numNodes = start.size();
+        level.childMask.resize(numNodes);
+        level.firstChild.resize(numNodes);
+        level.color.resize(numNodes);
+        parentCode.resize(numNodes);
+
+        runConcurrently(0, numNodes, [&](int j) {
+            const int begin = int(start[j]);
+            const int end = (j + 1 < numNodes) ? int(start[j + 1]) : numChildren;
+
+            uint8 mask = 0;
+            int sum[4] = {0, 0, 0, 0};
+            for (int c = begin; c < end; ++c) {
+                mask |= uint8(1 << (levelCode[c] & 7));
+                const Color4unorm8 k = childColor[c];
+                sum[0] += k.r.bits(); sum[1] += k.g.bits(); sum[2] += k.b.bits(); sum[3] += k.a.bits();
+            }
+
+            const int count = end - begin;
+            level.childMask[j]  = mask;
+            level.firstChild[j] = uint32(begin);
+            level.color[j]      = Color4unorm8(unorm8::fromBits(uint8(sum[0] / count)), unorm8::fromBits(uint8(sum[1] / count)),
+                                               unorm8::fromBits(uint8(sum[2] / count)), unorm8::fromBits(uint8(sum[3] / count)));
+            parentCode[j]       = levelCode[begin] >> 3;
+        }, numNodes < minBlockSize);
+
+        levelCode.swap(parentCode);
+    }
+
+    debugAssert(levelCode.size() == 1);
+}
+
+
+size_t VoxelOctree::sizeInBytes() const {
+    size_t bytes = m_leafColor.size() * (sizeof(Color4unorm8) + sizeof(int));
+    for (const Level& level : m_level) {
+        bytes += level.childMask.size() * (sizeof(uint8) + sizeof(uint32) + sizeof(Color4unorm8));
+    }
+    return bytes;
+}
+
+
+bool VoxelOctree::intersectGrid(const Point3& origin, const Vector3& direction, float minDistance, float maxDistance, int maxLevel, Hit& hit) const {
+    // Avoid 0 * inf for rays parallel to a slab
+    Vector3 invDirection;
+    for (int a = 0; a < 3; ++a) {
+        invDirection[a] = (fabsf(direction[a]) < 1e-20f) ? 1e20f : 1.0f / direction[a];
+    }
+
+    // Intersects the cube of edge s at corner C, narrowing [t0, t1] and recording the
+    // axis of the last slab entered.
+    const auto slab = [&](const Vector3int32& C, int s, float& t0, float& t1, int& axis) {
+        for (int a = 0; a < 3; ++a) {
+            const float tA = (float(C[a]) - origin[a]) * invDirection[a];
+            const float tB = (float(C[a] + s) - origin[a]) * invDirection[a];
+            const float tNear = min(tA, tB);
+            if (tNear > t0) {
+                t0 = tNear;
+                axis = a;
+            }
+            t1 = min(t1, max(tA, tB));
+        }
+        return t0 <= t1;
+    };
+
+    class Entry {
+    public:
+        Vector3int32    corner;
+        uint32          node;
+        int             level;
+        float           t0;
+        int             axis;
+    };
+
+    // Depth-first, front-to-back. At most 7 siblings wait at each of at most 16 levels.
+    Entry stack[8 * 17];
+    int stackSize = 0;
+
+    {
+        Entry& root = stack[0];
+        root.corner = Vector3int32(0, 0, 0);
+        root.node   = 0;
+        root.level  = 0;
+        root.t0     = minDistance;
+        root.axis   = -1;
+        float t1    = maxDistance;
+        if (! slab(root.corner, 1 << m_depth, root.t0, t1, root.axis)) {
+            return false;
+        }
+        stackSize = 1;
+    }
+
+    while (stackSize > 0) {
+        const Entry e = stack[--stackSize];
+
+        if (e.level == maxLevel) {
+            // The closest occupied cell, because siblings are visited in order of entry
+            hit.distance = e.t0;
+            hit.level    = e.level;
+            if (e.level == m_depth) {
+                hit.voxelIndex = m_leafVoxelIndex[e.node];
+                hit.color      = m_leafColor[e.node];
+            } else {
+                hit.voxelIndex = -1;
+                hit.color      = m_level[e.level].color[e.node];
+            }
+
+            // A ray that starts inside of the cell has no entry face; face it back along the ray
+            const int axis = (e.axis >= 0) ? e.axis : int(direction.primaryAxis());
+            hit.normal = Vector3::zero();
+            hit.normal[axis] = (direction[axis] > 0.0f) ? -1.0f : 1.0f;
+            return true;
+        }
+
+        const Level& level = m_level[e.level];
+        const uint8  mask  = level.childMask[e.node];
+        const uint32 first = level.firstChild[e.node];
+        const int    half  = 1 << (m_depth - e.level - 1);
+
+        // Gather the children that the ray passes through, sorted by entry distance
+        Entry child[8];
+        int numChildren = 0;
+        for (int c = 0; c < 8; ++c) {
+            if ((mask & (1 << c)) == 0) { continue; }
+
+            Entry k;
+            k.corner = e.corner + Vector3int32((c & 1) * half, ((c >> 1) & 1) * half, ((c >> 2) & 1) * half);
+            k.t0     = e.t0;
+            k.axis   = e.axis;
+            float t1 = maxDistance;
+            if (slab(k.corner, half, k.t0, t1, k.axis)) {
+                k.node  = childIndex(mask, first, c);
+                k.level = e.level + 1;
+
+                int i = numChildren++;
+                while ((i > 0) && (child[i - 1].t0 > k.t0)) {
+                    child[i] = child[i - 1];
+                    --i;
+                }
+                child[i] = k;
+            }
+        }
+
+        // Push in reverse so that the nearest child is popped first
+        for (int i = numChildren - 1; i >= 0; --i) {
+            stack[stackSize++] = child[i];
+        }
+    }
+
+    return false;
+}
+
+
+bool VoxelOctree::intersectRay(const Ray& ray, Hit& hit, int maxLevel) const {
+    hit = Hit();
+    if (m_leafColor.size() == 0) {
+        return false;
+    }
+
+    maxLevel = (maxLevel < 0) ? m_depth : min(maxLevel, m_depth);
+
+    // Grid space has unit voxels with the root's low corner at the origin. The scale is
+    // uniform, so distances along the ray are unchanged.
+    const float toGrid = 1.0f / (2.0f * m_voxelRadius);
+    const Point3& origin = ray.origin() * toGrid + Vector3(0.5f, 0.5f, 0.5f) - Vector3(m_origin);
+    return intersectGrid(origin, ray.direction() * toGrid, ray.minDistance(), ray.maxDistance(), maxLevel, hit);
+}
+
+
+void VoxelOctree::intersectRays(const Array<Ray>& rayArray, Array<Hit>& hitArray, int maxLevel, bool multithreaded) const {
+    hitArray.resize(rayArray.size());
+    runConcurrently(0, rayArray.size(), [&](int i) {
+        intersectRay(rayArray[i], hitArray[i], maxLevel);
+    }, ! multithreaded);
+}
+
+
+bool VoxelOctree::lodColor(const Point3& P, int level, Color4unorm8& color) const {
+    if (m_leafColor.size() == 0) {
+        return false;
+    }
+    level = clamp(level, 0, m_depth);
+
+    const Point3& g = P / (2.0f * m_voxelRadius) + Vector3(0.5f, 0.5f, 0.5f) - Vector3(m_origin);
+    const Vector3int32 cell(iFloor(g.x), iFloor(g.y), iFloor(g.z));
+    const int size = 1 << m_depth;
+    if ((cell.x < 0) || (cell.y < 0) || (cell.z < 0) || (cell.x >= size) || (cell.y >= size) || (cell.z >= size)) {
+        return false;
+    }
+
+    uint32 node = 0;
+    for (int d = 0; d < level; ++d) {
+        const int b = m_depth - 1 - d;
+        const int c = ((cell.x >> b) & 1) | (((cell.y >> b) & 1) << 1) | (((cell.z >> b) & 1) << 2);
+        const uint8 mask = m_level[d].childMask[node];
+        if ((mask & (1 << c)) == 0) {
+            return false;
+        }
+        node = childIndex(mask, m_level[d].firstChild[node], c);
+    }
+
+    color = (level == m_depth) ? m_leafColor[node] : m_level[level].color[node];
+    return true;
+}
+
+} // namespace G3D
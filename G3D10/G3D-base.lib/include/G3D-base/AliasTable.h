@@ -0,0 +1,77 @@
+/**
+  \file G3D-base.lib/include/G3D-base/AliasTable.h
+
+  G3D Innovation Engine http://casual-effects.com/g3d
+  Copyright 2000-2019, Morgan McGuire
+  All rights reserved
+  Available under the BSD License
+*/
+#pragma once
+
+#include "G3D-base/platform.h"
+#include "G3D-base/Array.h"
+
+namespace G3D {
+
+/** \brief Samples from a discrete probability distribution in constant time.
+
+    Built from an array of non-negative weights using Vose's method. Each sample
+    costs one table lookup and one comparison, independent of the number of entries,
+    which makes this preferable to binary search of a CDF for large distributions
+    such as the texels of an environment map.
+
+    \code
+    AliasTable table(weight);
+    float pmf;
+    const int i = table.sample(rng.uniform(), rng.uniform(), pmf);
+    \endcode
+
+    \sa CubeMapSampler
+*/
+class AliasTable {
+protected:
+
+    /** Probability of keeping bin i instead of jumping to m_alias[i] */
+    Array<float>    m_threshold;
+    Array<int>      m_alias;
+
+    /** Normalized probability of each entry */
+    Array<float>    m_pmf;
+
+    double          m_totalWeight = 0.0;
+
+public:
+
+    AliasTable() {}
+
+    /** \param weight Non-negative, need not be normalized. If all are zero, every entry is equally likely. */
+    explicit AliasTable(const Array<float>& weight);
+
+    int size() const {
+        return m_pmf.size();
+    }
+
+    /** Sum of the weights that the table was built from */
+    double totalWeight() const {
+        return m_totalWeight;
+    }
+
+    /** Probability of sampling entry \a i */
+    float pmf(int i) const {
+        return m_pmf[i];
+    }
+
+    /** \param u Uniform random number on [0, 1) that selects a bin
+        \param v Uniform random number on [0, 1) that chooses between the bin and its alias.
+        Using a separate number avoids the precision loss of reusing the fractional part
+        of \a u when the table is large.
+        \param pmf Probability with which the returned entry was chosen */
+    int sample(float u, float v, float& pmf) const {
+        const int bin = min(int(u * float(m_threshold.size())), m_threshold.size() - 1);
+        const int i = (v < m_threshold[bin]) ? bin : m_alias[bin];
+        pmf = m_pmf[i];
+        return i;
+    }
+};
+
+} // namespace G3D
@@ -454,6 +454,23 @@ private:
 
     void _parse(const String& src);
 
+    /** Single-pass parser that reads the text format directly from a
+        byte buffer, bypassing TextInput. Used by load() and parse().
+        Defined in Any_parse.cpp. */
+    class Parser;
+
+    /** Parses the text format from \a data with Parser.
+        \param sourceName Recorded in source() and reported in ParseErrors */
+    void parseText(const char* data, size_t length, const String& sourceName);
+
+    /** Reads and writes the compact binary encoding used by serialize(BinaryOutput&)
+        and saveBinary(). Defined in Any_binary.cpp. */
+    class BinaryCodec;
+
+    /** Identifies files written by saveBinary(). Begins with a zero byte, so it can never
+        be the start of a legal text file. */
+    static const char  BINARY_MAGIC[8];
+
 public:
 
     /** Thrown by operator[] when a key is not present in a const table. */
@@ -823,7 +840,8 @@ public:
        This must be a TABLE or ARRAY */
     void clear();
 
-    /** Parse from a file.
+    /** Parse from a file. Also accepts files written by saveBinary(),
+        which load without any tokenizing.
      \sa deserialize, parse, fromFile, loadIfExists
      */
     void load(const String& filename);
@@ -837,15 +855,26 @@ public:
     /** Uses the serialize method. If the extension is ".json", uses JSON format with coercion, otherwise uses native Any format. */
     void save(const String& filename) const;
 
+    /** Writes a "cooked" file in the compact binary encoding of serialize(BinaryOutput&) that
+        load() reads back without tokenizing. Comments, names, source locations,
+        and #include lines are preserved, so relative filenames still resolve against the
+        directory of the original text file. \sa load, save */
+    void saveBinary(const String& filename) const;
+
     /** \param coerce.  If json=true, should features that JSON doesn't support be coerced or produce errors?*/
     void serialize(TextOutput& to, bool json = false, bool coerce = false) const;
 
+    /** Writes a compact binary encoding in which every string (values, keys, names, comments,
+        and source filenames) is stored once in an interned string table. Much faster to
+        deserialize than the text format. */
     void serialize(class BinaryOutput& b) const;
 
     /** Parse from a stream.
      \sa load, parse */
     void deserialize(TextInput& ti);
 
+    /** Reads the output of serialize(BinaryOutput&). Also accepts the text-in-binary
+        encoding written by older versions of G3D. */
     void deserialize(class BinaryInput& b);
 
     const Source& source() const;
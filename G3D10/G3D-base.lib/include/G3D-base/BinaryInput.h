@@ -49,6 +49,13 @@ namespace G3D {
  size are transparently decompressed when the compressed = true flag is
  specified to the constructor.
 
+ Files written by BinaryOutput::setChunkedCompression are also read
+ with compressed = true and the same read API.  Those files are split into
+ independently compressed blocks, so a huge file is not decompressed into
+ one allocation: blocks are decompressed on demand, several at a time in
+ parallel ahead of the read position, and setPosition() (or setPositionToBlock())
+ only decompresses the blocks around the new position.
+
  For every readX method there are also versions that operate on a whole
  Array, std::vector, or C-array.  e.g. readFloat32(Array<float32>& array, n)
  These methods resize the array or std::vector to the appropriate size
@@ -118,10 +125,40 @@ private:
      */
     bool            m_freeBuffer;
 
+    /** Location in the file of one block of a chunked compressed file */
+    class CompressedBlock {
+    public:
+        int64       offset;
+        uint32      size;
+    };
+
+    /** For chunked compressed files that are decompressed on demand, one entry per block. Otherwise empty. */
+    Array<CompressedBlock> m_compressedBlockArray;
+
+    /** Uncompressed bytes in each block of a chunked compressed file, or 0 */
+    int64           m_compressedBlockLength;
+
+    /** Number of blocks decompressed at a time by loadIntoMemory for chunked files */
+    int             m_readAheadBlocks;
+
+    /** Allocated size of m_buffer for chunked files, which may exceed m_bufferLength */
+    int64           m_bufferCapacity;
+
     /** Ensures that we are able to read at least minLength from startPosition (relative
         to start of file). */
     void loadIntoMemory(int64 startPosition, int64 minLength = 0);
 
+    /** loadIntoMemory for chunked compressed files. Decompresses the blocks overlapping
+        the requested range and the following blocks up to m_readAheadBlocks, in parallel. */
+    void loadBlocksIntoMemory(int64 startPosition, int64 minLength);
+
+    /** Reads the index of a chunked compressed file. Returns false if \a file is not one. */
+    bool openChunkedFile(FILE* file, int64 fileLength);
+
+    /** Decompresses an entire in-memory chunked compressed file into m_buffer, in parallel.
+        Returns false if \a data is not one. */
+    bool decompressChunked(const uint8* data, int64 dataLen);
+
     /** Verifies that at least this number of bytes can be read.*/
     void prepareToRead(int64 nbytes);
 
@@ -138,12 +175,28 @@ public:
     /** false, constant to use with the copyMemory option */
     static const bool       NO_COPY;
 
+    /** First and last four bytes of a chunked compressed file ("G3DZ").
+        \sa BinaryOutput::setChunkedCompression */
+    static const uint32     CHUNKED_MAGIC = 0x5A443347;
+
+    static const uint32     CHUNKED_VERSION = 1;
+
+    /** Magic number, version, uncompressed block length, and a reserved uint32 */
+    static const int        CHUNKED_HEADER_SIZE = 16;
+
+    /** Each block's uint64 file offset and uint32 compressed size, between the last block and the footer */
+    static const int        CHUNKED_INDEX_ENTRY_SIZE = 12;
+
+    /** Uncompressed uint64 length, uint32 number of blocks, and the magic number */
+    static const int        CHUNKED_FOOTER_SIZE = 16;
+
     /**
        If the file cannot be opened, a zero length buffer is presented.
        Automatically opens files that are inside zipfiles.
 
        @param compressed Set to true if and only if the file was
-       compressed using BinaryOutput's zlib compression.  This has
+       compressed using BinaryOutput's zlib compression (either
+       BinaryOutput::compress or BinaryOutput::setChunkedCompression).  This has
        nothing to do with whether the input is in a zipfile.
     */
     BinaryInput(
@@ -256,6 +309,32 @@ public:
         setPosition(0);
     }
 
+    /** Number of independently compressed blocks in a file written with
+        BinaryOutput::setChunkedCompression, or 0 for other files. */
+    int numCompressedBlocks() const {
+        return int(m_compressedBlockLength > 0 ? (m_length + m_compressedBlockLength - 1) / m_compressedBlockLength : 0);
+    }
+
+    /** Uncompressed length of every block but the last in a chunked compressed file, or 0 for other files. */
+    int64 compressedBlockLength() const {
+        return m_compressedBlockLength;
+    }
+
+    /** Seeks to the first byte of block \a b of a chunked compressed file. Only the blocks
+        around that position are decompressed. */
+    void setPositionToBlock(int b) {
+        debugAssertM(m_compressedBlockLength > 0, "Not a chunked compressed file");
+        debugAssert(b >= 0 && b < numCompressedBlocks());
+        setPosition(int64(b) * m_compressedBlockLength);
+    }
+
+    /** Number of blocks of a chunked compressed file that are decompressed in parallel
+        each time the read position leaves the decompressed range. Default is the number
+        of cores, and at least 2. */
+    void setReadAheadBlocks(int n) {
+        m_readAheadBlocks = max(1, n);
+    }
+
     void readBytes(void* bytes, int64 n);
 
     int8 readInt8() {
@@ -37,7 +37,10 @@ namespace G3D {
 /**
  Sequential or random access byte-order independent binary file access.
 
- The compress() call can be used to compress with zlib.
+ The compress() call can be used to compress with zlib.  For large files,
+ setChunkedCompression() instead compresses independent blocks in parallel
+ while the file is being written, so the whole file never has to be held in
+ memory, and BinaryInput can decompress it on demand with random access.
 
  Any method call can trigger an out of memory error (thrown as char*) 
  when writing to "<memory>" instead of a file.
@@ -87,6 +90,24 @@ private:
 
     bool            m_ok;
 
+    /** Uncompressed bytes per block after setChunkedCompression(), otherwise 0 */
+    int             m_chunkLength;
+
+    int             m_chunkLevel;
+
+    /** Bytes of compressed blocks (and header) already in the file or memory container */
+    int64           m_chunkedFileLength;
+
+    /** File offset of each compressed block */
+    Array<int64>    m_chunkOffset;
+
+    Array<uint32>   m_chunkCompressedSize;
+
+    /** Compresses the complete blocks before m_pos (or, if \a finish is true, everything
+        followed by the index) in parallel and writes them to the file, or to m_buffer when
+        writing to memory. */
+    void flushChunks(bool finish);
+
     void reserveBytesWhenOutOfMemory(size_t bytes);
 
     void reallocBuffer(size_t bytes, size_t oldBufferLen);
@@ -141,6 +162,22 @@ public:
      */
     void compress(int level = 9);
 
+    /** Compresses the file as independent blocks of \a blockLength uncompressed bytes using
+        zlib at \a level, in place of compress().  Call immediately after construction, before
+        writing anything.
+
+        When writing to a file, complete blocks are compressed in parallel and appended to
+        the file whenever several have accumulated, so memory use stays bounded.  commit()
+        compresses the last block and writes an index of the blocks.  When writing to
+        "<memory>", all blocks are compressed in parallel by commit(), after which
+        getCArray() and length() describe the compressed data.
+
+        Seeking backwards is limited to the blocks not yet compressed.
+
+        Read the result with BinaryInput and compressed = true.
+     */
+    void setChunkedCompression(int level = 6, int blockLength = 1024 * 1024);
+
     /** True if no errors have been encountered.*/
     bool ok() const;
 
@@ -22,6 +22,7 @@
 #include "G3D-base/Array.h"
 #include "G3D-base/Ray.h"
 #include "G3D-base/Line.h"
+#include "G3D-base/Sphere.h"
 
 namespace G3D {
 
@@ -795,6 +796,137 @@ public:
         float                   b[3] = (float*)&ignore,
         bool                    twoSided = false);
 
+    /** \brief Fixed triangles in structure-of-arrays form, four per packet, for the batched
+        moving sphere queries.
+
+        Build one for the candidate triangles returned by a broad phase such as
+        TriTree::intersectBox, and then sweep any number of spheres against it.
+
+        \sa collisionTimeForMovingSphereFixedTriangles, collisionTimeForMovingSpheresFixedTriangles
+    */
+    class TrianglePacketArray {
+    public:
+        /** Four triangles. Every array is indexed last by lane. */
+        class Packet {
+        public:
+            /** [vertex][axis][lane] */
+            float       vertex[3][3][4];
+
+            /** [axis][lane] */
+            float       normal[3][4];
+
+            /** Plane equation constant, such that normal . X + d = 0 on the plane */
+            float       d[4];
+
+            /** Unit vector from vertex[i] to vertex[(i + 1) % 3], [edge][axis][lane] */
+            float       edgeDirection[3][3][4];
+
+            float       edgeLength[3][4];
+
+            /** 1 / (normal . ((v1 - v0) x (v2 - v0))), for barycentric coordinates */
+            float       invDoubleArea[4];
+
+            /** 1 for triangles with nonzero area, 0 for degenerate (including nearly collinear) triangles and unused lanes */
+            float       valid[4];
+        };
+
+    protected:
+
+        Array<Packet>   m_packet;
+        int             m_size = 0;
+
+    public:
+
+        TrianglePacketArray() {}
+
+        TrianglePacketArray(const Array<Triangle>& triangleArray) {
+            append(triangleArray);
+        }
+
+        /** Number of triangles */
+        int size() const {
+            return m_size;
+        }
+
+        int numPackets() const {
+            return m_packet.size();
+        }
+
+        const Packet& packet(int p) const {
+            return m_packet[p];
+        }
+
+        /** Triangles are numbered in the order appended. Degenerate triangles are kept so that the
+            numbering is preserved, but never collide. */
+        void append(const Triangle& triangle);
+
+        void append(const Array<Triangle>& triangleArray);
+
+        void clear() {
+            m_packet.fastClear();
+            m_size = 0;
+        }
+
+        /** Reconstructs triangle \a i */
+        Triangle triangle(int i) const;
+    };
+
+    /**
+     Batched version of collisionTimeForMovingSphereFixedTriangle() that tests one moving sphere
+     against four triangles at a time with SSE. It writes the same collision time for each
+     triangle as the scalar function, up to roundoff, to \a outTime[i], which must have at least
+     triangles.size() elements.
+    */
+    static void collisionTimesForMovingSphereFixedTriangles(
+        const class Sphere&         sphere,
+        const Vector3&              velocity,
+        const TrianglePacketArray&  triangles,
+        float*                      outTime,
+        bool                        twoSided = false);
+
+    /**
+     Earliest collision of a moving sphere with any of \a triangles, as for
+     collisionTimeForMovingSphereFixedTriangle().
+
+     @param outLocation  Location of the first collision, if any.
+     @param outIndex     Index of the first triangle hit, or -1 if there is no collision.
+
+     @return Time until the first collision, or finf() if there is none.
+    */
+    static float collisionTimeForMovingSphereFixedTriangles(
+        const class Sphere&         sphere,
+        const Vector3&              velocity,
+        const TrianglePacketArray&  triangles,
+        Vector3&                    outLocation,
+        int&                        outIndex,
+        bool                        twoSided = false);
+
+    /** One moving sphere and its result, for collisionTimeForMovingSpheresFixedTriangles() */
+    class MovingSphereQuery {
+    public:
+        Sphere                      sphere;
+        Vector3                     velocity;
+
+        /** Candidate triangles for this sphere; queries may share them */
+        const TrianglePacketArray*  triangles = nullptr;
+        bool                        twoSided = false;
+
+        /** Output: time of the first collision, or finf() */
+        float                       time = finf();
+
+        /** Output: location of the first collision */
+        Vector3                     location;
+
+        /** Output: index into triangles of the first triangle hit, or -1 */
+        int                         triangleIndex = -1;
+    };
+
+    /** Runs collisionTimeForMovingSphereFixedTriangles() for every query, on multiple threads.
+        Intended for sweeping all of the characters or projectiles in a scene at once. */
+    static void collisionTimeForMovingSpheresFixedTriangles(
+        Array<MovingSphereQuery>&   queryArray,
+        bool                        multithreaded = true);
+
     /**
      Calculates time between the intersection of a moving sphere and a fixed
      rectangle defined by the points v0, v1, v2, & v3.
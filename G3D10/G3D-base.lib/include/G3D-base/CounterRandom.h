@@ -0,0 +1,142 @@
+/**
+  \file G3D-base.lib/include/G3D-base/CounterRandom.h
+
+  G3D Innovation Engine http://casual-effects.com/g3d
+  Copyright 2000-2019, Morgan McGuire
+  All rights reserved
+  Available under the BSD License
+*/
+#pragma once
+
+#include "G3D-base/platform.h"
+#include "G3D-base/Random.h"
+
+namespace G3D {
+
+class Vector3;
+class Vector4;
+
+/** \brief Stateless, counter-based random numbers for reproducible parallel sampling.
+
+    Each value is a pure function of a 64-bit seed, a three-word stream identifier, and the
+    position within that stream, computed with the Philox4x32-10 bijection. Two generators
+    with the same seed and stream produce the same sequence regardless of which thread they
+    run on or in what order, and different streams are statistically independent. This makes
+    it well suited to renderers that assign one stream to each (pixel, sample, scattering
+    event) and need identical images from run to run.
+
+    The entire state is 32 bytes and construction is free, so instances are normally
+    created on the stack right where they are needed instead of being shared per thread like
+    Random::threadCommon().
+
+    \code
+    CounterRandom rng(seed, pixelIndex, sampleIndex, bounce);
+    surfel->scatter(PathDirection::EYE_TO_SOURCE, w_o, false, rng, weight, w_i, impulse);
+    \endcode
+
+    The static batch routines generate values for many streams at once, four 32-bit words
+    per stream, with the lanes laid out so that the compiler can vectorize them.
+
+    Not threadsafe; use one instance per thread.
+
+    @cite Salmon, Moraes, Dror, and Shaw, Parallel Random Numbers: As Easy as 1, 2, 3, SC'11
+    \sa Random, PrecomputedRandom
+*/
+class CounterRandom : public Random {
+protected:
+
+    uint32      m_key[2];
+
+    /** Stream identifier in the first three words, block index within the stream in the fourth */
+    uint32      m_counter[4];
+
+    /** Output of the most recent block */
+    uint32      m_block[4];
+
+    /** Index of the next unused word in m_block. 4 means that a new block must be generated. */
+    int         m_next;
+
+public:
+
+    /** Philox4x32-10. Writes four random words for \a counter under \a key to \a result. */
+    static void philox(const uint32 counter[4], const uint32 key[2], uint32 result[4]) {
+        uint32 c0 = counter[0], c1 = counter[1], c2 = counter[2], c3 = counter[3];
+        uint32 k0 = key[0], k1 = key[1];
+
+        for (int round = 0; round < 10; ++round) {
+            const uint64 p0 = uint64(0xD2511F53) * c0;
+            const uint64 p1 = uint64(0xCD9E8D57) * c2;
+            c0 = uint32(p1 >> 32) ^ c1 ^ k0;
+            c1 = uint32(p1);
+            c2 = uint32(p0 >> 32) ^ c3 ^ k1;
+            c3 = uint32(p0);
+            k0 += 0x9E3779B9;
+            k1 += 0xBB67AE85;
+        }
+
+        result[0] = c0; result[1] = c1; result[2] = c2; result[3] = c3;
+    }
+
+    /** Maps random bits to a float on [0, 1) with 24 bits of precision */
+    static float toUniform(uint32 bits) {
+        return float(bits >> 8) * (1.0f / 16777216.0f);
+    }
+
+    /** \param seed Shared by all streams of one computation, e.g., one rendered frame
+        \param stream0, stream1, stream2 Identify the sequence, e.g., pixel, sample index, and scattering event */
+    CounterRandom(uint64 seed = 0xF018A4D2, uint32 stream0 = 0, uint32 stream1 = 0, uint32 stream2 = 0) : Random((void*)nullptr) {
+        m_key[0] = uint32(seed);
+        m_key[1] = uint32(seed >> 32);
+        setStream(stream0, stream1, stream2);
+    }
+
+    /** Begin the sequence for a different stream under the same seed */
+    void setStream(uint32 stream0, uint32 stream1 = 0, uint32 stream2 = 0) {
+        m_counter[0] = stream0;
+        m_counter[1] = stream1;
+        m_counter[2] = stream2;
+        m_counter[3] = 0;
+        m_next = 4;
+    }
+
+    /** Jump to word 4 * \a block of the current stream. Useful for giving independent
+        subsystems disjoint ranges of the same stream. */
+    void setBlock(uint32 block) {
+        m_counter[3] = block;
+        m_next = 4;
+    }
+
+    /** Sets the low 32 bits of the seed and restarts stream (0, 0, 0). \a threadsafe is ignored. */
+    virtual void reset(uint32 seed = 0xF018A4D2, bool threadsafe = true) override;
+
+    virtual uint32 bits() override {
+        if (m_next == 4) {
+            philox(m_counter, m_key, m_block);
+            ++m_counter[3];
+            m_next = 0;
+        }
+        return m_block[m_next++];
+    }
+
+    /** Uniform random float on the range [low, high) */
+    virtual float uniform(float low, float high) override {
+        return low + (high - low) * toUniform(bits());
+    }
+
+    /** Uniform random float on the range [0, 1) */
+    virtual float uniform() override {
+        return toUniform(bits());
+    }
+
+    virtual void cosHemi(float& x, float& y, float& z) override;
+
+    /** For each i in [0, \a count), writes to \a result[i] the four uniform values on [0, 1) at
+        block \a block of stream (\a stream0[i], \a stream1, \a stream2). This is the same
+        as the first four values of CounterRandom(seed, stream0[i], stream1, stream2) after setBlock(block). */
+    static void uniformBatch(uint64 seed, const int* stream0, uint32 stream1, uint32 stream2, uint32 block, int count, Vector4* result);
+
+    /** As uniformBatch(), but for the contiguous streams \a firstStream0 through \a firstStream0 + \a count - 1 */
+    static void uniformBatch(uint64 seed, uint32 firstStream0, uint32 stream1, uint32 stream2, uint32 block, int count, Vector4* result);
+};
+
+} // namespace G3D
@@ -46,6 +46,17 @@ public:
     Color3 nearest(const Vector3& v) const;
     Color3 bilinear(const Vector3& v) const;
 
+    /** Returns the face that \a vec points into and the coordinate within it on [0, 1]^2,
+        where (0, 0) is the upper-left corner of the face image. \a vec need not be normalized. */
+    static Vector2 faceCoord(const Vector3& vec, CubeFace& face);
+
+    /** Inverse of faceCoord(). Returns a unit vector. */
+    static Vector3 direction(CubeFace face, const Vector2& faceCoord);
+
+    /** The value of texel (\a x, \a y) of \a face, where both coordinates are on [-1, size()].
+        Coordinates -1 and size() read the adjacent faces' edges. */
+    Color3 texel(CubeFace face, int x, int y) const;
+
     /** The size of one face, in pixels, based on the input (not counting padding used for seamless cube mapping */
     int size() const;
 
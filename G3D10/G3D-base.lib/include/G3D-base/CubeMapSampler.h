@@ -0,0 +1,66 @@
+/**
+  \file G3D-base.lib/include/G3D-base/CubeMapSampler.h
+
+  G3D Innovation Engine http://casual-effects.com/g3d
+  Copyright 2000-2019, Morgan McGuire
+  All rights reserved
+  Available under the BSD License
+*/
+#pragma once
+
+#include "G3D-base/platform.h"
+#include "G3D-base/ReferenceCount.h"
+#include "G3D-base/AliasTable.h"
+#include "G3D-base/Vector2.h"
+#include "G3D-base/Vector3.h"
+#include "G3D-base/Vector4.h"
+
+namespace G3D {
+
+class CubeMap;
+
+/** \brief Importance samples directions from a CubeMap in proportion to its brightness.
+
+    The cube map is divided into cells of at most maxResolution x maxResolution per face.
+    Each cell is weighted by its mean channel average times its solid angle, and an AliasTable
+    over all cells selects one in constant time. The direction is then chosen uniformly
+    within the cell on the face. pdf() returns the matching density with respect to solid
+    angle, so the two can be combined with other sampling techniques by multiple importance
+    sampling.
+
+    Cells that are entirely black have zero probability. Because bilinear filtering can bleed
+    light into them, always combine this with another technique (such as BSDF sampling) that
+    covers the whole sphere.
+
+    \sa PathTracer, AliasTable
+*/
+class CubeMapSampler : public ReferenceCountedObject {
+protected:
+
+    /** Cells per face edge */
+    int                 m_resolution;
+
+    /** Index = (face * m_resolution + y) * m_resolution + x */
+    AliasTable          m_table;
+
+    CubeMapSampler(const shared_ptr<CubeMap>& cubeMap, int maxResolution);
+
+public:
+
+    /** \param maxResolution Upper bound on the sampling cells per face edge. The table holds
+        6 * maxResolution^2 entries; smaller cube maps use one cell per texel. */
+    static shared_ptr<CubeMapSampler> create(const shared_ptr<CubeMap>& cubeMap, int maxResolution = 256);
+
+    /** Returns a unit direction and its probability density with respect to solid angle.
+        \param u Four uniform random numbers on [0, 1) */
+    Vector3 sample(const Vector4& u, float& pdf) const;
+
+    /** Probability density with respect to solid angle that sample() returns \a w */
+    float pdf(const Vector3& w) const;
+
+    /** Integral of the mean channel average over the sphere, based on the sampling cells. Useful for
+        deciding how often to sample the environment relative to other lights. */
+    float power() const;
+};
+
+} // namespace G3D
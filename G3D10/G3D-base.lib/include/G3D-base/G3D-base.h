@@ -93,6 +93,8 @@
 #include "G3D-base/ReferenceCount.h"
 #include "G3D-base/Welder.h"
 #include "G3D-base/PrecomputedRandom.h"
+#include "G3D-base/AliasTable.h"
+#include "G3D-base/CounterRandom.h"
 #include "G3D-base/MemoryManager.h"
 #include "G3D-base/BlockPoolMemoryManager.h"
 #include "G3D-base/AreaMemoryManager.h"
@@ -109,7 +111,9 @@
 #include "G3D-base/Pathfinder.h"
 #include "G3D-base/EqualsTrait.h"
 #include "G3D-base/Image.h"
+#include "G3D-base/ImageResampler.h"
 #include "G3D-base/CubeMap.h"
+#include "G3D-base/CubeMapSampler.h"
 #include "G3D-base/CollisionDetection.h"
 #include "G3D-base/Intersect.h"
 #include "G3D-base/Log.h"
@@ -139,6 +143,7 @@
 #include "G3D-base/MeshBuilder.h"
 #include "G3D-base/Stopwatch.h"
 #include "G3D-base/Thread.h"
+#include "G3D-base/radixSort.h"
 #include "G3D-base/RegistryUtil.h"
 #include "G3D-base/Any.h"
 #include "G3D-base/XML.h"
@@ -175,6 +180,7 @@
 #include "G3D-base/float16.h"
 #include "G3D-base/PrefixTree.h"
 #include "G3D-base/WebServer.h"
+#include "G3D-base/WebFrameStreamer.h"
 
 namespace G3D {
 
@@ -0,0 +1,88 @@
+/**
+  \file G3D-base.lib/include/G3D-base/ImageResampler.h
+
+  G3D Innovation Engine http://casual-effects.com/g3d
+  Copyright 2000-2019, Morgan McGuire
+  All rights reserved
+  Available under the BSD License
+*/
+#pragma once
+#define G3D_base_ImageResampler_h
+
+#include "G3D-base/platform.h"
+#include "G3D-base/Array.h"
+#include "G3D-base/enumclass.h"
+
+namespace G3D {
+
+class ImageFormat;
+class CPUPixelTransferBuffer;
+
+/** \brief Resizes images and builds mip pyramids on the CPU.
+
+    The filter is applied separably, first along rows and then along columns, and both passes
+    run on multiple threads. Each output pixel is a normalized weighted sum of the input pixels
+    under the filter, whose support is widened by the scale factor when minifying so that
+    downsampling does not alias. Edges are clamped.
+
+    Supports RGB8, RGBA8, SRGB8, SRGBA8, RGB32F, and RGBA32F. Pixels are filtered as four
+    floats, which maps directly to SSE on x86.
+
+    8-bit sRGB formats are always decoded to linear radiance before filtering and re-encoded
+    afterward, because averaging sRGB values darkens the result. Pass \a srgb = true to also
+    treat RGB8 and RGBA8 that way, which is usually correct for images loaded from files.
+    Alpha is always filtered linearly.
+
+    \code
+    const shared_ptr<Image>& image = Image::fromFile("photo.jpg");
+    const shared_ptr<CPUPixelTransferBuffer>& thumbnail = ImageResampler::resize
+        (dynamic_pointer_cast<CPUPixelTransferBuffer>(image->toPixelTransferBuffer()), 128, 96,
+         ImageResampler::Filter::LANCZOS3, true);
+    \endcode
+
+    \sa Image, ImageConvert, Map2D
+*/
+class ImageResampler {
+private:
+    ImageResampler();
+
+public:
+
+    G3D_DECLARE_ENUM_CLASS(Filter,
+        /** Average of the covered pixels. Fast, and exact for power-of-two reductions. */
+        BOX,
+
+        /** Linear interpolation when magnifying; triangle-weighted average when minifying */
+        TENT,
+
+        /** Windowed sinc with three lobes. Sharpest, but can ring near hard edges. */
+        LANCZOS3,
+
+        /** Mitchell-Netravali cubic with B = C = 1/3, a good compromise between blur and ringing */
+        MITCHELL);
+
+    /** True if resize() accepts \a format */
+    static bool supportsFormat(const ImageFormat* format);
+
+    /** Returns a new buffer of the same format as \a src, scaled to \a width x \a height.
+        \param srgb Treat RGB8 and RGBA8 data as sRGB encoded. Ignored for float formats. */
+    static shared_ptr<CPUPixelTransferBuffer> resize
+       (const shared_ptr<CPUPixelTransferBuffer>&   src,
+        int                                         width,
+        int                                         height,
+        Filter                                      filter  = Filter::MITCHELL,
+        bool                                        srgb    = false);
+
+    /** Fills \a mipArray with the full mip chain of \a src, down to 1 x 1. Element 0 is \a src
+        itself (not a copy), and each subsequent level is half the size of the previous one, rounded
+        down, filtered from that previous level.
+
+        \param srgb As for resize() */
+    static void generateMipPyramid
+       (const shared_ptr<CPUPixelTransferBuffer>&   src,
+        Array<shared_ptr<CPUPixelTransferBuffer>>&  mipArray,
+        Filter                                      filter  = Filter::BOX,
+        bool                                        srgb    = false);
+};
+
+} // namespace G3D
@@ -245,13 +245,19 @@ public:
      @param faceArray       <I>Output</I>
      @param edgeArray       <I>Output</I>.  Sorted so that boundary edges are at the end of the array. 
      @param vertexArray     <I>Output</I> 
+     @param parallelSort    If true, edges are found by radix sorting (min vertex, max vertex, face)
+                            records on multiple threads and pairing faces within each run of equal
+                            vertex pairs. If false, edges are inserted one at a time into a per-vertex
+                            edge table. Both produce identical output; the sort is much faster on
+                            large meshes.
      */
     static void computeAdjacency(
         const Array<Vector3>&   vertexGeometry,
         const Array<int>&       indexArray,
         Array<Face>&            faceArray,
         Array<Edge>&            edgeArray,
-        Array<Vertex>&          vertexArray);
+        Array<Vertex>&          vertexArray,
+        bool                    parallelSort = true);
 
     /**
      @deprecated Use the other version of computeAdjacency, which takes Array<Vertex>.
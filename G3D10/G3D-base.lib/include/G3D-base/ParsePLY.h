@@ -13,11 +13,11 @@
 #include "G3D-base/platform.h"
 #include "G3D-base/ReferenceCount.h"
 #include "G3D-base/Array.h"
-#include "G3D-base/SmallArray.h"
 #include "G3D-base/Table.h"
 #include "G3D-base/Vector2.h"
 #include "G3D-base/Vector3.h"
 #include "G3D-base/Vector4.h"
+#include <functional>
 
 namespace G3D {
 
@@ -26,7 +26,12 @@ class BinaryInput;
 /** \brief Parses PLY geometry files to extract face and vertex information.
 
 The input file is required to contain only vertex and (face or triStrip) elements, in that order.
-Each may have any number of properties.
+Each may have any number of properties. Binary files of either endianness and ASCII files are supported.
+
+The header is compiled into a fixed record layout when the vertex element has no list properties,
+and then blocks of vertices are decoded with one copy or byte swap loop per property.
+ASCII files are split into blocks of lines that are parsed concurrently. Pass a VertexCallback
+to parse() to receive the vertices in blocks instead of holding all of them in vertexData.
 
 \cite http://paulbourke.net/dataformats/ply/
 
@@ -59,6 +64,11 @@ public:
         list_type,
         none_type};
 
+    enum FileFormat {
+        ASCII_FORMAT,
+        BINARY_LITTLE_ENDIAN_FORMAT,
+        BINARY_BIG_ENDIAN_FORMAT};
+
     static DataType parseDataType(const char* t);
     static size_t byteSize(DataType d);
 
@@ -74,14 +84,21 @@ public:
         /** Only used for type = LIST */
         DataType        listElementType;
 
-        Property() : type(none_type) {}
-    };
+        /** Byte offset within a binary vertex record. Only used when vertexStride > 0 */
+        int             byteOffset;
 
-    typedef SmallArray<int, 6> Face;
+        Property() : type(none_type), byteOffset(0) {}
+    };
 
     /** A -1 inside the triStrip means "restart" */
     typedef Array<int> TriStrip;
-    
+
+    /** Receives vertices firstVertex through firstVertex + count - 1, in the layout of vertexData.
+        \a data is only valid during the call. */
+    typedef std::function<void (int firstVertex, int count, const float* data)> VertexCallback;
+
+    FileFormat      fileFormat;
+
     int             numVertices;
     int             numFaces;
     int             numTriStrips;
@@ -91,27 +108,48 @@ public:
     /** Face or tristrip properties */
     Array<Property> faceOrTriStripProperty;    
 
+    /** Bytes per binary vertex record, or 0 if a list property makes the records variable length */
+    int             vertexStride;
+
     /** 
         vertexData[v*vertexPropertyArray.size() + p] is a float representing property p
         for vertex v.  If property p is a list type,
         the value is zero.
+
+        nullptr if parse() was given a VertexCallback.
     */
     float*          vertexData;
 
-    /** Only one of faceArray and triStripArray will be non-nullptr */
-    Face*           faceArray;
+    /** The vertex indices of every face, concatenated. Empty when the file has tristrips. 
+        \sa faceIndices, faceSize */
+    Array<int>      faceIndexArray;
+
+    /** Face f is faceIndexArray[faceStartArray[f]] through faceIndexArray[faceStartArray[f + 1] - 1].
+        numFaces + 1 elements when the file has faces. */
+    Array<int>      faceStartArray;
 
-    /** Only one of faceArray and triStripArray will be non-nullptr */
+    /** nullptr unless the file has tristrips */
     TriStrip*       triStripArray;
 
 private:
 
+    /** Vertices decoded at a time */
+    static const int VERTEX_BLOCK_SIZE = 1 << 16;
+
     static void parseProperty(const String& s, Property& prop);
     static float readAsFloat(const Property& prop, BinaryInput& bi);
 
     void readHeader(BinaryInput& bi);
-    void readVertexList(BinaryInput& bi);
+
+    /** Computes Property::byteOffset and vertexStride */
+    void compileVertexLayout();
+
+    /** Index of the vertex_index or vertex_indices property */
+    int findIndexProperty(BinaryInput& bi) const;
+
+    void readVertexList(BinaryInput& bi, const VertexCallback& callback);
     void readFaceList(BinaryInput& bi);
+    void readASCII(BinaryInput& bi, const VertexCallback& callback);
 
 public:
     
@@ -123,6 +161,19 @@ public:
 
     void parse(BinaryInput& bi);
 
+    /** Streams the vertices to \a callback in order instead of storing them in vertexData. 
+        Faces and tristrips are stored as usual. The text of an ASCII file is still read
+        into memory at once. */
+    void parse(BinaryInput& bi, const VertexCallback& callback);
+
+    const int* faceIndices(int f) const {
+        return faceIndexArray.getCArray() + faceStartArray[f];
+    }
+
+    int faceSize(int f) const {
+        return faceStartArray[f + 1] - faceStartArray[f];
+    }
+
 };
 
 
@@ -0,0 +1,294 @@
+/**
+  \file G3D-base.lib/include/G3D-base/WebFrameStreamer.h
+
+  G3D Innovation Engine http://casual-effects.com/g3d
+  Copyright 2000-2019, Morgan McGuire
+  All rights reserved
+  Available under the BSD License
+*/
+#pragma once
+
+#include "G3D-base/platform.h"
+#include "G3D-base/ReferenceCount.h"
+#include "G3D-base/Array.h"
+#include "G3D-base/Queue.h"
+#include "G3D-base/Image.h"
+#include "G3D-base/NetAddress.h"
+#include "G3D-base/WebServer.h"
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace G3D {
+
+class PixelTransferBuffer;
+
+/**
+ \brief Streams rendered frames to many WebServer::WebSocket clients without blocking the render thread.
+
+ submitFrame() only hands the image to an encoder thread and returns. If the encoder is still busy
+ when the next frame arrives, the older unencoded frame is dropped. Frames are encoded once, no matter
+ how many clients are connected, and then a pool of sender threads delivers them so that a slow client
+ never delays the others.
+
+ When Specification::tileSize is nonzero, the image is divided into tiles and only the tiles whose
+ pixels changed are re-encoded (in parallel) and sent. Each client remembers which version of every
+ tile it has, so a client that falls behind receives the union of the changes it missed in its next
+ message rather than a backlog of stale frames.
+
+ Each client may have at most Specification::maxFramesInFlight frames that it has not yet acknowledged.
+ While a client is at that limit, newer frames replace each other and the client skips them. Clients
+ acknowledge a frame by sending the JSON message <code>{"type": 1000, "frame": N}</code>, which is the
+ image request that the remoteRender sample's game.js already sends after each image.
+
+ Messages use the same binary framing as the remoteRender sample: a big-endian int32 length, a JSON
+ header of that length, and then the encoded image data.
+
+ - Whole frames (tileSize == 0) have the header
+   <code>{"type":1,"frame":N,"width":W,"height":H,"mimeType":M}</code> followed by one image file.
+ - Tiled frames have the header
+   <code>{"type":4,"frame":N,"width":W,"height":H,"mimeType":M,"tiles":[[x,y,w,h,bytes],...]}</code>
+   followed by the tile image files in the same order. Tiles not listed are unchanged.
+
+ The application's WebSocket subclass connects clients by calling addClient() from onReady(),
+ onClientData() from onData(), and removeClient() from onClose().
+
+ \sa WebServer
+*/
+class WebFrameStreamer : public ReferenceCountedObject {
+public:
+
+    /** Values of the "type" field in message headers */
+    enum MessageType {
+        IMAGE = 1,
+        TILES = 4,
+
+        /** Sent by clients to acknowledge a frame */
+        ACKNOWLEDGE = 1000
+    };
+
+    class Specification {
+    public:
+        /** PNG or JPEG. JPEG encodes more slowly but uses much less bandwidth. */
+        Image::ImageFileFormat      fileFormat;
+
+        /** Width and height of the delta tiles in pixels, or 0 to always send whole frames. Default is 0. */
+        int                         tileSize;
+
+        /** Frames that a client may have unacknowledged before newer frames skip it. Default is 1. */
+        int                         maxFramesInFlight;
+
+        /** If false, a frame is treated as acknowledged as soon as it has been written to the socket.
+            Default is true. */
+        bool                        requireAcknowledgement;
+
+        /** Threads writing to sockets. Default is 4. */
+        int                         numSenderThreads;
+
+        /** Period over which ClientStats::bytesPerSecond is measured. Default is one second. */
+        RealTime                    bandwidthWindow;
+
+        Specification() : fileFormat(Image::JPEG), tileSize(0), maxFramesInFlight(1),
+            requireAcknowledgement(true), numSenderThreads(4), bandwidthWindow(1.0) {}
+    };
+
+    /** Counters for one client. Times are in seconds. \sa getClientStats() */
+    class ClientStats {
+    public:
+        NetAddress                  clientAddress;
+
+        int                         framesSent;
+
+        /** Frames that were newer than the last one sent but never sent, because the client was busy */
+        int                         framesSkipped;
+
+        int                         framesAcknowledged;
+
+        /** Frames sent and not yet acknowledged */
+        int                         framesInFlight;
+
+        int64                       bytesSent;
+
+        /** Bytes sent over the most recent Specification::bandwidthWindow */
+        double                      bytesPerSecond;
+
+        /** Mean time from submitFrame() until the frame was written to this client's socket */
+        RealTime                    averageLatency;
+
+        RealTime                    maxLatency;
+
+        /** Mean time from starting to write a frame until the client acknowledged it */
+        RealTime                    averageRoundTrip;
+
+        ClientStats() : framesSent(0), framesSkipped(0), framesAcknowledged(0), framesInFlight(0), bytesSent(0),
+            bytesPerSecond(0), averageLatency(0), maxLatency(0), averageRoundTrip(0) {}
+    };
+
+    /** Counters for the encoder. Times are in seconds. \sa stats() */
+    class Stats {
+    public:
+        int                         framesSubmitted;
+
+        /** Frames replaced by a newer one before the encoder reached them */
+        int                         framesDropped;
+
+        int                         framesEncoded;
+
+        /** Frames identical to the previous one, which are not sent */
+        int                         framesUnchanged;
+
+        int                         tilesEncoded;
+
+        /** Tiles that were unchanged and not re-encoded */
+        int                         tilesReused;
+
+        RealTime                    averageEncodeTime;
+
+        RealTime                    maxEncodeTime;
+
+        Stats() : framesSubmitted(0), framesDropped(0), framesEncoded(0), framesUnchanged(0), tilesEncoded(0),
+            tilesReused(0), averageEncodeTime(0), maxEncodeTime(0) {}
+    };
+
+protected:
+
+    /** Encoded tile data is immutable once published, so senders share it without copying */
+    class EncodedTile {
+    public:
+        int                                 x = 0;
+        int                                 y = 0;
+        int                                 width = 0;
+        int                                 height = 0;
+
+        /** Frame in which these pixels last changed */
+        int                                 version = 0;
+
+        shared_ptr<Array<uint8>>            data;
+    };
+
+    class EncodedFrame {
+    public:
+        int                                 frame = 0;
+        int                                 width = 0;
+        int                                 height = 0;
+        RealTime                            submitTime = 0;
+        Array<EncodedTile>                  tileArray;
+    };
+
+    class InFlightFrame {
+    public:
+        int                                 frame;
+        RealTime                            sendTime;
+    };
+
+    class ClientState {
+    public:
+        shared_ptr<WebServer::WebSocket>    socket;
+
+        /** The EncodedTile::version that the client has for each tile. Empty until the first frame
+            and cleared when the frame size changes. */
+        Array<int>                          tileVersion;
+        int                                 width = 0;
+        int                                 height = 0;
+
+        int                                 lastSentFrame = 0;
+
+        /** Queued for or being processed by a sender thread */
+        bool                                scheduled = false;
+        bool                                closed = false;
+
+        Queue<InFlightFrame>                inFlight;
+
+        /** (time, bytes) of recent sends for the bandwidth estimate */
+        Queue<std::pair<RealTime, size_t>>  recentSends;
+        size_t                              recentBytes = 0;
+
+        ClientStats                         stats;
+    };
+
+    Specification                           m_specification;
+
+    /** Protects everything below except the encoder thread's m_previousPixels */
+    mutable std::mutex                      m_mutex;
+
+    /** Signaled when a frame is submitted or the threads are told to quit */
+    std::condition_variable                 m_encoderCondition;
+
+    /** Signaled when a client is scheduled or the threads are told to quit */
+    std::condition_variable                 m_senderCondition;
+
+    std::thread                             m_encoderThread;
+    Array<shared_ptr<std::thread>>          m_senderThreadArray;
+    bool                                    m_quit;
+
+    /** The newest submitted frame that the encoder has not started */
+    shared_ptr<Image>                       m_pendingImage;
+    RealTime                                m_pendingSubmitTime;
+
+    shared_ptr<EncodedFrame>                m_latestFrame;
+    int                                     m_frameCounter;
+
+    Array<shared_ptr<ClientState>>          m_clientArray;
+
+    /** Clients waiting for a sender thread */
+    Queue<shared_ptr<ClientState>>          m_readyClients;
+
+    Stats                                   m_stats;
+
+    /** Only accessed by the encoder thread */
+    shared_ptr<PixelTransferBuffer>         m_previousPixels;
+
+    WebFrameStreamer(const Specification& specification);
+
+    void encoderThreadMain();
+    void senderThreadMain();
+
+    /** Returns null if the image is identical to the previous one. Called on the encoder thread without the lock. */
+    shared_ptr<EncodedFrame> encode(const shared_ptr<Image>& image, const shared_ptr<EncodedFrame>& previous, int frame);
+
+    /** Queues the client for a sender thread if it has a newer frame to receive and room in flight. Called with m_mutex locked. */
+    void scheduleIfReady(const shared_ptr<ClientState>& client);
+
+    /** Called with m_mutex locked */
+    shared_ptr<ClientState> findClient(const shared_ptr<WebServer::WebSocket>& socket) const;
+
+    /** Called with m_mutex locked */
+    void acknowledge(ClientState& client, int frame);
+
+    const char* mimeType() const;
+
+public:
+
+    static shared_ptr<WebFrameStreamer> create(const Specification& specification = Specification());
+
+    /** Stops all threads. Queued frames are discarded. */
+    virtual ~WebFrameStreamer();
+
+    /** Queues \a image for encoding and returns immediately. The image must not be mutated afterward. */
+    void submitFrame(const shared_ptr<Image>& image);
+
+    /** True if any client is connected. Use this to avoid reading back frames that nobody will receive. */
+    bool hasClients() const;
+
+    /** Starts streaming to \a socket. Invoke from WebSocket::onReady. The next frame sent to it is complete. */
+    void addClient(const shared_ptr<WebServer::WebSocket>& socket);
+
+    /** Invoke from WebSocket::onClose. */
+    void removeClient(const shared_ptr<WebServer::WebSocket>& socket);
+
+    /** Handles acknowledgement messages. Invoke from WebSocket::onData before application processing.
+        Returns true if the message was an acknowledgement and needs no further handling. */
+    bool onClientData(const shared_ptr<WebServer::WebSocket>& socket, WebServer::WebSocket::Opcode opcode, const char* data, size_t dataLen);
+
+    /** Thread-safe snapshot of the encoder statistics */
+    Stats stats() const;
+
+    /** Thread-safe snapshot of the statistics for every connected client */
+    void getClientStats(Array<ClientStats>& clientStatsArray) const;
+
+    const Specification& specification() const {
+        return m_specification;
+    }
+};
+
+} // namespace G3D
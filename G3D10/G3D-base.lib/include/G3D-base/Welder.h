@@ -62,13 +62,17 @@ public:
      @param textureCoords Input and output
      @param normals Output only
      @param indices Input and output. This is an array of trilist indices. 
+     @param serial If true, uses the single-threaded hash grid reference implementation
+     instead of the parallel cell-sorted one. Both produce identical output: each vertex
+     welds to the first-created matching output vertex.
      */
     static void weld
     (Array<Vector3>&     vertices,
      Array<Vector2>&     textureCoords, 
      Array<Vector3>&     normals,
      Array<Array<int>*>& indices,
-     const Settings&     settings);
+     const Settings&     settings,
+     bool                serial = false);
     
     /**
      Mutates geometry, texCoord, and indexArray so that the output has collocated vertices collapsed (welded).
@@ -83,11 +87,12 @@ public:
      Array<Vector2>&     textureCoords, 
      Array<Vector3>&     normals,
      Array<int>&         indices,        
-     const Settings&     settings) {
+     const Settings&     settings,
+     bool                serial = false) {
 
         Array<Array<int>*> meta;
         meta.append(&indices);
-        weld(vertices, textureCoords, normals, meta, settings);
+        weld(vertices, textureCoords, normals, meta, settings, serial);
     }
 };
 
@@ -35,6 +35,7 @@ namespace _internal {
     class NetClientSideConnection;
     class NetServerSideConnection;
     class NetMessage;
+    class NetHost;
 }
 
 /**
@@ -47,8 +48,8 @@ namespace _internal {
 typedef uint32 NetChannel;
 
 /** 
-  Application defined message type.
-  \sa G3D::NetSendConnection::send
+  Application defined message type. 0xFFFFFFFF is reserved for packets of coalesced messages.
+  \sa G3D::NetSendConnection::send, setNetworkCoalescingThreshold
  */
 typedef uint32 NetMessageType;
 
@@ -88,18 +89,61 @@ RealTime networkCommunicationInterval();
 void serviceNetwork();
 
 /**
-  If NOT using G3D's internal threaded networking, you must invoke this periodically to service
-  the sending side network connections. Sending messages will only update
-  inside this call--all other network calls queue for processing.
-
-  If using G3D's internal threaded networking, this is automatically called continuously on
-  a separate thread.
+  Hands the messages queued by NetSendConnection::send on every connection to the network
+  immediately instead of waiting for the next serviceNetwork(), which also does this for each host
+  before checking for incoming data. Messages on all channels are sent, in order, so \a channel
+  is ignored. It is retained for compatibility with the per-channel sender threads that
+  this replaced.
 
    \sa setNetworkCommunicationInterval, G3D::G3DSpecification::threadedNetwork
 */
 void serviceNetworkSender(const G3D::NetChannel &channel);
 
 
+/**
+  Messages whose data and headers total no more than this many bytes and that were sent without a
+  MemoryManager are coalesced with other small messages to the same connection and channel. All
+  that are queued during one network service interval travel in a single packet instead of two
+  packets per message. Receivers see them as individual messages, in order. 0 disables coalescing.
+  Default is 1024.
+
+  \sa setNetworkMaxCoalescedPacketSize, networkSendStats
+*/
+void setNetworkCoalescingThreshold(size_t bytes);
+
+/** \sa setNetworkCoalescingThreshold */
+size_t networkCoalescingThreshold();
+
+/** Largest packet that coalescing produces, in bytes. Default is 16 kB.
+    \sa setNetworkCoalescingThreshold */
+void setNetworkMaxCoalescedPacketSize(size_t bytes);
+
+/** \sa setNetworkMaxCoalescedPacketSize */
+size_t networkMaxCoalescedPacketSize();
+
+
+/** Totals for messages handed to the network since startup or resetNetworkSendStats().
+    A broadcast counts once, no matter how many clients receive it. \sa networkSendStats */
+class NetworkSendStats {
+public:
+    int64               messages;
+
+    /** Messages that shared a packet with others */
+    int64               coalescedMessages;
+
+    int64               packets;
+
+    int64               bytes;
+
+    NetworkSendStats() : messages(0), coalescedMessages(0), packets(0), bytes(0) {}
+};
+
+/** Threadsafe */
+NetworkSendStats networkSendStats();
+
+void resetNetworkSendStats();
+
+
 /** Iterates through new messages on a NetConnection.
 
     Note that a DISCONNECTED NetConnection may still
@@ -242,6 +286,7 @@ public:
     friend class _internal::NetServerSideConnection;
     friend class NetConnectionIterator;
     friend void serviceNetwork();
+    friend void serviceNetworkSender(const NetChannel& channel);
 
     /** \sa connectToServer */
     enum {UNLIMITED_BANDWIDTH = 0, 
@@ -253,6 +298,9 @@ protected:
 
     _ENetHost*                                  m_enetHost;
 
+    /** Shared with the connections, which queue outgoing messages on it */
+    shared_ptr<_internal::NetHost>              m_host;
+
     // Clients hold weak pointers back to the server
     ClientTable                                 m_client;
 
@@ -261,7 +309,7 @@ protected:
     /** Contains the queue */
     NetConnectionIterator                       m_newConnectionIterator;
 
-    NetServer(_ENetHost* host);
+    NetServer(const shared_ptr<_internal::NetHost>& host);
 
     /** Service the ENetHost, checking for incoming messages and connections and depositing them
         in the appropriate queues. Invoked by NetServerSideConnection::serviceHost(), 
@@ -348,10 +396,14 @@ protected:
 
     _ENetHost*              m_enetHost;
 
+    /** Owns the outgoing message queue and the lock for enet calls on m_enetHost, which may be
+        shared with other connections */
+    shared_ptr<_internal::NetHost> m_host;
+
     /** Callbacks to be run the next time any method is invoked */
     ThreadsafeQueue<_internal::NetworkCallbackInfo> m_freeQueue;
 
-    NetSendConnection(_ENetPeer* p, _ENetHost* h) : m_enetPeer(p), m_enetHost(h) {}
+    NetSendConnection(_ENetPeer* p, const shared_ptr<_internal::NetHost>& host);
 
     /** Acutally send the packet with enet.  This allows code reuse with NetConnection, which
         has a different sending mechanism. */
@@ -385,6 +437,15 @@ public:
         occurs on either side before the message is completely
         transferred, or if this is currently disconnected.
 
+        Small messages sent without a \a memoryManager are coalesced. See setNetworkCoalescingThreshold.
+
+        This only queues the message. The network thread (or serviceNetwork(), if
+        G3DSpecification::threadedNetwork is false) hands the queue to enet the next time that it
+        services this connection's host, so a message may wait up to one
+        networkCommunicationInterval() before enet sees it. The per-channel sender threads that
+        this replaced flushed every 1/120 s regardless of that interval. Call serviceNetworkSender()
+        to hand the queued messages to enet immediately when latency matters more than coalescing.
+
         \sa networkSendBacklog
     */
     void send(NetMessageType type, const void* bytes, size_t size, NetChannel channel = 0, const shared_ptr<MemoryManager>& memoryManager = shared_ptr<MemoryManager>());
@@ -403,8 +464,11 @@ public:
     /** Includes a header.  The header should be fairly small to avoid increasing latency during the extra copies required. */
     void send(NetMessageType type, BinaryOutput& bo, BinaryOutput& header, NetChannel channel = 0);
 
+    /** Queues a message whose packets were already created, without coalescing it */
     void submitToSendQueues(const _internal::NetMessage& message);
 
+    /** Discards the messages queued on this connection that have not yet been handed to the network.
+        (Sending no longer uses per-channel threads; the name is retained for compatibility.) */
     void shutdownSenderThreads();
 
     /** Address of the other side of the connection */
@@ -483,7 +547,7 @@ protected:
 
     std::atomic_bool                m_sentRecently;
 
-    NetConnection(_ENetPeer* p, _ENetHost* h);
+    NetConnection(_ENetPeer* p, const shared_ptr<_internal::NetHost>& host);
 
     void updateLatencyEstimate();
     
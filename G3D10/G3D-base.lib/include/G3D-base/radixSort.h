@@ -0,0 +1,138 @@
+/**
+  \file G3D-base.lib/include/G3D-base/radixSort.h
+
+  G3D Innovation Engine http://casual-effects.com/g3d
+  Copyright 2000-2019, Morgan McGuire
+  All rights reserved
+  Available under the BSD License
+*/
+#pragma once
+
+#include "G3D-base/platform.h"
+#include "G3D-base/Array.h"
+#include "G3D-base/System.h"
+#include "G3D-base/Thread.h"
+
+namespace G3D {
+
+/**
+ \brief Stable least-significant-digit radix sort of \a array by the unsigned integer
+ returned by <code>key(element)</code>.
+
+ Keys are extracted once per element, then sorted eleven bits at a time, so 32-bit keys
+ take three passes. Digits on which every key agrees are skipped, so small keys stored in
+ a wide integer cost no more than narrow ones. Only the low \a keyBits bits of each key
+ are considered.
+
+ Large arrays are split into blocks that are histogrammed and scattered on separate
+ threads using runConcurrently(), so \a key must be safe to invoke concurrently. Because
+ the sort is stable, elements with equal keys retain their original relative order; this
+ makes it suitable for grouping duplicates while preserving first-occurrence order.
+
+ \code
+ // Sort edges by (i0, i1)
+ radixSort(edgeArray, [](const Edge& e) { return (uint64(e.i0) << 32) | uint64(e.i1); });
+ \endcode
+
+ \sa Array::sort
+ */
+template<class T, size_t MIN_ELEMENTS, class KeyFunction>
+void radixSort(Array<T, MIN_ELEMENTS>& array, const KeyFunction& key, int keyBits = 64) {
+    static const int RADIX_BITS = 11;
+    static const int RADIX      = 1 << RADIX_BITS;
+
+    // Elements per thread. Smaller blocks do not amortize the histogram cost.
+    static const int MIN_BLOCK_SIZE = 1 << 14;
+
+    const int n = array.size();
+    if (n < 2) {
+        return;
+    }
+
+    const int numBlocks = clamp(n / MIN_BLOCK_SIZE, 1, 64);
+    const int blockSize = (n + numBlocks - 1) / numBlocks;
+    const bool singleThread = (numBlocks == 1);
+
+    Array<uint64> keyBuffer[2];
+    Array<T, MIN_ELEMENTS> valueBuffer;
+    keyBuffer[0].resize(n);
+    keyBuffer[1].resize(n);
+    valueBuffer.resize(n);
+
+    runConcurrently(0, numBlocks, [&](int b) {
+        const int end = min(n, (b + 1) * blockSize);
+        for (int i = b * blockSize; i < end; ++i) {
+            keyBuffer[0][i] = uint64(key(array[i]));
+        }
+    }, singleThread);
+
+    T* value[2] = {array.getCArray(), valueBuffer.getCArray()};
+    int src = 0;
+
+    // count[b * RADIX + d] is the number of elements in block b with digit d,
+    // and becomes the first output position for those elements.
+    Array<int> count;
+    count.resize(numBlocks * RADIX);
+
+    for (int shift = 0; shift < min(keyBits, 64); shift += RADIX_BITS) {
+        const uint64* srcKey = keyBuffer[src].getCArray();
+        uint64*       dstKey = keyBuffer[1 - src].getCArray();
+        const T*      srcValue = value[src];
+        T*            dstValue = value[1 - src];
+
+        runConcurrently(0, numBlocks, [&](int b) {
+            int* c = count.getCArray() + b * RADIX;
+            System::memset(c, 0, sizeof(int) * RADIX);
+            const int end = min(n, (b + 1) * blockSize);
+            for (int i = b * blockSize; i < end; ++i) {
+                ++c[(srcKey[i] >> shift) & (RADIX - 1)];
+            }
+        }, singleThread);
+
+        // Convert counts to output offsets, ordered by digit and then by block
+        int total = 0;
+        bool trivial = false;
+        for (int d = 0; d < RADIX; ++d) {
+            const int start = total;
+            for (int b = 0; b < numBlocks; ++b) {
+                int& c = count[b * RADIX + d];
+                const int k = c;
+                c = total;
+                total += k;
+            }
+            if (total - start == n) {
+                // Every key has this digit
+                trivial = true;
+                break;
+            }
+        }
+
+        if (trivial) {
+            continue;
+        }
+
+        runConcurrently(0, numBlocks, [&](int b) {
+            int* offset = count.getCArray() + b * RADIX;
+            const int end = min(n, (b + 1) * blockSize);
+            for (int i = b * blockSize; i < end; ++i) {
+                const int j = offset[(srcKey[i] >> shift) & (RADIX - 1)]++;
+                dstKey[j]   = srcKey[i];
+                dstValue[j] = srcValue[i];
+            }
+        }, singleThread);
+
+        src = 1 - src;
+    }
+
+    if (src != 0) {
+        // The result is in the scratch buffer
+        runConcurrently(0, numBlocks, [&](int b) {
+            const int end = min(n, (b + 1) * blockSize);
+            for (int i = b * blockSize; i < end; ++i) {
+                array[i] = valueBuffer[i];
+            }
+        }, singleThread);
+    }
+}
+
+} // namespace G3D
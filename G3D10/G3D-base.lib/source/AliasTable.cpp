@@ -0,0 +1,75 @@
+/**
+  \file G3D-base.lib/source/AliasTable.cpp
+
+  G3D Innovation Engine http://casual-effects.com/g3d
+  Copyright 2000-2019, Morgan McGuire
+  All rights reserved
+  Available under the BSD License
+*/
+#include "G3D-base/AliasTable.h"
+
+namespace G3D {
+
+AliasTable::AliasTable(const Array<float>& weight) {
+    const int n = weight.size();
+    m_threshold.resize(n);
+    m_alias.resize(n);
+    m_pmf.resize(n);
+
+    m_totalWeight = 0.0;
+    for (const float w : weight) {
+        debugAssertM(w >= 0.0f, "AliasTable weights must be non-negative");
+        m_totalWeight += double(w);
+    }
+
+    if (n == 0) {
+        return;
+    }
+
+    // Probabilities scaled so that the average bin holds exactly 1
+    Array<double> scaled;
+    scaled.resize(n);
+    for (int i = 0; i < n; ++i) {
+        m_pmf[i] = (m_totalWeight > 0.0) ? float(double(weight[i]) / m_totalWeight) : 1.0f / float(n);
+        scaled[i] = (m_totalWeight > 0.0) ? double(weight[i]) * double(n) / m_totalWeight : 1.0;
+    }
+
+    // Worklists never shrink, which avoids reallocating as they drain
+    Array<int> small, large;
+    small.reserve(n);
+    large.reserve(n);
+    for (int i = 0; i < n; ++i) {
+        if (scaled[i] < 1.0) {
+            small.append(i);
+        } else {
+            large.append(i);
+        }
+    }
+
+    // Fill each underfull bin from an overfull one
+    while ((small.size() > 0) && (large.size() > 0)) {
+        const int s = small.pop(false);
+        const int l = large.last();
+
+        m_threshold[s] = float(scaled[s]);
+        m_alias[s]     = l;
+
+        scaled[l] -= 1.0 - scaled[s];
+        if (scaled[l] < 1.0) {
+            large.popDiscard();
+            small.append(l);
+        }
+    }
+
+    // Whatever remains is full up to roundoff
+    for (const int i : large) {
+        m_threshold[i] = 1.0f;
+        m_alias[i]     = i;
+    }
+    for (const int i : small) {
+        m_threshold[i] = 1.0f;
+        m_alias[i]     = i;
+    }
+}
+
+} // namespace G3D
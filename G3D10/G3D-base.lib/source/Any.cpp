@@ -32,21 +32,6 @@ static bool isContainerType(Any::Type& t) {
     return (t == Any::ARRAY) || (t == Any::TABLE) || (t == Any::EMPTY_CONTAINER);
 }
 
-void Any::serialize(BinaryOutput& b) const {
-    TextOutput::Settings s;
-    s.wordWrap = TextOutput::Settings::WRAP_NONE;
-    b.writeInt32(1);
-    b.writeString32(unparse(s));
-}
-
-
-void Any::deserialize(BinaryInput& b) {
-    const int version = b.readInt32();
-    alwaysAssertM(version == 1, "Wrong Any serialization version");
-    _parse(b.readString32());
-}
-
-
 String Any::resolveStringAsFilename(bool errorIfNotFound) const {
     verifyType(STRING);
     if ((string().length() > 0) && (string()[0] == '<') && (string()[string().length() - 1] == '>')) {
@@ -881,6 +866,12 @@ bool Any::operator!=(const Any& x) const {
 }
 
 
+/** If true, load() and parse() use the TextInput-based deserialize(TextInput&) instead of
+    the faster Any::Parser. The two accept the same language, so this is only
+    useful for isolating parser bugs. */
+static const bool useTextInputParser = false;
+
+
 static void getDeserializeSettings(TextInput::Settings& settings) {
     settings.cppBlockComments = true;
     settings.cppLineComments = true;
@@ -917,21 +908,48 @@ Any Any::parse(const String& src) {
 
 void Any::_parse(const String& src) {
     beforeRead();
-    TextInput::Settings settings;
-    getDeserializeSettings(settings);
+    if (useTextInputParser) {
+        TextInput::Settings settings;
+        getDeserializeSettings(settings);
 
-    TextInput ti(TextInput::FROM_STRING, src, settings);
-    deserialize(ti);
+        TextInput ti(TextInput::FROM_STRING, src, settings);
+        deserialize(ti);
+    } else {
+        // Name the source the way that TextInput does
+        const int len = int(src.size());
+        const String& sourceName = (len < 14) ?
+            format("\"%.*s\"", len, src.c_str()) :
+            format("\"%.*s...\"", 10, src.c_str());
+        parseText(src.c_str(), src.size(), sourceName);
+    }
 }
 
 
 void Any::load(const String& filename) {
     beforeRead();
-    TextInput::Settings settings;
-    getDeserializeSettings(settings);
+    const String& resolved = FileSystem::resolve(filename);
+
+    if (useTextInputParser) {
+        TextInput::Settings settings;
+        getDeserializeSettings(settings);
+
+        TextInput ti(resolved, settings);
+        deserialize(ti);
+        return;
+    }
+
+    alwaysAssertM(FileSystem::exists(resolved), String("File does not exist: ") + resolved);
+    BinaryInput b(resolved, G3D_LITTLE_ENDIAN);
+    const char* data = (const char*)b.getCArray();
+    const size_t length = size_t(b.size());
 
-    TextInput ti(FileSystem::resolve(filename), settings);
-    deserialize(ti);
+    if ((length >= sizeof(BINARY_MAGIC)) && (memcmp(data, BINARY_MAGIC, sizeof(BINARY_MAGIC)) == 0)) {
+        // Written by saveBinary()
+        b.skip(sizeof(BINARY_MAGIC));
+        deserialize(b);
+    } else {
+        parseText(data, length, resolved);
+    }
 }
 
 
@@ -0,0 +1,374 @@
+/**
+  \file G3D-base.lib/source/Any_binary.cpp
+
+  Compact binary serialization for Any.
+
+  G3D Innovation Engine http://casual-effects.com/g3d
+  Copyright 2000-2019, Morgan McGuire
+  All rights reserved
+  Available under the BSD License
+*/
+#include "G3D-base/Any.h"
+#include "G3D-base/BinaryOutput.h"
+#include "G3D-base/BinaryInput.h"
+
+namespace G3D {
+
+const char Any::BINARY_MAGIC[8] = {'\0', 'G', '3', 'D', 'A', 'n', 'y', 'B'};
+
+/**
+ Version 2 of the Any binary encoding:
+
+ <pre>
+   int32           version (= 2)
+   varuint         number of strings
+   { varuint length, bytes }*    string table
+   node            root
+ </pre>
+
+ where each node is
+
+ <pre>
+   uint8           Any::Type
+   uint8           flags (see below)
+   [varuint        source filename, line, character]        if HAS_DATA
+   [varuint        name]                                    if HAS_NAME
+   [varuint        comment]                                 if HAS_COMMENT
+   [varuint        include line]                            if HAS_INCLUDE
+   value:
+     BOOLEAN       uint8
+     NUMBER        float64
+     STRING        varuint
+     ARRAY         varuint count, node*
+     TABLE         varuint count, {varuint key, node}*
+ </pre>
+
+ All strings are indices into the string table, which holds each distinct string once.
+ Integers are stored as little-endian base-128 varints because most of them (line numbers,
+ string indices, and element counts) are small.
+ */
+class Any::BinaryCodec {
+private:
+
+    enum {
+        VERSION = 2,
+
+        HAS_DATA     = 1,
+        HAS_NAME     = 2,
+        HAS_COMMENT  = 4,
+        HAS_INCLUDE  = 8,
+        HEX_INTEGER  = 16,
+
+        /** Two bits: 0 = none, 1 = PAREN, 2 = BRACKET, 3 = BRACE */
+        BRACKET_SHIFT = 5,
+        BRACKET_MASK  = 3 << BRACKET_SHIFT,
+
+        SEMICOLON_SEPARATOR = 128
+    };
+
+    static void writeVarUInt(BinaryOutput& b, uint64 x) {
+        while (x >= 0x80) {
+            b.writeUInt8(uint8(x & 0x7F) | 0x80);
+            x >>= 7;
+        }
+        b.writeUInt8(uint8(x));
+    }
+
+    static uint64 readVarUInt(BinaryInput& b) {
+        uint64 x = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            const uint8 byte = b.readUInt8();
+            x |= uint64(byte & 0x7F) << shift;
+            if ((byte & 0x80) == 0) {
+                break;
+            }
+        }
+        return x;
+    }
+
+    static int bracketCode(const char* bracket) {
+        if (bracket == PAREN) {
+            return 1;
+        } else if (bracket == BRACKET) {
+            return 2;
+        } else if (bracket == BRACE) {
+            return 3;
+        } else {
+            return 0;
+        }
+    }
+
+    class Writer {
+    public:
+        Table<String, int>  index;
+        Array<const String*> strings;
+
+        int intern(const String& s) {
+            bool created = false;
+            int& i = index.getCreate(s, created);
+            if (created) {
+                i = strings.size();
+                strings.append(&s);
+            }
+            return i;
+        }
+
+        /** First pass: build the string table in the order that writeNode() will reference it */
+        void collect(const Any& a) {
+            const Data* d = a.m_data;
+            if (d == nullptr) {
+                return;
+            }
+
+            intern(d->source.filename);
+            if (! d->name.empty())        { intern(d->name); }
+            if (! d->comment.empty())     { intern(d->comment); }
+            if (! d->includeLine.empty()) { intern(d->includeLine); }
+
+            switch (a.m_type) {
+            case STRING:
+                intern(*d->value.s);
+                break;
+
+            case ARRAY:
+                for (const Any& element : *d->value.a) {
+                    collect(element);
+                }
+                break;
+
+            case TABLE:
+                for (AnyTable::Iterator it = d->value.t->begin(); it.isValid(); ++it) {
+                    intern(it->key);
+                    collect(it->value);
+                }
+                break;
+
+            default:;
+            }
+        }
+
+        void writeNode(const Any& a, BinaryOutput& b) const {
+            const Data* d = a.m_data;
+
+            uint8 flags = 0;
+            if (d != nullptr) {
+                flags |= HAS_DATA;
+                if (! d->name.empty())        { flags |= HAS_NAME; }
+                if (! d->comment.empty())     { flags |= HAS_COMMENT; }
+                if (! d->includeLine.empty()) { flags |= HAS_INCLUDE; }
+                if (d->hexInteger)            { flags |= HEX_INTEGER; }
+                flags |= bracketCode(d->bracket) << BRACKET_SHIFT;
+                if (d->separator == ';')      { flags |= SEMICOLON_SEPARATOR; }
+            }
+
+            b.writeUInt8(uint8(a.m_type));
+            b.writeUInt8(flags);
+
+            if (d != nullptr) {
+                writeVarUInt(b, index[d->source.filename]);
+                writeVarUInt(b, uint64(max(d->source.line, 0)));
+                writeVarUInt(b, uint64(max(d->source.character, 0)));
+                if (flags & HAS_NAME)    { writeVarUInt(b, index[d->name]); }
+                if (flags & HAS_COMMENT) { writeVarUInt(b, index[d->comment]); }
+                if (flags & HAS_INCLUDE) { writeVarUInt(b, index[d->includeLine]); }
+            }
+
+            switch (a.m_type) {
+            case BOOLEAN:
+                b.writeUInt8(a.m_simpleValue.b ? 1 : 0);
+                break;
+
+            case NUMBER:
+                b.writeFloat64(a.m_simpleValue.n);
+                break;
+
+            case STRING:
+                writeVarUInt(b, index[*d->value.s]);
+                break;
+
+            case ARRAY:
+                writeVarUInt(b, d->value.a->size());
+                for (const Any& element : *d->value.a) {
+                    writeNode(element, b);
+                }
+                break;
+
+            case TABLE:
+                writeVarUInt(b, d->value.t->size());
+                for (AnyTable::Iterator it = d->value.t->begin(); it.isValid(); ++it) {
+                    writeVarUInt(b, index[it->key]);
+                    writeNode(it->value, b);
+                }
+                break;
+
+            default:;
+            }
+        }
+    };
+
+
+    class Reader {
+    public:
+        BinaryInput&        b;
+        Array<String>       strings;
+
+        Reader(BinaryInput& b) : b(b) {}
+
+        void readStringTable() {
+            const uint64 n = readVarUInt(b);
+            strings.resize(int(n));
+            Array<char> scratch;
+            for (int i = 0; i < strings.size(); ++i) {
+                const uint64 length = readVarUInt(b);
+                // Read through a scratch buffer instead of readString() so that
+                // strings may contain embedded '\0' characters.
+                scratch.resize(int(length), false);
+                b.readBytes(scratch.getCArray(), length);
+                strings[i].assign(scratch.getCArray(), size_t(length));
+            }
+        }
+
+        const String& string() {
+            const uint64 i = readVarUInt(b);
+            alwaysAssertM(i < uint64(strings.size()), "Corrupt binary Any: string index out of range");
+            return strings[int(i)];
+        }
+
+        void readNode(Any& a) {
+            a.dropReference();
+            a.m_simpleValue.b = false;
+
+            const uint8 type  = b.readUInt8();
+            const uint8 flags = b.readUInt8();
+            alwaysAssertM(type <= EMPTY_CONTAINER, "Corrupt binary Any: illegal type");
+            a.m_type = Type(type);
+
+            if (flags & HAS_DATA) {
+                a.ensureData();
+                Data* d = a.m_data;
+                d->source.filename  = string();
+                d->source.line      = int(readVarUInt(b));
+                d->source.character = int(readVarUInt(b));
+                if (flags & HAS_NAME)    { d->name        = string(); }
+                if (flags & HAS_COMMENT) { d->comment     = string(); }
+                if (flags & HAS_INCLUDE) { d->includeLine = string(); }
+                d->hexInteger = (flags & HEX_INTEGER) != 0;
+
+                switch ((flags & BRACKET_MASK) >> BRACKET_SHIFT) {
+                case 1: d->bracket = PAREN;   break;
+                case 2: d->bracket = BRACKET; break;
+                case 3: d->bracket = BRACE;   break;
+                default:;
+                }
+
+                if (isContainer(a.m_type)) {
+                    d->separator = (flags & SEMICOLON_SEPARATOR) ? ';' : ',';
+                }
+            }
+
+            switch (a.m_type) {
+            case BOOLEAN:
+                a.m_simpleValue.b = (b.readUInt8() != 0);
+                break;
+
+            case NUMBER:
+                a.m_simpleValue.n = b.readFloat64();
+                break;
+
+            case STRING:
+                alwaysAssertM(a.m_data != nullptr, "Corrupt binary Any: STRING without data");
+                *(a.m_data->value.s) = string();
+                break;
+
+            case ARRAY:
+                {
+                    alwaysAssertM(a.m_data != nullptr, "Corrupt binary Any: ARRAY without data");
+                    Array<Any>& array = *a.m_data->value.a;
+                    array.resize(int(readVarUInt(b)));
+                    for (int i = 0; i < array.size(); ++i) {
+                        readNode(array[i]);
+                    }
+                }
+                break;
+
+            case TABLE:
+                {
+                    alwaysAssertM(a.m_data != nullptr, "Corrupt binary Any: TABLE without data");
+                    AnyTable& table = *a.m_data->value.t;
+                    const uint64 n = readVarUInt(b);
+                    for (uint64 i = 0; i < n; ++i) {
+                        const String& key = string();
+                        readNode(table.getCreate(key));
+                    }
+                }
+                break;
+
+            default:;
+            }
+        }
+    };
+
+    static bool isContainer(Type t) {
+        return (t == ARRAY) || (t == TABLE) || (t == EMPTY_CONTAINER);
+    }
+
+public:
+
+    static void write(const Any& a, BinaryOutput& b) {
+        Writer writer;
+        writer.collect(a);
+
+        b.writeInt32(VERSION);
+        writeVarUInt(b, writer.strings.size());
+        for (const String* s : writer.strings) {
+            writeVarUInt(b, s->size());
+            b.writeBytes(s->c_str(), s->size());
+        }
+
+        writer.writeNode(a, b);
+    }
+
+    /** Returns false if the version number is not one that this codec reads, in which
+        case nothing after the version number has been consumed. */
+    static bool read(Any& a, BinaryInput& b, int version) {
+        if (version != VERSION) {
+            return false;
+        }
+
+        Reader reader(b);
+        reader.readStringTable();
+        reader.readNode(a);
+        return true;
+    }
+};
+
+
+void Any::serialize(BinaryOutput& b) const {
+    beforeRead();
+    BinaryCodec::write(*this, b);
+}
+
+
+void Any::deserialize(BinaryInput& b) {
+    beforeRead();
+    const int version = b.readInt32();
+    if (version == 1) {
+        // Text wrapped in a binary stream, written by older versions
+        _parse(b.readString32());
+    } else {
+        const bool ok = BinaryCodec::read(*this, b, version);
+        alwaysAssertM(ok, "Wrong Any serialization version");
+        (void)ok;
+    }
+}
+
+
+void Any::saveBinary(const String& filename) const {
+    beforeRead();
+    BinaryOutput b(filename, G3D_LITTLE_ENDIAN);
+    b.writeBytes(BINARY_MAGIC, sizeof(BINARY_MAGIC));
+    serialize(b);
+    b.commit();
+}
+
+} // namespace G3D
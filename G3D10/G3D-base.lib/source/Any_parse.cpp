@@ -0,0 +1,924 @@
+/**
+  \file G3D-base.lib/source/Any_parse.cpp
+
+  Single-pass parser for the Any text format.
+
+  G3D Innovation Engine http://casual-effects.com/g3d
+  Copyright 2000-2019, Morgan McGuire
+  All rights reserved
+  Available under the BSD License
+*/
+#include "G3D-base/Any.h"
+#include "G3D-base/TextInput.h"
+#include "G3D-base/stringutils.h"
+#include "G3D-base/FileSystem.h"
+#include "G3D-base/System.h"
+#include <cstdlib>
+
+namespace G3D {
+
+/**
+ Reads the Any text format directly out of a byte buffer.
+
+ This accepts the same language as Any::deserialize(TextInput&) configured
+ by getDeserializeSettings() in Any.cpp (C++ comments, double-quoted strings, case-insensitive
+ booleans, MSVC float specials), and records the same comments, names, separators,
+ and source locations. It differs from the TextInput path only in speed: tokens
+ reference the buffer instead of allocating a String apiece, there is no token
+ push-back stack, and lookahead re-lexes from a saved Position instead
+ of buffering Token copies.
+ */
+class Any::Parser {
+private:
+
+    class Token {
+    public:
+        enum Type {END, SYMBOL, NUMBER, BOOLEAN, STRING, COMMENT};
+
+        Type            type;
+
+        /** Raw source text for SYMBOL, NUMBER, and BOOLEAN */
+        const char*     begin;
+        int             length;
+
+        /** Decoded contents of STRING and COMMENT, and the TextInput spelling of MSVC float specials */
+        String          text;
+
+        int             line;
+        int             character;
+
+        bool            boolean;
+
+        /** NUMBER was written as 0x... */
+        bool            hex;
+
+        /** NUMBER is an MSVC float special such as 1.#INF; the value is parsed from text */
+        bool            special;
+
+        Token() : type(END), begin(""), length(0), line(0), character(0), boolean(false), hex(false), special(false) {}
+
+        bool isSymbol(char c) const {
+            return (type == SYMBOL) && (length == 1) && (begin[0] == c);
+        }
+
+        bool isSymbol(const char* s, int n) const {
+            return (type == SYMBOL) && (length == n) && (memcmp(begin, s, n) == 0);
+        }
+
+        /** The first character of the string that TextInput would have produced for this token, or '\0'. */
+        char first() const {
+            switch (type) {
+            case STRING:
+            case COMMENT:
+                return text.empty() ? '\0' : text[0];
+
+            case END:
+                return '\0';
+
+            default:
+                return begin[0];
+            }
+        }
+
+        String string() const {
+            switch (type) {
+            case STRING:
+            case COMMENT:
+                return text;
+
+            case END:
+                return String();
+
+            default:
+                return String(begin, length);
+            }
+        }
+    };
+
+    /** Lexer state. Saved and restored for lookahead. */
+    class Position {
+    public:
+        const char*     next;
+        const char*     lineStart;
+        int             line;
+    };
+
+    const char* const   m_end;
+    const String&       m_filename;
+    Position            m_pos;
+
+    /** The current token */
+    Token               m_token;
+
+    static bool isOpen(const char c) {
+        return c == '(' || c == '[' || c == '{';
+    }
+
+    static bool isClose(const char c) {
+        return c == ')' || c == ']' || c == '}';
+    }
+
+    static bool isSeparator(const char c) {
+        return c == ',' || c == ';';
+    }
+
+    static bool isIdentifierChar(const char c) {
+        return isLetter(c) || isDigitFast(c) || (c == '_');
+    }
+
+    static bool isHexDigit(const char c) {
+        return isDigitFast(c) || ((c >= 'A') && (c <= 'F')) || ((c >= 'a') && (c <= 'f'));
+    }
+
+    /** Case-insensitive comparison against an upper-case literal */
+    static bool equalsUpper(const char* s, int n, const char* upper) {
+        for (int i = 0; i < n; ++i) {
+            if ((upper[i] == '\0') || (toupper((unsigned char)s[i]) != upper[i])) {
+                return false;
+            }
+        }
+        return upper[n] == '\0';
+    }
+
+    ParseError error(const Token& t, const String& message) const {
+        return ParseError(m_filename, t.line, t.character, message);
+    }
+
+    int peekChar(int distance = 0) const {
+        return (m_pos.next + distance < m_end) ? (unsigned char)m_pos.next[distance] : EOF;
+    }
+
+    /** Consumes one character, treating \r\n as a single character, and returns it. */
+    int eatChar() {
+        if (m_pos.next >= m_end) {
+            return EOF;
+        }
+        unsigned char c = *m_pos.next;
+        ++m_pos.next;
+        if (c == '\r') {
+            if ((m_pos.next < m_end) && (*m_pos.next == '\n')) {
+                c = '\n';
+                ++m_pos.next;
+            }
+            ++m_pos.line;
+            m_pos.lineStart = m_pos.next;
+        } else if (c == '\n') {
+            ++m_pos.line;
+            m_pos.lineStart = m_pos.next;
+        }
+        return c;
+    }
+
+    void setSymbol(Token& t, const char* begin, int length) {
+        t.type   = Token::SYMBOL;
+        t.begin  = begin;
+        t.length = length;
+        m_pos.next = begin + length;
+    }
+
+    /** Extends the symbol in \a t by one character if the next character is \a c */
+    void extendSymbolIf(Token& t, char c) {
+        if (peekChar() == c) {
+            ++t.length;
+            ++m_pos.next;
+        }
+    }
+
+    void lexNumber(Token& t, const char* begin);
+    void lexString(Token& t);
+    void lexBlockComment(Token& t, bool keepText);
+
+    /** Reads the next token into \a t. Comment text is only decoded when \a keepText is true. */
+    void lex(Token& t, bool keepText = true);
+
+    /** Advances m_token to the next token, including comments */
+    void read() {
+        lex(m_token);
+    }
+
+    /** Advances m_token to the next non-comment token */
+    void readSignificant() {
+        do {
+            lex(m_token, false);
+        } while (m_token.type == Token::COMMENT);
+    }
+
+    /** Returns the token after m_token without consuming it */
+    void peek(Token& t) {
+        const Position saved = m_pos;
+        lex(t);
+        m_pos = saved;
+    }
+
+    void setSource(Any& a, const Token& t) const {
+        Source& source   = a.m_data->source;
+        source.filename  = m_filename;
+        source.line      = t.line;
+        source.character = t.character;
+    }
+
+    double number(const Token& t) const;
+
+    /** Called with m_token at the open bracket. Does not change the current position. */
+    Any::Type findType(char closeSymbol);
+
+    void readComment(String& comment);
+    void readName(String& name);
+    void readInclude(Any& a, const String& comment);
+    void readUntilSeparatorOrClose();
+    void readBody(Any& a);
+
+    /** Reads the value beginning at m_token, leaving m_token at the following token */
+    void readValue(Any& a);
+
+public:
+
+    /** \param filename Reported in ParseErrors and Any::source(). Must outlive the Parser. */
+    Parser(const char* data, size_t length, const String& filename) : m_end(data + length), m_filename(filename) {
+        m_pos.next      = data;
+        m_pos.lineStart = data;
+        m_pos.line      = 1;
+    }
+
+    /** Reads the first Any from the buffer into \a a. As with Any::deserialize(TextInput&),
+        anything after it is ignored. */
+    void parse(Any& a) {
+        read();
+        readValue(a);
+    }
+};
+
+
+void Any::Parser::lex(Token& t, bool keepText) {
+    t.type    = Token::END;
+    t.hex     = false;
+    t.special = false;
+
+    while ((m_pos.next < m_end) && isWhitespace(*m_pos.next)) {
+        eatChar();
+    }
+
+    t.line      = m_pos.line;
+    t.character = int(m_pos.next - m_pos.lineStart) + 1;
+    t.begin     = m_pos.next;
+    t.length    = 0;
+
+    if (m_pos.next >= m_end) {
+        return;
+    }
+
+    const char* p = m_pos.next;
+    const char c  = p[0];
+    const int  c2 = peekChar(1);
+
+    if (isDigitFast(c)) {
+        lexNumber(t, p);
+        return;
+    }
+
+    if ((c == '/') && (c2 == '/')) {
+        const char* start = p + 2;
+        const char* stop  = start;
+        while ((stop < m_end) && ! isNewline(*stop)) {
+            ++stop;
+        }
+        m_pos.next = stop;
+        t.type = Token::COMMENT;
+        if (keepText) {
+            t.text.assign(start, stop - start);
+        }
+        return;
+    }
+
+    if ((c == '/') && (c2 == '*')) {
+        lexBlockComment(t, keepText);
+        return;
+    }
+
+    switch (c) {
+    case '@':
+    case '(':
+    case ')':
+    case ',':
+    case ';':
+    case '{':
+    case '}':
+    case '[':
+    case ']':
+    case '#':
+    case '$':
+    case '?':
+    case '%':
+    case '\\':
+    case '\'':
+        setSymbol(t, p, 1);
+        return;
+
+    case '-':
+    case '+':
+        if ((c2 == c) || (c2 == '=') || ((c == '-') && (c2 == '>'))) {
+            // --, -=, ->, ++, +=
+            setSymbol(t, p, 2);
+        } else if (isDigitFast(char(c2)) || ((c2 == '.') && isDigitFast(char(peekChar(2))))) {
+            lexNumber(t, p);
+        } else if ((c2 == 'i') && (peekChar(2) == 'n') && (peekChar(3) == 'f') &&
+                   ! isLetter(char(peekChar(4))) && (peekChar(4) != '_')) {
+            // +inf, -inf
+            setSymbol(t, p, 4);
+            t.type = Token::NUMBER;
+        } else {
+            setSymbol(t, p, 1);
+        }
+        return;
+
+    case ':':
+    case '=':
+        // ::, ==
+        setSymbol(t, p, 1);
+        extendSymbolIf(t, c);
+        return;
+
+    case '*':
+    case '/':
+    case '!':
+    case '~':
+    case '^':
+        setSymbol(t, p, 1);
+        extendSymbolIf(t, '=');
+        return;
+
+    case '>':
+    case '<':
+    case '|':
+    case '&':
+        setSymbol(t, p, 1);
+        if ((c2 == '=') || (c2 == c)) {
+            extendSymbolIf(t, char(c2));
+        }
+        return;
+
+    case '.':
+        if (isDigitFast(char(c2))) {
+            lexNumber(t, p);
+        } else {
+            // ., .., ...
+            setSymbol(t, p, 1);
+            if (c2 == '.') {
+                extendSymbolIf(t, '.');
+                extendSymbolIf(t, '.');
+            }
+        }
+        return;
+
+    case '\"':
+        lexString(t);
+        return;
+
+    case '\0':
+        return;
+
+    default:
+        break;
+    }
+
+    if (isLetter(c) || (c == '_')) {
+        const char* stop = p + 1;
+        while ((stop < m_end) && isIdentifierChar(*stop)) {
+            ++stop;
+        }
+        const int n = int(stop - p);
+        setSymbol(t, p, n);
+
+        if (equalsUpper(p, n, "TRUE")) {
+            t.type = Token::BOOLEAN;
+            t.boolean = true;
+        } else if (equalsUpper(p, n, "FALSE")) {
+            t.type = Token::BOOLEAN;
+            t.boolean = false;
+        } else if ((n == 3) && ((memcmp(p, "nan", 3) == 0) || (memcmp(p, "inf", 3) == 0))) {
+            t.type = Token::NUMBER;
+        }
+        return;
+    }
+
+    if ((unsigned char)c > 127) {
+        // Extended ASCII parses as itself
+        setSymbol(t, p, 1);
+        return;
+    }
+
+    throw error(t, format("Unrecognized token type beginning with character '%c' (ASCII %d)", c, c));
+}
+
+
+void Any::Parser::lexNumber(Token& t, const char* begin) {
+    t.type  = Token::NUMBER;
+    t.begin = begin;
+
+    const char* p = begin;
+    if ((*p == '-') || (*p == '+')) {
+        ++p;
+    }
+
+    bool isFloat = false;
+
+    if ((p[0] == '0') && (p + 1 < m_end) && (p[1] == 'x')) {
+        t.hex = true;
+        p += 2;
+        while ((p < m_end) && isHexDigit(*p)) {
+            ++p;
+        }
+    } else {
+        while ((p < m_end) && isDigitFast(*p)) {
+            ++p;
+        }
+
+        if ((p < m_end) && (*p == '.')) {
+            isFloat = true;
+            ++p;
+            if ((p < m_end) && (*p == '#')) {
+                // MSVC float special: 1.#INF, 1.#IND, 1.#INF00, 1.#QNAN. Spelled as TextInput
+                // would spell it so that TextInput::parseNumber can interpret it.
+                t.special = true;
+                const char* s = (*begin == '+') ? begin + 1 : begin;
+                t.text.assign(s, p - s);
+                ++p;
+                const char test = (p < m_end) ? char(toupper((unsigned char)*p)) : '\0';
+                bool ok = false;
+                if ((test == 'I') && (p + 2 < m_end) && (toupper((unsigned char)p[1]) == 'N') &&
+                    ((toupper((unsigned char)p[2]) == 'F') || (toupper((unsigned char)p[2]) == 'D'))) {
+                    t.text += "#IN";
+                    t.text += p[2];
+                    p += 3;
+                    for (int j = 0; (j < 2) && (p + 1 < m_end) && (p[0] == '0') && (p[1] == '0'); ++j) {
+                        t.text += "00";
+                        p += 2;
+                    }
+                    ok = true;
+                } else if ((test == 'Q') && (p + 3 < m_end) && equalsUpper(p + 1, 3, "NAN")) {
+                    t.text += "#QNAN";
+                    p += 4;
+                    ok = true;
+                }
+
+                if (! ok) {
+                    throw ParseError(m_filename, t.line, int(p - m_pos.lineStart) + 1,
+                                     "Incorrect floating-point special (inf or nan) format.");
+                }
+            } else {
+                while ((p < m_end) && isDigitFast(*p)) {
+                    ++p;
+                }
+            }
+        }
+
+        if (! t.special && (p < m_end) && ((*p == 'e') || (*p == 'E'))) {
+            isFloat = true;
+            ++p;
+            if ((p < m_end) && ((*p == '-') || (*p == '+'))) {
+                ++p;
+            }
+            while ((p < m_end) && isDigitFast(*p)) {
+                ++p;
+            }
+        }
+
+        if (! t.special && isFloat && (p < m_end) && (*p == 'f')) {
+            ++p;
+        }
+    }
+
+    t.length = int(p - begin);
+    m_pos.next = p;
+}
+
+
+void Any::Parser::lexString(Token& t) {
+    t.type = Token::STRING;
+    t.text.clear();
+
+    // Skip the open quote
+    ++m_pos.next;
+
+    while (m_pos.next < m_end) {
+        // Copy the run of ordinary characters in one step
+        const char* run = m_pos.next;
+        while ((run < m_end) && (*run != '\"') && (*run != '\\') && ! isNewline(*run)) {
+            ++run;
+        }
+        if (run > m_pos.next) {
+            t.text.append(m_pos.next, run - m_pos.next);
+            m_pos.next = run;
+        }
+
+        const int c = eatChar();
+        if (c == EOF) {
+            // END inside a quoted string; finish the string
+            break;
+        } else if (c == '\"') {
+            break;
+        } else if (c == '\\') {
+            switch (eatChar()) {
+            case 'r':  t.text += '\r'; break;
+            case 'n':  t.text += '\n'; break;
+            case 't':  t.text += '\t'; break;
+            case '0':  t.text += '\0'; break;
+            case '\\': t.text += '\\'; break;
+            case '\"': t.text += '\"'; break;
+            case '\'': t.text += '\''; break;
+            default:
+                // Illegal escape sequence; skip it
+                break;
+            }
+        } else {
+            // Newline. eatChar() returned \n for \r\n.
+            t.text += char(c);
+        }
+    }
+}
+
+
+void Any::Parser::lexBlockComment(Token& t, bool keepText) {
+    t.type = Token::COMMENT;
+    t.text.clear();
+
+    // Skip the /*
+    m_pos.next += 2;
+
+    while (m_pos.next < m_end) {
+        const char* run = m_pos.next;
+        while ((run < m_end) && ! isNewline(*run) &&
+               ! ((*run == '*') && (run + 1 < m_end) && (run[1] == '/'))) {
+            ++run;
+        }
+        if (keepText && (run > m_pos.next)) {
+            t.text.append(m_pos.next, run - m_pos.next);
+        }
+        m_pos.next = run;
+
+        if (m_pos.next >= m_end) {
+            break;
+        } else if (*m_pos.next == '*') {
+            // Closing */
+            m_pos.next += 2;
+            return;
+        } else {
+            // TextInput records the first character of a \r\n pair
+            if (keepText) {
+                t.text += *m_pos.next;
+            }
+            eatChar();
+        }
+    }
+}
+
+
+double Any::Parser::number(const Token& t) const {
+    if (t.special) {
+        return TextInput::parseNumber(t.text);
+    }
+
+    const char* p = t.begin;
+    int         n = t.length;
+
+    if (n == 3) {
+        if (memcmp(p, "nan", 3) == 0) {
+            return G3D::nan();
+        } else if (memcmp(p, "inf", 3) == 0) {
+            return G3D::inf();
+        }
+    } else if (n == 4) {
+        if (memcmp(p, "+inf", 4) == 0) {
+            return G3D::inf();
+        } else if (memcmp(p, "-inf", 4) == 0) {
+            return -G3D::inf();
+        }
+    }
+
+    if (*p == '+') {
+        ++p;
+        --n;
+    }
+
+    if (t.hex) {
+        if (*p == '-') {
+            return -double(strtoull(p + 3, nullptr, 16));
+        } else {
+            return double(uint32(strtoul(p + 2, nullptr, 16)));
+        }
+    }
+
+    // Numbers are short, so avoid allocating a String for strtod's terminator
+    char buffer[64];
+    if (n < int(sizeof(buffer))) {
+        System::memcpy(buffer, p, n);
+        buffer[n] = '\0';
+        return strtod(buffer, nullptr);
+    } else {
+        return strtod(String(p, n).c_str(), nullptr);
+    }
+}
+
+
+Any::Type Any::Parser::findType(const char closeSymbol) {
+    const Position saved = m_pos;
+
+    Any::Type type = Any::NIL;
+    bool hasAnElement = false;
+
+    Token token;
+    lex(token, false);
+    while (type == Any::NIL) {
+        if (token.type == Token::COMMENT) {
+            lex(token, false);
+        } else if (token.isSymbol('=') || token.isSymbol(':')) {
+            // An '=' indicates a key = value pairing, and thus a table
+            type = Any::TABLE;
+        } else if (hasAnElement) {
+            // Any non-comment, non-'=' token after any element indicates an array
+            type = Any::ARRAY;
+        } else if ((token.type == Token::SYMBOL) && (token.begin[0] == closeSymbol)) {
+            type = Any::EMPTY_CONTAINER;
+        } else {
+            hasAnElement = true;
+            lex(token, false);
+        }
+    }
+
+    m_pos = saved;
+    return type;
+}
+
+
+void Any::Parser::readComment(String& comment) {
+    if (m_token.type != Token::COMMENT) {
+        return;
+    }
+
+    while (m_token.type == Token::COMMENT) {
+        comment += trimWhitespace(m_token.text);
+        read();
+        comment += "\n";
+    }
+
+    comment = trimWhitespace(comment);
+}
+
+
+void Any::Parser::readName(String& name) {
+    debugAssert(m_token.type == Token::SYMBOL);
+    while (! isOpen(m_token.begin[0])) {
+        name.append(m_token.begin, m_token.length);
+
+        readSignificant();
+        if (m_token.type != Token::SYMBOL) {
+            throw error(m_token, "Expected symbol while parsing Any");
+        }
+    }
+}
+
+
+void Any::Parser::readInclude(Any& a, const String& comment) {
+    // Currently, "include" is the only pragma allowed
+    read();
+    const Token pragma = m_token;
+    if (! m_token.isSymbol("include", 7)) {
+        throw error(m_token, "Expected 'include' pragma after '#'");
+    }
+
+    read();
+    if (! m_token.isSymbol('(')) {
+        throw error(m_token, "Expected '(' after #include");
+    }
+
+    read();
+    if (m_token.type != Token::STRING) {
+        throw error(m_token, "Expected a quoted filename after #include(");
+    }
+    // The string typed into the file, which may be relative
+    const String includeName = m_token.text;
+
+    // Find the include file
+    const String& myPath = FilePath::parent(m_filename);
+    String t = FileSystem::resolve(includeName, myPath);
+    if (! FileSystem::exists(t)) {
+        // Try and find the path, starting with the cwd
+        t = System::findDataFile(includeName);
+    }
+
+    // Read the included file
+    a.load(t);
+
+    // Update the source information
+    a.ensureData();
+    if (! comment.empty()) {
+        a.m_data->includeLine = format("\n/* %s */\n", comment.c_str());
+    }
+    a.m_data->includeLine += format("#include(\"%s\")", includeName.c_str());
+    a.m_data->source.filename +=
+        format(" [included from %s:%d(%d)]", m_filename.c_str(), pragma.line, pragma.character);
+
+    read();
+    if (! m_token.isSymbol(')')) {
+        throw error(m_token, "Expected ')' after #include(\"...\"");
+    }
+}
+
+
+void Any::Parser::readValue(Any& a) {
+    // Deallocate old data
+    a.dropReference();
+    a.m_type = NIL;
+    a.m_simpleValue.b = false;
+
+    String comment;
+    readComment(comment);
+
+    if (m_token.type == Token::END) {
+        throw error(m_token, "File ended without a properly formed Any");
+    }
+
+    // Do we need to read one more token after the end?
+    bool needRead = true;
+
+    switch (m_token.type) {
+    case Token::STRING:
+        a.m_type = STRING;
+        a.ensureData();
+        *(a.m_data->value.s) = m_token.text;
+        setSource(a, m_token);
+        break;
+
+    case Token::NUMBER:
+        a.m_type = NUMBER;
+        a.m_simpleValue.n = number(m_token);
+        a.ensureData();
+        setSource(a, m_token);
+        a.m_data->hexInteger = m_token.hex;
+        break;
+
+    case Token::BOOLEAN:
+        a.m_type = BOOLEAN;
+        a.m_simpleValue.b = m_token.boolean;
+        a.ensureData();
+        setSource(a, m_token);
+        break;
+
+    case Token::SYMBOL:
+        // Pragma, Named Array, Named Table, Array, Table, or NIL
+        if (m_token.isSymbol('#')) {
+            readInclude(a, comment);
+        } else if (equalsUpper(m_token.begin, m_token.length, "NIL") || m_token.isSymbol("None", 4)) {
+            // Nothing left to do; we initialized to NIL originally
+            a.ensureData();
+            setSource(a, m_token);
+        } else {
+            bool unquoted = false;
+            if (isLetter(m_token.begin[0]) || (m_token.begin[0] == '_')) {
+                // An identifier is an unquoted string unless it names a container
+                Token next;
+                peek(next);
+                unquoted = ! isOpen(next.first()) && ! next.isSymbol("::", 2);
+            }
+
+            if (unquoted) {
+                a.m_type = STRING;
+                a.ensureData();
+                a.m_data->value.s->assign(m_token.begin, m_token.length);
+                setSource(a, m_token);
+            } else {
+                // Array or Table
+                String name;
+                readName(name);
+                readBody(a);
+
+                if (! name.empty()) {
+                    a.ensureData();
+                    a.m_data->name = name;
+                }
+                needRead = false;
+            }
+        }
+        break;
+
+    default:
+        throw error(m_token, "Unexpected token");
+    }
+
+    if (! comment.empty()) {
+        a.ensureData();
+        a.m_data->comment = comment;
+    }
+
+    if (needRead) {
+        // Array and table already consumed their last token
+        read();
+    }
+}
+
+
+void Any::Parser::readUntilSeparatorOrClose() {
+    while (! ((m_token.type == Token::END) ||
+              ((m_token.type == Token::SYMBOL) && isClose(m_token.begin[0])) ||
+              isSeparator(m_token.first()))) {
+        if (m_token.type == Token::COMMENT) {
+            // Discard trailing comments
+            read();
+        } else {
+            throw error(m_token, "Expected a comma or close paren");
+        }
+    }
+}
+
+
+void Any::Parser::readBody(Any& a) {
+    const char c = m_token.begin[0];
+
+    // Chose the appropriate close symbol based on the open symbol
+    const char* bracket;
+    if (c == '(') {
+        bracket = PAREN;
+    } else if (c == '[') {
+        bracket = BRACKET;
+    } else {
+        debugAssertM(c == '{', "Illegal bracket type");
+        bracket = BRACE;
+    }
+    const char closeSymbol = bracket[1];
+
+    // We must set the type before we allocate m_data in ensureData().
+    a.m_type = findType(closeSymbol);
+    a.ensureData();
+    setSource(a, m_token);
+    a.m_data->bracket = bracket;
+
+    // Consume the open token
+    read();
+
+    while (! ((m_token.type == Token::SYMBOL) && (m_token.begin[0] == closeSymbol))) {
+
+        // Read any leading comment. This must be done here (and not in readValue)
+        // in case the body contains only a comment.
+        String comment;
+        readComment(comment);
+
+        if ((m_token.type == Token::SYMBOL) && (m_token.begin[0] == closeSymbol)) {
+            break;
+        }
+
+        Any* element;
+        if (a.m_type == TABLE) {
+            // Read the key
+            if ((m_token.type != Token::SYMBOL) && (m_token.type != Token::STRING)) {
+                throw error(m_token, "Expected a name");
+            }
+            const String& key = m_token.string();
+
+            // Consume everything up to the = sign
+            readSignificant();
+            if (! (m_token.isSymbol('=') || m_token.isSymbol(':'))) {
+                throw error(m_token, "Expected = or :");
+            }
+
+            // Read the value's first token without skipping comments, which belong to the value
+            read();
+
+            // The value is parsed in place. The table is not modified again
+            // until readValue returns, so the reference remains valid.
+            element = &a.m_data->value.t->getCreate(key);
+        } else {
+            element = &a.m_data->value.a->next();
+        }
+
+        readValue(*element);
+
+        if (! comment.empty()) {
+            // Prepend the comment we read earlier
+            element->ensureData();
+            element->m_data->comment = trimWhitespace(comment + "\n" + element->m_data->comment);
+        }
+
+        // Read until the separator or close paren, discarding trailing comments
+        readUntilSeparatorOrClose();
+
+        if (m_token.type == Token::END) {
+            throw error(m_token, "Unexpected end of file");
+        }
+
+        const char s = m_token.first();
+        if (isSeparator(s)) {
+            read();
+            a.m_data->separator = s;
+        }
+    }
+
+    // Consume the close paren
+    read();
+}
+
+
+void Any::parseText(const char* data, size_t length, const String& sourceName) {
+    Parser(data, length, sourceName).parse(*this);
+}
+
+} // namespace G3D
@@ -15,7 +15,9 @@
 #include "G3D-base/FileSystem.h"
 #include "../../external/zlib.lib/include/zlib.h"
 #include "../../external/zip.lib/include/zip.h"
+#include <atomic>
 #include <cstring>
+#include <thread>
 
 namespace G3D {
 
@@ -37,6 +39,54 @@ static uint32 readUInt32FromBuffer(const uint8* data, bool swapBytes) {
 }
 
 
+/** Chunked compressed file metadata is always little-endian */
+static uint32 readLittleEndianUInt32(const uint8* data) {
+    return uint32(data[0]) | (uint32(data[1]) << 8) | (uint32(data[2]) << 16) | (uint32(data[3]) << 24);
+}
+
+
+static uint64 readLittleEndianUInt64(const uint8* data) {
+    return uint64(readLittleEndianUInt32(data)) | (uint64(readLittleEndianUInt32(data + 4)) << 32);
+}
+
+
+static void seekFile(FILE* file, int64 position) {
+#   ifdef G3D_WINDOWS
+        const int ret = _fseeki64(file, position, SEEK_SET);
+#   else
+        const int ret = fseeko(file, (off_t)position, SEEK_SET);
+#   endif
+    debugAssert(ret == 0); (void)ret;
+}
+
+
+static int defaultReadAheadBlocks() {
+    return max(2, int(std::thread::hardware_concurrency()));
+}
+
+
+/** Validates the header and footer of a chunked compressed file of \a length bytes */
+static bool parseChunkedHeaderAndFooter(const uint8* header, const uint8* footer, int64 length, int64& blockLength, int64& uncompressedLength, int& numBlocks) {
+    if ((length < BinaryInput::CHUNKED_HEADER_SIZE + BinaryInput::CHUNKED_FOOTER_SIZE) ||
+        (readLittleEndianUInt32(header) != BinaryInput::CHUNKED_MAGIC) ||
+        (readLittleEndianUInt32(footer + 12) != BinaryInput::CHUNKED_MAGIC)) {
+        return false;
+    }
+
+    alwaysAssertM(readLittleEndianUInt32(header + 4) == BinaryInput::CHUNKED_VERSION, "Unsupported chunked compressed file version");
+    blockLength        = readLittleEndianUInt32(header + 8);
+    uncompressedLength = int64(readLittleEndianUInt64(footer));
+    numBlocks          = int(readLittleEndianUInt32(footer + 8));
+
+    const int64 indexLength = int64(numBlocks) * BinaryInput::CHUNKED_INDEX_ENTRY_SIZE;
+    alwaysAssertM((blockLength > 0) &&
+                  (numBlocks == (uncompressedLength + blockLength - 1) / blockLength) &&
+                  (indexLength <= length - BinaryInput::CHUNKED_HEADER_SIZE - BinaryInput::CHUNKED_FOOTER_SIZE),
+                  "Chunked compressed file index is corrupted");
+    return true;
+}
+
+
 BinaryInput::BinaryInput(
     const uint8*        data,
     int64               dataLen,
@@ -49,13 +99,18 @@ BinaryInput::BinaryInput(
     m_beginEndBits(0),
     m_alreadyRead(0),
     m_bufferLength(0),
-    m_pos(0) {
+    m_pos(0),
+    m_compressedBlockLength(0),
+    m_readAheadBlocks(defaultReadAheadBlocks()),
+    m_bufferCapacity(0) {
 
     m_freeBuffer = copyMemory || compressed;
 
     setEndian(dataEndian);
 
-    if (compressed) {
+    if (compressed && decompressChunked(data, dataLen)) {
+        // Blocks were decompressed in parallel
+    } else if (compressed) {
         // Read the decompressed size from the first 4 bytes
         m_length = readUInt32FromBuffer(data, m_swapBytes);
 
@@ -96,7 +151,10 @@ BinaryInput::BinaryInput
 	m_bufferLength(0),
 	m_buffer(nullptr),
 	m_pos(0),
-	m_freeBuffer(true) {
+	m_freeBuffer(true),
+	m_compressedBlockLength(0),
+	m_readAheadBlocks(defaultReadAheadBlocks()),
+	m_bufferCapacity(0) {
 
 	setEndian(fileEndian);
 
@@ -161,6 +219,12 @@ BinaryInput::BinaryInput
 		throw format("File not found: \"%s\"", m_filename.c_str());
 	}
 
+	if (compressed && openChunkedFile(file, m_length)) {
+		// Blocks are decompressed on demand by loadIntoMemory
+		FileSystem::fclose(file); file = nullptr;
+		return;
+	}
+
 	if (!compressed && (m_length > INITIAL_BUFFER_LENGTH)) {
 		// Read only a subset of the file so we don't consume
 		// all available memory.
@@ -224,6 +288,12 @@ String BinaryInput::readFixedLengthString(int numBytes) {
 
 
 void BinaryInput::decompress() {
+    uint8* compressedBuffer = m_buffer;
+    if (decompressChunked(compressedBuffer, m_length)) {
+        System::alignedFree(compressedBuffer);
+        return;
+    }
+
     // Decompress
     // Use the existing buffer as the source, allocate
     // a new buffer to use as the destination.
@@ -253,6 +323,164 @@ void BinaryInput::decompress() {
 }
 
 
+bool BinaryInput::decompressChunked(const uint8* data, int64 dataLen) {
+    int64 uncompressedLength = 0;
+    int numBlocks = 0;
+    if ((dataLen < CHUNKED_HEADER_SIZE + CHUNKED_FOOTER_SIZE) ||
+        ! parseChunkedHeaderAndFooter(data, data + dataLen - CHUNKED_FOOTER_SIZE, dataLen, m_compressedBlockLength, uncompressedLength, numBlocks)) {
+        return false;
+    }
+
+    m_length = uncompressedLength;
+    m_bufferLength = m_length;
+    m_buffer = (uint8*)System::alignedMalloc(max<int64>(m_length, 1), 16);
+    if (isNull(m_buffer)) {
+        throw "Not enough memory to load compressed file. (3)";
+    }
+
+    const uint8* index = data + dataLen - CHUNKED_FOOTER_SIZE - int64(numBlocks) * CHUNKED_INDEX_ENTRY_SIZE;
+    std::atomic<bool> ok(true);
+    // Blocks are large, so each is its own task rather than batching them as runConcurrently does
+    tbb::parallel_for(0, numBlocks, 1, [&](int b) {
+        const uint8* entry = index + int64(b) * CHUNKED_INDEX_ENTRY_SIZE;
+        const int64  offset = int64(readLittleEndianUInt64(entry));
+        const uint32 size = readLittleEndianUInt32(entry + 8);
+        const int64  start = int64(b) * m_compressedBlockLength;
+        uLongf L = uLongf(min(m_compressedBlockLength, m_length - start));
+        const uLongf expected = L;
+        if ((offset + size > dataLen) ||
+            (uncompress(m_buffer + start, &L, data + offset, uLong(size)) != Z_OK) ||
+            (L != expected)) {
+            ok = false;
+        }
+    });
+
+    if (! ok) {
+        throw "BinaryInput/zlib detected corruption in " + m_filename;
+    }
+    return true;
+}
+
+
+bool BinaryInput::openChunkedFile(FILE* file, int64 fileLength) {
+    if (fileLength < CHUNKED_HEADER_SIZE + CHUNKED_FOOTER_SIZE) {
+        return false;
+    }
+
+    uint8 header[CHUNKED_HEADER_SIZE];
+    uint8 footer[CHUNKED_FOOTER_SIZE];
+    std::rewind(file);
+    const size_t headerRead = fread(header, 1, CHUNKED_HEADER_SIZE, file);
+    seekFile(file, fileLength - CHUNKED_FOOTER_SIZE);
+    const size_t footerRead = fread(footer, 1, CHUNKED_FOOTER_SIZE, file);
+    std::rewind(file);
+
+    int64 blockLength = 0, uncompressedLength = 0;
+    int numBlocks = 0;
+    if ((headerRead != size_t(CHUNKED_HEADER_SIZE)) || (footerRead != size_t(CHUNKED_FOOTER_SIZE)) ||
+        ! parseChunkedHeaderAndFooter(header, footer, fileLength, blockLength, uncompressedLength, numBlocks)) {
+        // Not a chunked file; the caller reads it from the beginning
+        return false;
+    }
+
+    Array<uint8> index;
+    index.resize(numBlocks * CHUNKED_INDEX_ENTRY_SIZE);
+    seekFile(file, fileLength - CHUNKED_FOOTER_SIZE - index.size());
+    if (fread(index.getCArray(), 1, index.size(), file) != size_t(index.size())) {
+        throw "Chunked compressed file index is truncated in " + m_filename;
+    }
+
+    m_compressedBlockArray.resize(numBlocks);
+    for (int b = 0; b < numBlocks; ++b) {
+        CompressedBlock& block = m_compressedBlockArray[b];
+        block.offset = int64(readLittleEndianUInt64(index.getCArray() + b * CHUNKED_INDEX_ENTRY_SIZE));
+        block.size   = readLittleEndianUInt32(index.getCArray() + b * CHUNKED_INDEX_ENTRY_SIZE + 8);
+        alwaysAssertM(block.offset + block.size <= fileLength, "Chunked compressed file index is corrupted");
+    }
+
+    m_compressedBlockLength = blockLength;
+    m_length = uncompressedLength;
+
+    // Nothing is decompressed until the first read
+    m_bufferLength = 0;
+    m_bufferCapacity = 0;
+    m_buffer = nullptr;
+    return true;
+}
+
+
+void BinaryInput::loadBlocksIntoMemory(int64 startPosition, int64 minLength) {
+    const int64 absPos = m_alreadyRead + m_pos;
+    const int numBlocks = m_compressedBlockArray.size();
+    const int first = int(startPosition / m_compressedBlockLength);
+
+    if (first >= numBlocks) {
+        // Positioned at the end of the file
+        m_alreadyRead = startPosition;
+        m_bufferLength = 0;
+        m_pos = absPos - m_alreadyRead;
+        return;
+    }
+
+    // Decompress all blocks overlapping the requested range, and read ahead
+    const int needed = int((startPosition + max<int64>(minLength, 1) - 1) / m_compressedBlockLength) - first + 1;
+    const int count = min(numBlocks - first, max(needed, m_readAheadBlocks));
+    const int64 capacity = int64(count) * m_compressedBlockLength;
+
+    if (m_bufferCapacity < capacity) {
+        System::alignedFree(m_buffer);
+        m_buffer = (uint8*)System::alignedMalloc(capacity, 16);
+        if (isNull(m_buffer)) {
+            m_bufferCapacity = 0;
+            m_bufferLength = 0;
+            throw "Tried to read a larger memory chunk than could fit in memory. (3)";
+        }
+        m_bufferCapacity = capacity;
+    }
+
+    // The blocks are contiguous in the file, so read them all with one call
+    const CompressedBlock& firstBlock = m_compressedBlockArray[first];
+    const CompressedBlock& lastBlock  = m_compressedBlockArray[first + count - 1];
+    Array<uint8> compressed;
+    compressed.resize(size_t(lastBlock.offset + lastBlock.size - firstBlock.offset));
+
+    FILE* file = FileSystem::fopen(m_filename.c_str(), "rb");
+    if (isNull(file)) {
+        throw format("File not found: \"%s\"", m_filename.c_str());
+    }
+    seekFile(file, firstBlock.offset);
+    const size_t bytesRead = fread(compressed.getCArray(), 1, compressed.size(), file);
+    FileSystem::fclose(file);
+    file = nullptr;
+    if (bytesRead != size_t(compressed.size())) {
+        throw "Chunked compressed file is truncated: " + m_filename;
+    }
+
+    m_alreadyRead = int64(first) * m_compressedBlockLength;
+    m_bufferLength = min(capacity, m_length - m_alreadyRead);
+
+    std::atomic<bool> ok(true);
+    tbb::parallel_for(0, count, 1, [&](int i) {
+        const CompressedBlock& block = m_compressedBlockArray[first + i];
+        const int64 start = int64(i) * m_compressedBlockLength;
+        uLongf L = uLongf(min(m_compressedBlockLength, m_bufferLength - start));
+        const uLongf expected = L;
+        if ((uncompress(m_buffer + start, &L, compressed.getCArray() + (block.offset - firstBlock.offset), uLong(block.size)) != Z_OK) ||
+            (L != expected)) {
+            ok = false;
+        }
+    });
+
+    if (! ok) {
+        m_bufferLength = 0;
+        throw "BinaryInput/zlib detected corruption in " + m_filename;
+    }
+
+    m_pos = absPos - m_alreadyRead;
+    debugAssert(m_pos >= 0);
+}
+
+
 void BinaryInput::setEndian(G3DEndian e) {
     m_fileEndian = e;
     m_swapBytes = (m_fileEndian != System::machineEndian());
@@ -263,6 +491,11 @@ void BinaryInput::loadIntoMemory(int64 startPosition, int64 minLength) {
     // Load the next section of the file
     debugAssertM(m_filename != "<memory>", "Read past end of file.");
 
+    if (m_compressedBlockArray.size() > 0) {
+        loadBlocksIntoMemory(startPosition, minLength);
+        return;
+    }
+
     int64 absPos = m_alreadyRead + m_pos;
 
     if (m_bufferLength < minLength) {
@@ -28,6 +28,10 @@
 // Currently 400 MB
 #define MAX_BINARYOUTPUT_BUFFER_SIZE 400000000
 
+// Number of complete blocks that accumulate before chunked compression
+// compresses them in parallel and appends them to the file
+#define CHUNKS_PER_FLUSH 16
+
 namespace G3D {
 
 void BinaryOutput::writeBool8(const std::vector<bool>& out, int n) {
@@ -112,6 +116,16 @@ IMPLEMENT_WRITER(Float64, float64)
 void BinaryOutput::reallocBuffer(size_t bytes, size_t oldBufferLen) {
     //debugPrintf("reallocBuffer(%d, %d)\n", bytes, oldBufferLen);
 
+    if ((m_chunkLength > 0) && (m_filename != "<memory>") && (m_pos >= int64(m_chunkLength) * CHUNKS_PER_FLUSH)) {
+        // Compress the complete blocks to disk instead of growing the buffer
+        m_bufferLen = oldBufferLen;
+        flushChunks(false);
+        m_bufferLen = max(m_bufferLen, (size_t)(m_pos + bytes));
+        if (m_bufferLen <= m_maxBufferLen) {
+            return;
+        }
+    }
+
     size_t newBufferLen = (int)(m_bufferLen * 1.5) + 100;
     uint8* newBuffer = nullptr;
 
@@ -142,7 +156,9 @@ void BinaryOutput::reallocBuffer(size_t bytes, size_t oldBufferLen) {
 
 
 void BinaryOutput::reserveBytesWhenOutOfMemory(size_t bytes) {
-    if (m_filename == "<memory>") {
+    if (m_chunkLength > 0) {
+        throw "Out of memory while writing a chunked compressed file in BinaryOutput.";
+    } else if (m_filename == "<memory>") {
         throw "Out of memory while writing to memory in BinaryOutput (no RAM left).";
     } else if ((int)bytes > (int)m_maxBufferLen) {
         throw "Out of memory while writing to disk in BinaryOutput (could not create a large enough buffer).";
@@ -210,6 +226,9 @@ BinaryOutput::BinaryOutput() {
     m_bitPos = 0;
     m_ok = true;
     m_committed = false;
+    m_chunkLength = 0;
+    m_chunkLevel = 6;
+    m_chunkedFileLength = 0;
 }
 
 
@@ -228,6 +247,9 @@ BinaryOutput::BinaryOutput(
     m_bitString = 0;
     m_bitPos = 0;
     m_committed = false;
+    m_chunkLength = 0;
+    m_chunkLevel = 6;
+    m_chunkedFileLength = 0;
 
     m_ok = true;    
     /** Verify ability to write to disk */
@@ -249,6 +271,10 @@ void BinaryOutput::reset() {
     m_bitString = 0;
     m_bitPos = 0;
     m_committed = false;
+    m_chunkLength = 0;
+    m_chunkedFileLength = 0;
+    m_chunkOffset.fastClear();
+    m_chunkCompressedSize.fastClear();
 }
 
 
@@ -273,6 +299,7 @@ bool BinaryOutput::ok() const {
 
 
 void BinaryOutput::compress(int level) {
+    alwaysAssertM(m_chunkLength == 0, "Cannot use both compress() and setChunkedCompression().");
     if (m_alreadyWritten > 0) {
         throw "Cannot compress huge files (part of this file has already been written to disk).";
     }
@@ -318,12 +345,119 @@ void BinaryOutput::compress(int level) {
 }
 
 
+void BinaryOutput::setChunkedCompression(int level, int blockLength) {
+    alwaysAssertM((m_alreadyWritten == 0) && (m_bufferLen == 0), "Call setChunkedCompression() before writing.");
+    alwaysAssertM(blockLength > 0, "Block length must be positive.");
+    m_chunkLength = blockLength;
+    m_chunkLevel = iClamp(level, 0, 9);
+}
+
+
+/** Chunked compressed file metadata is always little-endian */
+static void appendLittleEndian(Array<uint8>& out, uint64 x, int bytes) {
+    for (int i = 0; i < bytes; ++i) {
+        out.append(uint8(x >> (8 * i)));
+    }
+}
+
+
+void BinaryOutput::flushChunks(bool finish) {
+    debugAssert(m_chunkLength > 0);
+    const size_t numBytes = finish ? m_bufferLen : size_t(m_pos / m_chunkLength) * m_chunkLength;
+    if ((numBytes == 0) && ! finish) {
+        return;
+    }
+
+    Array<uint8> out;
+    const bool firstWrite = (m_chunkedFileLength == 0);
+    if (firstWrite) {
+        appendLittleEndian(out, BinaryInput::CHUNKED_MAGIC, 4);
+        appendLittleEndian(out, BinaryInput::CHUNKED_VERSION, 4);
+        appendLittleEndian(out, m_chunkLength, 4);
+        appendLittleEndian(out, 0, 4);
+        m_chunkedFileLength = out.size();
+    }
+
+    const int numBlocks = int((numBytes + m_chunkLength - 1) / m_chunkLength);
+    Array<Array<uint8>> blockArray;
+    blockArray.resize(numBlocks);
+    // Compress the blocks in parallel, one task per block
+    tbb::parallel_for(0, numBlocks, 1, [&](int b) {
+        const size_t start = size_t(b) * m_chunkLength;
+        const uLong srcSize = uLong(min(size_t(m_chunkLength), numBytes - start));
+        uLongf dstSize = compressBound(srcSize);
+        blockArray[b].resize(dstSize);
+        const int result = compress2(blockArray[b].getCArray(), &dstSize, m_buffer + start, srcSize, m_chunkLevel);
+        debugAssert(result == Z_OK); (void)result;
+        blockArray[b].resize(dstSize, false);
+    });
+
+    for (int b = 0; b < numBlocks; ++b) {
+        m_chunkOffset.append(m_chunkedFileLength);
+        m_chunkCompressedSize.append(uint32(blockArray[b].size()));
+        m_chunkedFileLength += blockArray[b].size();
+        out.append(blockArray[b]);
+    }
+
+    const int64 uncompressedLength = m_alreadyWritten + int64(numBytes);
+    if (finish) {
+        for (int b = 0; b < m_chunkOffset.size(); ++b) {
+            appendLittleEndian(out, m_chunkOffset[b], 8);
+            appendLittleEndian(out, m_chunkCompressedSize[b], 4);
+        }
+        appendLittleEndian(out, uncompressedLength, 8);
+        appendLittleEndian(out, m_chunkOffset.size(), 4);
+        appendLittleEndian(out, BinaryInput::CHUNKED_MAGIC, 4);
+    }
+
+    if (m_filename == "<memory>") {
+        // The container replaces the uncompressed data
+        debugAssert(finish);
+        if (size_t(out.size()) > m_maxBufferLen) {
+            uint8* newBuffer = (uint8*)System::realloc(m_buffer, out.size());
+            if (newBuffer == nullptr) {
+                throw "Out of memory while writing a chunked compressed file in BinaryOutput.";
+            }
+            m_buffer = newBuffer;
+            m_maxBufferLen = out.size();
+        }
+        System::memcpy(m_buffer, out.getCArray(), out.size());
+        m_bufferLen = out.size();
+        m_pos = m_bufferLen;
+        return;
+    }
+
+    FILE* file = FileSystem::fopen(m_filename.c_str(), firstWrite ? "wb" : "ab");
+    if (file == nullptr) {
+        logPrintf("Error %d while trying to open \"%s\"\n", errno, m_filename.c_str());
+        m_ok = false;
+        throw String("BinaryOutput could not write to '") + m_filename + "'";
+    }
+    const size_t count = fwrite(out.getCArray(), 1, out.size(), file);
+    FileSystem::fclose(file);
+    file = nullptr;
+    if (count != size_t(out.size())) {
+        m_ok = false;
+        throw String("BinaryOutput could not write to '") + m_filename + "'";
+    }
+
+    // Keep the uncompressed remainder (including anything after the write position)
+    m_alreadyWritten = uncompressedLength;
+    m_bufferLen -= numBytes;
+    m_pos -= numBytes;
+    memmove(m_buffer, m_buffer + numBytes, m_bufferLen);
+}
+
+
 void BinaryOutput::commit(bool flush) {
     debugAssertM(! m_committed, "Cannot commit twice");
     m_committed = true;
     debugAssertM(m_beginEndBits == 0, "Missing endBits before commit");
 
     if (m_filename == "<memory>") {
+        if (m_chunkLength > 0) {
+            flushChunks(true);
+        }
         return;
     }
 
@@ -337,6 +471,11 @@ void BinaryOutput::commit(bool flush) {
         FileSystem::createDirectory(path);
     }
 
+    if (m_chunkLength > 0) {
+        flushChunks(true);
+        return;
+    }
+
     const char* mode = (m_alreadyWritten > 0) ? "ab" : "wb";
 
     alwaysAssertM(m_filename != "<memory>", "Writing to memory file");
@@ -374,6 +513,9 @@ void BinaryOutput::commit(
     debugAssertM(! m_committed, "Cannot commit twice");
     m_committed = true;
 
+    if (m_chunkLength > 0) {
+        flushChunks(true);
+    }
     System::memcpy(out, m_buffer, m_bufferLen);
 }
 
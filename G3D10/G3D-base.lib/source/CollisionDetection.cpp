@@ -1640,7 +1640,8 @@ float CollisionDetection::collisionTimeForMovingSphereFixedTriangle
 
     if (velocity.dot(triangle.normal()) > 0.0f) {
         if (twoSided) {
-            return CollisionDetection::collisionTimeForMovingSphereFixedTriangle(sphere, velocity, triangle.otherSide(), outLocation, b, twoSided);
+            // Flip at most once. A degenerate triangle's recomputed normal may face away on both sides.
+            return CollisionDetection::collisionTimeForMovingSphereFixedTriangle(sphere, velocity, triangle.otherSide(), outLocation, b, false);
         } else {
             // No collision if moving towards a backface
             return finf();
@@ -0,0 +1,356 @@
+/**
+  \file G3D-base.lib/source/CollisionDetectionBatch.cpp
+
+  Batched moving sphere vs. triangle queries, four triangles at a time.
+
+  G3D Innovation Engine http://casual-effects.com/g3d
+  Copyright 2000-2019, Morgan McGuire
+  All rights reserved
+  Available under the BSD License
+*/
+#include "G3D-base/CollisionDetection.h"
+#include "G3D-base/Sphere.h"
+#include "G3D-base/Thread.h"
+
+#ifndef G3D_ARM
+#   include <xmmintrin.h>
+#endif
+
+namespace G3D {
+
+void CollisionDetection::TrianglePacketArray::append(const Triangle& triangle) {
+    const int lane = m_size % 4;
+    if (lane == 0) {
+        Packet& packet = m_packet.next();
+        System::memset(&packet, 0, sizeof(Packet));
+    }
+    Packet& packet = m_packet.last();
+
+    // Use exactly the quantities that the scalar query derives from the Triangle
+    Vector3 normal;
+    float d;
+    triangle.plane().getEquation(normal, d);
+
+    for (int v = 0; v < 3; ++v) {
+        const Vector3& e = triangle.vertex((v + 1) % 3) - triangle.vertex(v);
+        const float length = e.magnitude();
+        const Vector3& direction = (length == 0.0f) ? Vector3::zero() : e / length;
+        for (int a = 0; a < 3; ++a) {
+            packet.vertex[v][a][lane]        = triangle.vertex(v)[a];
+            packet.edgeDirection[v][a][lane] = direction[a];
+        }
+        packet.edgeLength[v][lane] = length;
+    }
+
+    const float doubleArea = normal.dot((triangle.vertex(1) - triangle.vertex(0)).cross(triangle.vertex(2) - triangle.vertex(0)));
+
+    // A triangle whose third vertex was computed on the line through the other two has a
+    // tiny nonzero area from roundoff and an arbitrary normal, so compare against the edges
+    const float maxEdgeLength = max(packet.edgeLength[0][lane], max(packet.edgeLength[1][lane], packet.edgeLength[2][lane]));
+    const bool degenerate = ! (doubleArea > 1e-5f * square(maxEdgeLength)) || ! normal.isFinite();
+
+    for (int a = 0; a < 3; ++a) {
+        packet.normal[a][lane] = normal[a];
+    }
+    packet.d[lane]             = d;
+    packet.invDoubleArea[lane] = degenerate ? 0.0f : 1.0f / doubleArea;
+    packet.valid[lane]         = degenerate ? 0.0f : 1.0f;
+
+    ++m_size;
+}
+
+
+void CollisionDetection::TrianglePacketArray::append(const Array<Triangle>& triangleArray) {
+    m_packet.reserve((m_size + triangleArray.size() + 3) / 4);
+    for (const Triangle& triangle : triangleArray) {
+        append(triangle);
+    }
+}
+
+
+Triangle CollisionDetection::TrianglePacketArray::triangle(int i) const {
+    debugAssert(i >= 0 && i < m_size);
+    const Packet& packet = m_packet[i / 4];
+    const int lane = i % 4;
+    Vector3 v[3];
+    for (int j = 0; j < 3; ++j) {
+        v[j] = Vector3(packet.vertex[j][0][lane], packet.vertex[j][1][lane], packet.vertex[j][2][lane]);
+    }
+    return Triangle(v[0], v[1], v[2]);
+}
+
+
+#ifndef G3D_ARM
+
+/** Broadcast sphere and velocity for the packet kernel */
+class SweptSpherePacketConstants {
+public:
+    __m128  center[3];
+    __m128  velocity[3];
+
+    /** Direction of motion, or zero if not moving */
+    __m128  direction[3];
+    __m128  radius;
+    __m128  radiusSquared;
+    __m128  invSpeed;
+
+    SweptSpherePacketConstants(const Sphere& sphere, const Vector3& v) {
+        const float speed = v.length();
+        const Vector3& dir = (speed > 0.0f) ? v / speed : Vector3::zero();
+        for (int a = 0; a < 3; ++a) {
+            center[a]    = _mm_set1_ps(sphere.center[a]);
+            velocity[a]  = _mm_set1_ps(v[a]);
+            direction[a] = _mm_set1_ps(dir[a]);
+        }
+        radius        = _mm_set1_ps(sphere.radius);
+        radiusSquared = _mm_set1_ps(square(sphere.radius));
+        invSpeed      = _mm_set1_ps((speed > 0.0f) ? 1.0f / speed : 0.0f);
+    }
+};
+
+
+static inline __m128 dot3(const __m128 a[3], const __m128 b[3]) {
+    return _mm_add_ps(_mm_add_ps(_mm_mul_ps(a[0], b[0]), _mm_mul_ps(a[1], b[1])), _mm_mul_ps(a[2], b[2]));
+}
+
+
+static inline __m128 select(__m128 mask, __m128 a, __m128 b) {
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+
+static inline __m128 absps(__m128 a) {
+    return _mm_andnot_ps(_mm_set1_ps(-0.0f), a);
+}
+
+
+/** n . ((a - p) x (b - p)) */
+static inline __m128 tripleProduct(const __m128 n[3], const float a[3][4], const float b[3][4], const __m128 p[3]) {
+    __m128 u[3], w[3];
+    for (int i = 0; i < 3; ++i) {
+        u[i] = _mm_sub_ps(_mm_loadu_ps(a[i]), p[i]);
+        w[i] = _mm_sub_ps(_mm_loadu_ps(b[i]), p[i]);
+    }
+    const __m128 cx = _mm_sub_ps(_mm_mul_ps(u[1], w[2]), _mm_mul_ps(u[2], w[1]));
+    const __m128 cy = _mm_sub_ps(_mm_mul_ps(u[2], w[0]), _mm_mul_ps(u[0], w[2]));
+    const __m128 cz = _mm_sub_ps(_mm_mul_ps(u[0], w[1]), _mm_mul_ps(u[1], w[0]));
+    return _mm_add_ps(_mm_add_ps(_mm_mul_ps(n[0], cx), _mm_mul_ps(n[1], cy)), _mm_mul_ps(n[2], cz));
+}
+
+
+/** The scalar collisionTimeForMovingSphereFixedTriangle() algorithm on four triangles at once:
+    sweep the sphere against the plane, accept the contact if it is inside the triangle, and otherwise
+    sweep the closest point on the perimeter back against the sphere. Every branch of the scalar
+    code becomes a lane mask. */
+static void sweepSphereTrianglePacket
+   (const SweptSpherePacketConstants&                   s,
+    const CollisionDetection::TrianglePacketArray::Packet& packet,
+    bool                                                twoSided,
+    __m128&                                             outTime,
+    __m128                                              outLocation[3]) {
+
+    const __m128 zero  = _mm_setzero_ps();
+    const __m128 one   = _mm_set1_ps(1.0f);
+    const __m128 sign  = _mm_set1_ps(-0.0f);
+    const __m128 eps32 = _mm_set1_ps(fuzzyEpsilon32);
+    const __m128 eps64 = _mm_set1_ps(float(fuzzyEpsilon64));
+
+    __m128 valid = _mm_cmpneq_ps(_mm_loadu_ps(packet.valid), zero);
+
+    const __m128 frontNormal[3] = {_mm_loadu_ps(packet.normal[0]), _mm_loadu_ps(packet.normal[1]), _mm_loadu_ps(packet.normal[2])};
+    __m128 n[3] = {frontNormal[0], frontNormal[1], frontNormal[2]};
+    __m128 d  = _mm_loadu_ps(packet.d);
+    __m128 vn = dot3(s.velocity, n);
+
+    // Moving toward the back face
+    const __m128 backface = _mm_cmpgt_ps(vn, zero);
+    if (twoSided) {
+        const __m128 flip = _mm_and_ps(backface, sign);
+        for (int a = 0; a < 3; ++a) {
+            n[a] = _mm_xor_ps(n[a], flip);
+        }
+        d  = _mm_xor_ps(d, flip);
+        vn = _mm_xor_ps(vn, flip);
+    } else {
+        valid = _mm_andnot_ps(backface, valid);
+    }
+
+    // Sphere vs. plane; fuzzyGt(vn, 0) rejects
+    valid = _mm_andnot_ps(_mm_cmpgt_ps(vn, _mm_mul_ps(eps64, _mm_add_ps(absps(vn), one))), valid);
+
+    const __m128 distance    = _mm_add_ps(dot3(s.center, n), d);
+    const __m128 absDistance = absps(distance);
+    const __m128 penetrating = _mm_cmplt_ps(absDistance, _mm_add_ps(s.radius, _mm_mul_ps(eps64, _mm_add_ps(absDistance, one))));
+
+    // The leading point of the sphere vs. the plane
+    const __m128 leadingDistance = _mm_sub_ps(distance, s.radius);
+    const __m128 absLeading      = absps(leadingDistance);
+    const __m128 onPlane         = _mm_or_ps(_mm_cmpeq_ps(leadingDistance, zero), _mm_cmple_ps(absLeading, _mm_mul_ps(eps32, _mm_add_ps(absLeading, one))));
+    const __m128 planeTime       = _mm_div_ps(_mm_xor_ps(leadingDistance, sign), vn);
+    const __m128 startsInContact = _mm_or_ps(penetrating, onPlane);
+    const __m128 reachesPlane    = _mm_and_ps(_mm_cmplt_ps(vn, zero), _mm_cmpge_ps(planeTime, zero));
+    valid = _mm_and_ps(valid, _mm_or_ps(startsInContact, reachesPlane));
+
+    const __m128 time = _mm_and_ps(_mm_andnot_ps(startsInContact, planeTime), valid);
+    __m128 P[3];
+    for (int a = 0; a < 3; ++a) {
+        const __m128 projected = _mm_sub_ps(s.center[a], _mm_mul_ps(distance, n[a]));
+        const __m128 swept     = _mm_add_ps(_mm_sub_ps(s.center[a], _mm_mul_ps(s.radius, n[a])), _mm_mul_ps(s.velocity[a], time));
+        P[a] = select(penetrating, projected, swept);
+    }
+
+    // Inside the triangle? The barycentric coordinates use the unflipped normal, for which the area is positive.
+    const __m128 invDoubleArea = _mm_loadu_ps(packet.invDoubleArea);
+    const __m128 b0 = _mm_mul_ps(tripleProduct(frontNormal, packet.vertex[1], packet.vertex[2], P), invDoubleArea);
+    const __m128 b1 = _mm_mul_ps(tripleProduct(frontNormal, packet.vertex[2], packet.vertex[0], P), invDoubleArea);
+    const __m128 b2 = _mm_sub_ps(_mm_sub_ps(one, b0), b1);
+    const __m128 inside =
+        _mm_and_ps(_mm_and_ps(_mm_and_ps(_mm_cmpge_ps(b0, zero), _mm_cmple_ps(b0, one)),
+                              _mm_and_ps(_mm_cmpge_ps(b1, zero), _mm_cmple_ps(b1, one))),
+                   _mm_and_ps(_mm_cmpge_ps(b2, zero), _mm_cmple_ps(b2, one)));
+
+    // Closest point on the perimeter, breaking ties as closestPointOnTrianglePerimeter does
+    __m128 r[3][3], dist2[3];
+    for (int e = 0; e < 3; ++e) {
+        const int next = (e + 1) % 3;
+        __m128 toP[3], dir[3];
+        for (int a = 0; a < 3; ++a) {
+            toP[a] = _mm_sub_ps(P[a], _mm_loadu_ps(packet.vertex[e][a]));
+            dir[a] = _mm_loadu_ps(packet.edgeDirection[e][a]);
+        }
+        const __m128 t      = dot3(dir, toP);
+        const __m128 before = _mm_cmple_ps(t, zero);
+        const __m128 after  = _mm_cmpge_ps(t, _mm_loadu_ps(packet.edgeLength[e]));
+        dist2[e] = zero;
+        for (int a = 0; a < 3; ++a) {
+            const __m128 start = _mm_loadu_ps(packet.vertex[e][a]);
+            const __m128 along = _mm_add_ps(start, _mm_mul_ps(dir[a], t));
+            r[e][a] = select(before, start, select(after, _mm_loadu_ps(packet.vertex[next][a]), along));
+            const __m128 delta = _mm_sub_ps(r[e][a], P[a]);
+            dist2[e] = _mm_add_ps(dist2[e], _mm_mul_ps(delta, delta));
+        }
+    }
+    const __m128 d0LessD1 = _mm_cmplt_ps(dist2[0], dist2[1]);
+    const __m128 pick0    = _mm_and_ps(d0LessD1, _mm_cmplt_ps(dist2[0], dist2[2]));
+    const __m128 pick1    = _mm_andnot_ps(d0LessD1, _mm_cmplt_ps(dist2[1], dist2[2]));
+    __m128 Q[3], L[3];
+    for (int a = 0; a < 3; ++a) {
+        Q[a] = select(pick0, r[0][a], select(pick1, r[1][a], r[2][a]));
+        L[a] = _mm_sub_ps(s.center[a], Q[a]);
+    }
+
+    // Sweep the perimeter point backwards against the sphere
+    const __m128 L2        = dot3(L, L);
+    const __m128 contained = _mm_cmple_ps(L2, s.radiusSquared);
+    __m128 backward[3];
+    for (int a = 0; a < 3; ++a) {
+        backward[a] = _mm_xor_ps(s.direction[a], sign);
+    }
+    const __m128 along   = dot3(L, backward);
+    const __m128 M2      = _mm_sub_ps(L2, _mm_mul_ps(along, along));
+    const __m128 outside = _mm_cmpgt_ps(L2, s.radiusSquared);
+    const __m128 miss    = _mm_or_ps(_mm_and_ps(_mm_cmplt_ps(along, zero), outside), _mm_cmpgt_ps(M2, s.radiusSquared));
+    const __m128 q       = _mm_sqrt_ps(_mm_max_ps(_mm_sub_ps(s.radiusSquared, M2), zero));
+    const __m128 pointTime = _mm_mul_ps(select(outside, _mm_sub_ps(along, q), _mm_add_ps(along, q)), s.invSpeed);
+    const __m128 edgeTime  = _mm_andnot_ps(contained, pointTime);
+    const __m128 edgeHit   = _mm_or_ps(contained, _mm_andnot_ps(miss, _mm_cmpgt_ps(s.invSpeed, zero)));
+
+    valid = _mm_and_ps(valid, _mm_or_ps(inside, edgeHit));
+    outTime = select(valid, select(inside, time, edgeTime), _mm_set1_ps(finf()));
+    for (int a = 0; a < 3; ++a) {
+        outLocation[a] = select(inside, P[a], Q[a]);
+    }
+}
+
+#endif
+
+
+void CollisionDetection::collisionTimesForMovingSphereFixedTriangles
+   (const Sphere&               sphere,
+    const Vector3&              velocity,
+    const TrianglePacketArray&  triangles,
+    float*                      outTime,
+    bool                        twoSided) {
+
+#   ifdef G3D_ARM
+        Vector3 location;
+        for (int i = 0; i < triangles.size(); ++i) {
+            outTime[i] = collisionTimeForMovingSphereFixedTriangle(sphere, velocity, triangles.triangle(i), location, (float*)&ignore, twoSided);
+        }
+#   else
+        const SweptSpherePacketConstants constants(sphere, velocity);
+        for (int p = 0; p < triangles.numPackets(); ++p) {
+            __m128 time, location[3];
+            sweepSphereTrianglePacket(constants, triangles.packet(p), twoSided, time, location);
+            float t[4];
+            _mm_storeu_ps(t, time);
+            for (int lane = 0; (lane < 4) && (p * 4 + lane < triangles.size()); ++lane) {
+                outTime[p * 4 + lane] = t[lane];
+            }
+        }
+#   endif
+}
+
+
+float CollisionDetection::collisionTimeForMovingSphereFixedTriangles
+   (const Sphere&               sphere,
+    const Vector3&              velocity,
+    const TrianglePacketArray&  triangles,
+    Vector3&                    outLocation,
+    int&                        outIndex,
+    bool                        twoSided) {
+
+    float firstTime = finf();
+    outIndex = -1;
+
+#   ifdef G3D_ARM
+        for (int i = 0; i < triangles.size(); ++i) {
+            Vector3 location;
+            const float t = collisionTimeForMovingSphereFixedTriangle(sphere, velocity, triangles.triangle(i), location, (float*)&ignore, twoSided);
+            if (t < firstTime) {
+                firstTime = t;
+                outIndex = i;
+                outLocation = location;
+            }
+        }
+#   else
+        const SweptSpherePacketConstants constants(sphere, velocity);
+        __m128 bestTime = _mm_set1_ps(finf());
+        for (int p = 0; p < triangles.numPackets(); ++p) {
+            __m128 time, location[3];
+            sweepSphereTrianglePacket(constants, triangles.packet(p), twoSided, time, location);
+
+            // Only leave the SIMD path for the rare packets that improve on the best so far
+            if (_mm_movemask_ps(_mm_cmplt_ps(time, bestTime)) != 0) {
+                float t[4], x[4], y[4], z[4];
+                _mm_storeu_ps(t, time);
+                _mm_storeu_ps(x, location[0]); _mm_storeu_ps(y, location[1]); _mm_storeu_ps(z, location[2]);
+                for (int lane = 0; (lane < 4) && (p * 4 + lane < triangles.size()); ++lane) {
+                    if (t[lane] < firstTime) {
+                        firstTime   = t[lane];
+                        outIndex    = p * 4 + lane;
+                        outLocation = Vector3(x[lane], y[lane], z[lane]);
+                    }
+                }
+                bestTime = _mm_set1_ps(firstTime);
+            }
+        }
+#   endif
+
+    return firstTime;
+}
+
+
+void CollisionDetection::collisionTimeForMovingSpheresFixedTriangles(Array<MovingSphereQuery>& queryArray, bool multithreaded) {
+    runConcurrently(0, queryArray.size(), [&](int i) {
+        MovingSphereQuery& query = queryArray[i];
+        if (notNull(query.triangles)) {
+            query.time = collisionTimeForMovingSphereFixedTriangles(query.sphere, query.velocity, *query.triangles, query.location, query.triangleIndex, query.twoSided);
+        } else {
+            query.time = finf();
+            query.triangleIndex = -1;
+        }
+    }, ! multithreaded);
+}
+
+} // namespace G3D
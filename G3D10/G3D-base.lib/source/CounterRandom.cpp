@@ -0,0 +1,106 @@
+/**
+  \file G3D-base.lib/source/CounterRandom.cpp
+
+  G3D Innovation Engine http://casual-effects.com/g3d
+  Copyright 2000-2019, Morgan McGuire
+  All rights reserved
+  Available under the BSD License
+*/
+#include "G3D-base/CounterRandom.h"
+#include "G3D-base/Vector3.h"
+#include "G3D-base/Vector4.h"
+
+namespace G3D {
+
+/** Number of streams processed together by the batch routines. The loops over lanes have
+    no dependencies between iterations so that they map onto SIMD registers. */
+static const int LANES = 8;
+
+/** Philox4x32-10 on LANES independent counters at once. Only c0 varies per lane on entry. */
+static void philoxLanes(uint32 c0[LANES], uint32 c1[LANES], uint32 c2[LANES], uint32 c3[LANES], const uint32 key[2]) {
+    uint32 k0 = key[0], k1 = key[1];
+    for (int round = 0; round < 10; ++round) {
+        for (int j = 0; j < LANES; ++j) {
+            const uint64 p0 = uint64(0xD2511F53) * c0[j];
+            const uint64 p1 = uint64(0xCD9E8D57) * c2[j];
+            const uint32 n0 = uint32(p1 >> 32) ^ c1[j] ^ k0;
+            const uint32 n2 = uint32(p0 >> 32) ^ c3[j] ^ k1;
+            c1[j] = uint32(p1);
+            c3[j] = uint32(p0);
+            c0[j] = n0;
+            c2[j] = n2;
+        }
+        k0 += 0x9E3779B9;
+        k1 += 0xBB67AE85;
+    }
+}
+
+
+/** Invokes emit(i, c0, c1, c2, c3) with the Philox output for every stream i in [0, count) */
+template<class StreamFunction, class EmitFunction>
+static void forEachBlock(uint64 seed, const StreamFunction& stream0, uint32 stream1, uint32 stream2, uint32 block, int count, const EmitFunction& emit) {
+    const uint32 key[2] = {uint32(seed), uint32(seed >> 32)};
+    uint32 c0[LANES], c1[LANES], c2[LANES], c3[LANES];
+
+    for (int base = 0; base < count; base += LANES) {
+        const int n = min(LANES, count - base);
+        for (int j = 0; j < LANES; ++j) {
+            // Pad the last group by repeating its final stream
+            c0[j] = stream0(base + min(j, n - 1));
+            c1[j] = stream1;
+            c2[j] = stream2;
+            c3[j] = block;
+        }
+
+        philoxLanes(c0, c1, c2, c3, key);
+
+        for (int j = 0; j < n; ++j) {
+            emit(base + j, c0[j], c1[j], c2[j], c3[j]);
+        }
+    }
+}
+
+
+/** Jensen's method, as in Random::cosHemi */
+static void cosHemiFromUniform(float e1, float e2, float& x, float& y, float& z) {
+    const float sin_theta = sqrtf(1.0f - e1);
+    const float cos_theta = sqrtf(e1);
+    const float phi = 6.28318531f * e2;
+
+    x = cos(phi) * sin_theta;
+    y = sin(phi) * sin_theta;
+    z = cos_theta;
+}
+
+
+void CounterRandom::reset(uint32 seed, bool threadsafe) {
+    (void)threadsafe;
+    m_key[0] = seed;
+    m_key[1] = 0;
+    setStream(0, 0, 0);
+}
+
+
+void CounterRandom::cosHemi(float& x, float& y, float& z) {
+    const float e1 = uniform();
+    const float e2 = uniform();
+    cosHemiFromUniform(e1, e2, x, y, z);
+}
+
+
+void CounterRandom::uniformBatch(uint64 seed, const int* stream0, uint32 stream1, uint32 stream2, uint32 block, int count, Vector4* result) {
+    forEachBlock(seed, [stream0](int i) { return uint32(stream0[i]); }, stream1, stream2, block, count,
+        [result](int i, uint32 r0, uint32 r1, uint32 r2, uint32 r3) {
+            result[i] = Vector4(toUniform(r0), toUniform(r1), toUniform(r2), toUniform(r3));
+        });
+}
+
+
+void CounterRandom::uniformBatch(uint64 seed, uint32 firstStream0, uint32 stream1, uint32 stream2, uint32 block, int count, Vector4* result) {
+    forEachBlock(seed, [firstStream0](int i) { return firstStream0 + uint32(i); }, stream1, stream2, block, count,
+        [result](int i, uint32 r0, uint32 r1, uint32 r2, uint32 r3) {
+            result[i] = Vector4(toUniform(r0), toUniform(r1), toUniform(r2), toUniform(r3));
+        });
+}
+
+} // namespace G3D
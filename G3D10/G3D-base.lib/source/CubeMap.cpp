@@ -164,6 +164,11 @@ CubeMap::CubeMap
 
 
 Vector2 CubeMap::pixelCoord(const Vector3& vec, CubeFace& face) const {
+    return m_fSize * faceCoord(vec, face) + Vector2::one();
+}
+
+
+Vector2 CubeMap::faceCoord(const Vector3& vec, CubeFace& face) {
     const Vector3::Axis faceAxis = vec.primaryAxis();
     face = (CubeFace)(int(faceAxis) * 2 + ((vec[faceAxis] < 0.0f) ? 1 : 0));
 
@@ -201,7 +206,53 @@ Vector2 CubeMap::pixelCoord(const Vector3& vec, CubeFace& face) const {
         break;
     }
 
-    return m_fSize * texCoord + Vector2::one();
+    return texCoord;
+}
+
+
+Vector3 CubeMap::direction(CubeFace face, const Vector2& faceCoord) {
+    // Undo the OpenGL cube map rules applied by faceCoord()
+    const Vector2& t = faceCoord;
+    Vector2 texCoord;
+    switch (face) {
+    case CubeFace::POS_X:
+        texCoord = Vector2(1.0f - t.y, 1.0f - t.x);
+        break;
+
+    case CubeFace::NEG_X:
+        texCoord = Vector2(1.0f - t.y, t.x);
+        break;
+
+    case CubeFace::POS_Y:
+        texCoord = Vector2(t.y, t.x);
+        break;
+
+    case CubeFace::NEG_Y:
+        texCoord = Vector2(1.0f - t.y, t.x);
+        break;
+
+    case CubeFace::POS_Z:
+        texCoord = Vector2(t.x, 1.0f - t.y);
+        break;
+
+    case CubeFace::NEG_Z:
+    default:
+        texCoord = Vector2(1.0f - t.x, 1.0f - t.y);
+        break;
+    }
+
+    const int faceAxis = int(face) / 2;
+    Vector3 vec;
+    vec[faceAxis]           = ((int(face) & 1) != 0) ? -1.0f : 1.0f;
+    vec[(faceAxis + 1) % 3] = 2.0f * texCoord.x - 1.0f;
+    vec[(faceAxis + 2) % 3] = 2.0f * texCoord.y - 1.0f;
+    return vec.direction();
+}
+
+
+Color3 CubeMap::texel(CubeFace face, int x, int y) const {
+    // Skip the padding
+    return m_faceArray[face].get(x + 1, y + 1);
 }
 
 
@@ -0,0 +1,109 @@
+/**
+  \file G3D-base.lib/source/CubeMapSampler.cpp
+
+  G3D Innovation Engine http://casual-effects.com/g3d
+  Copyright 2000-2019, Morgan McGuire
+  All rights reserved
+  Available under the BSD License
+*/
+#include "G3D-base/CubeMapSampler.h"
+#include "G3D-base/CubeMap.h"
+#include "G3D-base/CubeFace.h"
+#include "G3D-base/Color3.h"
+#include "G3D-base/Thread.h"
+
+namespace G3D {
+
+/** Solid angle subtended by the part of a cube face at distance 1 from the center
+    that lies below and to the left of (x, y). */
+static double cornerSolidAngle(double x, double y) {
+    return ::atan2(x * y, ::sqrt(x * x + y * y + 1.0));
+}
+
+
+/** Converts the density of a point on the face plane, whose area is 4, to density with
+    respect to solid angle. \a t is the face coordinate on [0, 1]^2. */
+static float faceToSolidAngleScale(const Vector2& t) {
+    const float x = 2.0f * t.x - 1.0f;
+    const float y = 2.0f * t.y - 1.0f;
+    const float r2 = x * x + y * y + 1.0f;
+    return 0.25f * r2 * ::sqrtf(r2);
+}
+
+
+shared_ptr<CubeMapSampler> CubeMapSampler::create(const shared_ptr<CubeMap>& cubeMap, int maxResolution) {
+    return createShared<CubeMapSampler>(cubeMap, maxResolution);
+}
+
+
+CubeMapSampler::CubeMapSampler(const shared_ptr<CubeMap>& cubeMap, int maxResolution) {
+    debugAssert(notNull(cubeMap));
+    const int size = cubeMap->size();
+    const int R = max(1, min(size, maxResolution));
+    m_resolution = R;
+
+    Array<float> weight;
+    weight.resize(6 * R * R);
+
+    runConcurrently(0, 6 * R, [&](int row) {
+        const CubeFace face = CubeFace(row / R);
+        const int y = row % R;
+        const int y0 = y * size / R, y1 = (y + 1) * size / R;
+
+        for (int x = 0; x < R; ++x) {
+            const int x0 = x * size / R, x1 = (x + 1) * size / R;
+
+            // Include a one-texel border, which bilinear interpolation can bleed into this
+            // cell. Otherwise cells beside a small, bright source would have tiny probability
+            // but large radiance, and the estimator's variance would be unbounded.
+            float sum = 0.0f;
+            for (int j = y0 - 1; j <= y1; ++j) {
+                for (int i = x0 - 1; i <= x1; ++i) {
+                    sum += cubeMap->texel(face, i, j).average();
+                }
+            }
+            const float mean = sum / float((x1 - x0 + 2) * (y1 - y0 + 2));
+
+            // Cell corners on [-1, 1]^2. The face orientation does not matter
+            // because the solid angle is symmetric under flips and transposes.
+            const double ax = 2.0 * x / R - 1.0, bx = 2.0 * (x + 1) / R - 1.0;
+            const double ay = 2.0 * y / R - 1.0, by = 2.0 * (y + 1) / R - 1.0;
+            const double solidAngle = cornerSolidAngle(bx, by) - cornerSolidAngle(ax, by) - cornerSolidAngle(bx, ay) + cornerSolidAngle(ax, ay);
+
+            weight[row * R + x] = max(0.0f, mean) * float(solidAngle);
+        }
+    });
+
+    m_table = AliasTable(weight);
+}
+
+
+Vector3 CubeMapSampler::sample(const Vector4& u, float& pdf) const {
+    const int R = m_resolution;
+    float pmf;
+    const int cell = m_table.sample(u.x, u.y, pmf);
+    const int x = cell % R;
+    const int y = (cell / R) % R;
+    const CubeFace face = CubeFace(cell / (R * R));
+
+    const Vector2 t((float(x) + u.z) / float(R), (float(y) + u.w) / float(R));
+    pdf = pmf * float(R * R) * faceToSolidAngleScale(t);
+    return CubeMap::direction(face, t);
+}
+
+
+float CubeMapSampler::pdf(const Vector3& w) const {
+    const int R = m_resolution;
+    CubeFace face;
+    const Vector2& t = CubeMap::faceCoord(w, face);
+    const int x = clamp(int(t.x * float(R)), 0, R - 1);
+    const int y = clamp(int(t.y * float(R)), 0, R - 1);
+    return m_table.pmf((int(face) * R + y) * R + x) * float(R * R) * faceToSolidAngleScale(t);
+}
+
+
+float CubeMapSampler::power() const {
+    return float(m_table.totalWeight());
+}
+
+} // namespace G3D
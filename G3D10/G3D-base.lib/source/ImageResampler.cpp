@@ -0,0 +1,393 @@
+/**
+  \file G3D-base.lib/source/ImageResampler.cpp
+
+  G3D Innovation Engine http://casual-effects.com/g3d
+  Copyright 2000-2019, Morgan McGuire
+  All rights reserved
+  Available under the BSD License
+*/
+#include "G3D-base/ImageResampler.h"
+#include "G3D-base/CPUPixelTransferBuffer.h"
+#include "G3D-base/ImageFormat.h"
+#include "G3D-base/Thread.h"
+#include "G3D-base/g3dmath.h"
+#include "G3D-base/System.h"
+#include <functional>
+
+#ifndef G3D_ARM
+#   include <xmmintrin.h>
+#endif
+
+namespace G3D {
+
+/** Rows per task in the parallel passes */
+static const int ROWS_PER_BLOCK = 16;
+
+static float filterRadius(ImageResampler::Filter filter) {
+    switch (filter.value) {
+    case ImageResampler::Filter::BOX:      return 0.5f;
+    case ImageResampler::Filter::TENT:     return 1.0f;
+    case ImageResampler::Filter::LANCZOS3: return 3.0f;
+    default:                               return 2.0f;
+    }
+}
+
+
+static float filterWeight(ImageResampler::Filter filter, float x) {
+    switch (filter.value) {
+    case ImageResampler::Filter::BOX:
+        // Half-open so that adjacent output pixels do not share an input pixel
+        return ((x >= -0.5f) && (x < 0.5f)) ? 1.0f : 0.0f;
+
+    case ImageResampler::Filter::TENT:
+        return max(0.0f, 1.0f - fabsf(x));
+
+    case ImageResampler::Filter::LANCZOS3:
+        x = fabsf(x);
+        if (x < 1e-6f) {
+            return 1.0f;
+        } else if (x >= 3.0f) {
+            return 0.0f;
+        } else {
+            const float px = pif() * x;
+            return 3.0f * sinf(px) * sinf(px / 3.0f) / (px * px);
+        }
+
+    default:
+        {
+            // Mitchell-Netravali with B = C = 1/3
+            const float B = 1.0f / 3.0f, C = 1.0f / 3.0f;
+            x = fabsf(x);
+            if (x < 1.0f) {
+                return ((12.0f - 9.0f * B - 6.0f * C) * x * x * x + (-18.0f + 12.0f * B + 6.0f * C) * x * x + (6.0f - 2.0f * B)) / 6.0f;
+            } else if (x < 2.0f) {
+                return ((-B - 6.0f * C) * x * x * x + (6.0f * B + 30.0f * C) * x * x + (-12.0f * B - 48.0f * C) * x + (8.0f * B + 24.0f * C)) / 6.0f;
+            } else {
+                return 0.0f;
+            }
+        }
+    }
+}
+
+
+/** The input pixels and normalized weights for every output pixel along one axis */
+class ResampleContributions {
+public:
+    /** First input pixel for each output pixel */
+    Array<int>      first;
+
+    /** Number of consecutive input pixels for each output pixel */
+    Array<int>      count;
+
+    /** Output pixel i's weights begin at i * stride */
+    Array<float>    weight;
+    int             stride = 0;
+
+    ResampleContributions(int srcSize, int dstSize, ImageResampler::Filter filter) {
+        const float scale = float(dstSize) / float(srcSize);
+
+        // Widen the filter when minifying so that every input pixel contributes
+        const float support = filterRadius(filter) / min(scale, 1.0f);
+        const float invFilterScale = min(scale, 1.0f);
+
+        stride = min(iCeil(2.0f * support) + 3, srcSize);
+        first.resize(dstSize);
+        count.resize(dstSize);
+        weight.resize(dstSize * stride);
+        weight.setAll(0.0f);
+
+        for (int i = 0; i < dstSize; ++i) {
+            const float center = (float(i) + 0.5f) / scale - 0.5f;
+            const int lo = max(0, iFloor(center - support));
+            const int hi = min(srcSize - 1, iCeil(center + support));
+            first[i] = lo;
+            count[i] = min(hi - lo + 1, stride);
+
+            float* w = weight.getCArray() + i * stride;
+            float total = 0.0f;
+
+            // Taps beyond the edge of the image clamp to the edge pixel
+            for (int j = iFloor(center - support); j <= iCeil(center + support); ++j) {
+                const float f = filterWeight(filter, (float(j) - center) * invFilterScale);
+                const int k = clamp(j, lo, lo + count[i] - 1) - lo;
+                w[k] += f;
+                total += f;
+            }
+
+            if (fabsf(total) > 1e-8f) {
+                for (int k = 0; k < count[i]; ++k) {
+                    w[k] /= total;
+                }
+            } else {
+                // Degenerate filter footprint; fall back to the nearest pixel
+                first[i] = clamp(iRound(center), 0, srcSize - 1);
+                count[i] = 1;
+                w[0] = 1.0f;
+            }
+        }
+    }
+};
+
+
+/** dst[0..3] = sum over k of weight[k] * src[4 * k .. 4 * k + 3] */
+static inline void filterPixel(const float* src, const float* weight, int count, float* dst) {
+#   ifndef G3D_ARM
+        __m128 acc = _mm_setzero_ps();
+        for (int k = 0; k < count; ++k) {
+            acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(weight[k]), _mm_loadu_ps(src + 4 * k)));
+        }
+        _mm_storeu_ps(dst, acc);
+#   else
+        float acc[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+        for (int k = 0; k < count; ++k) {
+            for (int c = 0; c < 4; ++c) {
+                acc[c] += weight[k] * src[4 * k + c];
+            }
+        }
+        for (int c = 0; c < 4; ++c) {
+            dst[c] = acc[c];
+        }
+#   endif
+}
+
+
+/** acc[0..n-1] += w * src[0..n-1], where n is a multiple of 4 */
+static inline void multiplyAdd(float* acc, const float* src, float w, int n) {
+#   ifndef G3D_ARM
+        const __m128 w4 = _mm_set1_ps(w);
+        for (int i = 0; i < n; i += 4) {
+            _mm_storeu_ps(acc + i, _mm_add_ps(_mm_loadu_ps(acc + i), _mm_mul_ps(w4, _mm_loadu_ps(src + i))));
+        }
+#   else
+        for (int i = 0; i < n; ++i) {
+            acc[i] += w * src[i];
+        }
+#   endif
+}
+
+
+/** Writes row y of the image as four floats per pixel */
+typedef std::function<void (int y, float* dst)> RowReader;
+
+/** Receives row y of the result as four floats per pixel. Called concurrently for different rows. */
+typedef std::function<void (int y, const float* src)> RowWriter;
+
+static void resampleRows(int srcWidth, int srcHeight, const RowReader& read, int dstWidth, int dstHeight, const RowWriter& write, ImageResampler::Filter filter) {
+    const ResampleContributions horizontal(srcWidth, dstWidth, filter);
+    const ResampleContributions vertical(srcHeight, dstHeight, filter);
+
+    // Rows filtered horizontally but not yet vertically
+    const int dstRowFloats = dstWidth * 4;
+    Array<float> intermediate;
+    intermediate.resize(srcHeight * dstRowFloats);
+
+    runConcurrently(0, iCeil(float(srcHeight) / float(ROWS_PER_BLOCK)), [&](int block) {
+        Array<float> row;
+        row.resize(srcWidth * 4);
+        const int yEnd = min(srcHeight, (block + 1) * ROWS_PER_BLOCK);
+        for (int y = block * ROWS_PER_BLOCK; y < yEnd; ++y) {
+            read(y, row.getCArray());
+            float* dst = intermediate.getCArray() + y * dstRowFloats;
+            for (int x = 0; x < dstWidth; ++x) {
+                filterPixel(row.getCArray() + 4 * horizontal.first[x], horizontal.weight.getCArray() + x * horizontal.stride, horizontal.count[x], dst + 4 * x);
+            }
+        }
+    });
+
+    runConcurrently(0, iCeil(float(dstHeight) / float(ROWS_PER_BLOCK)), [&](int block) {
+        Array<float> acc;
+        acc.resize(dstRowFloats);
+        const int yEnd = min(dstHeight, (block + 1) * ROWS_PER_BLOCK);
+        for (int y = block * ROWS_PER_BLOCK; y < yEnd; ++y) {
+            acc.setAll(0.0f);
+            const float* w = vertical.weight.getCArray() + y * vertical.stride;
+            for (int k = 0; k < vertical.count[y]; ++k) {
+                multiplyAdd(acc.getCArray(), intermediate.getCArray() + (vertical.first[y] + k) * dstRowFloats, w[k], dstRowFloats);
+            }
+            write(y, acc.getCArray());
+        }
+    });
+}
+
+
+/** Exact sRGB transfer functions, per channel */
+static float sRGBToLinear(float s) {
+    return (s <= 0.04045f) ? s / 12.92f : powf((s + 0.055f) / 1.055f, 2.4f);
+}
+
+
+class ResampleSRGBTable {
+public:
+    /** Linear value of each 8-bit code */
+    float decode[256];
+
+    /** threshold[k] is the linear value halfway (in sRGB space) between codes k and k + 1 */
+    float threshold[255];
+
+    ResampleSRGBTable() {
+        for (int k = 0; k < 256; ++k) {
+            decode[k] = sRGBToLinear(float(k) / 255.0f);
+        }
+        for (int k = 0; k < 255; ++k) {
+            threshold[k] = sRGBToLinear((float(k) + 0.5f) / 255.0f);
+        }
+    }
+
+    /** Correctly rounded encoding by binary search of the thresholds */
+    uint8 encode(float linear) const {
+        int lo = 0, hi = 255;
+        while (lo < hi) {
+            const int mid = (lo + hi) / 2;
+            if (linear < threshold[mid]) {
+                hi = mid;
+            } else {
+                lo = mid + 1;
+            }
+        }
+        return uint8(lo);
+    }
+
+    static const ResampleSRGBTable& instance() {
+        static const ResampleSRGBTable table;
+        return table;
+    }
+};
+
+
+/** How pixels of a supported format are stored */
+class ResampleLayout {
+public:
+    int         channels = 0;
+    bool        isFloat = false;
+    bool        srgb = false;
+
+    ResampleLayout(const ImageFormat* format, bool forceSRGB) {
+        switch (format->code) {
+        case ImageFormat::CODE_RGB8:    channels = 3; srgb = forceSRGB; break;
+        case ImageFormat::CODE_RGBA8:   channels = 4; srgb = forceSRGB; break;
+        case ImageFormat::CODE_SRGB8:   channels = 3; srgb = true;      break;
+        case ImageFormat::CODE_SRGBA8:  channels = 4; srgb = true;      break;
+        case ImageFormat::CODE_RGB32F:  channels = 3; isFloat = true;   break;
+        case ImageFormat::CODE_RGBA32F: channels = 4; isFloat = true;   break;
+        default: break;
+        }
+    }
+
+    void decodeRow(const void* srcRow, int width, float* dst) const {
+        if (isFloat) {
+            const float* src = static_cast<const float*>(srcRow);
+            for (int x = 0; x < width; ++x, src += channels, dst += 4) {
+                dst[0] = src[0]; dst[1] = src[1]; dst[2] = src[2];
+                dst[3] = (channels == 4) ? src[3] : 1.0f;
+            }
+        } else {
+            const uint8* src = static_cast<const uint8*>(srcRow);
+            const ResampleSRGBTable& table = ResampleSRGBTable::instance();
+            for (int x = 0; x < width; ++x, src += channels, dst += 4) {
+                for (int c = 0; c < 3; ++c) {
+                    dst[c] = srgb ? table.decode[src[c]] : float(src[c]) * (1.0f / 255.0f);
+                }
+                dst[3] = (channels == 4) ? float(src[3]) * (1.0f / 255.0f) : 1.0f;
+            }
+        }
+    }
+
+    void encodeRow(const float* src, int width, void* dstRow) const {
+        if (isFloat) {
+            float* dst = static_cast<float*>(dstRow);
+            for (int x = 0; x < width; ++x, src += 4, dst += channels) {
+                for (int c = 0; c < channels; ++c) {
+                    dst[c] = src[c];
+                }
+            }
+        } else {
+            // Negative lobes of the filter can leave the representable range
+            uint8* dst = static_cast<uint8*>(dstRow);
+            const ResampleSRGBTable& table = ResampleSRGBTable::instance();
+            for (int x = 0; x < width; ++x, src += 4, dst += channels) {
+                for (int c = 0; c < 3; ++c) {
+                    dst[c] = srgb ? table.encode(src[c]) : uint8(iClamp(iRound(src[c] * 255.0f), 0, 255));
+                }
+                if (channels == 4) {
+                    dst[3] = uint8(iClamp(iRound(src[3] * 255.0f), 0, 255));
+                }
+            }
+        }
+    }
+};
+
+
+bool ImageResampler::supportsFormat(const ImageFormat* format) {
+    return notNull(format) && (ResampleLayout(format, false).channels > 0);
+}
+
+
+shared_ptr<CPUPixelTransferBuffer> ImageResampler::resize
+   (const shared_ptr<CPUPixelTransferBuffer>&   src,
+    int                                         width,
+    int                                         height,
+    Filter                                      filter,
+    bool                                        srgb) {
+
+    alwaysAssertM(supportsFormat(src->format()), "ImageResampler does not support " + src->format()->name());
+    alwaysAssertM((width > 0) && (height > 0), "ImageResampler::resize requires a positive size");
+
+    const ResampleLayout layout(src->format(), srgb);
+    const shared_ptr<CPUPixelTransferBuffer>& dst = CPUPixelTransferBuffer::create(width, height, src->format());
+
+    resampleRows(src->width(), src->height(),
+        [&](int y, float* row) { layout.decodeRow(src->row(y), src->width(), row); },
+        width, height,
+        [&](int y, const float* row) { layout.encodeRow(row, width, dst->row(y)); },
+        filter);
+
+    return dst;
+}
+
+
+void ImageResampler::generateMipPyramid
+   (const shared_ptr<CPUPixelTransferBuffer>&   src,
+    Array<shared_ptr<CPUPixelTransferBuffer>>&  mipArray,
+    Filter                                      filter,
+    bool                                        srgb) {
+
+    alwaysAssertM(supportsFormat(src->format()), "ImageResampler does not support " + src->format()->name());
+
+    const ResampleLayout layout(src->format(), srgb);
+    mipArray.fastClear();
+    mipArray.append(src);
+
+    // Each level is filtered from the previous one in linear floating point, so 8-bit
+    // quantization does not compound down the chain
+    Array<float> previous, current;
+    int width = src->width(), height = src->height();
+
+    while ((width > 1) || (height > 1)) {
+        const int w = max(1, width / 2), h = max(1, height / 2);
+        const shared_ptr<CPUPixelTransferBuffer>& level = CPUPixelTransferBuffer::create(w, h, src->format());
+        current.resize(w * h * 4, false);
+
+        const bool first = (mipArray.size() == 1);
+        resampleRows(width, height,
+            [&](int y, float* row) {
+                if (first) {
+                    layout.decodeRow(src->row(y), src->width(), row);
+                } else {
+                    System::memcpy(row, previous.getCArray() + y * width * 4, width * 4 * sizeof(float));
+                }
+            },
+            w, h,
+            [&](int y, const float* row) {
+                System::memcpy(current.getCArray() + y * w * 4, row, w * 4 * sizeof(float));
+                layout.encodeRow(row, w, level->row(y));
+            },
+            filter);
+
+        mipArray.append(level);
+        Array<float>::swap(previous, current);
+        width = w;
+        height = h;
+    }
+}
+
+} // namespace G3D
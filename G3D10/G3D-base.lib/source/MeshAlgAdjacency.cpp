@@ -13,6 +13,9 @@
 #include "G3D-base/Stopwatch.h"
 #include "G3D-base/SmallArray.h"
 #include "G3D-base/AreaMemoryManager.h"
+#include "G3D-base/Thread.h"
+#include "G3D-base/Vector2int32.h"
+#include "G3D-base/radixSort.h"
 
 namespace G3D {
 
@@ -187,55 +190,28 @@ void MeshAlg::computeAdjacency(
 }
 
 
-void MeshAlg::computeAdjacency(
-    const Array<Vector3>&   vertexGeometry,
-    const Array<int>&       indexArray,
-    Array<Face>&            faceArray,
-    Array<Edge>&            edgeArray,
-    Array<Vertex>&          vertexArray) {
-
-    MeshEdgeTable           edgeTable;
-
-    edgeArray.clear();
-    vertexArray.clear();
-    faceArray.clear();
-    
-    // Face normals
-    Array<Vector3> faceNormal;
-    faceNormal.resize(indexArray.size() / 3);
-    faceArray.resize(faceNormal.size());
+static const int nextIndex[] = {1, 2, 0};
 
-    // This array has the same size as the vertex array
-    vertexArray.resize(vertexGeometry.size());
-
-    edgeTable.resize(vertexArray.size());
-
-    // Iterate through the triangle list
-    for (int q = 0, f = 0; q < indexArray.size(); ++f, q += 3) {
-
-        Vector3 vertex[3];
-        MeshAlg::Face& face = faceArray[f];
-
-        // Construct the face
-        for (int j = 0; j < 3; ++j) {
-            int v = indexArray[q + j];
-            face.vertexIndex[j] = v;
-            face.edgeIndex[j]   = Face::NONE;
-
-            // Store back pointers in the vertices
-            vertexArray[v].faceIndex.append(f);
-
-            // We'll need these vertices to find the face normal
-            vertex[j]           = vertexGeometry[v];
-        }
+/**
+ Creates the edges for computeAdjacency, in the order that it
+ numbers them before moving boundary edges to the end, by inserting
+ each directed edge into a MeshEdgeTable.
+ */
+static void computeEdgesWithTable
+   (const Array<int>&           indexArray,
+    const Array<Vector3>&       faceNormal,
+    int                         numVertices,
+    Array<MeshAlg::Face>&       faceArray,
+    Array<MeshAlg::Edge>&       tempEdgeArray) {
 
-        // Compute the face normal
-        const Vector3& N = (vertex[1] - vertex[0]).cross(vertex[2] - vertex[0]);
-        faceNormal[f] = N.directionOrZero();
+    typedef MeshAlg::Face Face;
+    typedef MeshAlg::Edge Edge;
 
-        static const int nextIndex[] = {1, 2, 0};
+    MeshEdgeTable           edgeTable;
+    edgeTable.resize(numVertices);
 
-        // Add each edge to the edge table.
+    // Add each edge to the edge table.
+    for (int q = 0, f = 0; f < faceArray.size(); ++f, q += 3) {
         for (int j = 0; j < 3; ++j) {
             const int      i0 = indexArray[q + j];
             const int      i1 = indexArray[q + nextIndex[j]];
@@ -255,7 +231,6 @@ void MeshAlg::computeAdjacency(
 
     MeshEdgeTable::Iterator cur = edgeTable.begin();
 
-    Array<Edge> tempEdgeArray;
     while (cur.isValid()) {
         MeshEdgeTable::FaceIndexArray& faceIndexArray = cur.faceIndex();
 
@@ -345,8 +320,306 @@ void MeshAlg::computeAdjacency(
 
         ++cur;
     }
+}
+
+
+/**
+ Produces exactly the same output as computeEdgesWithTable, in parallel.
+
+ Each face contributes three (min vertex, max vertex, face) records, which
+ are radix sorted by vertex pair. The sort is stable, so each run of
+ records for one vertex pair lists its faces in the order that
+ MeshEdgeTable::insert would have received them, and the runs can pair
+ faces independently with the same rule. Runs are then numbered in
+ MeshEdgeTable iteration order: by lower vertex, and then by the first
+ face to use the pair.
+ */
+static void computeEdgesWithSort
+   (const Array<int>&           indexArray,
+    const Array<Vector3>&       faceNormal,
+    int                         numVertices,
+    Array<MeshAlg::Face>&       faceArray,
+    Array<MeshAlg::Edge>&       tempEdgeArray) {
+
+    typedef MeshAlg::Face Face;
+    typedef MeshAlg::Edge Edge;
+
+    const int numRecords = faceArray.size() * 3;
+    if (numRecords == 0) {
+        return;
+    }
+
+    // Records are indexed by their position in indexArray
+    const auto isForward = [&](int r) {
+        return indexArray[r] < indexArray[r - (r % 3) + nextIndex[r % 3]];
+    };
+
+    const auto signedFace = [&](int r) {
+        return isForward(r) ? (r / 3) : ~(r / 3);
+    };
+
+    // Divide the records into blocks for the passes that are not naturally parallel
+    const int numBlocks = clamp(numRecords / (1 << 14), 1, 256);
+    const int blockSize = (numRecords + numBlocks - 1) / numBlocks;
+    const bool singleThread = (numBlocks == 1);
+
+    // Pack vertex pairs into as few bits as possible to minimize the number of radix passes
+    int vertexBits = 1;
+    while ((vertexBits < 32) && ((int64(1) << vertexBits) < numVertices)) {
+        ++vertexBits;
+    }
+
+    class EdgeRecord {
+    public:
+        /** (min vertex << vertexBits) | max vertex */
+        uint64  key;
+        int     record;
+    };
+
+    Array<EdgeRecord> sorted;
+    sorted.resize(numRecords);
+    runConcurrently(0, numBlocks, [&](int b) {
+        const int end = min(numRecords, (b + 1) * blockSize);
+        for (int r = b * blockSize; r < end; ++r) {
+            const uint32 i0 = uint32(indexArray[r]);
+            const uint32 i1 = uint32(indexArray[r - (r % 3) + nextIndex[r % 3]]);
+            sorted[r].key    = (uint64(min(i0, i1)) << vertexBits) | uint64(max(i0, i1));
+            sorted[r].record = r;
+        }
+    }, singleThread);
+
+    radixSort(sorted, [](const EdgeRecord& e) { return e.key; }, 2 * vertexBits);
+
+    class Run {
+    public:
+        /** Index in sorted of the first record, which is the earliest because the sort is stable */
+        int     begin;
+        int     end;
+        /** Index of this run's first edge in tempEdgeArray */
+        int     firstEdge;
+    };
+
+    // Find the runs of equal vertex pairs, block by block
+    Array<int> blockRunStart;
+    blockRunStart.resize(numBlocks + 1);
+    blockRunStart[0] = 0;
+    runConcurrently(0, numBlocks, [&](int b) {
+        int count = 0;
+        const int end = min(numRecords, (b + 1) * blockSize);
+        for (int s = b * blockSize; s < end; ++s) {
+            count += ((s == 0) || (sorted[s].key != sorted[s - 1].key)) ? 1 : 0;
+        }
+        blockRunStart[b + 1] = count;
+    }, singleThread);
+    for (int b = 0; b < numBlocks; ++b) {
+        blockRunStart[b + 1] += blockRunStart[b];
+    }
+
+    Array<Run> runArray;
+    runArray.resize(blockRunStart[numBlocks]);
+    runConcurrently(0, numBlocks, [&](int b) {
+        int k = blockRunStart[b];
+        const int end = min(numRecords, (b + 1) * blockSize);
+        for (int s = b * blockSize; s < end; ++s) {
+            if ((s == 0) || (sorted[s].key != sorted[s - 1].key)) {
+                runArray[k].begin = s;
+                ++k;
+            }
+        }
+    }, singleThread);
+    for (int k = 0; k < runArray.size(); ++k) {
+        runArray[k].end = (k + 1 < runArray.size()) ? runArray[k + 1].begin : numRecords;
+    }
+
+    // The table visits the edges leaving each lower vertex in order of first appearance. Runs
+    // sharing a lower vertex are adjacent and few, so insertion sort each group by first record.
+    const auto lowerVertex = [&](const Run& run) { return sorted[run.begin].key >> vertexBits; };
+    const auto firstRecord = [&](const Run& run) { return sorted[run.begin].record; };
+    const int numRuns = runArray.size();
+    const int runBlockSize = (numRuns + numBlocks - 1) / numBlocks;
+    runConcurrently(0, numBlocks, [&](int b) {
+        // Each block sorts the groups that start inside of it
+        int k = b * runBlockSize;
+        const int end = min(numRuns, (b + 1) * runBlockSize);
+        while ((k > 0) && (k < end) && (lowerVertex(runArray[k]) == lowerVertex(runArray[k - 1]))) {
+            ++k;
+        }
+
+        while (k < end) {
+            const uint64 v = lowerVertex(runArray[k]);
+            int groupEnd = k + 1;
+            while ((groupEnd < numRuns) && (lowerVertex(runArray[groupEnd]) == v)) {
+                const Run run = runArray[groupEnd];
+                int j = groupEnd;
+                while ((j > k) && (firstRecord(runArray[j - 1]) > firstRecord(run))) {
+                    runArray[j] = runArray[j - 1];
+                    --j;
+                }
+                runArray[j] = run;
+                ++groupEnd;
+            }
+            k = groupEnd;
+        }
+    }, singleThread);
+
+    // Pair the faces within each run exactly as computeEdgesWithTable does. localEdge[r] is the
+    // index of record r's edge among the edges created by its run. A face that is
+    // matched to an earlier face's edge is flagged in the low bit so that it sorts after it.
+    Array<int> localEdge;
+    localEdge.resize(numRecords);
+    runConcurrently(0, runArray.size(), [&](int k) {
+        Run& run = runArray[k];
+
+        // Signed face and record. The run is short, so this is usually on the stack.
+        SmallArray<Vector2int32, 4> faceIndexArray;
+        for (int s = run.begin; s < run.end; ++s) {
+            const int r = sorted[s].record;
+            faceIndexArray.push(Vector2int32(signedFace(r), r));
+        }
+
+        int numEdges = 0;
+        while (faceIndexArray.size() > 0) {
+            const Vector2int32 f0 = faceIndexArray.pop();
+            const Vector3& n0 = faceNormal[(f0.x >= 0) ? f0.x : ~f0.x];
+
+            // Find the oppositely oriented face with the closest normal
+            float ndotn = -2;
+            int i1 = -1;
+            for (int i = faceIndexArray.size() - 1; i >= 0; --i) {
+                const int f = faceIndexArray[i].x;
+                if ((f >= 0) != (f0.x >= 0)) {
+                    const float d = faceNormal[(f >= 0) ? f : ~f].dot(n0);
+                    if ((i1 == -1) || (d > ndotn)) {
+                        ndotn = d;
+                        i1    = i;
+                    }
+                }
+            }
+
+            localEdge[f0.y] = numEdges * 2;
+            if (i1 != -1) {
+                localEdge[faceIndexArray[i1].y] = numEdges * 2 + 1;
+                faceIndexArray.fastRemove(i1);
+            }
+            ++numEdges;
+        }
+
+        run.firstEdge = numEdges;
+    });
+
+    // Convert edge counts to the index of each run's first edge
+    int numEdges = 0;
+    for (int k = 0; k < runArray.size(); ++k) {
+        const int n = runArray[k].firstEdge;
+        runArray[k].firstEdge = numEdges;
+        numEdges += n;
+    }
+
+    tempEdgeArray.resize(numEdges);
+
+    // Order in which the edge of each record was assigned to its face: 2 * edge index, plus one if
+    // the face was matched to an edge that another face created.
+    Array<int>& assignmentOrder = localEdge;
+
+    // Each run is processed by a single thread, so there are no write conflicts on its edges
+    runConcurrently(0, runArray.size(), [&](int k) {
+        const Run& run = runArray[k];
+        const int i0 = int(sorted[run.begin].key >> vertexBits);
+        const int i1 = int(sorted[run.begin].key & ((uint64(1) << vertexBits) - 1));
+
+        for (int s = run.begin; s < run.end; ++s) {
+            const int r = sorted[s].record;
+            const int e = run.firstEdge + (localEdge[r] >> 1);
+            Edge& edge = tempEdgeArray[e];
+
+            if ((localEdge[r] & 1) == 0) {
+                // This record created the edge
+                edge.vertexIndex[0] = i0;
+                edge.vertexIndex[1] = i1;
+                edge.faceIndex[0]   = Face::NONE;
+                edge.faceIndex[1]   = Face::NONE;
+            }
+            assignmentOrder[r] = e * 2 + (localEdge[r] & 1);
+        }
+
+        // Fill in the faces after all edges of the run have been initialized
+        for (int s = run.begin; s < run.end; ++s) {
+            const int r = sorted[s].record;
+            Edge& edge = tempEdgeArray[assignmentOrder[r] >> 1];
+            if (isForward(r)) {
+                edge.faceIndex[0] = r / 3;
+            } else {
+                edge.faceIndex[1] = r / 3;
+            }
+        }
+    });
+
+    // Assign edges to face slots in the order that assignEdgeIndex would have
+    runConcurrently(0, faceArray.size(), [&](int f) {
+        int r[3] = {3 * f, 3 * f + 1, 3 * f + 2};
+        if (assignmentOrder[r[1]] < assignmentOrder[r[0]]) { std::swap(r[0], r[1]); }
+        if (assignmentOrder[r[2]] < assignmentOrder[r[1]]) { std::swap(r[1], r[2]); }
+        if (assignmentOrder[r[1]] < assignmentOrder[r[0]]) { std::swap(r[0], r[1]); }
+
+        Face& face = faceArray[f];
+        for (int i = 0; i < 3; ++i) {
+            const int e = assignmentOrder[r[i]] >> 1;
+            face.edgeIndex[i] = isForward(r[i]) ? e : ~e;
+        }
+    });
+}
+
+
+void MeshAlg::computeAdjacency(
+    const Array<Vector3>&   vertexGeometry,
+    const Array<int>&       indexArray,
+    Array<Face>&            faceArray,
+    Array<Edge>&            edgeArray,
+    Array<Vertex>&          vertexArray,
+    bool                    parallelSort) {
+
+    edgeArray.clear();
+    vertexArray.clear();
+    faceArray.clear();
+    
+    // Face normals
+    Array<Vector3> faceNormal;
+    faceNormal.resize(indexArray.size() / 3);
+    faceArray.resize(faceNormal.size());
+
+    // This array has the same size as the vertex array
+    vertexArray.resize(vertexGeometry.size());
+
+    // Iterate through the triangle list
+    for (int q = 0, f = 0; q < indexArray.size(); ++f, q += 3) {
+
+        Vector3 vertex[3];
+        MeshAlg::Face& face = faceArray[f];
+
+        // Construct the face
+        for (int j = 0; j < 3; ++j) {
+            int v = indexArray[q + j];
+            face.vertexIndex[j] = v;
+            face.edgeIndex[j]   = Face::NONE;
+
+            // Store back pointers in the vertices
+            vertexArray[v].faceIndex.append(f);
+
+            // We'll need these vertices to find the face normal
+            vertex[j]           = vertexGeometry[v];
+        }
+
+        // Compute the face normal
+        const Vector3& N = (vertex[1] - vertex[0]).cross(vertex[2] - vertex[0]);
+        faceNormal[f] = N.directionOrZero();
+    }
 
-    edgeTable.clear();
+    Array<Edge> tempEdgeArray;
+    if (parallelSort) {
+        computeEdgesWithSort(indexArray, faceNormal, vertexArray.size(), faceArray, tempEdgeArray);
+    } else {
+        computeEdgesWithTable(indexArray, faceNormal, vertexArray.size(), faceArray, tempEdgeArray);
+    }
 
     // Move boundary edges to the end of the list and then
     // clean up the face references into them
@@ -374,7 +647,7 @@ void MeshAlg::computeAdjacency(
         debugAssertM(i == j + 1, "Counting from front and back of array did not match");
 
         // Fix the faces
-        for (int f = 0; f < faceArray.size(); ++f) {
+        runConcurrently(0, faceArray.size(), [&](int f) {
             Face& face = faceArray[f];
             for (int q = 0; q < 3; ++q) {
                 int e = face.edgeIndex[q];
@@ -386,11 +659,11 @@ void MeshAlg::computeAdjacency(
                     face.edgeIndex[q] = newIndex[e];
                 }
             }
-        }
+        }, ! parallelSort);
     }
 
     // Now order the edge indices inside the faces correctly.
-    for (int f = 0; f < faceArray.size(); ++f) {
+    runConcurrently(0, faceArray.size(), [&](int f) {
         Face& face = faceArray[f];
         int e0 = face.edgeIndex[0];
         int e1 = face.edgeIndex[1];
@@ -413,7 +686,7 @@ void MeshAlg::computeAdjacency(
             face.edgeIndex[1] = e2;
             face.edgeIndex[2] = e1;
         }
-    }
+    }, ! parallelSort);
 
     // Fill out the edge adjacency information in the vertex array
     for (int e = 0; e < edgeArray.size(); ++e) {
@@ -439,20 +712,15 @@ void MeshAlg::weldBoundaryEdges(
     newEdgeIndex.resize(edgeArray.size());
     edgeArray.resize(0);
 
-    // boundaryEdgeIndices[v_low] is an array of the indices of 
-    // all boundary edges whose lower vertex is v_low.
-    Table<int, Array<int> > boundaryEdgeIndices;
+    // The indices of all boundary edges, sorted by their lower vertex (and then by index)
+    // so that edges that might pair are adjacent.
+    Array<int> boundaryEdgeIndices;
 
     // Copy over non-boundary edges to the new array
     for (int e = 0; e < oldEdgeArray.size(); ++e) {
         if (oldEdgeArray[e].boundary()) {
 
-            // Add to the boundary table
-            const int v_low = min(oldEdgeArray[e].vertexIndex[0], oldEdgeArray[e].vertexIndex[1]);
-            if (! boundaryEdgeIndices.containsKey(v_low)) {
-                boundaryEdgeIndices.set(v_low, Array<int>());
-            }
-            boundaryEdgeIndices[v_low].append(e);
+            boundaryEdgeIndices.append(e);
 
             // We'll fill out newEdgeIndex[e] later, when we find pairs
 
@@ -465,12 +733,27 @@ void MeshAlg::weldBoundaryEdges(
         }
     }
 
-
-    // Remove all edges from the table that have pairs.
-    Table<int, Array<int> >::Iterator cur = boundaryEdgeIndices.begin();
-    Table<int, Array<int> >::Iterator end = boundaryEdgeIndices.end();
-    while (cur != end) {
-        Array<int>&     boundaryEdge = cur->value;
+    const auto lowVertex = [&](int e) {
+        return uint32(min(oldEdgeArray[e].vertexIndex[0], oldEdgeArray[e].vertexIndex[1]));
+    };
+    radixSort(boundaryEdgeIndices, lowVertex, 32);
+
+    // Edges that remain unpaired after the first pass
+    Array<int> unpaired;
+
+    // Remove all edges from each group that have pairs.
+    Array<int> boundaryEdge;
+    for (int begin = 0; begin < boundaryEdgeIndices.size(); ) {
+        // Find the group of edges sharing the same lower vertex
+        int end = begin + 1;
+        while ((end < boundaryEdgeIndices.size()) && (lowVertex(boundaryEdgeIndices[end]) == lowVertex(boundaryEdgeIndices[begin]))) {
+            ++end;
+        }
+        boundaryEdge.fastClear();
+        for (int b = begin; b < end; ++b) {
+            boundaryEdge.append(boundaryEdgeIndices[b]);
+        }
+        begin = end;
 
         for (int i = 0; i < boundaryEdge.size(); ++i) {
             int ei = boundaryEdge[i];
@@ -568,24 +851,17 @@ void MeshAlg::weldBoundaryEdges(
                 }
             }
         }
-        ++cur;
+
+        unpaired.append(boundaryEdge);
     }
 
-    // Anything remaining in the table is a real boundary edge; just copy it to
+    // Anything remaining is a real boundary edge; just copy it to
     // the end of the array.
-    cur = boundaryEdgeIndices.begin();
-    end = boundaryEdgeIndices.end();
-    while (cur != end) {
-        Array<int>&     boundaryEdge = cur->value;
-
-        for (int b = 0; b < boundaryEdge.size(); ++b) {
-            const int e = boundaryEdge[b];
+    for (int b = 0; b < unpaired.size(); ++b) {
+        const int e = unpaired[b];
 
-            newEdgeIndex[e] = edgeArray.size();
-            edgeArray.append(oldEdgeArray[e]);
-        }
-
-        ++cur;
+        newEdgeIndex[e] = edgeArray.size();
+        edgeArray.append(oldEdgeArray[e]);
     }
 
     // Finally, fix up edge indices in the face and vertex arrays
@@ -11,20 +11,282 @@
 #include "G3D-base/FileSystem.h"
 #include "G3D-base/stringutils.h"
 #include "G3D-base/ParseError.h"
+#include "G3D-base/System.h"
+#include "G3D-base/Thread.h"
+#include <cstdlib>
+#include <cstring>
 
 namespace G3D {
-    
-ParsePLY::ParsePLY() : vertexData(nullptr), faceArray(nullptr), triStripArray(nullptr) {}
+
+/** Most tasks that one block of vertices or lines is divided into. runConcurrently
+    gives each its own task up to this many. */
+static const int MAX_TASKS_PER_BLOCK = 32;
+
+/** Fewest vertices or lines worth a task of their own */
+static const int MIN_ELEMENTS_PER_TASK = 1024;
+
+/** Bytes of binary face data read at a time */
+static const int FACE_WINDOW_SIZE = 1 << 20;
+
+
+static int numTasksFor(int count) {
+    return clamp(count / MIN_ELEMENTS_PER_TASK, 1, MAX_TASKS_PER_BLOCK);
+}
+
+
+template<class T, bool swapBytes>
+static T loadScalar(const uint8* src) {
+    T value;
+    if (swapBytes) {
+        uint8 b[sizeof(T)];
+        for (size_t i = 0; i < sizeof(T); ++i) {
+            b[i] = src[sizeof(T) - 1 - i];
+        }
+        memcpy(&value, b, sizeof(T));
+    } else {
+        memcpy(&value, src, sizeof(T));
+    }
+    return value;
+}
+
+
+/** Reads one scalar of any type from memory */
+template<bool swapBytes>
+static int loadAsInt(ParsePLY::DataType type, const uint8* src) {
+    switch (type) {
+    case ParsePLY::char_type:
+        return int(loadScalar<int8, swapBytes>(src));
+
+    case ParsePLY::uchar_type:
+        return int(loadScalar<uint8, swapBytes>(src));
+
+    case ParsePLY::short_type:
+        return int(loadScalar<int16, swapBytes>(src));
+
+    case ParsePLY::ushort_type:
+        return int(loadScalar<uint16, swapBytes>(src));
+
+    case ParsePLY::int_type:
+        return int(loadScalar<int32, swapBytes>(src));
+
+    case ParsePLY::uint_type:
+        return int(loadScalar<uint32, swapBytes>(src));
+
+    case ParsePLY::float_type:
+        return int(loadScalar<float32, swapBytes>(src));
+
+    case ParsePLY::double_type:
+        return int(loadScalar<float64, swapBytes>(src));
+
+    default:
+        throw String("Tried to read a list or undefined type as a value type");
+    }
+}
+
+
+/** Converts \a count values of type T that are \a srcStride bytes apart to floats that are
+    \a dstStride floats apart */
+template<class T, bool swapBytes>
+static void decodeColumnAs(const uint8* src, int srcStride, int count, float* dst, int dstStride) {
+    for (int i = 0; i < count; ++i) {
+        dst[i * dstStride] = float(loadScalar<T, swapBytes>(src + i * srcStride));
+    }
+}
+
+
+template<bool swapBytes>
+static void decodeColumn(ParsePLY::DataType type, const uint8* src, int srcStride, int count, float* dst, int dstStride) {
+    switch (type) {
+    case ParsePLY::char_type:
+        decodeColumnAs<int8, swapBytes>(src, srcStride, count, dst, dstStride);
+        break;
+
+    case ParsePLY::uchar_type:
+        decodeColumnAs<uint8, swapBytes>(src, srcStride, count, dst, dstStride);
+        break;
+
+    case ParsePLY::short_type:
+        decodeColumnAs<int16, swapBytes>(src, srcStride, count, dst, dstStride);
+        break;
+
+    case ParsePLY::ushort_type:
+        decodeColumnAs<uint16, swapBytes>(src, srcStride, count, dst, dstStride);
+        break;
+
+    case ParsePLY::int_type:
+        decodeColumnAs<int32, swapBytes>(src, srcStride, count, dst, dstStride);
+        break;
+
+    case ParsePLY::uint_type:
+        decodeColumnAs<uint32, swapBytes>(src, srcStride, count, dst, dstStride);
+        break;
+
+    case ParsePLY::float_type:
+        decodeColumnAs<float32, swapBytes>(src, srcStride, count, dst, dstStride);
+        break;
+
+    case ParsePLY::double_type:
+        decodeColumnAs<float64, swapBytes>(src, srcStride, count, dst, dstStride);
+        break;
+
+    default:
+        throw String("Tried to read a list or undefined type as a value type");
+    }
+}
+
+
+template<class T, bool swapBytes>
+static void decodeIndicesAs(const uint8* src, int count, int* dst) {
+    for (int i = 0; i < count; ++i) {
+        dst[i] = int(loadScalar<T, swapBytes>(src + i * sizeof(T)));
+    }
+}
+
+
+template<bool swapBytes>
+static void decodeIndices(ParsePLY::DataType type, const uint8* src, int count, int* dst) {
+    switch (type) {
+    case ParsePLY::char_type:
+        decodeIndicesAs<int8, swapBytes>(src, count, dst);
+        break;
+
+    case ParsePLY::uchar_type:
+        decodeIndicesAs<uint8, swapBytes>(src, count, dst);
+        break;
+
+    case ParsePLY::short_type:
+        decodeIndicesAs<int16, swapBytes>(src, count, dst);
+        break;
+
+    case ParsePLY::ushort_type:
+        decodeIndicesAs<uint16, swapBytes>(src, count, dst);
+        break;
+
+    case ParsePLY::int_type:
+        decodeIndicesAs<int32, swapBytes>(src, count, dst);
+        break;
+
+    case ParsePLY::uint_type:
+        decodeIndicesAs<uint32, swapBytes>(src, count, dst);
+        break;
+
+    default:
+        throw String("Face indices must have an integer type");
+    }
+}
+
+
+/** Decodes faces whose only property is the index list, beginning with face \a f, until
+    the next face does not fit before \a end. Returns the first byte that was not decoded. */
+template<bool swapBytes>
+static const uint8* decodeFaces
+   (const ParsePLY::Property&   prop,
+    const uint8*                src,
+    const uint8*                end,
+    int                         numFaces,
+    int&                        f,
+    Array<int>&                 faceIndexArray,
+    Array<int>&                 faceStartArray) {
+
+    const int lengthSize  = int(ParsePLY::byteSize(prop.listLengthType));
+    const int elementSize = int(ParsePLY::byteSize(prop.listElementType));
+
+    while ((f < numFaces) && (src + lengthSize <= end)) {
+        const int len = loadAsInt<swapBytes>(prop.listLengthType, src);
+        if (src + lengthSize + int64(len) * elementSize > end) {
+            break;
+        }
+
+        const int start = faceIndexArray.size();
+        faceIndexArray.resize(start + len, false);
+        decodeIndices<swapBytes>(prop.listElementType, src + lengthSize, len, faceIndexArray.getCArray() + start);
+        src += lengthSize + len * elementSize;
+
+        ++f;
+        faceStartArray[f] = faceIndexArray.size();
+    }
+
+    return src;
+}
+
+
+/** Skips spaces and tabs, but not newlines */
+static const char* skipSpace(const char* c) {
+    while ((*c == ' ') || (*c == '\t') || (*c == '\r')) {
+        ++c;
+    }
+    return c;
+}
+
+
+static double parseASCIINumber(const char*& c) {
+    char* next = nullptr;
+    const double value = strtod(c, &next);
+    if (next == c) {
+        throw String("Expected a number in ASCII PLY data");
+    }
+    c = next;
+    return value;
+}
+
+
+/** Consumes one property of an ASCII element. Lists are skipped and read as zero. */
+static float parseASCIIProperty(const ParsePLY::Property& prop, const char*& c) {
+    if (prop.type == ParsePLY::list_type) {
+        const int n = int(parseASCIINumber(c));
+        for (int i = 0; i < n; ++i) {
+            parseASCIINumber(c);
+        }
+        return 0.0f;
+    } else {
+        return float(parseASCIINumber(c));
+    }
+}
+
+
+/** Sets \a lineStart to the beginnings of the next \a count nonblank lines after \a c,
+    and returns the beginning of the line after them. */
+static const char* findLines(const char* c, const char* end, int count, Array<const char*>& lineStart) {
+    lineStart.fastClear();
+    while ((lineStart.size() < count) && (c < end)) {
+        const char* newline = (const char*)memchr(c, '\n', end - c);
+        if (isNull(newline)) {
+            newline = end;
+        }
+        if (skipSpace(c) < newline) {
+            lineStart.append(c);
+        }
+        c = newline + 1;
+    }
+
+    if (lineStart.size() < count) {
+        throw String("ASCII PLY file ended early");
+    }
+    return min(c, end);
+}
+
+
+ParsePLY::ParsePLY() :
+    fileFormat(BINARY_LITTLE_ENDIAN_FORMAT),
+    numVertices(0),
+    numFaces(0),
+    numTriStrips(0),
+    vertexStride(0),
+    vertexData(nullptr),
+    triStripArray(nullptr) {}
 
 
 void ParsePLY::clear() {
     delete[] vertexData;
     vertexData = nullptr;
-    delete[] faceArray;
-    faceArray = nullptr;
+    faceIndexArray.clear();
+    faceStartArray.clear();
     delete[] triStripArray;
     triStripArray = nullptr;
+    vertexProperty.clear();
+    faceOrTriStripProperty.clear();
     numVertices = numFaces = numTriStrips = 0;
+    vertexStride = 0;
 }
 
 
@@ -34,17 +296,36 @@ ParsePLY::~ParsePLY() {
 
 
 void ParsePLY::parse(BinaryInput& bi) {
+    parse(bi, VertexCallback());
+}
+
+
+void ParsePLY::parse(BinaryInput& bi, const VertexCallback& callback) {
     const G3DEndian oldEndian = bi.endian();
 
     clear();
     readHeader(bi);
+    compileVertexLayout();
 
-    vertexData = new float[numVertices * vertexProperty.size()];
-    faceArray = new Face[numFaces];
-    triStripArray = new TriStrip[numTriStrips];
+    if (! callback) {
+        vertexData = new float[size_t(numVertices) * vertexProperty.size()];
+    }
+
+    if (numFaces > 0) {
+        faceStartArray.resize(numFaces + 1);
+        faceStartArray[0] = 0;
+    }
 
-    readVertexList(bi);
-    readFaceList(bi);
+    if (numTriStrips > 0) {
+        triStripArray = new TriStrip[numTriStrips];
+    }
+
+    if (fileFormat == ASCII_FORMAT) {
+        readASCII(bi, callback);
+    } else {
+        readVertexList(bi, callback);
+        readFaceList(bi);
+    }
 
     bi.setEndian(oldEndian);
 }
@@ -59,6 +340,14 @@ ParsePLY::DataType ParsePLY::parseDataType(const char* t) {
         }
     }
 
+    // Sized aliases from PLY 1.0 files written by newer tools
+    static const char* aliases[] = {"int8", "uint8", "int16", "uint16", "int32", "uint32", "float32", "float64", nullptr};
+    for (int i = 0; aliases[i] != nullptr; ++i) {
+        if (strcmp(t, aliases[i]) == 0) {
+            return DataType(i);
+        }
+    }
+
     throw String("Illegal type specifier: ") + t;
     return none_type;
 }
@@ -72,17 +361,17 @@ void ParsePLY::parseProperty(const String& s, Property& prop) {
 
     char temp[100], name[100];
 
-    sscanf(s.c_str(), "%*s %100s", temp);
+    sscanf(s.c_str(), "%*s %99s", temp);
     prop.type = parseDataType(temp);
 
     if (prop.type == list_type) {
         char temp2[100];
         // Read the index and element types
-        sscanf(s.c_str(), "%*s %*s %100s %100s %100s", temp, temp2, name);
+        sscanf(s.c_str(), "%*s %*s %99s %99s %99s", temp, temp2, name);
         prop.listLengthType = parseDataType(temp);
         prop.listElementType = parseDataType(temp2);
     } else {
-        sscanf(s.c_str(), "%*s %*s %100s", name);
+        sscanf(s.c_str(), "%*s %*s %99s", name);
     }
 
     prop.name = name;
@@ -103,15 +392,17 @@ void ParsePLY::readHeader(BinaryInput& bi) {
     }
 
     const String& fmt = bi.readStringNewline();
-    
+
     if (fmt == "format binary_little_endian 1.0") {
         // Default format, nothing to do
+        fileFormat = BINARY_LITTLE_ENDIAN_FORMAT;
         bi.setEndian(G3D_LITTLE_ENDIAN);
     } else if (fmt == "format binary_big_endian 1.0") {
         // Flip the endian
+        fileFormat = BINARY_BIG_ENDIAN_FORMAT;
         bi.setEndian(G3D_BIG_ENDIAN);
     } else if (fmt == "format ascii 1.0") {
-        throw ParseError(bi.getFilename(), bi.getPosition(), "ASCII PLY format is not supported in this release.");
+        fileFormat = ASCII_FORMAT;
     } else {
         throw ParseError(bi.getFilename(), bi.getPosition(), "Unsupported PLY format: " + fmt);
     }
@@ -122,12 +413,12 @@ void ParsePLY::readHeader(BinaryInput& bi) {
 
     String s =  bi.readStringNewline();
     while (s != "end_header") {
-        if (beginsWith(s, "comment ")) {
+        if (beginsWith(s, "comment ") || beginsWith(s, "obj_info ")) {
 
             // Ignore this line
             s = bi.readStringNewline();
 
-        } if (beginsWith(s, "element vertex ")) {
+        } else if (beginsWith(s, "element vertex ")) {
             if (readVertex) {
                 throw String("Already defined vertex.");
             }
@@ -174,6 +465,33 @@ void ParsePLY::readHeader(BinaryInput& bi) {
 }
 
 
+void ParsePLY::compileVertexLayout() {
+    vertexStride = 0;
+    for (Property& prop : vertexProperty) {
+        if (prop.type == list_type) {
+            // Records are variable length
+            vertexStride = 0;
+            return;
+        }
+        prop.byteOffset = vertexStride;
+        vertexStride += int(byteSize(prop.type));
+    }
+}
+
+
+int ParsePLY::findIndexProperty(BinaryInput& bi) const {
+    for (int p = 0; p < faceOrTriStripProperty.size(); ++p) {
+        if ((faceOrTriStripProperty[p].type == list_type) &&
+            ((faceOrTriStripProperty[p].name == "vertex_index") ||
+             (faceOrTriStripProperty[p].name == "vertex_indices"))) {
+            return p;
+        }
+    }
+
+    throw ParseError(bi.getFilename(), bi.getPosition(), "No vertex_index or vertex_indices property on faces in this PLY file");
+}
+
+
 template<class T>
 static T readAs(ParsePLY::DataType type, BinaryInput& bi) {
     switch (type) {
@@ -244,80 +562,238 @@ float ParsePLY::readAsFloat(const Property& prop, BinaryInput& bi) {
 }
 
 
-void ParsePLY::readVertexList(BinaryInput& bi) {
+void ParsePLY::readVertexList(BinaryInput& bi, const VertexCallback& callback) {
     const int N = vertexProperty.size();
-    int i = 0;
-    for (int v = 0; v < numVertices; ++v) {
-        for (int p = 0; p < N; ++p) {
-            vertexData[i] = readAsFloat(vertexProperty[p], bi);
-            ++i;
+    const bool swapBytes = (bi.endian() != System::machineEndian());
+
+    // Decoded vertices when streaming
+    Array<float> block;
+    if (callback) {
+        block.resize(min(numVertices, VERTEX_BLOCK_SIZE) * N);
+    }
+
+    // Raw records of one block
+    Array<uint8> record;
+
+    for (int first = 0; first < numVertices; first += VERTEX_BLOCK_SIZE) {
+        const int count = min(VERTEX_BLOCK_SIZE, numVertices - first);
+        float* dst = callback ? block.getCArray() : vertexData + size_t(first) * N;
+
+        if (vertexStride > 0) {
+            // Fixed layout: read the block at once and convert each property's column
+            record.resize(count * vertexStride, false);
+            bi.readBytes(record.getCArray(), record.size());
+
+            const int numTasks = numTasksFor(count);
+            runConcurrently(0, numTasks, [&](int t) {
+                const int begin = int(int64(count) * t / numTasks);
+                const int end   = int(int64(count) * (t + 1) / numTasks);
+                for (int p = 0; p < N; ++p) {
+                    const Property& prop = vertexProperty[p];
+                    const uint8* src = record.getCArray() + begin * vertexStride + prop.byteOffset;
+                    if (swapBytes) {
+                        decodeColumn<true>(prop.type, src, vertexStride, end - begin, dst + begin * N + p, N);
+                    } else {
+                        decodeColumn<false>(prop.type, src, vertexStride, end - begin, dst + begin * N + p, N);
+                    }
+                }
+            }, numTasks == 1);
+        } else {
+            // Variable-length records must be read one value at a time
+            int i = 0;
+            for (int v = 0; v < count; ++v) {
+                for (int p = 0; p < N; ++p) {
+                    dst[i] = readAsFloat(vertexProperty[p], bi);
+                    ++i;
+                }
+            }
+        }
+
+        if (callback) {
+            callback(first, count, dst);
         }
     }
 }
 
 
 void ParsePLY::readFaceList(BinaryInput& bi) {
-    // How many properties are there before and after
-    // the vertex_index list?
-    int numBefore = 0, numAfter = faceOrTriStripProperty.size() - 2;
+    // Only one of these is nonzero
+    const int num = max(numFaces, numTriStrips);
+    if (num == 0) {
+        return;
+    }
 
-    bool found = false;
-    for (int p = 0; p < faceOrTriStripProperty.size(); ++p) {
-        if ((faceOrTriStripProperty[p].name == "vertex_index") || 
-            (faceOrTriStripProperty[p].name == "vertex_indices")) {
-            found = true;
-        } else {
-            ++numBefore;
-            --numAfter;
+    const int indexProperty = findIndexProperty(bi);
+
+    if ((numFaces > 0) && (faceOrTriStripProperty.size() == 1)) {
+        // Each face is only its index list, so decode a window of the file at a time
+        const bool swapBytes = (bi.endian() != System::machineEndian());
+        const Property& prop = faceOrTriStripProperty[indexProperty];
+
+        // Triangles are the common case
+        faceIndexArray.reserve(numFaces * 3);
+
+        Array<uint8> window;
+        int64 remaining = bi.getLength() - bi.getPosition();
+        int used = 0;
+        int f = 0;
+        while (f < numFaces) {
+            if (remaining == 0) {
+                throw ParseError(bi.getFilename(), bi.getPosition(), "PLY file ended before the last face");
+            }
+
+            // Keep the partial face at the end of the window and append the next part of the file
+            const int tail = window.size() - used;
+            memmove(window.getCArray(), window.getCArray() + used, tail);
+            const int n = int(min(remaining, int64(FACE_WINDOW_SIZE)));
+            window.resize(tail + n, false);
+            bi.readBytes(window.getCArray() + tail, n);
+            remaining -= n;
+
+            const uint8* begin = window.getCArray();
+            const uint8* end = begin + window.size();
+            const uint8* next = swapBytes ?
+                decodeFaces<true>(prop, begin, end, numFaces, f, faceIndexArray, faceStartArray) :
+                decodeFaces<false>(prop, begin, end, numFaces, f, faceIndexArray, faceStartArray);
+            used = int(next - begin);
         }
+        return;
     }
 
-    if (! found) {
-        throw ParseError(bi.getFilename(), bi.getPosition(), "No vertex_index or vertex_indices property on faces in this PLY file");
-    }
+    for (int f = 0; f < num; ++f) {
+        for (int p = 0; p < faceOrTriStripProperty.size(); ++p) {
+            const Property& prop = faceOrTriStripProperty[p];
+            if (p != indexProperty) {
+                // Ignore other properties.  Each one might contain lists and therefore
+                // have variable length, so we actually have to parse this data even
+                // though we throw it away.
+                (void)readAsFloat(prop, bi);
+                continue;
+            }
 
-    // Only one of these is nonzero
-    const int num = max(numFaces, numTriStrips);
+            const int len = readAs<int>(prop.listLengthType, bi);
 
-    for (int f = 0; f < num; ++f) {
-        int p = 0;
-        // Ignore properties before.  Each one might contain lists and therefore
-        // have variable length, so we actually have to parse this data even
-        // though we throw it away.
-        for (int i = 0; i < numBefore; ++i) {
-            (void)readAsFloat(faceOrTriStripProperty[p], bi);
-            ++p;
+            if (numFaces > 0) {
+                // Read one face
+                for (int i = 0; i < len; ++i) {
+                    const int index = readAs<int>(prop.listElementType, bi);
+                    debugAssert(index >= 0 && index < numVertices);
+                    faceIndexArray.append(index);
+                }
+                faceStartArray[f + 1] = faceIndexArray.size();
+            } else {
+                // Read one tristrip
+                TriStrip& triStrip = triStripArray[f];
+                for (int i = 0; i < len; ++i) {
+                    const int index = readAs<int>(prop.listElementType, bi);
+                    debugAssert(index >= -1 && index < numVertices);  // -1 = "restart tristrip"
+                    triStrip.append(index);
+                }
+            }
         }
+    }
+}
 
-        // Now read the index list
-        const Property& prop = faceOrTriStripProperty[p];
-        const int len = readAs<int>(prop.listLengthType, bi);
-
-        if (numFaces > 0) {
-            // Read one face
-            Face& face = faceArray[f];
-            for (int i = 0; i < len; ++i) {
-                const int index = readAs<int>(prop.listElementType, bi);
-                debugAssert(index >= 0 && index < numVertices);
-                face.append(index);
-            }
-        } else {
-            // Read one tristrip
-            TriStrip& triStrip = triStripArray[f];
-            for (int i = 0; i < len; ++i) {
-                const int index = readAs<int>(prop.listElementType, bi);
-                debugAssert(index >= -1 && index < numVertices);  // -1 = "restart tristrip"
-                triStrip.append(index);
+
+void ParsePLY::readASCII(BinaryInput& bi, const VertexCallback& callback) {
+    // The rest of the file, null terminated so that number parsing stops at the end
+    const int64 length = bi.getLength() - bi.getPosition();
+    Array<char> text;
+    text.resize(size_t(length + 1));
+    bi.readBytes(text.getCArray(), length);
+    text[int(length)] = '\0';
+
+    const char* c = text.getCArray();
+    const char* end = c + length;
+
+    // Each element is on its own line, so one sequential pass finds the lines of a block
+    // and then they are parsed concurrently
+    Array<const char*> lineStart;
+
+    const int N = vertexProperty.size();
+    Array<float> block;
+    if (callback) {
+        block.resize(min(numVertices, VERTEX_BLOCK_SIZE) * N);
+    }
+
+    for (int first = 0; first < numVertices; first += VERTEX_BLOCK_SIZE) {
+        const int count = min(VERTEX_BLOCK_SIZE, numVertices - first);
+        float* dst = callback ? block.getCArray() : vertexData + size_t(first) * N;
+        c = findLines(c, end, count, lineStart);
+
+        const int numTasks = numTasksFor(count);
+        runConcurrently(0, numTasks, [&](int t) {
+            const int taskEnd = int(int64(count) * (t + 1) / numTasks);
+            for (int v = int(int64(count) * t / numTasks); v < taskEnd; ++v) {
+                const char* s = lineStart[v];
+                for (int p = 0; p < N; ++p) {
+                    dst[v * N + p] = parseASCIIProperty(vertexProperty[p], s);
+                }
             }
+        }, numTasks == 1);
+
+        if (callback) {
+            callback(first, count, dst);
         }
+    }
 
-        // Ignore properties after
-        for (int i = 0; i < numAfter; ++i) {
-            (void)readAsFloat(faceOrTriStripProperty[p], bi);
-            ++p;
+    // Only one of these is nonzero
+    const int num = max(numFaces, numTriStrips);
+    if (num == 0) {
+        return;
+    }
+    const int indexProperty = findIndexProperty(bi);
+
+    // Indices and lengths parsed by each task, which are concatenated in order
+    Array<int> taskIndex[MAX_TASKS_PER_BLOCK];
+    Array<int> taskLength[MAX_TASKS_PER_BLOCK];
+
+    for (int first = 0; first < num; first += VERTEX_BLOCK_SIZE) {
+        const int count = min(VERTEX_BLOCK_SIZE, num - first);
+        c = findLines(c, end, count, lineStart);
+
+        const int numTasks = numTasksFor(count);
+        runConcurrently(0, numTasks, [&](int t) {
+            Array<int>& index = taskIndex[t];
+            Array<int>& length = taskLength[t];
+            index.fastClear();
+            length.fastClear();
+            const int taskEnd = int(int64(count) * (t + 1) / numTasks);
+            for (int f = int(int64(count) * t / numTasks); f < taskEnd; ++f) {
+                const char* s = lineStart[f];
+                for (int p = 0; p < faceOrTriStripProperty.size(); ++p) {
+                    if (p == indexProperty) {
+                        const int len = int(parseASCIINumber(s));
+                        length.append(len);
+                        for (int i = 0; i < len; ++i) {
+                            index.append(int(parseASCIINumber(s)));
+                        }
+                    } else {
+                        (void)parseASCIIProperty(faceOrTriStripProperty[p], s);
+                    }
+                }
+            }
+        }, numTasks == 1);
+
+        int f = first;
+        for (int t = 0; t < numTasks; ++t) {
+            if (numFaces > 0) {
+                faceIndexArray.append(taskIndex[t]);
+                for (const int len : taskLength[t]) {
+                    faceStartArray[f + 1] = faceStartArray[f] + len;
+                    ++f;
+                }
+            } else {
+                const int* index = taskIndex[t].getCArray();
+                for (const int len : taskLength[t]) {
+                    triStripArray[f].resize(len);
+                    memcpy(triStripArray[f].getCArray(), index, sizeof(int) * len);
+                    index += len;
+                    ++f;
+                }
+            }
         }
     }
 }
 
 } // G3D
-
@@ -0,0 +1,458 @@
+/**
+  \file G3D-base.lib/source/WebFrameStreamer.cpp
+
+  G3D Innovation Engine http://casual-effects.com/g3d
+  Copyright 2000-2019, Morgan McGuire
+  All rights reserved
+  Available under the BSD License
+*/
+#include "G3D-base/WebFrameStreamer.h"
+#include "G3D-base/Any.h"
+#include "G3D-base/BinaryOutput.h"
+#include "G3D-base/CPUPixelTransferBuffer.h"
+#include "G3D-base/ImageFormat.h"
+#include "G3D-base/TextInput.h"
+#include "G3D-base/Thread.h"
+#include "G3D-base/System.h"
+
+namespace G3D {
+
+WebFrameStreamer::WebFrameStreamer(const Specification& specification) :
+    m_specification(specification),
+    m_quit(false),
+    m_pendingSubmitTime(0),
+    m_frameCounter(0) {
+
+    alwaysAssertM((specification.fileFormat == Image::PNG) || (specification.fileFormat == Image::JPEG),
+        "Only PNG and JPEG are supported by web browsers");
+    alwaysAssertM(specification.maxFramesInFlight >= 1, "maxFramesInFlight must be at least 1");
+    alwaysAssertM(specification.numSenderThreads >= 1, "numSenderThreads must be at least 1");
+
+    m_encoderThread = std::thread([this]() { encoderThreadMain(); });
+    for (int i = 0; i < specification.numSenderThreads; ++i) {
+        m_senderThreadArray.append(std::make_shared<std::thread>([this]() { senderThreadMain(); }));
+    }
+}
+
+
+shared_ptr<WebFrameStreamer> WebFrameStreamer::create(const Specification& specification) {
+    return createShared<WebFrameStreamer>(specification);
+}
+
+
+WebFrameStreamer::~WebFrameStreamer() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_quit = true;
+    }
+    m_encoderCondition.notify_all();
+    m_senderCondition.notify_all();
+
+    m_encoderThread.join();
+    for (const shared_ptr<std::thread>& thread : m_senderThreadArray) {
+        thread->join();
+    }
+}
+
+
+const char* WebFrameStreamer::mimeType() const {
+    return (m_specification.fileFormat == Image::PNG) ? "image/png" : "image/jpeg";
+}
+
+
+void WebFrameStreamer::submitFrame(const shared_ptr<Image>& image) {
+    debugAssert(notNull(image));
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        ++m_stats.framesSubmitted;
+        if (notNull(m_pendingImage)) {
+            // The encoder never reached the previous frame
+            ++m_stats.framesDropped;
+        }
+        m_pendingImage = image;
+        m_pendingSubmitTime = System::time();
+    }
+    m_encoderCondition.notify_one();
+}
+
+
+bool WebFrameStreamer::hasClients() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_clientArray.size() > 0;
+}
+
+
+shared_ptr<WebFrameStreamer::ClientState> WebFrameStreamer::findClient(const shared_ptr<WebServer::WebSocket>& socket) const {
+    for (const shared_ptr<ClientState>& client : m_clientArray) {
+        if (client->socket == socket) {
+            return client;
+        }
+    }
+    return nullptr;
+}
+
+
+void WebFrameStreamer::addClient(const shared_ptr<WebServer::WebSocket>& socket) {
+    debugAssert(notNull(socket));
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (notNull(findClient(socket))) {
+        return;
+    }
+
+    const shared_ptr<ClientState>& client = std::make_shared<ClientState>();
+    client->socket = socket;
+    client->stats.clientAddress = socket->clientAddress;
+    m_clientArray.append(client);
+
+    // Send the most recent frame immediately instead of waiting for the next change
+    scheduleIfReady(client);
+}
+
+
+void WebFrameStreamer::removeClient(const shared_ptr<WebServer::WebSocket>& socket) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (int c = 0; c < m_clientArray.size(); ++c) {
+        if (m_clientArray[c]->socket == socket) {
+            // A sender thread that already holds the client will see the flag and drop it
+            m_clientArray[c]->closed = true;
+            m_clientArray.remove(c);
+            return;
+        }
+    }
+}
+
+
+bool WebFrameStreamer::onClientData(const shared_ptr<WebServer::WebSocket>& socket, WebServer::WebSocket::Opcode opcode, const char* data, size_t dataLen) {
+    if ((opcode != WebServer::WebSocket::TEXT) || (dataLen < 2) || (data[0] != '{')) {
+        return false;
+    }
+
+    int type = 0;
+    int frame = -1;
+    try {
+        TextInput t(TextInput::FROM_STRING, data, dataLen);
+        const Any msg(t);
+        type = msg.get("type", 0);
+        if (type == ACKNOWLEDGE) {
+            frame = msg.get("frame", -1);
+        }
+    } catch (...) {
+        return false;
+    }
+
+    if (type != ACKNOWLEDGE) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const shared_ptr<ClientState>& client = findClient(socket);
+    if (notNull(client)) {
+        acknowledge(*client, frame);
+        scheduleIfReady(client);
+    }
+    return true;
+}
+
+
+void WebFrameStreamer::acknowledge(ClientState& client, int frame) {
+    const RealTime now = System::time();
+
+    // Acknowledging a frame also acknowledges every earlier one. An acknowledgement
+    // without a frame number retires the oldest frame in flight.
+    while ((client.inFlight.size() > 0) && ((frame < 0) || (client.inFlight[0].frame <= frame))) {
+        const InFlightFrame& sent = client.inFlight.popFront();
+        ClientStats& stats = client.stats;
+        ++stats.framesAcknowledged;
+        stats.averageRoundTrip += ((now - sent.sendTime) - stats.averageRoundTrip) / stats.framesAcknowledged;
+        if (frame < 0) {
+            break;
+        }
+    }
+}
+
+
+void WebFrameStreamer::scheduleIfReady(const shared_ptr<ClientState>& client) {
+    if (! client->scheduled &&
+        ! client->closed &&
+        notNull(m_latestFrame) &&
+        (m_latestFrame->frame > client->lastSentFrame) &&
+        (client->inFlight.size() < m_specification.maxFramesInFlight)) {
+
+        client->scheduled = true;
+        m_readyClients.pushBack(client);
+        m_senderCondition.notify_one();
+    }
+}
+
+
+shared_ptr<WebFrameStreamer::EncodedFrame> WebFrameStreamer::encode(const shared_ptr<Image>& image, const shared_ptr<EncodedFrame>& previous, int frame) {
+    const shared_ptr<PixelTransferBuffer>& pixels = image->toPixelTransferBuffer();
+    const ImageFormat* imageFormat = pixels->format();
+    const int width  = image->width();
+    const int height = image->height();
+    const int tileSize = (m_specification.tileSize > 0) ? m_specification.tileSize : max(1, width, height);
+    const int tilesX = (width + tileSize - 1) / tileSize;
+    const int tilesY = (height + tileSize - 1) / tileSize;
+    const size_t bytesPerPixel = iCeil(imageFormat->cpuBitsPerPixel / 8.0f);
+
+    // Compare against the previous frame only when every tile lines up
+    const bool comparable = notNull(previous) && notNull(m_previousPixels) &&
+        (previous->width == width) && (previous->height == height) &&
+        (previous->tileArray.size() == tilesX * tilesY) && (m_previousPixels->format() == imageFormat);
+
+    const shared_ptr<EncodedFrame>& result = std::make_shared<EncodedFrame>();
+    result->frame  = frame;
+    result->width  = width;
+    result->height = height;
+    result->tileArray.resize(tilesX * tilesY);
+
+    const uint8* current = static_cast<const uint8*>(pixels->mapRead());
+    const uint8* old     = comparable ? static_cast<const uint8*>(m_previousPixels->mapRead()) : nullptr;
+
+    Array<int> changed;
+    for (int ty = 0; ty < tilesY; ++ty) {
+        for (int tx = 0; tx < tilesX; ++tx) {
+            const int t = tx + ty * tilesX;
+            EncodedTile& tile = result->tileArray[t];
+            tile.x = tx * tileSize;
+            tile.y = ty * tileSize;
+            tile.width  = min(tileSize, width - tile.x);
+            tile.height = min(tileSize, height - tile.y);
+
+            bool same = comparable;
+            const size_t rowBytes = tile.width * bytesPerPixel;
+            for (int y = tile.y; same && (y < tile.y + tile.height); ++y) {
+                same = (memcmp(current + y * pixels->stride() + tile.x * bytesPerPixel,
+                               old + y * m_previousPixels->stride() + tile.x * bytesPerPixel, rowBytes) == 0);
+            }
+
+            if (same) {
+                // Share the previous encoding
+                tile = previous->tileArray[t];
+            } else {
+                tile.version = frame;
+                changed.append(t);
+            }
+        }
+    }
+
+    if (changed.size() > 0) {
+        runConcurrently(0, changed.size(), [&](int i) {
+            EncodedTile& tile = result->tileArray[changed[i]];
+            const size_t rowBytes = tile.width * bytesPerPixel;
+            const shared_ptr<CPUPixelTransferBuffer>& tileBuffer = CPUPixelTransferBuffer::create(tile.width, tile.height, imageFormat);
+            uint8* dst = static_cast<uint8*>(tileBuffer->buffer());
+            for (int y = 0; y < tile.height; ++y) {
+                System::memcpy(dst + y * tileBuffer->stride(), current + (tile.y + y) * pixels->stride() + tile.x * bytesPerPixel, rowBytes);
+            }
+
+            BinaryOutput bo("<memory>", G3D_LITTLE_ENDIAN);
+            Image::fromPixelTransferBuffer(tileBuffer)->serialize(bo, m_specification.fileFormat);
+            tile.data = std::make_shared<Array<uint8>>();
+            tile.data->resize((int)bo.size());
+            System::memcpy(tile.data->getCArray(), bo.getCArray(), (size_t)bo.size());
+        });
+    }
+
+    pixels->unmap();
+    if (comparable) {
+        m_previousPixels->unmap();
+    }
+
+    if (changed.size() == 0) {
+        // m_previousPixels is identical to this frame, so there is no need to replace it
+        return nullptr;
+    }
+
+    m_previousPixels = pixels;
+    return result;
+}
+
+
+void WebFrameStreamer::encoderThreadMain() {
+    while (true) {
+        shared_ptr<Image> image;
+        shared_ptr<EncodedFrame> previous;
+        RealTime submitTime = 0;
+        int frame = 0;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_encoderCondition.wait(lock, [this]() { return m_quit || notNull(m_pendingImage); });
+            if (m_quit) {
+                return;
+            }
+            image = m_pendingImage;
+            m_pendingImage.reset();
+            submitTime = m_pendingSubmitTime;
+            previous = m_latestFrame;
+            frame = m_frameCounter + 1;
+        }
+
+        // Encode without holding the lock, so that the render thread and the senders are never blocked
+        const RealTime start = System::time();
+        const shared_ptr<EncodedFrame>& encoded = encode(image, previous, frame);
+        const RealTime encodeTime = System::time() - start;
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (isNull(encoded)) {
+            ++m_stats.framesUnchanged;
+            continue;
+        }
+
+        int tilesEncoded = 0;
+        for (const EncodedTile& tile : encoded->tileArray) {
+            if (tile.version == frame) {
+                ++tilesEncoded;
+            }
+        }
+
+        ++m_stats.framesEncoded;
+        m_stats.tilesEncoded += tilesEncoded;
+        m_stats.tilesReused  += encoded->tileArray.size() - tilesEncoded;
+        m_stats.averageEncodeTime += (encodeTime - m_stats.averageEncodeTime) / m_stats.framesEncoded;
+        m_stats.maxEncodeTime = max(m_stats.maxEncodeTime, encodeTime);
+
+        encoded->submitTime = submitTime;
+        m_frameCounter = frame;
+        m_latestFrame = encoded;
+
+        for (const shared_ptr<ClientState>& client : m_clientArray) {
+            scheduleIfReady(client);
+        }
+    }
+}
+
+
+void WebFrameStreamer::senderThreadMain() {
+    while (true) {
+        shared_ptr<ClientState> client;
+        shared_ptr<EncodedFrame> frame;
+        Array<int> tileIndex;
+        int previousSentFrame = 0;
+        int skipped = 0;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_senderCondition.wait(lock, [this]() { return m_quit || (m_readyClients.size() > 0); });
+            if (m_quit) {
+                return;
+            }
+
+            client = m_readyClients.popFront();
+            if (client->closed) {
+                client->scheduled = false;
+                continue;
+            }
+
+            frame = m_latestFrame;
+            if ((client->width != frame->width) || (client->height != frame->height) || (client->tileVersion.size() != frame->tileArray.size())) {
+                // New client or resized frame: send every tile
+                client->width  = frame->width;
+                client->height = frame->height;
+                client->tileVersion.resize(frame->tileArray.size());
+                client->tileVersion.setAll(-1);
+            }
+
+            // Send every tile that changed since this client's last frame, which
+            // coalesces all of the frames that it skipped
+            for (int t = 0; t < frame->tileArray.size(); ++t) {
+                if (client->tileVersion[t] != frame->tileArray[t].version) {
+                    client->tileVersion[t] = frame->tileArray[t].version;
+                    tileIndex.append(t);
+                }
+            }
+
+            previousSentFrame = client->lastSentFrame;
+            skipped = (client->lastSentFrame > 0) ? frame->frame - client->lastSentFrame - 1 : 0;
+            client->stats.framesSkipped += skipped;
+            client->lastSentFrame = frame->frame;
+
+            // Record the frame before sending, in case the acknowledgement arrives before send() returns
+            if (m_specification.requireAcknowledgement) {
+                InFlightFrame sent;
+                sent.frame = frame->frame;
+                sent.sendTime = System::time();
+                client->inFlight.pushBack(sent);
+            }
+        }
+
+        // Build and send the message without holding the lock
+        BinaryOutput bo("<memory>", G3D_BIG_ENDIAN);
+        String header;
+        if (m_specification.tileSize > 0) {
+            header = format("{\"type\":%d,\"frame\":%d,\"width\":%d,\"height\":%d,\"mimeType\":\"%s\",\"tiles\":[",
+                            TILES, frame->frame, frame->width, frame->height, mimeType());
+            for (int i = 0; i < tileIndex.size(); ++i) {
+                const EncodedTile& tile = frame->tileArray[tileIndex[i]];
+                header += format("%s[%d,%d,%d,%d,%d]", (i > 0) ? "," : "", tile.x, tile.y, tile.width, tile.height, tile.data->size());
+            }
+            header += "]}";
+        } else {
+            header = format("{\"type\":%d,\"frame\":%d,\"width\":%d,\"height\":%d,\"mimeType\":\"%s\"}",
+                            IMAGE, frame->frame, frame->width, frame->height, mimeType());
+        }
+
+        // JSON header length (in network byte order), JSON header, and then the binary data
+        bo.writeInt32((int32)header.length());
+        bo.writeString(header, (int32)header.length());
+        for (const int t : tileIndex) {
+            const shared_ptr<Array<uint8>>& data = frame->tileArray[t].data;
+            bo.writeBytes(data->getCArray(), data->size());
+        }
+
+        const int bytes = client->socket->send(bo);
+        const RealTime now = System::time();
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        client->scheduled = false;
+        if (bytes > 0) {
+            ClientStats& stats = client->stats;
+            ++stats.framesSent;
+            stats.bytesSent += bytes;
+            stats.averageLatency += ((now - frame->submitTime) - stats.averageLatency) / stats.framesSent;
+            stats.maxLatency = max(stats.maxLatency, now - frame->submitTime);
+
+            client->recentSends.pushBack(std::pair<RealTime, size_t>(now, size_t(bytes)));
+            client->recentBytes += bytes;
+            while (client->recentSends[0].first < now - m_specification.bandwidthWindow) {
+                client->recentBytes -= client->recentSends.popFront().second;
+            }
+            stats.bytesPerSecond = double(client->recentBytes) / m_specification.bandwidthWindow;
+
+            if (! m_specification.requireAcknowledgement) {
+                ++stats.framesAcknowledged;
+            }
+        } else {
+            // The client did not receive these tiles, so the next frame must send all of them.
+            // Forget this send so that scheduleIfReady resends the latest frame now instead of
+            // waiting for a newer one, which a static scene never submits.
+            client->tileVersion.setAll(-1);
+            client->lastSentFrame = previousSentFrame;
+            client->stats.framesSkipped -= skipped;
+            if ((client->inFlight.size() > 0) && (client->inFlight.last().frame == frame->frame)) {
+                client->inFlight.popBack();
+            }
+        }
+
+        // A newer frame may have arrived while this one was being sent
+        scheduleIfReady(client);
+    }
+}
+
+
+WebFrameStreamer::Stats WebFrameStreamer::stats() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
+
+
+void WebFrameStreamer::getClientStats(Array<ClientStats>& clientStatsArray) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    clientStatsArray.fastClear();
+    for (const shared_ptr<ClientState>& client : m_clientArray) {
+        ClientStats& stats = clientStatsArray.next();
+        stats = client->stats;
+        stats.framesInFlight = client->inFlight.size();
+    }
+}
+
+} // namespace G3D
@@ -111,10 +111,15 @@ void WebServer::websocket_close_handler(const struct mg_connection* connection,
     debugAssert(userdata);
     WebServer::SocketScheme* socketScheme = reinterpret_cast<WebServer::SocketScheme*>(userdata);
     WebServer* webServer = socketScheme->webServer;
-    webServer->onWebSocketClose(webServer->socketFromConnection(const_cast<mg_connection*>(connection)));
+    const shared_ptr<WebSocket>& webSocket = webServer->socketFromConnection(const_cast<mg_connection*>(connection));
+    webServer->onWebSocketClose(webSocket);
 
-    // Drop the connection from the table
+    // Drop the connection from both sets
     webServer->m_socketTableMutex.lock();
+    const int index = socketScheme->webSocketArray.findIndex(webSocket);
+    if (index != -1) {
+        socketScheme->webSocketArray.fastRemove(index);
+    }
     webServer->m_socketTable.remove(const_cast<mg_connection*>(connection));
     webServer->m_socketTableMutex.unlock();
 }
@@ -173,11 +178,12 @@ void WebServer::getWebSocketArray(const String& uri, Array<shared_ptr<WebSocket>
         socketScheme = *socketSchemePtr;
     }
 
-    m_socketTableMutex.unlock();
-
+    // Copy while locked because the close handler removes sockets
     if (notNull(socketScheme)) {
         array = socketScheme->webSocketArray;
     }
+
+    m_socketTableMutex.unlock();
 }
 
 
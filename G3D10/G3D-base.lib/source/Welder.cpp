@@ -19,6 +19,9 @@
 #include "G3D-base/stringutils.h"
 #include "G3D-base/BinaryInput.h"
 #include "G3D-base/BinaryOutput.h"
+#include "G3D-base/Thread.h"
+#include "G3D-base/radixSort.h"
+#include <algorithm>
 
 namespace G3D { namespace _internal{
 
@@ -93,38 +96,37 @@ private:
 
     float                   normalSmoothingAngle;
 
+    /** True if the vertex (\a v, \a n, \a t) may weld to the earlier output vertex (\a cv, \a cn, \a ct).
+        Not symmetric: a zero \a n matches any normal, but a zero \a cn does not. */
+    bool matches(const Vector3& v, const Vector3& n, const Vector2& t, const Vector3& cv, const Vector3& cn, const Vector2& ct) const {
+        return ((v - cv).squaredLength() <= square(vertexWeldRadius)) &&
+            (n.isZero() || ((n - cn).squaredLength() <= normalWeldRadius2)) &&
+            ((t - ct).squaredLength() <= texCoordWeldRadius2);
+    }
+
     /**
      Returns the index of the vertex in 
      outputVertexArray/outputNormalArray/outputTexCoordArray
      that is within the global tolerances of v,n,t. If there 
+     is more than one, returns the one created first, so that the
+     result does not depend on the order of the hash grid. If there 
      is no such vertex, adds it to the arrays and returns that index.
 
-     Called from updateTriLists().
+     Called from weldSerial().
      */
     int getIndex(const Vector3& v, const Vector3& n, const Vector2& t) {
-        PointHashGrid<VNTi>::SphereIterator it = 
-                weldGrid.begin(Sphere(v, vertexWeldRadius));
-
-        if (n.isZero()) {
-            // Don't bother trying to match the surface normal, since this vertex has no surface normal.
-            while (it.isValid()) {
-                if ((t - it->texCoord).squaredLength() <= texCoordWeldRadius2) {
-                    // This is the vertex
-                    return it->index;
-                }
-                ++it;
-            }
-        } else {
-            while (it.isValid()) {
-                if (((n - it->normal).squaredLength() <= normalWeldRadius2) &&
-                    ((t - it->texCoord).squaredLength() <= texCoordWeldRadius2)) {
-                    // This is the vertex
-                    return it->index;
-                }
-                ++it;
+        int best = INT_MAX;
+        for (PointHashGrid<VNTi>::SphereIterator it = weldGrid.begin(Sphere(v, vertexWeldRadius)); it.isValid(); ++it) {
+            if ((it->index < best) && matches(v, n, t, it->vertex, it->normal, it->texCoord)) {
+                best = it->index;
             }
         }
 
+        if (best < INT_MAX) {
+            // This is the vertex
+            return best;
+        }
+
         // Note that a sliver triangle processed before its neighbors may reach here
         // with a zero length normal.
 
@@ -141,6 +143,179 @@ private:
     }
 
 
+    /** Single-threaded reference implementation of welding. Sets outputIndex[u] to the
+        output vertex for unrolled vertex u, extending the output arrays. */
+    void weldSerial
+    (const Array<Vector3>&       vertexArray,
+     const Array<Vector3>&       normalArray,
+     const Array<Vector2>&       texCoordArray,
+     Array<int>&                 outputIndex) {
+
+        // Compute a hash grid so that we can find neighbors quickly.
+        // It begins empty and is extended as the vertices are iterated
+        // through.
+        weldGrid.clear();
+        outputIndex.resize(vertexArray.size());
+        for (int u = 0; u < vertexArray.size(); ++u) {
+            outputIndex[u] = getIndex(vertexArray[u], normalArray[u], texCoordArray[u]);
+        }
+    }
+
+
+    /** Key of the grid cell of width \a cellSize that contains \a p. Distinct cells may
+        share a key; that only makes a neighbor search test extra vertices. */
+    static uint64 cellKey(const Vector3& p, float cellSize, int dx = 0, int dy = 0, int dz = 0) {
+        uint64 key = 0;
+        for (int a = 0; a < 3; ++a) {
+            // Non-finite positions never weld, so any cell will do for them
+            const float c = p[a] / cellSize;
+            const int64 i = (isFinite(c) ? int64(floor(clamp(c, -1e15f, 1e15f))) : 0) + ((a == 0) ? dx : (a == 1) ? dy : dz);
+            key = (key ^ uint64(i)) * 0x100000001b3ull;
+        }
+        return key;
+    }
+
+
+    /**
+     Parallel implementation of weldSerial() with identical output.
+
+     Unrolled vertex u welds to the lowest-indexed earlier vertex that both matches it and
+     created an output vertex; otherwise u creates one. Vertices are sorted by cells the
+     size of the weld radius, so the matching earlier vertices are found in the 27
+     surrounding cells independently for every vertex. Only the final pass over the
+     candidates, which decides which vertices create outputs, runs serially in index order.
+     */
+    void weldParallel
+    (const Array<Vector3>&       vertexArray,
+     const Array<Vector3>&       normalArray,
+     const Array<Vector2>&       texCoordArray,
+     Array<int>&                 outputIndex) {
+
+        const int n = vertexArray.size();
+        const float cellSize = (vertexWeldRadius > 0) ? vertexWeldRadius : 1.0f;
+
+        // With a zero radius, only vertices at identical positions (and thus in the same cell) can weld
+        const int neighborhood = (vertexWeldRadius > 0) ? 1 : 0;
+
+        // Unrolled vertex indices grouped by cell. The sort is stable, so each cell is in index order.
+        Array<int> sorted;
+        sorted.resize(n);
+        runConcurrently(0, n, [&](int u) { sorted[u] = u; });
+        radixSort(sorted, [&](int u) { return cellKey(vertexArray[u], cellSize); });
+
+        // cellStart[c] is the first element of sorted in the cell with key cellKeyArray[c]
+        Array<uint64> cellKeyArray;
+        Array<int>    cellStart;
+        for (int i = 0; i < n; ++i) {
+            const uint64 key = cellKey(vertexArray[sorted[i]], cellSize);
+            if ((i == 0) || (key != cellKeyArray.last())) {
+                cellKeyArray.append(key);
+                cellStart.append(i);
+            }
+        }
+        cellStart.append(n);
+
+        // Invokes visit(c) for every earlier vertex c that u may weld to, stopping if visit returns false
+        const auto forEachMatch = [&](int u, const std::function<bool(int)>& visit) {
+            const Vector3& v = vertexArray[u];
+            SmallArray<int, 27> cells;
+            for (int dz = -neighborhood; dz <= neighborhood; ++dz) {
+                for (int dy = -neighborhood; dy <= neighborhood; ++dy) {
+                    for (int dx = -neighborhood; dx <= neighborhood; ++dx) {
+                        const uint64 key = cellKey(v, cellSize, dx, dy, dz);
+                        const uint64* k = std::lower_bound(cellKeyArray.begin(), cellKeyArray.end(), key);
+                        if ((k != cellKeyArray.end()) && (*k == key)) {
+                            const int c = int(k - cellKeyArray.begin());
+                            if (! cells.contains(c)) {
+                                cells.append(c);
+                            }
+                        }
+                    }
+                }
+            }
+
+            for (int j = 0; j < cells.size(); ++j) {
+                const int c = cells[j];
+                // Each cell is in index order, so stop at u
+                for (int i = cellStart[c]; (i < cellStart[c + 1]) && (sorted[i] < u); ++i) {
+                    const int w = sorted[i];
+                    if (matches(v, normalArray[u], texCoordArray[u], vertexArray[w], normalArray[w], texCoordArray[w]) && ! visit(w)) {
+                        return;
+                    }
+                }
+            }
+        };
+
+        // An exact duplicate u of an earlier vertex w has the same matches before w, and matches w,
+        // so it welds wherever w does. Skipping their candidate lists bounds the work for the
+        // common case of many coincident vertices.
+        Array<int> duplicateOf;
+        Array<int> candidateStart;
+        duplicateOf.resize(n);
+        candidateStart.resize(n + 1);
+        runConcurrently(0, n, [&](int u) {
+            int count = 0;
+            int duplicate = -1;
+            forEachMatch(u, [&](int w) {
+                if ((vertexArray[w] == vertexArray[u]) && (normalArray[w] == normalArray[u]) && (texCoordArray[w] == texCoordArray[u])) {
+                    duplicate = w;
+                    return false;
+                }
+                ++count;
+                return true;
+            });
+            duplicateOf[u] = duplicate;
+            candidateStart[u] = (duplicate == -1) ? count : 0;
+        });
+
+        // Exclusive prefix sum
+        int total = 0;
+        for (int u = 0; u < n; ++u) {
+            const int count = candidateStart[u];
+            candidateStart[u] = total;
+            total += count;
+        }
+        candidateStart[n] = total;
+
+        Array<int> candidate;
+        candidate.resize(total);
+        runConcurrently(0, n, [&](int u) {
+            if (duplicateOf[u] == -1) {
+                int* out = candidate.getCArray() + candidateStart[u];
+                forEachMatch(u, [&](int w) { *out = w; ++out; return true; });
+                std::sort(candidate.getCArray() + candidateStart[u], out);
+            }
+        });
+
+        // Decide which vertices create outputs, in index order
+        outputIndex.resize(n);
+        Array<bool> created;
+        created.resize(n);
+        for (int u = 0; u < n; ++u) {
+            created[u] = false;
+            if (duplicateOf[u] != -1) {
+                outputIndex[u] = outputIndex[duplicateOf[u]];
+                continue;
+            }
+
+            int i = candidateStart[u];
+            while ((i < candidateStart[u + 1]) && ! created[candidate[i]]) {
+                ++i;
+            }
+
+            if (i < candidateStart[u + 1]) {
+                outputIndex[u] = outputIndex[candidate[i]];
+            } else {
+                created[u] = true;
+                outputIndex[u] = outputVertexArray->size();
+                outputVertexArray->append(vertexArray[u]);
+                outputNormalArray->append(normalArray[u]);
+                outputTexCoordArray->append(texCoordArray[u]);
+            }
+        }
+    }
+
+
     /**
      Updates each indexArray to refer to vertices in the
      outputVertexArray.
@@ -151,16 +326,19 @@ private:
     (Array<Array<int>*>&         indexArrayArray, 
      const Array<Vector3>&       vertexArray,
      const Array<Vector3>&       normalArray,
-     const Array<Vector2>&       texCoordArray) {
+     const Array<Vector2>&       texCoordArray,
+     bool                        serial) {
      
 #       ifdef VERBOSE
             debugPrintf("WeldHelper::updateTriLists\n");
 #       endif
-          
-        // Compute a hash grid so that we can find neighbors quickly.
-        // It begins empty and is extended as the tri lists are iterated
-        // through.
-        weldGrid.clear();
+
+        Array<int> outputIndex;
+        if (serial) {
+            weldSerial(vertexArray, normalArray, texCoordArray, outputIndex);
+        } else {
+            weldParallel(vertexArray, normalArray, texCoordArray, outputIndex);
+        }
 
         // Process all triLists
         int numTriLists = indexArrayArray.size();
@@ -172,17 +350,7 @@ private:
                 // For all vertices in this list
                 for (int v = 0; v < triList.size(); ++v) {
                     // This vertex mapped to u in the flatVertexArray
-                    triList[v] = getIndex(vertexArray[u], normalArray[u], texCoordArray[u]);
-
-                    /*
-    #           ifdef G3D_DEBUG
-                {
-                    int i = triList[v];
-                    Vector3 N = normalArray[i];
-                    debugAssertM(N.length() > 0.9f, "Produced non-unit normal");
-                }
-    #           endif
-                */
+                    triList[v] = outputIndex[u];
                     ++u;
                 }
             }
@@ -243,6 +411,24 @@ private:
         }
     }
 
+    /** Returns the direction of \a sum, or \a original if that is undefined or would
+        point away from \a original. Called from smoothNormals(). */
+    static Vector3 smoothedNormal(const Vector3& original, const Vector3& sum) {
+        const Vector3& average = sum.directionOrZero();
+
+        const bool indeterminate = average.isZero();
+        // Never "smooth" a normal so far that it points backwards
+        const bool backFacing    = original.dot(average) < 0;
+        
+        if (indeterminate || backFacing) {
+            // Revert to the face normal
+            return original;
+        } else {
+            // Average available normals
+            return average;
+        }
+    }
+
     /**
      Computes @a smoothNormalArray, whose elements are those of normalArray averaged
      with neighbors within the angular cutoff.
@@ -285,7 +471,8 @@ private:
                 list.append(normalArray[v]);
             }
 
-            for (int v = 0; v < vertexArray.size(); ++v) {
+            // The table is read-only from here on, so vertices are independent
+            runConcurrently(0, vertexArray.size(), [&](int v) {
                 Vector3 sum;
 
                 const Vector3& original = normalArray[v];
@@ -302,20 +489,8 @@ private:
                     }
                 }
 
-                const Vector3& average = sum.directionOrZero();
-
-                const bool indeterminate = average.isZero();
-                // Never "smooth" a normal so far that it points backwards
-                const bool backFacing    = original.dot(average) < 0;
-                
-                if (indeterminate || backFacing) {
-                    // Revert to the face normal
-                    smoothNormalArray[v] = original;
-                } else {
-                    // Average available normals
-                    smoothNormalArray[v] = average;
-                }
-            }
+                smoothNormalArray[v] = smoothedNormal(original, sum);
+            });
 
         } else {
             // Non-zero vertex normal welding
@@ -331,13 +506,15 @@ private:
                 grid.insert(VN(vertexArray[v], normalArray[v]));
             }
             
-            // OPT: this step could be done on multiple threads
-            for (int v = 0; v < normalArray.size(); ++v) {            
+            // The grid is read-only from here on, so the neighbor searches in
+            // adjacent cells are independent across vertices
+            runConcurrently(0, normalArray.size(), [&](int v) {
                 // Compute the sum of all nearby normals within the cutoff angle.
                 // Search within the vertexWeldRadius, since those are the vertices
                 // that will collapse to the same point.
+                const PointHashGrid<VN>& constGrid = grid;
                 PointHashGrid<VN>::SphereIterator it = 
-                    grid.begin(Sphere(vertexArray[v], vertexWeldRadius));
+                    constGrid.begin(Sphere(vertexArray[v], vertexWeldRadius));
                 
                 Vector3 sum;
                 
@@ -353,20 +530,8 @@ private:
                     ++it;
                 }
                 
-                const Vector3& average = sum.directionOrZero();
-                
-                const bool indeterminate = average.isZero();
-                // Never "smooth" a normal so far that it points backwards
-                const bool backFacing    = original.dot(average) < 0;
-                
-                if (indeterminate || backFacing) {
-                    // Revert to the face normal
-                    smoothNormalArray[v] = original;
-                } else {
-                    // Average available normals
-                    smoothNormalArray[v] = average;
-                }
-            }
+                smoothNormalArray[v] = smoothedNormal(original, sum);
+            });
         }
     }
 
@@ -393,7 +558,8 @@ public:
       Array<Array<int>*>& indexArrayArray,
       float               normAngle,
       float               texRadius,
-      float               normRadius) {
+      float               normRadius,
+      bool                serial) {
 #       ifdef VERBOSE
             debugPrintf("WeldHelper::process\n");
 #       endif
@@ -448,7 +614,7 @@ public:
         }
 
         // Regenerate the triangle lists
-        updateTriLists(indexArrayArray, unrolledVertexArray, unrolledSmoothNormalArray, unrolledTexCoordArray);
+        updateTriLists(indexArrayArray, unrolledVertexArray, unrolledSmoothNormalArray, unrolledTexCoordArray, serial);
 
         if (! hasTexCoords) {
             // Throw away the generated texCoords
@@ -486,11 +652,12 @@ void Welder::weld
  Array<Vector2>&     texCoordArray, 
  Array<Vector3>&     normalArray,
  Array<Array<int>*>& indexArrayArray,
- const Welder::Settings& settings) {
+ const Welder::Settings& settings,
+ bool                serial) {
 
     _internal::WeldHelper(settings.vertexWeldRadius).process
         (vertexArray, texCoordArray, normalArray, indexArrayArray, 
-         settings.normalSmoothingAngle, settings.textureWeldRadius, settings.normalWeldRadius);
+         settings.normalSmoothingAngle, settings.textureWeldRadius, settings.normalWeldRadius, serial);
         
 }
 
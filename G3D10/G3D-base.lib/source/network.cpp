@@ -48,6 +48,11 @@ enet is also not threadsafe--it is not safe to call send and receive functions o
 for networking.  But single threading those calls under reliable transport increases latency because the network cannot
 perform useful communication while other work continues.
 
+G3D therefore gives each ENetHost its own lock (_internal::NetHost::enetMutex) and never calls enet from
+NetSendConnection::send.  send() only appends to the host's outgoing queue, coalescing small messages to the same
+peer and channel into one packet, and the network thread hands that queue to enet at the start of each service of
+the host.  Hosts are independent, so connections do not contend with each other for a global lock.
+
 Server side of a connection:
   ENetHost is like a TCP listener socket, with some extra information limiting total connections.  You have one per server.
   ENetPeer is like a TCP socket.  You have one per client.
@@ -81,22 +86,28 @@ static std::atomic_int  s_backlog;
 static std::mutex                   s_allServerAndClientConnectionMutex;
 static Array< weak_ptr<NetServer> > s_allServers;
 
-/** Protects enet calls from crashing when called in parallel */
-static  std::mutex                  s_enet_command_ThreadMutex;
-
-typedef Table<NetChannel, shared_ptr<ThreadsafeQueue<_internal::NetMessage>>> ChannelSendQueueTable;
-static ChannelSendQueueTable m_sendQueueTable;
-
-typedef Table<NetChannel, shared_ptr<std::thread>> ChannelSenderThreadTable;
-static ChannelSenderThreadTable m_senderThreadsTable;
-
 static std::mutex s_networkThreadMutex;
 static std::thread s_networkThread;
 static std::atomic_bool s_shutdownNetworkThread(false);
 
-static std::mutex s_networkSenderThreadMutex;
-static std::thread s_networkSenderThread;
-static std::atomic_bool s_shutdownNetworkSenderThread(false);
+static std::atomic<size_t>  s_coalescingThreshold(1024);
+static std::atomic<size_t>  s_maxCoalescedPacketSize(16 * 1024);
+
+static std::atomic<int64>   s_messagesSent(0);
+static std::atomic<int64>   s_coalescedMessagesSent(0);
+static std::atomic<int64>   s_packetsSent(0);
+static std::atomic<int64>   s_bytesSent(0);
+
+/** Bytes of NetMessageType and NetChannel that precede the user's header in every message */
+static const size_t G3D_HEADER_SIZE = 8;
+
+/** NetMessageType reserved for packets that contain several messages. Such a packet begins with this and the
+    number of messages, followed by a record for each message: the sizes of its headers and of its data, the
+    G3D and user headers, and then the data. All integers are in network byte order. 
+    \sa setNetworkCoalescingThreshold */
+static const uint32 COALESCED_MESSAGE_TYPE = 0xFFFFFFFF;
+static const size_t COALESCED_PACKET_HEADER_SIZE = 8;
+static const size_t COALESCED_RECORD_HEADER_SIZE = 8;
 
 
 namespace _internal {
@@ -131,6 +142,67 @@ unsigned int networkSendBacklog() {
 }
 
 
+void setNetworkCoalescingThreshold(size_t bytes) {
+    s_coalescingThreshold = bytes;
+}
+
+
+size_t networkCoalescingThreshold() {
+    return s_coalescingThreshold;
+}
+
+
+void setNetworkMaxCoalescedPacketSize(size_t bytes) {
+    s_maxCoalescedPacketSize = bytes;
+}
+
+
+size_t networkMaxCoalescedPacketSize() {
+    return s_maxCoalescedPacketSize;
+}
+
+
+NetworkSendStats networkSendStats() {
+    NetworkSendStats stats;
+    stats.messages          = s_messagesSent;
+    stats.coalescedMessages = s_coalescedMessagesSent;
+    stats.packets           = s_packetsSent;
+    stats.bytes             = s_bytesSent;
+    return stats;
+}
+
+
+void resetNetworkSendStats() {
+    s_messagesSent          = 0;
+    s_coalescedMessagesSent = 0;
+    s_packetsSent           = 0;
+    s_bytesSent             = 0;
+}
+
+
+static void writeNetworkUInt32(uint8* dst, uint32 x) {
+    x = htonl(x);
+    memcpy(dst, &x, sizeof(x));
+}
+
+
+static uint32 readNetworkUInt32(const uint8* src) {
+    uint32 x;
+    memcpy(&x, src, sizeof(x));
+    return ntohl(x);
+}
+
+
+/** Writes the G3D header followed by the user's header.  \sa NetMessageQueue::halfPushBack */
+static void writeHeader(uint8* dst, NetMessageType type, NetChannel channel, const BinaryOutput& userData) {
+    writeNetworkUInt32(dst, type);
+    writeNetworkUInt32(dst + 4, channel);
+    if (userData.size() > 0) {
+        memcpy(dst + G3D_HEADER_SIZE, userData.getCArray(), size_t(userData.size()));
+    }
+}
+
+
 namespace _internal {
 
 class NetMessage {
@@ -138,34 +210,333 @@ public:
 
     NetMessageType          type;
     NetChannel              channel;
+
+    /** Data of a message that was sent in its own packet, or nullptr */
     ENetPacket*             packet;
+
+    /** G3D header of a message that was sent in its own packet, or nullptr */
     ENetPacket*             header;
 
-    /** Only for outgoing messages */
-    ENetPeer*               enetPeer;
+    /** For a message that was coalesced with others, the packet that contains them all */
+    shared_ptr<ENetPacket>  coalesced;
+
+    uint8*                  data;
+    size_t                  size;
+
+    /** The user's header, which follows the G3D header */
+    uint8*                  userHeader;
+    size_t                  userHeaderSize;
 
-    /** Only for outgoing messages */
-    ENetHost*               enetHost;
 
+    NetMessage() : type(0), channel(0), packet(nullptr), header(nullptr), data(nullptr), size(0), userHeader(nullptr), userHeaderSize(0) {}
 
-    NetMessage() : type(0), channel(0), packet(nullptr), header(nullptr), enetPeer(nullptr), enetHost(nullptr) {}
+
+    NetMessage(_ENetPacket* p, _ENetPacket* h) : 
+        packet(p), header(h), data(p->data), size(p->dataLength), 
+        userHeader(h->data + G3D_HEADER_SIZE), userHeaderSize(h->dataLength - G3D_HEADER_SIZE) {
+        type = readNetworkUInt32(header->data);
+        channel = readNetworkUInt32(header->data + 4);
+    }
 
 
-    NetMessage(_ENetPacket* p, _ENetPacket* h, ENetPeer* peer = nullptr, ENetHost* host = nullptr) : 
-        packet(p), header(h), enetPeer(peer), enetHost(host) {
-        const uint32* data = reinterpret_cast<const uint32*>(header->data);
-        type = ntohl(data[0]);
-        channel = ntohl(data[1]);
+    /** \a h is the G3D header, followed by the user's header, in \a c */
+    NetMessage(const shared_ptr<_ENetPacket>& c, uint8* h, size_t headerSize, uint8* d, size_t dataSize) : 
+        packet(nullptr), header(nullptr), coalesced(c), data(d), size(dataSize), 
+        userHeader(h + G3D_HEADER_SIZE), userHeaderSize(headerSize - G3D_HEADER_SIZE) {
+        type = readNetworkUInt32(h);
+        channel = readNetworkUInt32(h + 4);
     }
 
 
     void destroy() {
-        enet_packet_destroy(packet);
-        enet_packet_destroy(header);
+        if (notNull(packet)) {
+            enet_packet_destroy(packet);
+            enet_packet_destroy(header);
+        }
         packet = nullptr;
         header = nullptr;
+        coalesced.reset();
+    }
+};
+
+
+/** A packet on a NetHost's outgoing queue */
+class OutgoingPacket {
+public:
+    /** nullptr to broadcast to every peer of the host */
+    ENetPeer*               peer;
+
+    NetChannel              channel;
+
+    /** G3D header of a message sent in its own packet, or nullptr for a packet of coalesced messages */
+    ENetPacket*             header;
+
+    ENetPacket*             packet;
+
+    /** Bytes of a coalesced packet that are in use. It is allocated at full size and shrunk when sent. */
+    size_t                  used;
+
+    int                     numMessages;
+};
+
+
+/** Identifies the coalesced packet that is accepting messages for one peer (or broadcast) and channel */
+class CoalescingKey {
+public:
+    ENetPeer*               peer;
+    NetChannel              channel;
+
+    CoalescingKey() : peer(nullptr), channel(0) {}
+    CoalescingKey(ENetPeer* p, NetChannel c) : peer(p), channel(c) {}
+
+    static size_t hashCode(const CoalescingKey& key) {
+        return HashTrait<ENetPeer*>::hashCode(key.peer) ^ (size_t(key.channel) * 2654435761u);
+    }
+
+    static bool equals(const CoalescingKey& a, const CoalescingKey& b) {
+        return (a.peer == b.peer) && (a.channel == b.channel);
+    }
+};
+
+
+/**
+  Outgoing messages and the enet lock for one ENetHost, shared by the connections that use it.
+
+  Messages are sent in the order queued on each channel.  Coalesced messages are appended to the open packet for
+  their peer and channel only when nothing queued since could reach the same peer on that channel, so coalescing
+  never reorders what a receiver sees.
+*/
+class NetHost {
+protected:
+
+    /** Index in m_outgoing of the packet accepting coalesced messages, valid only during \a generation */
+    class OpenPacket {
+    public:
+        int                 index;
+        uint64              generation;
+        OpenPacket() : index(-1), generation(0) {}
+    };
+
+    /** Indices in m_outgoing of the last packets queued on a channel, valid only during \a generation */
+    class ChannelOrder {
+    public:
+        int                 lastUnicast;
+        int                 lastBroadcast;
+        uint64              generation;
+        ChannelOrder() : lastUnicast(-1), lastBroadcast(-1), generation(0) {}
+    };
+
+    /** Protects everything below except m_sending */
+    std::mutex              m_outgoingMutex;
+
+    Array<OutgoingPacket>   m_outgoing;
+
+    Table<CoalescingKey, OpenPacket, CoalescingKey, CoalescingKey> m_openPacket;
+
+    Table<NetChannel, ChannelOrder> m_channelOrder;
+
+    /** Incremented whenever m_outgoing is emptied or compacted, which invalidates all indices into it */
+    uint64                  m_generation;
+
+    /** Swapped with m_outgoing by flush() so that neither array is reallocated every interval. Only accessed under enetMutex. */
+    Array<OutgoingPacket>   m_sending;
+
+    ChannelOrder& channelOrder(NetChannel channel) {
+        ChannelOrder& order = m_channelOrder.getCreate(channel);
+        if (order.generation != m_generation) {
+            order = ChannelOrder();
+            order.generation = m_generation;
+        }
+        return order;
+    }
+
+    int append(const OutgoingPacket& p) {
+        const int index = m_outgoing.size();
+        m_outgoing.append(p);
+        ChannelOrder& order = channelOrder(p.channel);
+        if (isNull(p.peer)) {
+            order.lastBroadcast = index;
+        } else {
+            order.lastUnicast = index;
+        }
+        return index;
+    }
+
+    static void destroy(const OutgoingPacket& p) {
+        if (notNull(p.header)) {
+            enet_packet_destroy(p.header);
+        }
+        enet_packet_destroy(p.packet);
+    }
+
+    /** enet only takes ownership of a packet that it queued */
+    static void sendToPeer(ENetPeer* peer, NetChannel channel, ENetPacket* packet) {
+        if ((enet_peer_send(peer, enet_uint8(channel), packet) < 0) && (packet->referenceCount == 0)) {
+            enet_packet_destroy(packet);
+        }
+    }
+
+public:
+
+    /** nullptr after the host is destroyed */
+    ENetHost*               enetHost;
+
+    /** Held for every enet call on enetHost or its peers */
+    std::mutex              enetMutex;
+
+    NetHost(ENetHost* h) : m_generation(1), enetHost(h) {}
+
+    ~NetHost() {
+        discard(nullptr, true);
+    }
+
+    static shared_ptr<NetHost> create(ENetHost* h) {
+        return shared_ptr<NetHost>(new NetHost(h));
+    }
+
+    /** Appends a message to the open packet for \a peer and \a channel, starting a new one if needed. */
+    void queueCoalesced(ENetPeer* peer, NetChannel channel, NetMessageType type, const BinaryOutput& header, const void* bytes, size_t size) {
+        const size_t headerSize = G3D_HEADER_SIZE + size_t(header.size());
+        const size_t recordSize = COALESCED_RECORD_HEADER_SIZE + headerSize + size;
+
+        std::lock_guard<std::mutex> guard(m_outgoingMutex);
+        const ChannelOrder& order = channelOrder(channel);
+        OpenPacket& open = m_openPacket.getCreate(CoalescingKey(peer, channel));
+
+        bool usable = (open.generation == m_generation) && (open.index >= 0);
+        if (usable) {
+            const OutgoingPacket& p = m_outgoing[open.index];
+            // A broadcast must be the last packet on its channel. A packet to one peer only has to follow the last broadcast,
+            // because queuePacket() closes it when another packet to the same peer is queued.
+            const bool inOrder = isNull(peer) ? 
+                ((open.index > order.lastUnicast) && (open.index >= order.lastBroadcast)) :
+                (open.index > order.lastBroadcast);
+            usable = inOrder && (p.used + recordSize <= p.packet->dataLength);
+        }
+
+        if (! usable) {
+            OutgoingPacket p;
+            p.peer        = peer;
+            p.channel     = channel;
+            p.header      = nullptr;
+            p.packet      = enet_packet_create(nullptr, max(COALESCED_PACKET_HEADER_SIZE + recordSize, size_t(s_maxCoalescedPacketSize)), ENET_PACKET_FLAG_RELIABLE);
+            p.used        = COALESCED_PACKET_HEADER_SIZE;
+            p.numMessages = 0;
+            writeNetworkUInt32(p.packet->data, COALESCED_MESSAGE_TYPE);
+
+            open.index      = append(p);
+            open.generation = m_generation;
+        }
+
+        OutgoingPacket& p = m_outgoing[open.index];
+        uint8* record = p.packet->data + p.used;
+        writeNetworkUInt32(record, uint32(headerSize));
+        writeNetworkUInt32(record + 4, uint32(size));
+        writeHeader(record + COALESCED_RECORD_HEADER_SIZE, type, channel, header);
+        if (size > 0) {
+            memcpy(record + COALESCED_RECORD_HEADER_SIZE + headerSize, bytes, size);
+        }
+        p.used += recordSize;
+        ++p.numMessages;
+    }
+
+
+    /** Queues a message that was already packetized. Takes ownership of the packets. */
+    void queuePacket(ENetPeer* peer, NetChannel channel, ENetPacket* header, ENetPacket* packet) {
+        std::lock_guard<std::mutex> guard(m_outgoingMutex);
+
+        // Later small messages to the same receivers must follow this one
+        m_openPacket.remove(CoalescingKey(peer, channel));
+
+        OutgoingPacket p;
+        p.peer        = peer;
+        p.channel     = channel;
+        p.header      = header;
+        p.packet      = packet;
+        p.used        = 0;
+        p.numMessages = 1;
+        append(p);
+    }
+
+
+    /** Hands all queued packets to enet, in order. Called with enetMutex locked. */
+    void flush() {
+        {
+            std::lock_guard<std::mutex> guard(m_outgoingMutex);
+            if (m_outgoing.size() == 0) {
+                return;
+            }
+            Array<OutgoingPacket>::swap(m_sending, m_outgoing);
+            ++m_generation;
+        }
+
+        if (isNull(enetHost)) {
+            for (const OutgoingPacket& p : m_sending) {
+                destroy(p);
+            }
+            m_sending.fastClear();
+            return;
+        }
+
+        int64 numMessages = 0, numCoalesced = 0, numPackets = 0, numBytes = 0;
+        for (const OutgoingPacket& p : m_sending) {
+            if (isNull(p.header)) {
+                writeNetworkUInt32(p.packet->data + 4, uint32(p.numMessages));
+                enet_packet_resize(p.packet, p.used);
+                if (p.numMessages > 1) {
+                    numCoalesced += p.numMessages;
+                }
+            } else {
+                numBytes += p.header->dataLength;
+                ++numPackets;
+            }
+            numBytes += p.packet->dataLength;
+            ++numPackets;
+            numMessages += p.numMessages;
+
+            if (isNull(p.peer)) {
+                if (notNull(p.header)) {
+                    enet_host_broadcast(enetHost, enet_uint8(p.channel), p.header);
+                }
+                enet_host_broadcast(enetHost, enet_uint8(p.channel), p.packet);
+            } else {
+                if (notNull(p.header)) {
+                    sendToPeer(p.peer, p.channel, p.header);
+                }
+                sendToPeer(p.peer, p.channel, p.packet);
+            }
+        }
+        m_sending.fastClear();
+
+        s_messagesSent          += numMessages;
+        s_coalescedMessagesSent += numCoalesced;
+        s_packetsSent           += numPackets;
+        s_bytesSent             += numBytes;
+    }
+
+
+    /** Destroys the queued packets for \a peer, or for all peers and broadcasts if \a all is true. Packets for a
+        peer do not need to be flushed before it disconnects, and must not be flushed after. */
+    void discard(ENetPeer* peer, bool all = false) {
+        std::lock_guard<std::mutex> guard(m_outgoingMutex);
+        int keep = 0;
+        for (int i = 0; i < m_outgoing.size(); ++i) {
+            const OutgoingPacket& p = m_outgoing[i];
+            if (all || (notNull(peer) && (p.peer == peer))) {
+                destroy(p);
+            } else {
+                m_outgoing[keep] = p;
+                ++keep;
+            }
+        }
+
+        if (keep < m_outgoing.size()) {
+            m_outgoing.resize(keep, false);
+            ++m_generation;
+        }
     }
 };
+
 } // namespace _internal
 
 
@@ -237,7 +608,9 @@ public:
         */
     void halfPushBack(ENetPacket* p) {
         std::lock_guard<std::mutex> guard(m_mutex);
-        if (isNull(m_header)) {
+        if (isNull(m_header) && (p->dataLength >= COALESCED_PACKET_HEADER_SIZE) && (readNetworkUInt32(p->data) == COALESCED_MESSAGE_TYPE)) {
+            unpackCoalesced(p);
+        } else if (isNull(m_header)) {
             m_header = p;
         } else {
             // This is the data packet
@@ -249,11 +622,43 @@ public:
         }
     }
 
+    /** Queues each message of a packet sent by NetHost::queueCoalesced. They share the packet, which is
+        destroyed when the last is popped. Called with m_mutex locked. */
+    void unpackCoalesced(ENetPacket* p) {
+        const shared_ptr<ENetPacket> packet(p, &enet_packet_destroy);
+        const uint32 count = readNetworkUInt32(p->data + 4);
+        uint8* record = p->data + COALESCED_PACKET_HEADER_SIZE;
+        const uint8* end = p->data + p->dataLength;
+
+        for (uint32 i = 0; i < count; ++i) {
+            if (size_t(end - record) < COALESCED_RECORD_HEADER_SIZE + G3D_HEADER_SIZE) {
+                debugPrintf("Warning: truncated coalesced network packet\n");
+                return;
+            }
+            const size_t headerSize = readNetworkUInt32(record);
+            const size_t dataSize   = readNetworkUInt32(record + 4);
+            uint8* header = record + COALESCED_RECORD_HEADER_SIZE;
+            if ((headerSize < G3D_HEADER_SIZE) || (size_t(end - header) < headerSize + dataSize)) {
+                debugPrintf("Warning: truncated coalesced network packet\n");
+                return;
+            }
+
+            m_packetQueue.pushBack(NetMessage(packet, header, headerSize, header + headerSize, dataSize));
+            record = header + headerSize + dataSize;
+        }
+    }
+
     // The following methods are called on the application thread...but it is the application's responsibility to verify that there is an element in the queue first,
     // so this code just has to ensure that the queue is not reallocated while being accessed, not make sure that there is something in the queue.
-    ENetPacket* packet() const {
+    void* messageData() const {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        return m_packetQueue[0].data;
+    }
+
+
+    size_t messageSize() const {
         std::lock_guard<std::mutex> guard(m_mutex);
-        return m_packetQueue[0].packet;
+        return m_packetQueue[0].size;
     }
 
 
@@ -272,8 +677,8 @@ public:
     BinaryInput& binaryInput() {
         std::lock_guard<std::mutex> guard(m_mutex);
         if (isNull(m_binaryInput)) {
-            ENetPacket* packet = m_packetQueue[0].packet;
-            m_binaryInput = new BinaryInput(packet->data, packet->dataLength, G3D_LITTLE_ENDIAN, false, false);
+            const NetMessage& message = m_packetQueue[0];
+            m_binaryInput = new BinaryInput(message.data, message.size, G3D_LITTLE_ENDIAN, false, false);
         }
 
         return *m_binaryInput;
@@ -283,9 +688,8 @@ public:
     BinaryInput& headerBinaryInput() {
         std::lock_guard<std::mutex> guard(m_mutex);
         if (isNull(m_headerBinaryInput)) {
-            ENetPacket* header = m_packetQueue[0].header;
-            const size_t G3D_HEADER_SIZE = 8;
-            m_headerBinaryInput = new BinaryInput(reinterpret_cast<uint8*>(header->data) + G3D_HEADER_SIZE, header->dataLength - G3D_HEADER_SIZE, G3D_LITTLE_ENDIAN, false, false);
+            const NetMessage& message = m_packetQueue[0];
+            m_headerBinaryInput = new BinaryInput(message.userHeader, message.userHeaderSize, G3D_LITTLE_ENDIAN, false, false);
         }
 
         return *m_headerBinaryInput;
@@ -298,17 +702,20 @@ class NetClientSideConnection : public NetConnection {
 protected:
     friend class NetConnection;
     friend void G3D::serviceNetwork();
+    friend void G3D::serviceNetworkSender(const NetChannel& channel);
 
+    /** Called with m_host->enetMutex locked */
     void onDisconnect()
     {
         NETWORK_DEBUG_PRINT(VERB_INFORMATIVE, "NetClientSideConnection::onDisconnect()");
-        shutdownSenderThreads(); // stop all sender threads
 
         if (m_status != DISCONNECTED)
         {
             NETWORK_DEBUG_PRINT(VERB_INFORMATIVE, "status != DISCONNECTED");
             m_status = DISCONNECTED;
+            m_host->discard(nullptr, true);
             enet_host_destroy(m_enetHost);
+            m_host->enetHost = nullptr;
             m_enetHost = nullptr;
         }
     }
@@ -328,14 +735,20 @@ protected:
         ENetEvent event;
         //NetMessageIterator iterator;
 
+        // Events are handled with the lock held, since a disconnect destroys the host
+        std::lock_guard<std::mutex> guard(m_host->enetMutex);
+        if (isNull(m_enetHost)) {
+            return;
+        }
+
+        // Hand everything sent since the last service to enet, which transmits it below
+        m_host->flush();
+
         int result = 0;
         // Note that the following code assigns result inside the conditional
         while (m_status != DISCONNECTED)
         {
-
-            s_enet_command_ThreadMutex.lock();  // lock mutex for enet commands
             result = enet_host_service(m_enetHost, &event, networkCommunicationIntervalMilliseconds());
-            s_enet_command_ThreadMutex.unlock(); // unlock mutex for enet commands
             
             // if there is no more work to do leave loop
             if (result <= 0)
@@ -381,10 +794,10 @@ protected:
     }
 
 
-    NetClientSideConnection(_ENetPeer* p, _ENetHost* h) : NetConnection(p, h)
+    NetClientSideConnection(_ENetPeer* p, const shared_ptr<NetHost>& h) : NetConnection(p, h)
     {
         debugAssert(p != nullptr);
-        debugAssert(h != nullptr);
+        debugAssert(notNull(h->enetHost));
     }
 
 public:
@@ -407,6 +820,7 @@ public:
             if (! waitForOtherSide)
             {
                 // Destroy my host now since I will not receive more events
+                std::lock_guard<std::mutex> guard(m_host->enetMutex);
                 onDisconnect();
             }
         }
@@ -427,7 +841,7 @@ protected:
     weak_ptr<NetServer>                  m_server;
 
     NetServerSideConnection(const shared_ptr<NetServer>& s, _ENetPeer* p) : 
-        NetConnection(p, s->m_enetHost), m_server(s) {
+        NetConnection(p, s->m_host), m_server(s) {
         debugAssert(notNull(p));
         m_status = JUST_CONNECTED;
     }
@@ -438,9 +852,6 @@ protected:
 
         NETWORK_DEBUG_PRINT(VERB_INFORMATIVE, "NetServerSideConnection::onDisconnect()");
 
-        // stop per-channel sender threads
-        shutdownSenderThreads();
-
         // The caller has dropped all pointers to the 
         // server, thus closing the connection.
         m_status = DISCONNECTED;
@@ -475,98 +886,93 @@ static int32 backlogForHost(ENetHost* host) {
 }
 
 
-void serviceNetwork() {
-    // Process the G3D send queue first, filling the enet communication queues in a
-    // threadsafe fashion. This way, servicing the host below can empty these queues.
+static int32 lockedBacklogForHost(_internal::NetHost& host) {
+    std::lock_guard<std::mutex> guard(host.enetMutex);
+    return notNull(host.enetHost) ? backlogForHost(host.enetHost) : 0;
+}
 
-    int32 b = 0;
 
-    // Service all server enet hosts (and flush those that are gone)
-    s_allServerAndClientConnectionMutex.lock(); // protect from adding a host while the following code is executed
+void serviceNetwork() {
+    // Each host hands its queued messages to enet at the start of its service, and
+    // then servicing the host transmits them.
+    //
+    // The hosts are serviced without the global lock, so that connections can be created and
+    // servers stopped meanwhile.
+    Array<shared_ptr<NetServer>> servers;
+    Array<shared_ptr<_internal::NetClientSideConnection>> clients;
+    {
+        std::lock_guard<std::mutex> guard(s_allServerAndClientConnectionMutex);
 
-    for (int i = 0; i < s_allServers.length(); ++i) {
-        const shared_ptr<NetServer> &s = s_allServers[i].lock();
-        if (notNull(s) && notNull(s->m_enetHost)) {
-            b += backlogForHost(s->m_enetHost);
-            s->serviceHost();
-        } else
-        {
-            s_allServers.fastRemove(i);
-            --i;
-            NETWORK_DEBUG_PRINT(VERB_INFORMATIVE, "removing server connection %d", i);
-            NETWORK_DEBUG_PRINT(VERB_INFORMATIVE, "num remaining servers %d", (int)s_allServers.size());
+        for (int i = 0; i < s_allServers.length(); ++i) {
+            const shared_ptr<NetServer>& s = s_allServers[i].lock();
+            if (notNull(s) && notNull(s->m_enetHost)) {
+                servers.append(s);
+            } else
+            {
+                s_allServers.fastRemove(i);
+                --i;
+                NETWORK_DEBUG_PRINT(VERB_INFORMATIVE, "removing server connection %d", i);
+                NETWORK_DEBUG_PRINT(VERB_INFORMATIVE, "num remaining servers %d", (int)s_allServers.size());
+            }
         }
-    }
 
-    // Service all client enet hosts (and flush those that are gone)
-    for (int i = 0; i < s_allClientConnections.length(); ++i) {
-        const shared_ptr<_internal::NetClientSideConnection> &c = s_allClientConnections[i].lock();
-        if (notNull(c) && notNull(c->m_enetHost)) {
-            b += backlogForHost(c->m_enetHost);
-            c->serviceHost();
-        } else
-        {
-            s_allClientConnections.fastRemove(i);
-            --i;
-            NETWORK_DEBUG_PRINT(VERB_INFORMATIVE, "removing client connection %d", i);
-            NETWORK_DEBUG_PRINT(VERB_INFORMATIVE, "num remaining clients %d", (int)s_allClientConnections.size());
+        for (int i = 0; i < s_allClientConnections.length(); ++i) {
+            const shared_ptr<_internal::NetClientSideConnection>& c = s_allClientConnections[i].lock();
+            if (notNull(c) && notNull(c->m_enetHost)) {
+                clients.append(c);
+            } else
+            {
+                s_allClientConnections.fastRemove(i);
+                --i;
+                NETWORK_DEBUG_PRINT(VERB_INFORMATIVE, "removing client connection %d", i);
+                NETWORK_DEBUG_PRINT(VERB_INFORMATIVE, "num remaining clients %d", (int)s_allClientConnections.size());
+            }
         }
     }
 
-    s_allServerAndClientConnectionMutex.unlock(); // unprotect hosts
+    int32 b = 0;
+    for (const shared_ptr<NetServer>& s : servers) {
+        b += lockedBacklogForHost(*s->m_host);
+        s->serviceHost();
+    }
+
+    for (const shared_ptr<_internal::NetClientSideConnection>& c : clients) {
+        b += lockedBacklogForHost(*c->m_host);
+        c->serviceHost();
+    }
 
     // Update the estimate of the total network backlog
     s_backlog = b;
 }
 
-void serviceNetworkSender(const G3D::NetChannel &channel)
-{
-    // check if queue exists for this channel
-    if (m_sendQueueTable.containsKey(channel))
-    {
-        const shared_ptr<ThreadsafeQueue<_internal::NetMessage>> &queue = m_sendQueueTable.get(channel); // get queue
-        _internal::NetMessage message; // new message
-        
-        // empty single message at a time from queue
-        while (queue->popFront(message))
-        {
-            // make sure host does exist
-            //debugAssert(notNull(message.enetHost)); // if (host disappears?)
-            if (!message.enetHost)
-            {
-                queue->clear();
-                NETWORK_DEBUG_PRINT(VERB_INFORMATIVE, "WARNING message.enetHost is null ! queue for channel %d cleared", (int)channel);
-                break;
-            }
-
-            // debug output
-            NETWORK_DEBUG_PRINT(VERB_INFORMATIVE, "sending message on channel %d in thread", channel);
+void serviceNetworkSender(const G3D::NetChannel &channel) {
+    (void)channel;
 
-            s_enet_command_ThreadMutex.lock(); // lock mutex for enet commands
-
-            if (isNull(message.enetPeer))
-            {
-                //printf("enet_host_broadcast\n");
-                // Must be a NetSendConnection broadcast message
-                enet_host_broadcast(message.enetHost, message.channel, message.header);
-                enet_host_broadcast(message.enetHost, message.channel, message.packet);
+    // Collect the hosts first so that no host lock is held with the global one
+    Array<shared_ptr<_internal::NetHost>> hosts;
+    {
+        std::lock_guard<std::mutex> guard(s_allServerAndClientConnectionMutex);
+        for (int i = 0; i < s_allServers.size(); ++i) {
+            const shared_ptr<NetServer>& s = s_allServers[i].lock();
+            if (notNull(s)) {
+                hosts.append(s->m_host);
             }
-            else {
-                //printf("enet_peer_send\n");
-                enet_peer_send(message.enetPeer, message.channel, message.header);
-                enet_peer_send(message.enetPeer, message.channel, message.packet);
+        }
+        for (int i = 0; i < s_allClientConnections.size(); ++i) {
+            const shared_ptr<_internal::NetClientSideConnection>& c = s_allClientConnections[i].lock();
+            if (notNull(c)) {
+                hosts.append(c->m_host);
             }
-            enet_host_flush(message.enetHost);
-
-            s_enet_command_ThreadMutex.unlock(); // unlock mutex for enet commands
         }
     }
-    else
-    {
-        NETWORK_DEBUG_PRINT(VERB_INFORMATIVE, "sender thread : sender queue for channel %d does not exist !", (int)channel); // inform that queue does not exist 
-        System::sleep(0.5); // wait some time
-    }
 
+    for (const shared_ptr<_internal::NetHost>& host : hosts) {
+        std::lock_guard<std::mutex> guard(host->enetMutex);
+        host->flush();
+        if (notNull(host->enetHost)) {
+            enet_host_flush(host->enetHost);
+        }
+    }
 }
 
 
@@ -678,6 +1084,9 @@ static Table<ENetPacket*, _internal::NetworkCallbackInfo>& callbackTable() {
     return t;
 }
 
+/** Protects callbackTable(), which is modified by application threads sending and the network thread freeing */
+static std::mutex s_callbackTableMutex;
+
 
 /** Registered callback for all ENet packets with a memory manager.  This is how ENet tells us 
     that it has processed a packet and we are allowed to free the data. */
@@ -685,7 +1094,12 @@ void freePacketDataCallback(_ENetPacket* packet) {
     ENetPacket* ignore = nullptr;
 
     _internal::NetworkCallbackInfo callbackInfo;
-    if (callbackTable().getRemove(packet, ignore, callbackInfo)) {
+    bool found = false;
+    {
+        std::lock_guard<std::mutex> guard(s_callbackTableMutex);
+        found = callbackTable().getRemove(packet, ignore, callbackInfo);
+    }
+    if (found) {
         callbackInfo.connection->m_freeQueue.pushBack(callbackInfo);
     } else
     {
@@ -703,6 +1117,7 @@ void NetSendConnection::processFreeQueue() {
 
 
 void addCallback(const shared_ptr<NetSendConnection>& conn, ENetPacket* packet, const shared_ptr<MemoryManager>& manager, const void* data) {
+    std::lock_guard<std::mutex> guard(s_callbackTableMutex);
     callbackTable().set(packet, _internal::NetworkCallbackInfo(conn, manager, data));
 }
 
@@ -727,16 +1142,17 @@ shared_ptr<NetServer> NetServer::create
     _ENetHost* host = enet_host_create(&addr, maxClients, numChannels,
         (enet_uint32)incomingBytesPerSecondThrottle, (enet_uint32)outgoingBytesPerSecondThrottle);
 
-    shared_ptr<NetServer> n(new NetServer(host));
+    shared_ptr<NetServer> n(new NetServer(_internal::NetHost::create(host)));
 
     s_allServers.append(n);
     return n;
 }
 
 
-NetServer::NetServer(_ENetHost* h) : 
-    m_enetHost(h),
-    m_omniConnection(new NetSendConnection(nullptr, h)) {
+NetServer::NetServer(const shared_ptr<_internal::NetHost>& host) : 
+    m_enetHost(host->enetHost),
+    m_host(host),
+    m_omniConnection(new NetSendConnection(nullptr, host)) {
 }
 
 
@@ -762,35 +1178,46 @@ void NetServer::stop() {
     }
 
     // Flush any pending communication
-    enet_host_flush(m_enetHost);
-
-    // Explicitly remove me from the list of servers accessed by serviceNetwork so 
-    // that there is not a race between garbage collection and servicing the network
-    // after this is shut down.
-    shared_ptr<NetServer> me = dynamic_pointer_cast<NetServer>(shared_from_this());
-    for (int i = 0; i < s_allServers.size(); ++i) {
-        if (s_allServers[i].lock().get() == this) {
-            s_allServers.fastRemove(i);
-            break;
-        }
+    {
+        std::lock_guard<std::mutex> guard(m_host->enetMutex);
+        m_host->flush();
+        enet_host_flush(m_enetHost);
     }
 
+    // serviceNetwork drops this server from s_allServers once the host is destroyed. Until then, it may
+    // still be servicing this server on another thread, which the host lock makes safe.
+    std::lock_guard<std::mutex> guard(m_host->enetMutex);
+    m_host->discard(nullptr, true);
     enet_host_destroy(m_enetHost);
+    m_host->enetHost = nullptr;
     m_enetHost = nullptr;
 }
 
 
 void NetServer::serviceHost() {
-    alwaysAssertM(notNull(m_enetHost), "Cannot perform more actions after NetServer::stop()");
-   
     ENetEvent event;
     int result = 0;
+
+    // Hand everything sent since the last service to enet, which transmits it below
+    {
+        std::lock_guard<std::mutex> guard(m_host->enetMutex);
+        if (isNull(m_host->enetHost)) {
+            // Stopped on another thread since this was scheduled
+            return;
+        }
+        m_host->flush();
+    }
+
     // Note that the following code assigns result inside the conditional
     while (true)
     {
-        s_enet_command_ThreadMutex.lock(); // protect enet command being called from sender thread
-        result = enet_host_service(m_enetHost, &event, networkCommunicationIntervalMilliseconds());
-        s_enet_command_ThreadMutex.unlock(); // protect enet command being called from sender thread
+        {
+            std::lock_guard<std::mutex> guard(m_host->enetMutex);
+            if (isNull(m_host->enetHost)) {
+                return;
+            }
+            result = enet_host_service(m_host->enetHost, &event, networkCommunicationIntervalMilliseconds());
+        }
 
         // if there is no more work to do leave loop
         if (result <= 0)
@@ -836,82 +1263,29 @@ void NetServer::serviceHost() {
 
 /////////////////////////////////////////////////////////////////////////
 
-/** \sa NetMessageQueue::halfPushBack */
-static ENetPacket* makeHeader(NetMessageType type, NetChannel channel, BinaryOutput& userData) {
-    if (userData.size() == 0) {
-        uint32 data[2];
-        data[0] = htonl(type);
-        data[1] = htonl(channel);
-        return enet_packet_create(data, sizeof(data), ENET_PACKET_FLAG_RELIABLE);
-    } else {
-        // Copy the data to insert the header
-        const size_t dataSize = size_t(8 + userData.size());
-        ENetPacket* packet = enet_packet_create(nullptr, dataSize, ENET_PACKET_FLAG_RELIABLE);
-
-        uint32* data = (uint32*)(packet->data);
-        data[0] = htonl(type);
-        data[1] = htonl(channel);
-
-        // Copy the data into the packet, starting 2 x uint32 in
-        userData.commit((uint8*)(data + 2));
-
-        return enet_packet_create(data, dataSize, ENET_PACKET_FLAG_RELIABLE);
-    }
+static ENetPacket* makeHeader(NetMessageType type, NetChannel channel, const BinaryOutput& userData) {
+    ENetPacket* packet = enet_packet_create(nullptr, G3D_HEADER_SIZE + size_t(userData.size()), ENET_PACKET_FLAG_RELIABLE);
+    writeHeader(packet->data, type, channel, userData);
+    return packet;
 }
 
-void NetSendConnection::submitToSendQueues(const _internal::NetMessage& message)
-{
-    if (!m_sendQueueTable.containsKey(message.channel))
-    {
-        NETWORK_DEBUG_PRINT(VERB_INFORMATIVE, "creating sender queue for channel %d", message.channel);
-        shared_ptr<ThreadsafeQueue<_internal::NetMessage>> q(new ThreadsafeQueue<_internal::NetMessage>); // maybe better shared_ptr ?
-        m_sendQueueTable.set(message.channel, q);
-
-        // start send thread
-        const G3D::NetChannel &c = message.channel;
-        std::shared_ptr <std::thread> sendThread (new std::thread([c](){
-            NETWORK_DEBUG_PRINT(VERB_INFORMATIVE, "starting network sender thread for channel %d", c);
-            while (!s_shutdownNetworkSenderThread)
-            {
-                serviceNetworkSender(c);
 
-                // Yield, since we can't access enet's internal select() call to make it process
-                // multiple hosts at once and sleep until one is needed
-                
-                System::sleep(G3D::RealTime(0.008)); // 120 Hz
-                //System::sleep(G3D::RealTime(0.016)); // 60 Hz
-                //Sleep(16); // 60 Hz
-            }
-        }));
+NetSendConnection::NetSendConnection(_ENetPeer* p, const shared_ptr<_internal::NetHost>& host) : 
+    m_enetPeer(p), m_enetHost(host->enetHost), m_host(host) {}
 
-        // add thread to table
-        m_senderThreadsTable.set(message.channel, sendThread);
-    }
-    
-    // queue message
-    m_sendQueueTable.get(message.channel)->pushBack(message);
+
+void NetSendConnection::submitToSendQueues(const _internal::NetMessage& message) {
+    m_host->queuePacket(m_enetPeer, message.channel, message.header, message.packet);
 }
 
-void NetSendConnection::shutdownSenderThreads()
-{
-    // shutdown sender threads
-    s_shutdownNetworkSenderThread = true;
-     
-    NETWORK_DEBUG_PRINT(VERB_INFORMATIVE, "NetSendConnection::shutdownSenderThreads()");
 
-    const G3D::Array<G3D::NetChannel> &keys = m_senderThreadsTable.getKeys();
-    for (auto k : keys)
-    {
-        if (m_senderThreadsTable.get(k)->joinable())
-        {
-            NETWORK_DEBUG_PRINT(VERB_INFORMATIVE, "stopping network sender thread for channel %d", k);
-            m_senderThreadsTable.get(k)->join();
-        }
+void NetSendConnection::shutdownSenderThreads() {
+    NETWORK_DEBUG_PRINT(VERB_INFORMATIVE, "NetSendConnection::shutdownSenderThreads()");
+    if (notNull(m_enetPeer)) {
+        m_host->discard(m_enetPeer);
+    } else {
+        m_host->discard(nullptr, true);
     }
-    // reset threads and queues
-    m_senderThreadsTable.clear(); // delete all entries from sender
-    m_sendQueueTable.clear(); // delete all sender queues
-    
 }
 
 
@@ -921,6 +1295,10 @@ void NetSendConnection::send(NetMessageType type, const void* bytes, size_t size
 
     if (m_enetHost)
     {
+        if (isNull(memoryManager) && (G3D_HEADER_SIZE + size_t(header.size()) + size <= s_coalescingThreshold)) {
+            m_host->queueCoalesced(m_enetPeer, channel, type, header, bytes, size);
+            return;
+        }
 
         const uint32 extraFlags = isNull(memoryManager) ? 0 : ENET_PACKET_FLAG_NO_ALLOCATE;
         ENetPacket* packet = enet_packet_create(bytes, size, ENET_PACKET_FLAG_RELIABLE | extraFlags);
@@ -931,7 +1309,7 @@ void NetSendConnection::send(NetMessageType type, const void* bytes, size_t size
             addCallback(dynamic_pointer_cast<NetSendConnection>(shared_from_this()), packet, memoryManager, bytes);
         }
 
-        submitToSendQueues(_internal::NetMessage(packet, makeHeader(type, channel, header), m_enetPeer, m_enetHost));
+        submitToSendQueues(_internal::NetMessage(packet, makeHeader(type, channel, header)));
     }
     else
     {
@@ -958,10 +1336,15 @@ void NetSendConnection::send(NetMessageType type, BinaryOutput& bo, BinaryOutput
 
     if (m_enetHost) {
         
+        if (G3D_HEADER_SIZE + size_t(header.size()) + size_t(bo.size()) <= s_coalescingThreshold) {
+            m_host->queueCoalesced(m_enetPeer, channel, type, header, bo.getCArray(), size_t(bo.size()));
+            return;
+        }
+
         ENetPacket* packet = enet_packet_create(nullptr, size_t(bo.size()), ENET_PACKET_FLAG_RELIABLE);
         bo.commit(packet->data);
 
-        submitToSendQueues(_internal::NetMessage(packet, makeHeader(type, channel, header), m_enetPeer, m_enetHost));
+        submitToSendQueues(_internal::NetMessage(packet, makeHeader(type, channel, header)));
     }
     else
     {
@@ -970,7 +1353,8 @@ void NetSendConnection::send(NetMessageType type, BinaryOutput& bo, BinaryOutput
 }
 
 void NetSendConnection::enetsend(NetChannel channel, _ENetPacket* packet) {
-    enet_host_broadcast(m_enetHost, channel, packet);
+    std::lock_guard<std::mutex> guard(m_host->enetMutex);
+    enet_host_broadcast(m_enetHost, enet_uint8(channel), packet);
 }
 
 /////////////////////////////////////////////////////////////////////////
@@ -986,13 +1370,13 @@ NetMessageIterator::NetMessageIterator() :
 /** Size of the data in bytes. */
 size_t NetMessageIterator::size() const {
     alwaysAssertM(isValid(), "Not a valid message!");
-    return m_queue->packet()->dataLength;
+    return m_queue->messageSize();
 }
 
 /** The raw data bytes. */
 void* NetMessageIterator::data() const {
     alwaysAssertM(isValid(), "Not a valid message!");
-    return m_queue->packet()->data;
+    return m_queue->messageData();
 }
 
 BinaryInput& NetMessageIterator::binaryInput() const {
@@ -1034,7 +1418,7 @@ BinaryInput& NetMessageIterator::headerBinaryInput() const {
 ///////////////////////////////////////////////////////////////////////
 
 
-NetConnection::NetConnection(_ENetPeer* peer, _ENetHost* host) : 
+NetConnection::NetConnection(_ENetPeer* peer, const shared_ptr<_internal::NetHost>& host) : 
     NetSendConnection(peer, host), 
     m_status(WAITING_TO_CONNECT),
     m_latency(0.0f),
@@ -1103,13 +1487,11 @@ shared_ptr<NetConnection> NetConnection::connectToServer
     const _ENetAddress addr = toENetAddress(server);
     _ENetPeer* peer = enet_host_connect(host, &addr, numChannels, 0);
     
-    shared_ptr<_internal::NetClientSideConnection> connection(new _internal::NetClientSideConnection(peer, host));
+    shared_ptr<_internal::NetClientSideConnection> connection(new _internal::NetClientSideConnection(peer, _internal::NetHost::create(host)));
 
     s_allClientConnections.append(connection); // remember connection list of client connections
     NETWORK_DEBUG_PRINT(VERB_INFORMATIVE, "Number of pending client connections %d", (int)s_allClientConnections.size());
 
-    s_shutdownNetworkSenderThread = false;
-
     return connection;
 }
 
@@ -1182,16 +1564,32 @@ void NetConnection::disconnect(bool waitForOtherSide) {
     if (waitForOtherSide)
     {
         m_status = WAITING_TO_DISCONNECT;
-        enet_peer_disconnect_later(m_enetPeer, 0);
-        enet_host_flush(m_enetHost);
+        {
+            std::lock_guard<std::mutex> guard(m_host->enetMutex);
+            // Messages sent before disconnecting are delivered first
+            m_host->flush();
+            enet_peer_disconnect_later(m_enetPeer, 0);
+            enet_host_flush(m_enetHost);
+        }
         serviceHost();
     } else {
         // Force immediate disconnect (although make a last attempt to service the host)
         serviceHost();
-        enet_peer_disconnect_now(m_enetPeer, 0);
-        enet_host_flush(m_enetHost);
+        {
+            std::lock_guard<std::mutex> guard(m_host->enetMutex);
+            m_host->discard(m_enetPeer);
+            if (notNull(m_host->enetHost)) {
+                enet_peer_disconnect_now(m_enetPeer, 0);
+                enet_host_flush(m_enetHost);
+            }
+        }
         serviceHost();
-        enet_peer_reset(m_enetPeer);
+        {
+            std::lock_guard<std::mutex> guard(m_host->enetMutex);
+            if (notNull(m_host->enetHost)) {
+                enet_peer_reset(m_enetPeer);
+            }
+        }
         m_enetHost = nullptr;
         m_status = DISCONNECTED;
     }
@@ -17,6 +17,7 @@
 #include "G3D-gfx/Texture.h"
 #include "G3D-gfx/glFormat.h"
 #include "G3D-gfx/Milestone.h"
+#include "G3D-gfx/GLThreadQueue.h"
 #include "G3D-gfx/RenderDevice.h"
 #include "G3D-gfx/VertexBuffer.h"
 #include "G3D-gfx/AttributeArray.h"
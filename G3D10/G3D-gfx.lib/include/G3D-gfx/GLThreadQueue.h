@@ -0,0 +1,51 @@
+/**
+  \file G3D-gfx.lib/include/G3D-gfx/GLThreadQueue.h
+
+  G3D Innovation Engine http://casual-effects.com/g3d
+  Copyright 2000-2019, Morgan McGuire
+  All rights reserved
+  Available under the BSD License
+*/
+#ifndef G3D_gfx_GLThreadQueue_h
+#define G3D_gfx_GLThreadQueue_h
+
+#include "G3D-base/platform.h"
+#include <functional>
+
+namespace G3D {
+
+/**
+ \brief Lets worker threads run code that needs the OpenGL context.
+
+ The OpenGL context is current on one thread. While that thread is inside serve(),
+ other threads may call run() to have work executed on it, blocking until the work
+ is done. Outside of serve(), run() executes the work immediately on the calling
+ thread, so code that calls run() behaves exactly as if it made the call directly.
+
+ Texture::create and UniversalMaterial::create forward themselves through run(),
+ which is what allows Scene::load to resolve ArticulatedModels on worker threads.
+
+ \sa Scene::LoadOptions::prefetchModels
+*/
+class GLThreadQueue {
+public:
+
+    /** True if the calling thread is not the one inside serve() and
+        must forward OpenGL work through run() */
+    static bool mustForward();
+
+    /** Executes \a work on the thread inside serve(), or on the calling thread if
+        mustForward() is false. Blocks until \a work returns, and rethrows any exception
+        that it threw. */
+    static void run(const std::function<void()>& work);
+
+    /** Runs \a background on a new thread while executing the work that other threads
+        forward with run() on the calling thread, which must own the OpenGL context.
+        Returns once \a background has returned, rethrowing any exception that it threw.
+        May not be nested. */
+    static void serve(const std::function<void()>& background);
+};
+
+} // namespace G3D
+
+#endif
@@ -814,19 +814,27 @@ protected:
 
     mutable LoadingInfo*              m_loadingInfo = nullptr;
 
-    /** Protects m_needsForce, m_loadingThread, and m_loadingGLCallback. \sa force()  */
+    /** Protects m_needsForce, m_loadingJob, and m_loadingGLCallback. \sa force()  */
     mutable std::mutex                m_loadingMutex;
 
-    /** The thread that lazy loads into memory by invoking the m_loadingCPUCallbackQueue
-        callbacks. Not permitted to make any OpenGL calls.
-        Mutable so that it can be deallocated during the const force() method.
+    /** A unit of work for the shared LoadingPool. Defined in Texture.cpp. */
+    class LoadingJob;
 
-        The loading thread advances through m_loadingInfo.nextStep processing
+    /** Fixed-size set of threads shared by all Textures that performs the
+        CPU stages of lazy loading in priority order. Defined in Texture.cpp. */
+    class LoadingPool;
+
+    /** The pending lazy load into memory, run by a LoadingPool thread. Not permitted
+        to make any OpenGL calls. Mutable so that it can be released during the const
+        force() method.
+
+        The loading job advances through m_loadingInfo.nextStep processing
         until it reaches the UPLOAD_TO_GPU stage. That must be run during force
-        on the GL thread.
+        on the GL thread. If force() is invoked before a pool thread has started
+        the job, the job runs immediately on the calling thread instead.
 
-        \sa force() */
-    mutable std::thread*              m_loadingThread = nullptr;
+        \sa force(), setLoadingPriority() */
+    mutable shared_ptr<LoadingJob>    m_loadingJob;
     
     static int64                      m_sizeOfAllTexturesInMemory;
     
@@ -851,7 +859,7 @@ protected:
         blocks on the loading thread and does not return until the upload is completed. Otherwise it 
         does nothing. This should be called on the OpenGL thread. 
         
-        \sa m_loadingThread, m_loadingGLCallback, m_loadingMutex, m_needsForce */
+        \sa m_loadingJob, m_loadingGLCallback, m_loadingMutex, m_needsForce */
     void force() const;
 
     friend class BufferTexture;
@@ -1228,6 +1236,68 @@ public:
         return m_sizeOfAllTexturesInMemory;
     }
 
+    /** \brief Progress of the thread pool that performs the disk and decode stages
+        of lazily-loaded textures from fromFile(). Times are in seconds.
+        \sa loadingStats() */
+    class LoadingStats {
+    public:
+        int         numThreads = 0;
+
+        /** Textures waiting for a loading thread */
+        int         queued = 0;
+
+        /** Textures currently being loaded on any thread */
+        int         active = 0;
+
+        /** Textures whose CPU loading has finished */
+        int         completed = 0;
+
+        /** Textures that were released before a loading thread reached them */
+        int         cancelled = 0;
+
+        /** Mean time from fromFile() until a thread began loading */
+        RealTime    averageQueueTime = 0;
+
+        /** Mean time spent reading and decoding */
+        RealTime    averageLoadTime = 0;
+
+        RealTime    maxLoadTime = 0;
+
+        String toString() const;
+    };
+
+    /** Snapshot of the lazy loading pool, e.g., for a loading screen progress bar. */
+    static LoadingStats loadingStats();
+
+    /** Number of threads used for lazy loading by fromFile(). May be called at any time;
+        threads beyond \a n exit after their current texture. The default is the number of
+        hardware threads, at least 2. */
+    static void setNumLoadingThreads(int n);
+
+    /** While paused, loading threads do not start new textures, e.g., to keep the disk and CPU
+        free during a latency-critical section. force() still loads a paused texture
+        on the calling thread. */
+    static void setLoadingPaused(bool paused);
+
+    /** Textures that are waiting for a loading thread, in the order that they will be loaded
+        if their priorities do not change. */
+    static void getLoadingQueue(Array<shared_ptr<Texture>>& textures);
+
+    /** Destroys textures that the program released while a loading thread was reading them.
+        Loading threads cannot destroy a Texture themselves because ~Texture makes OpenGL calls.
+        Invoked on the GL thread by fromFile() and RenderDevice::endFrame(). */
+    static void releaseLoadedTextures();
+
+    /** Hint for the order in which lazily-loaded textures are read from disk. Textures that
+        are \a visible load before those that are not, and larger \a projectedScreenArea
+        (e.g., in pixels) loads first among those. Textures with equal priority load in the
+        order they were created. Has no effect if loading has already begun.
+        Does not trigger force().
+
+        Renderer::cullAndSort() sets this for the textures of every Surface each frame.
+        \sa Surface::setTextureLoadingPriority */
+    void setLoadingPriority(bool visible, float projectedScreenArea = 0.0f);
+
     /**
      True if this texture was created with an alpha channel.  Note that
      a texture may have a format that is not opaque (e.g., RGBA8) yet still
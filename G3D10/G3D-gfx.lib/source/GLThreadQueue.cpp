@@ -0,0 +1,120 @@
+/**
+  \file G3D-gfx.lib/source/GLThreadQueue.cpp
+
+  G3D Innovation Engine http://casual-effects.com/g3d
+  Copyright 2000-2019, Morgan McGuire
+  All rights reserved
+  Available under the BSD License
+*/
+#include "G3D-gfx/GLThreadQueue.h"
+#include "G3D-base/Queue.h"
+#include "G3D-base/debugAssert.h"
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
+
+namespace G3D {
+
+/** Work forwarded by run(). Lives on the stack of the waiting thread. */
+class GLThreadQueueRequest {
+public:
+    const std::function<void()>*    work;
+    std::exception_ptr              exception;
+    bool                            done = false;
+};
+
+static std::mutex                   s_mutex;
+
+/** Signaled when a request is queued or the background work finishes */
+static std::condition_variable      s_serverCondition;
+
+/** Signaled when a request completes */
+static std::condition_variable      s_requestCondition;
+
+static Queue<GLThreadQueueRequest*> s_queue;
+
+/** Read without the lock by mustForward() so that the common case costs no locking */
+static std::atomic<bool>            s_serving(false);
+static std::thread::id              s_servingThread;
+
+
+bool GLThreadQueue::mustForward() {
+    if (! s_serving.load()) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(s_mutex);
+    return s_serving.load() && (std::this_thread::get_id() != s_servingThread);
+}
+
+
+void GLThreadQueue::run(const std::function<void()>& work) {
+    std::unique_lock<std::mutex> lock(s_mutex);
+    if (! s_serving.load() || (std::this_thread::get_id() == s_servingThread)) {
+        lock.unlock();
+        work();
+        return;
+    }
+
+    GLThreadQueueRequest request;
+    request.work = &work;
+    s_queue.pushBack(&request);
+    s_serverCondition.notify_one();
+    s_requestCondition.wait(lock, [&request] { return request.done; });
+
+    if (request.exception) {
+        std::rethrow_exception(request.exception);
+    }
+}
+
+
+void GLThreadQueue::serve(const std::function<void()>& background) {
+    std::unique_lock<std::mutex> lock(s_mutex);
+    alwaysAssertM(! s_serving.load(), "GLThreadQueue::serve may not be nested");
+    s_servingThread = std::this_thread::get_id();
+    s_serving = true;
+
+    bool backgroundDone = false;
+    std::exception_ptr backgroundException;
+    std::thread backgroundThread([&] {
+        try {
+            background();
+        } catch (...) {
+            backgroundException = std::current_exception();
+        }
+        std::lock_guard<std::mutex> guard(s_mutex);
+        backgroundDone = true;
+        s_serverCondition.notify_one();
+    });
+
+    while (true) {
+        s_serverCondition.wait(lock, [&backgroundDone] { return backgroundDone || (s_queue.size() > 0); });
+        if (s_queue.size() == 0) {
+            // The background work has returned, so nothing else can be forwarded by it
+            break;
+        }
+
+        GLThreadQueueRequest* request = s_queue.popFront();
+        lock.unlock();
+        try {
+            (*request->work)();
+        } catch (...) {
+            request->exception = std::current_exception();
+        }
+        lock.lock();
+        request->done = true;
+        s_requestCondition.notify_all();
+    }
+
+    s_serving = false;
+    s_servingThread = std::thread::id();
+    lock.unlock();
+    backgroundThread.join();
+
+    if (backgroundException) {
+        std::rethrow_exception(backgroundException);
+    }
+}
+
+} // namespace G3D
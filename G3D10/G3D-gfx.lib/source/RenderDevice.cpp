@@ -1242,6 +1242,7 @@ void RenderDevice::setSwapBuffersAutomatically(bool b) {
 void RenderDevice::endFrame() {
     --m_beginEndFrame;
     VertexBuffer::resetCacheMarkers();
+    Texture::releaseLoadedTextures();
     
 
     // Because of modal dialogs, this can be higher than 0 but should never be negative or 
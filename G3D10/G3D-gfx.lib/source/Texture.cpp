@@ -19,6 +19,7 @@
 #include "G3D-base/CPUPixelTransferBuffer.h"
 #include "G3D-base/format.h"
 #include "G3D-base/CubeMap.h"
+#include "G3D-base/System.h"
 #include "G3D-gfx/glcalls.h"
 #include "G3D-gfx/Texture.h"
 #include "G3D-gfx/getOpenGLState.h"
@@ -27,9 +28,12 @@
 #include "G3D-gfx/RenderDevice.h"
 #include "G3D-gfx/Shader.h"
 #include "G3D-gfx/GLPixelTransferBuffer.h"
+#include "G3D-gfx/GLThreadQueue.h"
 #include "G3D-app/BumpMap.h"
 #include "G3D-app/GApp.h"
 #include "G3D-app/VideoRecordDialog.h"
+#include <condition_variable>
+#include <exception>
 
 #ifdef verify
 #undef verify
@@ -542,6 +546,313 @@ void Texture::completeGPULoading() {
 }
 
 
+class Texture::LoadingJob {
+public:
+    enum State { QUEUED, RUNNING, DONE, CANCELLED };
+
+    /** Weak so that releasing the last reference to a Texture cancels its load */
+    weak_ptr<Texture>   texture;
+
+    State               state = QUEUED;
+
+    bool                visible = false;
+    float               projectedScreenArea = 0.0f;
+
+    /** Creation order, for FIFO ordering among equal priorities */
+    uint64              sequence = 0;
+
+    RealTime            enqueueTime = 0;
+
+    /** Thrown by completeCPULoading() on a pool thread, rethrown by force() */
+    std::exception_ptr  error;
+
+    /** True if this job should run before \a other */
+    bool precedes(const LoadingJob& other) const {
+        if (visible != other.visible) {
+            return visible;
+        } else if (projectedScreenArea != other.projectedScreenArea) {
+            return projectedScreenArea > other.projectedScreenArea;
+        } else {
+            return sequence < other.sequence;
+        }
+    }
+};
+
+
+/** Never destroyed, so that threads still loading at program exit do not
+    race with static destruction. */
+class Texture::LoadingPool {
+private:
+    std::mutex                      m_mutex;
+
+    /** Signaled when a job is queued or finished, or the pool configuration changes */
+    std::condition_variable         m_condition;
+
+    /** Unordered; the highest priority job is found by a linear scan on dequeue so that
+        priority changes are O(1). The scan is negligible next to image decoding. */
+    Array<shared_ptr<LoadingJob>>   m_queue;
+
+    /** References held by pool threads while loading. Handed back here instead of being
+        dropped on the pool thread, because the last reference runs ~Texture, which makes
+        OpenGL calls. Released on the GL thread by releaseLoadedTextures(). */
+    Array<shared_ptr<Texture>>      m_loadedTextures;
+
+    /** Detached threads currently in threadMain() */
+    int                             m_numRunningThreads = 0;
+    int                             m_numThreads;
+    bool                            m_paused = false;
+    uint64                          m_nextSequence = 0;
+    LoadingStats                    m_stats;
+
+    LoadingPool() : m_numThreads(G3D::max(2, int(std::thread::hardware_concurrency()))) {}
+
+    /** Called with m_mutex locked */
+    int highestPriorityIndex() const {
+        int best = 0;
+        for (int i = 1; i < m_queue.size(); ++i) {
+            if (m_queue[i]->precedes(*m_queue[best])) {
+                best = i;
+            }
+        }
+        return best;
+    }
+
+    /** Called with m_mutex locked. Starts threads on demand so that programs that never
+        lazy load pay nothing. */
+    void startThreads() {
+        while (m_numRunningThreads < m_numThreads) {
+            ++m_numRunningThreads;
+            std::thread([this] { threadMain(); }).detach();
+        }
+    }
+
+    /** Runs the CPU stages for \a job, which the caller has moved to the RUNNING state */
+    void run(const shared_ptr<LoadingJob>& job, Texture* texture) {
+        const RealTime start = System::time();
+        try {
+            texture->completeCPULoading();
+        } catch (...) {
+            job->error = std::current_exception();
+        }
+        const RealTime stop = System::time();
+
+        {
+            std::lock_guard<std::mutex> guard(m_mutex);
+            job->state = LoadingJob::DONE;
+            --m_stats.active;
+            ++m_stats.completed;
+            const float n = float(m_stats.completed);
+            m_stats.averageQueueTime += ((start - job->enqueueTime) - m_stats.averageQueueTime) / n;
+            m_stats.averageLoadTime  += ((stop - start) - m_stats.averageLoadTime) / n;
+            m_stats.maxLoadTime       = G3D::max(m_stats.maxLoadTime, stop - start);
+        }
+        m_condition.notify_all();
+    }
+
+    void threadMain() {
+        while (true) {
+            shared_ptr<LoadingJob> job;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_condition.wait(lock, [this] {
+                    return (m_numRunningThreads > m_numThreads) || ((m_queue.size() > 0) && ! m_paused);
+                });
+
+                if (m_numRunningThreads > m_numThreads) {
+                    // setNumThreads() reduced the pool size
+                    --m_numRunningThreads;
+                    return;
+                }
+
+                const int i = highestPriorityIndex();
+                job = m_queue[i];
+                m_queue.fastRemove(i);
+                job->state = LoadingJob::RUNNING;
+                ++m_stats.active;
+            }
+
+            // Holding a strong reference keeps the Texture alive until the job is DONE
+            shared_ptr<Texture> texture = job->texture.lock();
+            if (isNull(texture)) {
+                // Released while this thread was dequeuing; the destructor will not wait for us
+                {
+                    std::lock_guard<std::mutex> guard(m_mutex);
+                    job->state = LoadingJob::CANCELLED;
+                    --m_stats.active;
+                    ++m_stats.cancelled;
+                }
+                m_condition.notify_all();
+            } else {
+                run(job, texture.get());
+
+                // This may be the last reference if the program released the texture during loading
+                std::lock_guard<std::mutex> guard(m_mutex);
+                m_loadedTextures.append(texture);
+                texture.reset();
+            }
+        }
+    }
+
+public:
+
+    static LoadingPool& instance() {
+        static LoadingPool* pool = new LoadingPool();
+        return *pool;
+    }
+
+    void setNumThreads(int n) {
+        {
+            std::lock_guard<std::mutex> guard(m_mutex);
+            m_numThreads = G3D::max(1, n);
+            if (m_numRunningThreads > 0) {
+                startThreads();
+            }
+        }
+        // Wake idle threads so that extra ones exit
+        m_condition.notify_all();
+    }
+
+    void setPaused(bool paused) {
+        {
+            std::lock_guard<std::mutex> guard(m_mutex);
+            m_paused = paused;
+        }
+        m_condition.notify_all();
+    }
+
+    shared_ptr<LoadingJob> enqueue(const shared_ptr<Texture>& texture) {
+        const shared_ptr<LoadingJob>& job = std::make_shared<LoadingJob>();
+        job->texture = texture;
+        job->enqueueTime = System::time();
+        {
+            std::lock_guard<std::mutex> guard(m_mutex);
+            startThreads();
+            job->sequence = m_nextSequence++;
+            m_queue.append(job);
+        }
+        m_condition.notify_one();
+        return job;
+    }
+
+    void setPriority(const shared_ptr<LoadingJob>& job, bool visible, float projectedScreenArea) {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        job->visible = visible;
+        job->projectedScreenArea = projectedScreenArea;
+    }
+
+    /** Removes \a job from the queue if no thread has started it */
+    void cancel(const shared_ptr<LoadingJob>& job) {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        if (job->state == LoadingJob::QUEUED) {
+            m_queue.remove(m_queue.findIndex(job));
+            job->state = LoadingJob::CANCELLED;
+            ++m_stats.cancelled;
+        }
+    }
+
+    /** Returns when the CPU stages of \a job are complete. Runs the job on the
+        calling thread if no pool thread has started it. */
+    void finish(const shared_ptr<LoadingJob>& job, Texture* texture) {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            if (job->state == LoadingJob::QUEUED) {
+                m_queue.remove(m_queue.findIndex(job));
+                job->state = LoadingJob::RUNNING;
+                ++m_stats.active;
+            } else {
+                m_condition.wait(lock, [&job] { return job->state == LoadingJob::DONE; });
+                lock.unlock();
+                if (job->error) {
+                    std::rethrow_exception(job->error);
+                }
+                return;
+            }
+        }
+
+        run(job, texture);
+        if (job->error) {
+            std::rethrow_exception(job->error);
+        }
+    }
+
+    /** Called on the GL thread */
+    void releaseLoadedTextures() {
+        Array<shared_ptr<Texture>> loaded;
+        {
+            std::lock_guard<std::mutex> guard(m_mutex);
+            Array<shared_ptr<Texture>>::swap(loaded, m_loadedTextures);
+        }
+        // Any Texture that the program released during loading is destroyed here, outside of the lock
+        loaded.clear();
+    }
+
+    void getQueue(Array<shared_ptr<Texture>>& textures) {
+        textures.fastClear();
+        std::lock_guard<std::mutex> guard(m_mutex);
+        Array<shared_ptr<LoadingJob>> order = m_queue;
+        order.sort([](const shared_ptr<LoadingJob>& a, const shared_ptr<LoadingJob>& b) { return a->precedes(*b); });
+        for (const shared_ptr<LoadingJob>& job : order) {
+            const shared_ptr<Texture>& texture = job->texture.lock();
+            if (notNull(texture)) {
+                textures.append(texture);
+            }
+        }
+    }
+
+    LoadingStats stats() {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        LoadingStats s = m_stats;
+        s.numThreads = m_numThreads;
+        s.queued = m_queue.size();
+        return s;
+    }
+};
+
+
+String Texture::LoadingStats::toString() const {
+    return G3D::format("%d/%d textures loaded (%d queued, %d active, %d cancelled) on %d threads; "
+                  "average wait %.1f ms, average load %.1f ms, max load %.1f ms",
+                  completed, completed + queued + active, queued, active, cancelled, numThreads,
+                  averageQueueTime * 1000.0, averageLoadTime * 1000.0, maxLoadTime * 1000.0);
+}
+
+
+Texture::LoadingStats Texture::loadingStats() {
+    return LoadingPool::instance().stats();
+}
+
+
+void Texture::setNumLoadingThreads(int n) {
+    LoadingPool::instance().setNumThreads(n);
+}
+
+
+void Texture::setLoadingPaused(bool paused) {
+    LoadingPool::instance().setPaused(paused);
+}
+
+
+void Texture::getLoadingQueue(Array<shared_ptr<Texture>>& textures) {
+    LoadingPool::instance().getQueue(textures);
+}
+
+
+void Texture::releaseLoadedTextures() {
+    LoadingPool::instance().releaseLoadedTextures();
+}
+
+
+void Texture::setLoadingPriority(bool visible, float projectedScreenArea) {
+    // Quick, mutex-less conservative out for textures that are already loaded
+    if (! m_needsForce) { return; }
+
+    std::lock_guard<std::mutex> guard(m_loadingMutex);
+    if (notNull(m_loadingJob)) {
+        LoadingPool::instance().setPriority(m_loadingJob, visible, projectedScreenArea);
+    }
+}
+
+
 void Texture::force() const {
     // Quick, mutex-less conservative out for the common run-time case
     if (! m_needsForce) { return; }
@@ -551,13 +862,17 @@ void Texture::force() const {
         if (! m_needsForce) { m_loadingMutex.unlock(); return; }
 
         debugAssert(notNull(m_loadingInfo));
-        debugAssert(notNull(m_loadingThread));
+        debugAssert(notNull(m_loadingJob));
+
+        // Block on the actual loading operation, or run it here if it has not started
+        try {
+            LoadingPool::instance().finish(m_loadingJob, const_cast<Texture*>(this));
+        } catch (...) {
+            m_loadingMutex.unlock();
+            throw;
+        }
+        m_loadingJob.reset();
 
-        // Block on the actual loading operation
-        m_loadingThread->join();
-        // Free the callback code
-        delete m_loadingThread;
-        m_loadingThread = nullptr;       
         // Upload to GL
         const_cast<Texture*>(this)->completeGPULoading();
 
@@ -1203,6 +1518,13 @@ Texture::TexelType Texture::texelType() const {
 
     
 shared_ptr<Texture> Texture::create(const Specification& s) {
+    if (GLThreadQueue::mustForward()) {
+        // The cache is not thread-safe and constant textures are uploaded immediately
+        shared_ptr<Texture> t;
+        GLThreadQueue::run([&] { t = create(s); });
+        return t;
+    }
+
     if (s.cachable) {
         if ((s.filename == "<white>" || s.filename.empty()) && s.alphaFilename.empty() && (s.dimension == DIM_2D) && s.encoding.readMultiplyFirst.isOne() && s.encoding.readAddSecond.isZero()) {
             // Make a single white texture when the other properties don't matter
@@ -1374,12 +1696,9 @@ shared_ptr<Texture> Texture::fromFile
         instance->completeCPULoading();
         instance->completeGPULoading();
     } else {
-        instance->m_loadingThread = new std::thread([instance]() { instance->completeCPULoading(); });
-#       if defined(G3D_WINDOWS) && 0
-            String sname = String("Loading ") + instance->m_name;
-            std::wstring wname(sname.begin(), sname.end());
-            SetThreadDescription(instance->m_loadingThread->native_handle(), wname.c_str());
-#       endif
+        // This is the GL thread, so destroy textures that were released while loading
+        releaseLoadedTextures();
+        instance->m_loadingJob = LoadingPool::instance().enqueue(instance);
     }
 
     return instance;
@@ -2234,12 +2553,19 @@ bool Texture::isSupportedImage(const String& filename) {
 Texture::~Texture() {
     reallocateHook(m_textureID);
     s_allTextures.remove((uintptr_t)this);
-    if (m_destroyGLTextureInDestructor) {
-        if (notNull(m_loadingThread)) {
-            m_loadingThread->detach();
-            delete m_loadingThread;
-            m_loadingThread = nullptr;
+    if (notNull(m_loadingJob)) {
+        // No pool thread can be running this job, since a running job holds a reference
+        // to this Texture. Drop it from the queue if it has not been dequeued yet.
+        LoadingPool::instance().cancel(m_loadingJob);
+        m_loadingJob.reset();
+        if (notNull(m_loadingInfo)) {
+            delete m_loadingInfo->binaryInput;
+            delete m_loadingInfo;
+            m_loadingInfo = nullptr;
         }
+    }
+
+    if (m_destroyGLTextureInDestructor) {
 
         m_sizeOfAllTexturesInMemory -= sizeInMemory();
         if (m_textureID != GL_NONE) {
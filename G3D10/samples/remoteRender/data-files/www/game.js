@@ -18,6 +18,10 @@ var MessageType = {
     // Matches G3D::GEventType::KEY_UP
     KEY_UP: 3,
 
+    // Only the tiles of the frame that changed since the last one received
+    TILES: 4,
+
+    // Acknowledges receipt of an IMAGE or TILES message so that the server sends the next frame
     SEND_IMAGE: 1000
 };
 
@@ -37,9 +41,13 @@ var socket;
 /** Virtual directional pad */
 var dpad;
 
-/** Current image being displayed */
+/** Current image being displayed. Either an Image or the canvas that tiles are drawn into. */
 var img;
 
+/** Frame number of the most recent tile drawn at each position, so that
+    tiles that finish decoding out of order do not overwrite newer ones */
+var tileFrame = {};
+
 ///////////////////////////////////////////////////////////////
 //                                                           //
 //                      EVENT RULES                          //
@@ -137,7 +145,12 @@ function onReceiveMessage(msg) {
 
             // Now that we've received this one, ask the server for a new image.  It will be transmitted
             // while this one is encoding.
-            sendMessage({ type: MessageType.SEND_IMAGE });
+            sendMessage({ type: MessageType.SEND_IMAGE, frame: msg.frame });
+            break;
+
+        case MessageType.TILES:
+            receiveTiles(msg);
+            sendMessage({ type: MessageType.SEND_IMAGE, frame: msg.frame });
             break;
 
     case MessageType.COMMENT:
@@ -154,6 +167,39 @@ function onReceiveMessage(msg) {
 //                                                           //
 //                      HELPER RULES                         //
 
+/** Decodes each tile in a TILES message and draws it into the frame canvas */
+function receiveTiles(msg) {
+    if (! img || ! img.getContext || (img.width !== msg.width) || (img.height !== msg.height)) {
+        // The first frame or a new size; the server sends every tile
+        img = document.createElement('canvas');
+        img.width = msg.width;
+        img.height = msg.height;
+        tileFrame = {};
+    }
+    var canvas = img;
+
+    var offset = 0;
+    for (var i = 0; i < msg.tiles.length; ++i) {
+        var x = msg.tiles[i][0], y = msg.tiles[i][1], bytes = msg.tiles[i][4];
+        drawTile(canvas, msg.frame, x, y, msg.mimeType, msg.data.subarray(offset, offset + bytes));
+        offset += bytes;
+    }
+}
+
+
+function drawTile(canvas, frame, x, y, mimeType, data) {
+    var tile = new Image();
+    tile.onload = function () {
+        var key = x + ',' + y;
+        if ((canvas === img) && ! (tileFrame[key] > frame)) {
+            tileFrame[key] = frame;
+            canvas.getContext('2d').drawImage(tile, x, y);
+        }
+    };
+    tile.onerror = function (evt) { console.log('error loading tile'); };
+    tile.src = 'data:' + mimeType + ';base64,' + btoa(String.fromCharCode.apply(undefined, data));
+}
+
 function createDPad() {
     // Create the directional pad.  Note that images might not have
     // loaded yet, so we can't refer to their width and height.
@@ -12,8 +12,9 @@ G3D_START_AT_MAIN();
 /** Events coming in from the remote machine */
 static ThreadsafeQueue<GEvent>      remoteEventQueue;
 
-/** Set to 1 when the client requests a full-screen image and back to 0 after the frame is sent. */
-static std::atomic_int              clientWantsImage(0);
+/** Encodes frames and sends them to every connected client on background threads.
+    Created in App::startWebServer. */
+static shared_ptr<WebFrameStreamer> frameStreamer;
 
 /** Socket URI used to link the connections 
     /websocket is matched with the one in game.js */
@@ -94,6 +95,13 @@ void printRequest(const mg_request_info* request_info) {
 void App::startWebServer() {
     alwaysAssertM(notNull(m_webServer), "server is null");
 
+    // JPEG encoding/decoding takes more time but substantially less bandwidth than PNG.
+    // Only the 64x64 tiles that changed since a client's last frame are sent to it.
+    WebFrameStreamer::Specification specification;
+    specification.fileFormat = Image::JPEG;
+    specification.tileSize = 64;
+    frameStreamer = WebFrameStreamer::create(specification);
+
     // start the server first then add handlers, the order matters
     // Start the web server.
     m_webServer->start();
@@ -106,6 +114,9 @@ void App::startWebServer() {
 
 void App::stopWebServer() {
     alwaysAssertM(notNull(m_webServer), "server is null");
+
+    // Join the encoder and sender threads before the connections close
+    frameStreamer.reset();
     m_webServer->stop();
 }
 
@@ -161,33 +172,6 @@ bool App::onEvent(const GEvent& event) {
 }
 
 
-static void sendImage(const shared_ptr<Image>& image, const Array<shared_ptr<WebServer::WebSocket>>& socketArray, Image::ImageFileFormat ff) {
-    static const int IMAGE = 1;
-    BinaryOutput bo("<memory>", G3D_BIG_ENDIAN);
-
-    alwaysAssertM((ff == Image::PNG) || (ff == Image::JPEG), "Only PNG and JPEG are supported right now");
-    const char* mimeType = (ff == Image::PNG) ? "image/png" : "image/jpeg";
-    const String& msg = 
-        format("{\"type\":%d,\"width\":%d,\"height\":%d,\"mimeType\":\"%s\"}",IMAGE, image->width(), image->height(), mimeType);
-
-    // JSON header length (in network byte order)
-    bo.writeInt32((int32)msg.length());
-
-    // JSON header
-    bo.writeString(msg, (int32)msg.length());
-
-    // Binary data
-    image->serialize(bo, ff);
-    
-    // Send to all children
-    for (const shared_ptr<WebServer::WebSocket>& socket : socketArray) {
-        const size_t bytes = socket->send(bo);
-        (void)bytes;
-        // debugPrintf("Sent %d bytes\n", (unsigned int)bytes);
-    }
-}
-
-
 void App::onGraphics3D(RenderDevice* rd, Array<shared_ptr<Surface> >& allSurfaces) {
     // Perform gamma correction, bloom, and SSAA, and write to the native window frame buffer
     rd->pushState(m_finalFramebuffer); {
@@ -199,13 +183,10 @@ void App::onGraphics3D(RenderDevice* rd, Array<shared_ptr<Surface> >& allSurface
         Draw::rect2D(m_finalFramebuffer->texture(0)->rect2DBounds(), rd, Color3::white(), m_finalFramebuffer->texture(0));
     } rd->pop2D();
 
-    if (clientWantsImage.load() != 0) {
-        Array<shared_ptr<WebServer::WebSocket>> array;
-        m_webServer->getWebSocketArray(socketUri, array);
-
-        // JPEG encoding/decoding takes more time but substantially less bandwidth than PNG
-        sendImage(m_finalFramebuffer->texture(0)->toImage(ImageFormat::RGB8()), array, Image::JPEG);
-        clientWantsImage = 0;
+    if (frameStreamer->hasClients()) {
+        // Returns immediately. Encoding and sending happen on other threads, and clients
+        // that are still receiving earlier frames skip this one.
+        frameStreamer->submitFrame(m_finalFramebuffer->texture(0)->toImage(ImageFormat::RGB8()));
     }
 }
 
@@ -221,8 +202,13 @@ void App::onGraphics2D(RenderDevice* rd, Array<shared_ptr<Surface2D> >& posed2D)
         Array<shared_ptr<WebServer::WebSocket>> array;  m_webServer->getWebSocketArray(socketUri, array);
         m_font->draw2D(rd, format("%d clients connected:", array.size()), Vector2(400, 10), 18, Color3::white(), Color3::black());
         float y = 40;
-        for (const shared_ptr<WebServer::WebSocket>& socket : array) {
-            y += m_font->draw2D(rd, socket->clientAddress.toString(), Vector2(400, y), 12, Color3::white(), Color3::black()).y + 5;
+        Array<WebFrameStreamer::ClientStats> clientStats;
+        frameStreamer->getClientStats(clientStats);
+        for (const WebFrameStreamer::ClientStats& stats : clientStats) {
+            const String& text = format("%s  %d frames, %d skipped, %.0f KB/s, %.0f ms latency",
+                stats.clientAddress.toString().c_str(), stats.framesSent, stats.framesSkipped,
+                stats.bytesPerSecond / 1024.0, stats.averageLatency * 1000.0);
+            y += m_font->draw2D(rd, text, Vector2(400, y), 12, Color3::white(), Color3::black()).y + 5;
         }
     }
 
@@ -249,7 +235,16 @@ bool MySocket::onConnect() {
 void MySocket::onReady() {
     // Handshake with a new client
     send("{\"type\": 0, \"value\":\"server ready\"}");
-    clientWantsImage = 1;
+    if (notNull(frameStreamer)) {
+        frameStreamer->addClient(dynamic_pointer_cast<WebSocket>(shared_from_this()));
+    }
+}
+
+
+void MySocket::onClose() {
+    if (notNull(frameStreamer)) {
+        frameStreamer->removeClient(dynamic_pointer_cast<WebSocket>(shared_from_this()));
+    }
 }
 
 
@@ -263,6 +258,11 @@ bool MySocket::onData(Opcode opcode, char* data, size_t data_len) {
         return true;
     }
 
+    // Frame acknowledgements
+    if (notNull(frameStreamer) && frameStreamer->onClientData(dynamic_pointer_cast<WebSocket>(shared_from_this()), opcode, data, data_len)) {
+        return true;
+    }
+
     if ((data_len < 2) || (data[0] != '{')) {
         // Some corrupt message
         debugPrintf("Message makes no sense\n");
@@ -275,7 +275,6 @@ bool MySocket::onData(Opcode opcode, char* data, size_t data_len) {
         const Any msg(t);
 
         const int UNKNOWN = 0;
-        const int SEND_IMAGE = 1000;
         const int type = msg.get("type", UNKNOWN);
 
         switch (type) {
@@ -283,10 +282,6 @@ bool MySocket::onData(Opcode opcode, char* data, size_t data_len) {
             debugPrintf("Cannot identify message type\n");
             break;
 
-        case SEND_IMAGE:
-            clientWantsImage = 1;
-            break;
-
         case GEventType::KEY_DOWN:
         case GEventType::KEY_UP:
         {
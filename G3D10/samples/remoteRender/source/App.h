@@ -73,6 +73,8 @@ public:
 
     bool onData(Opcode opcode, char* data, size_t data_len) override;
 
+    void onClose() override;
+
 };
 
 #endif
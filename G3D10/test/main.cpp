@@ -39,6 +39,13 @@ using G3D::uint8;
 // Forward declarations
 void testImageConvert();
 void testImage();
+void testImageResampler();
+void perfImageResampler();
+void testTextureTileCache();
+void testTextureLoading();
+void testGFont();
+void testPathTracer();
+void perfTextureTileCache();
 
 void perfArray();
 void testArray();
@@ -58,6 +65,8 @@ void testuint128();
 void testCollisionDetection();
 void perfCollisionDetection();
 
+void testWelder();
+
 void testWeakCache();
 void testCallback();
 
@@ -89,11 +98,33 @@ void testMap2D();
 void testReferenceCount();
 
 void testRandom();
+void testCubeMapSampler();
+void perfCubeMapSampler();
 
 void perfTextOutput();
 
 void testMeshAlgTangentSpace();
 
+void testArticulatedModelMergeVertices();
+void testLightTree();
+void testInstancedTriTree();
+void testWebFrameStreamer();
+void testNetwork();
+void perfNetwork();
+void testGLThreadQueue();
+void testGAppFrameLoop();
+void testVoxelOctree();
+void perfVoxelOctree();
+void testPointLODOctree();
+void perfPointLODOctree();
+void testParsePLY();
+void perfParsePLY();
+void testHeightfieldModel();
+void perfHeightfieldModel();
+void testMD2Model();
+void perfMD2Model();
+void perfArticulatedModelMergeVertices();
+
 void perfQueue();
 void testQueue();
 
@@ -117,6 +148,8 @@ void testfilter();
 
 void testAny();
 
+void testVideoOutput();
+
 void testFastPODTable() {
     typedef FastPODTable<int, int, HashTrait<int>, EqualsTrait<int>, true> TestTable;
 
@@ -748,6 +781,11 @@ int main(int argc, char* argv[]) {
 
         perfMatrix3();
 
+        perfCubeMapSampler();
+
+        perfImageResampler();
+        perfTextureTileCache();
+
         perfTextOutput();
 
         measureNormalizationPerformance();
@@ -769,6 +807,20 @@ int main(int argc, char* argv[]) {
         
         perfKDTree();
 
+        perfVoxelOctree();
+
+        perfPointLODOctree();
+
+        perfParsePLY();
+
+        perfHeightfieldModel();
+
+        perfMD2Model();
+
+        perfNetwork();
+
+        perfArticulatedModelMergeVertices();
+
         if (renderDevice) {
             renderDevice->cleanup();
             delete renderDevice;
@@ -815,6 +867,8 @@ int main(int argc, char* argv[]) {
 
     testCollisionDetection();  
 
+    testWelder();
+
     testTextInput();
     testTextInput2();
     printf("  passed\n");
@@ -823,6 +877,10 @@ int main(int argc, char* argv[]) {
 
     testImageConvert();
 
+    testImageResampler();
+    testTextureTileCache();
+    testPathTracer();
+
     testLineSegment2D();
 
     if (! renderDevice) {
@@ -831,8 +889,13 @@ int main(int argc, char* argv[]) {
     }
 
     if (renderDevice) {
+        testTextureLoading();
+        testGFont();
         testKDTree();
         testGLight();
+        testLightTree();
+        testHeightfieldModel();
+        testMD2Model();
     }
 
     if (renderDevice) {
@@ -841,6 +904,8 @@ int main(int argc, char* argv[]) {
         renderDevice = NULL;
     }
 
+    testGAppFrameLoop();
+
     testZip();
 
     testMap2D();
@@ -894,11 +959,22 @@ int main(int argc, char* argv[]) {
     printf("  passed\n");
     testAdjacency();
     printf("  passed\n");
+
+    testArticulatedModelMergeVertices();
+
     testWildcards();
     printf("  passed\n");
 
     
     testRandom();
+    testCubeMapSampler();
+    testVoxelOctree();
+    testPointLODOctree();
+    testParsePLY();
+    testInstancedTriTree();
+    testWebFrameStreamer();
+    testNetwork();
+    testGLThreadQueue();
 
     testFuzzy();
     printf("  passed\n");
@@ -919,6 +995,8 @@ int main(int argc, char* argv[]) {
 
     testPointHashGrid();
 
+    testVideoOutput();
+
 #   ifdef RUN_SLOW_TESTS
         testHugeBinaryIO();
         printf("  passed\n");
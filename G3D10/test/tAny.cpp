@@ -285,6 +285,57 @@ static void testParse() {
     }
 }
 
+static void testBinary() {
+    const String& src =
+        "Scene {\n\
+            // The camera\n\
+            camera = Camera { position = Vector3(0, 1.5, -2); mask = 0xFF; };\n\
+            names = [\"a\\nb\", c, None];\n\
+            flags = (true, false, 1.#INF);\n\
+            empty = {};\n\
+        }";
+
+    const Any& a = Any::parse(src);
+
+    BinaryOutput out("<memory>", G3D_LITTLE_ENDIAN);
+    a.serialize(out);
+    Array<uint8> buffer;
+    buffer.resize(int(out.size()));
+    out.commit(buffer.getCArray());
+
+    Any b;
+    BinaryInput in(buffer.getCArray(), buffer.size(), G3D_LITTLE_ENDIAN);
+    b.deserialize(in);
+
+    testAssert(a == b);
+    testAssert(b.name() == "Scene");
+    testAssert(b["camera"].comment() == "The camera");
+    testAssert(b["camera"]["mask"].number() == 255);
+    testAssert(b["names"][0].string() == "a\nb");
+    testAssert(b["names"][2].isNil());
+    testAssert(b["camera"]["position"].source().line == a["camera"]["position"].source().line);
+    testAssert(b["camera"]["position"].source().character == a["camera"]["position"].source().character);
+    testAssert(b.unparse() == a.unparse());
+
+    // Version 1 streams stored the unparsed text
+    BinaryOutput old("<memory>", G3D_LITTLE_ENDIAN);
+    old.writeInt32(1);
+    old.writeString32(a.unparse());
+    buffer.resize(int(old.size()));
+    old.commit(buffer.getCArray());
+
+    Any c;
+    BinaryInput oldIn(buffer.getCArray(), buffer.size(), G3D_LITTLE_ENDIAN);
+    c.deserialize(oldIn);
+    testAssert(a == c);
+
+    a.saveBinary("Any-save.anyb");
+    Any d;
+    d.load("Any-save.anyb");
+    testAssert(a == d);
+}
+
+
 static void testTableReader() {
     Any a(Any::TABLE);
     a["HI"] = 3;
@@ -307,6 +358,7 @@ void testAny() {
     printf("G3D::Any ");
     testTableReader();
     testParse();
+    testBinary();
 
     testRefCount1();
     testRefCount2();
@@ -334,6 +386,13 @@ void testAny() {
             throw "Any-load.txt and Any-save.txt differ.";
         }
 
+        any .saveBinary("Any-save.anyb");
+        any2.load("Any-save.anyb");
+        if (any != any2) {
+            any2.save("Any-failed.txt");
+            throw "Any-load.txt and Any-save.anyb differ.";
+        }
+
         // Trigger the destructors explicitly to help test reference counting
         any = Any();
         any2 = Any();
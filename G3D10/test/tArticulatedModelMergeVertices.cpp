@@ -0,0 +1,186 @@
+/**
+  \file test/tArticulatedModelMergeVertices.cpp
+
+  G3D Innovation Engine http://casual-effects.com/g3d
+  Copyright 2000-2019, Morgan McGuire
+  All rights reserved
+  Available under the BSD License
+*/
+#include "G3D/G3D.h"
+#include "printhelpers.h"
+#include "testassert.h"
+
+typedef ArticulatedModel::Geometry::Face AMFace;
+
+/** A jittered grid of triangles with every vertex duplicated per face, some normals that differ by
+    more than the weld angle, some zero normals, and a few degenerate faces. */
+static void makeTriangleSoup(int gridSize, ArticulatedModel::Mesh* mesh, Array<AMFace>& faceArray) {
+    Random rnd(1234, false);
+    const Vector3 normal[] = {Vector3::unitZ(), Vector3(0.0f, 0.1f, 1.0f).direction(), Vector3::unitX(), Vector3::zero()};
+
+    for (int y = 0; y < gridSize; ++y) {
+        for (int x = 0; x < gridSize; ++x) {
+            AMFace::Vertex v[4];
+            for (int i = 0; i < 4; ++i) {
+                const int cx = x + (i & 1);
+                const int cy = y + (i >> 1);
+                v[i].position  = Point3(float(cx), float(cy), float((cx * 7 + cy * 3) % 5));
+                v[i].texCoord0 = Point2(float(cx), float(cy)) / float(gridSize);
+                v[i].normal    = normal[rnd.integer(0, 3)];
+                v[i].tangent   = Vector4(1, 0, 0, 1);
+            }
+
+            faceArray.append(AMFace(mesh, v[0], v[1], v[3]));
+            faceArray.append(AMFace(mesh, v[0], v[3], v[2]));
+
+            if (rnd.integer(0, 50) == 0) {
+                faceArray.append(AMFace(mesh, v[0], v[0], v[1]));
+            }
+        }
+    }
+}
+
+
+/** Checks that the output of mergeVertices is consistent with faceArray */
+static void checkMerge(const Array<AMFace>& faceArray, float maxNormalWeldAngle, const ArticulatedModel::Geometry* geometry, const ArticulatedModel::Mesh* mesh) {
+    const float threshold = cos(maxNormalWeldAngle);
+    const Array<CPUVertexArray::Vertex>& vertex = geometry->cpuVertexArray.vertex;
+    const Array<int>& index = mesh->cpuIndexArray;
+
+    int i = 0;
+    for (const AMFace& face : faceArray) {
+        if ((i < index.size()) &&
+            (vertex[index[i]].position == face.vertex[0].position) &&
+            (vertex[index[i + 1]].position == face.vertex[1].position) &&
+            (vertex[index[i + 2]].position == face.vertex[2].position)) {
+
+            for (int v = 0; v < 3; ++v) {
+                const CPUVertexArray::Vertex& out = vertex[index[i + v]];
+                testAssert(out.texCoord0 == face.vertex[v].texCoord0);
+                testAssert(out.normal.isZero() || face.vertex[v].normal.isZero() || (out.normal.dot(face.vertex[v].normal) >= threshold));
+            }
+            i += 3;
+        }
+    }
+
+    // Every triangle was accounted for, and only degenerate ones were dropped
+    testAssert(i == index.size());
+
+    // No two output vertices could have been welded
+    Table<Point3, Array<int>> byPosition;
+    for (int v = 0; v < vertex.size(); ++v) {
+        byPosition.getCreate(vertex[v].position).append(v);
+    }
+    for (Table<Point3, Array<int>>::Iterator it = byPosition.begin(); it.isValid(); ++it) {
+        const Array<int>& list = it->value;
+        for (int a = 0; a < list.size(); ++a) {
+            for (int b = a + 1; b < list.size(); ++b) {
+                const CPUVertexArray::Vertex& A = vertex[list[a]];
+                const CPUVertexArray::Vertex& B = vertex[list[b]];
+                testAssert((A.texCoord0 != B.texCoord0) || (A.normal.dot(B.normal) < threshold));
+                testAssert(! A.normal.isZero() && ! B.normal.isZero());
+            }
+        }
+    }
+}
+
+
+static void testTwoTriangles() {
+    shared_ptr<ArticulatedModel> model = ArticulatedModel::createEmpty("test");
+    ArticulatedModel::Part*     part     = model->addPart("root");
+    ArticulatedModel::Geometry* geometry = model->addGeometry("geom");
+    ArticulatedModel::Mesh*     mesh     = model->addMesh("mesh", part, geometry);
+
+    AMFace::Vertex v[4];
+    for (int i = 0; i < 4; ++i) {
+        v[i].position = Point3(float(i & 1), float(i >> 1), 0.0f);
+        v[i].normal   = Vector3::unitZ();
+    }
+
+    Array<AMFace> faceArray;
+    faceArray.append(AMFace(mesh, v[0], v[1], v[3]));
+    faceArray.append(AMFace(mesh, v[0], v[3], v[2]));
+
+    geometry->mergeVertices(faceArray, 0.1f, Array<ArticulatedModel::Mesh*>(mesh));
+
+    // Vertices are numbered in order of first use
+    testAssert(geometry->cpuVertexArray.size() == 4);
+    const int expected[] = {0, 1, 2, 0, 2, 3};
+    testAssert(mesh->cpuIndexArray.size() == 6);
+    for (int i = 0; i < 6; ++i) {
+        testAssert(mesh->cpuIndexArray[i] == expected[i]);
+    }
+    testAssert(geometry->cpuVertexArray.vertex[3].position == v[2].position);
+
+    // Bending the second face past the weld angle splits its vertices
+    faceArray[1].vertex[0].normal = faceArray[1].vertex[1].normal = Vector3::unitX();
+    geometry->mergeVertices(faceArray, 0.1f, Array<ArticulatedModel::Mesh*>(mesh));
+    testAssert(geometry->cpuVertexArray.size() == 6);
+    testAssert(mesh->cpuIndexArray[3] == 3);
+    testAssert(mesh->cpuIndexArray[4] == 4);
+}
+
+
+void testArticulatedModelMergeVertices() {
+    printf("ArticulatedModel::Geometry::mergeVertices ");
+
+    testTwoTriangles();
+
+    shared_ptr<ArticulatedModel> model = ArticulatedModel::createEmpty("test");
+    ArticulatedModel::Part*     part     = model->addPart("root");
+    ArticulatedModel::Geometry* geometry = model->addGeometry("geom");
+    ArticulatedModel::Mesh*     mesh     = model->addMesh("mesh", part, geometry);
+
+    // Large enough to exercise the multithreaded path
+    Array<AMFace> faceArray;
+    makeTriangleSoup(150, mesh, faceArray);
+
+    const float angle = 0.2f;
+    geometry->mergeVertices(faceArray, angle, Array<ArticulatedModel::Mesh*>(mesh));
+    checkMerge(faceArray, angle, geometry, mesh);
+
+    // Identical to the serial reference implementation, vertex for vertex and index for index
+    const Array<CPUVertexArray::Vertex> parallelVertex = geometry->cpuVertexArray.vertex;
+    const Array<int> parallelIndex = mesh->cpuIndexArray;
+    geometry->mergeVertices(faceArray, angle, Array<ArticulatedModel::Mesh*>(mesh), true);
+    checkMerge(faceArray, angle, geometry, mesh);
+
+    const Array<CPUVertexArray::Vertex>& serialVertex = geometry->cpuVertexArray.vertex;
+    testAssert(parallelVertex.size() == serialVertex.size());
+    for (int v = 0; v < serialVertex.size(); ++v) {
+        testAssert(parallelVertex[v].position  == serialVertex[v].position);
+        testAssert(parallelVertex[v].normal    == serialVertex[v].normal);
+        testAssert(parallelVertex[v].texCoord0 == serialVertex[v].texCoord0);
+        testAssert(parallelVertex[v].tangent   == serialVertex[v].tangent);
+    }
+    testAssert(parallelIndex.size() == mesh->cpuIndexArray.size());
+    for (int i = 0; i < parallelIndex.size(); ++i) {
+        testAssert(parallelIndex[i] == mesh->cpuIndexArray[i]);
+    }
+
+    printf("passed\n");
+}
+
+
+void perfArticulatedModelMergeVertices() {
+    PRINT_SECTION("Performance: ArticulatedModel::Geometry::mergeVertices", "");
+
+    shared_ptr<ArticulatedModel> model = ArticulatedModel::createEmpty("test");
+    ArticulatedModel::Part*     part     = model->addPart("root");
+    ArticulatedModel::Geometry* geometry = model->addGeometry("geom");
+    ArticulatedModel::Mesh*     mesh     = model->addMesh("mesh", part, geometry);
+
+    Array<AMFace> faceArray;
+    makeTriangleSoup(1000, mesh, faceArray);
+    const int numFaceVertices = faceArray.size() * 3;
+
+    Stopwatch timer;
+    timer.tick();
+    geometry->mergeVertices(faceArray, 0.2f, Array<ArticulatedModel::Mesh*>(mesh));
+    timer.tock();
+
+    const chrono::nanoseconds elapsed = timer.elapsedDuration();
+    PRINT_HEADER(format("%d face vertices -> %d vertices", numFaceVertices, geometry->cpuVertexArray.size()).c_str());
+    PRINT_MILLI("mergeVertices", "ms", elapsed);
+    printf("    %.1f M face vertices/s\n", numFaceVertices / (1e3 * std::chrono::duration<double, std::milli>(elapsed).count()));
+}
@@ -180,6 +180,115 @@ static void testCompression() {
 }
 
 
+/** Mildly compressible value of element \a i */
+static uint32 chunkedTestValue(int i) {
+    return uint32(i * 2654435761u) >> (i & 15);
+}
+
+
+static void testChunkedCompression() {
+    printf("BinaryInput & BinaryOutput chunked compression\n");
+    static const int N = 300000;
+    static const int blockLength = 4096;
+
+    // Several flushes of complete blocks happen before commit
+    {
+        BinaryOutput f("outChunked.t", G3D_BIG_ENDIAN);
+        f.setChunkedCompression(6, blockLength);
+        for (int i = 0; i < N; ++i) {
+            f.writeUInt32(chunkedTestValue(i));
+        }
+        f.writeString("end");
+        f.commit();
+        testAssert(f.length() == N * 4 + 4);
+    }
+
+    BinaryInput g("outChunked.t", G3D_BIG_ENDIAN, true);
+    testAssert(g.getLength() == N * 4 + 4);
+    testAssert(g.compressedBlockLength() == blockLength);
+    testAssert(g.numCompressedBlocks() == (N * 4 + 4 + blockLength - 1) / blockLength);
+    g.setReadAheadBlocks(3);
+    for (int i = 0; i < N; ++i) {
+        testAssert(g.readUInt32() == chunkedTestValue(i));
+    }
+    testAssert(g.readString() == "end");
+
+    // Random access, including reads that span blocks
+    g.setPositionToBlock(17);
+    testAssert(g.readUInt32() == chunkedTestValue(17 * blockLength / 4));
+    g.setPosition(4 * 1000);
+    testAssert(g.readUInt32() == chunkedTestValue(1000));
+    Array<uint32> span;
+    g.setPosition(4 * 100000 - 8);
+    g.readUInt32(span, 5 * blockLength);
+    for (int i = 0; i < span.size(); ++i) {
+        testAssert(span[i] == chunkedTestValue(100000 - 2 + i));
+    }
+
+    // The in-memory container is decompressed all at once
+    BinaryOutput m("<memory>", G3D_LITTLE_ENDIAN);
+    m.setChunkedCompression(9, blockLength);
+    for (int i = 0; i < 10000; ++i) {
+        m.writeUInt32(chunkedTestValue(i));
+    }
+    m.commit();
+    testAssert(m.length() < 40000);
+
+    BinaryInput h(m.getCArray(), m.length(), G3D_LITTLE_ENDIAN, true);
+    testAssert(h.getLength() == 40000);
+    testAssert(h.numCompressedBlocks() == 10);
+    for (int i = 0; i < 10000; ++i) {
+        testAssert(h.readUInt32() == chunkedTestValue(i));
+    }
+
+    FileSystem::removeFile("outChunked.t");
+}
+
+
+static void measureChunkedCompression() {
+    static const int N = 16 * 1024 * 1024;
+    Stopwatch stopwatch;
+    chrono::nanoseconds writeTime[2], readTime[2];
+
+    for (int chunked = 0; chunked < 2; ++chunked) {
+        stopwatch.tick();
+        {
+            BinaryOutput f("outChunked.t", G3D_LITTLE_ENDIAN);
+            if (chunked) {
+                f.setChunkedCompression(6);
+            }
+            for (int i = 0; i < N; ++i) {
+                f.writeUInt32(chunkedTestValue(i));
+            }
+            if (! chunked) {
+                f.compress(6);
+            }
+            f.commit();
+        }
+        stopwatch.tock();
+        writeTime[chunked] = stopwatch.elapsedDuration();
+
+        stopwatch.tick();
+        {
+            BinaryInput g("outChunked.t", G3D_LITTLE_ENDIAN, true);
+            uint32 sum = 0;
+            for (int i = 0; i < N; ++i) {
+                sum += g.readUInt32();
+            }
+            (void)sum;
+        }
+        stopwatch.tock();
+        readTime[chunked] = stopwatch.elapsedDuration();
+    }
+    FileSystem::removeFile("outChunked.t");
+
+    PRINT_HEADER("Compression, 64 MB");
+    PRINT_TEXT("", "write", "read");
+    PRINT_MILLI("whole buffer", "(ms)", writeTime[0], readTime[0]);
+    PRINT_MILLI("chunked", "(ms)", writeTime[1], readTime[1]);
+}
+
+
 static void measureSerializerPerformance() {
     Array<uint8> x;
     x.resize(1024);
@@ -262,6 +371,7 @@ void perfBinaryIO() {
     PRINT_SECTION("Performance: BinaryOutput", "Measures performance of read/write operations");
     measureOverhead();
     measureSerializerPerformance();
+    measureChunkedCompression();
 }
 
 
@@ -429,4 +539,5 @@ void testBinaryIO() {
     testBasicSerialization();
     testBitSerialization();
     testCompression();
+    testChunkedCompression();
 }
@@ -152,6 +152,92 @@ static void measureAABoxCollisionPerformance() {
 }
 
 
+/** Random triangles near the origin, with a few degenerate ones */
+static void makeRandomTriangles(Random& rnd, int n, Array<Triangle>& triangleArray) {
+    for (int i = 0; i < n; ++i) {
+        const Vector3& center = Vector3(rnd.uniform(-4.0f, 4.0f), rnd.uniform(-4.0f, 4.0f), rnd.uniform(-4.0f, 4.0f));
+        const Vector3& v0 = center + Vector3::random(rnd) * rnd.uniform(0.5f, 2.0f);
+        const Vector3& v1 = center + Vector3::random(rnd) * rnd.uniform(0.5f, 2.0f);
+        const Vector3& v2 = (i % 17 == 16) ? v0.lerp(v1, 0.5f) : center + Vector3::random(rnd) * rnd.uniform(0.5f, 2.0f);
+        triangleArray.append(Triangle(v0, v1, v2));
+    }
+}
+
+
+static void testBatchedSphereTriangle() {
+    Random rnd(7, false);
+    Array<Triangle> triangleArray;
+    makeRandomTriangles(rnd, 203, triangleArray);
+    const CollisionDetection::TrianglePacketArray packets(triangleArray);
+    testAssert(packets.size() == 203 && packets.numPackets() == 51);
+    testAssert(packets.triangle(5).vertex(1) == triangleArray[5].vertex(1));
+
+    Array<float> batchTime;
+    batchTime.resize(triangleArray.size());
+    int hits = 0;
+    for (int q = 0; q < 200; ++q) {
+        const Sphere sphere(Vector3(rnd.uniform(-6.0f, 6.0f), rnd.uniform(-6.0f, 6.0f), rnd.uniform(-6.0f, 6.0f)), rnd.uniform(0.1f, 1.0f));
+        const Vector3& velocity = Vector3::random(rnd) * rnd.uniform(0.0f, 3.0f);
+        const bool twoSided = (q % 2) == 1;
+
+        CollisionDetection::collisionTimesForMovingSphereFixedTriangles(sphere, velocity, packets, batchTime.getCArray(), twoSided);
+
+        float firstTime = finf();
+        for (int i = 0; i < triangleArray.size(); ++i) {
+            Vector3 location;
+            float b[3];
+            const float t = CollisionDetection::collisionTimeForMovingSphereFixedTriangle(sphere, velocity, triangleArray[i], location, b, twoSided);
+            if (i % 17 == 16) {
+                // Degenerate triangles have no well-defined normal. The batch never collides with them,
+                // while the scalar query may. Every other triangle must agree exactly on hit vs. miss.
+                testAssert(batchTime[i] == finf());
+                continue;
+            }
+            if (t < firstTime) {
+                firstTime = t;
+            }
+            testAssertM((t < finf()) == (batchTime[i] < finf()), "Batched and scalar sphere-triangle collisions disagree");
+            if (t < finf()) {
+                ++hits;
+                testAssert(fuzzyEq(t, batchTime[i]) || (abs(t - batchTime[i]) < 1e-3f));
+            }
+        }
+
+        Vector3 location;
+        int index;
+        const float t = CollisionDetection::collisionTimeForMovingSphereFixedTriangles(sphere, velocity, packets, location, index, twoSided);
+        testAssert((t == finf()) == (index == -1));
+        if (index != -1) {
+            testAssert(t == batchTime[index]);
+            testAssert(index % 17 != 16);
+            testAssert(abs(t - firstTime) < 1e-3f);
+        }
+    }
+    testAssert(hits > 0);
+
+    // The simple case from the scalar tests
+    const CollisionDetection::TrianglePacketArray single(Array<Triangle>(Triangle(Vector3(0, 0, 0), Vector3(0, 0, -1), Vector3(-1, 0, 0))));
+    Vector3 location;
+    int index;
+    const float t = CollisionDetection::collisionTimeForMovingSphereFixedTriangles(Sphere(Vector3(-0.25f, 2.0f, -0.25f), 1.0f), Vector3(0, -1, 0), single, location, index);
+    testAssert(fuzzyEq(t, 1.0f) && (index == 0) && location.fuzzyEq(Vector3(-0.25f, 0.0f, -0.25f)));
+
+    // Many agents at once give the same answers as one at a time
+    Array<CollisionDetection::MovingSphereQuery> queryArray;
+    queryArray.resize(100);
+    for (CollisionDetection::MovingSphereQuery& query : queryArray) {
+        query.sphere    = Sphere(Vector3(rnd.uniform(-6.0f, 6.0f), rnd.uniform(-6.0f, 6.0f), rnd.uniform(-6.0f, 6.0f)), 0.5f);
+        query.velocity  = Vector3::random(rnd) * 2.0f;
+        query.triangles = &packets;
+    }
+    CollisionDetection::collisionTimeForMovingSpheresFixedTriangles(queryArray);
+    for (const CollisionDetection::MovingSphereQuery& query : queryArray) {
+        const float expected = CollisionDetection::collisionTimeForMovingSphereFixedTriangles(query.sphere, query.velocity, packets, location, index);
+        testAssert((query.time == expected) && (query.triangleIndex == index));
+    }
+}
+
+
 void testCollisionDetection() {
     printf("CollisionDetection ");
 
@@ -313,12 +399,58 @@ void testCollisionDetection() {
         testAssertM(outLocation.fuzzyEq(Vector3(1,1,0)), "Wrong collision location");
     }
 
+    testBatchedSphereTriangle();
+
     printf("passed\n");
 }
 
 
+static void measureBatchedTriangleCollisionPerformance() {
+    Random rnd(1, false);
+    Array<Triangle> triangleArray;
+    makeRandomTriangles(rnd, 256, triangleArray);
+    const CollisionDetection::TrianglePacketArray packets(triangleArray);
+
+    Array<Sphere> sphereArray;
+    Array<Vector3> velocityArray;
+    for (int i = 0; i < 1024; ++i) {
+        sphereArray.append(Sphere(Vector3(rnd.uniform(-6.0f, 6.0f), rnd.uniform(-6.0f, 6.0f), rnd.uniform(-6.0f, 6.0f)), 0.5f));
+        velocityArray.append(Vector3::random(rnd) * 2.0f);
+    }
+
+    Stopwatch stopwatch;
+    float sum = 0.0f;
+    stopwatch.tick();
+    for (int s = 0; s < sphereArray.size(); ++s) {
+        float firstTime = finf();
+        for (const Triangle& triangle : triangleArray) {
+            Vector3 location;
+            firstTime = min(firstTime, CollisionDetection::collisionTimeForMovingSphereFixedTriangle(sphereArray[s], velocityArray[s], triangle, location));
+        }
+        sum += firstTime;
+    }
+    stopwatch.tock();
+    const chrono::nanoseconds scalar = stopwatch.elapsedDuration();
+
+    stopwatch.tick();
+    for (int s = 0; s < sphereArray.size(); ++s) {
+        Vector3 location;
+        int index;
+        sum += CollisionDetection::collisionTimeForMovingSphereFixedTriangles(sphereArray[s], velocityArray[s], packets, location, index);
+    }
+    stopwatch.tock();
+    const chrono::nanoseconds batched = stopwatch.elapsedDuration();
+    (void)sum;
+
+    PRINT_HEADER("Sphere vs. 256 triangles");
+    PRINT_MICRO("Scalar", "(us)", scalar / sphereArray.size());
+    PRINT_MICRO("Batched", "(us)", batched / sphereArray.size());
+}
+
+
 void perfCollisionDetection() {
     PRINT_SECTION("Performance: Collision Detection", "");
 	measureTriangleCollisionPerformance();
 	measureAABoxCollisionPerformance();
+	measureBatchedTriangleCollisionPerformance();
 }
@@ -0,0 +1,124 @@
+/**
+  \file test/tCubeMapSampler.cpp
+
+  G3D Innovation Engine http://casual-effects.com/g3d
+  Copyright 2000-2019, Morgan McGuire
+  All rights reserved
+  Available under the BSD License
+*/
+#include "G3D/G3D.h"
+#include "printhelpers.h"
+#include "testassert.h"
+
+/** A dim sky with a small, very bright sun on the +Y face */
+static shared_ptr<CubeMap> makeSunSky(int size) {
+    Array<shared_ptr<Image3>> face;
+    for (int f = 0; f < 6; ++f) {
+        const shared_ptr<Image3>& im = Image3::createEmpty(size, size, WrapMode::CLAMP);
+        im->setAll(Color3(0.2f, 0.3f, 0.5f));
+        if (f == int(CubeFace::POS_Y)) {
+            for (int y = size / 3; y < size / 3 + 2; ++y) {
+                for (int x = size / 2; x < size / 2 + 2; ++x) {
+                    im->set(x, y, Color3(20000.0f));
+                }
+            }
+        }
+        face.append(im);
+    }
+    return CubeMap::create(face);
+}
+
+
+void testCubeMapSampler() {
+    printf("CubeMapSampler ");
+
+    Random rnd(7, false);
+
+    // CubeMap::direction inverts CubeMap::faceCoord
+    for (int i = 0; i < 1000; ++i) {
+        Vector3 w;
+        rnd.sphere(w.x, w.y, w.z);
+        CubeFace face;
+        const Vector2& t = CubeMap::faceCoord(w, face);
+        testAssert(t.x >= 0.0f && t.x <= 1.0f && t.y >= 0.0f && t.y <= 1.0f);
+        testAssert((CubeMap::direction(face, t) - w).length() < 1e-4f);
+    }
+
+    {
+        AliasTable table(Array<float>(1.0f, 0.0f, 3.0f));
+        testAssert(fuzzyEq(table.pmf(0), 0.25f) && (table.pmf(1) == 0.0f) && fuzzyEq(table.pmf(2), 0.75f));
+        int count[3] = {0, 0, 0};
+        for (int i = 0; i < 10000; ++i) {
+            float pmf;
+            ++count[table.sample(rnd.uniform(), rnd.uniform(), pmf)];
+        }
+        testAssert((count[1] == 0) && (abs(count[2] - 7500) < 300));
+    }
+
+    const shared_ptr<CubeMapSampler>& sampler = CubeMapSampler::create(makeSunSky(32));
+
+    // The density integrates to one over the sphere
+    double sum = 0.0;
+    const int N = 200000;
+    for (int i = 0; i < N; ++i) {
+        Vector3 w;
+        rnd.sphere(w.x, w.y, w.z);
+        sum += sampler->pdf(w) * 4.0 * pi();
+    }
+    testAssert(fabs(sum / N - 1.0) < 0.05);
+
+    // Samples report the same density as pdf()
+    for (int i = 0; i < 1000; ++i) {
+        float pdf;
+        const Vector3& w = sampler->sample(Vector4(rnd.uniform(), rnd.uniform(), rnd.uniform(), rnd.uniform()), pdf);
+        testAssert(w.isUnit());
+        testAssert(fabs(pdf - sampler->pdf(w)) <= 1e-3f * pdf);
+    }
+
+    printf("passed\n");
+}
+
+
+void perfCubeMapSampler() {
+    PRINT_SECTION("Performance: CubeMapSampler", "Irradiance at an upward-facing point under a sky with a small sun");
+
+    const shared_ptr<CubeMap>& sky = makeSunSky(128);
+    Stopwatch stopwatch;
+    stopwatch.tick();
+    const shared_ptr<CubeMapSampler>& sampler = CubeMapSampler::create(sky);
+    stopwatch.tock();
+    PRINT_MILLI("Build (128^2 faces)", "ms", stopwatch.elapsedDuration());
+
+    const Vector3 n = Vector3::unitY();
+    const int N = 200000;
+
+    // 0 = cosine-weighted hemisphere, 1 = environment, 2 = balance heuristic mixture of both
+    const char* name[3] = {"cosine", "environment", "MIS"};
+    PRINT_TEXT("", "mean", "rel. stddev", "ns/sample");
+    for (int technique = 0; technique < 3; ++technique) {
+        Random rnd(1, false);
+        double sum = 0.0, sum2 = 0.0;
+        stopwatch.tick();
+        for (int i = 0; i < N; ++i) {
+            Vector3 w;
+            float envPdf = 0.0f;
+            if ((technique == 0) || ((technique == 2) && (rnd.uniform() < 0.5f))) {
+                rnd.cosHemi(w.x, w.z, w.y);
+                if (technique == 2) { envPdf = sampler->pdf(w); }
+            } else {
+                w = sampler->sample(Vector4(rnd.uniform(), rnd.uniform(), rnd.uniform(), rnd.uniform()), envPdf);
+            }
+            const float cosTheta = max(0.0f, w.dot(n));
+            const float cosPdf = cosTheta / pif();
+            const float pdf = (technique == 0) ? cosPdf : (technique == 1) ? envPdf : 0.5f * (cosPdf + envPdf);
+            const double f = (pdf > 0.0f) ? double(sky->bilinear(w).average() * cosTheta / pdf) : 0.0;
+            sum += f;
+            sum2 += f * f;
+        }
+        stopwatch.tock();
+        const double mean = sum / N;
+        const double stddev = sqrt(max(0.0, sum2 / N - mean * mean));
+        printf("%-26s %12.3f %12.3f %12.1f\n", name[technique], mean, stddev / mean,
+               stopwatch.elapsedTime() * 1e9 / N);
+    }
+}
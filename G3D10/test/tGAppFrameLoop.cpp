@@ -0,0 +1,141 @@
+/**
+  \file test/tGAppFrameLoop.cpp
+
+  G3D Innovation Engine http://casual-effects.com/g3d
+  Copyright 2000-2019, Morgan McGuire
+  All rights reserved
+  Available under the BSD License
+*/
+#include "G3D/G3D.h"
+#include "testassert.h"
+#include <atomic>
+#include <thread>
+
+/** Runs frames in FrameLoopMode::PIPELINED and then FrameLoopMode::SEQUENTIAL with the default
+    Scene simulation and renderer, checking which thread each handler runs on, that the simulation
+    never overlaps the main thread's work outside of rendering, and that rendering sees the lights
+    and clocks as they were when the frame was posed. */
+class FrameLoopApp : public GApp {
+protected:
+
+    std::thread::id     m_testThread;
+
+    /** True while onSimulation runs */
+    std::atomic<bool>   m_simulating;
+
+    std::atomic<int>    m_numSimulated;
+
+    /** Number of frames whose input has been processed */
+    int                 m_numFrames;
+
+    /** m_numSimulated when the frame being rendered was posed */
+    int                 m_numSimulatedAtPose;
+
+    /** Moved by every simulation step */
+    shared_ptr<Light>   m_light;
+
+    /** m_light's position when the frame being rendered was posed */
+    Point3              m_lightPositionAtPose;
+
+public:
+
+    static const int    NUM_PIPELINED_FRAMES = 10;
+    static const int    NUM_FRAMES = 15;
+
+    int                 numRendered;
+
+    FrameLoopApp(const GApp::Settings& settings) : GApp(settings), m_testThread(std::this_thread::get_id()),
+        m_simulating(false), m_numSimulated(0), m_numFrames(0), m_numSimulatedAtPose(0), numRendered(0) {}
+
+    virtual void onInit() override {
+        GApp::onInit();
+        showRenderingStats = false;
+        m_light = Light::directional("Moving Light", Vector3(0.0f, 1.0f, 0.0f), Color3::white(), false);
+        scene()->insert(m_light);
+        setFrameLoopMode(FrameLoopMode::PIPELINED);
+    }
+
+    virtual void onUserInput(UserInput* ui) override {
+        GApp::onUserInput(ui);
+        testAssert(std::this_thread::get_id() == m_testThread);
+
+        // Sync point: every earlier frame's simulation has finished
+        testAssert(! m_simulating);
+        testAssert(m_numSimulated == m_numFrames);
+
+        ++m_numFrames;
+        if (m_numFrames == NUM_PIPELINED_FRAMES + 1) {
+            setFrameLoopMode(FrameLoopMode::SEQUENTIAL);
+        } else if (m_numFrames == NUM_FRAMES) {
+            m_endProgram = true;
+        }
+    }
+
+    virtual void onSimulation(RealTime rdt, SimTime sdt, SimTime idt) override {
+        testAssert((std::this_thread::get_id() == m_testThread) == (frameLoopMode() == FrameLoopMode::SEQUENTIAL));
+        testAssert(! m_simulating.exchange(true));
+
+        // Simulates the Scene on this thread
+        GApp::onSimulation(rdt, sdt, idt);
+        m_light->setFrame(CFrame::fromXYZYPRDegrees(float(m_numSimulated.load()), 10.0f, 0.0f, 0.0f, -90.0f));
+
+        // Give rendering time to overlap the simulation
+        System::sleep(0.002);
+        screenPrintf("Simulated %d", m_numSimulated.load());
+
+        ++m_numSimulated;
+        m_simulating = false;
+    }
+
+    virtual void onPose(Array<shared_ptr<Surface> >& posed3D, Array<shared_ptr<Surface2D> >& posed2D) override {
+        GApp::onPose(posed3D, posed2D);
+        testAssert(std::this_thread::get_id() == m_testThread);
+        testAssert(! m_simulating);
+        m_numSimulatedAtPose = m_numSimulated;
+        m_lightPositionAtPose = m_light->frame().translation;
+    }
+
+    virtual void onGraphics3D(RenderDevice* rd, Array<shared_ptr<Surface> >& posed3D) override {
+        testAssert(std::this_thread::get_id() == m_testThread);
+
+        // Pipelined frames render the simulation that finished before their input was
+        // processed; sequential frames also include their own simulation step
+        const bool pipelined = (frameLoopMode() == FrameLoopMode::PIPELINED);
+        testAssert(m_numSimulatedAtPose == (pipelined ? m_numFrames - 1 : m_numFrames));
+
+        // Pipelined frames render from a snapshot of the light, which holds still while the
+        // simulation moves the light itself
+        testAssert(lightingEnvironment().lightArray.size() == 1);
+        const shared_ptr<Light>& light = lightingEnvironment().lightArray[0];
+        testAssert((light == m_light) == ! pipelined);
+        testAssert(light->frame().translation == m_lightPositionAtPose);
+
+        // The clocks hold still while rendering even though the simulation advances them
+        const SimTime simTime0 = simTime();
+        const RealTime realTime0 = realTime();
+        System::sleep(0.004);
+        testAssert((simTime() == simTime0) && (realTime() == realTime0));
+        testAssert(light->frame().translation == m_lightPositionAtPose);
+
+        GApp::onGraphics3D(rd, posed3D);
+        ++numRendered;
+    }
+};
+
+
+void testGAppFrameLoop() {
+    printf("GApp frame loop ");
+
+    GApp::Settings settings;
+    settings.window.caption = "Frame Loop Test";
+    settings.window.width   = 256;
+    settings.window.height  = 256;
+    settings.dataDir        = FileSystem::currentDirectory();
+
+    FrameLoopApp app(settings);
+    testAssert(app.run() == 0);
+    testAssert(app.numRendered == FrameLoopApp::NUM_FRAMES);
+    testAssert(app.frameLoopMode() == GApp::FrameLoopMode::SEQUENTIAL);
+
+    printf("passed\n");
+}
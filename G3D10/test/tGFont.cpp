@@ -0,0 +1,94 @@
+/**
+  \file test/tGFont.cpp
+
+  G3D Innovation Engine http://casual-effects.com/g3d
+  Copyright 2000-2019, Morgan McGuire
+  All rights reserved
+  Available under the BSD License
+*/
+#include "G3D/G3D.h"
+#include "testassert.h"
+
+typedef GFont::CPUCharVertex CPUCharVertex;
+
+static bool same(const Array<CPUCharVertex>& a, const Array<int>& aIndex, const Array<CPUCharVertex>& b, const Array<int>& bIndex) {
+    if ((a.size() != b.size()) || (aIndex.size() != bIndex.size())) {
+        return false;
+    }
+    for (int i = 0; i < a.size(); ++i) {
+        if ((a[i].texCoord != b[i].texCoord) || (a[i].position != b[i].position) ||
+            (a[i].color != b[i].color) || (a[i].borderColor != b[i].borderColor)) {
+            return false;
+        }
+    }
+    for (int i = 0; i < aIndex.size(); ++i) {
+        if (aIndex[i] != bIndex[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+/** Appends \a s at a fixed position and color, word wrapped if \a wrapWidth is finite */
+static void append(const shared_ptr<GFont>& font, const String& s, float wrapWidth, Array<CPUCharVertex>& vertexArray, Array<int>& indexArray) {
+    vertexArray.fastClear();
+    indexArray.fastClear();
+    if (wrapWidth == finf()) {
+        font->appendToCharVertexArray(vertexArray, indexArray, nullptr, s, Point2(17.0f, 31.0f), 14.0f, Color3::red(), Color4(0, 0, 1, 0.5f));
+    } else {
+        font->appendToCharVertexArrayWordWrap(vertexArray, indexArray, nullptr, wrapWidth, s, Point2(17.0f, 31.0f), 14.0f, Color3::red(), Color4(0, 0, 1, 0.5f));
+    }
+}
+
+
+/** Requires a RenderDevice */
+void testGFont() {
+    printf("GFont layout cache ");
+
+    const shared_ptr<GFont>& font = GFont::fromFile(System::findDataFile("arial.fnt"));
+    const int defaultCapacity = font->layoutCacheCapacity();
+    const String text = "The quick brown fox jumps over the lazy dog";
+
+    Array<CPUCharVertex> uncached, cached;
+    Array<int> uncachedIndex, cachedIndex;
+    for (float wrapWidth : {finf(), 100.0f}) {
+        // Uncached
+        font->setLayoutCacheCapacity(0);
+        font->resetLayoutCacheStats();
+        append(font, text, wrapWidth, uncached, uncachedIndex);
+        append(font, text, wrapWidth, uncached, uncachedIndex);
+        GFont::LayoutCacheStats stats = font->layoutCacheStats();
+        testAssert((stats.layouts == 2) && (stats.cacheHits == 0) && (stats.entries == 0));
+        testAssert(uncached.size() > 0);
+
+        // A miss and then a hit, both identical to the uncached result
+        font->setLayoutCacheCapacity(8);
+        append(font, text, wrapWidth, cached, cachedIndex);
+        testAssert(same(cached, cachedIndex, uncached, uncachedIndex));
+        append(font, text, wrapWidth, cached, cachedIndex);
+        testAssert(same(cached, cachedIndex, uncached, uncachedIndex));
+        stats = font->layoutCacheStats();
+        testAssert((stats.layouts == 3) && (stats.cacheHits == 1) && (stats.entries == 1));
+    }
+
+    // Overfilling the cache keeps the most recently used half
+    font->setLayoutCacheCapacity(4);
+    font->clearLayoutCache();
+    font->resetLayoutCacheStats();
+    for (int i = 0; i < 5; ++i) {
+        append(font, format("string %d", i), finf(), cached, cachedIndex);
+    }
+    GFont::LayoutCacheStats stats = font->layoutCacheStats();
+    testAssert((stats.layouts == 5) && (stats.evictions == 3) && (stats.entries == 2));
+
+    append(font, "string 4", finf(), cached, cachedIndex);
+    testAssert(font->layoutCacheStats().cacheHits == 1);
+    append(font, "string 0", finf(), cached, cachedIndex);
+    testAssert(font->layoutCacheStats().layouts == 6);
+
+    font->setLayoutCacheCapacity(defaultCapacity);
+    font->clearLayoutCache();
+
+    printf("passed\n");
+}
@@ -0,0 +1,67 @@
+/**
+  \file test/tGLThreadQueue.cpp
+
+  G3D Innovation Engine http://casual-effects.com/g3d
+  Copyright 2000-2019, Morgan McGuire
+  All rights reserved
+  Available under the BSD License
+*/
+#include "G3D/G3D.h"
+#include "testassert.h"
+#include <atomic>
+#include <thread>
+
+void testGLThreadQueue() {
+    printf("GLThreadQueue ");
+
+    // Outside of serve(), work runs on the calling thread
+    const std::thread::id mainThread = std::this_thread::get_id();
+    testAssert(! GLThreadQueue::mustForward());
+    bool ranHere = false;
+    GLThreadQueue::run([&] { ranHere = (std::this_thread::get_id() == mainThread); });
+    testAssert(ranHere);
+
+    // Inside serve(), all work forwarded by other threads runs on the serving thread
+    std::atomic<int> numOnMainThread(0);
+    GLThreadQueue::serve([&] {
+        Array<shared_ptr<std::thread>> threadArray;
+        for (int t = 0; t < 4; ++t) {
+            threadArray.append(std::make_shared<std::thread>([&] {
+                for (int i = 0; i < 200; ++i) {
+                    testAssert(GLThreadQueue::mustForward());
+                    GLThreadQueue::run([&] {
+                        testAssert(! GLThreadQueue::mustForward());
+                        if (std::this_thread::get_id() == mainThread) {
+                            ++numOnMainThread;
+                        }
+                    });
+                }
+            }));
+        }
+        for (const shared_ptr<std::thread>& thread : threadArray) {
+            thread->join();
+        }
+
+        // Exceptions reach the thread that forwarded the work
+        bool caught = false;
+        try {
+            GLThreadQueue::run([] { throw String("forwarded"); });
+        } catch (const String& s) {
+            caught = (s == "forwarded");
+        }
+        testAssert(caught);
+    });
+    testAssert(numOnMainThread == 800);
+    testAssert(! GLThreadQueue::mustForward());
+
+    // ...and exceptions from the background work reach the serving thread
+    bool caught = false;
+    try {
+        GLThreadQueue::serve([] { throw String("background"); });
+    } catch (const String& s) {
+        caught = (s == "background");
+    }
+    testAssert(caught);
+
+    printf("passed\n");
+}
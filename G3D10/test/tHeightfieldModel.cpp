@@ -0,0 +1,184 @@
+/**
+  \file test/tHeightfieldModel.cpp
+
+  G3D Innovation Engine http://casual-effects.com/g3d
+  Copyright 2000-2019, Morgan McGuire
+  All rights reserved
+  Available under the BSD License
+*/
+#include "G3D/G3D.h"
+#include "printhelpers.h"
+#include "testassert.h"
+
+/** Writes a rolling terrain with a few cliffs and a flat plateau to \a filename and returns the image */
+static shared_ptr<Image> makeElevationFile(const String& filename, int size) {
+    const shared_ptr<Image>& image = Image::create(size, size, ImageFormat::RGB8());
+    for (int z = 0; z < size; ++z) {
+        for (int x = 0; x < size; ++x) {
+            float h = 0.5f + 0.3f * sinf(float(x) * 0.15f) * cosf(float(z) * 0.11f);
+            if ((x > size / 2) && (z < size / 3)) {
+                h = 0.9f;
+            }
+            image->set(Point2int32(x, z), Color3(h));
+        }
+    }
+    image->save(filename);
+    return image;
+}
+
+
+static shared_ptr<HeightfieldModel> makeHeightfield(const String& filename, int pixelsPerQuadSide) {
+    HeightfieldModel::Specification spec;
+    spec.filename          = filename;
+    spec.pixelsPerTileSide = 32;
+    spec.pixelsPerQuadSide = pixelsPerQuadSide;
+    spec.metersPerPixel    = 0.5f;
+    spec.maxElevation      = 10.0f;
+    return HeightfieldModel::create(spec);
+}
+
+
+/** Tests every triangle of the tessellation. \a normal is the object-space normal of the closest hit. */
+static float bruteForceIntersect(const Ray& ray, const shared_ptr<Image>& image, const HeightfieldModel::Specification& spec, Vector3& normal) {
+    const int   ppq           = spec.pixelsPerQuadSide;
+    const int   widthQuads    = image->width() / ppq - 1;
+    const int   heightQuads   = image->height() / ppq - 1;
+    const float metersPerQuad = spec.metersPerPixel * ppq;
+
+    const auto vertex = [&](int x, int z) {
+        return Point3(float(x) * metersPerQuad, image->nearest(x * ppq, z * ppq).rgb().sum() / 3.0f * spec.maxElevation, float(z) * metersPerQuad);
+    };
+
+    float nearest = finf();
+    for (int z = 0; z < heightQuads; ++z) {
+        for (int x = 0; x < widthQuads; ++x) {
+            const Point3 p0 = vertex(x, z), p1 = vertex(x + 1, z), p2 = vertex(x + 1, z + 1), p3 = vertex(x, z + 1);
+            float t = ray.intersectionTime(p0, p3, p2);
+            if ((t >= 0.0f) && (t < nearest)) {
+                nearest = t;
+                normal  = (p2 - p0).cross(p3 - p0).direction();
+            }
+            t = ray.intersectionTime(p0, p2, p1);
+            if ((t >= 0.0f) && (t < nearest)) {
+                nearest = t;
+                normal  = (p1 - p0).cross(p2 - p0).direction();
+            }
+        }
+    }
+    return nearest;
+}
+
+
+void testHeightfieldModel() {
+    printf("HeightfieldModel ");
+
+    const String filename = "_testHeightfield.png";
+    const int size = 64;
+    const shared_ptr<Image>& image = makeElevationFile(filename, size);
+
+    Random rnd(7, false);
+    for (int pixelsPerQuadSide = 1; pixelsPerQuadSide <= 2; ++pixelsPerQuadSide) {
+        const shared_ptr<HeightfieldModel>& model = makeHeightfield(filename, pixelsPerQuadSide);
+        const HeightfieldModel::Specification& spec = model->specification();
+        const float extent = float(size) * spec.metersPerPixel;
+        const CFrame cframe = CFrame::fromXYZYPRDegrees(3, -1, 2, 30);
+
+        Array<Ray> rayArray;
+        Array<float> expectedArray;
+        Array<Vector3> expectedNormalArray;
+        for (int r = 0; r < 400; ++r) {
+            Point3 origin(rnd.uniform(-5, extent + 5), rnd.uniform(0, 20), rnd.uniform(-5, extent + 5));
+            Vector3 d;
+            if (r % 4 == 0) {
+                // Grazing rays that skim along the terrain
+                origin.y = rnd.uniform(4, 10);
+                d = Vector3(rnd.uniform(-1, 1), rnd.uniform(-0.05f, 0.05f), rnd.uniform(-1, 1)).direction();
+            } else {
+                rnd.sphere(d.x, d.y, d.z);
+            }
+            const Ray osRay(origin, d);
+            Vector3 normal;
+            expectedArray.append(bruteForceIntersect(osRay, image, spec, normal));
+            expectedNormalArray.append(cframe.vectorToWorldSpace(normal));
+            rayArray.append(cframe.toWorldSpace(osRay));
+        }
+
+        Array<float> distanceArray;
+        Array<Vector3> normalArray;
+        model->intersectRays(rayArray, cframe, distanceArray, &normalArray);
+
+        for (int r = 0; r < rayArray.size(); ++r) {
+            const Ray& ray = rayArray[r];
+            const float expected = expectedArray[r];
+
+            float distance = finf();
+            Model::HitInfo info;
+            const bool hit = model->intersect(ray, cframe, distance, info);
+            testAssert(hit == (expected < finf()));
+            testAssert(distanceArray[r] == distance);
+            if (hit) {
+                testAssert(fabsf(distance - expected) < 1e-3f);
+                testAssert(fuzzyEq(info.normal.dot(expectedNormalArray[r]), 1.0f));
+                testAssert(fuzzyEq(normalArray[r].dot(info.normal), 1.0f));
+
+                // The old grid walk culls some cells too aggressively and may miss a ray,
+                // but when it hits it must find the same surface
+                float walkDistance = finf();
+                Model::HitInfo walkInfo;
+                if (model->intersectByGridWalk(ray, cframe, walkDistance, walkInfo)) {
+                    testAssert(fabsf(walkDistance - distance) < 1e-3f);
+                    testAssert(fuzzyEq(walkInfo.normal.dot(info.normal), 1.0f));
+                    testAssert(walkInfo.primitiveIndex == info.primitiveIndex);
+                }
+            }
+        }
+    }
+
+    FileSystem::removeFile(filename);
+    printf("passed\n");
+}
+
+
+void perfHeightfieldModel() {
+    PRINT_SECTION("Performance: HeightfieldModel", "1024 x 1024 heightfield, 100k rays cast down onto it");
+
+    const String filename = "_perfHeightfield.png";
+    makeElevationFile(filename, 1024);
+    const shared_ptr<HeightfieldModel>& model = makeHeightfield(filename, 1);
+
+    Random rnd(5, false);
+    Array<Ray> rayArray;
+    rayArray.resize(100000);
+    for (Ray& ray : rayArray) {
+        const Vector3& d = Vector3(rnd.uniform(-1, 1), -0.3f, rnd.uniform(-1, 1)).direction();
+        ray = Ray(Point3(rnd.uniform(0, 512), 20.0f, rnd.uniform(0, 512)), d);
+    }
+
+    Stopwatch stopwatch;
+    float total = 0.0f;
+    stopwatch.tick();
+    for (const Ray& ray : rayArray) {
+        float distance = finf();
+        model->intersectByGridWalk(ray, CFrame(), distance);
+        total += (distance < finf()) ? distance : 0.0f;
+    }
+    stopwatch.tock();
+    PRINT_MILLI("Grid walk", "ms", stopwatch.elapsedDuration());
+
+    stopwatch.tick();
+    for (const Ray& ray : rayArray) {
+        float distance = finf();
+        model->intersect(ray, CFrame(), distance);
+        total -= (distance < finf()) ? distance : 0.0f;
+    }
+    stopwatch.tock();
+    PRINT_MILLI("Elevation pyramid", "ms", stopwatch.elapsedDuration());
+
+    Array<float> distanceArray;
+    stopwatch.tick();
+    model->intersectRays(rayArray, CFrame(), distanceArray);
+    stopwatch.tock();
+    PRINT_MILLI("Elevation pyramid, multithreaded", "ms", stopwatch.elapsedDuration());
+
+    FileSystem::removeFile(filename);
+}
@@ -0,0 +1,132 @@
+/**
+  \file test/tImageResampler.cpp
+
+  G3D Innovation Engine http://casual-effects.com/g3d
+  Copyright 2000-2019, Morgan McGuire
+  All rights reserved
+  Available under the BSD License
+*/
+#include "G3D/G3D.h"
+#include "printhelpers.h"
+#include "testassert.h"
+
+static shared_ptr<CPUPixelTransferBuffer> makeCheckerboard(int width, int height, const ImageFormat* format) {
+    const shared_ptr<CPUPixelTransferBuffer>& buffer = CPUPixelTransferBuffer::create(width, height, format);
+    for (int y = 0; y < height; ++y) {
+        uint8* row = static_cast<uint8*>(buffer->row(y));
+        for (int x = 0; x < width * format->numComponents; ++x) {
+            row[x] = (((x / format->numComponents) + y) & 1) ? 255 : 0;
+        }
+    }
+    return buffer;
+}
+
+
+static void testConstant() {
+    // Every normalized filter preserves a constant image at any scale
+    const shared_ptr<CPUPixelTransferBuffer>& src = CPUPixelTransferBuffer::create(17, 9, ImageFormat::RGBA32F());
+    for (int y = 0; y < src->height(); ++y) {
+        Color4* row = static_cast<Color4*>(src->row(y));
+        for (int x = 0; x < src->width(); ++x) {
+            row[x] = Color4(0.25f, 0.5f, 0.75f, 1.0f);
+        }
+    }
+
+    for (int f = 0; f < 4; ++f) {
+        const ImageResampler::Filter filter = ImageResampler::Filter(ImageResampler::Filter::Value(f));
+        for (const Vector2int32 size : {Vector2int32(5, 3), Vector2int32(17, 9), Vector2int32(40, 21), Vector2int32(1, 1)}) {
+            const shared_ptr<CPUPixelTransferBuffer>& dst = ImageResampler::resize(src, size.x, size.y, filter);
+            testAssert((dst->width() == size.x) && (dst->height() == size.y) && (dst->format() == src->format()));
+            for (int y = 0; y < dst->height(); ++y) {
+                const Color4* row = static_cast<const Color4*>(dst->row(y));
+                for (int x = 0; x < dst->width(); ++x) {
+                    testAssert(row[x].fuzzyEq(Color4(0.25f, 0.5f, 0.75f, 1.0f)));
+                }
+            }
+        }
+    }
+}
+
+
+static void testBoxAndSRGB() {
+    // Box filtering a checkerboard by half averages each 2 x 2 block exactly
+    const shared_ptr<CPUPixelTransferBuffer>& linear = ImageResampler::resize(makeCheckerboard(8, 8, ImageFormat::RGB8()), 4, 4, ImageResampler::Filter::BOX);
+    testAssert(static_cast<const uint8*>(linear->row(2))[5] == 128);
+
+    // ...and in sRGB, 50% linear coverage is brighter than code 128
+    const shared_ptr<CPUPixelTransferBuffer>& srgb = ImageResampler::resize(makeCheckerboard(8, 8, ImageFormat::RGB8()), 4, 4, ImageResampler::Filter::BOX, true);
+    testAssert(static_cast<const uint8*>(srgb->row(2))[5] == 188);
+
+    const shared_ptr<CPUPixelTransferBuffer>& srgb8 = ImageResampler::resize(makeCheckerboard(8, 8, ImageFormat::SRGBA8()), 4, 4, ImageResampler::Filter::BOX);
+    const uint8* row = static_cast<const uint8*>(srgb8->row(1));
+    testAssert((row[0] == 188) && (row[3] == 128));
+
+    // Magnifying with a tent interpolates between pixel centers
+    const shared_ptr<CPUPixelTransferBuffer>& ramp = CPUPixelTransferBuffer::create(2, 1, ImageFormat::RGB32F());
+    static_cast<Color3*>(ramp->row(0))[0] = Color3::zero();
+    static_cast<Color3*>(ramp->row(0))[1] = Color3::one();
+    const shared_ptr<CPUPixelTransferBuffer>& wide = ImageResampler::resize(ramp, 8, 1, ImageResampler::Filter::TENT);
+    const Color3* c = static_cast<const Color3*>(wide->row(0));
+    testAssert(c[0].r == 0.0f && c[7].r == 1.0f);
+    for (int x = 1; x < 8; ++x) {
+        testAssert(c[x].r >= c[x - 1].r);
+    }
+    testAssert(fuzzyEq(c[3].r + c[4].r, 1.0f));
+}
+
+
+static void testMipPyramid() {
+    Array<shared_ptr<CPUPixelTransferBuffer>> mipArray;
+    const shared_ptr<CPUPixelTransferBuffer>& src = makeCheckerboard(13, 5, ImageFormat::RGBA8());
+    ImageResampler::generateMipPyramid(src, mipArray);
+    testAssert(mipArray.size() == 4);
+    testAssert(mipArray[0] == src);
+    testAssert((mipArray[1]->width() == 6) && (mipArray[1]->height() == 2));
+    testAssert((mipArray[2]->width() == 3) && (mipArray[2]->height() == 1));
+    testAssert((mipArray[3]->width() == 1) && (mipArray[3]->height() == 1));
+
+    // The checkerboard, including alpha, averages to gray at every level
+    for (int i = 1; i < mipArray.size(); ++i) {
+        const uint8* p = static_cast<const uint8*>(mipArray[i]->row(0));
+        testAssert(abs(int(p[0]) - 128) <= 20);
+        testAssert(abs(int(p[3]) - 128) <= 20);
+    }
+}
+
+
+void testImageResampler() {
+    printf("ImageResampler ");
+    testConstant();
+    testBoxAndSRGB();
+    testMipPyramid();
+    printf("passed\n");
+}
+
+
+void perfImageResampler() {
+    PRINT_SECTION("Performance: ImageResampler", "2048 x 2048 RGBA8 image");
+
+    Random rnd(1, false);
+    const shared_ptr<CPUPixelTransferBuffer>& src = CPUPixelTransferBuffer::create(2048, 2048, ImageFormat::RGBA8());
+    uint8* data = static_cast<uint8*>(src->buffer());
+    for (int i = 0; i < 2048 * 2048 * 4; ++i) {
+        data[i] = uint8(rnd.integer(0, 255));
+    }
+
+    Stopwatch stopwatch;
+    stopwatch.tick();
+    ImageResampler::resize(src, 1024, 1024, ImageResampler::Filter::LANCZOS3, true);
+    stopwatch.tock();
+    PRINT_MILLI("Lanczos3 half", "ms", stopwatch.elapsedDuration());
+
+    stopwatch.tick();
+    ImageResampler::resize(src, 300, 200, ImageResampler::Filter::MITCHELL);
+    stopwatch.tock();
+    PRINT_MILLI("Mitchell thumb", "ms", stopwatch.elapsedDuration());
+
+    Array<shared_ptr<CPUPixelTransferBuffer>> mipArray;
+    stopwatch.tick();
+    ImageResampler::generateMipPyramid(src, mipArray, ImageResampler::Filter::BOX, true);
+    stopwatch.tock();
+    PRINT_MILLI("Box mip chain", "ms", stopwatch.elapsedDuration());
+}
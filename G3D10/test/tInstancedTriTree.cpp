@@ -0,0 +1,218 @@
+/**
+  \file test/tInstancedTriTree.cpp
+
+  G3D Innovation Engine http://casual-effects.com/g3d
+  Copyright 2000-2019, Morgan McGuire
+  All rights reserved
+  Available under the BSD License
+*/
+#include "G3D/G3D.h"
+#include "testassert.h"
+
+/** A bumpy n x n grid of quads on the XZ plane in object space */
+static void makeTerrainPatch(Random& rnd, int n, Array<Tri>& triArray, CPUVertexArray& vertexArray) {
+    for (int z = 0; z <= n; ++z) {
+        for (int x = 0; x <= n; ++x) {
+            CPUVertexArray::Vertex& vertex = vertexArray.vertex.next();
+            vertex.position  = Point3(float(x), rnd.uniform(-0.3f, 0.3f), float(z));
+            vertex.normal    = Vector3::unitY();
+            vertex.tangent   = Vector4(1, 0, 0, 1);
+            vertex.texCoord0 = Point2(float(x), float(z)) / float(n);
+        }
+    }
+
+    for (int z = 0; z < n; ++z) {
+        for (int x = 0; x < n; ++x) {
+            const int i = x + z * (n + 1);
+            triArray.append(Tri(i, i + n + 1, i + 1, vertexArray, nullptr, true));
+            triArray.append(Tri(i + 1, i + n + 1, i + n + 2, vertexArray, nullptr, true));
+        }
+    }
+}
+
+
+/** Flattens the instances into world space in instance order, so that triangle indices match */
+static shared_ptr<NativeTriTree> flatten(const InstancedTriTree& instanced) {
+    Array<Tri> triArray;
+    CPUVertexArray vertexArray;
+    for (int i = 0; i < instanced.numInstances(); ++i) {
+        const InstancedTriTree::Instance& instance = instanced.instance(i);
+        const shared_ptr<NativeTriTree>& geometry = instanced.geometry(instance.geometry);
+        const int offset = vertexArray.size();
+        vertexArray.transformAndAppend(geometry->vertexArray(), instance.frame);
+        for (const Tri& tri : geometry->triArray()) {
+            triArray.append(Tri(tri.index[0] + offset, tri.index[1] + offset, tri.index[2] + offset, vertexArray, nullptr, true));
+        }
+    }
+
+    const shared_ptr<NativeTriTree>& flat = NativeTriTree::create();
+    flat->setContents(triArray, vertexArray);
+    return flat;
+}
+
+
+/** Intersects every instance in turn, with the same object-space rays that InstancedTriTree uses */
+static bool bruteForceIntersectRay(const InstancedTriTree& instanced, const Ray& ray, TriTree::Hit& hit, TriTree::IntersectRayOptions options) {
+    hit.triIndex = TriTree::Hit::NONE;
+    for (int i = 0; i < instanced.numInstances(); ++i) {
+        const InstancedTriTree::Instance& instance = instanced.instance(i);
+        const Ray objectRay(instance.frame.pointToObjectSpace(ray.origin()), instance.frame.vectorToObjectSpace(ray.direction()), ray.minDistance(), ray.maxDistance());
+        TriTree::Hit instanceHit;
+        if (instanced.geometry(instance.geometry)->intersectRay(objectRay, instanceHit, options) &&
+            ((hit.triIndex == TriTree::Hit::NONE) || (instanceHit.distance < hit.distance))) {
+            hit = instanceHit;
+            hit.triIndex += instance.firstTri;
+        }
+    }
+    return hit.triIndex != TriTree::Hit::NONE;
+}
+
+
+/** World-space position of \a hit, computed from the object-space triangle and its instance's frame */
+static Point3 hitPosition(const InstancedTriTree& instanced, const TriTree::Hit& hit) {
+    int i = instanced.numInstances() - 1;
+    while (instanced.instance(i).firstTri > hit.triIndex) {
+        --i;
+    }
+    const InstancedTriTree::Instance& instance = instanced.instance(i);
+    const NativeTriTree& geometry = *instanced.geometry(instance.geometry);
+    const Tri& tri = geometry.triArray()[hit.triIndex - instance.firstTri];
+    const Point3& objectPosition =
+        (1.0f - hit.u - hit.v) * tri.position(geometry.vertexArray(), 0) +
+        hit.u * tri.position(geometry.vertexArray(), 1) +
+        hit.v * tri.position(geometry.vertexArray(), 2);
+    return instance.frame.pointToWorldSpace(objectPosition);
+}
+
+
+static void compareRays(Random& rnd, const InstancedTriTree& instanced) {
+    const TriTree::IntersectRayOptions options = TriTree::NO_PARTIAL_COVERAGE_TEST;
+    int hits = 0;
+    for (int r = 0; r < 2000; ++r) {
+        const Point3 origin(rnd.uniform(-5.0f, 45.0f), rnd.uniform(5.0f, 20.0f), rnd.uniform(-5.0f, 45.0f));
+        const Vector3& direction = (Point3(rnd.uniform(0.0f, 40.0f), 0.0f, rnd.uniform(0.0f, 40.0f)) - origin).direction();
+        const Ray ray(origin, direction);
+
+        // The top level must neither cull an instance that the ray hits nor change the result
+        TriTree::Hit expected, actual;
+        const bool expectedHit = bruteForceIntersectRay(instanced, ray, expected, options);
+        const bool actualHit   = instanced.intersectRay(ray, actual, options);
+        testAssert(expectedHit == actualHit);
+        if (actualHit) {
+            ++hits;
+            testAssert(abs(expected.distance - actual.distance) < 1e-4f);
+            // Overlapping instances may tie
+            testAssert((expected.triIndex == actual.triIndex) || (hitPosition(instanced, expected) - hitPosition(instanced, actual)).length() < 1e-4f);
+            testAssert(actual.triIndex >= 0 && actual.triIndex < instanced.size());
+
+            // Distance is in world space
+            testAssert((hitPosition(instanced, actual) - ray.origin() - ray.direction() * actual.distance).length() < 1e-3f);
+        }
+
+        // Occlusion rays agree on whether anything was hit
+        TriTree::Hit occlusion;
+        testAssert(instanced.intersectRay(ray, occlusion, options | TriTree::OCCLUSION_TEST_ONLY) == actualHit);
+    }
+    testAssert(hits > 100);
+}
+
+
+static void compareBoxes(Random& rnd, const InstancedTriTree& instanced, const NativeTriTree& flat) {
+    Array<Triangle> actual;
+    Array<Tri> actualTri;
+    Array<Tri> expected;
+    for (int b = 0; b < 50; ++b) {
+        const Point3 center(rnd.uniform(0.0f, 40.0f), rnd.uniform(-1.0f, 1.0f), rnd.uniform(0.0f, 40.0f));
+        const AABox box(center - Vector3(1.5f, 1.0f, 1.5f), center + Vector3(1.5f, 1.0f, 1.5f));
+        instanced.intersectBox(box, actual);
+
+        expected.fastClear();
+        flat.intersectBox(box, expected);
+        int expectedCount = 0;
+        for (const Tri& tri : expected) {
+            if (CollisionDetection::fixedSolidBoxIntersectsFixedTriangle(box, tri.toTriangle(flat.vertexArray()))) {
+                ++expectedCount;
+            }
+        }
+        testAssert(actual.size() == expectedCount);
+        for (const Triangle& triangle : actual) {
+            testAssert(CollisionDetection::fixedSolidBoxIntersectsFixedTriangle(box, triangle));
+        }
+
+        // The Tri overload finds the same triangles, indexed into the flattened vertex array
+        instanced.intersectBox(box, actualTri);
+        testAssert(actualTri.size() == expectedCount);
+        for (const Tri& tri : actualTri) {
+            testAssert(CollisionDetection::fixedSolidBoxIntersectsFixedTriangle(box, tri.toTriangle(instanced.vertexArray())));
+        }
+    }
+}
+
+
+/** The lazily flattened arrays match an independent flattening */
+static void compareFlattened(const InstancedTriTree& instanced, const NativeTriTree& flat) {
+    instanced.flatten();
+    testAssert(instanced.triArray().size() == instanced.size());
+    testAssert(instanced.vertexArray().size() == flat.vertexArray().size());
+    for (int t = 0; t < instanced.size(); ++t) {
+        for (int v = 0; v < 3; ++v) {
+            testAssert((instanced[t].position(instanced.vertexArray(), v) - flat[t].position(flat.vertexArray(), v)).length() < 1e-4f);
+        }
+    }
+}
+
+
+void testInstancedTriTree() {
+    printf("InstancedTriTree ");
+
+    Random rnd(11, false);
+    const shared_ptr<InstancedTriTree>& instanced = InstancedTriTree::create();
+
+    for (int g = 0; g < 2; ++g) {
+        Array<Tri> triArray;
+        CPUVertexArray vertexArray;
+        makeTerrainPatch(rnd, 4 + g * 2, triArray, vertexArray);
+        testAssert(instanced->addGeometry(triArray, vertexArray) == g);
+    }
+
+    // A forest of rotated, translated instances sharing two geometries
+    for (int i = 0; i < 64; ++i) {
+        const CFrame& frame = CFrame::fromXYZYPRDegrees(float(i % 8) * 5.0f, rnd.uniform(-1.0f, 1.0f), float(i / 8) * 5.0f, rnd.uniform(0.0f, 360.0f), rnd.uniform(-10.0f, 10.0f));
+        instanced->addInstance(i % 3 == 0 ? 1 : 0, frame);
+    }
+    instanced->rebuild();
+
+    testAssert(instanced->numGeometries() == 2);
+    testAssert(instanced->numInstances() == 64);
+    testAssert(instanced->size() == 22 * (2 * 6 * 6) + 42 * (2 * 4 * 4));
+
+    // The world-space copy is only made on demand
+    testAssert(instanced->triArray().size() == 0);
+
+    compareRays(rnd, *instanced);
+    compareBoxes(rnd, *instanced, *flatten(*instanced));
+    compareFlattened(*instanced, *flatten(*instanced));
+
+    // Moving instances only refits the top level, and the results still match a full rebuild
+    for (int i = 0; i < instanced->numInstances(); i += 2) {
+        const CFrame& frame = instanced->instance(i).frame;
+        instanced->setInstanceFrame(i, CFrame(frame.rotation * Matrix3::fromAxisAngle(Vector3::unitY(), 0.5f), frame.translation + Vector3(1.0f, 0.5f, -1.0f)));
+    }
+    instanced->refit();
+    testAssert(instanced->instance(0).previousFrame.translation != instanced->instance(0).frame.translation);
+    testAssert(instanced->triArray().size() == 0);
+
+    compareRays(rnd, *instanced);
+    compareBoxes(rnd, *instanced, *flatten(*instanced));
+    compareFlattened(*instanced, *flatten(*instanced));
+
+    // Tri overload of the sphere query
+    const Sphere sphere(Point3(20.0f, 0.0f, 20.0f), 3.0f);
+    Array<Tri> triArray;
+    Array<Triangle> triangleArray;
+    instanced->intersectSphere(sphere, triArray);
+    instanced->intersectSphere(sphere, triangleArray);
+    testAssert((triArray.size() == triangleArray.size()) && (triArray.size() > 0));
+
+    printf("passed\n");
+}
@@ -0,0 +1,73 @@
+/**
+  \file test/tLightTree.cpp
+
+  G3D Innovation Engine http://casual-effects.com/g3d
+  Copyright 2000-2019, Morgan McGuire
+  All rights reserved
+  Available under the BSD License
+*/
+#include "G3D/G3D.h"
+#include "testassert.h"
+
+void testLightTree() {
+    printf("LightTree ");
+
+    Random rnd(42, false);
+    Array<shared_ptr<Light>> lightArray;
+    for (int i = 0; i < 200; ++i) {
+        const Point3 P(rnd.uniform(-50, 50), rnd.uniform(0, 10), rnd.uniform(-50, 50));
+        const Color3 power = Color3(rnd.uniform(1, 100));
+        if (i % 3 == 0) {
+            // Spot lights pointing down
+            lightArray.append(Light::spot(format("spot%d", i), P, -Vector3::unitY(), 0.5f, power, 0.01f, 0.0f, 1.0f, false));
+        } else {
+            lightArray.append(Light::point(format("point%d", i), P, power, 0.01f, 0.0f, 1.0f, false));
+        }
+    }
+    lightArray.append(Light::directional("sun", Vector3(1, 2, 1), Color3(3.0f), false));
+
+    const shared_ptr<LightTree>& tree = LightTree::create(lightArray);
+    testAssert(tree->size() == lightArray.size());
+
+    for (int trial = 0; trial < 10; ++trial) {
+        const Point3 X(rnd.uniform(-60, 60), rnd.uniform(-5, 5), rnd.uniform(-60, 60));
+        Vector3 n;
+        rnd.sphere(n.x, n.y, n.z);
+
+        // The probabilities sum to at most one. Probability is lost only when the traversal reaches
+        // a node whose children are all oriented away from X, which are lights that cannot contribute.
+        float sum = 0.0f;
+        for (int i = 0; i < lightArray.size(); ++i) {
+            const float p = tree->pdf(X, n, i);
+            testAssert(p >= 0.0f);
+            sum += p;
+
+            // A spot light pointing away from X is never chosen
+            if ((lightArray[i]->type() == Light::Type::SPOT) && (X.y > lightArray[i]->position().y + 1.0f)) {
+                testAssert(p == 0.0f);
+            }
+        }
+        testAssert(sum <= 1.0f + 1e-4f);
+
+        // Sampling reports the same probability as pdf()
+        for (int s = 0; s < 20; ++s) {
+            float pdf;
+            const int j = tree->sample(X, n, rnd.uniform(), pdf);
+            if (j >= 0) {
+                testAssert(pdf > 0.0f);
+                testAssert(fabs(pdf - tree->pdf(X, n, j)) <= 1e-4f * max(pdf, 1.0f));
+            }
+        }
+    }
+
+    // With the normal ignored, the nearest bright light dominates
+    {
+        Array<shared_ptr<Light>> pair;
+        pair.append(Light::point("near", Point3(0, 0, 1), Color3(10.0f), 0.01f, 0.0f, 1.0f, false));
+        pair.append(Light::point("far", Point3(0, 0, 100), Color3(10.0f), 0.01f, 0.0f, 1.0f, false));
+        const shared_ptr<LightTree>& small = LightTree::create(pair);
+        testAssert(small->pdf(Point3::zero(), Vector3::nan(), 0) > 0.99f);
+    }
+
+    printf("passed\n");
+}
@@ -0,0 +1,213 @@
+/**
+  \file test/tMD2Model.cpp
+
+  G3D Innovation Engine http://casual-effects.com/g3d
+  Copyright 2000-2019, Morgan McGuire
+  All rights reserved
+  Available under the BSD License
+*/
+#include "G3D/G3D.h"
+#include "testassert.h"
+
+static const String modelFilename = "tMD2Model-temp.md2";
+
+/** Writes an animated (gridSize x gridSize) sheet in the Quake II MD2 format */
+static void writeTestModel(int numFrames, int gridSize) {
+    const int numVertices  = square(gridSize + 1);
+    const int numTriangles = 2 * square(gridSize);
+    const int frameSize    = 40 + 4 * numVertices;
+
+    const int offsetSkins      = 68;
+    const int offsetTexCoords  = offsetSkins;
+    const int offsetTriangles  = offsetTexCoords + 4;
+    const int offsetFrames     = offsetTriangles + numTriangles * 12;
+    const int offsetGlCommands = offsetFrames + numFrames * frameSize;
+    const int offsetEnd        = offsetGlCommands + 4;
+
+    BinaryOutput b(modelFilename, G3D_LITTLE_ENDIAN);
+    const int header[] = {0x32504449, 8, 64, 64, frameSize, 0, numVertices, 1, numTriangles, 1, numFrames,
+        offsetSkins, offsetTexCoords, offsetTriangles, offsetFrames, offsetGlCommands, offsetEnd};
+    for (int i = 0; i < 17; ++i) {
+        b.writeInt32(header[i]);
+    }
+
+    // One texture coordinate
+    b.writeUInt16(0);
+    b.writeUInt16(0);
+
+    for (int y = 0; y < gridSize; ++y) {
+        for (int x = 0; x < gridSize; ++x) {
+            const int i = x + y * (gridSize + 1);
+            const int triangle[2][3] = {{i, i + gridSize + 1, i + 1}, {i + 1, i + gridSize + 1, i + gridSize + 2}};
+            for (int t = 0; t < 2; ++t) {
+                for (int v = 0; v < 3; ++v) {
+                    b.writeUInt16(uint16(triangle[t][v]));
+                }
+                for (int v = 0; v < 3; ++v) {
+                    b.writeUInt16(0);
+                }
+            }
+        }
+    }
+
+    for (int f = 0; f < numFrames; ++f) {
+        Vector3(0.1f, 0.1f, 0.1f).serialize(b);
+        Vector3::zero().serialize(b);
+        b.writeString(format("frame%d", f), 16);
+        for (int v = 0; v < numVertices; ++v) {
+            const int x = v % (gridSize + 1);
+            const int y = v / (gridSize + 1);
+            b.writeUInt8(uint8(x * 8));
+            b.writeUInt8(uint8(y * 8));
+            b.writeUInt8(uint8((x * y + f * 5) & 255));
+            b.writeUInt8(uint8((v * 7 + f * 13) % 162));
+        }
+    }
+
+    b.writeInt32(0);
+    b.commit();
+}
+
+
+static shared_ptr<MD2Model::Part> loadTestModel(int numFrames, int gridSize) {
+    writeTestModel(numFrames, gridSize);
+    MD2Model::Part::Specification specification;
+    specification.filename = modelFilename;
+    const shared_ptr<MD2Model::Part>& part = MD2Model::Part::create(specification);
+    FileSystem::removeFile(modelFilename);
+    return part;
+}
+
+
+/** Blends from keyframe \a frame into the first STAND frame */
+static MD2Model::Pose blendPose(int frame, float alpha) {
+    MD2Model::Pose pose(MD2Model::STAND, (alpha - 1.0f) * MD2Model::PRE_BLEND_TIME);
+    pose.preFrameNumber = frame;
+    return pose;
+}
+
+
+static bool sameGeometry(const MeshAlg::Geometry& a, const MeshAlg::Geometry& b) {
+    return (a.vertexArray.size() == b.vertexArray.size()) &&
+        (memcmp(a.vertexArray.getCArray(), b.vertexArray.getCArray(), sizeof(Vector3) * a.vertexArray.size()) == 0) &&
+        (memcmp(a.normalArray.getCArray(), b.normalArray.getCArray(), sizeof(Vector3) * a.normalArray.size()) == 0);
+}
+
+
+void testMD2Model() {
+    printf("MD2Model ");
+
+    const shared_ptr<MD2Model::Part>& part = loadTestModel(40, 9);
+    const int numVertices = square(10);
+
+    // Blending matches a per-vertex lerp, and normals are renormalized
+    MeshAlg::Geometry frame5, frame0, mid;
+    part->getGeometry(blendPose(5, 0.0f), frame5);
+    part->getGeometry(blendPose(0, 0.0f), frame0);
+    part->getGeometry(blendPose(5, 0.5f), mid);
+    testAssert(mid.vertexArray.size() == numVertices);
+    for (int v = 0; v < numVertices; ++v) {
+        testAssert((mid.vertexArray[v] - frame5.vertexArray[v].lerp(frame0.vertexArray[v], 0.5f)).length() < 1e-5f);
+        testAssert(fuzzyEq(mid.normalArray[v].length(), 1.0f));
+        const Vector3& sum = frame5.normalArray[v] + frame0.normalArray[v];
+        if (sum.length() > 0.1f) {
+            testAssert((mid.normalArray[v] - sum.direction()).length() < 1e-4f);
+        }
+    }
+
+    // Negated normals are cached separately
+    MeshAlg::Geometry negated;
+    part->getGeometry(blendPose(5, 0.5f), negated, true);
+    for (int v = 0; v < numVertices; ++v) {
+        testAssert(negated.normalArray[v] == -mid.normalArray[v]);
+        testAssert(negated.vertexArray[v] == mid.vertexArray[v]);
+    }
+
+    // A repeated pose is copied from the cache
+    MD2Model::Part::PoseCacheStats stats = part->poseCacheStats();
+    testAssert(stats.misses == 4 && stats.hits == 0 && stats.entries == 4);
+    MeshAlg::Geometry again;
+    part->getGeometry(blendPose(5, 0.5f), again);
+    testAssert(sameGeometry(again, mid));
+    testAssert(part->poseCacheStats().hits == 1);
+
+    // The least-recently used poses are evicted first
+    part->setPoseCacheCapacity(3);
+    stats = part->poseCacheStats();
+    testAssert(stats.entries == 3 && stats.evictions == 1);
+    part->getGeometry(blendPose(5, 0.5f), again);
+    testAssert(part->poseCacheStats().hits == 2);
+    for (int f = 10; f < 13; ++f) {
+        part->getGeometry(blendPose(f, 0.25f), again);
+    }
+    part->getGeometry(blendPose(5, 0.5f), again);
+    testAssert(part->poseCacheStats().hits == 2);
+    testAssert(part->poseCacheStats().entries == 3);
+
+    // A crowd posed in parallel matches posing each character serially with no cache
+    part->setPoseCacheCapacity(64);
+    Array<MD2Model::Pose> crowd;
+    for (int c = 0; c < 200; ++c) {
+        crowd.append(MD2Model::Pose(MD2Model::STAND, (c % 10) * 0.173));
+    }
+    Array<MeshAlg::Geometry> crowdGeometry;
+    part->getGeometry(crowd, crowdGeometry);
+    testAssert(crowdGeometry.size() == crowd.size());
+
+    const shared_ptr<MD2Model::Part>& uncached = loadTestModel(40, 9);
+    uncached->setPoseCacheCapacity(0);
+    for (int c = 0; c < crowd.size(); ++c) {
+        MeshAlg::Geometry expected;
+        uncached->getGeometry(crowd[c], expected);
+        testAssert(sameGeometry(crowdGeometry[c], expected));
+    }
+    testAssert(uncached->poseCacheStats().entries == 0);
+
+    // Once warm, the whole crowd hits
+    const int hits = part->poseCacheStats().hits;
+    part->getGeometry(crowd, crowdGeometry);
+    testAssert(part->poseCacheStats().hits == hits + crowd.size());
+
+    printf("passed\n");
+}
+
+
+void perfMD2Model() {
+    printf("MD2Model crowd posing:\n");
+
+    const shared_ptr<MD2Model::Part>& part = loadTestModel(40, 24);
+    const int numCharacters = 500;
+    const int numFrames = 20;
+
+    // Characters march in 16 groups that are each in step
+    Array<MD2Model::Pose> crowd;
+    crowd.resize(numCharacters);
+    Array<MeshAlg::Geometry> crowdGeometry;
+    crowdGeometry.resize(numCharacters);
+
+    for (int mode = 0; mode < 3; ++mode) {
+        part->clearPoseCache();
+        part->setPoseCacheCapacity((mode == 2) ? 64 : 0);
+
+        Stopwatch stopwatch;
+        stopwatch.tick();
+        for (int f = 0; f < numFrames; ++f) {
+            for (int c = 0; c < numCharacters; ++c) {
+                crowd[c] = MD2Model::Pose(MD2Model::STAND, f / 30.0 + (c % 16) * 0.31);
+            }
+
+            if (mode == 0) {
+                for (int c = 0; c < numCharacters; ++c) {
+                    part->getGeometry(crowd[c], crowdGeometry[c]);
+                }
+            } else {
+                part->getGeometry(crowd, crowdGeometry);
+            }
+        }
+        stopwatch.tock();
+
+        static const char* name[] = {"serial, no cache", "parallel, no cache", "parallel, cached"};
+        printf("  %-20s %6.2f ms/frame for %d characters\n", name[mode], stopwatch.elapsedTime() / numFrames * 1000.0, numCharacters);
+    }
+    printf("\n");
+}
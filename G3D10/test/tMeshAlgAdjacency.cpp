@@ -311,5 +311,90 @@ void testAdjacency() {
         testAssert(edgeArray[4].boundary());
 
     }
+
+    {
+        // The sort-based and table-based edge builders must agree exactly on a mesh large enough
+        // to be processed in parallel, including non-manifold and inconsistently wound edges
+        const int N = 120;
+        MeshAlg::Geometry       geometry;
+        Array<int>              index;
+        Random                  rnd(7, false);
+
+        for (int y = 0; y <= N; ++y) {
+            for (int x = 0; x <= N; ++x) {
+                geometry.vertexArray.append(Vector3(float(x), float(y), rnd.uniform()));
+            }
+        }
+
+        for (int y = 0; y < N; ++y) {
+            for (int x = 0; x < N; ++x) {
+                const int v00 = y * (N + 1) + x;
+                const int v10 = v00 + 1;
+                const int v01 = v00 + N + 1;
+                const int v11 = v01 + 1;
+                switch (rnd.integer(0, 9)) {
+                case 0:
+                    // Hole
+                    break;
+
+                case 1:
+                    // Flipped
+                    index.append(v00, v11, v10);
+                    index.append(v00, v01, v11);
+                    break;
+
+                case 2:
+                    // Duplicated, creating non-manifold edges
+                    index.append(v00, v10, v11);
+                    index.append(v00, v10, v11);
+                    index.append(v00, v11, v01);
+                    break;
+
+                default:
+                    index.append(v00, v10, v11);
+                    index.append(v00, v11, v01);
+                }
+            }
+        }
+
+        Array<MeshAlg::Face>    faceArray[2];
+        Array<MeshAlg::Edge>    edgeArray[2];
+        Array<MeshAlg::Vertex>  vertexArray[2];
+        for (int i = 0; i < 2; ++i) {
+            MeshAlg::computeAdjacency(geometry.vertexArray, index, faceArray[i], edgeArray[i], vertexArray[i], i == 1);
+        }
+
+        testAssert(faceArray[0].size() == faceArray[1].size());
+        for (int f = 0; f < faceArray[0].size(); ++f) {
+            for (int j = 0; j < 3; ++j) {
+                testAssert(faceArray[0][f].vertexIndex[j] == faceArray[1][f].vertexIndex[j]);
+                testAssert(faceArray[0][f].edgeIndex[j] == faceArray[1][f].edgeIndex[j]);
+            }
+        }
+
+        testAssert(edgeArray[0].size() == edgeArray[1].size());
+        for (int e = 0; e < edgeArray[0].size(); ++e) {
+            for (int j = 0; j < 2; ++j) {
+                testAssert(edgeArray[0][e].vertexIndex[j] == edgeArray[1][e].vertexIndex[j]);
+                testAssert(edgeArray[0][e].faceIndex[j] == edgeArray[1][e].faceIndex[j]);
+            }
+        }
+
+        testAssert(vertexArray[0].size() == vertexArray[1].size());
+        for (int v = 0; v < vertexArray[0].size(); ++v) {
+            const MeshAlg::Vertex& A = vertexArray[0][v];
+            const MeshAlg::Vertex& B = vertexArray[1][v];
+            testAssert(A.edgeIndex.size() == B.edgeIndex.size());
+            for (int j = 0; j < A.edgeIndex.size(); ++j) {
+                testAssert(A.edgeIndex[j] == B.edgeIndex[j]);
+            }
+            testAssert(A.faceIndex.size() == B.faceIndex.size());
+            for (int j = 0; j < A.faceIndex.size(); ++j) {
+                testAssert(A.faceIndex[j] == B.faceIndex[j]);
+            }
+        }
+
+        MeshAlg::debugCheckConsistency(faceArray[1], edgeArray[1], vertexArray[1]);
+    }
     
 }
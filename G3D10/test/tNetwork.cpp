@@ -0,0 +1,212 @@
+/**
+  \file test/tNetwork.cpp
+
+  G3D Innovation Engine http://casual-effects.com/g3d
+  Copyright 2000-2019, Morgan McGuire
+  All rights reserved
+  Available under the BSD License
+*/
+#include "G3D/G3D.h"
+#include "testassert.h"
+
+static const uint32 loopback = 0x7F000001;
+
+
+/** Polls until \a done returns true. Returns false after a timeout. */
+template<class Predicate>
+static bool waitUntil(const Predicate& done) {
+    const RealTime stop = System::time() + 10.0;
+    while (! done()) {
+        if (System::time() > stop) {
+            return false;
+        }
+        System::sleep(0.0005);
+    }
+    return true;
+}
+
+
+/** Starts a server on \a port and connects \a client to it. Returns the server's side of the connection. */
+static shared_ptr<NetConnection> connectLoopback(uint16 port, shared_ptr<NetServer>& server, shared_ptr<NetConnection>& client) {
+    server = NetServer::create(NetAddress(loopback, port), 4, 2);
+    client = NetConnection::connectToServer(NetAddress(loopback, port), 2);
+    testAssert(waitUntil([&]() {
+        return server->newConnectionIterator().isValid() && (client->status() != NetConnection::WAITING_TO_CONNECT);
+    }));
+
+    const shared_ptr<NetConnection> connection = server->newConnectionIterator().connection();
+    ++server->newConnectionIterator();
+    return connection;
+}
+
+
+class ReceivedMessage {
+public:
+    NetMessageType      type;
+    Array<uint8>        data;
+
+    /** First int32 of the user header, or -1 if there is none */
+    int                 header;
+};
+
+
+/** Appends the messages waiting on \a channel to \a messages */
+static void receive(const shared_ptr<NetConnection>& connection, NetChannel channel, Array<ReceivedMessage>& messages) {
+    NetMessageIterator& it = connection->incomingMessageIterator(channel);
+    while (it.isValid()) {
+        testAssert(it.channel() == channel);
+        ReceivedMessage& m = messages.next();
+        m.type = it.type();
+        m.data.resize(int(it.size()));
+        System::memcpy(m.data.getCArray(), it.data(), it.size());
+        BinaryInput& header = it.headerBinaryInput();
+        m.header = (header.size() >= 4) ? header.readInt32() : -1;
+        ++it;
+    }
+}
+
+
+/** Sends \a count messages whose contents depend on \a first + their index. Every 50th is too big to coalesce,
+    and every third has a user header. */
+static void sendPattern(const shared_ptr<NetSendConnection>& connection, NetChannel channel, int first, int count) {
+    Array<uint8> data;
+    for (int i = first; i < first + count; ++i) {
+        data.resize(((i % 50) == 49) ? 5000 : (i % 40));
+        for (int b = 0; b < data.size(); ++b) {
+            data[b] = uint8(i + b);
+        }
+
+        if ((i % 3) == 0) {
+            BinaryOutput header("<memory>", G3D_LITTLE_ENDIAN);
+            header.writeInt32(i);
+            connection->send(NetMessageType(i % 7), data.getCArray(), data.size(), header, channel);
+        } else {
+            connection->send(NetMessageType(i % 7), data.getCArray(), data.size(), channel);
+        }
+    }
+}
+
+
+static void checkPattern(const Array<ReceivedMessage>& messages, int first, int count) {
+    testAssert(messages.size() == count);
+    for (int m = 0; m < count; ++m) {
+        const int i = first + m;
+        const ReceivedMessage& message = messages[m];
+        testAssert(message.type == NetMessageType(i % 7));
+        testAssert(message.data.size() == (((i % 50) == 49) ? 5000 : (i % 40)));
+        for (int b = 0; b < message.data.size(); ++b) {
+            testAssert(message.data[b] == uint8(i + b));
+        }
+        testAssert(message.header == (((i % 3) == 0) ? i : -1));
+    }
+}
+
+
+void testNetwork() {
+    printf("Network ");
+
+    shared_ptr<NetServer> server;
+    shared_ptr<NetConnection> client;
+    const shared_ptr<NetConnection>& connection = connectLoopback(20317, server, client);
+
+    // Small messages are coalesced, and are received individually and in order with the large ones.
+    // A long service interval makes it likely that all are sent in one flush.
+    const size_t defaultThreshold = networkCoalescingThreshold();
+    const RealTime defaultInterval = networkCommunicationInterval();
+    setNetworkCommunicationInterval(0.02);
+    resetNetworkSendStats();
+    sendPattern(client, 1, 0, 500);
+    Array<ReceivedMessage> messages;
+    testAssert(waitUntil([&]() { receive(connection, 1, messages); return messages.size() >= 500; }));
+    checkPattern(messages, 0, 500);
+
+    NetworkSendStats stats = networkSendStats();
+    testAssert(stats.messages == 500);
+    testAssert(stats.coalescedMessages > 0);
+    testAssert(stats.packets < 100);
+
+    // Broadcasts and messages to one client stay in order on a channel
+    messages.fastClear();
+    sendPattern(server->omniConnection(), 0, 0, 100);
+    sendPattern(connection, 0, 100, 100);
+    sendPattern(server->omniConnection(), 0, 200, 100);
+    testAssert(waitUntil([&]() { receive(client, 0, messages); return messages.size() >= 300; }));
+    checkPattern(messages, 0, 300);
+
+    // Each message has its own packets when coalescing is disabled
+    setNetworkCoalescingThreshold(0);
+    resetNetworkSendStats();
+    messages.fastClear();
+    sendPattern(client, 1, 1000, 20);
+    testAssert(waitUntil([&]() { receive(connection, 1, messages); return messages.size() >= 20; }));
+    checkPattern(messages, 1000, 20);
+    stats = networkSendStats();
+    testAssert(stats.coalescedMessages == 0);
+    testAssert(stats.packets == 40);
+    setNetworkCoalescingThreshold(defaultThreshold);
+    setNetworkCommunicationInterval(defaultInterval);
+
+    client->disconnect(false);
+    server->stop();
+
+    printf("passed\n");
+}
+
+
+void perfNetwork() {
+    printf("Network send path, loopback:\n");
+
+    shared_ptr<NetServer> server;
+    shared_ptr<NetConnection> client;
+    const shared_ptr<NetConnection>& connection = connectLoopback(20318, server, client);
+
+    const size_t defaultThreshold = networkCoalescingThreshold();
+    const int numMessages = 20000;
+    const int numRoundTrips = 200;
+    uint8 payload[64] = {};
+
+    for (int mode = 0; mode < 2; ++mode) {
+        setNetworkCoalescingThreshold((mode == 0) ? 0 : defaultThreshold);
+        resetNetworkSendStats();
+
+        // Throughput of a burst of small messages
+        Stopwatch stopwatch;
+        stopwatch.tick();
+        for (int i = 0; i < numMessages; ++i) {
+            client->send(1, payload, sizeof(payload));
+        }
+        int received = 0;
+        NetMessageIterator& serverIt = connection->incomingMessageIterator(0);
+        testAssert(waitUntil([&]() {
+            while (serverIt.isValid()) {
+                ++received;
+                ++serverIt;
+            }
+            return received == numMessages;
+        }));
+        stopwatch.tock();
+        const NetworkSendStats& stats = networkSendStats();
+
+        // Round-trip latency of one small message at a time
+        NetMessageIterator& clientIt = client->incomingMessageIterator(0);
+        const RealTime start = System::time();
+        for (int i = 0; i < numRoundTrips; ++i) {
+            client->send(2, payload, sizeof(payload));
+            testAssert(waitUntil([&]() { return serverIt.isValid(); }));
+            ++serverIt;
+            connection->send(3, payload, sizeof(payload));
+            testAssert(waitUntil([&]() { return clientIt.isValid(); }));
+            ++clientIt;
+        }
+        const RealTime roundTrip = (System::time() - start) / numRoundTrips;
+
+        printf("  %-14s %9.0f msg/s  %6d packets for %d messages  %6.3f ms round trip\n",
+            (mode == 0) ? "uncoalesced" : "coalesced",
+            numMessages / stopwatch.elapsedTime(), int(stats.packets), numMessages, roundTrip * 1000.0);
+    }
+    setNetworkCoalescingThreshold(defaultThreshold);
+
+    client->disconnect(false);
+    server->stop();
+    printf("\n");
+}
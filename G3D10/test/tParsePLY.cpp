@@ -0,0 +1,180 @@
+/**
+  \file test/tParsePLY.cpp
+
+  G3D Innovation Engine http://casual-effects.com/g3d
+  Copyright 2000-2019, Morgan McGuire
+  All rights reserved
+  Available under the BSD License
+*/
+#include "G3D/G3D.h"
+#include "printhelpers.h"
+#include "testassert.h"
+
+/** Vertex v has x = v / 2, y = -v, z = v % 7, red = v % 256, and s = v % 1000 - 500.
+    Face f is a triangle or quad of consecutive vertices starting at f. If \a faceFlags is true,
+    each face has a uchar property before its index list, and if \a vertexList is true, each
+    vertex ends with an empty list, which makes the binary records variable length. */
+static void writePLY(BinaryOutput& b, ParsePLY::FileFormat fileFormat, int numVertices, int numFaces, bool faceFlags, bool vertexList) {
+    const char* formatName[] = {"ascii", "binary_little_endian", "binary_big_endian"};
+
+    String header = format("ply\nformat %s 1.0\ncomment made by tParsePLY\n", formatName[fileFormat]);
+    header += format("element vertex %d\nproperty float x\nproperty float y\nproperty float z\nproperty uchar red\nproperty short s\n", numVertices);
+    if (vertexList) {
+        header += "property list uchar float empty\n";
+    }
+    if (numFaces > 0) {
+        header += format("element face %d\n", numFaces);
+        if (faceFlags) {
+            header += "property uchar flags\n";
+        }
+        header += "property list uchar int vertex_indices\n";
+    }
+    header += "end_header\n";
+    b.writeBytes(header.c_str(), header.size());
+
+    for (int v = 0; v < numVertices; ++v) {
+        if (fileFormat == ParsePLY::ASCII_FORMAT) {
+            const String& line = format("%.1f %d %d %d %d%s\n", v * 0.5f, -v, v % 7, v % 256, v % 1000 - 500, vertexList ? " 0" : "");
+            b.writeBytes(line.c_str(), line.size());
+        } else {
+            b.writeFloat32(v * 0.5f);
+            b.writeFloat32(float(-v));
+            b.writeFloat32(float(v % 7));
+            b.writeUInt8(uint8(v % 256));
+            b.writeInt16(int16(v % 1000 - 500));
+            if (vertexList) {
+                b.writeUInt8(0);
+            }
+        }
+    }
+
+    for (int f = 0; f < numFaces; ++f) {
+        const int len = 3 + (f % 2);
+        if (fileFormat == ParsePLY::ASCII_FORMAT) {
+            String line = faceFlags ? format("%d ", f % 3) : String();
+            line += format("%d", len);
+            for (int i = 0; i < len; ++i) {
+                line += format(" %d", (f + i) % numVertices);
+            }
+            line += "\n";
+            b.writeBytes(line.c_str(), line.size());
+        } else {
+            if (faceFlags) {
+                b.writeUInt8(uint8(f % 3));
+            }
+            b.writeUInt8(uint8(len));
+            for (int i = 0; i < len; ++i) {
+                b.writeInt32((f + i) % numVertices);
+            }
+        }
+    }
+}
+
+
+static void parsePLY(ParsePLY& parser, ParsePLY::FileFormat fileFormat, int numVertices, int numFaces, bool faceFlags, bool vertexList, const ParsePLY::VertexCallback& callback = ParsePLY::VertexCallback()) {
+    const G3DEndian endian = (fileFormat == ParsePLY::BINARY_BIG_ENDIAN_FORMAT) ? G3D_BIG_ENDIAN : G3D_LITTLE_ENDIAN;
+    BinaryOutput b("<memory>", endian);
+    writePLY(b, fileFormat, numVertices, numFaces, faceFlags, vertexList);
+
+    BinaryInput bi(b.getCArray(), b.size(), G3D_LITTLE_ENDIAN);
+    if (callback) {
+        parser.parse(bi, callback);
+    } else {
+        parser.parse(bi);
+    }
+}
+
+
+static void checkVertex(const float* data, int v) {
+    testAssert(data[0] == v * 0.5f);
+    testAssert(data[1] == float(-v));
+    testAssert(data[2] == float(v % 7));
+    testAssert(data[3] == float(v % 256));
+    testAssert(data[4] == float(v % 1000 - 500));
+}
+
+
+static void checkPLY(ParsePLY::FileFormat fileFormat, int numVertices, int numFaces, bool faceFlags, bool vertexList) {
+    ParsePLY parser;
+    parsePLY(parser, fileFormat, numVertices, numFaces, faceFlags, vertexList);
+
+    testAssert(parser.fileFormat == fileFormat);
+    testAssert(parser.numVertices == numVertices);
+    testAssert(parser.numFaces == numFaces);
+    testAssert(parser.vertexStride == (vertexList ? 0 : 15));
+
+    const int N = parser.vertexProperty.size();
+    testAssert(N == (vertexList ? 6 : 5));
+    for (int v = 0; v < numVertices; ++v) {
+        checkVertex(parser.vertexData + v * N, v);
+    }
+
+    for (int f = 0; f < numFaces; ++f) {
+        testAssert(parser.faceSize(f) == 3 + (f % 2));
+        for (int i = 0; i < parser.faceSize(f); ++i) {
+            testAssert(parser.faceIndices(f)[i] == (f + i) % numVertices);
+        }
+    }
+}
+
+
+void testParsePLY() {
+    printf("ParsePLY ");
+
+    // More vertices than one block, so that blocks and tasks are divided
+    const int numVertices = 70000;
+    const int numFaces = 50000;
+
+    for (int fileFormat = 0; fileFormat < 3; ++fileFormat) {
+        checkPLY(ParsePLY::FileFormat(fileFormat), numVertices, numFaces, false, false);
+        checkPLY(ParsePLY::FileFormat(fileFormat), numVertices, numFaces, true, false);
+        checkPLY(ParsePLY::FileFormat(fileFormat), 1000, 500, false, true);
+
+        // A point cloud has no faces
+        checkPLY(ParsePLY::FileFormat(fileFormat), 100, 0, false, false);
+    }
+
+    // Streaming receives every vertex once, in order, and stores no vertexData
+    for (int fileFormat = 0; fileFormat < 3; ++fileFormat) {
+        ParsePLY parser;
+        int next = 0;
+        parsePLY(parser, ParsePLY::FileFormat(fileFormat), numVertices, 10, false, false, [&](int first, int count, const float* data) {
+            testAssert(first == next);
+            for (int i = 0; i < count; ++i) {
+                checkVertex(data + i * 5, first + i);
+            }
+            next += count;
+        });
+        testAssert(next == numVertices);
+        testAssert(isNull(parser.vertexData));
+        testAssert(parser.faceSize(9) == 4);
+    }
+
+    printf("passed\n");
+}
+
+
+void perfParsePLY() {
+    PRINT_SECTION("Performance: ParsePLY", "1M vertices and 1M faces");
+
+    const int numVertices = 1000000;
+    const int numFaces = 1000000;
+
+    for (int fileFormat = 0; fileFormat < 3; ++fileFormat) {
+        const G3DEndian endian = (fileFormat == ParsePLY::BINARY_BIG_ENDIAN_FORMAT) ? G3D_BIG_ENDIAN : G3D_LITTLE_ENDIAN;
+        BinaryOutput b("<memory>", endian);
+        writePLY(b, ParsePLY::FileFormat(fileFormat), numVertices, numFaces, false, false);
+
+        ParsePLY parser;
+        Stopwatch stopwatch;
+        stopwatch.tick();
+        {
+            BinaryInput bi(b.getCArray(), b.size(), G3D_LITTLE_ENDIAN, false, false);
+            parser.parse(bi);
+        }
+        stopwatch.tock();
+
+        const char* name[] = {"ASCII", "Binary LE", "Binary BE"};
+        PRINT_MILLI(name[fileFormat], "ms", stopwatch.elapsedDuration());
+    }
+}
@@ -0,0 +1,105 @@
+/**
+  \file test/tPathTracer.cpp
+
+  G3D Innovation Engine http://casual-effects.com/g3d
+  Copyright 2000-2019, Morgan McGuire
+  All rights reserved
+  Available under the BSD License
+*/
+#include "G3D/G3D.h"
+#include "testassert.h"
+
+/** Tiles of a 100 x 60 image in blocks of 8 pixels, as traceImageAdaptive() makes them */
+static void makeTiles(Random& rnd, float targetError, Array<float>& tileError, Array<int>& tilePixels) {
+    const int width = 100, height = 60, tileSize = 8;
+    const int tilesX = (width + tileSize - 1) / tileSize, tilesY = (height + tileSize - 1) / tileSize;
+    tileError.fastClear();
+    tilePixels.fastClear();
+    for (int y = 0; y < tilesY; ++y) {
+        for (int x = 0; x < tilesX; ++x) {
+            tilePixels.append((min(width, (x + 1) * tileSize) - x * tileSize) * (min(height, (y + 1) * tileSize) - y * tileSize));
+            // A third of the tiles have converged
+            tileError.append(rnd.uniform(0.0f, 3.0f) * targetError);
+        }
+    }
+}
+
+
+static int64 totalRays(const Array<int>& tileRays, const Array<int>& tilePixels) {
+    int64 total = 0;
+    for (int t = 0; t < tileRays.size(); ++t) {
+        total += int64(tileRays[t]) * int64(tilePixels[t]);
+    }
+    return total;
+}
+
+
+static void testAdaptiveAllocation() {
+    const float targetError = 0.02f;
+    const int maxRaysPerPixel = 16;
+    Random rnd(11, false);
+
+    Array<float> tileError;
+    Array<int> tilePixels, tileRays;
+    for (int trial = 0; trial < 20; ++trial) {
+        makeTiles(rnd, targetError, tileError, tilePixels);
+
+        int numPixels = 0, unconvergedPixels = 0, noisiest = 0;
+        for (int t = 0; t < tileError.size(); ++t) {
+            numPixels += tilePixels[t];
+            if (tileError[t] > targetError) {
+                unconvergedPixels += tilePixels[t];
+            }
+            if (tileError[t] > tileError[noisiest]) {
+                noisiest = t;
+            }
+        }
+
+        // A full pass gives every unconverged tile at least one ray per pixel, and noisier
+        // tiles of the same size at least as many rays
+        testAssert(PathTracer::allocateAdaptivePass(tileError, tilePixels, targetError, numPixels, maxRaysPerPixel, tileRays));
+        testAssert(totalRays(tileRays, tilePixels) <= numPixels);
+        for (int t = 0; t < tileError.size(); ++t) {
+            testAssert((tileRays[t] > 0) == (tileError[t] > targetError));
+            testAssert(tileRays[t] <= maxRaysPerPixel);
+            for (int u = 0; u < tileError.size(); ++u) {
+                if ((tilePixels[t] == tilePixels[u]) && (tileError[t] > tileError[u]) && (tileError[u] > targetError)) {
+                    testAssert(tileRays[t] >= tileRays[u]);
+                }
+            }
+        }
+
+        // A pass too small for every unconverged tile goes to the noisiest ones, wherever they are
+        const int64 smallBudget = unconvergedPixels / 3;
+        testAssert(PathTracer::allocateAdaptivePass(tileError, tilePixels, targetError, smallBudget, maxRaysPerPixel, tileRays));
+        testAssert(totalRays(tileRays, tilePixels) <= smallBudget);
+        testAssert(tileRays[noisiest] > 0);
+        for (int t = 0; t < tileError.size(); ++t) {
+            for (int u = 0; u < tileError.size(); ++u) {
+                if ((tilePixels[t] == tilePixels[u]) && (tileError[t] > tileError[u])) {
+                    testAssert(tileRays[t] >= tileRays[u]);
+                }
+            }
+        }
+
+        // Even a pass smaller than one tile makes progress
+        testAssert(PathTracer::allocateAdaptivePass(tileError, tilePixels, targetError, 10, maxRaysPerPixel, tileRays));
+        testAssert(tileRays[noisiest] == 1);
+        testAssert(totalRays(tileRays, tilePixels) == tilePixels[noisiest]);
+    }
+
+    // Nothing to do once every tile has converged
+    makeTiles(rnd, targetError, tileError, tilePixels);
+    for (float& e : tileError) {
+        e = min(e, targetError);
+    }
+    testAssert(! PathTracer::allocateAdaptivePass(tileError, tilePixels, targetError, 1000, maxRaysPerPixel, tileRays));
+    testAssert(totalRays(tileRays, tilePixels) == 0);
+}
+
+
+void testPathTracer() {
+    printf("PathTracer ");
+    testAdaptiveAllocation();
+    printf("passed\n");
+}
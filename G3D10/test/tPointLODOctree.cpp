@@ -0,0 +1,239 @@
+/**
+  \file test/tPointLODOctree.cpp
+
+  G3D Innovation Engine http://casual-effects.com/g3d
+  Copyright 2000-2019, Morgan McGuire
+  All rights reserved
+  Available under the BSD License
+*/
+#include "G3D/G3D.h"
+#include "printhelpers.h"
+#include "testassert.h"
+#include <algorithm>
+
+/** A bumpy terrain sheet with some coincident points */
+static void makeCloud(int n, Random& rnd, Array<Point3>& position, Array<Color4unorm8>& color) {
+    position.resize(n);
+    color.resize(n);
+    for (int i = 0; i < n; ++i) {
+        const float x = rnd.uniform(-50, 50);
+        const float z = rnd.uniform(-50, 50);
+        position[i] = ((i % 97) == 0) ? Point3(1, 2, 3) : Point3(x, 3.0f * sinf(x * 0.2f) * cosf(z * 0.1f), z);
+        color[i] = Color4unorm8(unorm8::fromBits(uint8(i)), unorm8::fromBits(uint8(i >> 8)), unorm8::fromBits(uint8(i >> 16)), unorm8::one());
+    }
+}
+
+
+static shared_ptr<PointLODOctree> build(const String& filename, const PointLODOctree::Specification& specification,
+    const Array<Point3>& position, const Array<Color4unorm8>& color, const Vector3& translation) {
+    const shared_ptr<PointLODOctree::Builder>& builder = PointLODOctree::Builder::create(filename, specification);
+    for (int i = 0; i < position.size(); ++i) {
+        builder->addPoint(position[i], color[i]);
+    }
+    builder->commit(translation);
+    return PointLODOctree::open(filename);
+}
+
+
+/** Reads every point in the octree, identified by its color, and checks that each node is
+    consistent with its parent */
+static void checkOctree(const shared_ptr<PointLODOctree>& octree, const PointLODOctree::Specification& specification,
+    const Array<Point3>& position, const Vector3& translation) {
+
+    const Array<PointLODOctree::Node>& nodes = octree->nodes();
+    testAssert(nodes[0].parent == -1);
+    testAssert(octree->numPoints() == position.size());
+
+    Array<int> seen;
+    seen.resize(position.size());
+    for (int& s : seen) {
+        s = 0;
+    }
+
+    for (int n = 0; n < nodes.size(); ++n) {
+        const PointLODOctree::Node& node = nodes[n];
+        if (node.spacing > 0.0f) {
+            testAssert(node.numPoints <= specification.maxPointsPerNode);
+        }
+        if (n > 0) {
+            const PointLODOctree::Node& parent = nodes[node.parent];
+            testAssert(parent.bounds.contains(node.bounds));
+            testAssert(node.level == parent.level + 1);
+            testAssert(parent.spacing > 0.0f);
+        }
+        for (int o = 0; o < 8; ++o) {
+            testAssert((node.child[o] == -1) || (nodes[node.child[o]].parent == n));
+        }
+
+        const shared_ptr<PointLODOctree::NodePoints>& points = octree->loadPoints(n);
+        testAssert(points->position.size() == node.numPoints);
+        const AABox& slack = AABox(node.bounds.low() - Vector3::one() * 1e-3f, node.bounds.high() + Vector3::one() * 1e-3f);
+        for (int i = 0; i < points->position.size(); ++i) {
+            const Color4unorm8& c = points->color[i];
+            const int index = c.r.bits() | (c.g.bits() << 8) | (c.b.bits() << 16);
+            testAssert(index < position.size());
+            ++seen[index];
+            testAssert((points->position[i] - (position[index] + translation)).length() < 1e-4f);
+            testAssert(slack.contains(points->position[i]));
+        }
+    }
+
+    // Every point is stored exactly once
+    for (const int s : seen) {
+        testAssert(s == 1);
+    }
+}
+
+
+void testPointLODOctree() {
+    printf("PointLODOctree ");
+
+    Random rnd(7, false);
+    Array<Point3> position;
+    Array<Color4unorm8> color;
+    makeCloud(60000, rnd, position, color);
+    const Vector3 translation(5, -1, 2);
+
+    PointLODOctree::Specification specification;
+    specification.maxPointsPerNode = 1000;
+    specification.gridResolution = 16;
+    specification.maxDepth = 8;
+
+    // Built in memory, and out of core with a budget much smaller than the cloud.
+    // Both store each point once, in a node that contains it.
+    const String inMemoryFilename = "tPointLODOctree-temp-a.octree";
+    shared_ptr<PointLODOctree> inMemory = build(inMemoryFilename, specification, position, color, translation);
+    testAssert(notNull(inMemory));
+    checkOctree(inMemory, specification, position, translation);
+
+    specification.maxPointsInMemory = 5000;
+    const String outOfCoreFilename = "tPointLODOctree-temp-b.octree";
+    shared_ptr<PointLODOctree> octree = build(outOfCoreFilename, specification, position, color, translation);
+    testAssert(notNull(octree));
+    checkOctree(octree, specification, position, translation);
+    testAssert(octree->nodes().size() == inMemory->nodes().size());
+    testAssert(! FileSystem::exists(outOfCoreFilename + ".spill.tmp"));
+
+    // A distant viewpoint needs only the root
+    PointLODOctree::Viewpoint viewpoint;
+    viewpoint.eye = Point3(0, 10000, 0);
+    viewpoint.pixelsPerUnit = 500.0f;
+    Array<int> selection;
+    octree->selectNodes(viewpoint, selection);
+    testAssert(selection.size() == 1 && selection[0] == 0);
+
+    // Near a corner, the nodes there are refined more than the far ones
+    viewpoint.eye = Point3(-45, 5, -45) + translation;
+    viewpoint.pixelsPerUnit = 20.0f;
+    selection.fastClear();
+    octree->selectNodes(viewpoint, selection);
+    testAssert(selection.size() > 1);
+    int deepestNear = 0, deepestFar = 0;
+    for (int i = 0; i < selection.size(); ++i) {
+        const PointLODOctree::Node& node = octree->nodes()[selection[i]];
+        // Parents precede their children
+        testAssert((node.parent == -1) || selection.findIndex(node.parent) < i);
+        if (node.bounds.center().x < translation.x) {
+            deepestNear = max(deepestNear, node.level);
+        } else {
+            deepestFar = max(deepestFar, node.level);
+        }
+    }
+    testAssert(deepestNear > deepestFar);
+
+    // The point budget stops refinement early
+    viewpoint.maxPoints = 3000;
+    Array<int> budgeted;
+    octree->selectNodes(viewpoint, budgeted);
+    testAssert(budgeted.size() < selection.size());
+
+    // Clipping planes remove nodes behind them
+    viewpoint.maxPoints = 10000000;
+    const Point3& onPlane = translation - Vector3(1, 0, 0);
+    viewpoint.clipPlanes.append(Plane(Vector3(-1, 0, 0), onPlane));
+    Array<int> clipped;
+    octree->selectNodes(viewpoint, clipped);
+    testAssert(clipped.size() < selection.size());
+    for (const int n : clipped) {
+        testAssert(octree->nodes()[n].bounds.low().x <= onPlane.x);
+    }
+
+    // Only the selected nodes stay resident, except for those within the budget
+    shared_ptr<PointLODOctree> paged = PointLODOctree::open(outOfCoreFilename);
+    paged->makeResident(selection);
+    PointLODOctree::Stats stats = paged->stats();
+    testAssert(stats.numResidentNodes == selection.size());
+    testAssert(stats.numNodeLoads == selection.size());
+    for (const int n : selection) {
+        testAssert(notNull(paged->residentPoints(n)));
+    }
+
+    Array<int> root;
+    root.append(0);
+    paged->makeResident(root);
+    stats = paged->stats();
+    testAssert(stats.numResidentNodes == 1);
+    testAssert(stats.numNodeEvictions == selection.size() - 1);
+    testAssert(stats.numResidentPoints == paged->nodes()[0].numPoints);
+
+    paged->setResidentPointBudget(position.size());
+    paged->makeResident(selection);
+    paged->makeResident(root);
+    testAssert(paged->stats().numResidentNodes == selection.size());
+
+    // Reselecting resident nodes does not read them again
+    const int64 loads = paged->stats().numNodeLoads;
+    paged->makeResident(selection);
+    testAssert(paged->stats().numNodeLoads == loads);
+
+    inMemory.reset();
+    octree.reset();
+    paged.reset();
+    FileSystem::removeFile(inMemoryFilename);
+    FileSystem::removeFile(outOfCoreFilename);
+
+    printf("passed\n");
+}
+
+
+void perfPointLODOctree() {
+    PRINT_SECTION("Performance: PointLODOctree", "4M point terrain, built with a 1M point memory budget");
+
+    Random rnd(11, false);
+    Array<Point3> position;
+    Array<Color4unorm8> color;
+    makeCloud(4000000, rnd, position, color);
+
+    PointLODOctree::Specification specification;
+    specification.maxPointsInMemory = 1000000;
+    const String filename = "tPointLODOctree-temp.octree";
+
+    Stopwatch stopwatch;
+    stopwatch.tick();
+    shared_ptr<PointLODOctree> octree = build(filename, specification, position, color, Vector3::zero());
+    stopwatch.tock();
+    PRINT_MILLI("Build", "ms", stopwatch.elapsedDuration());
+    printf("%d nodes\n", octree->nodes().size());
+
+    // Walk along the terrain, paging in the nodes for each viewpoint
+    PointLODOctree::Viewpoint viewpoint;
+    viewpoint.pixelsPerUnit = 1000.0f;
+    Array<int> selection;
+    int64 selected = 0;
+    stopwatch.tick();
+    for (int frame = 0; frame < 100; ++frame) {
+        viewpoint.eye = Point3(-50.0f + float(frame), 5.0f, 0.0f);
+        selection.fastClear();
+        octree->selectNodes(viewpoint, selection);
+        octree->makeResident(selection);
+        selected += selection.size();
+    }
+    stopwatch.tock();
+    PRINT_MILLI("Select and page 100 views", "ms", stopwatch.elapsedDuration());
+
+    const PointLODOctree::Stats& stats = octree->stats();
+    printf("%d nodes per view, %d resident, %lld loads\n", int(selected / 100), stats.numResidentNodes, (long long)stats.numNodeLoads);
+
+    octree.reset();
+    FileSystem::removeFile(filename);
+}
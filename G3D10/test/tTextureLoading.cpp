@@ -0,0 +1,87 @@
+/**
+  \file test/tTextureLoading.cpp
+
+  G3D Innovation Engine http://casual-effects.com/g3d
+  Copyright 2000-2019, Morgan McGuire
+  All rights reserved
+  Available under the BSD License
+*/
+#include "G3D/G3D.h"
+#include "testassert.h"
+
+static bool queueIs(const Array<shared_ptr<Texture>>& expected) {
+    Array<shared_ptr<Texture>> queue;
+    Texture::getLoadingQueue(queue);
+    if (queue.size() != expected.size()) {
+        return false;
+    }
+    for (int i = 0; i < queue.size(); ++i) {
+        if (queue[i] != expected[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+/** Returns the stats once the pool is idle */
+static Texture::LoadingStats waitForLoading() {
+    const RealTime stop = System::time() + 30.0;
+    Texture::LoadingStats stats = Texture::loadingStats();
+    while (((stats.queued > 0) || (stats.active > 0)) && (System::time() < stop)) {
+        System::sleep(0.001);
+        stats = Texture::loadingStats();
+    }
+    return stats;
+}
+
+
+/** Requires a RenderDevice */
+void testTextureLoading() {
+    printf("Texture lazy loading ");
+
+    // Nothing starts while paused, so the queue is deterministic
+    waitForLoading();
+    Texture::setLoadingPaused(true);
+    const Texture::LoadingStats& before = Texture::loadingStats();
+    testAssert((before.queued == 0) && (before.active == 0));
+
+    const shared_ptr<Texture>& a = Texture::fromFile("ImageTest/test-image.png");
+    const shared_ptr<Texture>& b = Texture::fromFile("ImageTest/test-image.jpg");
+    const shared_ptr<Texture>& c = Texture::fromFile("ImageTest/test-image.bmp");
+    shared_ptr<Texture> d = Texture::fromFile("ImageTest/test-image.tga");
+
+    // Equal priorities load in creation order
+    testAssert(queueIs(Array<shared_ptr<Texture>>(a, b, c, d)));
+
+    // Visible before not visible, then larger projected area first
+    c->setLoadingPriority(true, 10.0f);
+    b->setLoadingPriority(true, 100.0f);
+    d->setLoadingPriority(false, 1000.0f);
+    testAssert(queueIs(Array<shared_ptr<Texture>>(b, c, d, a)));
+
+    // Releasing a queued texture cancels its load
+    d.reset();
+    testAssert(queueIs(Array<shared_ptr<Texture>>(b, c, a)));
+    testAssert(Texture::loadingStats().cancelled == before.cancelled + 1);
+
+    // Forcing a queued texture loads it on this thread, even while paused
+    testAssert(c->openGLID() != GL_NONE);
+    testAssert(queueIs(Array<shared_ptr<Texture>>(b, a)));
+    testAssert(Texture::loadingStats().completed == before.completed + 1);
+    const shared_ptr<Image>& expected = Image::fromFile("ImageTest/test-image.bmp");
+    testAssert((c->width() == expected->width()) && (c->height() == expected->height()));
+
+    // Resuming loads the rest on the pool threads
+    Texture::setLoadingPaused(false);
+    const Texture::LoadingStats& stats = waitForLoading();
+    testAssert((stats.queued == 0) && (stats.active == 0));
+    testAssert(stats.completed == before.completed + 3);
+    testAssert(stats.cancelled == before.cancelled + 1);
+
+    // force() waits for the finished pool job and uploads
+    testAssert((a->openGLID() != GL_NONE) && (b->openGLID() != GL_NONE));
+    Texture::releaseLoadedTextures();
+
+    printf("passed\n");
+}
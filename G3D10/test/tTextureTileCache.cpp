@@ -0,0 +1,161 @@
+/**
+  \file test/tTextureTileCache.cpp
+
+  G3D Innovation Engine http://casual-effects.com/g3d
+  Copyright 2000-2019, Morgan McGuire
+  All rights reserved
+  Available under the BSD License
+*/
+#include "G3D/G3D.h"
+#include "printhelpers.h"
+#include "testassert.h"
+
+/** A texel function for a procedural image whose texel (x, y) encodes its own coordinates */
+static TextureTileCache::TexelFunction coordinateTexels() {
+    return [](int x0, int y0, int width, int height, Color4* dst) {
+        for (int y = 0; y < height; ++y) {
+            for (int x = 0; x < width; ++x) {
+                dst[x + y * width] = Color4(float(x0 + x), float(y0 + y), 0.0f, 1.0f);
+            }
+        }
+    };
+}
+
+
+static void testLevels() {
+    const shared_ptr<TextureTileCache>& cache = TextureTileCache::create(16 * 1024 * 1024);
+    const shared_ptr<TextureTileCache::Source>& source = cache->addSource(100, 37, WrapMode::CLAMP, coordinateTexels());
+
+    // 100, 50, 25, 12, 6, 3, 1
+    testAssert(source->numLevels() == 7);
+    testAssert(fuzzyEq(source->levelForFootprint(1.0f / 100.0f), 0.0f));
+    testAssert(fuzzyEq(source->levelForFootprint(4.0f / 100.0f), 2.0f));
+
+    // Level 0 returns the source texels exactly at texel centers, including across tile boundaries
+    for (int y = 0; y < 37; y += 3) {
+        for (int x = 0; x < 100; x += 7) {
+            const Color4& c = cache->sample(*source, Vector2((float(x) + 0.5f) / 100.0f, (float(y) + 0.5f) / 37.0f), 0.0f);
+            testAssert(fuzzyEq(c.r, float(x)) && fuzzyEq(c.g, float(y)));
+        }
+    }
+
+    // Bilinear interpolation between texels 31 and 32, which are in different tiles
+    const Color4& mid = cache->sample(*source, Vector2(32.0f / 100.0f, 0.5f / 37.0f), 0.0f);
+    testAssert(fuzzyEq(mid.r, 31.5f));
+
+    // Coarser levels average the finer ones: texel (1, 0) of level 1 covers level 0 texels 2 and 3
+    const Color4& coarse = cache->sample(*source, Vector2(1.5f / 50.0f, 0.5f / 18.0f), 1.0f);
+    testAssert(fuzzyEq(coarse.r, 2.5f) && fuzzyEq(coarse.g, 0.5f));
+}
+
+
+static void testConstant() {
+    const shared_ptr<TextureTileCache>& cache = TextureTileCache::create(16 * 1024 * 1024);
+    const shared_ptr<TextureTileCache::Source>& source = cache->addSource(77, 130, WrapMode::TILE, [](int x0, int y0, int width, int height, Color4* dst) {
+        for (int i = 0; i < width * height; ++i) {
+            dst[i] = Color4(0.25f, 0.5f, 0.75f, 1.0f);
+        }
+    });
+
+    Random rnd(3, false);
+    for (int i = 0; i < 1000; ++i) {
+        const Vector2 texCoord(rnd.uniform(-2.0f, 2.0f), rnd.uniform(-2.0f, 2.0f));
+        const Color4& c = cache->sample(*source, texCoord, rnd.uniform(0.0f, float(source->numLevels())));
+        testAssert(c.fuzzyEq(Color4(0.25f, 0.5f, 0.75f, 1.0f)));
+    }
+}
+
+
+static void testEviction() {
+    // Budget for about four tiles, and touch many more
+    const size_t tileBytes = TextureTileCache::TILE_SIZE * TextureTileCache::TILE_SIZE * sizeof(Color4);
+    const shared_ptr<TextureTileCache>& cache = TextureTileCache::create(tileBytes * 9 / 2);
+    shared_ptr<TextureTileCache::Source> source = cache->addSource(512, 512, WrapMode::CLAMP, coordinateTexels());
+
+    const float texel = 1.0f / 512.0f;
+    for (int y = 0; y < 512; y += 32) {
+        for (int x = 0; x < 512; x += 32) {
+            const Color4& c = cache->sample(*source, Vector2((float(x) + 0.5f) * texel, (float(y) + 0.5f) * texel), 0.0f);
+            testAssert(fuzzyEq(c.r, float(x)) && fuzzyEq(c.g, float(y)));
+        }
+        cache->advanceEpoch();
+    }
+
+    TextureTileCache::Stats stats = cache->stats();
+    testAssert(stats.misses == 256);
+    testAssert(stats.evictions > 0);
+    testAssert(stats.residentBytes <= cache->memoryBudget());
+
+    // Repeating a lookup hits, and evicted tiles are recreated correctly
+    cache->resetStats();
+    const Color4& first = cache->sample(*source, Vector2(0.5f, 0.5f) * texel, 0.0f);
+    testAssert(fuzzyEq(first.r, 0.0f) && fuzzyEq(first.g, 0.0f));
+    cache->sample(*source, Vector2(0.5f, 0.5f) * texel, 0.0f);
+    stats = cache->stats();
+    testAssert((stats.hits == 1) && (stats.misses == 1));
+
+    // Releasing the source frees its tiles at the next epoch
+    weak_ptr<TextureTileCache::Source> weakSource = source;
+    source.reset();
+    cache->advanceEpoch();
+    testAssert(weakSource.expired());
+    testAssert(cache->stats().residentTiles == 0);
+}
+
+
+static void testConcurrent() {
+    const shared_ptr<TextureTileCache>& cache = TextureTileCache::create(64 * 1024 * 1024);
+    const shared_ptr<TextureTileCache::Source>& source = cache->addSource(300, 300, WrapMode::TILE, coordinateTexels());
+
+    std::atomic<int> errors(0);
+    runConcurrently(0, 10000, [&](int i) {
+        const int x = (i * 7919) % 300, y = (i * 104729) % 300;
+        const Color4& c = cache->sample(*source, Vector2((float(x) + 0.5f) / 300.0f, (float(y) + 0.5f) / 300.0f), 0.0f);
+        if (! fuzzyEq(c.r, float(x)) || ! fuzzyEq(c.g, float(y))) {
+            ++errors;
+        }
+        cache->sample(*source, Vector2(float(x), float(y)) / 300.0f, float(i % 9));
+    });
+    testAssert(errors == 0);
+}
+
+
+void testTextureTileCache() {
+    printf("TextureTileCache ");
+    testLevels();
+    testConstant();
+    testEviction();
+    testConcurrent();
+    printf("passed\n");
+}
+
+
+void perfTextureTileCache() {
+    PRINT_SECTION("Performance: TextureTileCache", "4096 x 4096 procedural texture, 1M samples in batches of 64k");
+
+    const shared_ptr<TextureTileCache>& cache = TextureTileCache::create(32 * 1024 * 1024);
+    const shared_ptr<TextureTileCache::Source>& source = cache->addSource(4096, 4096, WrapMode::TILE, coordinateTexels());
+
+    Array<Vector2> texCoord;
+    texCoord.resize(1000000);
+    Random rnd(1, false);
+    for (Vector2& t : texCoord) {
+        t = Vector2(rnd.uniform(), rnd.uniform());
+    }
+
+    Stopwatch stopwatch;
+    for (const float level : {0.0f, 6.0f}) {
+        cache->clear();
+        cache->resetStats();
+        stopwatch.tick();
+        for (int start = 0; start < texCoord.size(); start += 65536) {
+            runConcurrently(start, min(start + 65536, texCoord.size()), [&](int i) {
+                cache->sample(*source, texCoord[i], level);
+            });
+            cache->advanceEpoch();
+        }
+        stopwatch.tock();
+        PRINT_MILLI((level == 0.0f) ? "Random, level 0" : "Random, level 6", "ms", stopwatch.elapsedDuration());
+        printf("    hit rate %.1f%%\n", 100.0f * cache->stats().hitRate());
+    }
+}
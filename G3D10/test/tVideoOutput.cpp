@@ -0,0 +1,65 @@
+/**
+  \file test/tVideoOutput.cpp
+
+  G3D Innovation Engine http://casual-effects.com/g3d
+  Copyright 2000-2019, Morgan McGuire
+  All rights reserved
+  Available under the BSD License
+*/
+#include "G3D/G3D.h"
+#include "testassert.h"
+
+#ifndef G3D_NO_FFMPEG
+
+static void encodeFrames(VideoOutput::QueueFullPolicy policy, const ImageFormat* format) {
+    const String filename = "tVideoOutput-temp.mp4";
+
+    VideoOutput::Settings settings;
+    settings.width  = 64;
+    settings.height = 48;
+    settings.fps    = 30;
+    settings.setBitrateQuality();
+    settings.encoder         = VideoOutput::Encoder::MPEG4();
+    settings.asynchronous    = true;
+    settings.maxQueuedFrames = 2;
+    settings.queueFullPolicy = policy;
+
+    const shared_ptr<VideoOutput>& video = VideoOutput::create(filename, settings);
+    if (isNull(video)) {
+        printf("(MPEG-4 encoder unavailable, skipping) ");
+        return;
+    }
+
+    const shared_ptr<CPUPixelTransferBuffer>& frame = CPUPixelTransferBuffer::create(settings.width, settings.height, format);
+    const int numFrames = 20;
+    for (int i = 0; i < numFrames; ++i) {
+        System::memset(frame->buffer(), i * 10, frame->size());
+        video->append(frame);
+    }
+    video->commit();
+
+    const VideoOutput::Stats& stats = video->stats();
+    testAssert(stats.framesAppended == numFrames);
+    testAssert(stats.framesEncoded + stats.framesDropped == numFrames);
+    testAssert(stats.queueDepth == 0);
+    testAssert(stats.maxQueueDepth <= settings.maxQueuedFrames);
+    if (policy == VideoOutput::QueueFullPolicy::BLOCK) {
+        testAssert(stats.framesDropped == 0);
+    }
+
+    testAssert(FileSystem::exists(filename));
+    FileSystem::removeFile(filename);
+}
+
+#endif
+
+void testVideoOutput() {
+    printf("VideoOutput ");
+#   ifndef G3D_NO_FFMPEG
+        encodeFrames(VideoOutput::QueueFullPolicy::BLOCK, ImageFormat::RGB8());
+        encodeFrames(VideoOutput::QueueFullPolicy::BLOCK, ImageFormat::RGBA8());
+        encodeFrames(VideoOutput::QueueFullPolicy::DROP_NEWEST, ImageFormat::RGB8());
+        encodeFrames(VideoOutput::QueueFullPolicy::DROP_OLDEST, ImageFormat::RGB8());
+#   endif
+    printf("passed\n");
+}
@@ -0,0 +1,131 @@
+/**
+  \file test/tVoxelOctree.cpp
+
+  G3D Innovation Engine http://casual-effects.com/g3d
+  Copyright 2000-2019, Morgan McGuire
+  All rights reserved
+  Available under the BSD License
+*/
+#include "G3D/G3D.h"
+#include "printhelpers.h"
+#include "testassert.h"
+
+static void makeVoxels(int n, int extent, Random& rnd, Array<Point3int16>& position, Array<Color4unorm8>& color) {
+    position.resize(n);
+    color.resize(n);
+    for (int i = 0; i < n; ++i) {
+        position[i] = Point3int16(int16(rnd.integer(-extent, extent)), int16(rnd.integer(-extent, extent) / 2), int16(rnd.integer(-extent, extent)));
+        color[i] = Color4unorm8(Color4(rnd.uniform(), rnd.uniform(), rnd.uniform(), 1.0f));
+    }
+}
+
+
+void testVoxelOctree() {
+    printf("VoxelOctree ");
+
+    Random rnd(3, false);
+    const float voxelRadius = 0.25f;
+    Array<Point3int16> position;
+    Array<Color4unorm8> color;
+    makeVoxels(800, 20, rnd, position, color);
+
+    // Duplicates keep the first occurrence
+    position.append(position[0]);
+    color.append(Color4unorm8::zero());
+
+    const shared_ptr<VoxelOctree>& tree = VoxelOctree::create(position, color, voxelRadius);
+    testAssert(tree->numNodes(0) == 1);
+    testAssert(tree->numNodes(tree->depth()) == tree->numVoxels());
+    testAssert(tree->numVoxels() < position.size());
+    testAssert(tree->sizeInBytes() > 0);
+
+    // Every voxel can be found at full resolution, and coarse levels cover it
+    for (int i = 0; i < 50; ++i) {
+        const Point3& P = Point3(position[i]) * 2.0f * voxelRadius;
+        Color4unorm8 c;
+        testAssert(tree->lodColor(P, tree->depth(), c));
+        testAssert(tree->lodColor(P, 2, c));
+    }
+
+    // Compare ray casts against testing every voxel
+    for (int r = 0; r < 300; ++r) {
+        Vector3 d;
+        rnd.sphere(d.x, d.y, d.z);
+        const Point3 origin(rnd.uniform(-15, 15), rnd.uniform(-15, 15), rnd.uniform(-15, 15));
+        const Ray ray(origin, d);
+
+        float expected = finf();
+        for (const Point3int16& p : position) {
+            const Point3& C = Point3(p) * 2.0f * voxelRadius;
+            const AABox box(C - Vector3::one() * voxelRadius, C + Vector3::one() * voxelRadius);
+            const float t = box.contains(origin) ? 0.0f : ray.intersectionTime(box);
+            expected = min(expected, t);
+        }
+
+        VoxelOctree::Hit hit;
+        const bool found = tree->intersectRay(ray, hit);
+        testAssert(found == (expected < finf()));
+        if (found) {
+            testAssert(fuzzyEq(hit.distance, expected) || (fabs(hit.distance - expected) < 1e-3f));
+            testAssert(hit.normal.dot(d) <= 0.0f);
+            const Point3& C = Point3(position[hit.voxelIndex]) * 2.0f * voxelRadius;
+            const Vector3& offset = ray.origin() + d * hit.distance - C;
+            testAssert(max(fabsf(offset.x), fabsf(offset.y), fabsf(offset.z)) <= voxelRadius * 1.001f);
+
+            // Coarser levels are hit no later
+            VoxelOctree::Hit coarse;
+            testAssert(tree->intersectRay(ray, coarse, 2) && (coarse.distance <= hit.distance + 1e-4f) && (coarse.level == 2));
+        }
+    }
+
+    printf("passed\n");
+}
+
+
+void perfVoxelOctree() {
+    PRINT_SECTION("Performance: VoxelOctree", "Voxelized 1024 x 1024 terrain and 1M rays cast down onto it");
+
+    // One column of voxels per (x, z), down to the lower of the neighbors so that there are no holes
+    Array<Point3int16> position;
+    Array<Color4unorm8> color;
+    const int size = 1024;
+    const auto height = [](int x, int z) {
+        return int(40.0f * sinf(float(x) * 0.02f) * cosf(float(z) * 0.03f) + 10.0f * sinf(float(x + z) * 0.1f));
+    };
+    for (int z = 0; z < size; ++z) {
+        for (int x = 0; x < size; ++x) {
+            const int h = height(x, z);
+            const int bottom = min(h, height(x + 1, z), height(x, z + 1)) - 1;
+            for (int y = bottom; y <= h; ++y) {
+                position.append(Point3int16(int16(x - size / 2), int16(y), int16(z - size / 2)));
+                color.append(Color4unorm8(Color4(0.2f, 0.5f + 0.01f * float(y), 0.1f, 1.0f)));
+            }
+        }
+    }
+
+    Stopwatch stopwatch;
+    stopwatch.tick();
+    const shared_ptr<VoxelOctree>& tree = VoxelOctree::create(position, color, 0.5f);
+    stopwatch.tock();
+    PRINT_MILLI("Build", "ms", stopwatch.elapsedDuration());
+    printf("%d levels, %d voxels, %d MB\n", tree->depth(), tree->numVoxels(), int(tree->sizeInBytes() / (1024 * 1024)));
+
+    Random rnd(5, false);
+    Array<Ray> rayArray;
+    rayArray.resize(1000000);
+    for (Ray& ray : rayArray) {
+        const Vector3& d = Vector3(rnd.uniform(-1, 1), -1.0f, rnd.uniform(-1, 1)).direction();
+        ray = Ray(Point3(rnd.uniform(-400, 400), 200.0f, rnd.uniform(-400, 400)), d);
+    }
+
+    Array<VoxelOctree::Hit> hitArray;
+    stopwatch.tick();
+    tree->intersectRays(rayArray, hitArray);
+    stopwatch.tock();
+    PRINT_MILLI("Cast rays", "ms", stopwatch.elapsedDuration());
+
+    stopwatch.tick();
+    tree->intersectRays(rayArray, hitArray, tree->depth() - 3);
+    stopwatch.tock();
+    PRINT_MILLI("Cast rays (1/8 resolution)", "ms", stopwatch.elapsedDuration());
+}
@@ -0,0 +1,232 @@
+/**
+  \file test/tWebFrameStreamer.cpp
+
+  G3D Innovation Engine http://casual-effects.com/g3d
+  Copyright 2000-2019, Morgan McGuire
+  All rights reserved
+  Available under the BSD License
+*/
+#include "G3D/G3D.h"
+#include "testassert.h"
+#include <mutex>
+
+/** Records the messages sent to it instead of writing to a network connection */
+class FakeFrameSocket : public WebServer::WebSocket {
+protected:
+    mutable std::mutex      m_mutex;
+    Array<Any>              m_headerArray;
+
+    /** Number of upcoming send() calls that fail without recording anything */
+    int                     m_failuresRemaining = 0;
+
+public:
+
+    FakeFrameSocket(int port) : WebSocket(nullptr, nullptr, NetAddress(0x7F000001, uint16(port))) {}
+
+    static shared_ptr<FakeFrameSocket> create(int port) {
+        return createShared<FakeFrameSocket>(port);
+    }
+
+    virtual int send(Opcode opcode, const uint8* data, size_t dataLen) override {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_failuresRemaining > 0) {
+                --m_failuresRemaining;
+                return -1;
+            }
+        }
+
+        testAssert(opcode == BINARY);
+        const int headerLength = (data[0] << 24) | (data[1] << 16) | (data[2] << 8) | data[3];
+        testAssert(4 + headerLength < int(dataLen));
+        TextInput t(TextInput::FROM_STRING, reinterpret_cast<const char*>(data + 4), headerLength);
+        const Any header(t);
+
+        // The header accounts for all of the image data
+        int64 total = 4 + headerLength;
+        if (int(header["type"]) == WebFrameStreamer::TILES) {
+            for (int i = 0; i < header["tiles"].size(); ++i) {
+                total += int(header["tiles"][i][4]);
+            }
+            testAssert(total == int64(dataLen));
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_headerArray.append(header);
+        return int(dataLen);
+    }
+
+    void failNextSends(int count) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_failuresRemaining = count;
+    }
+
+    int numMessages() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_headerArray.size();
+    }
+
+    Any message(int i) const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_headerArray[i];
+    }
+};
+
+
+/** Polls until the socket has received \a count messages. Returns false after a timeout. */
+static bool waitForMessages(const shared_ptr<FakeFrameSocket>& socket, int count) {
+    const RealTime stop = System::time() + 10.0;
+    while (socket->numMessages() < count) {
+        if (System::time() > stop) {
+            return false;
+        }
+        System::sleep(0.001);
+    }
+    return true;
+}
+
+
+static void waitForEncoder(const shared_ptr<WebFrameStreamer>& streamer) {
+    const RealTime stop = System::time() + 10.0;
+    while (true) {
+        const WebFrameStreamer::Stats& stats = streamer->stats();
+        if ((stats.framesEncoded + stats.framesUnchanged + stats.framesDropped == stats.framesSubmitted) || (System::time() > stop)) {
+            return;
+        }
+        System::sleep(0.001);
+    }
+}
+
+
+static void acknowledge(const shared_ptr<WebFrameStreamer>& streamer, const shared_ptr<FakeFrameSocket>& socket, int frame) {
+    const String& msg = format("{\"type\": 1000, \"frame\": %d}", frame);
+    testAssert(streamer->onClientData(socket, WebServer::WebSocket::TEXT, msg.c_str(), msg.size()));
+}
+
+
+void testWebFrameStreamer() {
+    printf("WebFrameStreamer ");
+
+    WebFrameStreamer::Specification specification;
+    specification.fileFormat = Image::PNG;
+    specification.tileSize = 16;
+    specification.numSenderThreads = 2;
+    const shared_ptr<WebFrameStreamer>& streamer = WebFrameStreamer::create(specification);
+
+    const shared_ptr<FakeFrameSocket>& fast = FakeFrameSocket::create(1);
+    const shared_ptr<FakeFrameSocket>& slow = FakeFrameSocket::create(2);
+    streamer->addClient(fast);
+    streamer->addClient(slow);
+    testAssert(streamer->hasClients());
+
+    // The first frame is sent complete
+    const shared_ptr<Image>& image = Image::create(64, 32, ImageFormat::RGB8());
+    image->setAll(Color3::black());
+    streamer->submitFrame(image);
+    testAssert(waitForMessages(fast, 1) && waitForMessages(slow, 1));
+    testAssert(int(fast->message(0)["type"]) == WebFrameStreamer::TILES);
+    testAssert(fast->message(0)["tiles"].size() == 8);
+    testAssert(int(fast->message(0)["frame"]) == 1);
+
+    // Only the changed tile is sent to the client that acknowledged
+    acknowledge(streamer, fast, 1);
+    const shared_ptr<Image>& second = Image::create(64, 32, ImageFormat::RGB8());
+    second->setAll(Color3::black());
+    second->set(Point2int32(20, 5), Color3::white());
+    streamer->submitFrame(second);
+    testAssert(waitForMessages(fast, 2));
+    testAssert(fast->message(1)["tiles"].size() == 1);
+    testAssert(int(fast->message(1)["tiles"][0][0]) == 16);
+    testAssert(int(fast->message(1)["tiles"][0][1]) == 0);
+
+    // An identical frame is not sent at all
+    const shared_ptr<Image>& repeat = Image::create(64, 32, ImageFormat::RGB8());
+    repeat->setAll(Color3::black());
+    repeat->set(Point2int32(20, 5), Color3::white());
+    streamer->submitFrame(repeat);
+    waitForEncoder(streamer);
+    testAssert(streamer->stats().framesUnchanged == 1);
+
+    // Another change in a different tile
+    acknowledge(streamer, fast, 2);
+    const shared_ptr<Image>& third = Image::create(64, 32, ImageFormat::RGB8());
+    third->setAll(Color3::black());
+    third->set(Point2int32(20, 5), Color3::white());
+    third->set(Point2int32(50, 20), Color3::white());
+    streamer->submitFrame(third);
+    testAssert(waitForMessages(fast, 3));
+    testAssert(fast->message(2)["tiles"].size() == 1);
+    waitForEncoder(streamer);
+
+    // The slow client never acknowledged its first frame, so it received nothing more
+    testAssert(slow->numMessages() == 1);
+
+    // When it catches up, it receives the union of the changes it missed in one message
+    acknowledge(streamer, slow, 1);
+    testAssert(waitForMessages(slow, 2));
+    testAssert(int(slow->message(1)["frame"]) == 3);
+    testAssert(slow->message(1)["tiles"].size() == 2);
+
+    // Statistics are updated after send() returns
+    Array<WebFrameStreamer::ClientStats> clientStats;
+    const RealTime stop = System::time() + 10.0;
+    do {
+        System::sleep(0.001);
+        streamer->getClientStats(clientStats);
+    } while ((clientStats[0].framesSent + clientStats[1].framesSent < 5) && (System::time() < stop));
+    testAssert(clientStats.size() == 2);
+    for (const WebFrameStreamer::ClientStats& stats : clientStats) {
+        testAssert(stats.bytesSent > 0);
+        testAssert(stats.framesInFlight == 1);
+        if (stats.clientAddress.port() == 2) {
+            testAssert(stats.framesSent == 2);
+            testAssert(stats.framesSkipped == 1);
+        } else {
+            testAssert(stats.framesSent == 3);
+            testAssert(stats.framesSkipped == 0);
+        }
+    }
+
+    // Messages that are not acknowledgements are left for the application
+    const String& keyMessage = "{\"type\": 2, \"key\": {\"keysym\": {\"sym\": 119}}}";
+    testAssert(! streamer->onClientData(fast, WebServer::WebSocket::TEXT, keyMessage.c_str(), keyMessage.size()));
+
+    // Removed clients receive nothing further
+    streamer->removeClient(fast);
+    streamer->removeClient(slow);
+    testAssert(! streamer->hasClients());
+    const shared_ptr<Image>& fourth = Image::create(64, 32, ImageFormat::RGB8());
+    fourth->setAll(Color3::white());
+    streamer->submitFrame(fourth);
+    waitForEncoder(streamer);
+    System::sleep(0.05);
+    testAssert(fast->numMessages() == 3);
+    testAssert(slow->numMessages() == 2);
+
+    // A failed send is retried with every tile, without waiting for a newer frame
+    {
+        const shared_ptr<WebFrameStreamer>& retrying = WebFrameStreamer::create(specification);
+        const shared_ptr<FakeFrameSocket>& flaky = FakeFrameSocket::create(3);
+        retrying->addClient(flaky);
+
+        flaky->failNextSends(1);
+        retrying->submitFrame(image);
+        testAssert(waitForMessages(flaky, 1));
+        testAssert(int(flaky->message(0)["frame"]) == 1);
+        testAssert(flaky->message(0)["tiles"].size() == 8);
+
+        // Even when only one tile changed
+        acknowledge(retrying, flaky, 1);
+        flaky->failNextSends(1);
+        retrying->submitFrame(second);
+        testAssert(waitForMessages(flaky, 2));
+        testAssert(int(flaky->message(1)["frame"]) == 2);
+        testAssert(flaky->message(1)["tiles"].size() == 8);
+
+        retrying->getClientStats(clientStats);
+        testAssert((clientStats.size() == 1) && (clientStats[0].framesSent == 2) && (clientStats[0].framesSkipped == 0));
+        retrying->removeClient(flaky);
+    }
+
+    printf("passed\n");
+}
@@ -0,0 +1,78 @@
+/**
+  \file test/tWelder.cpp
+
+  G3D Innovation Engine http://casual-effects.com/g3d
+  Copyright 2000-2019, Morgan McGuire
+  All rights reserved
+  Available under the BSD License
+*/
+#include "G3D/G3D.h"
+#include "testassert.h"
+
+/** An indexed heightfield whose vertices are jittered by up to \a jitter, with every
+    vertex duplicated per triangle and a few texture seams */
+static void makeMesh(int gridSize, float jitter, Array<Vector3>& vertexArray, Array<Vector2>& texCoordArray, Array<int>& indexArray) {
+    Random rnd(5678, false);
+    for (int y = 0; y < gridSize; ++y) {
+        for (int x = 0; x < gridSize; ++x) {
+            int corner[4];
+            for (int i = 0; i < 4; ++i) {
+                const int cx = x + (i & 1);
+                const int cy = y + (i >> 1);
+                corner[i] = vertexArray.size();
+                vertexArray.append(Vector3(float(cx), float((cx * 7 + cy * 3) % 5) * 0.2f, float(cy)) +
+                                   Vector3(rnd.uniform(-jitter, jitter), rnd.uniform(-jitter, jitter), rnd.uniform(-jitter, jitter)));
+                texCoordArray.append(Vector2(float(cx), float(cy)) / float(gridSize) + ((x % 7 == 3) ? Vector2(0.5f, 0.0f) : Vector2::zero()));
+            }
+            indexArray.append(corner[0], corner[1], corner[3]);
+            indexArray.append(corner[0], corner[3], corner[2]);
+        }
+    }
+}
+
+
+static void testMatchesSerial(float jitter, const Welder::Settings& settings) {
+    Array<Vector3> vertexArray[2];
+    Array<Vector2> texCoordArray[2];
+    Array<Vector3> normalArray[2];
+    Array<int>     indexArray[2];
+
+    for (int s = 0; s < 2; ++s) {
+        makeMesh(40, jitter, vertexArray[s], texCoordArray[s], indexArray[s]);
+        Welder::weld(vertexArray[s], texCoordArray[s], normalArray[s], indexArray[s], settings, s == 1);
+    }
+
+    // Welding happened
+    testAssert(vertexArray[0].size() < indexArray[0].size() / 2);
+
+    // The parallel and serial implementations agree exactly
+    testAssert(vertexArray[0].size() == vertexArray[1].size());
+    testAssert(indexArray[0].size() == indexArray[1].size());
+    for (int i = 0; i < vertexArray[0].size(); ++i) {
+        testAssert(vertexArray[0][i] == vertexArray[1][i]);
+        testAssert(normalArray[0][i] == normalArray[1][i]);
+        testAssert(texCoordArray[0][i] == texCoordArray[1][i]);
+    }
+    for (int i = 0; i < indexArray[0].size(); ++i) {
+        testAssert(indexArray[0][i] == indexArray[1][i]);
+    }
+}
+
+
+void testWelder() {
+    printf("Welder ");
+
+    Welder::Settings settings;
+    testMatchesSerial(0.0f, settings);
+    testMatchesSerial(0.0004f, settings);
+
+    // Jitter comparable to the radius, so that first-fit order decides many welds
+    settings.vertexWeldRadius = 0.05f;
+    settings.normalWeldRadius = 0.5f;
+    testMatchesSerial(0.03f, settings);
+
+    settings.vertexWeldRadius = 0.0f;
+    testMatchesSerial(0.0f, settings);
+
+    printf("passed\n");
+}